@@ -0,0 +1,49 @@
+/**
+ * @file adaptive.c
+ * @brief Xrun/load thresholds deciding when to grow or shrink the audio buffering.
+ *
+ * Kept free of any audio API so the policy can be unit tested by feeding it
+ * synthetic observations.
+ */
+
+ #include <string.h>
+
+ #include "adaptive.h"
+
+ void adaptive_policy_reset(AdaptivePolicy *p) {
+     memset(p, 0, sizeof(*p));
+ }
+
+ void adaptive_policy_applied(AdaptivePolicy *p) {
+     adaptive_policy_reset(p);
+     p->settle_time = ADAPTIVE_SETTLE_SEC;
+ }
+
+ AdaptiveDecision adaptive_policy_update(AdaptivePolicy *p, unsigned long new_xruns, double load, double elapsed_sec) {
+     // A freshly reopened stream often glitches once; ignore it while settling
+     if (p->settle_time > 0.0) {
+         p->settle_time -= elapsed_sec;
+         return ADAPTIVE_HOLD;
+     }
+
+     p->window_time += elapsed_sec;
+     p->window_xruns += new_xruns;
+
+     if (new_xruns > 0 || load >= ADAPTIVE_LOAD_HIGH) {
+         p->stable_time = 0.0;
+     } else if (load < ADAPTIVE_LOAD_LOW) {
+         p->stable_time += elapsed_sec;
+     }
+
+     if (p->window_xruns >= ADAPTIVE_XRUN_THRESHOLD || load >= ADAPTIVE_LOAD_HIGH) {
+         return ADAPTIVE_STEP_UP;
+     }
+     if (p->window_time >= ADAPTIVE_XRUN_WINDOW_SEC) {
+         p->window_time = 0.0;
+         p->window_xruns = 0;
+     }
+     if (p->stable_time >= ADAPTIVE_STABLE_SEC) {
+         return ADAPTIVE_STEP_DOWN;
+     }
+     return ADAPTIVE_HOLD;
+ }
@@ -0,0 +1,71 @@
+/**
+ * @file adaptive.h
+ * @brief Policy that decides when the audio engine should change its latency.
+ *
+ * The audio module samples the xrun counter and the measured DSP load a few
+ * times per second and feeds them to adaptive_policy_update(). Repeated xruns
+ * or a sustained high load ask for more buffering; a long stretch without
+ * either asks to step back down. The policy only decides, audio.c applies the
+ * step (larger lookahead or a reopened stream with a larger buffer).
+ */
+
+ #ifndef ADAPTIVE_H
+ #define ADAPTIVE_H
+
+ // --- Policy Thresholds ---
+ #define ADAPTIVE_POLL_MS 250            ///< Interval at which the audio module samples the statistics.
+ #define ADAPTIVE_XRUN_WINDOW_SEC 5.0    ///< Window in which xruns are counted.
+ #define ADAPTIVE_XRUN_THRESHOLD 2UL     ///< Xruns within one window that trigger a step up.
+ #define ADAPTIVE_LOAD_HIGH 0.80         ///< DSP load (render time / block time) that triggers a step up.
+ #define ADAPTIVE_LOAD_LOW 0.50          ///< DSP load below which the stream counts as stable.
+ #define ADAPTIVE_STABLE_SEC 60.0        ///< Stable time required before stepping down.
+ #define ADAPTIVE_SETTLE_SEC 2.0         ///< Hold-off after a step while the new setting settles.
+
+ /**
+  * @enum AdaptiveDecision
+  * @brief Result of one policy update.
+  */
+ typedef enum {
+     ADAPTIVE_STEP_DOWN = -1, ///< Stable for long enough: halve the buffering.
+     ADAPTIVE_HOLD = 0,       ///< Keep the current setting.
+     ADAPTIVE_STEP_UP = 1     ///< Xruns or overload: double the buffering.
+ } AdaptiveDecision;
+
+ /**
+  * @struct AdaptivePolicy
+  * @brief Accumulated observations since the last step.
+  */
+ typedef struct {
+     double window_time;          ///< Seconds elapsed in the current xrun window.
+     unsigned long window_xruns;  ///< Xruns seen in the current window.
+     double stable_time;          ///< Seconds without xruns and with low load.
+     double settle_time;          ///< Remaining hold-off after the last step.
+ } AdaptivePolicy;
+
+ /**
+  * @brief Clears all observations (no hold-off).
+  * @param[out] p The policy state.
+  */
+ void adaptive_policy_reset(AdaptivePolicy *p);
+
+ /**
+  * @brief Restarts the observations after a step was applied.
+  *
+  * Xruns caused by reopening the stream fall into the hold-off period and are
+  * not held against the new setting.
+  *
+  * @param[out] p The policy state.
+  */
+ void adaptive_policy_applied(AdaptivePolicy *p);
+
+ /**
+  * @brief Adds one sampling interval's observations and decides on a step.
+  * @param[in,out] p The policy state.
+  * @param new_xruns Xruns (device and lookahead underruns) since the previous update.
+  * @param load Current DSP load as a fraction of the block time (negative if unknown).
+  * @param elapsed_sec Seconds since the previous update.
+  * @return The decision. The caller calls adaptive_policy_applied() if it acted on it.
+  */
+ AdaptiveDecision adaptive_policy_update(AdaptivePolicy *p, unsigned long new_xruns, double load, double elapsed_sec);
+
+ #endif // ADAPTIVE_H
@@ -0,0 +1,182 @@
+/**
+ * @file arp.c
+ * @brief Implements the arpeggiator: the held notes and the pattern played on the tempo grid.
+ */
+
+ #include <string.h>
+
+ #include "arp.h"
+
+ #define ARP_PATTERN_MAX (ARP_MAX_NOTES * ARP_MAX_OCTAVES)
+
+
+ // --- Helper Functions ---
+
+ /** @brief xorshift32: the next value of the random mode's generator. */
+ static uint32_t arp_random(Arp *a) {
+     uint32_t x = a->rng;
+
+     x ^= x << 13;
+     x ^= x >> 17;
+     x ^= x << 5;
+     return a->rng = x;
+ }
+
+ /**
+  * @brief Lists the notes a pass of the pattern walks through, lowest first
+  * (in key order for ARP_AS_PLAYED), octave by octave.
+  * @return The number of notes.
+  */
+ static int arp_pattern(const Arp *a, uint8_t *notes, uint8_t *velocities) {
+     uint8_t order[ARP_MAX_NOTES];
+     int n = 0;
+
+     for (int i = 0; i < a->count; i++) {
+         int j = i;
+         // Insertion sort of at most ARP_MAX_NOTES indices, by pitch unless played order is wanted
+         if (a->mode != ARP_AS_PLAYED) {
+             while (j > 0 && a->held[order[j - 1]] > a->held[i]) { order[j] = order[j - 1]; j--; }
+         }
+         order[j] = (uint8_t)i;
+     }
+     for (int o = 0; o < a->octaves; o++) {
+         for (int i = 0; i < a->count; i++) {
+             int note = a->held[order[i]] + 12 * o;
+             if (note > 127) continue;
+             notes[n] = (uint8_t)note;
+             velocities[n++] = a->velocity[order[i]];
+         }
+     }
+     return n;
+ }
+
+ /** @brief Index into the pattern of `len` notes the current step plays. */
+ static int arp_pick(Arp *a, int len) {
+     unsigned long period;
+
+     switch (a->mode) {
+         case ARP_DOWN:
+             return len - 1 - (int)(a->position % (unsigned long)len);
+         case ARP_UP_DOWN:
+             if (len == 1) return 0;
+             period = 2 * (unsigned long)len - 2;
+             return (a->position % period < (unsigned long)len) ? (int)(a->position % period)
+                                                                 : (int)(period - a->position % period);
+         case ARP_RANDOM:
+             return (int)(arp_random(a) % (uint32_t)len);
+         default:
+             return (int)(a->position % (unsigned long)len);
+     }
+ }
+
+
+ // --- Public Functions ---
+
+ void arp_init(Arp *a, ArpMode mode, double tempo, double rate, double gate, int octaves) {
+     memset(a, 0, sizeof(*a));
+     a->mode = mode;
+     a->tempo = (tempo > 0.0) ? tempo : ARP_DEFAULT_TEMPO;
+     a->rate = (rate > 0.0) ? rate : ARP_DEFAULT_RATE;
+     a->gate = (gate < ARP_MIN_GATE) ? ARP_MIN_GATE : (gate > 1.0) ? 1.0 : gate;
+     a->octaves = (octaves < 1) ? 1 : (octaves > ARP_MAX_OCTAVES) ? ARP_MAX_OCTAVES : octaves;
+     a->sounding = -1;
+     a->off_frame = ARP_NEVER;
+     a->rng = ARP_SEED;
+ }
+
+ int arp_enabled(const Arp *a) {
+     return a->mode != ARP_OFF;
+ }
+
+ void arp_set_sample_rate(Arp *a, double sampleRate) {
+     double step_frames = sampleRate * 60.0 / (a->tempo * a->rate);
+
+     a->sample_rate = sampleRate;
+     if (step_frames == a->grid.step_frames) return;
+     a->grid.step_frames = step_frames;
+     if (a->count > 0) tempogrid_align(&a->grid, a->grid.step_frame);
+ }
+
+ void arp_sync(Arp *a, double beat_frame, double beat, double tempo, uint64_t frame, int restart) {
+     a->tempo = tempo;
+     if (a->sample_rate <= 0.0) return;
+     a->grid.step_frames = a->sample_rate * 60.0 / (tempo * a->rate);
+     a->grid.origin = beat_frame;
+     a->grid.origin_step = beat * a->rate;
+     if (a->count == 0) return; // The next chord aligns itself
+     tempogrid_resync(&a->grid, frame, restart);
+     // A note playing is over by the step, wherever it moved
+     if (a->sounding >= 0 && a->off_frame > a->grid.step_frame) a->off_frame = a->grid.step_frame;
+ }
+
+ void arp_note_on(Arp *a, uint64_t frame, int note, int velocity) {
+     for (int i = 0; i < a->count; i++) {
+         if (a->held[i] == note) { a->velocity[i] = (uint8_t)velocity; return; }
+     }
+     if (a->count == ARP_MAX_NOTES) return;
+     if (a->count == 0) {
+         a->position = 0;
+         if (a->grid.step_frames > 0.0) tempogrid_align(&a->grid, frame);
+     }
+     a->held[a->count] = (uint8_t)note;
+     a->velocity[a->count++] = (uint8_t)velocity;
+ }
+
+ void arp_note_off(Arp *a, int note) {
+     for (int i = 0; i < a->count; i++) {
+         if (a->held[i] != note) continue;
+         memmove(&a->held[i], &a->held[i + 1], (size_t)(a->count - i - 1));
+         memmove(&a->velocity[i], &a->velocity[i + 1], (size_t)(a->count - i - 1));
+         a->count--;
+         return;
+     }
+ }
+
+ void arp_release_all(Arp *a) {
+     a->count = 0;
+ }
+
+ void arp_silence(Arp *a) {
+     a->count = 0;
+     a->sounding = -1;
+     a->off_frame = ARP_NEVER;
+ }
+
+ uint64_t arp_next_frame(const Arp *a) {
+     uint64_t next = (a->count > 0 && a->grid.step_frames > 0.0) ? a->grid.step_frame : ARP_NEVER;
+
+     if (a->sounding >= 0 && a->off_frame <= next) return a->off_frame;
+     return next;
+ }
+
+ int arp_next(Arp *a, MidiEvent *ev) {
+     uint8_t notes[ARP_PATTERN_MAX], velocities[ARP_PATTERN_MAX];
+     const uint64_t frame = arp_next_frame(a);
+     double gate_frames;
+     int len, i;
+
+     if (frame == ARP_NEVER) return 0;
+     memset(ev, 0, sizeof(*ev));
+     ev->frame = frame;
+     if (a->sounding >= 0 && a->off_frame == frame) {
+         ev->type = MIDI_EVENT_NOTE_OFF;
+         ev->data1 = (uint8_t)a->sounding;
+         a->sounding = -1;
+         a->off_frame = ARP_NEVER;
+         return 1;
+     }
+
+     len = arp_pattern(a, notes, velocities);
+     i = arp_pick(a, len);
+     ev->type = MIDI_EVENT_NOTE_ON;
+     ev->data1 = notes[i];
+     ev->data2 = velocities[i];
+     a->sounding = notes[i];
+     a->position++;
+     tempogrid_advance(&a->grid);
+     // At least a frame long, and over by the next step (gate 1 is legato: off and on on the same frame)
+     gate_frames = a->gate * a->grid.step_frames;
+     a->off_frame = frame + ((gate_frames < 1.0) ? 1 : (uint64_t)(gate_frames + 0.5));
+     if (a->off_frame > a->grid.step_frame) a->off_frame = a->grid.step_frame;
+     return 1;
+ }
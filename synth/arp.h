@@ -0,0 +1,142 @@
+/**
+ * @file arp.h
+ * @brief Arpeggiator: turns the held notes into a pattern of notes on a tempo grid, run by the render loop.
+ *
+ * The held notes do not sound themselves; on every step of the grid the
+ * arpeggiator plays the next note of its pattern (up, down, up and down,
+ * random or in the order the keys were pressed, over 1-4 octaves) for `gate`
+ * of the step. The grid is an internal tempo clock counted in engine frames
+ * (see tempogrid.h): step `k` starts at frame `round(k * step_frames)` since
+ * audio_midi_reset(), so a tempo that does not divide the sample rate does
+ * not drift, and a step lands on the same sample wherever the block
+ * boundaries fall. Following a
+ * MIDI clock, arp_sync() moves the grid onto the clock's beats instead. The render
+ * loop asks for the frame of the next note on or off and splits the block
+ * there, exactly as for a queued MIDI event.
+ *
+ * The state only changes with the notes fed to it and the frames it is
+ * stepped to; the random mode draws from its own generator, seeded by
+ * arp_init(). Rendering the same input from a reset therefore produces the
+ * same notes on the same samples every time.
+ *
+ * The arpeggiator belongs to the render thread; nothing here blocks or allocates.
+ */
+
+ #ifndef ARP_H
+ #define ARP_H
+
+ #include <stdint.h>
+
+ #include "midi.h"
+ #include "tempogrid.h"
+
+ // --- Constants ---
+ #define ARP_MAX_NOTES 32               ///< Held notes tracked; further keys are ignored until one is released.
+ #define ARP_MAX_OCTAVES 4
+ #define ARP_DEFAULT_TEMPO 120.0        ///< Beats per minute.
+ #define ARP_MIN_TEMPO 20.0
+ #define ARP_MAX_TEMPO 300.0
+ #define ARP_DEFAULT_RATE 4.0           ///< Steps per beat: sixteenth notes.
+ #define ARP_MAX_RATE 24.0              ///< Steps per beat: 1/64 triplets.
+ #define ARP_DEFAULT_GATE 0.5           ///< Fraction of a step a note sounds.
+ #define ARP_MIN_GATE 0.01
+ #define ARP_SEED 0x9e3779b9u           ///< Random mode's generator state after arp_init().
+ #define ARP_NEVER UINT64_MAX           ///< arp_next_frame() when nothing is due.
+
+ /**
+  * @enum ArpMode
+  * @brief The order the held notes are played in.
+  */
+ typedef enum {
+     ARP_OFF,           ///< Notes play as they are held.
+     ARP_UP,            ///< Lowest to highest, then the next octave up.
+     ARP_DOWN,          ///< Highest to lowest, starting in the top octave.
+     ARP_UP_DOWN,       ///< Up then down, without repeating the top and bottom notes.
+     ARP_RANDOM,        ///< Any held note (or octave of it), from a seeded generator.
+     ARP_AS_PLAYED      ///< In the order the keys were pressed.
+ } ArpMode;
+
+ /**
+  * @struct Arp
+  * @brief Settings, held notes and position of the arpeggiator.
+  */
+ typedef struct {
+     ArpMode mode;
+     double tempo;                   ///< Beats per minute.
+     double rate;                    ///< Steps per beat.
+     double gate;                    ///< Fraction of a step a note sounds, 0.01-1.
+     int octaves;                    ///< Octaves the pattern spans, 1-4.
+     double sample_rate;             ///< Engine rate, 0 until arp_set_sample_rate().
+     TempoGrid grid;                 ///< Steps at the engine rate, spacing 0 until arp_set_sample_rate(); next step valid while notes are held.
+     uint8_t held[ARP_MAX_NOTES];     ///< Held notes in the order they were pressed.
+     uint8_t velocity[ARP_MAX_NOTES];
+     int count;                      ///< Held notes.
+     unsigned long position;         ///< Steps played since the first key of the chord, the pattern position.
+     int sounding;                   ///< Note playing, -1 if none.
+     uint64_t off_frame;             ///< Frame the note off of `sounding` is due.
+     uint32_t rng;                   ///< Random mode's xorshift state.
+ } Arp;
+
+ /**
+  * @brief Resets the arpeggiator: no notes held, the generator seeded with ARP_SEED.
+  * @param[out] a The arpeggiator.
+  * @param mode Pattern, ARP_OFF to pass notes through.
+  * @param tempo Beats per minute.
+  * @param rate Steps per beat (4 for sixteenth notes, 3 for eighth note triplets).
+  * @param gate Fraction of a step each note sounds (1 for legato).
+  * @param octaves Octaves the pattern spans.
+  */
+ void arp_init(Arp *a, ArpMode mode, double tempo, double rate, double gate, int octaves);
+
+ /** @brief Returns 1 if the arpeggiator takes the notes. */
+ int arp_enabled(const Arp *a);
+
+ /**
+  * @brief Sets the engine rate the grid is counted in. Called at the start of every block.
+  * A changed rate moves the next step to the first step of the new grid from there on.
+  */
+ void arp_set_sample_rate(Arp *a, double sampleRate);
+
+ /**
+  * @brief Lays the grid on an external clock's beats and tempo (see midisync.h).
+  *
+  * Beat `beat` falls on frame `beat_frame` and a step lasts `1 / rate` beats
+  * at `tempo`. The next step keeps its place in the pattern and moves to its
+  * new frame, or to `frame` if that has already passed, so a tempo change
+  * neither repeats nor skips a step. With `restart` (after a Start, or when
+  * the grid was the internal one) the next step is the first of the new grid
+  * from the tick at `beat_frame` on, which may be a few frames back.
+  * @param frame Engine frame the clock is applied at.
+  */
+ void arp_sync(Arp *a, double beat_frame, double beat, double tempo, uint64_t frame, int restart);
+
+ /**
+  * @brief Holds a note. The first note of a chord starts the pattern on the next step at or after `frame`.
+  * @param frame Engine frame the key went down at.
+  */
+ void arp_note_on(Arp *a, uint64_t frame, int note, int velocity);
+
+ /** @brief Releases a held note; a note it is playing still ends at its gate. */
+ void arp_note_off(Arp *a, int note);
+
+ /** @brief Releases every held note (all notes off). */
+ void arp_release_all(Arp *a);
+
+ /** @brief Releases every held note and forgets the note playing, whose voice was silenced (all sound off). */
+ void arp_silence(Arp *a);
+
+ /**
+  * @brief Returns the frame of the next note on or off.
+  * @return The frame, ARP_NEVER if no note is held or playing.
+  */
+ uint64_t arp_next_frame(const Arp *a);
+
+ /**
+  * @brief Produces the note on or off due at arp_next_frame() and moves on.
+  * At a frame with both, the note off comes first.
+  * @param[out] ev The event, on channel 1.
+  * @return 1 if there was an event, 0 if nothing is due.
+  */
+ int arp_next(Arp *a, MidiEvent *ev);
+
+ #endif // ARP_H
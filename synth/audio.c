@@ -16,8 +16,31 @@
  #include <string.h> 
  #include <errno.h> 
  #include <sched.h> 
+ #include <ctype.h>
+ #include <stdlib.h>
+ #include <time.h>
  
+ #include <stdatomic.h>
+
  #include "../synth/audio.h"      
+ #include "../synth/audio_internal.h"
+ #include "../synth/audio_alsa.h"
+ #include "../synth/audio_jack.h"
+ #include "../synth/lookahead.h"
+ #include "../synth/adaptive.h"
+ #include "../synth/resampler.h"
+ #include "../synth/sidechain.h"
+ #include "../synth/sampleformat.h"
+ #include "../synth/watchdog.h"
+ #include "../synth/midi.h"
+ #include "../synth/midi_alsa.h"
+ #include "../synth/mpe.h"
+ #include "../synth/arp.h"
+ #include "../synth/sequencer.h"
+ #include "../synth/automation.h"
+ #include "../synth/midisync.h"
+ #include "../synth/osc_server.h"
+ #include "../synth/control_server.h"
  #include "../synth/synth_data.h" 
  
  // --- External Global Shared Data Instance ---
@@ -35,6 +58,48 @@
   * @note Static to this file, managed by start_audio(), stop_audio().
   */
  static PaStream *g_paStream = NULL;
+
+ /**
+  * @var g_paSampleRate
+  * @brief Sample rate of the open PortAudio stream, used by paCallback() for the load measurement.
+  * @note 0 while no stream is open (the load is then not recorded).
+  */
+ static double g_paSampleRate = 0.0;
+
+ /**
+  * @var g_paDevice
+  * @brief Device index of the open (or last opened) PortAudio stream, `paNoDevice` before the first.
+  */
+ static PaDeviceIndex g_paDevice = paNoDevice;
+
+ /**
+  * @var g_audioConfig
+  * @brief Stream configuration (device, buffer size, latency) used by start_audio().
+  * @note Defaults reproduce the original behaviour: default device, backend-chosen
+  * buffer size and the device's low-latency setting. Replaced via audio_set_config().
+  */
+ static AudioConfig g_audioConfig = AUDIO_CONFIG_DEFAULTS;
+
+ /**
+  * @brief Guards g_audioConfig for readers outside the reopen paths: audio_get_config() and audio_get_stats().
+  * @note Restarts and the adaptive monitor also hold `g_restartMutex`, so they read it without this lock
+  * and only take it around their writes (config_store(), config_store_frames()).
+  */
+ static pthread_mutex_t g_configMutex = PTHREAD_MUTEX_INITIALIZER;
+
+ /** @brief Replaces the stream configuration. */
+ static void config_store(const AudioConfig *config) {
+     pthread_mutex_lock(&g_configMutex);
+     g_audioConfig = *config;
+     pthread_mutex_unlock(&g_configMutex);
+ }
+
+ /** @brief Replaces the device buffer size of the stream configuration. */
+ static void config_store_frames(unsigned long frames) {
+     pthread_mutex_lock(&g_configMutex);
+     g_audioConfig.framesPerBuffer = frames;
+     pthread_mutex_unlock(&g_configMutex);
+ }
  
  // --- Error Handling Macros ---
  
@@ -68,299 +133,2476 @@
          return err; \
      }
  
- // --- PortAudio Callback Function ---
- 
+ // --- Engine Statistics ---
  /**
-  * @brief PortAudio callback function for generating and mixing audio samples for two waves.
-  *
-  * This function is called by the PortAudio library in a high-priority thread
-  * whenever the audio device needs more samples. It reads shared synthesizer
-  * parameters for **both waves**, calculates their respective ADSR envelopes,
-  * generates the appropriate waveforms, applies the envelopes, updates phase and state
-  * for both waves, **mixes the resulting samples**, and writes the final mixed
-  * sample to the output buffer. It minimizes mutex lock time by copying parameters locally.
-  *
-  * @param inputBuffer Unused (input audio buffer).
-  * @param outputBuffer Buffer where generated mixed audio samples (float) should be written.
-  * @param framesPerBuffer The number of sample frames to generate for the buffer.
-  * @param timeInfo Timing information from PortAudio (unused).
-  * @param statusFlags Flags indicating buffer under/overflow or other conditions.
-  * @param userData A pointer to the SharedSynthData structure containing synth parameters and state for both waves.
-  *
-  * @return `paContinue` (0) if processing should continue, or `paAbort` (<0) on critical errors (like mutex failure).
+  * @var g_stats
+  * @brief Counters and latency measurements updated by the active backend's audio thread.
+  * @note Single writer (the audio thread), read by any thread via audio_get_stats().
+  * Latencies are stored in microseconds; -1 means "not measured yet". The
+  * resampler's quality, rates and latency are set when it is built and
+  * cleared when it is freed, so readers never touch g_src itself.
+  */
+ static struct {
+     const char *_Atomic backend;
+     atomic_ullong callbacks;
+     atomic_ullong frames;
+     atomic_ulong xruns;
+     atomic_long latency_last_us;
+     atomic_long latency_min_us;
+     atomic_long latency_max_us;
+     atomic_long latency_avg_us;
+     atomic_ulong lookahead_frames;
+     atomic_ulong lookahead_fill;
+     atomic_long lookahead_min_fill;
+     atomic_ulong lookahead_underruns;
+     atomic_long load_avg_ppm;
+     atomic_long load_peak_ppm;
+     atomic_long src_load_ppm;
+     const char *_Atomic src_quality;
+     _Atomic double src_engine_rate;
+     _Atomic double src_device_rate;
+     _Atomic double src_latency_ms;
+     atomic_long duplex_last_us;
+     atomic_long duplex_min_us;
+     atomic_long duplex_max_us;
+     const char *_Atomic sample_format;
+     const char *_Atomic dither;
+     atomic_long convert_load_ppm;
+ } g_stats = { .backend = "none", .src_quality = "off", .sample_format = "float32", .dither = "none", .convert_load_ppm = -1, .latency_last_us = -1, .latency_min_us = -1, .latency_max_us = -1, .latency_avg_us = -1,
+               .lookahead_min_fill = -1, .load_avg_ppm = -1, .load_peak_ppm = -1, .src_load_ppm = -1,
+               .duplex_last_us = -1, .duplex_min_us = -1, .duplex_max_us = -1 };
+
+ /**
+  * @var g_src
+  * @brief Resampler from the engine rate to the device rate, used while `g_srcActive` is set.
+  * @note Built by audio_device_rate_adopt() before a stream starts and only used by its audio thread.
+  */
+ static Resampler g_src;
+ static atomic_int g_srcActive;
+
+ /**
+  * @var g_sidechain
+  * @brief Modulator applying the device input to the output, at the device rate.
+  * @note Initialised by audio_device_rate_adopt() before a stream starts and only used by its audio thread.
+  */
+ static Sidechain g_sidechain;
+
+ /**
+  * @var g_paConv
+  * @brief Float to device format conversion of the PortAudio stream.
+  * @note Initialised by start_portaudio() before the stream opens; zeroed (float32) it is a plain render.
+  */
+ static SampleConverter g_paConv;
+
+ /**
+  * @var g_paScratch
+  * @brief Float render buffer of an integer format PortAudio stream, converted into the device buffer.
+  * @note Allocated by start_portaudio() before the stream starts and freed by stop_portaudio();
+  * only that stream's audio thread (callback or blocking writer) uses it. NULL for float streams.
+  */
+ static float *g_paScratch;
+ static unsigned long g_paScratchFrames; ///< Capacity of `g_paScratch` in frames.
+
+ /**
+  * @var g_adaptive
+  * @brief State of the adaptive latency monitor (see adaptive.h for the policy).
+  * @note Written by adaptive_start() before the monitor thread runs, then by that thread only;
+  * the atomics are read by audio_get_stats() from any thread.
+  * Survives stream reopens, which is how the settled latency stays visible.
+  */
+ static struct {
+     pthread_t thread;
+     atomic_int running;            ///< Set while the monitor thread runs.
+     atomic_int enabled;            ///< The current (or last) stream was adaptive; kept after stop for the summary.
+     SharedSynthData *data;         ///< Passed to start_backend() when reopening.
+     AdaptivePolicy policy;
+     atomic_int use_lookahead;      ///< Resize the lookahead ring (1) or reopen with a new buffer size (0).
+     _Atomic double sample_rate;    ///< Used to convert between frames and milliseconds.
+     unsigned long configured_frames; ///< `framesPerBuffer` before the policy changed it, restored on stop.
+     unsigned long min_frames;      ///< The configured setting: the policy never goes below it.
+     unsigned long max_frames;      ///< `adaptiveMaxMs` in frames.
+     atomic_ulong frames;           ///< Current setting, 0 until known.
+     atomic_ulong steps_up;
+     atomic_ulong steps_down;
+ } g_adaptive;
+
+ /** @brief Serialises device reopens: audio_restart() callers, the watchdog and the adaptive monitor. */
+ static pthread_mutex_t g_restartMutex = PTHREAD_MUTEX_INITIALIZER;
+
+ /**
+  * @var g_restart
+  * @brief Runtime restarts (device switches) and the output gap each one caused.
+  * @note Not part of g_stats: a restart resets the per-stream counters, these survive it.
+  */
+ static struct {
+     atomic_ulong count;
+     atomic_long last_block_us;     ///< Time of the most recent device block (audio_time_now(), us).
+     atomic_long gap_start_us;      ///< Last block of the stream being replaced, 0 when no gap is pending.
+     atomic_long gap_us;            ///< Block-to-block gap across the last restart (-1 if not measured).
+     atomic_long gap_max_us;
+     atomic_long restart_us;        ///< Time audio_restart() took for the last restart.
+ } g_restart = { .gap_us = -1, .gap_max_us = -1, .restart_us = -1 };
+
+ /**
+  * @var g_watchdog
+  * @brief Stall watchdog thread and the outages it handled.
+  * @note Like g_restart not part of g_stats: the counters survive the restarts the watchdog performs.
+  */
+ static struct {
+     pthread_t thread;
+     atomic_int running;            ///< Set while the watchdog thread runs.
+     SharedSynthData *data;         ///< Passed to the restart.
+     Watchdog policy;               ///< Only used by the watchdog thread.
+     atomic_long stream_start_us;   ///< Time the current device stream was opened (audio_time_now(), us).
+     atomic_ulong outages;
+     atomic_ulong recoveries;
+     atomic_ulong failed_restarts;
+     atomic_long outage_us;         ///< Length of the last recovered outage (-1 if none).
+ } g_watchdog = { .outage_us = -1 };
+
+ /**
+  * @var g_midi
+  * @brief MIDI events on their way to the render loop and what the applied ones left behind.
+  * @note `queue` and `clock` are shared with the MIDI input thread, `control` with
+  * the control interfaces (which serialise their pushes with `control_lock`),
+  * `keys` with the GUI thread.
+  * `schedule` and the note state belong to whichever thread renders the engine
+  * (device callback or render-ahead thread).
+  */
+ static struct {
+     MidiQueue queue;
+     MidiQueue control;             ///< Events from control interfaces, in arrival order but with any frame.
+     pthread_mutex_t control_lock;  ///< Held by a control interface while it pushes; never taken by the renderer.
+     MidiQueue keys;                ///< Notes played on the computer keyboard, their arrival time in `value`.
+     struct {
+         uint64_t frame;
+         double arrival;            ///< Time audio_key_input() queued it.
+         uint8_t note;
+     } key_pending[AUDIO_KEY_PENDING]; ///< Keyboard note ons moved into the schedule but not applied yet...
+     unsigned int key_pending_head; ///< ...the oldest of them...
+     unsigned int key_pending_count; ///< ...and how many there are.
+     MidiSchedule schedule;         ///< `control` events sorted by frame.
+     MidiClock clock;
+     uint64_t frame;                ///< Engine frames rendered since audio_midi_reset().
+     int note;                      ///< Note playing (held or releasing), -1 if none.
+     double pitch;                  ///< Frequency of `note`, 0 while the GUI frequencies play.
+     double velocity;               ///< Velocity of `note` as a gain.
+     double volume;                 ///< Controller 7 as a gain.
+     Arp arp;                       ///< Takes the held notes and plays its own when an arpeggiator mode is configured.
+     Sequencer seq;                 ///< Loops g_seqPattern's pattern when the sequencer is configured.
+     unsigned int seq_generation;   ///< g_seqPattern generation `seq` was set from, 0 before the first copy.
+     double locks[SYNTH_PARAM_COUNT]; ///< Values of the current step's parameter locks...
+     unsigned int locked;           ///< ...and which parameters they hold (bit per SynthParam).
+     uint64_t input_frame;          ///< Frame of the last event from MIDI, a control interface or the keyboard.
+     double render_load;            ///< Moving average of render time / block duration, -1 until measured.
+     int seq_on;                    ///< `sequencer` as configured at the last reset...
+     double seq_prerender_ms;       ///< ...and `seqPrerenderMs`.
+     int prerendering;              ///< The render thread was asked to render ahead for the sequencer.
+     MidiClockMode clock_mode;      ///< `midiClock` as configured at the last reset.
+     MidiSync sync;                 ///< The received MIDI clock (see midi_sync_input()).
+     int sync_following;            ///< The arpeggiator's and sequencer's grids are on the received clock's beats.
+     int sync_start;                ///< A Start arrived: the next tick restarts the grids and the sequencer.
+     int seq_stopped;               ///< A received Stop halted the sequencer.
+     uint64_t clock_out_tick;       ///< Number of the next MIDI clock tick to send...
+     double clock_out_frame;        ///< ...its frame, unrounded: the previous tick's plus the period at the time...
+     MidiQueue clock_out;           ///< ...and the messages rendered but not sent yet, for the MIDI thread.
+     double clock_late_sq;          ///< Sum of the squared lateness of the sent ticks (MIDI thread only).
+     MidiMap map;                   ///< Render thread's copy of g_midiMap.
+     unsigned int map_generation;   ///< g_midiMap generation `map` was copied from, 0 before the first copy.
+     double values[SYNTH_PARAM_COUNT]; ///< Parameter values set by controllers...
+     unsigned int changed;          ///< ...and which of them still have to be written to the shared data (bit per SynthParam).
+     WaveformType waves[2];         ///< Waveforms set by control interfaces...
+     unsigned int waves_changed;    ///< ...and which of them still have to be written (bit per wave).
+     atomic_uchar cc_value[16][MIDI_MAP_CONTROLLERS];  ///< Latest value of each controller, for coalescing.
+     atomic_uchar cc_queued[16][MIDI_MAP_CONTROLLERS]; ///< Set while an event for the controller waits in the queue.
+     atomic_ulong applied;
+     atomic_ulong late;
+     atomic_ulong dropped;
+     atomic_ulong coalesced;
+     atomic_ulong param_updates;    ///< Blocks that wrote controller values to the shared data.
+     atomic_ulong mpe_notes;        ///< Notes started on MPE voices (see g_mpe).
+     atomic_ulong mpe_stolen;
+     atomic_ulong mpe_peak;         ///< Most MPE voices sounding at once.
+     atomic_ulong arp_notes;        ///< Notes started by the arpeggiator.
+     atomic_ulong seq_steps;        ///< Steps played by the sequencer.
+     atomic_ulong seq_prerenders;   ///< Times pre-rendering for the sequencer started.
+     atomic_int seq_prerendering;
+     atomic_ulong clock_ticks;      ///< MIDI clock ticks received.
+     atomic_ulong clock_lost;       ///< Times the received clock went missing.
+     atomic_long clock_tempo_mbpm;  ///< Its tempo in thousandths of a beat per minute, 0 without one.
+     atomic_int clock_locked;
+     atomic_long clock_jitter_us;   ///< RMS of the ticks against the loop's prediction (-1 if none)...
+     atomic_long clock_jitter_max_us; ///< ...and the largest.
+     atomic_ulong clock_sent;       ///< MIDI clock ticks sent.
+     atomic_long clock_late_us;     ///< RMS lateness of the sent ticks against their time (-1 if none)...
+     atomic_long clock_late_max_us; ///< ...and the largest.
+     atomic_ulong key_notes;        ///< Notes played on the computer keyboard.
+     atomic_long key_last_us;       ///< Key-to-sound latency of the last of them (-1 if none).
+     atomic_long key_min_us;
+     atomic_long key_max_us;
+     atomic_long key_avg_us;
+ } g_midi = { .control_lock = PTHREAD_MUTEX_INITIALIZER, .note = -1, .velocity = 1.0, .volume = 1.0, .render_load = -1.0,
+              .clock_jitter_us = -1, .clock_jitter_max_us = -1, .clock_late_us = -1, .clock_late_max_us = -1,
+              .key_last_us = -1, .key_min_us = -1, .key_max_us = -1, .key_avg_us = -1 };
+
+ /**
+  * @var g_midiMap
+  * @brief Controller assignments as set by the configuration, the GUI or MIDI learn.
+  * @note Changed under `lock`, which the render thread only ever try-locks to
+  * refresh its copy once `generation` has moved.
+  */
+ static struct {
+     pthread_mutex_t lock;
+     MidiMap map;
+     int initialised;               ///< `map` has been cleared (done lazily under the lock).
+     atomic_uint generation;        ///< Incremented on every change, starts at 1.
+     atomic_int learn;              ///< Parameter waiting for the next controller, -1 if none.
+ } g_midiMap = { .lock = PTHREAD_MUTEX_INITIALIZER, .generation = 1, .learn = -1 };
+
+ /**
+  * @var g_seqPattern
+  * @brief The step pattern as set by audio_seq_set_pattern(), e.g. from a loaded preset.
+  * @note Like g_midiMap: changed under `lock`, which the render thread only
+  * try-locks to pick up the pattern once `generation` has moved.
+  */
+ static struct {
+     pthread_mutex_t lock;
+     SeqPattern pattern;            ///< Length 0 until a pattern is set.
+     atomic_uint generation;        ///< Incremented on every change, starts at 1.
+ } g_seqPattern = { .lock = PTHREAD_MUTEX_INITIALIZER, .generation = 1 };
+
+ /**
+  * @var g_automation
+  * @brief The automation take, the requests to record or play it and the render thread's progress.
+  * @note `take`, `path`, `mode` and `generation` change under `lock`. While
+  * playing, the render thread try-locks it for every block it reads the lanes
+  * in (a block that cannot take it plays without automation), so a request
+  * waits at most one block. While recording the render thread only pushes the
+  * changes into `queue`, which the recorder thread drains into the take. The
+  * fields from `render_mode` on belong to the render thread.
+  */
+ static struct {
+     pthread_mutex_t lock;
+     Automation take;
+     char path[CONFIG_AUTOMATION_PATH_MAX]; ///< File the recording is written to, "" for none.
+     int file_started;              ///< The recording's file has its header.
+     uint64_t record_base;          ///< Added to recorded frames, moved on when the engine frames restart.
+     atomic_int mode;               ///< AudioAutomationMode as last requested.
+     atomic_uint generation;        ///< Incremented on every request, starts at 1.
+     uint8_t record_tag;            ///< Low byte of the generation of the recording.
+     MidiQueue queue;               ///< Recorded changes: MIDI_EVENT_PARAM at the take's frame, the generation's low byte in `data2`.
+     pthread_t thread;
+     atomic_int running;            ///< Set while the recorder thread runs.
+     atomic_ulong points;           ///< automation_points() and automation_bytes() of the take, for the statistics.
+     atomic_ulong bytes;
+     atomic_ulong dropped;
+     AudioAutomationMode render_mode; ///< Request of `render_generation` as the render thread carries it out.
+     unsigned int render_generation;  ///< 0 to pick up the current request with the next block.
+     int held;                      ///< The render thread holds `lock` for the block it renders.
+     int resync;                    ///< A block played without the lock: the cursors have to seek.
+     uint64_t start;                ///< Engine frame of the take's frame 0.
+     double ratio;                  ///< Engine frames per take frame.
+     AutoCursor cursors[SYNTH_PARAM_COUNT];
+     uint64_t due[SYNTH_PARAM_COUNT]; ///< Engine frame of each cursor's next value, AUTO_NEVER if none.
+     double last[SYNTH_PARAM_COUNT];  ///< Parameters the previous block ended with, to spot GUI changes while recording.
+ } g_automation = { .lock = PTHREAD_MUTEX_INITIALIZER, .generation = 1 };
+
+ /** @brief Marks the first record of a take: its `value` is the engine rate the frames count at. */
+ #define AUTOMATION_RATE_RECORD SYNTH_PARAM_COUNT
+
+ /**
+  * @var g_params
+  * @brief The parameters the last rendered block played with, for readers that must not take the mutex.
+  * @note Written by the render thread at the end of each block; each value is
+  * atomic on its own, so a reader racing a block may mix values of two blocks.
+  */
+ static struct {
+     _Atomic double values[SYNTH_PARAM_COUNT];
+     atomic_int waves[2];
+     atomic_long time_us;           ///< audio_time_now() of the last publish in microseconds, -1 if none.
+ } g_params = { .time_us = -1 };
+
+ /**
+  * @brief Timestamps a device block and completes a pending restart gap measurement.
+  */
+ static void record_restart_gap(void) {
+     long now = (long)(audio_time_now() * 1e6);
+     long start = atomic_load_explicit(&g_restart.gap_start_us, memory_order_relaxed);
+
+     atomic_store_explicit(&g_restart.last_block_us, now, memory_order_relaxed);
+     // First block of a restarted stream: measure how long the device went without audio
+     if (start > 0 && atomic_compare_exchange_strong(&g_restart.gap_start_us, &start, 0)) {
+         long gap = now - start;
+         atomic_store(&g_restart.gap_us, gap);
+         if (gap > atomic_load(&g_restart.gap_max_us)) atomic_store(&g_restart.gap_max_us, gap);
+     }
+ }
+
+ void audio_stats_reset(const char *backend_name) {
+     atomic_store(&g_stats.backend, backend_name ? backend_name : "none");
+     atomic_store(&g_stats.callbacks, 0);
+     atomic_store(&g_stats.frames, 0);
+     atomic_store(&g_stats.xruns, 0);
+     atomic_store(&g_stats.latency_last_us, -1);
+     atomic_store(&g_stats.latency_min_us, -1);
+     atomic_store(&g_stats.latency_max_us, -1);
+     atomic_store(&g_stats.latency_avg_us, -1);
+     // The lookahead size is configuration, not a counter, and survives the reset
+     atomic_store(&g_stats.lookahead_fill, 0);
+     atomic_store(&g_stats.lookahead_min_fill, -1);
+     atomic_store(&g_stats.lookahead_underruns, 0);
+     atomic_store(&g_stats.load_avg_ppm, -1);
+     atomic_store(&g_stats.load_peak_ppm, -1);
+     atomic_store(&g_stats.src_load_ppm, -1);
+     atomic_store(&g_stats.duplex_last_us, -1);
+     atomic_store(&g_stats.duplex_min_us, -1);
+     atomic_store(&g_stats.duplex_max_us, -1);
+     atomic_store(&g_stats.sample_format, "float32");
+     atomic_store(&g_stats.dither, "none");
+     atomic_store(&g_stats.convert_load_ppm, -1);
+ }
+
+ void audio_stats_record_block(unsigned long frames, double dac_latency_sec) {
+     atomic_fetch_add_explicit(&g_stats.callbacks, 1, memory_order_relaxed);
+     atomic_fetch_add_explicit(&g_stats.frames, frames, memory_order_relaxed);
+     record_restart_gap();
+     if (dac_latency_sec < 0.0) return;
+
+     long us = (long)(dac_latency_sec * 1e6 + 0.5);
+     long min = atomic_load_explicit(&g_stats.latency_min_us, memory_order_relaxed);
+     long max = atomic_load_explicit(&g_stats.latency_max_us, memory_order_relaxed);
+     long avg = atomic_load_explicit(&g_stats.latency_avg_us, memory_order_relaxed);
+     atomic_store_explicit(&g_stats.latency_last_us, us, memory_order_relaxed);
+     if (min < 0 || us < min) atomic_store_explicit(&g_stats.latency_min_us, us, memory_order_relaxed);
+     if (us > max) atomic_store_explicit(&g_stats.latency_max_us, us, memory_order_relaxed);
+     // Exponential moving average over roughly the last 64 blocks
+     atomic_store_explicit(&g_stats.latency_avg_us, (avg < 0) ? us : avg + (us - avg) / 64, memory_order_relaxed);
+ }
+
+ void audio_stats_record_duplex(double round_trip_sec) {
+     if (round_trip_sec < 0.0) return;
+     long us = (long)(round_trip_sec * 1e6 + 0.5);
+     long min = atomic_load_explicit(&g_stats.duplex_min_us, memory_order_relaxed);
+     long max = atomic_load_explicit(&g_stats.duplex_max_us, memory_order_relaxed);
+     atomic_store_explicit(&g_stats.duplex_last_us, us, memory_order_relaxed);
+     if (min < 0 || us < min) atomic_store_explicit(&g_stats.duplex_min_us, us, memory_order_relaxed);
+     if (us > max) atomic_store_explicit(&g_stats.duplex_max_us, us, memory_order_relaxed);
+ }
+
+ void audio_stats_set_format(const char *format, const char *dither) {
+     atomic_store(&g_stats.sample_format, format);
+     atomic_store(&g_stats.dither, dither);
+ }
+
+ void audio_convert_output(SampleConverter *conv, const float *in, void *out, unsigned long frames, double rate) {
+     double start = audio_time_now();
+     long ppm, avg;
+
+     sample_convert(conv, in, out, frames);
+     if (conv->format == SAMPLE_FORMAT_FLOAT32 || frames == 0 || rate <= 0.0) return;
+
+     // Conversion cost alone, as a fraction of the block time
+     ppm = (long)((audio_time_now() - start) * rate / frames * 1e6 + 0.5);
+     avg = atomic_load_explicit(&g_stats.convert_load_ppm, memory_order_relaxed);
+     atomic_store_explicit(&g_stats.convert_load_ppm, (avg < 0) ? ppm : avg + (ppm - avg) / 64, memory_order_relaxed);
+ }
+
+ void audio_stats_record_xrun(void) {
+     atomic_fetch_add_explicit(&g_stats.xruns, 1, memory_order_relaxed);
+ }
+
+ void audio_stats_record_load(double busy_sec, double period_sec) {
+     if (period_sec <= 0.0 || busy_sec < 0.0) return;
+
+     // Load in parts per million of the block time
+     long ppm = (long)(busy_sec / period_sec * 1e6 + 0.5);
+     long avg = atomic_load_explicit(&g_stats.load_avg_ppm, memory_order_relaxed);
+     long peak = atomic_load_explicit(&g_stats.load_peak_ppm, memory_order_relaxed);
+     if (ppm > peak) atomic_store_explicit(&g_stats.load_peak_ppm, ppm, memory_order_relaxed);
+     atomic_store_explicit(&g_stats.load_avg_ppm, (avg < 0) ? ppm : avg + (ppm - avg) / 64, memory_order_relaxed);
+ }
+
+ double audio_time_now(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+ }
+
+ void audio_stats_set_lookahead(unsigned long frames) {
+     atomic_store(&g_stats.lookahead_frames, frames);
+     atomic_store(&g_stats.lookahead_fill, 0);
+     atomic_store(&g_stats.lookahead_min_fill, -1);
+ }
+
+ void audio_stats_record_lookahead(unsigned long fill, int underrun) {
+     long min = atomic_load_explicit(&g_stats.lookahead_min_fill, memory_order_relaxed);
+     atomic_store_explicit(&g_stats.lookahead_fill, fill, memory_order_relaxed);
+     if (min < 0 || (long)fill < min) atomic_store_explicit(&g_stats.lookahead_min_fill, (long)fill, memory_order_relaxed);
+     if (underrun) atomic_fetch_add_explicit(&g_stats.lookahead_underruns, 1, memory_order_relaxed);
+ }
+
+ /**
+  * @brief Copies a consistent-enough snapshot of the engine statistics.
+  * @param[out] stats Receives the current counters. Latencies are in milliseconds, -1 if unknown.
+  */
+ void audio_get_stats(AudioStats *stats) {
+     long v;
+     if (!stats) return;
+     stats->backend = atomic_load(&g_stats.backend);
+     stats->callbacks = atomic_load(&g_stats.callbacks);
+     stats->framesRendered = atomic_load(&g_stats.frames);
+     stats->xruns = atomic_load(&g_stats.xruns);
+     v = atomic_load(&g_stats.latency_last_us); stats->dacLatencyMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_stats.latency_min_us);  stats->dacLatencyMinMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_stats.latency_max_us);  stats->dacLatencyMaxMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_stats.latency_avg_us);  stats->dacLatencyAvgMs = (v < 0) ? -1.0 : v / 1000.0;
+     stats->lookaheadFrames = atomic_load(&g_stats.lookahead_frames);
+     stats->lookaheadFill = atomic_load(&g_stats.lookahead_fill);
+     v = atomic_load(&g_stats.lookahead_min_fill); stats->lookaheadMinFill = (v < 0) ? stats->lookaheadFill : (unsigned long)v;
+     stats->lookaheadUnderruns = atomic_load(&g_stats.lookahead_underruns);
+     v = atomic_load(&g_stats.load_avg_ppm);  stats->cpuLoad = (v < 0) ? -1.0 : v / 1e6;
+     v = atomic_load(&g_stats.load_peak_ppm); stats->cpuLoadPeak = (v < 0) ? -1.0 : v / 1e6;
+     stats->adaptive = atomic_load(&g_adaptive.enabled);
+     stats->adaptiveTarget = atomic_load(&g_adaptive.use_lookahead) ? "lookahead" : "buffer";
+     stats->adaptiveFrames = atomic_load(&g_adaptive.frames);
+     double adaptive_rate = atomic_load(&g_adaptive.sample_rate);
+     stats->adaptiveLatencyMs = (adaptive_rate > 0.0) ? 1000.0 * stats->adaptiveFrames / adaptive_rate : 0.0;
+     stats->adaptiveStepsUp = atomic_load(&g_adaptive.steps_up);
+     stats->adaptiveStepsDown = atomic_load(&g_adaptive.steps_down);
+     stats->srcQuality = atomic_load(&g_stats.src_quality);
+     stats->srcEngineRate = atomic_load(&g_stats.src_engine_rate);
+     stats->srcDeviceRate = atomic_load(&g_stats.src_device_rate);
+     stats->srcLatencyMs = atomic_load(&g_stats.src_latency_ms);
+     v = atomic_load(&g_stats.src_load_ppm); stats->srcLoad = (v < 0) ? -1.0 : v / 1e6;
+     pthread_mutex_lock(&g_configMutex);
+     stats->inputMode = sidechain_mode_name(g_audioConfig.inputMode);
+     pthread_mutex_unlock(&g_configMutex);
+     v = atomic_load(&g_stats.duplex_last_us); stats->duplexLatencyMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_stats.duplex_min_us);  stats->duplexLatencyMinMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_stats.duplex_max_us);  stats->duplexLatencyMaxMs = (v < 0) ? -1.0 : v / 1000.0;
+     stats->sampleFormat = atomic_load(&g_stats.sample_format);
+     stats->dither = atomic_load(&g_stats.dither);
+     v = atomic_load(&g_stats.convert_load_ppm); stats->convertLoad = (v < 0) ? -1.0 : v / 1e6;
+     stats->restarts = atomic_load(&g_restart.count);
+     v = atomic_load(&g_restart.restart_us); stats->restartMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_restart.gap_us);     stats->restartGapMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_restart.gap_max_us); stats->restartGapMaxMs = (v < 0) ? -1.0 : v / 1000.0;
+     stats->watchdogOutages = atomic_load(&g_watchdog.outages);
+     stats->watchdogRecoveries = atomic_load(&g_watchdog.recoveries);
+     stats->watchdogFailedRestarts = atomic_load(&g_watchdog.failed_restarts);
+     v = atomic_load(&g_watchdog.outage_us); stats->watchdogOutageMs = (v < 0) ? -1.0 : v / 1000.0;
+     stats->midiEvents = atomic_load(&g_midi.applied);
+     stats->midiLateEvents = atomic_load(&g_midi.late);
+     stats->midiDroppedEvents = atomic_load(&g_midi.dropped);
+     stats->midiCoalescedEvents = atomic_load(&g_midi.coalesced);
+     stats->mpeNotes = atomic_load(&g_midi.mpe_notes);
+     stats->mpeStolen = atomic_load(&g_midi.mpe_stolen);
+     stats->mpeVoicesPeak = atomic_load(&g_midi.mpe_peak);
+     stats->arpNotes = atomic_load(&g_midi.arp_notes);
+     stats->seqSteps = atomic_load(&g_midi.seq_steps);
+     stats->seqPrerenders = atomic_load(&g_midi.seq_prerenders);
+     stats->seqPrerendering = atomic_load(&g_midi.seq_prerendering);
+     stats->midiClockTicks = atomic_load(&g_midi.clock_ticks);
+     stats->midiClockLost = atomic_load(&g_midi.clock_lost);
+     stats->midiClockTempo = atomic_load(&g_midi.clock_tempo_mbpm) / 1000.0;
+     stats->midiClockLocked = atomic_load(&g_midi.clock_locked);
+     v = atomic_load(&g_midi.clock_jitter_us);     stats->midiClockJitterMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_midi.clock_jitter_max_us); stats->midiClockJitterMaxMs = (v < 0) ? -1.0 : v / 1000.0;
+     stats->midiClockSent = atomic_load(&g_midi.clock_sent);
+     v = atomic_load(&g_midi.clock_late_us);       stats->midiClockLateMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_midi.clock_late_max_us);   stats->midiClockLateMaxMs = (v < 0) ? -1.0 : v / 1000.0;
+     stats->automationMode = (AudioAutomationMode)atomic_load(&g_automation.mode);
+     stats->automationPoints = atomic_load(&g_automation.points);
+     stats->automationBytes = atomic_load(&g_automation.bytes);
+     stats->automationDropped = atomic_load(&g_automation.dropped);
+     stats->keyNotes = atomic_load(&g_midi.key_notes);
+     v = atomic_load(&g_midi.key_last_us); stats->keyLatencyMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_midi.key_min_us);  stats->keyLatencyMinMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_midi.key_max_us);  stats->keyLatencyMaxMs = (v < 0) ? -1.0 : v / 1000.0;
+     v = atomic_load(&g_midi.key_avg_us);  stats->keyLatencyAvgMs = (v < 0) ? -1.0 : v / 1000.0;
+ }
+
+ /**
+  * @brief Prints the statistics of the stream that is about to be closed.
+  */
+ static void print_stats_summary(void) {
+     AudioStats st;
+     audio_get_stats(&st);
+     printf("Audio stats [%s]: callbacks=%llu frames=%llu xruns=%lu", st.backend, st.callbacks, st.framesRendered, st.xruns);
+     if (st.dacLatencyAvgMs >= 0.0) {
+         printf(" callback-to-DAC latency avg=%.2fms min=%.2fms max=%.2fms", st.dacLatencyAvgMs, st.dacLatencyMinMs, st.dacLatencyMaxMs);
+     }
+     if (st.lookaheadFrames > 0) {
+         printf(" lookahead=%lu frames (min fill %lu, underruns %lu)", st.lookaheadFrames, st.lookaheadMinFill, st.lookaheadUnderruns);
+     }
+     if (st.cpuLoad >= 0.0) {
+         printf(" load avg=%.0f%% peak=%.0f%%", 100.0 * st.cpuLoad, 100.0 * st.cpuLoadPeak);
+     }
+     if (st.srcLoad >= 0.0) {
+         printf(" resampler %.0f->%.0fHz %s (+%.2fms, load %.1f%%)", st.srcEngineRate, st.srcDeviceRate,
+                st.srcQuality, st.srcLatencyMs, 100.0 * st.srcLoad);
+     }
+     if (st.duplexLatencyMs >= 0.0) {
+         printf(" input %s round-trip=%.2fms (min %.2fms, max %.2fms)", st.inputMode, st.duplexLatencyMs,
+                st.duplexLatencyMinMs, st.duplexLatencyMaxMs);
+     }
+     if (st.convertLoad >= 0.0) {
+         printf(" output %s dither=%s (convert load %.2f%%)", st.sampleFormat, st.dither, 100.0 * st.convertLoad);
+     }
+     if (st.adaptive) {
+         printf(" adaptive %s=%lu frames (%.1fms, %lu up, %lu down)", st.adaptiveTarget, st.adaptiveFrames,
+                st.adaptiveLatencyMs, st.adaptiveStepsUp, st.adaptiveStepsDown);
+     }
+     if (st.restarts > 0) {
+         printf(" restarts=%lu (last gap %.1fms, max %.1fms)", st.restarts, st.restartGapMs, st.restartGapMaxMs);
+     }
+     if (st.watchdogOutages > 0) {
+         printf(" outages=%lu (recovered %lu, failed restarts %lu", st.watchdogOutages, st.watchdogRecoveries, st.watchdogFailedRestarts);
+         if (st.watchdogOutageMs >= 0.0) printf(", last %.0fms", st.watchdogOutageMs);
+         printf(")");
+     }
+     if (st.midiEvents > 0 || st.midiDroppedEvents > 0) {
+         printf(" midi=%lu events (late %lu, dropped %lu, coalesced %lu)", st.midiEvents, st.midiLateEvents,
+                st.midiDroppedEvents, st.midiCoalescedEvents);
+     }
+     if (st.mpeNotes > 0) {
+         printf(" mpe=%lu notes (peak %lu voices, stolen %lu)", st.mpeNotes, st.mpeVoicesPeak, st.mpeStolen);
+     }
+     if (st.arpNotes > 0) printf(" arp=%lu notes", st.arpNotes);
+     if (st.seqSteps > 0) printf(" seq=%lu steps prerenders=%lu", st.seqSteps, st.seqPrerenders);
+     if (st.midiClockTicks > 0) {
+         printf(" clock-in=%lu ticks tempo=%.2f (%s, lost %lu", st.midiClockTicks, st.midiClockTempo,
+                st.midiClockLocked ? "locked" : "unlocked", st.midiClockLost);
+         if (st.midiClockJitterMs >= 0.0) printf(", jitter rms=%.3fms max=%.3fms", st.midiClockJitterMs, st.midiClockJitterMaxMs);
+         printf(")");
+     }
+     if (st.midiClockSent > 0) {
+         printf(" clock-out=%lu ticks", st.midiClockSent);
+         if (st.midiClockLateMs >= 0.0) printf(" (late rms=%.3fms max=%.3fms)", st.midiClockLateMs, st.midiClockLateMaxMs);
+     }
+     if (st.automationPoints > 0) {
+         printf(" automation=%lu points (%lu bytes, dropped %lu)", st.automationPoints, st.automationBytes, st.automationDropped);
+     }
+     if (st.keyLatencyAvgMs >= 0.0) {
+         printf(" keys=%lu notes key-to-sound avg=%.2fms min=%.2fms max=%.2fms", st.keyNotes, st.keyLatencyAvgMs,
+                st.keyLatencyMinMs, st.keyLatencyMaxMs);
+     }
+     printf("\n");
+ }
+
+
+ // --- Per-Wave Render Helpers ---
+
+ /**
+  * @struct WaveParams
+  * @brief Synthesis parameters of one wave, copied from SharedSynthData at the start of a block.
+  */
+ typedef struct {
+     double freq, amp, attack_time, decay_time, sustain_level, release_time;
+     WaveformType wave;
+ } WaveParams;
+
+ /**
+  * @struct WaveVoice
+  * @brief Oscillator and envelope state of one wave, advanced by the audio thread.
+  */
+ typedef struct {
+     double phase;
+     double timeInStage;
+     double lastEnvValue; // Value captured at note-off (GUI or MIDI)
+     EnvelopeStage stage;
+     int note_active;
+ } WaveVoice;
+
+ /**
+  * @var g_mpe
+  * @brief The MPE voices: expression and allocation (see mpe.h) and the oscillators of both waves of each voice.
+  * @note Owned by the thread rendering the engine, like the note state of g_midi,
+  * which also holds the MPE counters.
+  */
+ static struct {
+     MpeVoices pool;
+     WaveVoice waves[MPE_MAX_VOICES][2];
+     double pitch[MPE_MAX_VOICES];  ///< Frequency of each voice's note before bending.
+ } g_mpe;
+
+ /** @brief Copies Wave 1 parameters and state out of the shared structure. Caller holds the mutex. */
+ static void read_wave1(const SharedSynthData *d, WaveParams *p, WaveVoice *v) {
+     p->freq = d->frequency; p->amp = d->amplitude; p->wave = d->waveform;
+     p->attack_time = d->attackTime; p->decay_time = d->decayTime;
+     p->sustain_level = d->sustainLevel; p->release_time = d->releaseTime;
+     v->note_active = d->note_active; v->stage = d->currentStage; v->phase = d->phase;
+     v->timeInStage = d->timeInStage; v->lastEnvValue = d->lastEnvValue;
+ }
+
+ /** @brief Copies Wave 2 parameters and state out of the shared structure. Caller holds the mutex. */
+ static void read_wave2(const SharedSynthData *d, WaveParams *p, WaveVoice *v) {
+     p->freq = d->frequency2; p->amp = d->amplitude2; p->wave = d->waveform2;
+     p->attack_time = d->attackTime2; p->decay_time = d->decayTime2;
+     p->sustain_level = d->sustainLevel2; p->release_time = d->releaseTime2;
+     v->note_active = d->note_active2; v->stage = d->currentStage2; v->phase = d->phase2;
+     v->timeInStage = d->timeInStage2; v->lastEnvValue = d->lastEnvValue2;
+ }
+
+ /** @brief Writes back the Wave 1 state modified by the audio thread. Caller holds the mutex. */
+ static void write_wave1_state(SharedSynthData *d, const WaveVoice *v) {
+     d->phase = v->phase; d->timeInStage = v->timeInStage; d->lastEnvValue = v->lastEnvValue;
+     d->currentStage = v->stage; d->note_active = v->note_active;
+ }
+
+ /** @brief Writes back the Wave 2 state modified by the audio thread. Caller holds the mutex. */
+ static void write_wave2_state(SharedSynthData *d, const WaveVoice *v) {
+     d->phase2 = v->phase; d->timeInStage2 = v->timeInStage; d->lastEnvValue2 = v->lastEnvValue;
+     d->currentStage2 = v->stage; d->note_active2 = v->note_active;
+ }
+
+ /**
+  * @brief Advances one wave by a single sample: ADSR envelope, oscillator and phase.
   *
-  * @note This function is conditionally non-static (`#ifdef TESTING`) to allow unit testing.
-  * @warning Must be real-time safe. Avoid blocking operations, excessive computation, or holding mutexes for too long.
+  * @param[in] p The wave's parameters for this block.
+  * @param[in,out] v The wave's oscillator/envelope state.
+  * @param time_increment Seconds per sample (1 / sample rate).
+  * @param sampleRate Sample rate in Hz, used for the phase increment.
+  * @param wave_num Wave number (1 or 2), used in diagnostics only.
+  * @return The enveloped sample of this wave.
   */
- #ifdef TESTING
- int paCallback( const void *inputBuffer, void *outputBuffer,
- #else
- static int paCallback( const void *inputBuffer, void *outputBuffer,
- #endif // TESTING
-                        unsigned long framesPerBuffer,
-                        const PaStreamCallbackTimeInfo* timeInfo,
-                        PaStreamCallbackFlags statusFlags,
-                        void *userData )
- {
-     SharedSynthData *shared_data = (SharedSynthData*)userData;
-     float *out = (float*)outputBuffer;
-     unsigned long i;
-     int ret_lock, ret_unlock;
- 
-     // --- Local copies for thread safety and reduced lock contention ---
- 
-     // Wave 1 Local Copies
-     double local_freq, local_amp, local_sustain_level, local_attack_time, local_decay_time, local_release_time;
-     WaveformType local_wave;
-     EnvelopeStage local_stage;
-     int local_note_active;
-     double local_phase;
-     double local_timeInStage;
-     double local_lastEnvValue; // Value captured by GUI thread at note-off
- 
-     // Wave 2 Local Copies
-     double local_freq2, local_amp2, local_sustain_level2, local_attack_time2, local_decay_time2, local_release_time2;
-     WaveformType local_wave2;
-     EnvelopeStage local_stage2;
-     int local_note_active2;
-     double local_phase2;
-     double local_timeInStage2;
-     double local_lastEnvValue2;
- 
-     // Common Local Copies
-     double local_sampleRate;
- 
-     // ADSR state variables local to the callback run
+ static inline float render_wave_sample(const WaveParams *p, WaveVoice *v, double time_increment, double sampleRate, int wave_num) {
      double env_multiplier = 0.0;
-     double env_multiplier2 = 0.0; // Envelope for Wave 2
-     double time_increment;
- 
-     // Check for PortAudio buffer issues
-     if (statusFlags & (paOutputUnderflow | paOutputOverflow)) {
-         fprintf(stderr, "PortAudio Warning: Buffer under/overflow detected (flags: %lu)\n", statusFlags);
+     float sample;
+
+     v->timeInStage += time_increment;
+
+     // State machine for the ADSR envelope
+     switch(v->stage)
+     {
+         case ENV_IDLE:
+             env_multiplier = 0.0;
+             break;
+         case ENV_ATTACK:
+             if (p->attack_time <= 0.0) { env_multiplier = p->amp; v->stage = ENV_DECAY; v->timeInStage = 0.0; }
+             else { env_multiplier = p->amp * fmin(1.0, (v->timeInStage / p->attack_time)); }
+             if (v->timeInStage >= p->attack_time) { env_multiplier = p->amp; v->stage = ENV_DECAY; v->timeInStage = 0.0; }
+             break;
+         case ENV_DECAY:
+              if (p->decay_time <= 0.0 || p->sustain_level >= 1.0) { env_multiplier = p->amp * p->sustain_level; v->stage = ENV_SUSTAIN; v->timeInStage = 0.0; }
+              else { double decay_factor = fmin(1.0, v->timeInStage / p->decay_time); env_multiplier = p->amp * (1.0 - (1.0 - p->sustain_level) * decay_factor); }
+             if (v->timeInStage >= p->decay_time) { env_multiplier = p->amp * p->sustain_level; v->stage = ENV_SUSTAIN; v->timeInStage = 0.0; }
+             if (env_multiplier < p->amp * p->sustain_level) { env_multiplier = p->amp * p->sustain_level; }
+             break;
+         case ENV_SUSTAIN:
+             env_multiplier = p->amp * p->sustain_level;
+             break;
+         case ENV_RELEASE:
+              if (p->release_time <= 0.0 || v->lastEnvValue <= 1e-9) { env_multiplier = 0.0; }
+              else { env_multiplier = v->lastEnvValue * fmax(0.0, (1.0 - (v->timeInStage / p->release_time))); }
+              if (v->timeInStage >= p->release_time || env_multiplier <= 1e-9) { env_multiplier = 0.0; v->stage = ENV_IDLE; v->note_active = 0; }
+             break;
+          default:
+             fprintf(stderr, "Warning: Unknown envelope stage %d for Wave %d\n", v->stage, wave_num);
+             env_multiplier = 0.0; v->stage = ENV_IDLE; v->note_active = 0;
+             break;
      }
- 
-     // --- Short Critical Section: Read Shared Parameters and State ---
-     ret_lock = pthread_mutex_lock(&shared_data->mutex);
-     if (ret_lock != 0) {
-         fprintf(stderr, "CRITICAL: Error in paCallback lock (read): %s. Outputting silence.\n", strerror(ret_lock));
-         // Output silence to prevent garbage audio
-         for( i = 0; i < framesPerBuffer; i++ ) { *out++ = 0.0f; }
-         return paAbort; // Abort stream on critical lock failure
+     env_multiplier = fmax(0.0, fmin(p->amp, env_multiplier)); // Clamp envelope
+
+     // Generate the sample
+     if (env_multiplier > 1e-9) {
+         switch(p->wave) {
+              case WAVE_SINE:     sample = (float)(sin(v->phase)); break;
+              case WAVE_SQUARE:   sample = (float)((sin(v->phase) >= 0.0 ? 1.0 : -1.0)); break;
+              case WAVE_SAWTOOTH: sample = (float)((fmod(v->phase, 2.0 * M_PI) / M_PI) - 1.0); break;
+              case WAVE_TRIANGLE: sample = (float)((2.0 / M_PI) * asin(sin(v->phase))); break;
+              default:            sample = 0.0f; break;
+         }
+         sample *= env_multiplier; // Apply envelope
+         // Update phase
+         v->phase += 2.0 * M_PI * p->freq / sampleRate;
+         v->phase = fmod(v->phase, 2.0 * M_PI); if (v->phase < 0.0) v->phase += 2.0 * M_PI;
+     } else {
+         sample = 0.0f;
      }
- 
-     // Copy necessary data from shared structure to local variables
-     // Wave 1
-     local_freq = shared_data->frequency;
-     local_amp = shared_data->amplitude;
-     local_wave = shared_data->waveform;
-     local_note_active = shared_data->note_active;
-     local_stage = shared_data->currentStage;
-     local_attack_time = shared_data->attackTime;
-     local_decay_time = shared_data->decayTime;
-     local_sustain_level = shared_data->sustainLevel;
-     local_release_time = shared_data->releaseTime;
-     local_phase = shared_data->phase;
-     local_timeInStage = shared_data->timeInStage;
-     local_lastEnvValue = shared_data->lastEnvValue;
- 
-     // Wave 2
-     local_freq2 = shared_data->frequency2;
-     local_amp2 = shared_data->amplitude2;
-     local_wave2 = shared_data->waveform2;
-     local_note_active2 = shared_data->note_active2;
-     local_stage2 = shared_data->currentStage2;
-     local_attack_time2 = shared_data->attackTime2;
-     local_decay_time2 = shared_data->decayTime2;
-     local_sustain_level2 = shared_data->sustainLevel2;
-     local_release_time2 = shared_data->releaseTime2;
-     local_phase2 = shared_data->phase2;
-     local_timeInStage2 = shared_data->timeInStage2;
-     local_lastEnvValue2 = shared_data->lastEnvValue2;
- 
-     // Common
-     local_sampleRate = shared_data->sampleRate;
- 
-     // Unlock mutex as quickly as possible
-     ret_unlock = pthread_mutex_unlock(&shared_data->mutex);
-      if (ret_unlock != 0) {
-          fprintf(stderr, "CRITICAL Error in paCallback unlock (read): %s\n", strerror(ret_unlock));
-          // Data might be inconsistent, but try to generate silence before aborting
-          for( i = 0; i < framesPerBuffer; i++ ) { *out++ = 0.0f; }
-          return paAbort;
+     return sample;
+ }
+
+
+ /**
+  * @brief Advances every sounding MPE voice by a single sample and mixes them.
+  *
+  * Each voice plays both waves at its note's pitch (wave 2 at the GUI's interval
+  * to wave 1) bent by its pitch bend ramp. Pressure raises the level from the
+  * note's velocity towards full, timbre fades from wave 1 (0) to wave 2 (1),
+  * both waves playing fully at the centre.
+  *
+  * @param[in] params1,params2 The playing parameters, of which the voices use everything but the frequency.
+  */
+ static inline float render_mpe_sample(const WaveParams *params1, const WaveParams *params2, double time_increment, double sampleRate) {
+     MpeVoices *m = &g_mpe.pool;
+     const double interval = (params1->freq > 0.0) ? params2->freq / params1->freq : 1.0;
+     WaveParams q1 = *params1, q2 = *params2;
+     float mix = 0.0f;
+
+     for (uint64_t bits = m->active; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         float bend = (m->value[MPE_BEND][v] += m->step[MPE_BEND][v]);
+         float pressure = (m->value[MPE_PRESSURE][v] += m->step[MPE_PRESSURE][v]);
+         float timbre = (m->value[MPE_TIMBRE][v] += m->step[MPE_TIMBRE][v]);
+         float gain = m->velocity[v] + (1.0f - m->velocity[v]) * pressure;
+
+         q1.freq = g_mpe.pitch[v] * exp2(bend / 12.0);
+         q2.freq = q1.freq * interval;
+         mix += gain * (fminf(1.0f, 2.0f - 2.0f * timbre) * render_wave_sample(&q1, &g_mpe.waves[v][0], time_increment, sampleRate, 1) +
+                        fminf(1.0f, 2.0f * timbre) * render_wave_sample(&q2, &g_mpe.waves[v][1], time_increment, sampleRate, 2));
      }
-     // --- End Read Critical Section ---
- 
+     return mix;
+ }
+
+ /**
+  * @brief Generates and mixes a run of samples from local copies of both waves, and the MPE voices.
+  * @note No shared data is touched, so the caller must not hold the mutex.
+  */
+ static void render_span(const WaveParams *params1, WaveVoice *voice1,
+                         const WaveParams *params2, WaveVoice *voice2,
+                         double sampleRate, float *out, unsigned long framesPerBuffer) {
      // Calculate time increment per sample
-     time_increment = 1.0 / local_sampleRate;
- 
-     // --- Audio Generation Loop (Mutex is NOT HELD) ---
-     for( i = 0; i < framesPerBuffer; i++ )
+     double time_increment = 1.0 / sampleRate;
+
+     for (unsigned long i = 0; i < framesPerBuffer; i++)
      {
-         float sample = 0.0f;
-         float sample2 = 0.0f; // Sample for Wave 2
-         float mixed_sample = 0.0f;
- 
-         // ==================== WAVE 1 Processing ====================
-         local_timeInStage += time_increment;
- 
-         // State machine for Wave 1 ADSR envelope
-         switch(local_stage)
-         {
-             case ENV_IDLE:
-                 env_multiplier = 0.0;
-                 break;
-             case ENV_ATTACK:
-                 if (local_attack_time <= 0.0) { env_multiplier = local_amp; local_stage = ENV_DECAY; local_timeInStage = 0.0; }
-                 else { env_multiplier = local_amp * fmin(1.0, (local_timeInStage / local_attack_time)); }
-                 if (local_timeInStage >= local_attack_time) { env_multiplier = local_amp; local_stage = ENV_DECAY; local_timeInStage = 0.0; }
-                 break;
-             case ENV_DECAY:
-                  if (local_decay_time <= 0.0 || local_sustain_level >= 1.0) { env_multiplier = local_amp * local_sustain_level; local_stage = ENV_SUSTAIN; local_timeInStage = 0.0; }
-                  else { double decay_factor = fmin(1.0, local_timeInStage / local_decay_time); env_multiplier = local_amp * (1.0 - (1.0 - local_sustain_level) * decay_factor); }
-                 if (local_timeInStage >= local_decay_time) { env_multiplier = local_amp * local_sustain_level; local_stage = ENV_SUSTAIN; local_timeInStage = 0.0; }
-                 if (env_multiplier < local_amp * local_sustain_level) { env_multiplier = local_amp * local_sustain_level; }
-                 break;
-             case ENV_SUSTAIN:
-                 env_multiplier = local_amp * local_sustain_level;
-                 break;
-             case ENV_RELEASE:
-                  if (local_release_time <= 0.0 || local_lastEnvValue <= 1e-9) { env_multiplier = 0.0; }
-                  else { env_multiplier = local_lastEnvValue * fmax(0.0, (1.0 - (local_timeInStage / local_release_time))); }
-                  if (local_timeInStage >= local_release_time || env_multiplier <= 1e-9) { env_multiplier = 0.0; local_stage = ENV_IDLE; local_note_active = 0; }
-                 break;
-              default:
-                 fprintf(stderr, "Warning: Unknown envelope stage %d for Wave 1\n", local_stage);
-                 env_multiplier = 0.0; local_stage = ENV_IDLE; local_note_active = 0;
-                 break;
-         }
-         env_multiplier = fmax(0.0, fmin(local_amp, env_multiplier)); // Clamp envelope
- 
-         // Generate Wave 1 Sample
-         if (env_multiplier > 1e-9) {
-             switch(local_wave) {
-                  case WAVE_SINE:     sample = (float)(sin(local_phase)); break;
-                  case WAVE_SQUARE:   sample = (float)((sin(local_phase) >= 0.0 ? 1.0 : -1.0)); break;
-                  case WAVE_SAWTOOTH: sample = (float)((fmod(local_phase, 2.0 * M_PI) / M_PI) - 1.0); break;
-                  case WAVE_TRIANGLE: sample = (float)((2.0 / M_PI) * asin(sin(local_phase))); break;
-                  default:            sample = 0.0f; break;
-             }
-             sample *= env_multiplier; // Apply envelope
-             // Update Phase 1
-             local_phase += 2.0 * M_PI * local_freq / local_sampleRate;
-             local_phase = fmod(local_phase, 2.0 * M_PI); if (local_phase < 0.0) local_phase += 2.0 * M_PI;
-         } else {
-             sample = 0.0f;
-             // Reset phase when idle?
-             // if (local_stage == ENV_IDLE && local_phase != 0.0) { local_phase = 0.0; }
-         }
- 
-         // ==================== WAVE 2 Processing ====================
-         local_timeInStage2 += time_increment;
- 
-         // State machine for Wave 2 ADSR envelope
-         switch(local_stage2)
-         {
-             case ENV_IDLE:
-                 env_multiplier2 = 0.0;
-                 break;
-             case ENV_ATTACK:
-                 if (local_attack_time2 <= 0.0) { env_multiplier2 = local_amp2; local_stage2 = ENV_DECAY; local_timeInStage2 = 0.0; }
-                 else { env_multiplier2 = local_amp2 * fmin(1.0, (local_timeInStage2 / local_attack_time2)); }
-                 if (local_timeInStage2 >= local_attack_time2) { env_multiplier2 = local_amp2; local_stage2 = ENV_DECAY; local_timeInStage2 = 0.0; }
-                 break;
-             case ENV_DECAY:
-                  if (local_decay_time2 <= 0.0 || local_sustain_level2 >= 1.0) { env_multiplier2 = local_amp2 * local_sustain_level2; local_stage2 = ENV_SUSTAIN; local_timeInStage2 = 0.0; }
-                  else { double decay_factor2 = fmin(1.0, local_timeInStage2 / local_decay_time2); env_multiplier2 = local_amp2 * (1.0 - (1.0 - local_sustain_level2) * decay_factor2); }
-                 if (local_timeInStage2 >= local_decay_time2) { env_multiplier2 = local_amp2 * local_sustain_level2; local_stage2 = ENV_SUSTAIN; local_timeInStage2 = 0.0; }
-                 if (env_multiplier2 < local_amp2 * local_sustain_level2) { env_multiplier2 = local_amp2 * local_sustain_level2; }
-                 break;
-             case ENV_SUSTAIN:
-                 env_multiplier2 = local_amp2 * local_sustain_level2;
-                 break;
-             case ENV_RELEASE:
-                  if (local_release_time2 <= 0.0 || local_lastEnvValue2 <= 1e-9) { env_multiplier2 = 0.0; }
-                  else { env_multiplier2 = local_lastEnvValue2 * fmax(0.0, (1.0 - (local_timeInStage2 / local_release_time2))); }
-                  if (local_timeInStage2 >= local_release_time2 || env_multiplier2 <= 1e-9) { env_multiplier2 = 0.0; local_stage2 = ENV_IDLE; local_note_active2 = 0; }
-                 break;
-              default:
-                 fprintf(stderr, "Warning: Unknown envelope stage %d for Wave 2\n", local_stage2);
-                 env_multiplier2 = 0.0; local_stage2 = ENV_IDLE; local_note_active2 = 0;
-                 break;
-         }
-         env_multiplier2 = fmax(0.0, fmin(local_amp2, env_multiplier2)); // Clamp envelope 2
- 
-         // Generate Wave 2 Sample
-         if (env_multiplier2 > 1e-9) {
-             switch(local_wave2) {
-                  case WAVE_SINE:     sample2 = (float)(sin(local_phase2)); break;
-                  case WAVE_SQUARE:   sample2 = (float)((sin(local_phase2) >= 0.0 ? 1.0 : -1.0)); break;
-                  case WAVE_SAWTOOTH: sample2 = (float)((fmod(local_phase2, 2.0 * M_PI) / M_PI) - 1.0); break;
-                  case WAVE_TRIANGLE: sample2 = (float)((2.0 / M_PI) * asin(sin(local_phase2))); break;
-                  default:            sample2 = 0.0f; break;
-             }
-             sample2 *= env_multiplier2; // Apply envelope 2
-             // Update Phase 2
-             local_phase2 += 2.0 * M_PI * local_freq2 / local_sampleRate;
-             local_phase2 = fmod(local_phase2, 2.0 * M_PI); if (local_phase2 < 0.0) local_phase2 += 2.0 * M_PI;
-         } else {
-             sample2 = 0.0f;
-             //  Reset phase when idle?
-             // if (local_stage2 == ENV_IDLE && local_phase2 != 0.0) { local_phase2 = 0.0; }
-         }
- 
-         // ==================== Mix and Write Output ====================
-         // Mix samples (simple addition, might need clipping or scaling later)
-         mixed_sample = sample + sample2;
- 
-         // Simple clipping to prevent exceeding -1.0 to 1.0 range
+         float sample = render_wave_sample(params1, voice1, time_increment, sampleRate, 1);
+         float sample2 = render_wave_sample(params2, voice2, time_increment, sampleRate, 2);
+
+         // Mix samples (simple addition) with simple clipping to the -1.0 to 1.0 range
+         float mixed_sample = sample + sample2;
+         if (g_mpe.pool.active != 0) mixed_sample += render_mpe_sample(params1, params2, time_increment, sampleRate);
          if (mixed_sample > 1.0f) mixed_sample = 1.0f;
          else if (mixed_sample < -1.0f) mixed_sample = -1.0f;
- 
-         // Write the final mixed sample to the output buffer
+
          *out++ = mixed_sample;
      }
-     // --- End Audio Generation Loop ---
- 
-     // --- Short Critical Section: Write Back Updated State ---
-     // Lock mutex to safely update shared state variables
-     ret_lock = pthread_mutex_lock(&shared_data->mutex);
-      if (ret_lock != 0) {
-         fprintf(stderr, "CRITICAL: Error in paCallback lock (write): %s. State lost.\n", strerror(ret_lock));
-         // Cannot safely update state. Abort stream to prevent inconsistent state.
-         return paAbort;
-     }
- 
-     // Write back state variables that were modified locally
-     // Wave 1
-     shared_data->phase = local_phase;
-     shared_data->timeInStage = local_timeInStage;
-     shared_data->currentStage = local_stage;
-     shared_data->note_active = local_note_active;
- 
-     // Wave 2
-     shared_data->phase2 = local_phase2;
-     shared_data->timeInStage2 = local_timeInStage2;
-     shared_data->currentStage2 = local_stage2;
-     shared_data->note_active2 = local_note_active2;
- 
-     // Unlock mutex
-     ret_unlock = pthread_mutex_unlock(&shared_data->mutex);
-      if (ret_unlock != 0) {
-          fprintf(stderr, "CRITICAL Error in paCallback unlock (write): %s\n", strerror(ret_unlock));
-          // Mutex state is potentially undefined. Abort stream.
-          return paAbort;
-     }
-     // --- End Write Critical Section ---
- 
-     // Signal PortAudio to continue processing
-     return paContinue; // paContinue = 0
  }
- 
- 
+
+
+ // --- MIDI Event Application ---
+
  /**
-  * @brief Initializes the PortAudio library and synth state for both waves.
-  *
+  * @brief Envelope level a voice has reached, as captured when its note is released.
+  */
+ static double envelope_level(const WaveParams *p, const WaveVoice *v) {
+     double env = 0.0;
+
+     switch (v->stage) {
+         case ENV_ATTACK:
+             env = (p->attack_time <= 0.0) ? p->amp : p->amp * fmin(1.0, v->timeInStage / p->attack_time);
+             break;
+         case ENV_DECAY:
+             if (p->decay_time <= 0.0 || p->sustain_level >= 1.0) env = p->amp * p->sustain_level;
+             else env = p->amp * (1.0 - (1.0 - p->sustain_level) * fmin(1.0, v->timeInStage / p->decay_time));
+             break;
+         case ENV_SUSTAIN:
+             env = p->amp * p->sustain_level;
+             break;
+         default:
+             break;
+     }
+     return fmax(0.0, fmin(p->amp, env));
+ }
+
+ /** @brief Starts a voice's attack, like the GUI note button (the phase restarts only from silence). */
+ static void voice_trigger(WaveVoice *v) {
+     if (v->stage == ENV_IDLE) v->phase = 0.0;
+     v->note_active = 1;
+     v->stage = ENV_ATTACK;
+     v->timeInStage = 0.0;
+     v->lastEnvValue = 0.0;
+ }
+
+ /** @brief Moves a sounding voice into its release from the level it has reached. */
+ static void voice_release(const WaveParams *p, WaveVoice *v) {
+     if (v->stage == ENV_IDLE || v->stage == ENV_RELEASE) return;
+     v->lastEnvValue = envelope_level(p, v);
+     v->stage = ENV_RELEASE;
+     v->timeInStage = 0.0;
+ }
+
+ /** @brief Field of the block's GUI parameters a SynthParam refers to. */
+ static double *wave_param_field(WaveParams *p1, WaveParams *p2, SynthParam param) {
+     WaveParams *p = (param < SYNTH_PARAM_FREQ2) ? p1 : p2;
+     switch (param) {
+         case SYNTH_PARAM_FREQ1:    case SYNTH_PARAM_FREQ2:    return &p->freq;
+         case SYNTH_PARAM_AMP1:     case SYNTH_PARAM_AMP2:     return &p->amp;
+         case SYNTH_PARAM_ATTACK1:  case SYNTH_PARAM_ATTACK2:  return &p->attack_time;
+         case SYNTH_PARAM_DECAY1:   case SYNTH_PARAM_DECAY2:   return &p->decay_time;
+         case SYNTH_PARAM_SUSTAIN1: case SYNTH_PARAM_SUSTAIN2: return &p->sustain_level;
+         default:                                              return &p->release_time;
+     }
+ }
+
+ /** @brief Value of the block's GUI parameters a SynthParam refers to. */
+ static double wave_param_value(const WaveParams *p1, const WaveParams *p2, SynthParam param) {
+     const WaveParams *p = (param < SYNTH_PARAM_FREQ2) ? p1 : p2;
+     switch (param) {
+         case SYNTH_PARAM_FREQ1:    case SYNTH_PARAM_FREQ2:    return p->freq;
+         case SYNTH_PARAM_AMP1:     case SYNTH_PARAM_AMP2:     return p->amp;
+         case SYNTH_PARAM_ATTACK1:  case SYNTH_PARAM_ATTACK2:  return p->attack_time;
+         case SYNTH_PARAM_DECAY1:   case SYNTH_PARAM_DECAY2:   return p->decay_time;
+         case SYNTH_PARAM_SUSTAIN1: case SYNTH_PARAM_SUSTAIN2: return p->sustain_level;
+         default:                                              return p->release_time;
+     }
+ }
+
+ /** @brief Field of the shared data a SynthParam refers to. */
+ static double *shared_param_field(SharedSynthData *d, SynthParam param) {
+     switch (param) {
+         case SYNTH_PARAM_FREQ1:    return &d->frequency;
+         case SYNTH_PARAM_AMP1:     return &d->amplitude;
+         case SYNTH_PARAM_ATTACK1:  return &d->attackTime;
+         case SYNTH_PARAM_DECAY1:   return &d->decayTime;
+         case SYNTH_PARAM_SUSTAIN1: return &d->sustainLevel;
+         case SYNTH_PARAM_RELEASE1: return &d->releaseTime;
+         case SYNTH_PARAM_FREQ2:    return &d->frequency2;
+         case SYNTH_PARAM_AMP2:     return &d->amplitude2;
+         case SYNTH_PARAM_ATTACK2:  return &d->attackTime2;
+         case SYNTH_PARAM_DECAY2:   return &d->decayTime2;
+         case SYNTH_PARAM_SUSTAIN2: return &d->sustainLevel2;
+         default:                   return &d->releaseTime2;
+     }
+ }
+
+ /** @brief Clears the assignment table on first use. Caller holds `g_midiMap.lock`. */
+ static void midi_map_ensure_initialised(void) {
+     if (!g_midiMap.initialised) {
+         midimap_init(&g_midiMap.map);
+         g_midiMap.initialised = 1;
+     }
+ }
+
+ /**
+  * @brief Refreshes the render thread's copy of the assignments if they changed.
+  * @note Only try-locks: if a writer holds the table, the copy is refreshed a block later.
+  */
+ static void midi_refresh_map(void) {
+     unsigned int generation = atomic_load_explicit(&g_midiMap.generation, memory_order_acquire);
+
+     if (generation == g_midi.map_generation || pthread_mutex_trylock(&g_midiMap.lock) != 0) return;
+     midi_map_ensure_initialised();
+     g_midi.map = g_midiMap.map;
+     g_midi.map_generation = atomic_load_explicit(&g_midiMap.generation, memory_order_relaxed);
+     pthread_mutex_unlock(&g_midiMap.lock);
+ }
+
+ /**
+  * @brief Value of a controller event: the latest one received if later messages were merged into it.
+  */
+ static int midi_control_value(const MidiEvent *ev) {
+     int channel = ev->channel & 0x0f;
+
+     if (ev->data1 < MIDI_MAP_CONTROLLERS &&
+         atomic_exchange_explicit(&g_midi.cc_queued[channel][ev->data1], 0, memory_order_acq_rel)) {
+         return atomic_load_explicit(&g_midi.cc_value[channel][ev->data1], memory_order_relaxed);
+     }
+     return ev->data2;
+ }
+
+ /**
+  * @brief Queues a parameter change for the automation recorder.
+  * @param frame Engine frame the change took effect at.
+  */
+ static void automation_push(int param, uint64_t frame, double value) {
+     MidiEvent ev = { .frame = frame - g_automation.start, .type = MIDI_EVENT_PARAM, .data1 = (uint8_t)param,
+                      .data2 = (uint8_t)g_automation.render_generation, .value = value };
+
+     if (!midi_queue_push(&g_automation.queue, &ev)) atomic_fetch_add_explicit(&g_automation.dropped, 1, memory_order_relaxed);
+ }
+
+ /**
+  * @brief Sets a parameter in the block's GUI parameters and marks it for write_controller_params().
+  * While automation is recorded, the change is recorded at the frame of the event setting it.
+  */
+ static void midi_set_param(SynthParam param, double value, WaveParams *gui1, WaveParams *gui2) {
+     if (g_automation.render_mode == AUDIO_AUTOMATION_RECORD) automation_push(param, g_midi.input_frame, value);
+     g_midi.values[param] = value;
+     *wave_param_field(gui1, gui2, param) = value;
+     g_midi.changed |= 1u << param;
+ }
+
+ /**
+  * @brief Sets the parameters assigned to a controller in the block's GUI parameters.
+  * @return 1 if any parameter is assigned to the controller.
+  */
+ static int midi_map_control(int channel, int cc, int value, WaveParams *gui1, WaveParams *gui2) {
+     int mapped = 0;
+
+     if (g_midi.map_generation == 0) return 0;
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         if (!midimap_matches(&g_midi.map.params[i], channel, cc)) continue;
+         midi_set_param((SynthParam)i, midimap_scale(&g_midi.map.params[i], value), gui1, gui2);
+         mapped = 1;
+     }
+     return mapped;
+ }
+
+ /**
+  * @brief Writes the parameters set by controllers to the shared data. Caller holds the mutex.
+  */
+ static void write_controller_params(SharedSynthData *d) {
+     if (g_midi.changed == 0 && g_midi.waves_changed == 0) return;
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         if (g_midi.changed & (1u << i)) *shared_param_field(d, (SynthParam)i) = g_midi.values[i];
+     }
+     if (g_midi.waves_changed & 1u) d->waveform = g_midi.waves[0];
+     if (g_midi.waves_changed & 2u) d->waveform2 = g_midi.waves[1];
+     g_midi.changed = 0;
+     g_midi.waves_changed = 0;
+     atomic_fetch_add_explicit(&g_midi.param_updates, 1, memory_order_relaxed);
+ }
+
+ /**
+  * @brief Derives the parameters that play from the GUI's: overridden by the
+  * sequencer step's parameter locks, at the MIDI note's pitch (wave 2 keeps
+  * its interval to wave 1), scaled by velocity and volume.
+  */
+ static void midi_params(const WaveParams *gui1, const WaveParams *gui2, WaveParams *p1, WaveParams *p2) {
+     *p1 = *gui1;
+     *p2 = *gui2;
+     for (unsigned int bits = g_midi.locked; bits != 0; bits &= bits - 1) {
+         int param = __builtin_ctz(bits);
+         *wave_param_field(p1, p2, (SynthParam)param) = g_midi.locks[param];
+     }
+     if (g_midi.pitch > 0.0) {
+         p2->freq = (p1->freq > 0.0) ? g_midi.pitch * p2->freq / p1->freq : g_midi.pitch;
+         p1->freq = g_midi.pitch;
+     }
+     p1->amp *= g_midi.velocity * g_midi.volume;
+     p2->amp *= g_midi.velocity * g_midi.volume;
+ }
+
+ /** @brief Starts an MPE voice for a note. */
+ static void mpe_start_note(int channel, int note, int velocity) {
+     unsigned long sounding, peak;
+     unsigned long stolen = g_mpe.pool.stolen;
+     int v = mpe_note_on(&g_mpe.pool, channel, note, velocity);
+
+     g_mpe.pitch[v] = midi_note_to_freq(note);
+     voice_trigger(&g_mpe.waves[v][0]);
+     voice_trigger(&g_mpe.waves[v][1]);
+     atomic_fetch_add_explicit(&g_midi.mpe_notes, 1, memory_order_relaxed);
+     if (g_mpe.pool.stolen != stolen) atomic_fetch_add_explicit(&g_midi.mpe_stolen, 1, memory_order_relaxed);
+     sounding = (unsigned long)__builtin_popcountll(g_mpe.pool.active);
+     peak = atomic_load_explicit(&g_midi.mpe_peak, memory_order_relaxed);
+     if (sounding > peak) atomic_store_explicit(&g_midi.mpe_peak, sounding, memory_order_relaxed);
+ }
+
+ /** @brief Releases the MPE voices of `voices` (bit per voice). */
+ static void mpe_release_voices(uint64_t voices, const WaveParams *p1, const WaveParams *p2) {
+     for (uint64_t bits = voices; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         voice_release(p1, &g_mpe.waves[v][0]);
+         voice_release(p2, &g_mpe.waves[v][1]);
+     }
+ }
+
+ /**
+  * @brief Applies a note or expression event to the MPE voices.
+  * @return 1 if the event was consumed, 0 if it applies as in the monophonic mode.
+  */
+ static int mpe_apply(const MidiEvent *ev, int value, const WaveParams *p1, const WaveParams *p2) {
+     MpeVoices *m = &g_mpe.pool;
+     int v;
+
+     switch (ev->type) {
+         case MIDI_EVENT_NOTE_ON:
+             if (ev->data2 > 0) {
+                 mpe_start_note(ev->channel, ev->data1, ev->data2);
+                 return 1;
+             }
+             // fall through
+         case MIDI_EVENT_NOTE_OFF:
+             if ((v = mpe_note_off(m, ev->channel, ev->data1)) >= 0) mpe_release_voices((uint64_t)1 << v, p1, p2);
+             return 1;
+         case MIDI_EVENT_PITCH_BEND:
+             mpe_expression(m, ev->channel, MPE_BEND, ((ev->data2 << 7 | ev->data1) - MIDI_BEND_CENTRE) / (double)MIDI_BEND_CENTRE);
+             return 1;
+         case MIDI_EVENT_PRESSURE:
+             mpe_expression(m, ev->channel, MPE_PRESSURE, ev->data1 / 127.0);
+             return 1;
+         case MIDI_EVENT_CONTROL:
+             if (ev->data1 == MPE_CC_TIMBRE) {
+                 mpe_expression(m, ev->channel, MPE_TIMBRE, value / 127.0);
+             } else if (ev->data1 == MIDI_CC_ALL_NOTES_OFF) {
+                 m->held = 0;
+                 mpe_release_voices(m->active, p1, p2);
+             } else if (ev->data1 == MIDI_CC_ALL_SOUND_OFF) {
+                 for (uint64_t bits = m->active; bits != 0; bits &= bits - 1) mpe_free(m, __builtin_ctzll(bits));
+             }
+             return 0; // Mapped controllers and the volume still apply
+         default:
+             return 0;
+     }
+ }
+
+ /**
+  * @brief Frees the MPE voices whose envelopes have both finished.
+  */
+ static void mpe_collect_voices(void) {
+     for (uint64_t bits = g_mpe.pool.active; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         if (g_mpe.waves[v][0].stage == ENV_IDLE && g_mpe.waves[v][1].stage == ENV_IDLE) mpe_free(&g_mpe.pool, v);
+     }
+ }
+
+ /**
+  * @brief Applies one MIDI event to both waves at the current sample.
+  * With MPE on, notes and expression go to the MPE voices instead (see mpe_apply()).
+  *
+  * @param live Non-zero for an event of the MIDI input queue, whose controller messages may have been merged.
+  * @param[in,out] gui1,gui2 Parameters as set in the GUI, updated by mapped controllers and parameter events.
+  * @param[in,out] p1,p2 Parameters playing, updated for a new note, volume or parameter.
+  */
+ static void midi_apply(const MidiEvent *ev, int live, WaveParams *gui1, WaveParams *gui2,
+                        WaveParams *p1, WaveVoice *v1, WaveParams *p2, WaveVoice *v2) {
+     int value = (ev->type == MIDI_EVENT_CONTROL && live) ? midi_control_value(ev) : ev->data2;
+
+     if (mpe_enabled(&g_mpe.pool) && mpe_apply(ev, value, p1, p2)) return;
+     switch (ev->type) {
+         case MIDI_EVENT_NOTE_ON:
+             if (ev->data2 > 0) {
+                 // Last note priority: a new note retriggers both waves at its pitch
+                 g_midi.note = ev->data1;
+                 g_midi.pitch = midi_note_to_freq(ev->data1);
+                 g_midi.velocity = ev->data2 / 127.0;
+                 midi_params(gui1, gui2, p1, p2);
+                 voice_trigger(v1);
+                 voice_trigger(v2);
+                 break;
+             }
+             // Velocity 0 is a note off
+             // fall through
+         case MIDI_EVENT_NOTE_OFF:
+             if (ev->data1 == g_midi.note) {
+                 voice_release(p1, v1);
+                 voice_release(p2, v2);
+             }
+             break;
+         case MIDI_EVENT_CONTROL:
+             if (midi_map_control(ev->channel, ev->data1, value, gui1, gui2)) midi_params(gui1, gui2, p1, p2);
+             if (ev->data1 == MIDI_CC_VOLUME) {
+                 g_midi.volume = value / 127.0;
+                 midi_params(gui1, gui2, p1, p2);
+             } else if (ev->data1 == MIDI_CC_ALL_NOTES_OFF) {
+                 voice_release(p1, v1);
+                 voice_release(p2, v2);
+             } else if (ev->data1 == MIDI_CC_ALL_SOUND_OFF) {
+                 v1->stage = v2->stage = ENV_IDLE;
+                 v1->note_active = v2->note_active = 0;
+             }
+             break;
+         case MIDI_EVENT_PARAM:
+             if (ev->data1 < SYNTH_PARAM_COUNT) {
+                 midi_set_param((SynthParam)ev->data1, ev->value, gui1, gui2);
+                 midi_params(gui1, gui2, p1, p2);
+             }
+             break;
+         case MIDI_EVENT_WAVEFORM:
+             if (ev->data1 < 2 && ev->data2 <= WAVE_TRIANGLE) {
+                 g_midi.waves[ev->data1] = (WaveformType)ev->data2;
+                 g_midi.waves_changed |= 1u << ev->data1;
+                 (ev->data1 == 0 ? gui1 : gui2)->wave = (WaveformType)ev->data2;
+                 midi_params(gui1, gui2, p1, p2);
+             }
+             break;
+         default:
+             break;
+     }
+ }
+
+ /**
+  * @brief Hands a note to the arpeggiator instead of the voices while an arpeggiator mode is on.
+  *
+  * All notes off releases the arpeggiator's keys and all sound off also
+  * forgets its note; both still go on to the voices.
+  *
+  * @param frame Engine frame the event takes effect at.
+  * @return 1 if the arpeggiator took the event, 0 if midi_apply() should apply it.
+  */
+ static int midi_arp_input(const MidiEvent *ev, uint64_t frame) {
+     Arp *a = &g_midi.arp;
+
+     if (!arp_enabled(a)) return 0;
+     switch (ev->type) {
+         case MIDI_EVENT_NOTE_ON:
+             if (ev->data2 > 0) {
+                 arp_note_on(a, frame, ev->data1, ev->data2);
+                 return 1;
+             }
+             // fall through
+         case MIDI_EVENT_NOTE_OFF:
+             arp_note_off(a, ev->data1);
+             return 1;
+         case MIDI_EVENT_CONTROL:
+             if (ev->data1 == MIDI_CC_ALL_NOTES_OFF) arp_release_all(a);
+             else if (ev->data1 == MIDI_CC_ALL_SOUND_OFF) arp_silence(a);
+             return 0;
+         default:
+             return 0;
+     }
+ }
+
+ /**
+  * @brief Applies a step of the sequencer or the end of its note.
+  *
+  * A step replaces the parameter locks of the previous one with its own and,
+  * unless it is a rest, plays its note like a MIDI note on channel 1.
+  */
+ static void midi_seq_apply(const SeqEvent *sev, WaveParams *gui1, WaveParams *gui2,
+                            WaveParams *p1, WaveVoice *v1, WaveParams *p2, WaveVoice *v2) {
+     MidiEvent note = { .frame = sev->frame, .type = MIDI_EVENT_NOTE_OFF, .data1 = (uint8_t)sev->note };
+     const SeqStep *step = sev->step;
+
+     if (step != NULL) {
+         g_midi.locked = 0;
+         for (int i = 0; i < step->locks && i < SEQ_MAX_LOCKS; i++) {
+             if (step->lock[i].param < 0 || step->lock[i].param >= SYNTH_PARAM_COUNT) continue;
+             g_midi.locks[step->lock[i].param] = step->lock[i].value;
+             g_midi.locked |= 1u << step->lock[i].param;
+         }
+         midi_params(gui1, gui2, p1, p2);
+         atomic_fetch_add_explicit(&g_midi.seq_steps, 1, memory_order_relaxed);
+         if (step->velocity == 0) return;
+         note.type = MIDI_EVENT_NOTE_ON;
+         note.data2 = step->velocity;
+     }
+     midi_apply(&note, 0, gui1, gui2, p1, v1, p2, v2);
+ }
+
+ /**
+  * @brief Hands the sequencer the pattern of g_seqPattern if it changed; it starts on the next step from `frame`.
+  * A sequencer halted by a received Stop only notes the generation.
+  * @note Only try-locks: if a writer holds the pattern, it is picked up a block later.
+  */
+ static void seq_refresh_pattern(uint64_t frame) {
+     unsigned int generation = atomic_load_explicit(&g_seqPattern.generation, memory_order_acquire);
+
+     if (generation == g_midi.seq_generation || pthread_mutex_trylock(&g_seqPattern.lock) != 0) return;
+     if (g_midi.seq_on && !g_midi.seq_stopped) seq_set_pattern(&g_midi.seq, &g_seqPattern.pattern, frame);
+     g_midi.seq_generation = atomic_load_explicit(&g_seqPattern.generation, memory_order_relaxed);
+     pthread_mutex_unlock(&g_seqPattern.lock);
+     // A stopped sequencer leaves no step holding parameters
+     if (!seq_playing(&g_midi.seq)) g_midi.locked = 0;
+ }
+
+ /**
+  * @brief Asks the render thread to render `seqPrerenderMs` further ahead while only the sequencer plays.
+  *
+  * What the sequencer plays is fixed in advance, so rendering it early only
+  * costs the latency of live input. Pre-rendering therefore runs only while
+  * no input arrived for SEQ_PRERENDER_IDLE_SEC and rendering takes less than
+  * SEQ_PRERENDER_MAX_LOAD of the block time. Input ends it, but what was
+  * already rendered still plays first: the first input after a quiet second
+  * sounds up to `seqPrerenderMs` late, and the ring drains back to the
+  * lookahead as the device reads. Following a received MIDI clock, the
+  * sequencer is not fixed in advance, so it does not pre-render.
+  */
+ static void seq_update_prerender(double sampleRate) {
+     int want = g_midi.seq_prerender_ms > 0.0 && g_midi.clock_mode != MIDI_CLOCK_IN &&
+                seq_playing(&g_midi.seq) && lookahead_is_running() &&
+                g_midi.frame - g_midi.input_frame >= (uint64_t)(SEQ_PRERENDER_IDLE_SEC * sampleRate) &&
+                g_midi.render_load >= 0.0 && g_midi.render_load < SEQ_PRERENDER_MAX_LOAD;
+
+     if (want == g_midi.prerendering) return;
+     g_midi.prerendering = want;
+     lookahead_set_prerender(want ? (unsigned long)(g_midi.seq_prerender_ms * sampleRate / 1000.0 + 0.5) : 0);
+     if (want) atomic_fetch_add_explicit(&g_midi.seq_prerenders, 1, memory_order_relaxed);
+     atomic_store_explicit(&g_midi.seq_prerendering, want, memory_order_relaxed);
+ }
+
+ /** @brief Halts the sequencer for a received Stop; the note it plays ends at once. */
+ static void seq_halt(uint64_t frame) {
+     static const SeqPattern no_pattern; // Zeroed: no steps
+
+     g_midi.seq_stopped = 1;
+     seq_set_pattern(&g_midi.seq, &no_pattern, frame);
+     if (g_midi.seq.sounding >= 0) g_midi.seq.off_frame = frame;
+     g_midi.locked = 0;
+ }
+
+ /** @brief Resumes a halted sequencer from the step at or after `frame` (the pattern may wait a block, see seq_refresh_pattern()). */
+ static void seq_resume(uint64_t frame) {
+     if (!g_midi.seq_stopped) return;
+     g_midi.seq_stopped = 0;
+     g_midi.seq_generation = 0;
+     seq_refresh_pattern(frame);
+ }
+
+ /** @brief Publishes the received clock's tempo, lock and jitter to the statistics. */
+ static void midi_sync_publish(void) {
+     double rms_ms, max_ms;
+
+     atomic_store_explicit(&g_midi.clock_tempo_mbpm, (long)(midisync_tempo(&g_midi.sync) * 1000.0 + 0.5), memory_order_relaxed);
+     atomic_store_explicit(&g_midi.clock_locked, g_midi.sync.state == MIDISYNC_LOCKED, memory_order_relaxed);
+     if (midisync_jitter(&g_midi.sync, &rms_ms, &max_ms)) {
+         atomic_store_explicit(&g_midi.clock_jitter_us, (long)(rms_ms * 1000.0 + 0.5), memory_order_relaxed);
+         atomic_store_explicit(&g_midi.clock_jitter_max_us, (long)(max_ms * 1000.0 + 0.5), memory_order_relaxed);
+     }
+ }
+
+ /**
+  * @brief Follows MIDI clock and transport messages while `midiClock` is "in".
+  *
+  * Every tick goes to the tempo loop (see midisync.h), whose tempo and beat
+  * position then carry the arpeggiator's and sequencer's grids (arp_sync(),
+  * seq_sync()). The first tick with a tempo and the first after a Start
+  * restart the grids on that tick; a Start also holds the sequencer until
+  * then, so its first step plays on beat 0. Stop halts the sequencer until
+  * Start or Continue. The arpeggiator plays held notes on the clock's tempo
+  * either way, and a lost clock leaves both grids running on its last tempo.
+  *
+  * @param frame Engine frame the message is applied at (its tick frame may be earlier if it was late).
+  * @return 1 if the event was a clock or transport message (used or ignored), 0 for any other event.
+  */
+ static int midi_sync_input(const MidiEvent *ev, uint64_t frame) {
+     MidiSync *s = &g_midi.sync;
+     double beat_frame, beat, tempo;
+     int restart;
+
+     switch (ev->type) {
+         case MIDI_EVENT_CLOCK:
+             break;
+         case MIDI_EVENT_START:
+             if (g_midi.clock_mode != MIDI_CLOCK_IN) return 1;
+             midisync_start(s);
+             g_midi.sync_start = 1;
+             seq_halt(frame);
+             return 1;
+         case MIDI_EVENT_CONTINUE:
+             if (g_midi.clock_mode != MIDI_CLOCK_IN) return 1;
+             midisync_continue(s);
+             seq_resume(frame);
+             return 1;
+         case MIDI_EVENT_STOP:
+             if (g_midi.clock_mode != MIDI_CLOCK_IN) return 1;
+             midisync_stop(s);
+             g_midi.sync_start = 0;
+             seq_halt(frame);
+             return 1;
+         default:
+             return 0;
+     }
+     if (g_midi.clock_mode != MIDI_CLOCK_IN) return 1;
+
+     atomic_fetch_add_explicit(&g_midi.clock_ticks, 1, memory_order_relaxed);
+     if (midisync_tick(s, ev->frame)) {
+         restart = g_midi.sync_start || !g_midi.sync_following;
+         if (g_midi.sync_start) {
+             g_midi.sync_start = 0;
+             seq_resume(frame);
+         }
+         midisync_position(s, &beat_frame, &beat);
+         tempo = midisync_tempo(s);
+         arp_sync(&g_midi.arp, beat_frame, beat, tempo, frame, restart);
+         seq_sync(&g_midi.seq, beat_frame, beat, tempo, frame, restart);
+         g_midi.sync_following = 1;
+     }
+     midi_sync_publish();
+     return 1;
+ }
+
+ /**
+  * @brief Starts a block for MIDI clock sync: notices a lost received clock
+  * and queues the clock messages of the block for sending while `midiClock` is "out".
+  *
+  * Sent ticks follow the internal tempo from engine frame 0, where a Start
+  * precedes the first tick, so beat 0 of the clock is the first step of the
+  * arpeggiator's and sequencer's grids. Each tick is one period after the
+  * previous one, so a tempo or rate change only moves the ticks after it.
+  */
+ static void midi_sync_begin_block(uint64_t start, uint64_t end, double sampleRate) {
+     MidiEvent ev = { .type = MIDI_EVENT_START };
+     double period;
+
+     if (g_midi.clock_mode == MIDI_CLOCK_IN) {
+         midisync_set_sample_rate(&g_midi.sync, sampleRate);
+         if (midisync_check(&g_midi.sync, start)) {
+             // Keep the grids where they are until the clock is back
+             g_midi.sync_following = 0;
+             atomic_fetch_add_explicit(&g_midi.clock_lost, 1, memory_order_relaxed);
+             midi_sync_publish();
+         }
+         return;
+     }
+     if (g_midi.clock_mode != MIDI_CLOCK_OUT) return;
+
+     period = sampleRate * 60.0 / (g_midi.seq.tempo * MIDISYNC_PPQN);
+     for (;;) {
+         ev.frame = (uint64_t)(g_midi.clock_out_frame + 0.5);
+         if (ev.frame >= end) break;
+         if (g_midi.clock_out_tick == 0 && !midi_queue_push(&g_midi.clock_out, &ev)) break;
+         ev.type = MIDI_EVENT_CLOCK;
+         // A sender that cannot keep up loses ticks, which its receivers ride out as jitter
+         midi_queue_push(&g_midi.clock_out, &ev);
+         g_midi.clock_out_tick++;
+         g_midi.clock_out_frame += period;
+     }
+ }
+
+ /** @brief Positions the automation cursors at engine frame `frame`. */
+ static void automation_seek(uint64_t frame) {
+     uint64_t at = (uint64_t)((double)(frame - g_automation.start) / g_automation.ratio);
+
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         automation_cursor_seek(&g_automation.cursors[i], &g_automation.take.lanes[i], at);
+         uint64_t next = automation_cursor_next_frame(&g_automation.cursors[i]);
+         g_automation.due[i] = (next == AUTO_NEVER) ? AUTO_NEVER
+                                                    : g_automation.start + (uint64_t)((double)next * g_automation.ratio + 0.5);
+         if (g_automation.due[i] < frame) g_automation.due[i] = frame;
+     }
+ }
+
+ /**
+  * @brief Picks up automation requests and prepares the block at `start` for them.
+  *
+  * A new recording starts by recording the engine rate and every parameter;
+  * after that, parameters the block starts with that differ from the ones the
+  * previous block ended with were changed in the GUI and are recorded at the
+  * block start. Playback holds the take's lock for the block, or plays the
+  * block without automation if a request holds it.
+  */
+ static void automation_begin_block(uint64_t start, WaveParams *gui1, WaveParams *gui2, double sampleRate) {
+     unsigned int generation = atomic_load_explicit(&g_automation.generation, memory_order_acquire);
+     int mode;
+
+     g_automation.held = 0;
+     if (generation == g_automation.render_generation && g_automation.render_mode == AUDIO_AUTOMATION_OFF) return;
+     mode = atomic_load_explicit(&g_automation.mode, memory_order_relaxed);
+     if (mode == AUDIO_AUTOMATION_PLAY || g_automation.render_mode == AUDIO_AUTOMATION_PLAY) {
+         if (pthread_mutex_trylock(&g_automation.lock) != 0) {
+             g_automation.resync = 1;
+             return;
+         }
+         g_automation.held = 1;
+         // Under the lock the request cannot change
+         generation = atomic_load_explicit(&g_automation.generation, memory_order_relaxed);
+         mode = atomic_load_explicit(&g_automation.mode, memory_order_relaxed);
+     }
+
+     if (generation != g_automation.render_generation) {
+         g_automation.render_generation = generation;
+         g_automation.render_mode = (AudioAutomationMode)mode;
+         g_automation.start = start;
+         if (mode == AUDIO_AUTOMATION_PLAY) {
+             g_automation.ratio = sampleRate / g_automation.take.sample_rate;
+             automation_seek(start);
+             g_automation.resync = 0;
+         } else if (mode == AUDIO_AUTOMATION_RECORD) {
+             automation_push(AUTOMATION_RATE_RECORD, start, sampleRate);
+             for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+                 g_automation.last[i] = wave_param_value(gui1, gui2, (SynthParam)i);
+                 automation_push(i, start, g_automation.last[i]);
+             }
+         }
+     }
+
+     if (g_automation.render_mode == AUDIO_AUTOMATION_RECORD) {
+         for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+             double value = wave_param_value(gui1, gui2, (SynthParam)i);
+             if (value != g_automation.last[i]) automation_push(i, start, value);
+         }
+     } else if (g_automation.render_mode == AUDIO_AUTOMATION_PLAY) {
+         if (!g_automation.held) return;
+         if (g_automation.resync) automation_seek(start);
+         g_automation.resync = 0;
+     }
+ }
+
+ /** @brief Engine frame of the next automation value, AUTO_NEVER if none is due this block. */
+ static uint64_t automation_next_frame(void) {
+     uint64_t next = AUTO_NEVER;
+
+     if (!g_automation.held || g_automation.render_mode != AUDIO_AUTOMATION_PLAY) return AUTO_NEVER;
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         if (g_automation.due[i] < next) next = g_automation.due[i];
+     }
+     return next;
+ }
+
+ /**
+  * @brief Sets the parameters whose automation values are due at `frame` like a
+  * control interface event, so they are written back to the shared data.
+  */
+ static void automation_apply(uint64_t frame, WaveParams *gui1, WaveParams *gui2, WaveParams *p1, WaveParams *p2) {
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         AutoCursor *c = &g_automation.cursors[i];
+         double value;
+         uint64_t next;
+
+         while (g_automation.due[i] <= frame && automation_cursor_next(c, &value)) {
+             midi_set_param((SynthParam)i, value, gui1, gui2);
+             next = automation_cursor_next_frame(c);
+             g_automation.due[i] = (next == AUTO_NEVER) ? AUTO_NEVER
+                                                        : g_automation.start + (uint64_t)((double)next * g_automation.ratio + 0.5);
+         }
+         if (automation_cursor_next_frame(c) == AUTO_NEVER) g_automation.due[i] = AUTO_NEVER;
+     }
+     midi_params(gui1, gui2, p1, p2);
+ }
+
+ /** @brief Ends the block for automation: notes the parameters for the next one and releases the take. */
+ static void automation_end_block(const WaveParams *gui1, const WaveParams *gui2) {
+     if (g_automation.render_mode == AUDIO_AUTOMATION_RECORD) {
+         for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+             g_automation.last[i] = wave_param_value(gui1, gui2, (SynthParam)i);
+         }
+     }
+     if (g_automation.held) pthread_mutex_unlock(&g_automation.lock);
+     g_automation.held = 0;
+ }
+
+ /**
+  * @brief Moves the control interfaces' events into the schedule, which sorts them by frame.
+  *
+  * The events of a request share one frame and must apply together, so a
+  * run of events with the same frame moves only if the schedule has room for
+  * all of it; otherwise it stays queued until the schedule has played enough.
+  */
+ static void midi_drain_control(void) {
+     const MidiEvent *ev;
+
+     while ((ev = midi_queue_peek(&g_midi.control)) != NULL) {
+         const MidiEvent *next;
+         unsigned int run = 1;
+
+         while ((next = midi_queue_peek_at(&g_midi.control, run)) != NULL && next->frame == ev->frame) run++;
+         if (run > midi_schedule_space(&g_midi.schedule)) return;
+         for (unsigned int i = 0; i < run; i++) {
+             midi_schedule_push(&g_midi.schedule, midi_queue_peek(&g_midi.control));
+             midi_queue_pop(&g_midi.control);
+         }
+     }
+ }
+
+ /**
+  * @brief Records the key-to-sound latency of one note played on the computer keyboard.
+  */
+ static void record_key_latency(double latency_sec) {
+     long us = (long)(latency_sec * 1e6 + 0.5);
+     long min = atomic_load_explicit(&g_midi.key_min_us, memory_order_relaxed);
+     long max = atomic_load_explicit(&g_midi.key_max_us, memory_order_relaxed);
+     long avg = atomic_load_explicit(&g_midi.key_avg_us, memory_order_relaxed);
+
+     atomic_fetch_add_explicit(&g_midi.key_notes, 1, memory_order_relaxed);
+     atomic_store_explicit(&g_midi.key_last_us, us, memory_order_relaxed);
+     if (min < 0 || us < min) atomic_store_explicit(&g_midi.key_min_us, us, memory_order_relaxed);
+     if (us > max) atomic_store_explicit(&g_midi.key_max_us, us, memory_order_relaxed);
+     // Exponential moving average over roughly the last 16 notes
+     atomic_store_explicit(&g_midi.key_avg_us, (avg < 0) ? us : avg + (us - avg) / 16, memory_order_relaxed);
+ }
+
+ /**
+  * @brief Moves the computer keyboard's notes into the schedule.
+  *
+  * Note ons are also remembered in `key_pending` until midi_key_applied()
+  * takes their latency; beyond AUDIO_KEY_PENDING of them they play unmeasured.
+  */
+ static void midi_drain_keys(void) {
+     const MidiEvent *ev;
+
+     while ((ev = midi_queue_peek(&g_midi.keys)) != NULL) {
+         if (!midi_schedule_push(&g_midi.schedule, ev)) {
+             atomic_fetch_add_explicit(&g_midi.dropped, 1, memory_order_relaxed);
+         } else if (ev->type == MIDI_EVENT_NOTE_ON && ev->data2 > 0 && g_midi.key_pending_count < AUDIO_KEY_PENDING) {
+             unsigned int slot = (g_midi.key_pending_head + g_midi.key_pending_count++) % AUDIO_KEY_PENDING;
+             g_midi.key_pending[slot].frame = ev->frame;
+             g_midi.key_pending[slot].arrival = ev->value;
+             g_midi.key_pending[slot].note = ev->data1;
+         }
+         midi_queue_pop(&g_midi.keys);
+     }
+ }
+
+ /**
+  * @brief Takes the key-to-sound latency of a scheduled note on that render_block() just applied.
+  *
+  * The schedule hands events out by frame, so a keyboard note is the oldest
+  * pending one when it is applied; a note on of the control interfaces leaves
+  * the pending keys alone. The note sounds `offset` frames into the block that
+  * began rendering at `now`, plus the callback-to-DAC latency the stream
+  * reports; its latency is that time minus the time the key handler queued it.
+  *
+  * @param sounded 0 if the note went to the arpeggiator, which then plays it: no latency is taken.
+  */
+ static void midi_key_applied(const MidiEvent *ev, unsigned long offset, double now, double sampleRate, int sounded) {
+     long dac_us;
+     double sounds;
+
+     // Pending notes before this frame were dropped with the schedule they were in
+     while (g_midi.key_pending_count > 0 && g_midi.key_pending[g_midi.key_pending_head].frame < ev->frame) {
+         g_midi.key_pending_head = (g_midi.key_pending_head + 1) % AUDIO_KEY_PENDING;
+         g_midi.key_pending_count--;
+     }
+     if (g_midi.key_pending_count == 0 || g_midi.key_pending[g_midi.key_pending_head].frame != ev->frame ||
+         g_midi.key_pending[g_midi.key_pending_head].note != ev->data1) return;
+
+     if (sounded) {
+         dac_us = atomic_load_explicit(&g_stats.latency_last_us, memory_order_relaxed);
+         sounds = now + offset / sampleRate;
+         if (dac_us > 0) sounds += dac_us / 1e6;
+         record_key_latency(sounds - g_midi.key_pending[g_midi.key_pending_head].arrival);
+     }
+     g_midi.key_pending_head = (g_midi.key_pending_head + 1) % AUDIO_KEY_PENDING;
+     g_midi.key_pending_count--;
+ }
+
+ /**
+  * @brief Publishes the parameters a block ended with to g_params.
+  */
+ static void publish_params(const WaveParams *gui1, const WaveParams *gui2) {
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         atomic_store_explicit(&g_params.values[i], wave_param_value(gui1, gui2, (SynthParam)i), memory_order_relaxed);
+     }
+     atomic_store_explicit(&g_params.waves[0], (int)gui1->wave, memory_order_relaxed);
+     atomic_store_explicit(&g_params.waves[1], (int)gui2->wave, memory_order_relaxed);
+     atomic_store_explicit(&g_params.time_us, (long)(audio_time_now() * 1e6), memory_order_release);
+ }
+
+ /**
+  * @brief Returns the earliest event due before `end` from the MIDI queue or the schedule.
+  * @param[out] live Set to 1 if the event is the MIDI queue's, 0 if the schedule's.
+  * @return The event, or NULL if none is due.
+  */
+ static const MidiEvent *midi_next_due(uint64_t end, int *live) {
+     const MidiEvent *queued = midi_queue_peek(&g_midi.queue);
+     const MidiEvent *scheduled = midi_schedule_peek(&g_midi.schedule);
+
+     if (queued != NULL && queued->frame >= end) queued = NULL;
+     if (scheduled != NULL && scheduled->frame >= end) scheduled = NULL;
+     // On a tie the MIDI input goes first, it is the one a player is listening to
+     *live = (queued != NULL && (scheduled == NULL || queued->frame <= scheduled->frame));
+     return *live ? queued : scheduled;
+ }
+
+ /**
+  * @brief Generates and mixes one block, applying the MIDI events due in it at their sample offsets.
+  *
+  * Publishes the block start to the MIDI clock, then renders up to each due
+  * event, applies it and continues. Events whose frame already passed (the
+  * render loop fell behind the input) are applied at the start of the block.
+  * MIDI input and the schedule of control interface and computer keyboard
+  * events are merged by frame. Mapped controllers and parameter events change `params1`/`params2`
+  * and mark the values for write_controller_params(); the final values are
+  * published for audio_get_params(). With an arpeggiator mode on, the notes
+  * go to the arpeggiator (see midi_arp_input()), and the block is also split
+  * at the notes it plays; input due on the same frame goes first, so a chord
+  * struck on a step is played by that step. The sequencer's steps and note
+  * offs split the block the same way, after input and before the
+  * arpeggiator's notes on the same frame, and bypass the arpeggiator. Played
+  * automation splits the block at its values, before everything else due on
+  * the same frame, and changes parameters like a parameter event; while
+  * recording, every parameter change is recorded at the frame it was applied
+  * (GUI changes at the block start). MPE expression ramps from the block start
+  * or the event that changed it to the block end, and MPE voices whose
+  * envelopes finished return to the pool. MIDI clock and transport messages
+  * move the arpeggiator's and sequencer's grids (see midi_sync_input()), and
+  * the ticks sent for the block are queued for the MIDI thread.
+  *
+  * @note No shared data is touched, so the caller must not hold the mutex.
+  */
+ static void render_block(WaveParams *params1, WaveVoice *voice1,
+                          WaveParams *params2, WaveVoice *voice2,
+                          double sampleRate, float *out, unsigned long framesPerBuffer) {
+     const uint64_t start = g_midi.frame, end = start + framesPerBuffer;
+     WaveParams p1, p2;
+     unsigned long done = 0, offset;
+     const double now = audio_time_now();
+     const MidiEvent *ev;
+     int live, arp_first, seq_first, auto_first;
+     double load;
+
+     midi_clock_publish(&g_midi.clock, start, now, framesPerBuffer, sampleRate);
+     midi_refresh_map();
+     midi_drain_control();
+     midi_drain_keys();
+     seq_set_sample_rate(&g_midi.seq, sampleRate);
+     seq_refresh_pattern(start);
+     arp_set_sample_rate(&g_midi.arp, sampleRate);
+     midi_sync_begin_block(start, end, sampleRate);
+     automation_begin_block(start, params1, params2, sampleRate);
+     midi_params(params1, params2, &p1, &p2);
+     mpe_begin_block(&g_mpe.pool, framesPerBuffer);
+
+     for (;;) {
+         const uint64_t arp_at = arp_next_frame(&g_midi.arp);
+         const uint64_t seq_at = seq_next_frame(&g_midi.seq);
+         const uint64_t auto_at = automation_next_frame();
+         ev = midi_next_due(end, &live);
+         const uint64_t input_at = (ev != NULL) ? ev->frame : end;
+         auto_first = (auto_at < input_at && auto_at <= seq_at && auto_at <= arp_at);
+         seq_first = (!auto_first && seq_at < input_at && seq_at <= arp_at);
+         arp_first = (!auto_first && !seq_first && arp_at < input_at);
+         if (!auto_first && !seq_first && !arp_first && ev == NULL) break;
+         if (auto_first) {
+             offset = (auto_at < start + done) ? done : (unsigned long)(auto_at - start);
+         } else if (seq_first) {
+             offset = (unsigned long)(seq_at - start);
+         } else if (arp_first) {
+             offset = (unsigned long)(arp_at - start);
+         } else if (ev->frame < start) {
+             atomic_fetch_add_explicit(&g_midi.late, 1, memory_order_relaxed);
+             offset = 0;
+         } else {
+             offset = (unsigned long)(ev->frame - start);
+         }
+         if (offset > done) {
+             render_span(&p1, voice1, &p2, voice2, sampleRate, out + done, offset - done);
+             done = offset;
+         }
+         g_mpe.pool.remaining = framesPerBuffer - done; // Expression changes ramp over the rest of the block
+         if (auto_first) {
+             automation_apply(start + done, params1, params2, &p1, &p2);
+             continue;
+         }
+         if (seq_first) {
+             SeqEvent step;
+             seq_next(&g_midi.seq, &step);
+             midi_seq_apply(&step, params1, params2, &p1, voice1, &p2, voice2);
+             continue;
+         }
+         if (arp_first) {
+             MidiEvent note;
+             arp_next(&g_midi.arp, &note);
+             if (note.type == MIDI_EVENT_NOTE_ON) atomic_fetch_add_explicit(&g_midi.arp_notes, 1, memory_order_relaxed);
+             midi_apply(&note, 0, params1, params2, &p1, voice1, &p2, voice2);
+             continue;
+         }
+         if (!midi_sync_input(ev, start + done)) {
+             int sounded;
+             g_midi.input_frame = start + done;
+             sounded = !midi_arp_input(ev, start + done);
+             if (sounded) midi_apply(ev, live, params1, params2, &p1, voice1, &p2, voice2);
+             if (!live && ev->type == MIDI_EVENT_NOTE_ON && ev->data2 > 0) midi_key_applied(ev, done, now, sampleRate, sounded);
+         }
+         if (live) midi_queue_pop(&g_midi.queue);
+         else midi_schedule_pop(&g_midi.schedule);
+         atomic_fetch_add_explicit(&g_midi.applied, 1, memory_order_relaxed);
+     }
+     render_span(&p1, voice1, &p2, voice2, sampleRate, out + done, framesPerBuffer - done);
+     g_midi.frame = end;
+     automation_end_block(params1, params2);
+     publish_params(params1, params2);
+     mpe_end_block(&g_mpe.pool);
+     mpe_collect_voices();
+
+     // Once the last MIDI note has faded out the GUI frequencies play again
+     if (g_midi.note >= 0 && voice1->stage == ENV_IDLE && voice2->stage == ENV_IDLE) {
+         g_midi.note = -1;
+         g_midi.pitch = 0.0;
+         g_midi.velocity = 1.0;
+     }
+
+     // Render time against the block's duration, averaged over roughly the last 64 blocks
+     load = (audio_time_now() - now) * sampleRate / framesPerBuffer;
+     g_midi.render_load = (g_midi.render_load < 0.0) ? load : g_midi.render_load + (load - g_midi.render_load) / 64.0;
+     seq_update_prerender(sampleRate);
+ }
+
+
+ int audio_midi_clock_peek(MidiEvent *ev, double *time_sec) {
+     const MidiEvent *next = midi_queue_peek(&g_midi.clock_out);
+
+     if (next == NULL || (*time_sec = midi_clock_time(&g_midi.clock, next->frame)) < 0.0) return 0;
+     *ev = *next;
+     return 1;
+ }
+
+ void audio_midi_clock_sent(double late_sec) {
+     unsigned long sent;
+     long late_us = (late_sec > 0.0) ? (long)(late_sec * 1e6 + 0.5) : 0;
+     const MidiEventType type = midi_queue_peek(&g_midi.clock_out)->type;
+
+     midi_queue_pop(&g_midi.clock_out);
+     if (type != MIDI_EVENT_CLOCK) return;
+     sent = atomic_fetch_add_explicit(&g_midi.clock_sent, 1, memory_order_relaxed) + 1;
+     g_midi.clock_late_sq += (double)late_us * late_us;
+     atomic_store_explicit(&g_midi.clock_late_us, (long)(sqrt(g_midi.clock_late_sq / sent) + 0.5), memory_order_relaxed);
+     if (late_us > atomic_load_explicit(&g_midi.clock_late_max_us, memory_order_relaxed)) {
+         atomic_store_explicit(&g_midi.clock_late_max_us, late_us, memory_order_relaxed);
+     }
+ }
+
+ int audio_midi_schedule(const MidiEvent *ev) {
+     if (midi_queue_push(&g_midi.queue, ev)) return 1;
+     atomic_fetch_add_explicit(&g_midi.dropped, 1, memory_order_relaxed);
+     return 0;
+ }
+
+ /**
+  * @brief Completes an armed MIDI learn with the controller just received.
+  */
+ static void midi_learn_control(int channel, int cc) {
+     int param = atomic_load_explicit(&g_midiMap.learn, memory_order_relaxed);
+     MidiMapping m;
+
+     if (param < 0 || !atomic_compare_exchange_strong(&g_midiMap.learn, &param, -1)) return;
+     m = midimap_default((SynthParam)param, channel, cc);
+     audio_midi_map((SynthParam)param, &m);
+     printf("MIDI: %s learned controller %d on channel %d\n", midimap_param_name((SynthParam)param), cc, channel + 1);
+ }
+
+ int audio_midi_input(MidiEventType type, int channel, int data1, int data2) {
+     MidiEvent ev;
+
+     ev.frame = midi_clock_stamp(&g_midi.clock, audio_time_now());
+     ev.type = type;
+     ev.channel = (uint8_t)(channel & 0x0f);
+     ev.data1 = (uint8_t)(data1 & 0x7f);
+     ev.data2 = (uint8_t)(data2 & 0x7f);
+
+     if (type == MIDI_EVENT_CONTROL && ev.data1 < MIDI_MAP_CONTROLLERS) {
+         atomic_uchar *queued = &g_midi.cc_queued[ev.channel][ev.data1];
+
+         midi_learn_control(ev.channel, ev.data1);
+         // Merge into the controller's event still in the queue, which then applies this value
+         atomic_store_explicit(&g_midi.cc_value[ev.channel][ev.data1], ev.data2, memory_order_relaxed);
+         if (atomic_exchange_explicit(queued, 1, memory_order_acq_rel)) {
+             atomic_fetch_add_explicit(&g_midi.coalesced, 1, memory_order_relaxed);
+             return 1;
+         }
+         if (!audio_midi_schedule(&ev)) {
+             atomic_store_explicit(queued, 0, memory_order_release);
+             return 0;
+         }
+         return 1;
+     }
+     return audio_midi_schedule(&ev);
+ }
+
+ int audio_control_event(const MidiEvent *ev, double time_sec) {
+     MidiEvent stamped = *ev;
+     int queued;
+
+     stamped.frame = midi_clock_stamp(&g_midi.clock, time_sec);
+     pthread_mutex_lock(&g_midi.control_lock);
+     queued = midi_queue_push(&g_midi.control, &stamped);
+     pthread_mutex_unlock(&g_midi.control_lock);
+     if (!queued) atomic_fetch_add_explicit(&g_midi.dropped, 1, memory_order_relaxed);
+     return queued;
+ }
+
+ int audio_key_input(int note, int velocity) {
+     MidiEvent ev;
+     double now = audio_time_now();
+
+     if (velocity > 127) velocity = 127;
+     ev.frame = midi_clock_stamp(&g_midi.clock, now);
+     ev.type = (velocity > 0) ? MIDI_EVENT_NOTE_ON : MIDI_EVENT_NOTE_OFF;
+     ev.channel = 0;
+     ev.data1 = (uint8_t)(note & 0x7f);
+     ev.data2 = (uint8_t)((velocity > 0) ? velocity : 0);
+     ev.value = now;
+     if (midi_queue_push(&g_midi.keys, &ev)) return 1;
+     atomic_fetch_add_explicit(&g_midi.dropped, 1, memory_order_relaxed);
+     return 0;
+ }
+
+ int audio_control_batch(const MidiEvent *events, unsigned int count, double time_sec) {
+     MidiEvent stamped[AUDIO_CONTROL_BATCH_MAX];
+     uint64_t frame = midi_clock_stamp(&g_midi.clock, time_sec);
+     int queued;
+
+     if (count == 0) return 1;
+     if (count > AUDIO_CONTROL_BATCH_MAX) return 0;
+     for (unsigned int i = 0; i < count; i++) {
+         stamped[i] = events[i];
+         stamped[i].frame = frame;
+     }
+     pthread_mutex_lock(&g_midi.control_lock);
+     queued = midi_queue_push_batch(&g_midi.control, stamped, count);
+     pthread_mutex_unlock(&g_midi.control_lock);
+     if (!queued) atomic_fetch_add_explicit(&g_midi.dropped, count, memory_order_relaxed);
+     return queued;
+ }
+
+ int audio_get_params(SharedSynthData *data, double values[SYNTH_PARAM_COUNT], WaveformType waves[2]) {
+     long published = atomic_load_explicit(&g_params.time_us, memory_order_acquire);
+     int ret;
+
+     if (published >= 0 && (long)(audio_time_now() * 1e6) - published <= AUDIO_PARAMS_MAX_AGE_MS * 1000L) {
+         for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+             values[i] = atomic_load_explicit(&g_params.values[i], memory_order_relaxed);
+         }
+         waves[0] = (WaveformType)atomic_load_explicit(&g_params.waves[0], memory_order_relaxed);
+         waves[1] = (WaveformType)atomic_load_explicit(&g_params.waves[1], memory_order_relaxed);
+         return 1;
+     }
+     // Nothing is rendering, so the mutex is free for the taking
+     ret = pthread_mutex_lock(&data->mutex);
+     if (ret != 0) {
+         fprintf(stderr, "Error: cannot lock the synth data to read parameters: %s\n", strerror(ret));
+         return 0;
+     }
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) values[i] = *shared_param_field(data, (SynthParam)i);
+     waves[0] = data->waveform;
+     waves[1] = data->waveform2;
+     pthread_mutex_unlock(&data->mutex);
+     return 1;
+ }
+
+ int audio_midi_map(SynthParam param, const MidiMapping *mapping) {
+     if (param < 0 || param >= SYNTH_PARAM_COUNT) return 0;
+     if (mapping != NULL && (mapping->cc < 0 || mapping->cc >= MIDI_MAP_CONTROLLERS ||
+                             mapping->channel < MIDI_MAP_ANY_CHANNEL || mapping->channel > 15)) return 0;
+
+     pthread_mutex_lock(&g_midiMap.lock);
+     midi_map_ensure_initialised();
+     if (mapping != NULL) g_midiMap.map.params[param] = *mapping;
+     else g_midiMap.map.params[param].cc = -1;
+     atomic_fetch_add_explicit(&g_midiMap.generation, 1, memory_order_release);
+     pthread_mutex_unlock(&g_midiMap.lock);
+     return 1;
+ }
+
+ void audio_midi_get_map(MidiMap *map) {
+     pthread_mutex_lock(&g_midiMap.lock);
+     midi_map_ensure_initialised();
+     *map = g_midiMap.map;
+     pthread_mutex_unlock(&g_midiMap.lock);
+ }
+
+ void audio_seq_set_pattern(const SeqPattern *pattern) {
+     pthread_mutex_lock(&g_seqPattern.lock);
+     if (pattern != NULL) g_seqPattern.pattern = *pattern;
+     else seq_pattern_init(&g_seqPattern.pattern, 0);
+     atomic_fetch_add_explicit(&g_seqPattern.generation, 1, memory_order_release);
+     pthread_mutex_unlock(&g_seqPattern.lock);
+ }
+
+ void audio_seq_get_pattern(SeqPattern *pattern) {
+     pthread_mutex_lock(&g_seqPattern.lock);
+     *pattern = g_seqPattern.pattern;
+     pthread_mutex_unlock(&g_seqPattern.lock);
+ }
+
+ /**
+  * @brief Moves the recorded changes from the queue into the take. Caller holds `g_automation.lock`.
+  *
+  * Changes of an earlier request are dropped. A rate record after the take
+  * has points means the engine frames started again from 0 (audio_midi_reset()),
+  * so the take continues from its last point.
+  */
+ static void automation_drain(void) {
+     const MidiEvent *ev;
+
+     while ((ev = midi_queue_peek(&g_automation.queue)) != NULL) {
+         if (ev->data2 == g_automation.record_tag &&
+             atomic_load_explicit(&g_automation.mode, memory_order_relaxed) == AUDIO_AUTOMATION_RECORD) {
+             if (ev->data1 == AUTOMATION_RATE_RECORD) {
+                 for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+                     const AutoLane *lane = &g_automation.take.lanes[i];
+                     if (lane->points > 0 && lane->last_frame > g_automation.record_base) g_automation.record_base = lane->last_frame;
+                 }
+                 g_automation.take.sample_rate = ev->value;
+             } else if (!automation_record(&g_automation.take, (SynthParam)ev->data1, g_automation.record_base + ev->frame, ev->value)) {
+                 atomic_fetch_add_explicit(&g_automation.dropped, 1, memory_order_relaxed);
+             }
+         }
+         midi_queue_pop(&g_automation.queue);
+     }
+     atomic_store(&g_automation.points, automation_points(&g_automation.take));
+     atomic_store(&g_automation.bytes, automation_bytes(&g_automation.take));
+ }
+
+ /**
+  * @brief Writes the recording's new points to its file. Caller holds `g_automation.lock`.
+  * If the file cannot be written, the recording goes on in memory only.
+  */
+ static void automation_flush(void) {
+     int ok;
+
+     if (g_automation.path[0] == '\0') return;
+     if (!g_automation.file_started) ok = g_automation.file_started = automation_save(&g_automation.take, g_automation.path);
+     else ok = automation_append(&g_automation.take, g_automation.path);
+     if (!ok) {
+         fprintf(stderr, "Warning: Automation recording continues in memory only.\n");
+         g_automation.path[0] = '\0';
+     }
+ }
+
+ /**
+  * @brief Recorder thread: drains the render thread's changes into the take
+  * every AUTOMATION_DRAIN_MS and writes them to the file every AUTOMATION_FLUSH_SEC.
+  */
+ static void *automation_thread_main(void *arg) {
+     const struct timespec poll = { 0, AUTOMATION_DRAIN_MS * 1000000L };
+     double flushed = audio_time_now();
+     (void)arg;
+
+     while (atomic_load(&g_automation.running)) {
+         nanosleep(&poll, NULL);
+         pthread_mutex_lock(&g_automation.lock);
+         automation_drain();
+         if (audio_time_now() - flushed >= AUTOMATION_FLUSH_SEC) {
+             automation_flush();
+             flushed = audio_time_now();
+         }
+         pthread_mutex_unlock(&g_automation.lock);
+     }
+     return NULL;
+ }
+
+ int audio_automation_record(const char *path) {
+     const double rate = (g_audioConfig.internalRate > 0.0) ? g_audioConfig.internalRate : g_audioConfig.sampleRate;
+     FILE *f;
+     int ret;
+
+     audio_automation_stop();
+     if (path == NULL) path = "";
+     if (strlen(path) >= CONFIG_AUTOMATION_PATH_MAX) {
+         fprintf(stderr, "Error: Automation file name too long: %s\n", path);
+         return 0;
+     }
+     // Fail now rather than a second into the recording
+     if (path[0] != '\0') {
+         f = fopen(path, "wb");
+         if (f == NULL) {
+             fprintf(stderr, "Error: Cannot create automation file %s: %s\n", path, strerror(errno));
+             return 0;
+         }
+         fclose(f);
+     }
+
+     pthread_mutex_lock(&g_automation.lock);
+     automation_free(&g_automation.take);
+     automation_init(&g_automation.take, rate);
+     strcpy(g_automation.path, path);
+     g_automation.file_started = 0;
+     g_automation.record_base = 0;
+     atomic_store(&g_automation.points, 0);
+     atomic_store(&g_automation.bytes, 0);
+     atomic_store(&g_automation.dropped, 0);
+     atomic_store(&g_automation.mode, AUDIO_AUTOMATION_RECORD);
+     g_automation.record_tag = (uint8_t)(atomic_fetch_add_explicit(&g_automation.generation, 1, memory_order_release) + 1);
+     atomic_store(&g_automation.running, 1);
+     ret = pthread_create(&g_automation.thread, NULL, automation_thread_main, NULL);
+     if (ret != 0) {
+         atomic_store(&g_automation.running, 0);
+         atomic_store(&g_automation.mode, AUDIO_AUTOMATION_OFF);
+         atomic_fetch_add_explicit(&g_automation.generation, 1, memory_order_release);
+     }
+     pthread_mutex_unlock(&g_automation.lock);
+     if (ret != 0) {
+         fprintf(stderr, "Error: Cannot create automation recorder thread: %s\n", strerror(ret));
+         return 0;
+     }
+     if (path[0] != '\0') printf("Automation: recording to %s.\n", path);
+     else printf("Automation: recording.\n");
+     return 1;
+ }
+
+ int audio_automation_play(const char *path) {
+     Automation loaded;
+     size_t points;
+
+     audio_automation_stop();
+     if (path != NULL) {
+         automation_init(&loaded, 0.0);
+         if (!automation_load(&loaded, path)) return 0;
+     }
+
+     pthread_mutex_lock(&g_automation.lock);
+     if (path != NULL) {
+         automation_free(&g_automation.take);
+         g_automation.take = loaded;
+     }
+     points = automation_points(&g_automation.take);
+     atomic_store(&g_automation.points, points);
+     atomic_store(&g_automation.bytes, automation_bytes(&g_automation.take));
+     if (!(g_automation.take.sample_rate > 0.0)) points = 0;
+     if (points > 0) {
+         atomic_store(&g_automation.mode, AUDIO_AUTOMATION_PLAY);
+         atomic_fetch_add_explicit(&g_automation.generation, 1, memory_order_release);
+     }
+     pthread_mutex_unlock(&g_automation.lock);
+     if (points == 0) {
+         fprintf(stderr, "Error: The automation take is empty.\n");
+         return 0;
+     }
+     printf("Automation: playing %zu points%s%s.\n", points, (path != NULL) ? " from " : "", (path != NULL) ? path : "");
+     return 1;
+ }
+
+ void audio_automation_stop(void) {
+     int mode;
+
+     if (atomic_load(&g_automation.running)) {
+         atomic_store(&g_automation.running, 0);
+         pthread_join(g_automation.thread, NULL);
+     }
+     pthread_mutex_lock(&g_automation.lock);
+     mode = atomic_load(&g_automation.mode);
+     if (mode == AUDIO_AUTOMATION_RECORD) {
+         automation_drain();
+         automation_flush();
+         printf("Automation: recorded %zu points (%zu bytes)%s%s.\n", automation_points(&g_automation.take),
+                automation_bytes(&g_automation.take), (g_automation.path[0] != '\0') ? " to " : "", g_automation.path);
+     }
+     if (mode != AUDIO_AUTOMATION_OFF) {
+         atomic_store(&g_automation.mode, AUDIO_AUTOMATION_OFF);
+         atomic_fetch_add_explicit(&g_automation.generation, 1, memory_order_release);
+     }
+     pthread_mutex_unlock(&g_automation.lock);
+ }
+
+ int audio_automation_save(const char *path) {
+     int ok = 0;
+
+     pthread_mutex_lock(&g_automation.lock);
+     if (atomic_load(&g_automation.mode) == AUDIO_AUTOMATION_RECORD) {
+         fprintf(stderr, "Error: Cannot save the automation take while recording it.\n");
+     } else {
+         ok = automation_save(&g_automation.take, path);
+     }
+     pthread_mutex_unlock(&g_automation.lock);
+     return ok;
+ }
+
+ void audio_midi_learn(int param) {
+     atomic_store(&g_midiMap.learn, (param >= 0 && param < SYNTH_PARAM_COUNT) ? param : -1);
+ }
+
+ int audio_midi_learning(void) {
+     return atomic_load(&g_midiMap.learn);
+ }
+
+ unsigned long audio_midi_param_updates(void) {
+     return atomic_load_explicit(&g_midi.param_updates, memory_order_relaxed);
+ }
+
+ void audio_midi_reset(void) {
+     midi_queue_init(&g_midi.queue);
+     midi_queue_init(&g_midi.control);
+     midi_queue_init(&g_midi.keys);
+     g_midi.key_pending_head = 0;
+     g_midi.key_pending_count = 0;
+     midi_schedule_init(&g_midi.schedule);
+     midi_clock_init(&g_midi.clock);
+     g_midi.frame = 0;
+     g_midi.note = -1;
+     g_midi.pitch = 0.0;
+     g_midi.velocity = 1.0;
+     g_midi.volume = 1.0;
+     g_midi.changed = 0;
+     g_midi.waves_changed = 0;
+     mpe_init(&g_mpe.pool, g_audioConfig.mpeBendRange);
+     arp_init(&g_midi.arp, g_audioConfig.arpMode, g_audioConfig.tempo, g_audioConfig.arpRate,
+              g_audioConfig.arpGate, g_audioConfig.arpOctaves);
+     seq_init(&g_midi.seq, g_audioConfig.tempo);
+     g_midi.seq_on = g_audioConfig.sequencer;
+     g_midi.seq_prerender_ms = g_audioConfig.seqPrerenderMs;
+     g_midi.seq_generation = 0; // The pattern is picked up again by the first block
+     g_midi.locked = 0;
+     g_midi.input_frame = 0;
+     g_midi.render_load = -1.0;
+     g_midi.clock_mode = g_audioConfig.midiClock;
+     midisync_init(&g_midi.sync, 0.0);
+     g_midi.sync_following = 0;
+     g_midi.sync_start = 0;
+     g_midi.seq_stopped = 0;
+     g_midi.clock_out_tick = 0;
+     g_midi.clock_out_frame = 0.0;
+     midi_queue_init(&g_midi.clock_out);
+     g_midi.clock_late_sq = 0.0;
+     g_automation.render_generation = 0; // The automation request too, from the new frame 0
+     g_automation.render_mode = AUDIO_AUTOMATION_OFF;
+     g_automation.held = 0;
+     if (g_midi.prerendering) lookahead_set_prerender(0);
+     g_midi.prerendering = 0;
+     atomic_store(&g_midi.seq_prerendering, 0);
+     for (int ch = 0; ch < 16; ch++) {
+         for (int cc = 0; cc < MIDI_MAP_CONTROLLERS; cc++) atomic_store(&g_midi.cc_queued[ch][cc], 0);
+     }
+ }
+
+
+ // --- Engine Render Function ---
+
+ /**
+  * @brief Renders one block of mixed mono audio for both waves.
+  *
+  * Shared by every audio backend. Reads the shared parameters for **both waves**
+  * under the mutex, generates and mixes the samples with the mutex released, and
+  * writes the advanced oscillator/envelope state back. Lock time is kept minimal
+  * by copying parameters locally.
+  *
+  * @param[in,out] shared_data The shared synthesizer data structure.
+  * @param[out] out Buffer receiving `framesPerBuffer` float samples.
+  * @param framesPerBuffer The number of frames to render.
+  * @return 0 on success, -1 on a critical mutex failure (silence is written, state may be lost).
+  * @warning Must be real-time safe.
+  */
+ int render_audio(SharedSynthData *shared_data, float *out, unsigned long framesPerBuffer) {
+     unsigned long i;
+     int ret_lock, ret_unlock;
+     WaveParams params1, params2;
+     WaveVoice voice1, voice2;
+     double local_sampleRate;
+
+     // --- Short Critical Section: Read Shared Parameters and State ---
+     ret_lock = pthread_mutex_lock(&shared_data->mutex);
+     if (ret_lock != 0) {
+         fprintf(stderr, "CRITICAL: Error in render_audio lock (read): %s. Outputting silence.\n", strerror(ret_lock));
+         // Output silence to prevent garbage audio
+         for( i = 0; i < framesPerBuffer; i++ ) { *out++ = 0.0f; }
+         return -1;
+     }
+
+     read_wave1(shared_data, &params1, &voice1);
+     read_wave2(shared_data, &params2, &voice2);
+     local_sampleRate = shared_data->sampleRate;
+
+     // Unlock mutex as quickly as possible
+     ret_unlock = pthread_mutex_unlock(&shared_data->mutex);
+      if (ret_unlock != 0) {
+          fprintf(stderr, "CRITICAL Error in render_audio unlock (read): %s\n", strerror(ret_unlock));
+          // Data might be inconsistent, but try to generate silence before aborting
+          for( i = 0; i < framesPerBuffer; i++ ) { *out++ = 0.0f; }
+          return -1;
+     }
+     // --- End Read Critical Section ---
+
+     // --- Audio Generation (Mutex is NOT HELD) ---
+     render_block(&params1, &voice1, &params2, &voice2, local_sampleRate, out, framesPerBuffer);
+
+     // --- Short Critical Section: Write Back Updated State ---
+     ret_lock = pthread_mutex_lock(&shared_data->mutex);
+      if (ret_lock != 0) {
+         fprintf(stderr, "CRITICAL: Error in render_audio lock (write): %s. State lost.\n", strerror(ret_lock));
+         return -1;
+     }
+
+     write_wave1_state(shared_data, &voice1);
+     write_wave2_state(shared_data, &voice2);
+     write_controller_params(shared_data);
+
+     ret_unlock = pthread_mutex_unlock(&shared_data->mutex);
+      if (ret_unlock != 0) {
+          fprintf(stderr, "CRITICAL Error in render_audio unlock (write): %s\n", strerror(ret_unlock));
+          return -1;
+     }
+     // --- End Write Critical Section ---
+
+     return 0;
+ }
+
+
+ // --- Non-Blocking Render Path ---
+
+ /**
+  * @struct RenderCache
+  * @brief Audio-thread copy of the parameters and voices used when the mutex is busy.
+  *
+  * `written1`/`written2` hold the shared voice state as last seen or written by
+  * the audio thread. If the shared state still matches them when the lock is next
+  * acquired, nothing else touched the voice and the locally advanced state is
+  * authoritative; otherwise the GUI changed it (e.g. note on/off) and wins.
+  */
+ typedef struct {
+     WaveParams params1, params2;
+     WaveVoice voice1, voice2;
+     WaveVoice written1, written2;
+     double sampleRate;
+     int valid;   ///< Parameters have been read at least once.
+     int pending; ///< Voices advanced since the last successful write-back.
+ } RenderCache;
+
+ static RenderCache g_renderCache;
+
+ /** @brief Returns 1 if the shared voice still holds the state the audio thread last saw. */
+ static int voice_unchanged(const WaveVoice *shared, const WaveVoice *written) {
+     return shared->stage == written->stage && shared->note_active == written->note_active &&
+            shared->phase == written->phase && shared->timeInStage == written->timeInStage;
+ }
+
+ void render_audio_nonblocking_reset(void) {
+     memset(&g_renderCache, 0, sizeof(g_renderCache));
+ }
+
+ /**
+  * @brief Renders one block without ever blocking on the shared mutex.
+  *
+  * Uses `pthread_mutex_trylock()` to refresh the cached parameters and to write
+  * the voices back. When the GUI holds the lock, the block is rendered from the
+  * cached parameters and the voice state is carried over to the next block, so
+  * a busy GUI delays parameter changes by a block instead of stalling the
+  * driver's real-time thread. Intended for callbacks that must not block (JACK).
+  *
+  * @param[in,out] shared_data The shared synthesizer data structure.
+  * @param[out] out Buffer receiving `framesPerBuffer` float samples.
+  * @param framesPerBuffer The number of frames to render.
+  * @return 0 (silence is rendered until parameters were read once).
+  */
+ int render_audio_nonblocking(SharedSynthData *shared_data, float *out, unsigned long framesPerBuffer) {
+     RenderCache *c = &g_renderCache;
+
+     if (pthread_mutex_trylock(&shared_data->mutex) == 0) {
+         WaveVoice shared1, shared2;
+         // Controller values a busy GUI kept from being written last time
+         write_controller_params(shared_data);
+         read_wave1(shared_data, &c->params1, &shared1);
+         read_wave2(shared_data, &c->params2, &shared2);
+         c->sampleRate = shared_data->sampleRate;
+         pthread_mutex_unlock(&shared_data->mutex);
+
+         // Keep the locally advanced voices unless something else changed them
+         if (!(c->valid && c->pending && voice_unchanged(&shared1, &c->written1))) c->voice1 = shared1;
+         if (!(c->valid && c->pending && voice_unchanged(&shared2, &c->written2))) c->voice2 = shared2;
+         c->written1 = shared1;
+         c->written2 = shared2;
+         c->valid = 1;
+     } else if (!c->valid) {
+         memset(out, 0, framesPerBuffer * sizeof(float));
+         return 0;
+     }
+
+     render_block(&c->params1, &c->voice1, &c->params2, &c->voice2, c->sampleRate, out, framesPerBuffer);
+
+     if (pthread_mutex_trylock(&shared_data->mutex) == 0) {
+         WaveParams unused;
+         WaveVoice shared1, shared2;
+         read_wave1(shared_data, &unused, &shared1);
+         read_wave2(shared_data, &unused, &shared2);
+         // Do not overwrite a note on/off the GUI issued while this block was rendered
+         if (voice_unchanged(&shared1, &c->written1)) { write_wave1_state(shared_data, &c->voice1); c->written1 = c->voice1; }
+         if (voice_unchanged(&shared2, &c->written2)) { write_wave2_state(shared_data, &c->voice2); c->written2 = c->voice2; }
+         write_controller_params(shared_data);
+         pthread_mutex_unlock(&shared_data->mutex);
+         c->pending = 0;
+     } else {
+         c->pending = 1;
+     }
+     return 0;
+ }
+
+
+ // --- Device Block Rendering ---
+
+ /**
+  * @struct EngineSource
+  * @brief Pull context handing engine-rate audio to the resampler.
+  */
+ typedef struct {
+     SharedSynthData *data;
+     int nonblocking;
+     double pull_time; ///< Time spent producing engine audio, excluded from the resampler's load.
+ } EngineSource;
+
+ /**
+  * @brief Produces engine-rate audio: from the lookahead ring if the render thread runs, else by rendering.
+  */
+ static int render_engine_block(SharedSynthData *data, float *out, unsigned long frames, int nonblocking) {
+     if (lookahead_is_running()) {
+         // The render thread already produced this audio, only copy it
+         lookahead_read(out, frames);
+         return 0;
+     }
+     if (nonblocking) return render_audio_nonblocking(data, out, frames);
+     return render_audio(data, out, frames);
+ }
+
+ /** @brief ResamplerPullFn reading from the engine. */
+ static int engine_pull(void *ctx, float *in, unsigned long frames) {
+     EngineSource *src = (EngineSource *)ctx;
+     double start = audio_time_now();
+     int err = render_engine_block(src->data, in, frames, src->nonblocking);
+     src->pull_time += audio_time_now() - start;
+     return err;
+ }
+
+/**
+  * @brief Produces one block of engine output at the device rate, resampling if needed.
+  */
+ static int render_device_rate(SharedSynthData *data, float *out, unsigned long frames, int nonblocking) {
+     EngineSource src = { data, nonblocking, 0.0 };
+     double start, busy;
+     long ppm, avg;
+     int err;
+
+     if (!atomic_load_explicit(&g_srcActive, memory_order_acquire)) {
+         return render_engine_block(data, out, frames, nonblocking);
+     }
+
+     start = audio_time_now();
+     err = resampler_process(&g_src, out, frames, engine_pull, &src);
+     busy = audio_time_now() - start - src.pull_time;
+
+     // Resampling cost alone, as a fraction of the block time
+     ppm = (long)(busy * g_src.out_rate / frames * 1e6 + 0.5);
+     avg = atomic_load_explicit(&g_stats.src_load_ppm, memory_order_relaxed);
+     atomic_store_explicit(&g_stats.src_load_ppm, (avg < 0) ? ppm : avg + (ppm - avg) / 64, memory_order_relaxed);
+     return err;
+ }
+
+ int audio_render_device_block(SharedSynthData *data, const float *in, float *out, unsigned long frames, int nonblocking) {
+     int err = render_device_rate(data, out, frames, nonblocking);
+     // Modulated here rather than by the render thread, so a lookahead does not delay the input
+     if (err == 0 && in != NULL) sidechain_process(&g_sidechain, in, out, frames);
+     return err;
+ }
+
+ #define AUDIO_SCRATCH_MIN_FRAMES 4096 ///< Smallest integer format render buffer when PortAudio picks the block size.
+
+ /**
+  * @brief Produces one PortAudio block in the stream's sample format.
+  *
+  * Float streams render straight into `out`. Integer streams render the whole
+  * block once into the stream's `g_paScratch` and convert it in one pass.
+  * Only a block larger than that buffer, which PortAudio can deliver when it
+  * picks the block size, is rendered in buffer-sized parts.
+  *
+  * @return 0 on success, -1 on a critical mutex failure (the rest of the block is silent).
+  */
+ static int render_device_output(SharedSynthData *data, const float *in, void *out, unsigned long frames, int nonblocking) {
+     const size_t bytes = sample_format_bytes(g_paConv.format);
+     unsigned long done, n;
+
+     if (g_paConv.format == SAMPLE_FORMAT_FLOAT32) {
+         return audio_render_device_block(data, in, (float *)out, frames, nonblocking);
+     }
+     if (g_paScratch == NULL) { // Not opened by start_portaudio()
+         memset(out, 0, frames * bytes);
+         return 0;
+     }
+     for (done = 0; done < frames; done += n) {
+         n = (frames - done < g_paScratchFrames) ? frames - done : g_paScratchFrames;
+         if (audio_render_device_block(data, in ? in + done : NULL, g_paScratch, n, nonblocking) != 0) {
+             memset((char *)out + done * bytes, 0, (frames - done) * bytes);
+             return -1;
+         }
+         audio_convert_output(&g_paConv, g_paScratch, (char *)out + done * bytes, n, g_paSampleRate);
+     }
+     return 0;
+ }
+
+ double audio_device_rate_requested(SharedSynthData *data) {
+     double rate = 0.0;
+
+     if (g_audioConfig.internalRate > 0.0) return g_audioConfig.sampleRate;
+     if (pthread_mutex_lock(&data->mutex) == 0) {
+         rate = data->sampleRate;
+         pthread_mutex_unlock(&data->mutex);
+     }
+     return rate;
+ }
+
+ int audio_device_rate_adopt(SharedSynthData *data, double device_rate) {
+     double engine_rate;
+
+     audio_src_release();
+     if (!sidechain_init(&g_sidechain, g_audioConfig.inputMode, device_rate, (float)g_audioConfig.inputGain)) {
+         fprintf(stderr, "Error: Cannot set up the %s input at %.0f Hz.\n", sidechain_mode_name(g_audioConfig.inputMode), device_rate);
+         return 0;
+     }
+     if (pthread_mutex_lock(&data->mutex) != 0) return 0;
+     engine_rate = data->sampleRate;
+     if (g_audioConfig.internalRate <= 0.0) {
+         // No fixed engine rate: the engine simply follows the device
+         data->sampleRate = device_rate;
+     }
+     pthread_mutex_unlock(&data->mutex);
+
+     if (g_audioConfig.internalRate <= 0.0 || engine_rate == device_rate) return 1;
+
+     if (!resampler_init(&g_src, engine_rate, device_rate, g_audioConfig.srcQuality)) {
+         fprintf(stderr, "Error: Cannot resample from %.0f Hz to %.0f Hz.\n", engine_rate, device_rate);
+         return 0;
+     }
+     atomic_store(&g_stats.src_quality, resampler_quality_name(g_src.quality));
+     atomic_store(&g_stats.src_engine_rate, g_src.in_rate);
+     atomic_store(&g_stats.src_device_rate, g_src.out_rate);
+     atomic_store(&g_stats.src_latency_ms, 1000.0 * resampler_latency(&g_src));
+     atomic_store_explicit(&g_srcActive, 1, memory_order_release);
+     printf("Resampling %.0f Hz -> %.0f Hz: %s quality, %u taps, +%.2f ms latency.\n",
+            engine_rate, device_rate, resampler_quality_name(g_src.quality), g_src.taps, 1000.0 * resampler_latency(&g_src));
+     return 1;
+ }
+
+ void audio_src_release(void) {
+     if (!atomic_load(&g_srcActive)) return;
+     atomic_store(&g_srcActive, 0);
+     atomic_store(&g_stats.src_quality, "off");
+     atomic_store(&g_stats.src_engine_rate, 0.0);
+     atomic_store(&g_stats.src_device_rate, 0.0);
+     atomic_store(&g_stats.src_latency_ms, 0.0);
+     resampler_free(&g_src);
+ }
+
+
+ // --- PortAudio Callback Function ---
+
+ /**
+  * @brief PortAudio callback function for generating and mixing audio samples for two waves.
+  *
+  * This function is called by the PortAudio library in a high-priority thread
+  * whenever the audio device needs more samples. It delegates the synthesis of
+  * **both waves** to render_audio() (or copies from the lookahead ring when the
+  * render thread runs) and records xruns and the callback-to-DAC latency
+  * reported by PortAudio in the engine statistics. On a duplex stream the
+  * input block modulates the output and the input-ADC-to-output-DAC time is
+  * recorded as the round-trip latency.
+  *
+  * @param inputBuffer Mono input samples of a duplex stream (modulate the output in place), or NULL.
+  * @param outputBuffer Buffer where generated mixed audio samples should be written, in the configured sample format.
+  * @param framesPerBuffer The number of sample frames to generate for the buffer.
+  * @param timeInfo Timing information from PortAudio, used for latency measurement (may be NULL).
+  * @param statusFlags Flags indicating buffer under/overflow or other conditions.
+  * @param userData A pointer to the SharedSynthData structure containing synth parameters and state for both waves.
+  *
+  * @return `paContinue` (0) if processing should continue, or `paAbort` on critical errors (like mutex failure).
+  *
+  * @note This function is conditionally non-static (`#ifdef TESTING`) to allow unit testing.
+  * @warning Must be real-time safe. Avoid blocking operations, excessive computation, or holding mutexes for too long.
+  */
+ #ifdef TESTING
+ int paCallback( const void *inputBuffer, void *outputBuffer,
+ #else
+ static int paCallback( const void *inputBuffer, void *outputBuffer,
+ #endif // TESTING
+                        unsigned long framesPerBuffer,
+                        const PaStreamCallbackTimeInfo* timeInfo,
+                        PaStreamCallbackFlags statusFlags,
+                        void *userData )
+ {
+     SharedSynthData *shared_data = (SharedSynthData*)userData;
+     double dac_latency = -1.0;
+     double render_start = audio_time_now();
+
+     // Check for PortAudio buffer issues
+     if (statusFlags & (paOutputUnderflow | paOutputOverflow | paInputOverflow)) {
+         fprintf(stderr, "PortAudio Warning: Buffer under/overflow detected (flags: %lu)\n", statusFlags);
+         audio_stats_record_xrun();
+     }
+
+     if (render_device_output(shared_data, (const float*)inputBuffer, outputBuffer, framesPerBuffer, 0) != 0) {
+         return paAbort; // Abort stream on critical lock failure
+     }
+
+     // Time from this callback until its first sample reaches the DAC
+     if (timeInfo != NULL && timeInfo->outputBufferDacTime > 0.0 && timeInfo->currentTime > 0.0) {
+         dac_latency = timeInfo->outputBufferDacTime - timeInfo->currentTime;
+     }
+     audio_stats_record_block(framesPerBuffer, dac_latency);
+     // Round trip: this block's input left the ADC at inputBufferAdcTime and reaches the DAC at outputBufferDacTime
+     if (inputBuffer != NULL && timeInfo != NULL && timeInfo->inputBufferAdcTime > 0.0 && timeInfo->outputBufferDacTime > 0.0) {
+         audio_stats_record_duplex(timeInfo->outputBufferDacTime - timeInfo->inputBufferAdcTime);
+     }
+     if (g_paSampleRate > 0.0) {
+         audio_stats_record_load(audio_time_now() - render_start, framesPerBuffer / g_paSampleRate);
+     }
+
+     // Signal PortAudio to continue processing
+     return paContinue; // paContinue = 0
+ }
+ 
+ 
+ /**
+  * @brief Initializes the PortAudio library and synth state for both waves.
+  *
   * Must be called once at application startup before any other audio functions.
   * Initializes the PortAudio library itself and sets the initial ADSR envelope
   * state for **both waves** in the shared data structure.
@@ -377,76 +2619,329 @@
          fprintf(stderr, "PortAudio Error in Pa_Initialize: %s\n", Pa_GetErrorText(err));
          return err;
      }
-     printf("PortAudio initialized. Version: %s\n", Pa_GetVersionInfo()->versionText);
- 
-     // Initialize ADSR state safely within the shared data for both waves
-     int ret_lock = pthread_mutex_lock(&data->mutex);
-     CHECK_PTHREAD_ERR(ret_lock, "initialize_audio lock");
-     if (ret_lock == 0) {
-         // Wave 1
-         data->currentStage = ENV_IDLE;
-         data->timeInStage = 0.0;
-         data->lastEnvValue = 0.0;
-         // Wave 2
-         data->currentStage2 = ENV_IDLE;
-         data->timeInStage2 = 0.0;
-         data->lastEnvValue2 = 0.0;
-         int ret_unlock = pthread_mutex_unlock(&data->mutex);
-         CHECK_PTHREAD_ERR(ret_unlock, "initialize_audio unlock");
-     } else {
-         // Handle lock failure during initialization - critical error.
-         Pa_Terminate(); // Clean up PortAudio if lock fails
-         return paInternalError; // Indicate initialization failure
+     printf("PortAudio initialized. Version: %s\n", Pa_GetVersionInfo()->versionText);
+ 
+     // Initialize ADSR state safely within the shared data for both waves
+     int ret_lock = pthread_mutex_lock(&data->mutex);
+     CHECK_PTHREAD_ERR(ret_lock, "initialize_audio lock");
+     if (ret_lock == 0) {
+         // Wave 1
+         data->currentStage = ENV_IDLE;
+         data->timeInStage = 0.0;
+         data->lastEnvValue = 0.0;
+         // Wave 2
+         data->currentStage2 = ENV_IDLE;
+         data->timeInStage2 = 0.0;
+         data->lastEnvValue2 = 0.0;
+         int ret_unlock = pthread_mutex_unlock(&data->mutex);
+         CHECK_PTHREAD_ERR(ret_unlock, "initialize_audio unlock");
+     } else {
+         // Handle lock failure during initialization - critical error.
+         Pa_Terminate(); // Clean up PortAudio if lock fails
+         return paInternalError; // Indicate initialization failure
+     }
+     return paNoError;
+ }
+ 
+ 
+ /**
+  * @brief Stores the stream configuration used by start_audio().
+  * @param[in] config The configuration to copy. NULL restores the defaults.
+  */
+ void audio_set_config(const AudioConfig *config) {
+     static const AudioConfig defaults = AUDIO_CONFIG_DEFAULTS;
+
+     config_store((config != NULL) ? config : &defaults);
+ }
+
+ /**
+  * @brief Copies the stream configuration currently in use.
+  * @param[out] config Receives the configuration.
+  */
+ void audio_get_config(AudioConfig *config) {
+     if (config == NULL) return;
+     pthread_mutex_lock(&g_configMutex);
+     *config = g_audioConfig;
+     pthread_mutex_unlock(&g_configMutex);
+ }
+
+
+ /**
+  * @brief Case-insensitive substring search used for device name matching.
+  * @return 1 if `needle` occurs in `haystack`, 0 otherwise.
+  */
+ static int contains_ignore_case(const char *haystack, const char *needle) {
+     size_t n = strlen(needle);
+     if (n == 0) return 1;
+     for (; *haystack; haystack++) {
+         size_t k = 0;
+         while (k < n && haystack[k] &&
+                tolower((unsigned char)haystack[k]) == tolower((unsigned char)needle[k])) {
+             k++;
+         }
+         if (k == n) return 1;
+     }
+     return 0;
+ }
+
+
+ /**
+  * @brief Resolves the configured output device to a PortAudio device index.
+  *
+  * An explicit index takes precedence, then a name pattern (first output device
+  * whose name contains the pattern), otherwise the default output device.
+  *
+  * @param[in] config The stream configuration.
+  * @return A valid device index, or `paNoDevice` if nothing matches.
+  */
+ static PaDeviceIndex resolve_output_device(const AudioConfig *config) {
+     if (config->deviceIndex >= 0) {
+         PaDeviceIndex count = Pa_GetDeviceCount();
+         if (count < 0 || config->deviceIndex >= count) {
+             fprintf(stderr, "Error: Output device index %d out of range (%d devices).\n", config->deviceIndex, count);
+             return paNoDevice;
+         }
+         return (PaDeviceIndex)config->deviceIndex;
+     }
+
+     if (config->deviceName[0] != '\0') {
+         PaDeviceIndex count = Pa_GetDeviceCount();
+         for (PaDeviceIndex i = 0; i < count; i++) {
+             const PaDeviceInfo *info = Pa_GetDeviceInfo(i);
+             if (info && info->maxOutputChannels > 0 && contains_ignore_case(info->name, config->deviceName)) {
+                 return i;
+             }
+         }
+         fprintf(stderr, "Error: No output device matching '%s'.\n", config->deviceName);
+         return paNoDevice;
+     }
+
+     return Pa_GetDefaultOutputDevice();
+ }
+
+ /**
+  * @brief Finds the input device for a duplex stream: the configured index or the default input.
+  * @return A device with at least one input channel, or `paNoDevice`.
+  */
+ static PaDeviceIndex resolve_input_device(const AudioConfig *config) {
+     PaDeviceIndex device = (config->inputDeviceIndex >= 0) ? (PaDeviceIndex)config->inputDeviceIndex : Pa_GetDefaultInputDevice();
+     const PaDeviceInfo *info;
+
+     if (device == paNoDevice || device >= Pa_GetDeviceCount()) return paNoDevice;
+     info = Pa_GetDeviceInfo(device);
+     return (info != NULL && info->maxInputChannels > 0) ? device : paNoDevice;
+ }
+
+
+ /**
+  * @brief Lists the output-capable PortAudio devices, e.g. for a device selector.
+  * @return The number of output devices (may exceed `max`), or the negative device count error.
+  */
+ int audio_get_output_devices(AudioOutputDevice *devices, int max) {
+     PaDeviceIndex count = Pa_GetDeviceCount();
+     PaDeviceIndex default_out = Pa_GetDefaultOutputDevice();
+     int found = 0;
+
+     if (count < 0) return count;
+     for (PaDeviceIndex i = 0; i < count; i++) {
+         const PaDeviceInfo *info = Pa_GetDeviceInfo(i);
+         if (info == NULL || info->maxOutputChannels <= 0) continue;
+         if (found < max) {
+             devices[found].index = i;
+             snprintf(devices[found].name, sizeof(devices[found].name), "%s", info->name);
+             devices[found].isDefault = (i == default_out);
+             devices[found].isActive = (i == g_paDevice);
+         }
+         found++;
+     }
+     return found;
+ }
+
+ /**
+  * @brief Prints all output-capable PortAudio devices with their default settings.
+  * @return `paNoError` (0) on success, or the negative device count error.
+  */
+ PaError list_audio_devices(void) {
+     PaDeviceIndex count = Pa_GetDeviceCount();
+     PaDeviceIndex default_out = Pa_GetDefaultOutputDevice();
+
+     if (count < 0) {
+         fprintf(stderr, "PortAudio Error in Pa_GetDeviceCount: %s\n", Pa_GetErrorText(count));
+         return count;
+     }
+
+     printf("Available output devices:\n");
+     for (PaDeviceIndex i = 0; i < count; i++) {
+         const PaDeviceInfo *info = Pa_GetDeviceInfo(i);
+         if (info == NULL || info->maxOutputChannels <= 0) continue;
+         const PaHostApiInfo *host = Pa_GetHostApiInfo(info->hostApi);
+         printf("%c %3d: %s [%s] ch=%d rate=%.0f low=%.1fms high=%.1fms\n",
+                (i == default_out) ? '*' : ' ', i, info->name,
+                host ? host->name : "?", info->maxOutputChannels, info->defaultSampleRate,
+                info->defaultLowOutputLatency * 1000.0, info->defaultHighOutputLatency * 1000.0);
+     }
+     return paNoError;
+ }
+
+
+ /** @brief Releases the integer format render buffer once no audio thread uses it. */
+ static void free_pa_scratch(void) {
+     free(g_paScratch);
+     g_paScratch = NULL;
+     g_paScratchFrames = 0;
+ }
+
+
+ // --- Blocking I/O Writer ---
+ #define AUDIO_BLOCKING_WRITE_FRAMES 256 ///< Frames per Pa_WriteStream() call when framesPerBuffer is "auto".
+
+ /** @brief Thread pushing lookahead audio into the stream in blocking I/O mode. */
+ static pthread_t g_writerThread;
+ /** @brief Non-zero while the writer thread should keep running. */
+ static atomic_int g_writerRunning;
+ /** @brief Frames per Pa_WriteStream() call. */
+ static unsigned long g_writerFrames;
+ /** @brief Shared data of the stream the writer feeds. */
+ static SharedSynthData *g_writerData;
+
+ /**
+  * @brief Blocking I/O loop: copies from the lookahead ring and writes to the stream.
+  *
+  * Pa_WriteStream() blocks until the device has room, which paces the loop;
+  * the render thread keeps the ring ahead of it.
+  */
+ static void *blocking_writer_main(void *arg) {
+     PaStream *stream = (PaStream *)arg;
+     const PaStreamInfo *info = Pa_GetStreamInfo(stream);
+     double latency = info ? info->outputLatency : -1.0;
+     void *buffer = malloc(g_writerFrames * sample_format_bytes(g_paConv.format));
+
+     if (buffer == NULL) {
+         fprintf(stderr, "CRITICAL: Cannot allocate blocking I/O buffer.\n");
+         return NULL;
+     }
+     while (atomic_load(&g_writerRunning)) {
+         render_device_output(g_writerData, NULL, buffer, g_writerFrames, 0);
+         PaError err = Pa_WriteStream(stream, buffer, g_writerFrames);
+         if (err == paOutputUnderflowed) {
+             audio_stats_record_xrun();
+         } else if (err != paNoError) {
+             fprintf(stderr, "PortAudio Error in Pa_WriteStream: %s\n", Pa_GetErrorText(err));
+             break;
+         }
+         audio_stats_record_block(g_writerFrames, latency);
+     }
+     free(buffer);
+     return NULL;
+ }
+
+ /**
+  * @brief Starts the blocking writer thread on the open stream.
+  * @return `paNoError`, or `paInternalError` if the thread cannot be created.
+  */
+ static PaError start_blocking_writer(SharedSynthData *data, unsigned long frames) {
+     g_writerFrames = frames;
+     g_writerData = data;
+     atomic_store(&g_writerRunning, 1);
+     int ret = pthread_create(&g_writerThread, NULL, blocking_writer_main, g_paStream);
+     if (ret != 0) {
+         fprintf(stderr, "Error: Cannot create blocking I/O thread: %s\n", strerror(ret));
+         atomic_store(&g_writerRunning, 0);
+         return paInternalError;
      }
+     printf("Blocking I/O: writing %lu frames per Pa_WriteStream().\n", frames);
      return paNoError;
  }
- 
- 
+
  /**
-  * @brief Opens and starts the default PortAudio output stream.
+  * @brief Stops the blocking writer thread, if it runs. Returns within one buffer.
+  */
+ static void stop_blocking_writer(void) {
+     if (!atomic_load(&g_writerRunning)) return;
+     atomic_store(&g_writerRunning, 0);
+     pthread_join(g_writerThread, NULL);
+ }
+
+
+ /**
+  * @brief Opens and starts the configured PortAudio output stream.
   *
-  * Configures and opens the default audio output device using parameters
-  * (like sample rate) from the shared data structure. Starts the stream,
-  * which begins calling the `paCallback` function to generate mixed audio.
+  * Resolves the output device from the active `AudioConfig` (index, name pattern
+  * or default), applies the configured frames per buffer and suggested latency,
+  * and opens the stream at the sample rate from the shared data structure.
+  * In callback mode the stream calls `paCallback`; in blocking mode no callback
+  * is installed and a writer thread feeds the stream from the lookahead ring.
   *
   * @param[in] data Pointer to the shared synthesizer data structure (used for sample rate and passed to callback).
   * @return `paNoError` (0) on success, or a negative PaError code on failure.
   * @note Sets the global `g_paStream` pointer on success.
   */
- PaError start_audio(SharedSynthData *data) {
+ static PaError start_portaudio(SharedSynthData *data) {
      PaError err;
-     PaStreamParameters outputParameters;
-     // Let PortAudio choose the buffer size for potentially lower latency
-     unsigned long framesPerBuffer = paFramesPerBufferUnspecified;
- 
+     PaStreamParameters outputParameters, inputParameters;
+     const PaStreamParameters *input = NULL;
+     int blocking = (g_audioConfig.ioMode == AUDIO_IO_BLOCKING);
+     // 0 maps to paFramesPerBufferUnspecified, letting PortAudio choose the buffer size
+     unsigned long framesPerBuffer = g_audioConfig.framesPerBuffer ? g_audioConfig.framesPerBuffer : paFramesPerBufferUnspecified;
+
      // Check if stream is already running
      if (g_paStream != NULL) {
          printf("Audio stream already started.\n");
          return paNoError;
      }
- 
-     // Get the default output device
-     outputParameters.device = Pa_GetDefaultOutputDevice();
+
+     // Resolve the configured (or default) output device
+     outputParameters.device = resolve_output_device(&g_audioConfig);
      if (outputParameters.device == paNoDevice) {
-         fprintf(stderr,"Error: No default output device found.\n");
+         fprintf(stderr,"Error: No usable output device found.\n");
          return paDeviceUnavailable;
      }
- 
+
      // Get device information (for name and suggested latency)
      const PaDeviceInfo *deviceInfo = Pa_GetDeviceInfo(outputParameters.device);
      if (deviceInfo == NULL) {
-         fprintf(stderr,"Error: Could not get info for default output device %d.\n", outputParameters.device);
+         fprintf(stderr,"Error: Could not get info for output device %d.\n", outputParameters.device);
          return paInternalError;
      }
-     printf("Using default output device: %s\n", deviceInfo->name);
- 
+     printf("Using output device %d: %s\n", outputParameters.device, deviceInfo->name);
+     g_paDevice = outputParameters.device;
+
      // Configure output stream parameters
      outputParameters.channelCount = 1; // Mono output (mixed waves)
-     outputParameters.sampleFormat = paFloat32; // Use 32-bit float samples
-     // Use default low latency setting - adjust if needed
-     outputParameters.suggestedLatency = deviceInfo->defaultLowOutputLatency;
+     // 32-bit float unless an integer format is configured; the callback converts with dither
+     switch (g_audioConfig.sampleFormat) {
+         case SAMPLE_FORMAT_INT16: outputParameters.sampleFormat = paInt16; break;
+         case SAMPLE_FORMAT_INT24: outputParameters.sampleFormat = paInt24; break;
+         default:                  outputParameters.sampleFormat = paFloat32; break;
+     }
+     sample_converter_init(&g_paConv, g_audioConfig.sampleFormat, g_audioConfig.dither, (uint32_t)time(NULL));
+     // Configured latency, or the device's default low latency setting
+     outputParameters.suggestedLatency = (g_audioConfig.suggestedLatency > 0.0)
+                                         ? g_audioConfig.suggestedLatency
+                                         : deviceInfo->defaultLowOutputLatency;
      outputParameters.hostApiSpecificStreamInfo = NULL; // No specific info needed
- 
+
+     // Duplex: the callback receives the input block next to the output block it modulates
+     if (g_audioConfig.inputMode != SIDECHAIN_OFF) {
+         inputParameters.device = blocking ? paNoDevice : resolve_input_device(&g_audioConfig);
+         if (blocking) {
+             fprintf(stderr, "Warning: --input needs callback I/O, ignoring it with blocking writes.\n");
+         } else if (inputParameters.device == paNoDevice) {
+             fprintf(stderr, "Warning: No usable input device, running output only.\n");
+         } else {
+             const PaDeviceInfo *inputInfo = Pa_GetDeviceInfo(inputParameters.device);
+             inputParameters.channelCount = 1;
+             inputParameters.sampleFormat = paFloat32;
+             inputParameters.suggestedLatency = (g_audioConfig.suggestedLatency > 0.0)
+                                                ? g_audioConfig.suggestedLatency
+                                                : inputInfo->defaultLowInputLatency;
+             inputParameters.hostApiSpecificStreamInfo = NULL;
+             input = &inputParameters;
+             printf("Using input device %d: %s (%s)\n", inputParameters.device, inputInfo->name,
+                    sidechain_mode_name(g_audioConfig.inputMode));
+         }
+     }
+
      // Read sample rate safely from shared data
      double currentSampleRate;
      int ret_lock = pthread_mutex_lock(&data->mutex);
@@ -457,32 +2952,131 @@
      CHECK_PTHREAD_ERR(ret_unlock, "start_audio unlock");
       // Check unlock failure - if lock succeeded, unlock should ideally not fail here often
       if (ret_lock != 0 && ret_unlock != 0) return paInternalError;
- 
- 
+     // With a fixed internal rate the device runs at the configured rate and the engine output is resampled
+     if (g_audioConfig.internalRate > 0.0) currentSampleRate = g_audioConfig.sampleRate;
+
+     audio_stats_reset("portaudio");
+     audio_stats_set_format(sample_format_name(g_paConv.format),
+                            (g_paConv.format == SAMPLE_FORMAT_FLOAT32) ? "none" : dither_mode_name(g_paConv.dither));
+     g_paSampleRate = currentSampleRate;
      printf("Opening stream: SR=%.1f, Frames/Buf=%lu, Suggested Latency=%.4f\n",
             currentSampleRate, framesPerBuffer, outputParameters.suggestedLatency);
- 
-     // Open the default stream
-     err = Pa_OpenDefaultStream(&g_paStream, // Pointer to the stream pointer variable
-                                0, // no input channels
-                                outputParameters.channelCount,
-                                outputParameters.sampleFormat,
-                                currentSampleRate,
-                                framesPerBuffer,
-                                paCallback, // The audio processing callback
-                                data );     // User data pointer passed to callback
+
+     // Open the stream on the selected device
+     err = Pa_OpenStream(&g_paStream, // Pointer to the stream pointer variable
+                         input, // NULL unless modulating with audio input
+                         &outputParameters,
+                         currentSampleRate,
+                         framesPerBuffer,
+                         paNoFlag,
+                         blocking ? NULL : paCallback, // The audio processing callback (none for blocking writes)
+                         data );     // User data pointer passed to callback
      // Use macro that checks error and returns on failure
-     CHECK_PA_ERR_RETURN(err, "Pa_OpenDefaultStream");
- 
+     CHECK_PA_ERR_RETURN(err, "Pa_OpenStream");
+     if (!audio_device_rate_adopt(data, currentSampleRate)) {
+         Pa_CloseStream(g_paStream); g_paStream = NULL;
+         return paInvalidSampleRate;
+     }
+     // Integer formats render each block into a float buffer first, sized now rather than in the audio thread
+     if (g_paConv.format != SAMPLE_FORMAT_FLOAT32) {
+         const PaStreamInfo *info = Pa_GetStreamInfo(g_paStream);
+         unsigned long frames = blocking ? (g_audioConfig.framesPerBuffer ? g_audioConfig.framesPerBuffer : AUDIO_BLOCKING_WRITE_FRAMES)
+                                         : g_audioConfig.framesPerBuffer;
+         if (frames == 0) {
+             // PortAudio picks the block size: allow for the whole reported device latency
+             frames = info ? (unsigned long)(info->outputLatency * currentSampleRate) + 1 : 0;
+             if (frames < AUDIO_SCRATCH_MIN_FRAMES) frames = AUDIO_SCRATCH_MIN_FRAMES;
+         }
+         g_paScratch = malloc(frames * sizeof(float));
+         if (g_paScratch == NULL) {
+             fprintf(stderr, "Error: Cannot allocate the %lu frame render buffer.\n", frames);
+             Pa_CloseStream(g_paStream); g_paStream = NULL;
+             return paInsufficientMemory;
+         }
+         g_paScratchFrames = frames;
+     }
+
      // Start the stream (begins callback execution)
      err = Pa_StartStream(g_paStream);
+     if (err != paNoError) free_pa_scratch();
      CHECK_PA_ERR_RETURN(err, "Pa_StartStream");
- 
+
+     if (blocking) {
+         err = start_blocking_writer(data, g_audioConfig.framesPerBuffer ? g_audioConfig.framesPerBuffer : AUDIO_BLOCKING_WRITE_FRAMES);
+         if (err != paNoError) {
+             Pa_StopStream(g_paStream);
+             Pa_CloseStream(g_paStream); g_paStream = NULL;
+             free_pa_scratch();
+             return err;
+         }
+     }
+
      printf("Audio stream started successfully.\n");
      return paNoError;
  }
- 
- 
+
+
+ /**
+  * @brief Starts the render-ahead thread if a lookahead is configured.
+  * @return 1 if no lookahead is needed or it started, 0 on failure.
+  */
+ static int start_lookahead(SharedSynthData *data) {
+     double lookahead_ms = g_audioConfig.lookaheadMs;
+     double rate;
+     unsigned long frames, max_frames;
+
+     // Blocking writes never render on the device side, so they always need a lookahead
+     if (g_audioConfig.backend == AUDIO_BACKEND_PORTAUDIO && g_audioConfig.ioMode == AUDIO_IO_BLOCKING && lookahead_ms <= 0.0) {
+         lookahead_ms = CONFIG_DEFAULT_BLOCKING_LOOKAHEAD_MS;
+     }
+     if (lookahead_ms <= 0.0) return 1;
+
+     if (pthread_mutex_lock(&data->mutex) != 0) return 0;
+     rate = data->sampleRate;
+     pthread_mutex_unlock(&data->mutex);
+     // Size the ring so the adaptive policy can grow the lookahead in place
+     frames = (unsigned long)(lookahead_ms * rate / 1000.0 + 0.5);
+     max_frames = g_audioConfig.adaptive ? (unsigned long)(g_audioConfig.adaptiveMaxMs * rate / 1000.0 + 0.5) : frames;
+     // Room for the sequencer to render further ahead on top of any target
+     if (g_audioConfig.sequencer) max_frames += (unsigned long)(g_audioConfig.seqPrerenderMs * rate / 1000.0 + 0.5);
+     return lookahead_start(data, frames, max_frames);
+ }
+
+
+ /**
+  * @brief Opens and starts the device stream of the configured backend.
+  * @return `paNoError` (0) on success, or a negative PaError code on failure.
+  */
+ static PaError start_backend(SharedSynthData *data) {
+     PaError err;
+
+     switch (g_audioConfig.backend) {
+         case AUDIO_BACKEND_ALSA:
+ #ifdef HAVE_ALSA
+             err = alsa_backend_start(data, &g_audioConfig);
+ #else
+             fprintf(stderr, "Error: ALSA backend requested but this build has no ALSA support.\n");
+             err = paHostApiNotFound;
+ #endif
+             break;
+         case AUDIO_BACKEND_JACK:
+ #ifdef HAVE_JACK
+             err = jack_backend_start(data, &g_audioConfig);
+ #else
+             fprintf(stderr, "Error: JACK backend requested but this build has no JACK support.\n");
+             err = paHostApiNotFound;
+ #endif
+             break;
+         default:
+             err = start_portaudio(data);
+             break;
+     }
+     // A new stream counts as alive until the watchdog timeout passes without a block
+     if (err == paNoError) atomic_store(&g_watchdog.stream_start_us, (long)(audio_time_now() * 1e6));
+     return err;
+ }
+
+
  /**
   * @brief Stops and closes the active PortAudio stream.
   *
@@ -494,12 +3088,13 @@
   * Errors during stopping are logged but don't prevent closing attempt.
   * @note Resets the global `g_paStream` pointer to NULL on success or after a close failure.
   */
- PaError stop_audio() {
+ static PaError stop_portaudio(void) {
      PaError err = paNoError;
      // Check if stream exists
      if (g_paStream == NULL) { return paNoError; }
  
      printf("Stopping audio stream...\n");
+     stop_blocking_writer();
  
      // Stop the stream
      err = Pa_StopStream(g_paStream);
@@ -509,9 +3104,13 @@
         // Continue to close even if stop failed
      }
  
+     print_stats_summary();
+
      // Close the stream
      err = Pa_CloseStream(g_paStream);
      g_paStream = NULL; // Mark as closed *after* attempting close
+     g_paSampleRate = 0.0;
+     free_pa_scratch();
       if (err != paNoError) {
          // Log error if close fails
          fprintf(stderr, "PortAudio Error in Pa_CloseStream: %s\n", Pa_GetErrorText(err));
@@ -521,6 +3120,503 @@
      printf("Audio stream stopped and closed.\n");
      return paNoError; // Return success only if CloseStream succeeded
  }
+
+
+ /**
+  * @brief Stops and closes the device stream of whichever backend runs it.
+  * @return `paNoError` (0) on success, or the backend's negative PaError code if closing fails.
+  */
+ static PaError stop_backend(void) {
+     PaError err = paNoError;
+ #ifdef HAVE_ALSA
+     if (alsa_backend_is_open()) {
+         printf("Stopping ALSA stream...\n");
+         err = alsa_backend_stop();
+         print_stats_summary();
+     }
+ #endif
+ #ifdef HAVE_JACK
+     if (jack_backend_is_running()) {
+         printf("Stopping JACK client...\n");
+         err = jack_backend_stop();
+         print_stats_summary();
+     }
+ #endif
+     if (g_paStream != NULL) {
+         err = stop_portaudio();
+     }
+     audio_src_release();
+     return err;
+ }
+
+ /**
+  * @brief Whether any backend has an open device stream.
+  */
+ static int backend_is_running(void) {
+ #ifdef HAVE_ALSA
+     if (alsa_backend_is_running()) return 1;
+ #endif
+ #ifdef HAVE_JACK
+     if (jack_backend_is_running()) return 1;
+ #endif
+     return g_paStream != NULL;
+ }
+
+
+ // --- Adaptive Latency ---
+
+ /**
+  * @brief Applies a new buffering setting chosen by the policy.
+  *
+  * A lookahead is resized in place. A device buffer change reopens the stream;
+  * the oscillator and envelope state live in the shared data, so the voices
+  * continue where they were and only the reopen gap is audible. If the device
+  * refuses the new size the previous one is restored.
+  *
+  * The reopen holds `g_restartMutex`, like audio_restart() and the watchdog,
+  * so only one thread closes or opens the device at a time. It is only tried:
+  * a restart holding the mutex stops this thread (adaptive_stop() joins it),
+  * so waiting for it would deadlock; the step is left for the next poll.
+  *
+  * @return 1 if the new setting is active, 0 otherwise.
+  */
+ static int adaptive_apply(unsigned long frames) {
+     unsigned long previous = atomic_load(&g_adaptive.frames);
+
+     if (atomic_load(&g_adaptive.use_lookahead)) {
+         frames = lookahead_set_target(frames);
+     } else {
+         if (pthread_mutex_trylock(&g_restartMutex) != 0) return 0;
+         if (!atomic_load(&g_adaptive.running)) {
+             pthread_mutex_unlock(&g_restartMutex); // Being stopped: leave the stream alone
+             return 0;
+         }
+         stop_backend();
+         config_store_frames(frames);
+         if (start_backend(g_adaptive.data) != paNoError) {
+             fprintf(stderr, "Adaptive latency: cannot reopen with %lu frames, restoring %lu.\n", frames, previous);
+             config_store_frames(previous);
+             if (start_backend(g_adaptive.data) != paNoError) {
+                 fprintf(stderr, "Adaptive latency: cannot restore the stream.\n");
+             }
+             pthread_mutex_unlock(&g_restartMutex);
+             return 0;
+         }
+         pthread_mutex_unlock(&g_restartMutex);
+     }
+     atomic_store(&g_adaptive.frames, frames);
+     return frames != previous;
+ }
+
+ /**
+  * @brief Monitor thread: samples xruns and load, and steps the buffering up or down.
+  */
+ static void *adaptive_thread_main(void *arg) {
+     struct timespec poll = { ADAPTIVE_POLL_MS / 1000, (ADAPTIVE_POLL_MS % 1000) * 1000000L };
+     unsigned long long last_xruns = 0;
+     const int use_lookahead = atomic_load(&g_adaptive.use_lookahead);
+     const double rate = atomic_load(&g_adaptive.sample_rate);
+     (void)arg;
+
+     while (atomic_load(&g_adaptive.running)) {
+         AudioStats st;
+         unsigned long long xruns, new_xruns;
+         unsigned long frames = atomic_load(&g_adaptive.frames);
+         unsigned long next;
+
+         nanosleep(&poll, NULL);
+         audio_get_stats(&st);
+         xruns = (unsigned long long)st.xruns + st.lookaheadUnderruns;
+         // A reopened stream starts its counters from zero
+         new_xruns = (xruns >= last_xruns) ? xruns - last_xruns : xruns;
+         last_xruns = xruns;
+
+         if (frames == 0) {
+             // "auto" buffer size: adopt the block size the backend actually chose
+             if (st.callbacks == 0) continue;
+             frames = (unsigned long)(st.framesRendered / st.callbacks);
+             g_adaptive.min_frames = frames;
+             if (g_adaptive.max_frames < frames) g_adaptive.max_frames = frames;
+             atomic_store(&g_adaptive.frames, frames);
+         }
+
+         switch (adaptive_policy_update(&g_adaptive.policy, (unsigned long)new_xruns, st.cpuLoad, ADAPTIVE_POLL_MS / 1000.0)) {
+             case ADAPTIVE_STEP_UP:
+                 next = (frames * 2 > g_adaptive.max_frames) ? g_adaptive.max_frames : frames * 2;
+                 if (next > frames && adaptive_apply(next)) {
+                     atomic_fetch_add(&g_adaptive.steps_up, 1);
+                     printf("Adaptive latency: %lu xruns, load %.0f%%: %s %lu -> %lu frames (%.1f ms).\n",
+                            (unsigned long)new_xruns, 100.0 * st.cpuLoad, use_lookahead ? "lookahead" : "buffer",
+                            frames, next, 1000.0 * next / rate);
+                     adaptive_policy_applied(&g_adaptive.policy);
+                     last_xruns = 0;
+                 } else {
+                     adaptive_policy_reset(&g_adaptive.policy); // At the ceiling
+                 }
+                 break;
+             case ADAPTIVE_STEP_DOWN:
+                 next = (frames / 2 < g_adaptive.min_frames) ? g_adaptive.min_frames : frames / 2;
+                 if (next < frames && adaptive_apply(next)) {
+                     atomic_fetch_add(&g_adaptive.steps_down, 1);
+                     printf("Adaptive latency: stable, %s %lu -> %lu frames (%.1f ms).\n",
+                            use_lookahead ? "lookahead" : "buffer", frames, next, 1000.0 * next / rate);
+                     adaptive_policy_applied(&g_adaptive.policy);
+                     last_xruns = 0;
+                 } else {
+                     adaptive_policy_reset(&g_adaptive.policy); // Back at the configured setting
+                 }
+                 break;
+             default:
+                 break;
+         }
+         // Lookahead underruns are not reset by a resize
+         if (use_lookahead) last_xruns = xruns;
+     }
+     return NULL;
+ }
+
+ /**
+  * @brief Starts the adaptive latency monitor for the stream that was just opened.
+  *
+  * Resizes the lookahead when the render thread runs, the device buffer otherwise.
+  * The configured size is the lower bound, `adaptiveMaxMs` the upper bound.
+  *
+  * @return 1 on success, 0 if the thread cannot be created.
+  */
+ static int adaptive_start(SharedSynthData *data) {
+     int ret, use_lookahead;
+     double rate;
+
+     if (pthread_mutex_lock(&data->mutex) != 0) return 0;
+     rate = data->sampleRate;
+     pthread_mutex_unlock(&data->mutex);
+
+     g_adaptive.data = data;
+     g_adaptive.configured_frames = g_audioConfig.framesPerBuffer;
+     use_lookahead = lookahead_is_running();
+     // Device buffers are counted at the device rate; the lookahead ring stays at the engine rate
+     if (!use_lookahead && atomic_load(&g_stats.src_device_rate) > 0.0) rate = atomic_load(&g_stats.src_device_rate);
+     atomic_store(&g_adaptive.use_lookahead, use_lookahead);
+     atomic_store(&g_adaptive.sample_rate, rate);
+     g_adaptive.min_frames = use_lookahead ? lookahead_get_target() : g_audioConfig.framesPerBuffer;
+     g_adaptive.max_frames = (unsigned long)(g_audioConfig.adaptiveMaxMs * rate / 1000.0 + 0.5);
+     if (g_adaptive.max_frames < g_adaptive.min_frames) g_adaptive.max_frames = g_adaptive.min_frames;
+     atomic_store(&g_adaptive.frames, g_adaptive.min_frames); // 0 for "auto": measured by the monitor
+     atomic_store(&g_adaptive.steps_up, 0);
+     atomic_store(&g_adaptive.steps_down, 0);
+     adaptive_policy_applied(&g_adaptive.policy);
+
+     atomic_store(&g_adaptive.running, 1);
+     ret = pthread_create(&g_adaptive.thread, NULL, adaptive_thread_main, NULL);
+     if (ret != 0) {
+         fprintf(stderr, "Error: Cannot create adaptive latency thread: %s\n", strerror(ret));
+         atomic_store(&g_adaptive.running, 0);
+         return 0;
+     }
+     atomic_store(&g_adaptive.enabled, 1);
+     printf("Adaptive latency: resizing the %s between %lu and %lu frames.\n",
+            use_lookahead ? "lookahead" : "device buffer", g_adaptive.min_frames, g_adaptive.max_frames);
+     return 1;
+ }
+
+ /**
+  * @brief Stops the adaptive latency monitor, if it runs. Returns within one poll interval.
+  */
+ static void adaptive_stop(void) {
+     if (!atomic_load(&g_adaptive.running)) return;
+     atomic_store(&g_adaptive.running, 0);
+     pthread_join(g_adaptive.thread, NULL);
+     // The next start_audio() begins from the configured size again
+     config_store_frames(g_adaptive.configured_frames);
+ }
+
+
+ // Stream watchdog, defined after the restart it uses
+ static int audio_watchdog_start(SharedSynthData *data);
+ static void audio_watchdog_stop(void);
+
+
+ /**
+  * @brief Opens and starts the output stream on the configured backend.
+  *
+  * Starts the render-ahead thread first when a lookahead is configured, then
+  * the PortAudio stream or the native ALSA/JACK backend selected in the
+  * active `AudioConfig`, and finally the adaptive latency monitor, the
+  * stream watchdog and the MIDI input if enabled. A MIDI input that cannot
+  * be opened is reported but does not fail the start.
+  * Every backend renders through render_audio(), or copies from the lookahead
+  * ring while the render thread runs. The configured automation file is
+  * played, or recorded into, from the first block on.
+  *
+  * @param[in] data Pointer to the shared synthesizer data structure (used for sample rate and passed to callback).
+  * @return `paNoError` (0) on success, or a negative PaError code on failure.
+  */
+ PaError start_audio(SharedSynthData *data) {
+     PaError err;
+
+     audio_midi_reset();
+     if (g_audioConfig.automationPlay[0] != '\0') {
+         if (!audio_automation_play(g_audioConfig.automationPlay)) fprintf(stderr, "Warning: Running without automation playback.\n");
+     } else if (g_audioConfig.automationRecord[0] != '\0') {
+         if (!audio_automation_record(g_audioConfig.automationRecord)) fprintf(stderr, "Warning: Running without automation recording.\n");
+     }
+     if (!start_lookahead(data)) {
+         audio_automation_stop();
+         return paInsufficientMemory;
+     }
+
+     atomic_store(&g_adaptive.enabled, 0);
+     err = start_backend(data);
+     if (err != paNoError) {
+         lookahead_stop();
+         audio_automation_stop();
+         return err;
+     }
+     if (g_audioConfig.adaptive && !adaptive_start(data)) {
+         fprintf(stderr, "Warning: Running without adaptive latency.\n");
+     }
+     if (g_audioConfig.watchdogMs > 0.0 && !audio_watchdog_start(data)) {
+         fprintf(stderr, "Warning: Running without the audio watchdog.\n");
+     }
+     if (g_audioConfig.midiInput || g_audioConfig.midiClock != MIDI_CLOCK_OFF) {
+ #ifdef HAVE_ALSA
+         if (!midi_alsa_start(g_audioConfig.midiSource, g_audioConfig.midiClock == MIDI_CLOCK_OUT)) {
+             fprintf(stderr, "Warning: Running without MIDI input.\n");
+         } else if (g_audioConfig.midiClock != MIDI_CLOCK_OFF) {
+             printf("MIDI clock: %s\n", midisync_mode_name(g_audioConfig.midiClock));
+         }
+ #else
+         fprintf(stderr, "Warning: MIDI input and clock need the ALSA sequencer, which this build lacks.\n");
+ #endif
+     }
+     if (g_audioConfig.oscPort > 0 && !osc_server_start(g_audioConfig.oscPort)) {
+         fprintf(stderr, "Warning: Running without the OSC server.\n");
+     }
+     if (g_audioConfig.controlSocket[0] != '\0' && !control_server_start(g_audioConfig.controlSocket, data)) {
+         fprintf(stderr, "Warning: Running without the control socket.\n");
+     }
+     return paNoError;
+ }
+
+
+ /**
+  * @brief Stops and closes the active stream, whichever backend runs it.
+  *
+  * MIDI input, the OSC server and the control socket stop first, then the watchdog and the adaptive monitor so neither can reopen the stream, and
+  * the device is stopped before the render-ahead thread so that nothing reads
+  * the lookahead ring once it is freed. An automation recording is completed
+  * in its file last. Safe to call when nothing is running.
+  *
+  * @return `paNoError` (0) on success, or the backend's negative PaError code if closing fails.
+  */
+ PaError stop_audio() {
+     PaError err;
+
+ #ifdef HAVE_ALSA
+     midi_alsa_stop();
+ #endif
+     osc_server_stop();
+     control_server_stop();
+     audio_watchdog_stop();
+     adaptive_stop();
+     err = stop_backend();
+     lookahead_stop();
+     audio_automation_stop();
+     return err;
+ }
+
+
+ // --- Runtime Reconfiguration ---
+
+ /**
+  * @brief Whether two configurations run the render-ahead thread identically.
+  */
+ static int same_lookahead_config(const AudioConfig *a, const AudioConfig *b) {
+     return a->lookaheadMs == b->lookaheadMs && a->ioMode == b->ioMode && a->backend == b->backend &&
+            a->adaptive == b->adaptive && a->adaptiveMaxMs == b->adaptiveMaxMs && a->internalRate == b->internalRate &&
+            a->sequencer == b->sequencer && a->seqPrerenderMs == b->seqPrerenderMs;
+ }
+
+ /**
+  * @brief Opens the device stream, restarting the render-ahead thread unless it is kept.
+  */
+ static PaError reopen_streams(SharedSynthData *data, int keep_lookahead) {
+     PaError err;
+
+     if (!keep_lookahead) {
+         lookahead_stop();
+         if (!start_lookahead(data)) return paInsufficientMemory;
+     }
+     err = start_backend(data);
+     if (err != paNoError && !keep_lookahead) lookahead_stop();
+     return err;
+ }
+
+ /**
+  * @brief Restart shared by audio_restart() and the watchdog. Caller holds `g_restartMutex`.
+  * @see audio_restart()
+  */
+ static PaError restart_streams(SharedSynthData *data, const AudioConfig *config) {
+     AudioConfig previous;
+     PaError err;
+     double start;
+     int keep_lookahead;
+
+     adaptive_stop(); // Also restores the configured buffer size
+     previous = g_audioConfig;
+     if (config != NULL) config_store(config);
+     keep_lookahead = lookahead_is_running() && same_lookahead_config(&previous, &g_audioConfig);
+
+     start = audio_time_now();
+     stop_backend();
+     // The old stream is closed: its last block starts the gap measured by the first new block
+     atomic_store(&g_restart.gap_start_us, atomic_load(&g_restart.last_block_us));
+     err = reopen_streams(data, keep_lookahead);
+     if (err != paNoError && config != NULL) {
+         fprintf(stderr, "Audio restart failed (%s), restoring the previous configuration.\n", Pa_GetErrorText(err));
+         config_store(&previous);
+         if (reopen_streams(data, keep_lookahead && lookahead_is_running()) != paNoError) {
+             fprintf(stderr, "Error: Cannot restore the previous audio stream.\n");
+         }
+     }
+     if (err != paNoError) atomic_store(&g_restart.gap_start_us, 0);
+
+     if (err == paNoError) {
+         long us = (long)((audio_time_now() - start) * 1e6 + 0.5);
+         atomic_store(&g_restart.restart_us, us);
+         atomic_fetch_add(&g_restart.count, 1);
+         printf("Audio restarted in %.1f ms.\n", us / 1000.0);
+     }
+
+     if (g_audioConfig.adaptive && backend_is_running() && !adaptive_start(data)) {
+         fprintf(stderr, "Warning: Running without adaptive latency.\n");
+     }
+     return err;
+ }
+
+ /**
+  * @brief Stops the stream and reopens it, optionally with a new configuration.
+  *
+  * Oscillator phases and envelope states live in the shared data, so every
+  * voice continues where it was. If the render-ahead thread can stay as it is
+  * it keeps running through the restart, and the new device starts from the
+  * audio already rendered for the old one. Only the device side is closed and
+  * reopened, which keeps the gap to the close/open time of the driver.
+  *
+  * If the new configuration cannot be opened, the previous one is restored.
+  *
+  * The watchdog keeps running with the timeout it was started with.
+  *
+  * @return `paNoError` if the new configuration runs, else the error that prevented it.
+  */
+ PaError audio_restart(SharedSynthData *data, const AudioConfig *config) {
+     PaError err;
+
+     pthread_mutex_lock(&g_restartMutex);
+     err = restart_streams(data, config);
+     pthread_mutex_unlock(&g_restartMutex);
+     return err;
+ }
+
+
+ // --- Stream Watchdog ---
+
+ /**
+  * @brief Logs what the engine last saw of a stream that went silent.
+  */
+ static void watchdog_log_stall(double silent_sec) {
+     AudioStats st;
+
+     audio_get_stats(&st);
+     fprintf(stderr, "Audio watchdog: no audio for %.0f ms on %s (callbacks=%llu, xruns=%lu",
+             1000.0 * silent_sec, st.backend, st.callbacks, st.xruns);
+     if (st.dacLatencyMs >= 0.0) fprintf(stderr, ", last DAC latency %.2fms", st.dacLatencyMs);
+     if (st.cpuLoadPeak >= 0.0) fprintf(stderr, ", load peak %.0f%%", 100.0 * st.cpuLoadPeak);
+     if (st.lookaheadFrames > 0) fprintf(stderr, ", lookahead underruns %lu", st.lookaheadUnderruns);
+     fprintf(stderr, "). Restarting the stream.\n");
+ }
+
+ /**
+  * @brief Watchdog thread: checks the block heartbeat and restarts a stalled stream.
+  *
+  * Every device block timestamps `g_restart.last_block_us`. Decisions are
+  * taken under `g_restartMutex`, so a restart in progress elsewhere is never
+  * mistaken for a stall and never raced. The restart keeps the voices (they
+  * live in the shared data) and the render-ahead thread, exactly like
+  * audio_restart() with the current configuration.
+  */
+ static void *watchdog_thread_main(void *arg) {
+     // Poll four times per timeout, between 10 ms and 250 ms
+     long poll_ms = (long)(g_watchdog.policy.timeout * 1000.0 / 4.0);
+     if (poll_ms < 10) poll_ms = 10;
+     if (poll_ms > 250) poll_ms = 250;
+     struct timespec poll = { poll_ms / 1000, (poll_ms % 1000) * 1000000L };
+     (void)arg;
+
+     while (atomic_load(&g_watchdog.running)) {
+         nanosleep(&poll, NULL);
+         if (!atomic_load(&g_watchdog.running)) break;
+
+         pthread_mutex_lock(&g_restartMutex);
+         double now = audio_time_now();
+         double beat = atomic_load(&g_restart.last_block_us) / 1e6;
+         double start = atomic_load(&g_watchdog.stream_start_us) / 1e6;
+         switch (watchdog_update(&g_watchdog.policy, now, beat, start)) {
+             case WATCHDOG_STALLED:
+                 atomic_fetch_add(&g_watchdog.outages, 1);
+                 watchdog_log_stall(now - g_watchdog.policy.outage_start);
+                 // fall through
+             case WATCHDOG_RETRY:
+                 if (restart_streams(g_watchdog.data, NULL) != paNoError) {
+                     atomic_fetch_add(&g_watchdog.failed_restarts, 1);
+                     fprintf(stderr, "Audio watchdog: restart failed, trying again.\n");
+                 }
+                 watchdog_restarted(&g_watchdog.policy, audio_time_now());
+                 break;
+             case WATCHDOG_RECOVERED: {
+                 double outage = watchdog_outage_duration(&g_watchdog.policy, beat);
+                 atomic_store(&g_watchdog.outage_us, (long)(outage * 1e6 + 0.5));
+                 atomic_fetch_add(&g_watchdog.recoveries, 1);
+                 printf("Audio watchdog: audio is back after %.0f ms.\n", 1000.0 * outage);
+                 break;
+             }
+             default:
+                 break;
+         }
+         pthread_mutex_unlock(&g_restartMutex);
+     }
+     return NULL;
+ }
+
+ /**
+  * @brief Starts the watchdog for the stream that was just opened.
+  * @return 1 on success, 0 if the thread cannot be created.
+  */
+ static int audio_watchdog_start(SharedSynthData *data) {
+     int ret;
+
+     if (atomic_load(&g_watchdog.running)) return 1;
+     watchdog_init(&g_watchdog.policy, g_audioConfig.watchdogMs / 1000.0);
+     g_watchdog.data = data;
+     atomic_store(&g_watchdog.running, 1);
+     ret = pthread_create(&g_watchdog.thread, NULL, watchdog_thread_main, NULL);
+     if (ret != 0) {
+         fprintf(stderr, "Error: Cannot create audio watchdog thread: %s\n", strerror(ret));
+         atomic_store(&g_watchdog.running, 0);
+         return 0;
+     }
+     printf("Audio watchdog: restarting the stream after %.0f ms without audio.\n", g_audioConfig.watchdogMs);
+     return 1;
+ }
+
+ /**
+  * @brief Stops the watchdog, if it runs. Returns within one poll interval (or after a restart in progress).
+  */
+ static void audio_watchdog_stop(void) {
+     if (!atomic_load(&g_watchdog.running)) return;
+     atomic_store(&g_watchdog.running, 0);
+     pthread_join(g_watchdog.thread, NULL);
+ }
  
  
  /**
@@ -535,6 +3631,18 @@
      PaError err = paNoError;
  
      // Ensure stream is stopped before terminating PortAudio
+ #ifdef HAVE_ALSA
+     if (alsa_backend_is_open()) {
+         fprintf(stderr, "Warning: Terminating while ALSA stream is open. Stopping it first.\n");
+         stop_audio();
+     }
+ #endif
+ #ifdef HAVE_JACK
+     if (jack_backend_is_running()) {
+         fprintf(stderr, "Warning: Terminating while JACK client is open. Stopping it first.\n");
+         stop_audio();
+     }
+ #endif
      if (g_paStream != NULL) {
          fprintf(stderr, "Warning: Terminating PortAudio while stream seems open. Attempting stop first.\n");
          stop_audio(); // Attempt graceful stop/close
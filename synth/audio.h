@@ -12,7 +12,123 @@
  
  #include <portaudio.h> 
  #include "synth_data.h" 
+ #include "config.h"
+ #include "midi.h"
+ #include "midimap.h"
+ #include "sequencer.h"
  
+ // --- Constants ---
+ #define AUDIO_CONTROL_BATCH_MAX 64    ///< Most events audio_control_batch() queues at once.
+ #define AUDIO_PARAMS_MAX_AGE_MS 100   ///< Age after which audio_get_params() no longer trusts the render thread's copy.
+ #define SEQ_PRERENDER_IDLE_SEC 1.0    ///< Time without input before the sequencer is rendered further ahead.
+ #define SEQ_PRERENDER_MAX_LOAD 0.5    ///< Render load (render time / block time) above which it is not.
+ #define AUTOMATION_DRAIN_MS 20        ///< Interval at which the recorder thread moves recorded changes into the take.
+ #define AUTOMATION_FLUSH_SEC 1.0      ///< Interval at which it appends them to the recording's file.
+ #define AUDIO_KEY_PENDING 64          ///< Keyboard notes waiting in the schedule whose latency is still to be taken.
+
+ /**
+  * @enum AudioAutomationMode
+  * @brief What the engine does with the automation take.
+  */
+ typedef enum {
+     AUDIO_AUTOMATION_OFF,
+     AUDIO_AUTOMATION_RECORD,          ///< Parameter changes are recorded into the take.
+     AUDIO_AUTOMATION_PLAY             ///< The take sets the parameters.
+ } AudioAutomationMode;
+
+ // --- Engine Statistics ---
+
+ /**
+  * @struct AudioStats
+  * @brief Snapshot of the running stream's counters and latency measurements.
+  *
+  * The callback-to-DAC latency is the time between rendering a block and its
+  * first sample reaching the converter, as reported by the active backend
+  * (PortAudio stream time, ALSA `snd_pcm_delay()` or JACK port latency).
+  */
+ typedef struct {
+     const char *backend;               ///< Name of the backend that produced the numbers ("portaudio", "alsa", "jack", "none").
+     unsigned long long callbacks;      ///< Number of blocks rendered.
+     unsigned long long framesRendered; ///< Total number of frames rendered.
+     unsigned long xruns;               ///< Buffer underruns/overruns reported by the backend.
+     double dacLatencyMs;               ///< Most recent callback-to-DAC latency in ms (-1 if not measured).
+     double dacLatencyMinMs;            ///< Minimum callback-to-DAC latency in ms (-1 if not measured).
+     double dacLatencyMaxMs;            ///< Maximum callback-to-DAC latency in ms (-1 if not measured).
+     double dacLatencyAvgMs;            ///< Moving average of the callback-to-DAC latency in ms (-1 if not measured).
+     unsigned long lookaheadFrames;     ///< Target fill of the render-ahead ring in frames (0 = render thread off).
+     unsigned long lookaheadFill;       ///< Ring fill seen by the device at its most recent read.
+     unsigned long lookaheadMinFill;    ///< Lowest ring fill seen by the device: the unused safety margin.
+     unsigned long lookaheadUnderruns;  ///< Device reads the render thread could not fully serve.
+     double cpuLoad;                    ///< Moving average of render time / block time on the device side (-1 if not measured).
+     double cpuLoadPeak;                ///< Highest single-block load seen (-1 if not measured).
+     int adaptive;                      ///< Non-zero while the adaptive latency policy is running.
+     const char *adaptiveTarget;        ///< What the policy resizes: "buffer" (device block) or "lookahead".
+     unsigned long adaptiveFrames;      ///< Buffering currently selected by the policy, in frames.
+     double adaptiveLatencyMs;          ///< The same in milliseconds: the latency this instance settled on.
+     unsigned long adaptiveStepsUp;     ///< Times the policy increased the buffering.
+     unsigned long adaptiveStepsDown;   ///< Times the policy reduced it again after a stable period.
+     const char *srcQuality;            ///< Resampler quality ("low", "medium", "high"), or "off" when the engine runs at the device rate.
+     double srcEngineRate;              ///< Rate the engine renders at (Hz), 0 when not resampling.
+     double srcDeviceRate;              ///< Rate the device runs at (Hz), 0 when not resampling.
+     double srcLatencyMs;               ///< Latency added by the resampler filter, in ms.
+     double srcLoad;                    ///< Moving average of resampling time / block time (-1 if not measured).
+     const char *inputMode;             ///< Configured input modulation ("off", "ringmod", "follow", "vocoder").
+     double duplexLatencyMs;            ///< Last input-ADC-to-output-DAC round trip, in ms (-1 if not measured).
+     double duplexLatencyMinMs;         ///< Smallest round trip seen, in ms (-1 if not measured).
+     double duplexLatencyMaxMs;         ///< Largest round trip seen, in ms (-1 if not measured).
+     const char *sampleFormat;          ///< Device sample format ("float32", "int16", "int24").
+     const char *dither;                ///< Dither of integer formats ("none", "tpdf", "shaped").
+     double convertLoad;                ///< Moving average of float-to-integer conversion time / block time (-1 if not converting).
+     unsigned long restarts;            ///< Successful audio_restart() calls (and watchdog restarts) since startup.
+     double restartMs;                  ///< Time the last audio_restart() took, in ms (-1 if none).
+     double restartGapMs;               ///< Time between the last block before and the first block after the last restart (-1 if none).
+     double restartGapMaxMs;            ///< Largest such gap, in ms (-1 if none).
+     unsigned long watchdogOutages;     ///< Times the watchdog found the stream silent for longer than `watchdogMs`.
+     unsigned long watchdogRecoveries;  ///< Outages that ended with audio playing again.
+     unsigned long watchdogFailedRestarts; ///< Watchdog restarts that could not reopen the stream.
+     double watchdogOutageMs;           ///< Duration of the last recovered outage, last block to first block, in ms (-1 if none).
+     unsigned long midiEvents;          ///< MIDI events applied by the render loop since startup.
+     unsigned long midiLateEvents;      ///< Events whose frame had already been rendered, applied at the start of a block instead.
+     unsigned long midiDroppedEvents;   ///< Events lost because the queue to the audio thread was full.
+     unsigned long midiCoalescedEvents; ///< Controller messages merged into an event still waiting in the queue.
+     unsigned long mpeNotes;            ///< Notes played by MPE voices.
+     unsigned long mpeStolen;           ///< MPE notes that took over a sounding voice because all were busy.
+     unsigned long mpeVoicesPeak;       ///< Most MPE voices sounding at once.
+     unsigned long arpNotes;            ///< Notes played by the arpeggiator.
+     unsigned long seqSteps;            ///< Steps played by the sequencer (rests included).
+     unsigned long seqPrerenders;       ///< Times the render thread started rendering ahead for the sequencer.
+     int seqPrerendering;               ///< Non-zero while it renders `seqPrerenderMs` further ahead.
+     unsigned long midiClockTicks;      ///< MIDI clock ticks received (`midiClock` "in").
+     unsigned long midiClockLost;       ///< Times the received clock stopped for MIDISYNC_TIMEOUT_TICKS tick periods.
+     double midiClockTempo;             ///< Tempo of the received clock in beats per minute, 0 without one.
+     int midiClockLocked;               ///< Non-zero while the tempo loop is locked to it.
+     double midiClockJitterMs;          ///< RMS deviation of the ticks from the loop's prediction while locked, in ms (-1 if none).
+     double midiClockJitterMaxMs;       ///< Largest deviation, in ms (-1 if none).
+     unsigned long midiClockSent;       ///< MIDI clock ticks sent (`midiClock` "out").
+     double midiClockLateMs;            ///< RMS lateness of the sent ticks against their time, in ms (-1 if none).
+     double midiClockLateMaxMs;         ///< Largest lateness, in ms (-1 if none).
+     AudioAutomationMode automationMode;
+     unsigned long automationPoints;    ///< Points in the automation take.
+     unsigned long automationBytes;     ///< Their encoded size.
+     unsigned long automationDropped;   ///< Recorded changes lost to a full queue or a failed append.
+     unsigned long keyNotes;            ///< Notes played on the computer keyboard (audio_key_input()).
+     double keyLatencyMs;               ///< Key handler to DAC for the last of them, taken when its note on is applied, in ms (-1 if none).
+     double keyLatencyMinMs;            ///< Shortest key-to-sound latency, in ms (-1 if none).
+     double keyLatencyMaxMs;            ///< Longest key-to-sound latency, in ms (-1 if none).
+     double keyLatencyAvgMs;            ///< Moving average of the key-to-sound latency, in ms (-1 if none).
+ } AudioStats;
+
+ /**
+  * @struct AudioOutputDevice
+  * @brief One entry of audio_get_output_devices().
+  */
+ typedef struct {
+     int index;                         ///< PortAudio device index, usable as `AudioConfig::deviceIndex`.
+     char name[CONFIG_DEVICE_NAME_MAX]; ///< Device name as reported by PortAudio.
+     int isDefault;                     ///< Non-zero for the system default output device.
+     int isActive;                      ///< Non-zero for the device of the current (or last) stream.
+ } AudioOutputDevice;
+
  // --- Public Audio Control Functions ---
  
  /**
@@ -25,7 +141,52 @@
  PaError initialize_audio(SharedSynthData *data);
  
  /**
-  * @brief Opens and starts the default PortAudio output stream.
+  * @brief Sets the stream configuration used by subsequent start_audio() calls.
+  * @param[in] config Device, buffer size and latency selection. Copied internally.
+  * @note The engine renders at `SharedSynthData::sampleRate`, which the caller
+  * should initialise from `config->internalRate` if set, else `config->sampleRate`.
+  * With an internal rate the device is opened at `config->sampleRate` and the
+  * engine output is resampled to it.
+  * @see audio_set_config() implementation in audio.c
+  */
+ void audio_set_config(const AudioConfig *config);
+
+ /**
+  * @brief Copies the stream configuration currently in use (e.g. to modify and pass to audio_restart()).
+  * @param[out] config Receives the configuration.
+  * @see audio_get_config() implementation in audio.c
+  */
+ void audio_get_config(AudioConfig *config);
+
+ /**
+  * @brief Prints all PortAudio devices that provide output channels.
+  *
+  * Must be called after initialize_audio(). Device indices printed here can be
+  * passed to `--device`.
+  *
+  * @return `paNoError` (0) on success, or a negative PaError code on failure.
+  * @see list_audio_devices() implementation in audio.c
+  */
+ PaError list_audio_devices(void);
+
+ /**
+  * @brief Lists the PortAudio devices that provide output channels.
+  * @param[out] devices Receives up to `max` entries.
+  * @param max Capacity of `devices`.
+  * @return The number of output devices (may exceed `max`), or a negative PaError code.
+  * @see audio_get_output_devices() implementation in audio.c
+  */
+ int audio_get_output_devices(AudioOutputDevice *devices, int max);
+
+ /**
+  * @brief Opens and starts the output stream on the configured backend.
+  *
+  * Uses PortAudio by default, the native ALSA mmap backend when
+  * `AudioConfig::backend` is `AUDIO_BACKEND_ALSA`, or a JACK client for
+  * `AUDIO_BACKEND_JACK` (returns `paHostApiNotFound` if the program was built
+  * without support for the requested backend). With `AudioConfig::adaptive`
+  * a monitor thread then resizes the buffering from the measured xruns and load.
+  *
   * @param[in] data Pointer to the shared synthesizer data structure (used for
   * sample rate and passed to the audio callback).
   * @return `paNoError` (0) on success, or a negative PaError code on failure.
@@ -34,12 +195,242 @@
  PaError start_audio(SharedSynthData *data);
  
  /**
-  * @brief Stops and closes the active PortAudio stream.
+  * @brief Copies the statistics of the current (or last) stream.
+  * @param[out] stats Receives the snapshot. May be called from any thread.
+  * @see audio_get_stats() implementation in audio.c
+  */
+ void audio_get_stats(AudioStats *stats);
+
+ /**
+  * @brief Stops and closes the active stream (PortAudio or native backend).
   * @return `paNoError` (0) on success, or a negative PaError code if closing fails.
   * @note Safe to call even if the stream is already stopped.
   * @see stop_audio() implementation in audio.c
   */
  PaError stop_audio();
+
+ /**
+  * @brief Reopens the output stream at runtime, e.g. on another device.
+  *
+  * Stops the device stream and reopens it with `config` (or the current
+  * configuration if NULL) without touching the voices: oscillator phases and
+  * envelopes continue where they were. The render-ahead thread keeps running
+  * when its settings are unchanged. If the new configuration cannot be opened
+  * the previous one is restored. Thread-safe; concurrent calls are serialised.
+  *
+  * @param[in] data Pointer to the shared synthesizer data structure.
+  * @param[in] config New configuration, copied, or NULL to restart with the current one.
+  * @return `paNoError` (0) if the requested configuration runs, else the negative PaError code that prevented it.
+  * @see audio_restart() implementation in audio.c
+  */
+ PaError audio_restart(SharedSynthData *data, const AudioConfig *config);
+
+ /**
+  * @brief Queues a MIDI channel message for the audio thread, stamped with the audio clock.
+  *
+  * Never blocks: the event goes through a lock-free queue and takes effect at
+  * its sample offset in the block after the one being rendered when it arrived.
+  * A note on starts both waves, wave 1 at the note's pitch and wave 2 at the
+  * same interval to it as set in the GUI; velocity scales both. Controller 7
+  * sets the volume, 120/123 silence or release the note; other controllers
+  * drive the parameters assigned with audio_midi_map() or MIDI learn.
+  * With `mpe` configured every note plays a voice of its own instead, bent,
+  * pressed and shaded by its channel's pitch bend, pressure and controller 74
+  * (see mpe.h). Must only be called from one thread at a time (the MIDI input thread).
+  *
+  * @param type Note on, note off, controller, pitch bend or channel pressure.
+  * @param channel MIDI channel 0-15 (all channels are played).
+  * @param data1 Note or controller number, pressure or low 7 bits of the bend, 0-127.
+  * @param data2 Velocity, controller value or high 7 bits of the bend, 0-127.
+  * @return 1 if queued, 0 if the queue was full and the event was dropped.
+  * @see audio_midi_input() implementation in audio.c
+  */
+ int audio_midi_input(MidiEventType type, int channel, int data1, int data2);
+
+ /**
+  * @brief Queues a note played on the computer keyboard, stamped with the audio clock.
+  *
+  * Like audio_midi_input() on channel 1, through a lock-free queue of its own,
+  * so a key press reaches the render thread without the synth data mutex or
+  * the note buttons. When the render thread applies the note on it records the
+  * time from this call to the note reaching the DAC (see AudioStats::keyLatencyMs).
+  * Must only be called from one thread at a time (the GUI thread).
+  *
+  * @param note MIDI note 0-127.
+  * @param velocity Velocity 1-127, 0 for the key's release.
+  * @return 1 if queued, 0 if the queue was full and the note was dropped.
+  * @see audio_key_input() implementation in audio.c
+  */
+ int audio_key_input(int note, int velocity);
+
+ /**
+  * @brief Queues an event from a control interface (OSC, control socket) to take effect at a given time.
+  *
+  * Never blocks the audio thread: the event goes through a lock-free queue of
+  * its own, separate from the MIDI input's, and the render thread sorts it into
+  * a schedule by frame, so events may be queued for any time ahead. A time is
+  * mapped to a frame like a MIDI arrival (one block ahead of the clock), so
+  * the spacing between timed events is kept to the sample. Besides note and
+  * controller events, MIDI_EVENT_PARAM sets a parameter directly; the value is
+  * written back to the shared data like a mapped controller's.
+  * Callable from any number of threads; they serialise on a lock of their own.
+  *
+  * @param[in] ev The event; its `frame` is ignored.
+  * @param time_sec When the event should sound, on the audio_time_now() clock
+  * (the arrival time for "as soon as possible"). Past times play in the next block.
+  * @return 1 if queued, 0 if the queue was full and the event was dropped.
+  * @see audio_control_event() implementation in audio.c
+  */
+ int audio_control_event(const MidiEvent *ev, double time_sec);
+
+ /**
+  * @brief Queues events from a control interface that must take effect together.
+  *
+  * All events get the frame of `time_sec` (see audio_control_event()) and are
+  * published to the render thread in one step, so they apply in the same
+  * block, at the same sample, in the given order. MIDI_EVENT_WAVEFORM may be
+  * used besides the events audio_control_event() accepts.
+  *
+  * @param[in] events The events; their `frame` is ignored.
+  * @param count Number of events, at most AUDIO_CONTROL_BATCH_MAX.
+  * @param time_sec When the events should sound, on the audio_time_now() clock.
+  * @return 1 if all were queued, 0 if the queue had no room for all of them (none is queued).
+  * @see audio_control_batch() implementation in audio.c
+  */
+ int audio_control_batch(const MidiEvent *events, unsigned int count, double time_sec);
+
+ /**
+  * @brief Sets the step pattern the sequencer loops while `sequencer` is configured.
+  *
+  * Handed to the render thread like the controller assignments (it only
+  * try-locks to pick up a change), which starts the pattern on the next step
+  * of the tempo grid. Each step's parameter locks replace the GUI values of
+  * their parameters until the next step, without being written to the shared data.
+  *
+  * @param[in] pattern The pattern, copied; a length of 0 (or NULL) stops the sequencer.
+  * @see audio_seq_set_pattern() implementation in audio.c
+  */
+ void audio_seq_set_pattern(const SeqPattern *pattern);
+
+ /**
+  * @brief Copies the pattern last set with audio_seq_set_pattern() (length 0 if none).
+  * @param[out] pattern Receives the pattern.
+  * @see audio_seq_get_pattern() implementation in audio.c
+  */
+ void audio_seq_get_pattern(SeqPattern *pattern);
+
+ /**
+  * @brief Starts recording a new automation take, replacing the current one.
+  *
+  * From the next block on, every parameter change is recorded at the sample
+  * it takes effect: mapped controllers and control interface events at their
+  * frame, slider moves in the GUI (which reach the engine between blocks) at
+  * the start of the block that plays them. The first block records the value
+  * of every parameter, so the take starts from the sound it was recorded
+  * with. The render thread only queues the changes; a recorder thread adds
+  * them to the take every AUTOMATION_DRAIN_MS and, with a file, appends them
+  * to it every AUTOMATION_FLUSH_SEC, so a crash loses at most that much.
+  * Waveform changes are not recorded.
+  *
+  * @param path File the take is written to while recording, NULL or "" to keep it in memory only.
+  * @return 1 if recording starts, 0 if the file cannot be created or the thread cannot start.
+  * @see audio_automation_record() implementation in audio.c
+  */
+ int audio_automation_record(const char *path);
+
+ /**
+  * @brief Plays an automation take from its start, beginning with the next block.
+  *
+  * The render thread sets each recorded parameter on the sample of its
+  * points and ramps linearly between them (see automation.h), splitting the
+  * block like a MIDI event; the values are written back to the shared data,
+  * so the sliders follow. A take recorded at another engine rate is
+  * stretched to the current one. Stops a recording first.
+  *
+  * @param path Take file to load, or NULL to play the take in memory (e.g. the one just recorded).
+  * @return 1 if playback starts, 0 if the file cannot be loaded or the take is empty.
+  * @see audio_automation_play() implementation in audio.c
+  */
+ int audio_automation_play(const char *path);
+
+ /**
+  * @brief Stops recording or playing automation; a recording is completed in its file. The take is kept.
+  * @see audio_automation_stop() implementation in audio.c
+  */
+ void audio_automation_stop(void);
+
+ /**
+  * @brief Writes the automation take to a file.
+  * @return 1 on success, 0 on failure or while recording (the recording has its own file).
+  * @see audio_automation_save() implementation in audio.c
+  */
+ int audio_automation_save(const char *path);
+
+ /**
+  * @brief Reads the synth parameters without contending with the audio thread.
+  *
+  * While audio runs, returns the values the last rendered block played with,
+  * published by the render thread, including changes from controllers and
+  * control interfaces. When no block was rendered for AUDIO_PARAMS_MAX_AGE_MS,
+  * reads the shared data under its mutex instead.
+  *
+  * @param[in] data The shared synthesizer data.
+  * @param[out] values Receives the parameters, indexed by SynthParam.
+  * @param[out] waves Receives the waveforms of wave 1 and wave 2.
+  * @return 1 on success, 0 if the mutex could not be taken.
+  * @see audio_get_params() implementation in audio.c
+  */
+ int audio_get_params(SharedSynthData *data, double values[SYNTH_PARAM_COUNT], WaveformType waves[2]);
+
+ /**
+  * @brief Assigns a controller to a synth parameter, or removes its assignment.
+  *
+  * Mapped controllers set the parameter in the render thread, at the sample
+  * offset of the controller message; the new value is then written to the
+  * shared data, where the GUI picks it up (see audio_midi_param_updates()).
+  * Messages for a controller that arrive while its previous one still waits
+  * for the render thread are merged into it, so only the latest value of a
+  * fast-moving controller is applied once per block.
+  *
+  * @param param The parameter.
+  * @param[in] mapping Controller, channel, range and curve, or NULL to unmap the parameter.
+  * @return 1 on success, 0 if the parameter or the controller number is invalid.
+  * @see audio_midi_map() implementation in audio.c
+  */
+ int audio_midi_map(SynthParam param, const MidiMapping *mapping);
+
+ /**
+  * @brief Copies the current controller assignments.
+  * @param[out] map Receives the assignments.
+  * @see audio_midi_get_map() implementation in audio.c
+  */
+ void audio_midi_get_map(MidiMap *map);
+
+ /**
+  * @brief Arms MIDI learn: the next controller received is assigned to `param`.
+  *
+  * The learned mapping uses the controller's channel and the parameter's full
+  * range and natural curve (see midimap_default()).
+  *
+  * @param param The parameter to learn, or -1 to cancel.
+  * @see audio_midi_learn() implementation in audio.c
+  */
+ void audio_midi_learn(int param);
+
+ /**
+  * @brief Returns the parameter waiting for a controller, or -1 if learn is not armed.
+  */
+ int audio_midi_learning(void);
+
+ /**
+  * @brief Counts the blocks that wrote controller values to the shared data.
+  *
+  * The GUI polls this and refreshes its sliders when it changed, so a storm of
+  * controller messages costs at most one refresh per poll.
+  *
+  * @see audio_midi_param_updates() implementation in audio.c
+  */
+ unsigned long audio_midi_param_updates(void);
  
  /**
   * @brief Terminates the PortAudio library.
@@ -0,0 +1,433 @@
+/**
+ * @file audio_alsa.c
+ * @brief Native ALSA output backend with mmap transfers and a real-time thread.
+ *
+ * Bypasses PortAudio's buffer adaptation: the render thread waits in poll()
+ * on the PCM descriptors, then maps one period of the hardware ring buffer with
+ * snd_pcm_mmap_begin(), renders straight into it and hands it back with
+ * snd_pcm_mmap_commit(). Integer formats are converted with the configured
+ * dither on the way in. Underruns are recovered in place and counted in the
+ * engine statistics, and snd_pcm_delay() provides the callback-to-DAC latency.
+ *
+ * The whole file compiles to nothing unless `HAVE_ALSA` is defined (the
+ * makefile sets it when pkg-config finds alsa).
+ */
+
+ #ifdef HAVE_ALSA
+
+ #include <alsa/asoundlib.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <poll.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <errno.h>
+ #include <unistd.h>
+ #include <stdint.h>
+ #include <stdatomic.h>
+ #include <time.h>
+
+ #include "audio_alsa.h"
+ #include "audio_internal.h"
+
+ // --- Constants ---
+ #define ALSA_DEFAULT_PERIOD_FRAMES 256 ///< Period size used when framesPerBuffer is 0 ("auto").
+ #define ALSA_RT_PRIORITY_OFFSET 10     ///< Render thread runs at SCHED_FIFO max minus this value.
+
+ /**
+  * @struct AlsaBackend
+  * @brief State of the open ALSA stream. Only one instance exists.
+  */
+ typedef struct {
+     snd_pcm_t *pcm;                   ///< Open playback PCM, NULL when stopped.
+     SharedSynthData *data;            ///< Shared data rendered by the thread.
+     pthread_t thread;                 ///< The real-time render thread.
+     int thread_started;               ///< Non-zero once `thread` has been created.
+     atomic_int running;               ///< Set while the thread renders; cleared by alsa_backend_stop(), or by the thread when it gives up.
+     int stop_pipe[2];                 ///< Self-pipe that wakes the thread out of poll() on stop.
+     struct pollfd *pfds;              ///< PCM descriptors followed by the stop pipe's read end.
+     int pcm_nfds;                     ///< Number of PCM descriptors in `pfds`.
+     snd_pcm_format_t format;          ///< Negotiated sample format (FLOAT, S16 or S24_3LE).
+     SampleConverter conv;             ///< Float to `format` conversion with dither.
+     unsigned int channels;            ///< Negotiated channel count; the mono mix is copied to each.
+     unsigned int rate;                ///< Negotiated sample rate in Hz.
+     snd_pcm_uframes_t period_size;    ///< Frames per period (one render block).
+     snd_pcm_uframes_t buffer_size;    ///< Frames in the hardware ring buffer.
+     float *scratch;                   ///< Mono render buffer of `period_size` frames.
+     unsigned char *converted;         ///< `scratch` in the device format, for copying into multi-channel areas.
+ } AlsaBackend;
+
+ static AlsaBackend g_alsa = { .stop_pipe = { -1, -1 } };
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Builds the PCM name from the configuration.
+  */
+ static void alsa_pcm_name(const AudioConfig *config, char *name, size_t size) {
+     if (config->deviceIndex >= 0) snprintf(name, size, "hw:%d", config->deviceIndex);
+     else if (config->deviceName[0] != '\0') snprintf(name, size, "%s", config->deviceName);
+     else snprintf(name, size, "default");
+ }
+
+ /**
+  * @brief Negotiates mmap access, format, channels, rate and period geometry.
+  * @param wanted Configured sample format; S16 is the fallback for all of them.
+  * @return 0 on success, a negative ALSA error code on failure.
+  */
+ static int alsa_set_hw_params(AlsaBackend *be, SampleFormat wanted, unsigned int requested_rate,
+                               snd_pcm_uframes_t period, unsigned int periods) {
+     snd_pcm_hw_params_t *hw;
+     int err;
+     int dir = 0;
+
+     snd_pcm_hw_params_alloca(&hw);
+     if ((err = snd_pcm_hw_params_any(be->pcm, hw)) < 0) return err;
+     if ((err = snd_pcm_hw_params_set_rate_resample(be->pcm, hw, 0)) < 0) return err;
+     if ((err = snd_pcm_hw_params_set_access(be->pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+         fprintf(stderr, "ALSA Error: device does not support mmap interleaved access.\n");
+         return err;
+     }
+
+     // The configured format (float needs no conversion), falling back to 16-bit integers
+     switch (wanted) {
+         case SAMPLE_FORMAT_INT16: be->format = SND_PCM_FORMAT_S16; break;
+         case SAMPLE_FORMAT_INT24: be->format = SND_PCM_FORMAT_S24_3LE; break;
+         default:                  be->format = SND_PCM_FORMAT_FLOAT; break;
+     }
+     if (snd_pcm_hw_params_set_format(be->pcm, hw, be->format) < 0) {
+         be->format = SND_PCM_FORMAT_S16;
+         if ((err = snd_pcm_hw_params_set_format(be->pcm, hw, be->format)) < 0) return err;
+     }
+
+     // Mono if possible, otherwise the smallest channel count the device accepts
+     be->channels = 1;
+     if (snd_pcm_hw_params_set_channels(be->pcm, hw, be->channels) < 0) {
+         if ((err = snd_pcm_hw_params_set_channels_first(be->pcm, hw, &be->channels)) < 0) return err;
+     }
+
+     be->rate = requested_rate;
+     if ((err = snd_pcm_hw_params_set_rate_near(be->pcm, hw, &be->rate, &dir)) < 0) return err;
+
+     be->period_size = period;
+     dir = 0;
+     if ((err = snd_pcm_hw_params_set_period_size_near(be->pcm, hw, &be->period_size, &dir)) < 0) return err;
+     dir = 0;
+     if ((err = snd_pcm_hw_params_set_periods_near(be->pcm, hw, &periods, &dir)) < 0) return err;
+
+     if ((err = snd_pcm_hw_params(be->pcm, hw)) < 0) return err;
+
+     snd_pcm_hw_params_get_period_size(hw, &be->period_size, &dir);
+     snd_pcm_hw_params_get_buffer_size(hw, &be->buffer_size);
+     return 0;
+ }
+
+ /**
+  * @brief Wakes the thread once a full period is writable; start is done manually after prefill.
+  * @return 0 on success, a negative ALSA error code on failure.
+  */
+ static int alsa_set_sw_params(AlsaBackend *be) {
+     snd_pcm_sw_params_t *sw;
+     int err;
+
+     snd_pcm_sw_params_alloca(&sw);
+     if ((err = snd_pcm_sw_params_current(be->pcm, sw)) < 0) return err;
+     if ((err = snd_pcm_sw_params_set_avail_min(be->pcm, sw, be->period_size)) < 0) return err;
+     if ((err = snd_pcm_sw_params_set_start_threshold(be->pcm, sw, be->buffer_size)) < 0) return err;
+     return snd_pcm_sw_params(be->pcm, sw);
+ }
+
+ /**
+  * @brief Converts the mono render buffer and copies it into every channel area of the mmap region.
+  *
+  * A mono, contiguous area is converted in place in the hardware buffer;
+  * otherwise the block is converted once and copied to each channel.
+  */
+ static void alsa_write_areas(AlsaBackend *be, const snd_pcm_channel_area_t *areas,
+                              snd_pcm_uframes_t offset, snd_pcm_uframes_t frames) {
+     const size_t bytes = sample_format_bytes(be->conv.format);
+
+     if (be->channels == 1 && areas[0].step == bytes * 8) {
+         unsigned char *dst = (unsigned char *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+         audio_convert_output(&be->conv, be->scratch, dst, frames, be->rate);
+         return;
+     }
+     audio_convert_output(&be->conv, be->scratch, be->converted, frames, be->rate);
+     for (unsigned int ch = 0; ch < be->channels; ch++) {
+         unsigned char *dst = (unsigned char *)areas[ch].addr + (areas[ch].first + offset * areas[ch].step) / 8;
+         const unsigned char *src = be->converted;
+         size_t step = areas[ch].step / 8;
+         for (snd_pcm_uframes_t i = 0; i < frames; i++, dst += step, src += bytes) {
+             memcpy(dst, src, bytes);
+         }
+     }
+ }
+
+ /**
+  * @brief Maps the negotiated ALSA format to the converter's sample format.
+  */
+ static SampleFormat alsa_sample_format(snd_pcm_format_t format) {
+     switch (format) {
+         case SND_PCM_FORMAT_S16:     return SAMPLE_FORMAT_INT16;
+         case SND_PCM_FORMAT_S24_3LE: return SAMPLE_FORMAT_INT24;
+         default:                     return SAMPLE_FORMAT_FLOAT32;
+     }
+ }
+
+ /**
+  * @brief Renders one period directly into the hardware buffer.
+  * @return 0 on success, a negative ALSA error code (e.g. -EPIPE) on failure.
+  */
+ static int alsa_write_period(AlsaBackend *be) {
+     snd_pcm_uframes_t remaining = be->period_size;
+     snd_pcm_sframes_t delay = 0;
+     double dac_latency = -1.0;
+     double render_start;
+
+     // Frames still queued ahead of this block = time until its first sample plays
+     if (snd_pcm_state(be->pcm) == SND_PCM_STATE_RUNNING && snd_pcm_delay(be->pcm, &delay) == 0 && delay >= 0) {
+         dac_latency = (double)delay / be->rate;
+     }
+
+     render_start = audio_time_now();
+     while (remaining > 0) {
+         const snd_pcm_channel_area_t *areas;
+         snd_pcm_uframes_t offset;
+         snd_pcm_uframes_t frames = remaining;
+         snd_pcm_sframes_t committed;
+         int err = snd_pcm_mmap_begin(be->pcm, &areas, &offset, &frames);
+         if (err < 0) return err;
+
+         if (audio_render_device_block(be->data, NULL, be->scratch, frames, 0) != 0) return -EIO;
+         alsa_write_areas(be, areas, offset, frames);
+
+         committed = snd_pcm_mmap_commit(be->pcm, offset, frames);
+         if (committed < 0) return (int)committed;
+         if ((snd_pcm_uframes_t)committed != frames) return -EPIPE;
+         remaining -= frames;
+     }
+
+     audio_stats_record_block(be->period_size, dac_latency);
+     audio_stats_record_load(audio_time_now() - render_start, (double)be->period_size / be->rate);
+     return 0;
+ }
+
+ /**
+  * @brief Recovers from an underrun or suspend, counting underruns.
+  * @return 0 if the stream is usable again, a negative ALSA error code otherwise.
+  */
+ static int alsa_recover(AlsaBackend *be, int err) {
+     if (err == -EPIPE) {
+         audio_stats_record_xrun();
+     }
+     err = snd_pcm_recover(be->pcm, err, 1);
+     if (err < 0) {
+         fprintf(stderr, "ALSA Error: cannot recover stream: %s\n", snd_strerror(err));
+     }
+     return err;
+ }
+
+ /**
+  * @brief Render thread: fills every writable period, then sleeps in poll().
+  */
+ static void *alsa_thread_main(void *arg) {
+     AlsaBackend *be = (AlsaBackend *)arg;
+     int err;
+
+     while (atomic_load(&be->running)) {
+         snd_pcm_sframes_t avail = snd_pcm_avail_update(be->pcm);
+         if (avail < 0) {
+             if (alsa_recover(be, (int)avail) < 0) break;
+             continue;
+         }
+
+         if ((snd_pcm_uframes_t)avail >= be->period_size) {
+             err = alsa_write_period(be);
+             if (err == -EIO) break; // render_audio() lock failure, same as paAbort
+             if (err < 0 && alsa_recover(be, err) < 0) break;
+             continue;
+         }
+
+         // Buffer is full: start after the initial prefill (or after a recovery)
+         if (snd_pcm_state(be->pcm) == SND_PCM_STATE_PREPARED) {
+             if ((err = snd_pcm_start(be->pcm)) < 0) {
+                 fprintf(stderr, "ALSA Error: snd_pcm_start: %s\n", snd_strerror(err));
+                 break;
+             }
+         }
+
+         // Sleep until a period is free or stop is requested
+         if (poll(be->pfds, (nfds_t)be->pcm_nfds + 1, -1) < 0) {
+             if (errno == EINTR) continue;
+             fprintf(stderr, "ALSA Error: poll: %s\n", strerror(errno));
+             break;
+         }
+         if (be->pfds[be->pcm_nfds].revents & POLLIN) break; // Stop requested
+
+         unsigned short revents = 0;
+         snd_pcm_poll_descriptors_revents(be->pcm, be->pfds, (unsigned int)be->pcm_nfds, &revents);
+         if (revents & POLLERR) {
+             err = (snd_pcm_state(be->pcm) == SND_PCM_STATE_SUSPENDED) ? -ESTRPIPE : -EPIPE;
+             if (alsa_recover(be, err) < 0) break;
+         }
+     }
+
+     atomic_store(&be->running, 0);
+     return NULL;
+ }
+
+ /**
+  * @brief Starts the render thread with SCHED_FIFO, falling back to normal scheduling.
+  * @return 0 on success, an errno value on failure.
+  */
+ static int alsa_start_thread(AlsaBackend *be) {
+     pthread_attr_t attr;
+     struct sched_param param;
+     int ret;
+
+     pthread_attr_init(&attr);
+     pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+     pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+     param.sched_priority = sched_get_priority_max(SCHED_FIFO) - ALSA_RT_PRIORITY_OFFSET;
+     pthread_attr_setschedparam(&attr, &param);
+     ret = pthread_create(&be->thread, &attr, alsa_thread_main, be);
+     pthread_attr_destroy(&attr);
+
+     if (ret == EPERM) {
+         fprintf(stderr, "Warning: No permission for real-time scheduling, ALSA thread runs at normal priority.\n");
+         ret = pthread_create(&be->thread, NULL, alsa_thread_main, be);
+     }
+     if (ret == 0) be->thread_started = 1;
+     return ret;
+ }
+
+ /**
+  * @brief Releases everything owned by the backend state.
+  */
+ static void alsa_release(AlsaBackend *be) {
+     if (be->pcm) { snd_pcm_drop(be->pcm); snd_pcm_close(be->pcm); be->pcm = NULL; }
+     if (be->stop_pipe[0] >= 0) { close(be->stop_pipe[0]); be->stop_pipe[0] = -1; }
+     if (be->stop_pipe[1] >= 0) { close(be->stop_pipe[1]); be->stop_pipe[1] = -1; }
+     free(be->pfds); be->pfds = NULL;
+     free(be->scratch); be->scratch = NULL;
+     free(be->converted); be->converted = NULL;
+     be->thread_started = 0;
+ }
+
+
+ // --- Public Functions ---
+
+ PaError alsa_backend_start(SharedSynthData *data, const AudioConfig *config) {
+     AlsaBackend *be = &g_alsa;
+     char pcm_name[CONFIG_DEVICE_NAME_MAX + 8];
+     unsigned int requested_rate;
+     snd_pcm_uframes_t period;
+     int err;
+
+     if (be->pcm != NULL) {
+         printf("ALSA stream already started.\n");
+         return paNoError;
+     }
+
+     if (config->inputMode != SIDECHAIN_OFF) {
+         fprintf(stderr, "Warning: The ALSA backend is output only, ignoring --input %s.\n", sidechain_mode_name(config->inputMode));
+     }
+
+     alsa_pcm_name(config, pcm_name, sizeof(pcm_name));
+     err = snd_pcm_open(&be->pcm, pcm_name, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+     if (err < 0) {
+         fprintf(stderr, "ALSA Error: cannot open PCM '%s': %s\n", pcm_name, snd_strerror(err));
+         be->pcm = NULL;
+         return paInvalidDevice;
+     }
+
+     requested_rate = (unsigned int)(audio_device_rate_requested(data) + 0.5);
+     if (requested_rate == 0) { alsa_release(be); return paInternalError; }
+
+     period = config->framesPerBuffer ? config->framesPerBuffer : ALSA_DEFAULT_PERIOD_FRAMES;
+     if ((err = alsa_set_hw_params(be, config->sampleFormat, requested_rate, period, config->periods)) < 0 ||
+         (err = alsa_set_sw_params(be)) < 0) {
+         fprintf(stderr, "ALSA Error: cannot configure PCM '%s': %s\n", pcm_name, snd_strerror(err));
+         alsa_release(be);
+         return paUnanticipatedHostError;
+     }
+
+     if (be->rate != requested_rate) {
+         fprintf(stderr, "Warning: ALSA device runs at %u Hz instead of %u Hz.\n", be->rate, requested_rate);
+     }
+     if (!audio_device_rate_adopt(data, be->rate)) {
+         alsa_release(be);
+         return paInvalidSampleRate;
+     }
+
+     if (alsa_sample_format(be->format) != config->sampleFormat) {
+         fprintf(stderr, "Warning: ALSA device does not accept %s samples, using %s.\n",
+                 sample_format_name(config->sampleFormat), snd_pcm_format_name(be->format));
+     }
+     sample_converter_init(&be->conv, alsa_sample_format(be->format), config->dither, (uint32_t)time(NULL));
+
+     be->data = data;
+     be->scratch = malloc(be->period_size * sizeof(float));
+     be->converted = malloc(be->period_size * sizeof(float)); // Large enough for every format
+     be->pcm_nfds = snd_pcm_poll_descriptors_count(be->pcm);
+     be->pfds = (be->pcm_nfds > 0) ? calloc((size_t)be->pcm_nfds + 1, sizeof(struct pollfd)) : NULL;
+     if (!be->scratch || !be->converted || !be->pfds || pipe(be->stop_pipe) != 0) {
+         fprintf(stderr, "ALSA Error: cannot allocate stream resources.\n");
+         alsa_release(be);
+         return paInsufficientMemory;
+     }
+     snd_pcm_poll_descriptors(be->pcm, be->pfds, (unsigned int)be->pcm_nfds);
+     be->pfds[be->pcm_nfds].fd = be->stop_pipe[0];
+     be->pfds[be->pcm_nfds].events = POLLIN;
+
+     printf("Opening ALSA stream '%s': SR=%u, %s, %u ch, period=%lu frames, buffer=%lu frames (%.2f ms)\n",
+            pcm_name, be->rate, snd_pcm_format_name(be->format), be->channels,
+            (unsigned long)be->period_size, (unsigned long)be->buffer_size,
+            1000.0 * (double)be->buffer_size / be->rate);
+
+     audio_stats_reset("alsa");
+     audio_stats_set_format(sample_format_name(be->conv.format),
+                            (be->conv.format == SAMPLE_FORMAT_FLOAT32) ? "none" : dither_mode_name(be->conv.dither));
+     atomic_store(&be->running, 1);
+     err = alsa_start_thread(be);
+     if (err != 0) {
+         fprintf(stderr, "ALSA Error: cannot create audio thread: %s\n", strerror(err));
+         atomic_store(&be->running, 0);
+         alsa_release(be);
+         return paUnanticipatedHostError;
+     }
+
+     printf("ALSA stream started successfully.\n");
+     return paNoError;
+ }
+
+ PaError alsa_backend_stop(void) {
+     AlsaBackend *be = &g_alsa;
+
+     if (be->pcm == NULL) return paNoError;
+
+     atomic_store(&be->running, 0);
+     if (be->thread_started) {
+         char c = 0;
+         if (write(be->stop_pipe[1], &c, 1) < 0) {
+             fprintf(stderr, "Warning: cannot wake ALSA thread: %s\n", strerror(errno));
+         }
+         pthread_join(be->thread, NULL);
+     }
+     alsa_release(be);
+     printf("ALSA stream stopped and closed.\n");
+     return paNoError;
+ }
+
+ int alsa_backend_is_running(void) {
+     // The thread leaves on errors it cannot recover from, with the PCM still open
+     return g_alsa.pcm != NULL && atomic_load(&g_alsa.running);
+ }
+
+ int alsa_backend_is_open(void) {
+     return g_alsa.pcm != NULL;
+ }
+
+ #endif // HAVE_ALSA
@@ -0,0 +1,54 @@
+/**
+ * @file audio_alsa.h
+ * @brief Native ALSA output backend using memory-mapped transfers.
+ *
+ * Opens a PCM with explicit period/buffer geometry and renders directly into
+ * the mmap'ed ring buffer from a dedicated real-time thread that sleeps in
+ * poll() between periods. Only available when built with `HAVE_ALSA`.
+ */
+
+ #ifndef AUDIO_ALSA_H
+ #define AUDIO_ALSA_H
+
+ #include <portaudio.h>
+ #include "synth_data.h"
+ #include "config.h"
+
+ #ifdef HAVE_ALSA
+
+ /**
+  * @brief Opens the configured ALSA PCM and starts the real-time render thread.
+  *
+  * The PCM name is `config->deviceName`, or `hw:N` for a device index, or
+  * "default". The period size comes from `framesPerBuffer` (256 if unset) and
+  * the buffer holds `periods` periods. If the device cannot run at the shared
+  * sample rate the nearest supported rate is stored back into `data->sampleRate`.
+  *
+  * @param[in,out] data Shared synthesizer data rendered by the audio thread.
+  * @param[in] config Stream configuration.
+  * @return `paNoError` on success, `paInvalidDevice` if the PCM cannot be opened,
+  * `paUnanticipatedHostError` if it cannot be configured or started.
+  */
+ PaError alsa_backend_start(SharedSynthData *data, const AudioConfig *config);
+
+ /**
+  * @brief Stops the render thread and closes the PCM. Safe to call when not running.
+  * @return `paNoError`.
+  */
+ PaError alsa_backend_stop(void);
+
+ /**
+  * @brief Reports whether an ALSA stream is open and its render thread still runs.
+  * @return 1 if running, 0 if stopped or if the thread ended on an error it could not recover from.
+  */
+ int alsa_backend_is_running(void);
+
+ /**
+  * @brief Reports whether the PCM is open, whether or not its thread still runs.
+  * @return 1 if alsa_backend_stop() has something to close, 0 otherwise.
+  */
+ int alsa_backend_is_open(void);
+
+ #endif // HAVE_ALSA
+
+ #endif // AUDIO_ALSA_H
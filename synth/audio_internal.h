@@ -0,0 +1,186 @@
+/**
+ * @file audio_internal.h
+ * @brief Engine functions shared between audio.c and the native audio backends.
+ *
+ * Not part of the public audio interface: the GUI and main module only use
+ * audio.h. Backends render through render_audio() and report their timing
+ * through the statistics recorders so every driver API is measured the same way.
+ */
+
+ #ifndef AUDIO_INTERNAL_H
+ #define AUDIO_INTERNAL_H
+
+ #include "synth_data.h"
+ #include "sampleformat.h"
+ #include "midi.h"
+
+ /**
+  * @brief Renders one block of mixed mono float samples for both waves.
+  * @param[in,out] shared_data The shared synthesizer data structure.
+  * @param[out] out Buffer receiving `framesPerBuffer` samples.
+  * @param framesPerBuffer Number of frames to render.
+  * @return 0 on success, -1 on a critical mutex failure (the block is silent).
+  * @see render_audio() implementation in audio.c
+  */
+ int render_audio(SharedSynthData *shared_data, float *out, unsigned long framesPerBuffer);
+
+ /**
+  * @brief Renders one block without blocking on the shared mutex.
+  *
+  * Parameters are refreshed with a try-lock; while the mutex is busy the block
+  * is rendered from the audio thread's cached copy and the voice state is
+  * written back on a later block. For driver callbacks that must never block.
+  *
+  * @param[in,out] shared_data The shared synthesizer data structure.
+  * @param[out] out Buffer receiving `framesPerBuffer` samples.
+  * @param framesPerBuffer Number of frames to render.
+  * @return 0. Silence is produced until the parameters could be read once.
+  * @see render_audio_nonblocking() implementation in audio.c
+  */
+ int render_audio_nonblocking(SharedSynthData *shared_data, float *out, unsigned long framesPerBuffer);
+
+ /**
+  * @brief Forgets the cached state of render_audio_nonblocking(). Call before starting a stream.
+  */
+ void render_audio_nonblocking_reset(void);
+
+ /**
+  * @brief Produces one block at the device rate. What every backend calls per period.
+  *
+  * Takes the engine output from the lookahead ring while the render thread
+  * runs, otherwise renders it (with render_audio_nonblocking() if requested),
+  * resamples it to the device rate when an internal engine rate is set, and
+  * modulates it in place with the device input of a duplex stream.
+  *
+  * @param[in,out] data The shared synthesizer data structure.
+  * @param[in] in `frames` mono input samples straight from the device, or NULL without input.
+  * @param[out] out Buffer receiving `frames` samples at the device rate.
+  * @param frames Number of device frames.
+  * @param nonblocking Non-zero if the caller must never block on the shared mutex.
+  * @return 0 on success, -1 on a critical mutex failure (the block is silent).
+  */
+ int audio_render_device_block(SharedSynthData *data, const float *in, float *out, unsigned long frames, int nonblocking);
+
+ /**
+  * @brief Returns the rate a backend should open the device at.
+  *
+  * The configured device rate when the engine renders at a fixed internal
+  * rate, otherwise the engine rate itself.
+  */
+ double audio_device_rate_requested(SharedSynthData *data);
+
+ /**
+  * @brief Adopts the rate the device actually runs at. Call before the stream starts.
+  *
+  * Without an internal rate the engine follows the device (its sample rate is
+  * overwritten); with one, the resampler from the engine rate to `device_rate`
+  * is built instead. The input modulator is prepared for `device_rate` as well.
+  *
+  * @return 1 on success, 0 if the resampler cannot convert between the two rates.
+  */
+ int audio_device_rate_adopt(SharedSynthData *data, double device_rate);
+
+ /**
+  * @brief Frees the resampler after the stream stopped.
+  */
+ void audio_src_release(void);
+
+ /**
+  * @brief Clears all statistics and names the backend that is about to start.
+  * @param[in] backend_name Static string reported in AudioStats::backend.
+  */
+ void audio_stats_reset(const char *backend_name);
+
+ /**
+  * @brief Records one rendered block. Called from the audio thread only.
+  * @param frames Number of frames in the block.
+  * @param dac_latency_sec Time until the block's first sample reaches the DAC, or a negative value if unknown.
+  */
+ void audio_stats_record_block(unsigned long frames, double dac_latency_sec);
+
+ /**
+  * @brief Records one buffer underrun/overrun. Safe to call from driver notification threads.
+  */
+ void audio_stats_record_xrun(void);
+
+ /**
+  * @brief Records the round-trip latency of a duplex stream (input ADC to output DAC).
+  * @param round_trip_sec Measured round trip in seconds, or a negative value if unknown.
+  */
+ void audio_stats_record_duplex(double round_trip_sec);
+
+ /**
+  * @brief Names the sample format and dither the backend writes, for the statistics.
+  * @param format Static string such as "int16"; audio_stats_reset() sets "float32".
+  * @param dither Static string such as "tpdf"; "none" for float output.
+  */
+ void audio_stats_set_format(const char *format, const char *dither);
+
+ /**
+  * @brief Converts one block to the device format and records the conversion cost.
+  *
+  * Called from the audio thread only. The cost is kept as a moving average of
+  * the fraction of the block time spent converting (AudioStats::convertLoad).
+  *
+  * @param[in,out] conv The backend's converter.
+  * @param[in] in `frames` mono float samples.
+  * @param[out] out Device buffer receiving `frames * sample_format_bytes()` bytes.
+  * @param frames Number of frames.
+  * @param rate Device sample rate, used to express the cost as a load.
+  */
+ void audio_convert_output(SampleConverter *conv, const float *in, void *out, unsigned long frames, double rate);
+
+ /**
+  * @brief Records how long the device side spent producing one block. Called from the audio thread only.
+  * @param busy_sec Time spent rendering (or copying) the block.
+  * @param period_sec Duration of the block at the stream's sample rate.
+  */
+ void audio_stats_record_load(double busy_sec, double period_sec);
+
+ /**
+  * @brief Monotonic time in seconds, for measuring render time.
+  */
+ double audio_time_now(void);
+
+ /**
+  * @brief Sets the lookahead size reported in the statistics and clears its fill levels.
+  * @param frames Target fill of the render-ahead ring, 0 when the render thread is off.
+  */
+ void audio_stats_set_lookahead(unsigned long frames);
+
+ /**
+  * @brief Records the ring fill level seen by the device side before a read.
+  * @param fill Frames available in the ring.
+  * @param underrun Non-zero if the read could not be fully served.
+  */
+ void audio_stats_record_lookahead(unsigned long fill, int underrun);
+
+ /**
+  * @brief Queues an event at an explicit engine frame, bypassing the clock stamp of audio_midi_input().
+  * @param[in] ev The event; `ev->frame` counts frames rendered since audio_midi_reset().
+  * @return 1 if queued, 0 if the queue was full.
+  */
+ int audio_midi_schedule(const MidiEvent *ev);
+
+ /**
+  * @brief Returns the next MIDI clock message to send while `midiClock` is "out", without removing it.
+  * Called by the MIDI thread only.
+  * @param[out] ev The message: MIDI_EVENT_START once, then MIDI_EVENT_CLOCK ticks.
+  * @param[out] time_sec audio_time_now() time it is due (see midi_clock_time()).
+  * @return 1 if a message is waiting, 0 otherwise.
+  */
+ int audio_midi_clock_peek(MidiEvent *ev, double *time_sec);
+
+ /**
+  * @brief Removes the message returned by audio_midi_clock_peek() once it was sent, and records how late.
+  * @param late_sec Seconds it went out after its time.
+  */
+ void audio_midi_clock_sent(double late_sec);
+
+ /**
+  * @brief Empties the MIDI queue and forgets the held note, volume, arpeggiator and engine position.
+  * @note Neither the renderer nor the input thread may run.
+  */
+ void audio_midi_reset(void);
+
+ #endif // AUDIO_INTERNAL_H
@@ -0,0 +1,256 @@
+/**
+ * @file audio_jack.c
+ * @brief JACK client backend rendering in the JACK process callback.
+ *
+ * The process callback runs in JACK's real-time thread and must never block,
+ * so it renders through render_audio_nonblocking(): parameters are refreshed
+ * with a try-lock and a busy GUI only delays them by one period. Xrun
+ * notifications from the server are counted in the engine statistics and the
+ * playback latency of the output ports is reported as callback-to-DAC latency.
+ * With an input mode configured, an input port is registered as well and its
+ * buffer modulates the output directly; its capture latency plus the playback
+ * latency is reported as the duplex round trip.
+ *
+ * The whole file compiles to nothing unless `HAVE_JACK` is defined (the
+ * makefile sets it when pkg-config finds jack).
+ */
+
+ #ifdef HAVE_JACK
+
+ #include <jack/jack.h>
+ #include <pthread.h>
+ #include <stdio.h>
+ #include <string.h>
+ #include <stdatomic.h>
+
+ #include "audio_jack.h"
+ #include "audio_internal.h"
+
+ // --- Constants ---
+ #define JACK_CLIENT_NAME "synthesizer" ///< Name of the client in the JACK graph.
+ #define JACK_NUM_PORTS 2               ///< Output ports, both carry the mono mix.
+
+ /**
+  * @struct JackBackend
+  * @brief State of the open JACK client. Only one instance exists.
+  */
+ typedef struct {
+     jack_client_t *client;                  ///< Open client, NULL when stopped.
+     jack_port_t *ports[JACK_NUM_PORTS];     ///< Registered output ports.
+     jack_port_t *input;                     ///< Input port modulating the output, NULL without input.
+     SharedSynthData *data;                  ///< Shared data rendered by the process callback.
+     atomic_long latency_frames;             ///< Playback latency of the output ports, -1 if unknown.
+     atomic_long capture_frames;             ///< Capture latency of the input port, -1 if unknown.
+     atomic_int shutdown;                    ///< Set when the server shut the client down.
+     jack_nframes_t rate;                    ///< Server sample rate.
+ } JackBackend;
+
+ static JackBackend g_jack;
+
+
+ // --- JACK Callbacks ---
+
+ /**
+  * @brief JACK process callback: renders one period into the first port and copies it to the others.
+  */
+ static int jack_process(jack_nframes_t nframes, void *arg) {
+     JackBackend *be = (JackBackend *)arg;
+     jack_default_audio_sample_t *out = jack_port_get_buffer(be->ports[0], nframes);
+     const jack_default_audio_sample_t *in = (be->input != NULL) ? jack_port_get_buffer(be->input, nframes) : NULL;
+     long latency = atomic_load_explicit(&be->latency_frames, memory_order_relaxed);
+     double render_start = audio_time_now();
+
+     audio_render_device_block(be->data, in, out, nframes, 1);
+     for (int p = 1; p < JACK_NUM_PORTS; p++) {
+         memcpy(jack_port_get_buffer(be->ports[p], nframes), out, nframes * sizeof(jack_default_audio_sample_t));
+     }
+
+     audio_stats_record_block(nframes, (latency >= 0) ? (double)latency / be->rate : -1.0);
+     if (in != NULL) {
+         long capture = atomic_load_explicit(&be->capture_frames, memory_order_relaxed);
+         if (capture >= 0 && latency >= 0) audio_stats_record_duplex((double)(capture + latency) / be->rate);
+     }
+     audio_stats_record_load(audio_time_now() - render_start, (double)nframes / be->rate);
+     return 0;
+ }
+
+ /**
+  * @brief Xrun notification from the server (non-real-time thread).
+  */
+ static int jack_xrun(void *arg) {
+     (void)arg;
+     audio_stats_record_xrun();
+     return 0;
+ }
+
+ /**
+  * @brief Latency recomputation: caches the worst playback latency of our ports
+  * and the worst capture latency of the input port.
+  */
+ static void jack_latency(jack_latency_callback_mode_t mode, void *arg) {
+     JackBackend *be = (JackBackend *)arg;
+     jack_latency_range_t range;
+     if (mode == JackPlaybackLatency) {
+         jack_port_get_latency_range(be->ports[0], JackPlaybackLatency, &range);
+         atomic_store(&be->latency_frames, (long)range.max);
+     } else if (mode == JackCaptureLatency && be->input != NULL) {
+         jack_port_get_latency_range(be->input, JackCaptureLatency, &range);
+         atomic_store(&be->capture_frames, (long)range.max);
+     }
+ }
+
+ /**
+  * @brief Called when the server shuts down or kicks the client out.
+  */
+ static void jack_shutdown(void *arg) {
+     JackBackend *be = (JackBackend *)arg;
+     atomic_store(&be->shutdown, 1);
+     fprintf(stderr, "Warning: JACK server shut down, audio output stopped.\n");
+ }
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Connects our output ports to the physical playback ports, if there are any.
+  */
+ static void jack_connect_playback(JackBackend *be) {
+     const char **playback = jack_get_ports(be->client, NULL, JACK_DEFAULT_AUDIO_TYPE,
+                                            JackPortIsPhysical | JackPortIsInput);
+     if (playback == NULL) {
+         printf("No physical JACK playback ports, leaving outputs unconnected.\n");
+         return;
+     }
+     for (int p = 0; p < JACK_NUM_PORTS && playback[p] != NULL; p++) {
+         if (jack_connect(be->client, jack_port_name(be->ports[p]), playback[p]) != 0) {
+             fprintf(stderr, "Warning: Cannot connect %s to %s\n", jack_port_name(be->ports[p]), playback[p]);
+         }
+     }
+     jack_free(playback);
+ }
+
+ /**
+  * @brief Connects the first physical capture port to our input port, if there is one.
+  */
+ static void jack_connect_capture(JackBackend *be) {
+     const char **capture = jack_get_ports(be->client, NULL, JACK_DEFAULT_AUDIO_TYPE,
+                                           JackPortIsPhysical | JackPortIsOutput);
+     if (capture == NULL) {
+         printf("No physical JACK capture ports, leaving the input unconnected.\n");
+         return;
+     }
+     if (jack_connect(be->client, capture[0], jack_port_name(be->input)) != 0) {
+         fprintf(stderr, "Warning: Cannot connect %s to %s\n", capture[0], jack_port_name(be->input));
+     }
+     jack_free(capture);
+ }
+
+
+ // --- Public Functions ---
+
+ PaError jack_backend_start(SharedSynthData *data, const AudioConfig *config) {
+     JackBackend *be = &g_jack;
+     jack_status_t status;
+     jack_options_t options = JackNoStartServer;
+     char port_name[16];
+
+     if (be->client != NULL) {
+         printf("JACK client already started.\n");
+         return paNoError;
+     }
+
+     if (config->sampleFormat != SAMPLE_FORMAT_FLOAT32) {
+         fprintf(stderr, "Warning: JACK ports are float, ignoring --format %s.\n", sample_format_name(config->sampleFormat));
+     }
+
+     if (config->deviceName[0] != '\0') {
+         options |= JackServerName;
+         be->client = jack_client_open(JACK_CLIENT_NAME, options, &status, config->deviceName);
+     } else {
+         be->client = jack_client_open(JACK_CLIENT_NAME, options, &status);
+     }
+     if (be->client == NULL) {
+         fprintf(stderr, "JACK Error: cannot connect to server (status 0x%x). Is jackd running?\n", (unsigned)status);
+         return paDeviceUnavailable;
+     }
+
+     be->data = data;
+     be->rate = jack_get_sample_rate(be->client);
+     be->input = NULL;
+     atomic_store(&be->latency_frames, -1);
+     atomic_store(&be->capture_frames, -1);
+     atomic_store(&be->shutdown, 0);
+
+     // The server dictates the sample rate: the engine follows it or is resampled to it
+     printf("JACK server sample rate %u Hz.\n", (unsigned)be->rate);
+     if (!audio_device_rate_adopt(data, be->rate)) {
+         jack_client_close(be->client); be->client = NULL;
+         return paInvalidSampleRate;
+     }
+
+     for (int p = 0; p < JACK_NUM_PORTS; p++) {
+         snprintf(port_name, sizeof(port_name), "out_%d", p + 1);
+         be->ports[p] = jack_port_register(be->client, port_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+         if (be->ports[p] == NULL) {
+             fprintf(stderr, "JACK Error: cannot register port %s\n", port_name);
+             jack_client_close(be->client); be->client = NULL;
+             return paUnanticipatedHostError;
+         }
+     }
+     if (config->inputMode != SIDECHAIN_OFF) {
+         be->input = jack_port_register(be->client, "in_1", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+         if (be->input == NULL) {
+             fprintf(stderr, "JACK Error: cannot register port in_1\n");
+             jack_client_close(be->client); be->client = NULL;
+             return paUnanticipatedHostError;
+         }
+         printf("JACK input in_1 modulates the output (%s).\n", sidechain_mode_name(config->inputMode));
+     }
+
+     jack_set_process_callback(be->client, jack_process, be);
+     jack_set_xrun_callback(be->client, jack_xrun, be);
+     jack_set_latency_callback(be->client, jack_latency, be);
+     jack_on_shutdown(be->client, jack_shutdown, be);
+
+     if (config->framesPerBuffer > 0 && jack_get_buffer_size(be->client) != config->framesPerBuffer) {
+         if (jack_set_buffer_size(be->client, (jack_nframes_t)config->framesPerBuffer) != 0) {
+             fprintf(stderr, "Warning: JACK server refused buffer size %lu.\n", config->framesPerBuffer);
+         }
+     }
+
+     render_audio_nonblocking_reset();
+     audio_stats_reset("jack");
+     if (jack_activate(be->client) != 0) {
+         fprintf(stderr, "JACK Error: cannot activate client.\n");
+         jack_client_close(be->client); be->client = NULL;
+         return paUnanticipatedHostError;
+     }
+     jack_connect_playback(be);
+     if (be->input != NULL) jack_connect_capture(be);
+
+     printf("JACK client '%s' started: SR=%u, buffer=%u frames\n",
+            jack_get_client_name(be->client), (unsigned)be->rate, (unsigned)jack_get_buffer_size(be->client));
+     return paNoError;
+ }
+
+ PaError jack_backend_stop(void) {
+     JackBackend *be = &g_jack;
+
+     if (be->client == NULL) return paNoError;
+
+     // After a server shutdown the client handle may only be closed
+     if (!atomic_load(&be->shutdown)) {
+         jack_deactivate(be->client);
+     }
+     jack_client_close(be->client);
+     be->client = NULL;
+     be->input = NULL;
+     printf("JACK client closed.\n");
+     return paNoError;
+ }
+
+ int jack_backend_is_running(void) {
+     return g_jack.client != NULL;
+ }
+
+ #endif // HAVE_JACK
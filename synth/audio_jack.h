@@ -0,0 +1,48 @@
+/**
+ * @file audio_jack.h
+ * @brief JACK client backend: renders inside the JACK process callback.
+ *
+ * Registers the synthesizer as a JACK client with two output ports carrying
+ * the mono mix, so it can be routed to other JACK clients as well as to the
+ * sound card. Only available when built with `HAVE_JACK`.
+ */
+
+ #ifndef AUDIO_JACK_H
+ #define AUDIO_JACK_H
+
+ #include <portaudio.h>
+ #include "synth_data.h"
+ #include "config.h"
+
+ #ifdef HAVE_JACK
+
+ /**
+  * @brief Connects to the JACK server, registers the output ports and activates the client.
+  *
+  * `config->deviceName` selects a named JACK server ("" = default server). The
+  * server's sample rate is stored into `data->sampleRate`. If
+  * `config->framesPerBuffer` is set the server's buffer size is changed to it.
+  * The output ports are connected to the physical playback ports.
+  *
+  * @param[in,out] data Shared synthesizer data rendered by the process callback.
+  * @param[in] config Stream configuration.
+  * @return `paNoError` on success, `paDeviceUnavailable` if no server is running,
+  * `paUnanticipatedHostError` if registration or activation fails.
+  */
+ PaError jack_backend_start(SharedSynthData *data, const AudioConfig *config);
+
+ /**
+  * @brief Deactivates and closes the JACK client. Safe to call when not running.
+  * @return `paNoError`.
+  */
+ PaError jack_backend_stop(void);
+
+ /**
+  * @brief Reports whether a JACK client is currently open.
+  * @return 1 if open, 0 otherwise.
+  */
+ int jack_backend_is_running(void);
+
+ #endif // HAVE_JACK
+
+ #endif // AUDIO_JACK_H
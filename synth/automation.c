@@ -0,0 +1,427 @@
+/**
+ * @file automation.c
+ * @brief Implements automation lanes: the delta encoding, the seek index, playback cursors and take files.
+ */
+
+ #include <errno.h>
+ #include <math.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+
+ #include "automation.h"
+
+ #define AUTO_VARINT_MAX 10               ///< Bytes of the longest varint (64 bits).
+ #define AUTO_VALUE_LIMIT (INT64_C(1) << 62) ///< Quantised values stay below this, so deltas cannot overflow.
+
+
+ // --- Helper Functions ---
+
+ /** @brief Quantises a value, returns 0 if it is not finite or out of range. */
+ static int quantise(double value, int64_t *q) {
+     double scaled = value / AUTO_VALUE_QUANTUM;
+
+     if (!isfinite(scaled) || fabs(scaled) >= (double)AUTO_VALUE_LIMIT) return 0;
+     *q = (int64_t)llround(scaled);
+     return 1;
+ }
+
+ /** @brief Writes `v` as an unsigned LEB128 varint, returns its length. */
+ static size_t put_varint(uint8_t *out, uint64_t v) {
+     size_t n = 0;
+
+     while (v >= 0x80) {
+         out[n++] = (uint8_t)(v | 0x80);
+         v >>= 7;
+     }
+     out[n++] = (uint8_t)v;
+     return n;
+ }
+
+ /** @brief Reads an unsigned LEB128 varint at `*pos`, returns 0 if it runs past `size` or overflows. */
+ static int get_varint(const uint8_t *data, size_t size, size_t *pos, uint64_t *v) {
+     uint64_t result = 0;
+
+     for (int shift = 0; shift < 64 && *pos < size; shift += 7) {
+         uint8_t byte = data[(*pos)++];
+         result |= (uint64_t)(byte & 0x7f) << shift;
+         if (!(byte & 0x80)) {
+             *v = result;
+             return 1;
+         }
+     }
+     return 0;
+ }
+
+ /** @brief Zigzag encoding: small magnitudes of either sign become small unsigned numbers. */
+ static uint64_t zigzag(int64_t d) {
+     return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+ }
+
+ static int64_t unzigzag(uint64_t u) {
+     return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+ }
+
+ /**
+  * @brief Decodes the point at `*offset` of encoded data, applying its deltas to `*frame` and `*value`.
+  * @return 1 on success, 0 if the data is truncated or the point leaves the valid range.
+  */
+ static int decode_point(const uint8_t *data, size_t size, size_t *offset, uint64_t *frame, int64_t *value) {
+     uint64_t df, dv;
+     int64_t v;
+
+     if (!get_varint(data, size, offset, &df) || !get_varint(data, size, offset, &dv)) return 0;
+     if (*frame + df < *frame) return 0;
+     v = *value + unzigzag(dv);
+     if (v >= AUTO_VALUE_LIMIT || v <= -AUTO_VALUE_LIMIT) return 0;
+     *frame += df;
+     *value = v;
+     return 1;
+ }
+
+ /** @brief Grows a buffer to hold at least `needed` elements of `elem` bytes. */
+ static int reserve(void **buffer, size_t *capacity, size_t needed, size_t elem, size_t initial) {
+     size_t cap = *capacity;
+     void *grown;
+
+     if (needed <= cap) return 1;
+     if (cap == 0) cap = initial;
+     while (cap < needed) cap *= 2;
+     grown = realloc(*buffer, cap * elem);
+     if (grown == NULL) return 0;
+     *buffer = grown;
+     *capacity = cap;
+     return 1;
+ }
+
+ /** @brief Appends a point with a quantised value. */
+ static int lane_append(AutoLane *lane, uint64_t frame, int64_t value) {
+     uint8_t bytes[2 * AUTO_VARINT_MAX];
+     size_t n;
+
+     if (lane->points > 0 && frame < lane->last_frame) return 0;
+     n = put_varint(bytes, frame - lane->last_frame);
+     n += put_varint(bytes + n, zigzag(value - lane->last_value));
+     if (!reserve((void **)&lane->data, &lane->capacity, lane->size + n, 1, 256)) return 0;
+     if (lane->points % AUTO_INDEX_INTERVAL == 0) {
+         if (!reserve((void **)&lane->index, &lane->index_capacity, lane->index_count + 1, sizeof(AutoIndexEntry), 16)) return 0;
+         lane->index[lane->index_count++] = (AutoIndexEntry){ frame, value, lane->size + n };
+     }
+     memcpy(lane->data + lane->size, bytes, n);
+     lane->size += n;
+     lane->points++;
+     lane->last_frame = frame;
+     lane->last_value = value;
+     return 1;
+ }
+
+ /** @brief Frees a lane's storage and empties it. */
+ static void lane_free(AutoLane *lane) {
+     free(lane->data);
+     free(lane->index);
+     memset(lane, 0, sizeof(*lane));
+ }
+
+ /** @brief Moves the cursor's next point, if any, into `to`. */
+ static void cursor_decode_to(AutoCursor *c, uint64_t base_frame, int64_t base_value) {
+     c->to_frame = base_frame;
+     c->to_value = base_value;
+     c->has_to = c->decoded < c->lane->points &&
+                 decode_point(c->lane->data, c->lane->size, &c->offset, &c->to_frame, &c->to_value);
+     if (c->has_to) c->decoded++;
+ }
+
+ static int write_u32(FILE *f, uint32_t v) {
+     for (int i = 0; i < 4; i++) if (fputc((int)((v >> (8 * i)) & 0xff), f) == EOF) return 0;
+     return 1;
+ }
+
+ static int write_u64(FILE *f, uint64_t v) {
+     for (int i = 0; i < 8; i++) if (fputc((int)((v >> (8 * i)) & 0xff), f) == EOF) return 0;
+     return 1;
+ }
+
+ static int read_u32(FILE *f, uint32_t *v) {
+     uint8_t b[4];
+
+     if (fread(b, 1, 4, f) != 4) return 0;
+     *v = (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+     return 1;
+ }
+
+ static int read_u64(FILE *f, uint64_t *v) {
+     uint32_t lo, hi;
+
+     if (!read_u32(f, &lo) || !read_u32(f, &hi)) return 0;
+     *v = (uint64_t)hi << 32 | lo;
+     return 1;
+ }
+
+ /**
+  * @brief Writes the points of every lane from its `saved_points` on as blocks and marks them saved.
+  * @return 1 on success, 0 on a write error or a block too large for the format.
+  */
+ static int write_blocks(Automation *a, FILE *f) {
+     for (int p = 0; p < SYNTH_PARAM_COUNT; p++) {
+         AutoLane *lane = &a->lanes[p];
+         size_t points = lane->points - lane->saved_points, bytes = lane->size - lane->saved_size;
+
+         if (points == 0) continue;
+         if (points > UINT32_MAX || bytes > UINT32_MAX) return 0;
+         if (fputc(p, f) == EOF || !write_u32(f, (uint32_t)points) || !write_u32(f, (uint32_t)bytes) ||
+             fwrite(lane->data + lane->saved_size, 1, bytes, f) != bytes) return 0;
+     }
+     if (fflush(f) != 0) return 0;
+     for (int p = 0; p < SYNTH_PARAM_COUNT; p++) {
+         a->lanes[p].saved_points = a->lanes[p].points;
+         a->lanes[p].saved_size = a->lanes[p].size;
+     }
+     return 1;
+ }
+
+ /**
+  * @brief Reads the blocks of a take file after its header.
+  * @return 1 on success (a truncated last block is dropped with a warning), 0 on malformed data.
+  */
+ static int read_blocks(Automation *a, FILE *f, const char *path) {
+     uint8_t *data = NULL;
+     size_t data_capacity = 0;
+     int c, ok = 1;
+
+     while (ok && (c = fgetc(f)) != EOF) {
+         uint32_t points, bytes;
+         AutoLane *lane;
+         uint64_t frame;
+         int64_t value;
+         size_t offset = 0;
+
+         if (!read_u32(f, &points) || !read_u32(f, &bytes)) {
+             fprintf(stderr, "Warning: %s ends in a truncated block, its points are ignored\n", path);
+             break;
+         }
+         if (c >= SYNTH_PARAM_COUNT || points == 0) {
+             fprintf(stderr, "Error: %s has a block for an unknown lane %d or without points\n", path, c);
+             ok = 0;
+             break;
+         }
+         if (!reserve((void **)&data, &data_capacity, bytes, 1, 4096)) {
+             fprintf(stderr, "Error: Out of memory reading %s\n", path);
+             ok = 0;
+             break;
+         }
+         if (fread(data, 1, bytes, f) != bytes) {
+             fprintf(stderr, "Warning: %s ends in a truncated block, its points are ignored\n", path);
+             break;
+         }
+         lane = &a->lanes[c];
+         frame = lane->last_frame;
+         value = lane->last_value;
+         for (uint32_t i = 0; ok && i < points; i++) {
+             ok = decode_point(data, bytes, &offset, &frame, &value) && lane_append(lane, frame, value);
+         }
+         if (!ok || offset != bytes) {
+             fprintf(stderr, "Error: %s has a malformed block for lane %d\n", path, c);
+             ok = 0;
+         }
+     }
+     free(data);
+     return ok;
+ }
+
+
+ // --- Public Functions ---
+
+ void automation_init(Automation *a, double sample_rate) {
+     memset(a, 0, sizeof(*a));
+     a->sample_rate = sample_rate;
+ }
+
+ void automation_free(Automation *a) {
+     for (int p = 0; p < SYNTH_PARAM_COUNT; p++) lane_free(&a->lanes[p]);
+ }
+
+ int automation_lane_append(AutoLane *lane, uint64_t frame, double value) {
+     int64_t q;
+
+     return quantise(value, &q) && lane_append(lane, frame, q);
+ }
+
+ int automation_record(Automation *a, SynthParam param, uint64_t frame, double value) {
+     AutoLane *lane = &a->lanes[param];
+     uint64_t hold = (uint64_t)(AUTO_RAMP_MAX_SEC * a->sample_rate);
+     int64_t q;
+
+     if (!quantise(value, &q)) return 0;
+     if (lane->points > 0) {
+         if (q == lane->last_value) return 1;
+         if (frame < lane->last_frame) return 0;
+         // After a pause the old value holds up to the change instead of ramping towards it
+         if (frame - lane->last_frame > hold && !lane_append(lane, frame, lane->last_value)) return 0;
+     }
+     return lane_append(lane, frame, q);
+ }
+
+ size_t automation_points(const Automation *a) {
+     size_t n = 0;
+
+     for (int p = 0; p < SYNTH_PARAM_COUNT; p++) n += a->lanes[p].points;
+     return n;
+ }
+
+ size_t automation_bytes(const Automation *a) {
+     size_t n = 0;
+
+     for (int p = 0; p < SYNTH_PARAM_COUNT; p++) n += a->lanes[p].size;
+     return n;
+ }
+
+ int automation_lane_value(const AutoLane *lane, uint64_t frame, double *value) {
+     AutoCursor c;
+
+     automation_cursor_seek(&c, lane, frame);
+     if (c.next_frame != frame) return 0;
+     return automation_cursor_next(&c, value);
+ }
+
+ void automation_cursor_seek(AutoCursor *c, const AutoLane *lane, uint64_t frame) {
+     size_t lo = 0, hi;
+
+     memset(c, 0, sizeof(*c));
+     c->lane = lane;
+     c->next_frame = AUTO_NEVER;
+     if (lane->points == 0) return;
+
+     // Last index entry at or before the frame
+     hi = lane->index_count;
+     while (hi - lo > 1) {
+         size_t mid = lo + (hi - lo) / 2;
+         if (lane->index[mid].frame <= frame) lo = mid;
+         else hi = mid;
+     }
+     c->offset = lane->index[lo].offset;
+     c->decoded = lo * AUTO_INDEX_INTERVAL + 1;
+     if (lane->index[lo].frame > frame) {
+         // Before the first point: nothing is set until it
+         c->has_to = 1;
+         c->to_frame = lane->index[0].frame;
+         c->to_value = lane->index[0].value;
+         c->next_frame = c->to_frame;
+         return;
+     }
+     c->has_from = 1;
+     c->from_frame = lane->index[lo].frame;
+     c->from_value = lane->index[lo].value;
+     for (;;) {
+         cursor_decode_to(c, c->from_frame, c->from_value);
+         if (!c->has_to || c->to_frame > frame) break;
+         c->from_frame = c->to_frame;
+         c->from_value = c->to_value;
+     }
+     c->next_frame = frame;
+ }
+
+ uint64_t automation_cursor_next_frame(const AutoCursor *c) {
+     return c->next_frame;
+ }
+
+ int automation_cursor_next(AutoCursor *c, double *value) {
+     const uint64_t frame = c->next_frame;
+     double from, to;
+
+     if (frame == AUTO_NEVER) return 0;
+     if (!c->has_from) {
+         c->has_from = 1;
+         c->from_frame = c->to_frame;
+         c->from_value = c->to_value;
+         cursor_decode_to(c, c->from_frame, c->from_value);
+     }
+     while (c->has_to && c->to_frame <= frame) {
+         c->from_frame = c->to_frame;
+         c->from_value = c->to_value;
+         cursor_decode_to(c, c->from_frame, c->from_value);
+     }
+
+     from = c->from_value * AUTO_VALUE_QUANTUM;
+     if (!c->has_to) {
+         // Past the last point: the value holds
+         *value = from;
+         c->next_frame = AUTO_NEVER;
+         return 1;
+     }
+     to = c->to_value * AUTO_VALUE_QUANTUM;
+     *value = from + (to - from) * (double)(frame - c->from_frame) / (double)(c->to_frame - c->from_frame);
+     // A flat segment needs no values until its end
+     c->next_frame = (c->to_value == c->from_value || c->to_frame - frame <= AUTO_CONTROL_FRAMES)
+                     ? c->to_frame : frame + AUTO_CONTROL_FRAMES;
+     return 1;
+ }
+
+ int automation_save(Automation *a, const char *path) {
+     FILE *f = fopen(path, "wb");
+     uint64_t rate_bits;
+     int ok;
+
+     if (f == NULL) {
+         fprintf(stderr, "Error opening automation file %s for writing: %s\n", path, strerror(errno));
+         return 0;
+     }
+     memcpy(&rate_bits, &a->sample_rate, sizeof(rate_bits));
+     for (int p = 0; p < SYNTH_PARAM_COUNT; p++) a->lanes[p].saved_points = a->lanes[p].saved_size = 0;
+     ok = fwrite(AUTO_FILE_MAGIC, 1, 8, f) == 8 && write_u32(f, AUTO_FILE_VERSION) && write_u64(f, rate_bits) &&
+          write_blocks(a, f);
+     if (fclose(f) != 0) ok = 0;
+     if (!ok) fprintf(stderr, "Error writing automation file %s\n", path);
+     return ok;
+ }
+
+ int automation_append(Automation *a, const char *path) {
+     FILE *f = fopen(path, "ab");
+     int ok;
+
+     if (f == NULL) {
+         fprintf(stderr, "Error opening automation file %s for appending: %s\n", path, strerror(errno));
+         return 0;
+     }
+     ok = write_blocks(a, f);
+     if (fclose(f) != 0) ok = 0;
+     if (!ok) fprintf(stderr, "Error appending to automation file %s\n", path);
+     return ok;
+ }
+
+ int automation_load(Automation *a, const char *path) {
+     FILE *f = fopen(path, "rb");
+     char magic[8];
+     uint32_t version;
+     uint64_t rate_bits;
+     double rate;
+     int ok;
+
+     if (f == NULL) {
+         fprintf(stderr, "Error opening automation file %s for reading: %s\n", path, strerror(errno));
+         return 0;
+     }
+     if (fread(magic, 1, 8, f) != 8 || memcmp(magic, AUTO_FILE_MAGIC, 8) != 0 ||
+         !read_u32(f, &version) || !read_u64(f, &rate_bits)) {
+         fprintf(stderr, "Error: %s is not an automation file\n", path);
+         fclose(f);
+         return 0;
+     }
+     memcpy(&rate, &rate_bits, sizeof(rate));
+     if (version != AUTO_FILE_VERSION || !(rate > 0.0)) {
+         fprintf(stderr, "Error: %s has an unsupported version %u or sample rate\n", path, version);
+         fclose(f);
+         return 0;
+     }
+     automation_init(a, rate);
+     ok = read_blocks(a, f, path);
+     fclose(f);
+     if (!ok) {
+         automation_free(a);
+         return 0;
+     }
+     for (int p = 0; p < SYNTH_PARAM_COUNT; p++) {
+         a->lanes[p].saved_points = a->lanes[p].points;
+         a->lanes[p].saved_size = a->lanes[p].size;
+     }
+     return 1;
+ }
@@ -0,0 +1,172 @@
+/**
+ * @file automation.h
+ * @brief Parameter automation: delta-encoded, append-only lanes of timed values and the cursor that plays them.
+ *
+ * A take holds one lane per SynthParam. A lane is a list of points (frame,
+ * value), frames counted from the start of the take, stored as the change
+ * from the previous point: the frame difference as an unsigned LEB128 varint,
+ * then the value, quantised to AUTO_VALUE_QUANTUM, as a zigzag varint of its
+ * difference. A slider move from one block to the next costs two to four
+ * bytes, so an hour of dense automation stays in the megabytes. Points are
+ * only ever appended, in frame order.
+ *
+ * Every AUTO_INDEX_INTERVAL points the lane also notes the point's frame,
+ * value and byte offset in an index. Seeking is a binary search of the index
+ * and decoding fewer than AUTO_INDEX_INTERVAL points, however long the take.
+ *
+ * Between two points the value ramps linearly. A cursor produces a value on
+ * every point and every AUTO_CONTROL_FRAMES frames in between; before the
+ * first point a lane sets nothing and after the last it holds its value.
+ * automation_record() keeps a pause from turning into a slow ramp: a change
+ * more than AUTO_RAMP_MAX_SEC after the previous point first repeats the old
+ * value on the same frame, so it plays back as the step it was.
+ *
+ * On disk a take is a header and a sequence of blocks, each holding points of
+ * one lane in the same encoding. A block continues the delta chain of the
+ * lane's previous block, so a recording is saved by appending the points
+ * added since the last save (automation_append()) without rewriting the file.
+ * All numbers in the file are little endian.
+ *
+ * Building lanes allocates. Cursors only read, never block and never
+ * allocate, so the render thread can play a take nobody changes meanwhile.
+ */
+
+ #ifndef AUTOMATION_H
+ #define AUTOMATION_H
+
+ #include <stddef.h>
+ #include <stdint.h>
+
+ #include "midimap.h"
+
+ // --- Constants ---
+ #define AUTO_VALUE_QUANTUM 1e-6        ///< Resolution of stored values.
+ #define AUTO_INDEX_INTERVAL 256        ///< Points between two seek index entries.
+ #define AUTO_CONTROL_FRAMES 32         ///< Frames between two values a cursor produces on a ramp.
+ #define AUTO_RAMP_MAX_SEC 0.025        ///< Longest gap automation_record() lets ramp (a GUI frame and a bit); later changes are steps.
+ #define AUTO_FILE_MAGIC "SYNTHAUT"     ///< First 8 bytes of a take file.
+ #define AUTO_FILE_VERSION 1
+ #define AUTO_NEVER UINT64_MAX          ///< automation_cursor_next_frame() when the lane sets nothing more.
+
+ /**
+  * @struct AutoIndexEntry
+  * @brief Where a lane's point number `k * AUTO_INDEX_INTERVAL` is.
+  */
+ typedef struct {
+     uint64_t frame;                 ///< Frame of the point.
+     int64_t value;                  ///< Its quantised value.
+     size_t offset;                  ///< Byte offset of the point after it.
+ } AutoIndexEntry;
+
+ /**
+  * @struct AutoLane
+  * @brief The points of one parameter. Zero-initialise, release with automation_free().
+  */
+ typedef struct {
+     uint8_t *data;                  ///< Encoded points.
+     size_t size;                    ///< Bytes used...
+     size_t capacity;                ///< ...and allocated.
+     AutoIndexEntry *index;          ///< Seek index, entry `k` for point `k * AUTO_INDEX_INTERVAL`.
+     size_t index_count;
+     size_t index_capacity;
+     size_t points;
+     uint64_t last_frame;            ///< Frame and quantised value of the last point, the base of the next delta.
+     int64_t last_value;
+     size_t saved_points;            ///< Points already in the file (see automation_append())...
+     size_t saved_size;              ///< ...and their bytes.
+ } AutoLane;
+
+ /**
+  * @struct Automation
+  * @brief A take: a lane per parameter and the rate its frames count at.
+  */
+ typedef struct {
+     double sample_rate;             ///< Frames per second of the lanes.
+     AutoLane lanes[SYNTH_PARAM_COUNT];
+ } Automation;
+
+ /**
+  * @struct AutoCursor
+  * @brief Playback position in a lane: the points around it and when the next value is due.
+  */
+ typedef struct {
+     const AutoLane *lane;
+     size_t offset;                  ///< Byte offset of the first point not decoded yet.
+     size_t decoded;                 ///< Points decoded so far.
+     int has_from, has_to;           ///< Whether `from`/`to` hold a point.
+     uint64_t from_frame, to_frame;  ///< The segment played: last point reached and the one after it.
+     int64_t from_value, to_value;
+     uint64_t next_frame;            ///< Frame of the next value, AUTO_NEVER if none.
+ } AutoCursor;
+
+ /**
+  * @brief Clears a take to empty lanes at `sample_rate`. The take must not hold allocated lanes.
+  */
+ void automation_init(Automation *a, double sample_rate);
+
+ /** @brief Frees the lanes of a take and empties it. Safe on an initialised or freed take. */
+ void automation_free(Automation *a);
+
+ /**
+  * @brief Appends a point to a lane.
+  * @param frame Frame of the point, not before the lane's last point.
+  * @param value The value, stored to AUTO_VALUE_QUANTUM.
+  * @return 1 on success, 0 if the frame is out of order or memory runs out (the lane is unchanged).
+  */
+ int automation_lane_append(AutoLane *lane, uint64_t frame, double value);
+
+ /**
+  * @brief Records a parameter change into a take: appends it, skipping values
+  * that do not change and holding the old value up to a change after a pause.
+  * @return 1 on success (or nothing to store), 0 as automation_lane_append().
+  */
+ int automation_record(Automation *a, SynthParam param, uint64_t frame, double value);
+
+ /** @brief Total points of a take. */
+ size_t automation_points(const Automation *a);
+
+ /** @brief Total encoded bytes of a take, without the seek index. */
+ size_t automation_bytes(const Automation *a);
+
+ /**
+  * @brief Reads the value a lane has at a frame.
+  * @param[out] value The value, interpolated between the points around `frame`.
+  * @return 1 if the lane sets a value there, 0 before its first point.
+  */
+ int automation_lane_value(const AutoLane *lane, uint64_t frame, double *value);
+
+ /**
+  * @brief Positions a cursor at a frame of a lane; the first value is due at
+  * `frame` if a point is at or before it, else at the first point.
+  */
+ void automation_cursor_seek(AutoCursor *c, const AutoLane *lane, uint64_t frame);
+
+ /** @brief Frame the cursor's next value is due, AUTO_NEVER if the lane sets nothing more. */
+ uint64_t automation_cursor_next_frame(const AutoCursor *c);
+
+ /**
+  * @brief Produces the value due at automation_cursor_next_frame() and moves on.
+  * @param[out] value The value.
+  * @return 1 if a value was due, 0 if the lane has ended.
+  */
+ int automation_cursor_next(AutoCursor *c, double *value);
+
+ /**
+  * @brief Writes a take to a new file and marks all its points saved.
+  * @return 1 on success, 0 on failure (reported on stderr).
+  */
+ int automation_save(Automation *a, const char *path);
+
+ /**
+  * @brief Appends the points added since the last save to a file written by automation_save().
+  * @return 1 on success, 0 on failure (reported on stderr; the points stay unsaved).
+  */
+ int automation_append(Automation *a, const char *path);
+
+ /**
+  * @brief Reads a take file into an empty take (initialised, no points).
+  * @return 1 on success, 0 if the file cannot be read or is malformed (reported on stderr; `a` is left empty).
+  */
+ int automation_load(Automation *a, const char *path);
+
+ #endif // AUTOMATION_H
@@ -0,0 +1,682 @@
+/**
+ * @file config.c
+ * @brief Implements parsing of audio stream options from files and the command line.
+ *
+ * Both sources share one key/value setter so a configuration file line such as
+ * `sampleRate: 48000` and the command-line option `--sample-rate 48000` are
+ * validated identically.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <errno.h>
+ #include <ctype.h>
+ #include <limits.h>
+
+ #include "config.h"
+
+ // --- Validation Limits ---
+ #define CONFIG_MIN_SAMPLE_RATE 8000.0
+ #define CONFIG_MAX_SAMPLE_RATE 384000.0
+ #define CONFIG_MAX_FRAMES_PER_BUFFER 16384UL
+ #define CONFIG_MAX_LATENCY_MS 2000.0
+ #define CONFIG_MIN_PERIODS 2U
+ #define CONFIG_MAX_PERIODS 16U
+ #define CONFIG_MAX_LOOKAHEAD_MS 500.0
+ #define CONFIG_MAX_INPUT_GAIN 100.0
+ #define CONFIG_MIN_WATCHDOG_MS 20.0
+ #define CONFIG_MAX_WATCHDOG_MS 60000.0
+ #define CONFIG_MAX_ARP_DIVISION 64UL
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Trims leading and trailing whitespace from a string in place.
+  * @param str The string to trim. Modifies the string directly.
+  */
+ static void trim_whitespace(char *str) {
+     if (!str) return;
+     char *start = str;
+     while (isspace((unsigned char)*start)) start++;
+     char *end = start + strlen(start);
+     while (end > start && isspace((unsigned char)*(end - 1))) end--;
+     *end = '\0';
+     if (start != str) {
+         memmove(str, start, strlen(start) + 1);
+     }
+ }
+
+ /**
+  * @brief Parses a complete string as a double.
+  * @return 1 if the whole string was a valid number, 0 otherwise.
+  */
+ static int parse_double(const char *str, double *out) {
+     char *end = NULL;
+     errno = 0;
+     double v = strtod(str, &end);
+     if (end == str || *end != '\0' || errno != 0) return 0;
+     *out = v;
+     return 1;
+ }
+
+ /**
+  * @brief Parses a complete string as a non-negative integer.
+  * @return 1 if the whole string was a valid integer, 0 otherwise.
+  */
+ static int parse_ulong(const char *str, unsigned long *out) {
+     char *end = NULL;
+     if (str[0] == '-' || str[0] == '\0') return 0;
+     errno = 0;
+     unsigned long v = strtoul(str, &end, 10);
+     if (*end != '\0' || errno != 0) return 0;
+     *out = v;
+     return 1;
+ }
+
+ /**
+  * @brief Parses a controller assignment `PARAM,CC[,MIN,MAX[,CURVE[,CHANNEL]]]` or `PARAM,off`.
+  *
+  * Omitted fields take the parameter's defaults (full range, natural curve,
+  * any channel). CHANNEL counts from 1 like the channel numbers on devices.
+  *
+  * @return 1 on success, 0 if the value is malformed.
+  */
+ static int parse_midi_map(AudioConfig *cfg, const char *value) {
+     char buffer[128];
+     char *fields[6];
+     int count = 0, param, curve;
+     unsigned long cc, channel;
+     MidiMapping m;
+
+     if (strlen(value) >= sizeof(buffer)) return 0;
+     snprintf(buffer, sizeof(buffer), "%s", value);
+     for (char *tok = strtok(buffer, ","); tok != NULL; tok = strtok(NULL, ",")) {
+         if (count == 6) return 0;
+         trim_whitespace(tok);
+         fields[count++] = tok;
+     }
+     if (count < 2 || count == 3 || (param = midimap_param_from_name(fields[0])) < 0) return 0;
+
+     if (strcmp(fields[1], "off") == 0) {
+         if (count != 2) return 0;
+         cfg->midiMap.params[param].cc = -1;
+         cfg->midiMapped |= 1u << param;
+         return 1;
+     }
+     if (!parse_ulong(fields[1], &cc) || cc >= MIDI_MAP_CONTROLLERS) return 0;
+     m = midimap_default((SynthParam)param, MIDI_MAP_ANY_CHANNEL, (int)cc);
+     if (count >= 4 && (!parse_double(fields[2], &m.min) || !parse_double(fields[3], &m.max))) return 0;
+     if (count >= 5) {
+         if ((curve = midimap_curve_from_name(fields[4])) < 0) return 0;
+         m.curve = (MidiCurve)curve;
+     }
+     if (count == 6) {
+         if (!parse_ulong(fields[5], &channel) || channel < 1 || channel > 16) return 0;
+         m.channel = (int)channel - 1;
+     }
+     cfg->midiMap.params[param] = m;
+     cfg->midiMapped |= 1u << param;
+     return 1;
+ }
+
+
+ // --- Public Functions ---
+
+ void audio_config_set_defaults(AudioConfig *cfg) {
+     *cfg = (AudioConfig)AUDIO_CONFIG_DEFAULTS;
+ }
+
+ /**
+  * @brief Parses an arpeggiator rate given as a note value: `16` or `1/16`, `8t` or `1/8t` for triplets.
+  * @param[out] steps_per_beat The rate in steps per (quarter note) beat.
+  * @return 1 on success, 0 if the value is not a power of two 1-64, optionally followed by `t`.
+  */
+ static int parse_arp_rate(const char *value, double *steps_per_beat) {
+     char buffer[16];
+     size_t len;
+     unsigned long division;
+     int triplet = 0;
+
+     if (strncmp(value, "1/", 2) == 0) value += 2;
+     len = strlen(value);
+     if (len == 0 || len >= sizeof(buffer)) return 0;
+     memcpy(buffer, value, len + 1);
+     if (buffer[len - 1] == 't') { triplet = 1; buffer[len - 1] = '\0'; }
+     if (!parse_ulong(buffer, &division) || division == 0 || division > CONFIG_MAX_ARP_DIVISION ||
+         (division & (division - 1)) != 0) return 0;
+     *steps_per_beat = division / 4.0 * (triplet ? 1.5 : 1.0);
+     return 1;
+ }
+
+ /**
+  * @brief Sets one option, as audio_config_set_value(), without reporting unknown keys.
+  * @return 1 on success, 0 if the value is invalid (reported on stderr), -1 if the key is unknown.
+  */
+ static int config_set_value(AudioConfig *cfg, const char *key, const char *value) {
+     double d_value;
+     unsigned long ul_value;
+
+     if (strcmp(key, "backend") == 0) {
+         if (strcmp(value, "portaudio") == 0) cfg->backend = AUDIO_BACKEND_PORTAUDIO;
+         else if (strcmp(value, "alsa") == 0) cfg->backend = AUDIO_BACKEND_ALSA;
+         else if (strcmp(value, "jack") == 0) cfg->backend = AUDIO_BACKEND_JACK;
+         else {
+             fprintf(stderr, "Config Error: unknown backend '%s' (expected portaudio, alsa or jack)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "device") == 0) {
+         if (value[0] == '\0' || strcmp(value, "default") == 0) {
+             cfg->deviceIndex = -1;
+             cfg->deviceName[0] = '\0';
+         } else if (parse_ulong(value, &ul_value)) {
+             cfg->deviceIndex = (int)ul_value;
+             cfg->deviceName[0] = '\0';
+         } else {
+             if (strlen(value) >= sizeof(cfg->deviceName)) {
+                 fprintf(stderr, "Config Error: device name too long: '%s'\n", value);
+                 return 0;
+             }
+             cfg->deviceIndex = -1;
+             snprintf(cfg->deviceName, sizeof(cfg->deviceName), "%s", value);
+         }
+         return 1;
+     }
+     if (strcmp(key, "sampleRate") == 0) {
+         if (!parse_double(value, &d_value) || d_value < CONFIG_MIN_SAMPLE_RATE || d_value > CONFIG_MAX_SAMPLE_RATE) {
+             fprintf(stderr, "Config Error: invalid sample rate '%s' (expected %.0f-%.0f Hz)\n", value, CONFIG_MIN_SAMPLE_RATE, CONFIG_MAX_SAMPLE_RATE);
+             return 0;
+         }
+         cfg->sampleRate = d_value;
+         return 1;
+     }
+     if (strcmp(key, "framesPerBuffer") == 0) {
+         if (strcmp(value, "auto") == 0) { cfg->framesPerBuffer = 0; return 1; }
+         if (!parse_ulong(value, &ul_value) || ul_value > CONFIG_MAX_FRAMES_PER_BUFFER) {
+             fprintf(stderr, "Config Error: invalid frames per buffer '%s' (expected 0-%lu or 'auto')\n", value, CONFIG_MAX_FRAMES_PER_BUFFER);
+             return 0;
+         }
+         cfg->framesPerBuffer = ul_value;
+         return 1;
+     }
+     if (strcmp(key, "latencyMs") == 0) {
+         if (strcmp(value, "auto") == 0) { cfg->suggestedLatency = -1.0; return 1; }
+         if (!parse_double(value, &d_value) || d_value <= 0.0 || d_value > CONFIG_MAX_LATENCY_MS) {
+             fprintf(stderr, "Config Error: invalid latency '%s' ms (expected >0-%.0f or 'auto')\n", value, CONFIG_MAX_LATENCY_MS);
+             return 0;
+         }
+         cfg->suggestedLatency = d_value / 1000.0;
+         return 1;
+     }
+     if (strcmp(key, "periods") == 0) {
+         if (!parse_ulong(value, &ul_value) || ul_value < CONFIG_MIN_PERIODS || ul_value > CONFIG_MAX_PERIODS) {
+             fprintf(stderr, "Config Error: invalid period count '%s' (expected %u-%u)\n", value, CONFIG_MIN_PERIODS, CONFIG_MAX_PERIODS);
+             return 0;
+         }
+         cfg->periods = (unsigned int)ul_value;
+         return 1;
+     }
+     if (strcmp(key, "lookaheadMs") == 0) {
+         if (strcmp(value, "off") == 0) { cfg->lookaheadMs = 0.0; return 1; }
+         if (!parse_double(value, &d_value) || d_value < 0.0 || d_value > CONFIG_MAX_LOOKAHEAD_MS) {
+             fprintf(stderr, "Config Error: invalid lookahead '%s' ms (expected 0-%.0f or 'off')\n", value, CONFIG_MAX_LOOKAHEAD_MS);
+             return 0;
+         }
+         cfg->lookaheadMs = d_value;
+         return 1;
+     }
+     if (strcmp(key, "ioMode") == 0) {
+         if (strcmp(value, "callback") == 0) cfg->ioMode = AUDIO_IO_CALLBACK;
+         else if (strcmp(value, "blocking") == 0) cfg->ioMode = AUDIO_IO_BLOCKING;
+         else {
+             fprintf(stderr, "Config Error: unknown I/O mode '%s' (expected callback or blocking)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "adaptive") == 0) {
+         if (strcmp(value, "on") == 0 || strcmp(value, "1") == 0) cfg->adaptive = 1;
+         else if (strcmp(value, "off") == 0 || strcmp(value, "0") == 0) cfg->adaptive = 0;
+         else {
+             fprintf(stderr, "Config Error: invalid adaptive setting '%s' (expected on or off)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "adaptiveMaxMs") == 0) {
+         if (!parse_double(value, &d_value) || d_value <= 0.0 || d_value > CONFIG_MAX_LOOKAHEAD_MS) {
+             fprintf(stderr, "Config Error: invalid adaptive maximum '%s' ms (expected >0-%.0f)\n", value, CONFIG_MAX_LOOKAHEAD_MS);
+             return 0;
+         }
+         cfg->adaptiveMaxMs = d_value;
+         return 1;
+     }
+     if (strcmp(key, "watchdogMs") == 0) {
+         if (strcmp(value, "off") == 0 || strcmp(value, "0") == 0) { cfg->watchdogMs = 0.0; return 1; }
+         if (!parse_double(value, &d_value) || d_value < CONFIG_MIN_WATCHDOG_MS || d_value > CONFIG_MAX_WATCHDOG_MS) {
+             fprintf(stderr, "Config Error: invalid watchdog timeout '%s' ms (expected %.0f-%.0f or 'off')\n", value, CONFIG_MIN_WATCHDOG_MS, CONFIG_MAX_WATCHDOG_MS);
+             return 0;
+         }
+         cfg->watchdogMs = d_value;
+         return 1;
+     }
+     if (strcmp(key, "internalRate") == 0) {
+         if (strcmp(value, "off") == 0) { cfg->internalRate = 0.0; return 1; }
+         if (!parse_double(value, &d_value) || d_value < CONFIG_MIN_SAMPLE_RATE || d_value > CONFIG_MAX_SAMPLE_RATE) {
+             fprintf(stderr, "Config Error: invalid internal rate '%s' (expected %.0f-%.0f Hz or 'off')\n", value, CONFIG_MIN_SAMPLE_RATE, CONFIG_MAX_SAMPLE_RATE);
+             return 0;
+         }
+         cfg->internalRate = d_value;
+         return 1;
+     }
+     if (strcmp(key, "srcQuality") == 0) {
+         if (strcmp(value, "low") == 0) cfg->srcQuality = RESAMPLER_QUALITY_LOW;
+         else if (strcmp(value, "medium") == 0) cfg->srcQuality = RESAMPLER_QUALITY_MEDIUM;
+         else if (strcmp(value, "high") == 0) cfg->srcQuality = RESAMPLER_QUALITY_HIGH;
+         else {
+             fprintf(stderr, "Config Error: unknown resampler quality '%s' (expected low, medium or high)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "sampleFormat") == 0) {
+         if (strcmp(value, "float32") == 0 || strcmp(value, "float") == 0) cfg->sampleFormat = SAMPLE_FORMAT_FLOAT32;
+         else if (strcmp(value, "int16") == 0) cfg->sampleFormat = SAMPLE_FORMAT_INT16;
+         else if (strcmp(value, "int24") == 0) cfg->sampleFormat = SAMPLE_FORMAT_INT24;
+         else {
+             fprintf(stderr, "Config Error: unknown sample format '%s' (expected float32, int16 or int24)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "dither") == 0) {
+         if (strcmp(value, "none") == 0 || strcmp(value, "off") == 0) cfg->dither = DITHER_NONE;
+         else if (strcmp(value, "tpdf") == 0) cfg->dither = DITHER_TPDF;
+         else if (strcmp(value, "shaped") == 0) cfg->dither = DITHER_SHAPED;
+         else {
+             fprintf(stderr, "Config Error: unknown dither '%s' (expected none, tpdf or shaped)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "input") == 0) {
+         if (strcmp(value, "off") == 0) cfg->inputMode = SIDECHAIN_OFF;
+         else if (strcmp(value, "ringmod") == 0) cfg->inputMode = SIDECHAIN_RINGMOD;
+         else if (strcmp(value, "follow") == 0) cfg->inputMode = SIDECHAIN_FOLLOW;
+         else if (strcmp(value, "vocoder") == 0) cfg->inputMode = SIDECHAIN_VOCODER;
+         else {
+             fprintf(stderr, "Config Error: unknown input mode '%s' (expected off, ringmod, follow or vocoder)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "inputDevice") == 0) {
+         if (value[0] == '\0' || strcmp(value, "default") == 0) { cfg->inputDeviceIndex = -1; return 1; }
+         if (!parse_ulong(value, &ul_value) || ul_value > INT_MAX) {
+             fprintf(stderr, "Config Error: invalid input device '%s' (expected an index or 'default')\n", value);
+             return 0;
+         }
+         cfg->inputDeviceIndex = (int)ul_value;
+         return 1;
+     }
+     if (strcmp(key, "inputGain") == 0) {
+         if (!parse_double(value, &d_value) || d_value <= 0.0 || d_value > CONFIG_MAX_INPUT_GAIN) {
+             fprintf(stderr, "Config Error: invalid input gain '%s' (expected >0-%.0f)\n", value, CONFIG_MAX_INPUT_GAIN);
+             return 0;
+         }
+         cfg->inputGain = d_value;
+         return 1;
+     }
+     if (strcmp(key, "midiIn") == 0) {
+         if (strcmp(value, "off") == 0) { cfg->midiInput = 0; cfg->midiSource[0] = '\0'; return 1; }
+         if (strcmp(value, "on") == 0) { cfg->midiInput = 1; cfg->midiSource[0] = '\0'; return 1; }
+         if (value[0] == '\0' || strlen(value) >= sizeof(cfg->midiSource)) {
+             fprintf(stderr, "Config Error: invalid MIDI input '%s' (expected off, on or a sequencer client:port)\n", value);
+             return 0;
+         }
+         cfg->midiInput = 1;
+         snprintf(cfg->midiSource, sizeof(cfg->midiSource), "%s", value);
+         return 1;
+     }
+     if (strcmp(key, "midiMap") == 0) {
+         if (!parse_midi_map(cfg, value)) {
+             fprintf(stderr, "Config Error: invalid MIDI mapping '%s' (expected PARAM,CC[,MIN,MAX[,CURVE[,CHANNEL]]] or PARAM,off "
+                             "with PARAM e.g. freq1 or release2, CC 0-%d, CURVE linear|exp|log, CHANNEL 1-16)\n",
+                     value, MIDI_MAP_CONTROLLERS - 1);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "midiClock") == 0) {
+         if (strcmp(value, "off") == 0) cfg->midiClock = MIDI_CLOCK_OFF;
+         else if (strcmp(value, "in") == 0) cfg->midiClock = MIDI_CLOCK_IN;
+         else if (strcmp(value, "out") == 0) cfg->midiClock = MIDI_CLOCK_OUT;
+         else {
+             fprintf(stderr, "Config Error: unknown MIDI clock mode '%s' (expected off, in or out)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "mpe") == 0) {
+         if (strcmp(value, "off") == 0) { cfg->mpeBendRange = 0.0; return 1; }
+         if (strcmp(value, "on") == 0) { cfg->mpeBendRange = MPE_DEFAULT_BEND_RANGE; return 1; }
+         if (!parse_double(value, &d_value) || d_value < 1.0 || d_value > MPE_MAX_BEND_RANGE) {
+             fprintf(stderr, "Config Error: invalid MPE mode '%s' (expected off, on or a pitch bend range of 1-%.0f semitones)\n",
+                     value, MPE_MAX_BEND_RANGE);
+             return 0;
+         }
+         cfg->mpeBendRange = d_value;
+         return 1;
+     }
+     if (strcmp(key, "arp") == 0) {
+         if (strcmp(value, "off") == 0) cfg->arpMode = ARP_OFF;
+         else if (strcmp(value, "up") == 0) cfg->arpMode = ARP_UP;
+         else if (strcmp(value, "down") == 0) cfg->arpMode = ARP_DOWN;
+         else if (strcmp(value, "updown") == 0) cfg->arpMode = ARP_UP_DOWN;
+         else if (strcmp(value, "random") == 0) cfg->arpMode = ARP_RANDOM;
+         else if (strcmp(value, "played") == 0) cfg->arpMode = ARP_AS_PLAYED;
+         else {
+             fprintf(stderr, "Config Error: unknown arpeggiator mode '%s' (expected off, up, down, updown, random or played)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "arpRate") == 0) {
+         if (!parse_arp_rate(value, &d_value)) {
+             fprintf(stderr, "Config Error: invalid arpeggiator rate '%s' (expected a note value 1/1-1/%lu such as 1/16, "
+                             "or 1/8t for triplets)\n", value, CONFIG_MAX_ARP_DIVISION);
+             return 0;
+         }
+         cfg->arpRate = d_value;
+         return 1;
+     }
+     if (strcmp(key, "arpGate") == 0) {
+         if (!parse_double(value, &d_value) || d_value < ARP_MIN_GATE || d_value > 1.0) {
+             fprintf(stderr, "Config Error: invalid arpeggiator gate '%s' (expected %.2f-1, the fraction of a step a note sounds)\n",
+                     value, ARP_MIN_GATE);
+             return 0;
+         }
+         cfg->arpGate = d_value;
+         return 1;
+     }
+     if (strcmp(key, "arpOctaves") == 0) {
+         if (!parse_ulong(value, &ul_value) || ul_value < 1 || ul_value > ARP_MAX_OCTAVES) {
+             fprintf(stderr, "Config Error: invalid arpeggiator octave range '%s' (expected 1-%d)\n", value, ARP_MAX_OCTAVES);
+             return 0;
+         }
+         cfg->arpOctaves = (int)ul_value;
+         return 1;
+     }
+     if (strcmp(key, "tempo") == 0) {
+         if (!parse_double(value, &d_value) || d_value < ARP_MIN_TEMPO || d_value > ARP_MAX_TEMPO) {
+             fprintf(stderr, "Config Error: invalid tempo '%s' (expected %.0f-%.0f BPM)\n", value, ARP_MIN_TEMPO, ARP_MAX_TEMPO);
+             return 0;
+         }
+         cfg->tempo = d_value;
+         return 1;
+     }
+     if (strcmp(key, "sequencer") == 0) {
+         if (strcmp(value, "on") == 0 || strcmp(value, "1") == 0) cfg->sequencer = 1;
+         else if (strcmp(value, "off") == 0 || strcmp(value, "0") == 0) cfg->sequencer = 0;
+         else {
+             fprintf(stderr, "Config Error: invalid sequencer setting '%s' (expected on or off)\n", value);
+             return 0;
+         }
+         return 1;
+     }
+     if (strcmp(key, "seqPrerenderMs") == 0) {
+         if (strcmp(value, "off") == 0) { cfg->seqPrerenderMs = 0.0; return 1; }
+         if (!parse_double(value, &d_value) || d_value < 0.0 || d_value > CONFIG_MAX_LOOKAHEAD_MS) {
+             fprintf(stderr, "Config Error: invalid sequencer pre-render '%s' ms (expected 0-%.0f or 'off')\n", value, CONFIG_MAX_LOOKAHEAD_MS);
+             return 0;
+         }
+         cfg->seqPrerenderMs = d_value;
+         return 1;
+     }
+     if (strcmp(key, "osc") == 0) {
+         if (strcmp(value, "off") == 0) { cfg->oscPort = 0; return 1; }
+         if (!parse_ulong(value, &ul_value) || ul_value < 1 || ul_value > 65535) {
+             fprintf(stderr, "Config Error: invalid OSC port '%s' (expected 1-65535 or 'off')\n", value);
+             return 0;
+         }
+         cfg->oscPort = (int)ul_value;
+         return 1;
+     }
+     if (strcmp(key, "control") == 0) {
+         if (strcmp(value, "off") == 0) { cfg->controlSocket[0] = '\0'; return 1; }
+         if (value[0] == '\0' || strlen(value) >= sizeof(cfg->controlSocket)) {
+             fprintf(stderr, "Config Error: invalid control socket path '%s' (expected a path of up to %d characters or 'off')\n",
+                     value, CONFIG_SOCKET_PATH_MAX - 1);
+             return 0;
+         }
+         snprintf(cfg->controlSocket, sizeof(cfg->controlSocket), "%s", value);
+         return 1;
+     }
+     if (strcmp(key, "automationRecord") == 0 || strcmp(key, "automationPlay") == 0) {
+         char *path = (strcmp(key, "automationRecord") == 0) ? cfg->automationRecord : cfg->automationPlay;
+         if (strcmp(value, "off") == 0) { path[0] = '\0'; return 1; }
+         if (value[0] == '\0' || strlen(value) >= CONFIG_AUTOMATION_PATH_MAX) {
+             fprintf(stderr, "Config Error: invalid automation file '%s' (expected a path of up to %d characters or 'off')\n",
+                     value, CONFIG_AUTOMATION_PATH_MAX - 1);
+             return 0;
+         }
+         snprintf(path, CONFIG_AUTOMATION_PATH_MAX, "%s", value);
+         return 1;
+     }
+
+     return -1;
+ }
+
+ int audio_config_set_value(AudioConfig *cfg, const char *key, const char *value) {
+     int result;
+
+     if (!cfg || !key || !value) return 0;
+
+     result = config_set_value(cfg, key, value);
+     if (result < 0) fprintf(stderr, "Config Error: unknown option '%s'\n", key);
+     return result > 0;
+ }
+
+ int audio_config_load_file(AudioConfig *cfg, const char *path) {
+     FILE *fp;
+     char line_buffer[256];
+     int line_num = 0;
+     int success = 1;
+
+     if (!cfg || !path) return 0;
+
+     fp = fopen(path, "r");
+     if (fp == NULL) {
+         fprintf(stderr, "Config Error: cannot open '%s': %s\n", path, strerror(errno));
+         return 0;
+     }
+
+     while (fgets(line_buffer, sizeof(line_buffer), fp) != NULL) {
+         line_num++;
+         char *line = line_buffer;
+         trim_whitespace(line);
+         if (line[0] == '\0' || line[0] == '#') continue;
+
+         char *colon_ptr = strchr(line, ':');
+         if (colon_ptr == NULL) {
+             fprintf(stderr, "Warning: Invalid format (no colon) on line %d of %s\n", line_num, path);
+             continue;
+         }
+         *colon_ptr = '\0';
+         char *key_str = line;
+         char *value_str = colon_ptr + 1;
+         trim_whitespace(key_str);
+         trim_whitespace(value_str);
+
+         int result = config_set_value(cfg, key_str, value_str);
+         if (result < 0) {
+             // Left for a newer version, or a typo: the rest of the file still applies
+             fprintf(stderr, "Warning: Unknown option '%s' on line %d of %s skipped\n", key_str, line_num, path);
+             continue;
+         }
+         if (result == 0) {
+             fprintf(stderr, "Config Error: line %d of %s rejected\n", line_num, path);
+             success = 0;
+             break;
+         }
+     }
+
+     fclose(fp);
+     return success;
+ }
+
+ /**
+  * @brief Maps a command-line option name to its configuration key.
+  * @return The configuration key, or NULL if the option is not an audio option.
+  */
+ static const char *option_to_key(const char *opt) {
+     if (strcmp(opt, "--backend") == 0) return "backend";
+     if (strcmp(opt, "--device") == 0) return "device";
+     if (strcmp(opt, "--sample-rate") == 0) return "sampleRate";
+     if (strcmp(opt, "--frames") == 0) return "framesPerBuffer";
+     if (strcmp(opt, "--latency") == 0) return "latencyMs";
+     if (strcmp(opt, "--periods") == 0) return "periods";
+     if (strcmp(opt, "--lookahead") == 0) return "lookaheadMs";
+     if (strcmp(opt, "--io") == 0) return "ioMode";
+     if (strcmp(opt, "--adaptive") == 0) return "adaptive";
+     if (strcmp(opt, "--adaptive-max") == 0) return "adaptiveMaxMs";
+     if (strcmp(opt, "--watchdog") == 0) return "watchdogMs";
+     if (strcmp(opt, "--internal-rate") == 0) return "internalRate";
+     if (strcmp(opt, "--src-quality") == 0) return "srcQuality";
+     if (strcmp(opt, "--format") == 0) return "sampleFormat";
+     if (strcmp(opt, "--dither") == 0) return "dither";
+     if (strcmp(opt, "--input") == 0) return "input";
+     if (strcmp(opt, "--input-device") == 0) return "inputDevice";
+     if (strcmp(opt, "--input-gain") == 0) return "inputGain";
+     if (strcmp(opt, "--midi") == 0) return "midiIn";
+     if (strcmp(opt, "--midi-map") == 0) return "midiMap";
+     if (strcmp(opt, "--midi-clock") == 0) return "midiClock";
+     if (strcmp(opt, "--mpe") == 0) return "mpe";
+     if (strcmp(opt, "--arp") == 0) return "arp";
+     if (strcmp(opt, "--arp-rate") == 0) return "arpRate";
+     if (strcmp(opt, "--arp-gate") == 0) return "arpGate";
+     if (strcmp(opt, "--arp-octaves") == 0) return "arpOctaves";
+     if (strcmp(opt, "--tempo") == 0) return "tempo";
+     if (strcmp(opt, "--seq") == 0) return "sequencer";
+     if (strcmp(opt, "--seq-prerender") == 0) return "seqPrerenderMs";
+     if (strcmp(opt, "--osc") == 0) return "osc";
+     if (strcmp(opt, "--control") == 0) return "control";
+     if (strcmp(opt, "--auto-record") == 0) return "automationRecord";
+     if (strcmp(opt, "--auto-play") == 0) return "automationPlay";
+     if (strcmp(opt, "--config") == 0) return "config";
+     return NULL;
+ }
+
+ int audio_config_parse_args(AudioConfig *cfg, int *argc, char **argv) {
+     int in, out = 1;
+     char opt_buffer[64];
+
+     if (!cfg || !argc || !argv) return 0;
+
+     for (in = 1; in < *argc; in++) {
+         const char *arg = argv[in];
+         const char *value = NULL;
+         const char *key;
+
+         if (strcmp(arg, "--list-devices") == 0) {
+             cfg->listDevices = 1;
+             continue;
+         }
+         if (strcmp(arg, "--build-preset-bank") == 0) {
+             cfg->buildPresetBank = 1;
+             continue;
+         }
+
+         // Split "--opt=value" into option and value
+         const char *eq = strchr(arg, '=');
+         if (strncmp(arg, "--", 2) == 0 && eq != NULL && (size_t)(eq - arg) < sizeof(opt_buffer)) {
+             memcpy(opt_buffer, arg, (size_t)(eq - arg));
+             opt_buffer[eq - arg] = '\0';
+             value = eq + 1;
+         } else {
+             snprintf(opt_buffer, sizeof(opt_buffer), "%s", arg);
+         }
+
+         key = option_to_key(opt_buffer);
+         if (key == NULL) {
+             argv[out++] = argv[in]; // Not ours, keep for GTK
+             continue;
+         }
+         if (value == NULL) {
+             if (in + 1 >= *argc) {
+                 fprintf(stderr, "Error: option %s requires a value\n", opt_buffer);
+                 return 0;
+             }
+             value = argv[++in];
+         }
+
+         if (strcmp(key, "config") == 0) {
+             if (!audio_config_load_file(cfg, value)) return 0;
+         } else if (!audio_config_set_value(cfg, key, value)) {
+             return 0;
+         }
+     }
+
+     argv[out] = NULL;
+     *argc = out;
+     return 1;
+ }
+
+ void audio_config_print_usage(const char *prog) {
+     printf("Usage: %s [options]\n", prog ? prog : "synthesizer");
+     printf("  --backend NAME        Audio backend: portaudio (default), alsa or jack\n");
+     printf("  --device NAME|INDEX   Output device (index or part of its name; ALSA PCM name with --backend alsa,\n");
+     printf("                        JACK server name with --backend jack)\n");
+     printf("  --sample-rate HZ      Stream sample rate (default %.0f)\n", CONFIG_DEFAULT_SAMPLE_RATE);
+     printf("  --frames N            Frames per buffer, 0 or 'auto' lets the backend choose\n");
+     printf("  --latency MS          Suggested output latency in milliseconds, or 'auto'\n");
+     printf("  --periods N           Periods per hardware buffer for the ALSA backend (default %d)\n", CONFIG_DEFAULT_PERIODS);
+     printf("  --lookahead MS        Render MS ahead on a separate thread (absorbs CPU spikes, adds latency)\n");
+     printf("  --io MODE             PortAudio I/O: callback (default) or blocking (implies %.0f ms lookahead)\n", CONFIG_DEFAULT_BLOCKING_LOOKAHEAD_MS);
+     printf("  --adaptive on|off     Grow the buffering on xruns/high load, shrink it again when stable\n");
+     printf("  --adaptive-max MS     Largest buffer or lookahead --adaptive may select (default %.0f)\n", CONFIG_DEFAULT_ADAPTIVE_MAX_MS);
+     printf("  --watchdog MS|off     Restart the stream after MS without audio (%.0f-%.0f, default off)\n", CONFIG_MIN_WATCHDOG_MS, CONFIG_MAX_WATCHDOG_MS);
+     printf("  --internal-rate HZ    Render at a fixed rate and resample to --sample-rate ('off' by default)\n");
+     printf("  --src-quality Q       Resampler quality for --internal-rate: low, medium or high (default)\n");
+     printf("  --format FMT          Device sample format: float32 (default), int16 or int24 (not with JACK)\n");
+     printf("  --dither MODE         Dither for integer formats: none, tpdf (default) or shaped (noise shaping)\n");
+     printf("  --input MODE          Modulate the output with audio input: off (default), ringmod, follow or vocoder\n");
+     printf("                        (opens a duplex stream; PortAudio callback I/O and JACK only)\n");
+     printf("  --input-device INDEX  PortAudio input device for --input (default input device)\n");
+     printf("  --input-gain G        Linear gain applied to the input before modulating (default 1)\n");
+     printf("  --midi off|on|SRC     MIDI input on an ALSA sequencer port, optionally connected from SRC\n");
+     printf("                        (client:port or client name, see 'aconnect -l'; default off)\n");
+     printf("  --midi-map SPEC       Assign a controller: PARAM,CC[,MIN,MAX[,CURVE[,CHANNEL]]] or PARAM,off\n");
+     printf("                        (PARAM freq1, amp1, attack1, ... release2; CURVE linear, exp or log; repeatable)\n");
+     printf("  --midi-clock MODE     MIDI clock: off (default), in (arpeggiator and sequencer follow the clock,\n");
+     printf("                        Start and Stop on the MIDI input) or out (send clock from a 'Clock Out' port)\n");
+     printf("  --mpe off|on|RANGE    MPE: a voice per note with per-note pitch bend (RANGE semitones, 48 for 'on'),\n");
+     printf("                        pressure and timbre (CC 74) from channels 2-16 (default off)\n");
+     printf("  --arp MODE            Arpeggiate held notes: off (default), up, down, updown, random or played\n");
+     printf("  --arp-rate NOTE       Arpeggiator step as a note value, e.g. 1/8, 1/16 (default) or 1/8t\n");
+     printf("  --arp-gate G          Fraction of a step each arpeggiated note sounds (%.2f-1, default %.1f)\n", ARP_MIN_GATE, ARP_DEFAULT_GATE);
+     printf("  --arp-octaves N       Octaves the arpeggio spans (1-%d, default 1)\n", ARP_MAX_OCTAVES);
+     printf("  --tempo BPM           Tempo of the arpeggiator and sequencer clock (%.0f-%.0f, default %.0f)\n", ARP_MIN_TEMPO, ARP_MAX_TEMPO, ARP_DEFAULT_TEMPO);
+     printf("  --seq on|off          Loop the step pattern stored in the loaded preset (default off)\n");
+     printf("  --seq-prerender MS    Render MS further ahead while only the sequencer plays and the CPU has\n");
+     printf("                        headroom (needs --lookahead; default off)\n");
+     printf("  --osc PORT|off        OSC control server on UDP PORT of localhost (default off)\n");
+     printf("  --control PATH|off    Control socket (Unix domain) at PATH for scripting (default off)\n");
+     printf("  --auto-record FILE    Record every parameter change into the automation file FILE (default off)\n");
+     printf("  --auto-play FILE      Play the automation file FILE from audio start (default off)\n");
+     printf("  --config FILE         Read options from FILE (default: %s if present)\n", CONFIG_DEFAULT_FILE);
+     printf("  --list-devices        Print the available output devices and exit\n");
+     printf("  --build-preset-bank   Convert presets/*.synthpreset into the bank presets/presets.synthbank and exit\n");
+ }
+
+ const char *audio_backend_name(AudioBackendType backend) {
+     switch (backend) {
+         case AUDIO_BACKEND_PORTAUDIO: return "portaudio";
+         case AUDIO_BACKEND_ALSA:      return "alsa";
+         case AUDIO_BACKEND_JACK:      return "jack";
+         default:                      return "unknown";
+     }
+ }
@@ -0,0 +1,217 @@
+/**
+ * @file config.h
+ * @brief Audio stream configuration (device, sample rate, buffer size, latency).
+ *
+ * Declares the `AudioConfig` structure together with helpers that fill it from
+ * defaults, a `key: value` configuration file and the command line. The audio
+ * module reads the resulting configuration when it opens the stream.
+ */
+
+ #ifndef CONFIG_H
+ #define CONFIG_H
+
+ #include "resampler.h"
+ #include "sidechain.h"
+ #include "sampleformat.h"
+ #include "midimap.h"
+ #include "mpe.h"
+ #include "arp.h"
+ #include "midisync.h"
+
+ // --- Constants ---
+ #define CONFIG_DEFAULT_FILE "synth.conf"   ///< Loaded automatically from the working directory if present.
+ #define CONFIG_DEVICE_NAME_MAX 128         ///< Maximum length (incl. terminator) of a device name pattern.
+ #define CONFIG_MIDI_SOURCE_MAX 64          ///< Maximum length (incl. terminator) of a MIDI source address.
+ #define CONFIG_SOCKET_PATH_MAX 108         ///< Maximum length (incl. terminator) of a Unix socket path.
+ #define CONFIG_AUTOMATION_PATH_MAX 256     ///< Maximum length (incl. terminator) of an automation file path.
+ #define CONFIG_DEFAULT_SAMPLE_RATE 44100.0 ///< Sample rate used when none is configured.
+ #define CONFIG_DEFAULT_PERIODS 3           ///< Periods per hardware buffer for backends that expose them (ALSA).
+ #define CONFIG_DEFAULT_BLOCKING_LOOKAHEAD_MS 10.0 ///< Lookahead used by blocking I/O when none is configured.
+ #define CONFIG_DEFAULT_ADAPTIVE_MAX_MS 50.0 ///< Upper bound for adaptive buffering when none is configured.
+
+ /**
+  * @enum AudioBackendType
+  * @brief The driver API used to open the output stream.
+  */
+ typedef enum {
+     AUDIO_BACKEND_PORTAUDIO, ///< PortAudio callback stream (default, portable).
+     AUDIO_BACKEND_ALSA,      ///< Native ALSA mmap stream with its own real-time thread (Linux only).
+     AUDIO_BACKEND_JACK       ///< JACK client rendering in the JACK process callback.
+ } AudioBackendType;
+
+ /**
+  * @enum AudioIoMode
+  * @brief How the PortAudio backend feeds the device.
+  */
+ typedef enum {
+     AUDIO_IO_CALLBACK, ///< PortAudio calls the synth from its audio callback.
+     AUDIO_IO_BLOCKING  ///< A writer thread pushes buffers with Pa_WriteStream().
+ } AudioIoMode;
+
+ /**
+  * @struct AudioConfig
+  * @brief User-selectable parameters for opening the audio output stream.
+  *
+  * Values of 0 / -1 / empty string mean "let the audio backend decide".
+  */
+ typedef struct {
+     AudioBackendType backend;                 ///< Driver API used to open the stream.
+     int deviceIndex;                          ///< Explicit device index, or -1 to use `deviceName` / the default device.
+     char deviceName[CONFIG_DEVICE_NAME_MAX];  ///< Case-insensitive substring of the device name, or "" for the default device.
+     double sampleRate;                        ///< Stream sample rate in Hz.
+     unsigned long framesPerBuffer;            ///< Frames per callback, or 0 to let the backend choose.
+     double suggestedLatency;                  ///< Suggested output latency in seconds, or a negative value for the device's low-latency default.
+     unsigned int periods;                     ///< Periods per hardware buffer (ALSA backend only).
+     double lookaheadMs;                       ///< Audio rendered ahead by a separate render thread, 0 to render in the device callback.
+     AudioIoMode ioMode;                       ///< Callback or blocking writes (PortAudio backend only).
+     int adaptive;                             ///< If non-zero, grow/shrink the buffering from measured xruns and load.
+     double adaptiveMaxMs;                     ///< Largest buffer or lookahead the adaptive policy may select, in ms.
+     double watchdogMs;                        ///< Time without an audio block after which the stream is restarted, 0 for no watchdog.
+     double internalRate;                      ///< Fixed engine rate resampled to `sampleRate`, or 0 to render at the device rate.
+     ResamplerQuality srcQuality;              ///< Resampler quality used with `internalRate`.
+     SampleFormat sampleFormat;                ///< Device sample format; integer formats are dithered with `dither`.
+     DitherMode dither;                        ///< Dither used when converting to an integer `sampleFormat`.
+     SidechainMode inputMode;                  ///< How audio input modulates the output; anything but off opens a duplex stream.
+     int inputDeviceIndex;                     ///< PortAudio input device index, or -1 for the default input device.
+     double inputGain;                         ///< Linear gain applied to the input before it modulates the output.
+     int midiInput;                            ///< If non-zero, open an ALSA sequencer port for MIDI note/controller input.
+     char midiSource[CONFIG_MIDI_SOURCE_MAX];  ///< Sequencer client:port to connect the input from, or "" to wait for connections.
+     MidiMap midiMap;                          ///< Controller assignments; only entries flagged in `midiMapped` are set.
+     unsigned int midiMapped;                  ///< Bit per SynthParam: the configuration assigns (or unassigns) that parameter.
+     MidiClockMode midiClock;                  ///< Follow a MIDI clock received on the MIDI input, send one, or neither.
+     double mpeBendRange;                      ///< MPE member channel bend range in semitones, 0 for the monophonic MIDI mode.
+     ArpMode arpMode;                          ///< Arpeggiator pattern, ARP_OFF to play held notes directly.
+     double arpRate;                           ///< Arpeggiator steps per beat.
+     double arpGate;                           ///< Fraction of a step each arpeggiated note sounds.
+     int arpOctaves;                           ///< Octaves the arpeggio spans.
+     double tempo;                             ///< Beats per minute of the internal clock the arpeggiator and sequencer step on.
+     int sequencer;                            ///< If non-zero, loop the step pattern of the loaded preset.
+     double seqPrerenderMs;                    ///< Audio rendered ahead on top of the lookahead while only the sequencer plays, 0 for none.
+     int oscPort;                              ///< UDP port of the OSC control server on localhost, 0 for none.
+     char controlSocket[CONFIG_SOCKET_PATH_MAX]; ///< Path of the control socket, or "" for none.
+     char automationRecord[CONFIG_AUTOMATION_PATH_MAX]; ///< File parameter changes are recorded into from audio start, or "" for none.
+     char automationPlay[CONFIG_AUTOMATION_PATH_MAX];   ///< Automation file played from audio start, or "" for none (takes precedence over recording).
+     int listDevices;                          ///< If non-zero, print the available output devices and exit.
+     int buildPresetBank;                      ///< If non-zero, convert the text presets into the preset bank and exit.
+ } AudioConfig;
+
+ /**
+  * @def AUDIO_CONFIG_DEFAULTS
+  * @brief Initializer for an AudioConfig holding the built-in defaults:
+  * default device, backend-chosen buffer size, device low-latency setting.
+  */
+ #define AUDIO_CONFIG_DEFAULTS { \
+     .backend = AUDIO_BACKEND_PORTAUDIO, \
+     .deviceIndex = -1, \
+     .deviceName = "", \
+     .sampleRate = CONFIG_DEFAULT_SAMPLE_RATE, \
+     .framesPerBuffer = 0, \
+     .suggestedLatency = -1.0, \
+     .periods = CONFIG_DEFAULT_PERIODS, \
+     .lookaheadMs = 0.0, \
+     .ioMode = AUDIO_IO_CALLBACK, \
+     .adaptive = 0, \
+     .adaptiveMaxMs = CONFIG_DEFAULT_ADAPTIVE_MAX_MS, \
+     .watchdogMs = 0.0, \
+     .internalRate = 0.0, \
+     .srcQuality = RESAMPLER_QUALITY_HIGH, \
+     .sampleFormat = SAMPLE_FORMAT_FLOAT32, \
+     .dither = DITHER_TPDF, \
+     .inputMode = SIDECHAIN_OFF, \
+     .inputDeviceIndex = -1, \
+     .inputGain = 1.0, \
+     .midiInput = 0, \
+     .midiSource = "", \
+     .midiMapped = 0, \
+     .midiClock = MIDI_CLOCK_OFF, \
+     .mpeBendRange = 0.0, \
+     .arpMode = ARP_OFF, \
+     .arpRate = ARP_DEFAULT_RATE, \
+     .arpGate = ARP_DEFAULT_GATE, \
+     .arpOctaves = 1, \
+     .tempo = ARP_DEFAULT_TEMPO, \
+     .sequencer = 0, \
+     .seqPrerenderMs = 0.0, \
+     .oscPort = 0, \
+     .controlSocket = "", \
+     .automationRecord = "", \
+     .automationPlay = "", \
+     .listDevices = 0, \
+     .buildPresetBank = 0 \
+ }
+
+ /**
+  * @brief Fills an AudioConfig with the built-in defaults.
+  * @param[out] cfg The configuration to reset.
+  */
+ void audio_config_set_defaults(AudioConfig *cfg);
+
+ /**
+  * @brief Sets a single configuration value from its textual key and value.
+  *
+  * Used by both the file and command-line parsers so that they accept
+  * exactly the same set of options. Recognised keys: `backend`, `device`,
+  * `sampleRate`, `framesPerBuffer`, `latencyMs`, `periods`, `lookaheadMs`, `ioMode`,
+  * `adaptive`, `adaptiveMaxMs`, `watchdogMs`, `internalRate`, `srcQuality`, `sampleFormat`,
+  * `dither`, `input`, `inputDevice`, `inputGain`, `midiIn`, `midiMap` (may be repeated, one parameter each), `midiClock`, `mpe`,
+  * `arp`, `arpRate`, `arpGate`, `arpOctaves`, `tempo`, `sequencer`, `seqPrerenderMs`, `osc`, `control`,
+  * `automationRecord`, `automationPlay`.
+  *
+  * @param[in,out] cfg The configuration to update.
+  * @param[in] key The option name.
+  * @param[in] value The option value as text.
+  * @return 1 on success, 0 if the key is unknown or the value is invalid.
+  */
+ int audio_config_set_value(AudioConfig *cfg, const char *key, const char *value);
+
+ /**
+  * @brief Loads options from a `key: value` configuration file.
+  *
+  * Blank lines and lines starting with `#` are ignored. Unknown keys are
+  * reported as warnings and skipped; an invalid value of a known key makes
+  * the load fail.
+  *
+  * @param[in,out] cfg The configuration to update.
+  * @param[in] path Path to the configuration file.
+  * @return 1 on success, 0 if the file cannot be opened or contains invalid values.
+  */
+ int audio_config_load_file(AudioConfig *cfg, const char *path);
+
+ /**
+  * @brief Parses and removes audio options from the command line.
+  *
+  * Recognises `--backend NAME`, `--device NAME|INDEX`, `--sample-rate HZ`,
+  * `--frames N`, `--latency MS`, `--periods N`, `--lookahead MS`,
+  * `--io callback|blocking`, `--adaptive on|off`, `--adaptive-max MS`, `--watchdog MS|off`,
+  * `--internal-rate HZ|off`, `--src-quality low|medium|high`,
+  * `--format float32|int16|int24`, `--dither none|tpdf|shaped`,
+  * `--input off|ringmod|follow|vocoder`, `--input-device INDEX`, `--input-gain G`,
+  * `--midi off|on|CLIENT:PORT`, `--midi-map PARAM,CC[,MIN,MAX[,CURVE[,CHANNEL]]]|PARAM,off`, `--mpe off|on|SEMITONES`,
+  * `--arp off|up|down|updown|random|played`, `--arp-rate NOTE`, `--arp-gate G`, `--arp-octaves N`, `--tempo BPM`,
+  * `--seq on|off`, `--seq-prerender MS|off`,
+  * `--osc PORT|off`, `--control PATH|off`, `--auto-record FILE|off`, `--auto-play FILE|off`,
+  * `--config FILE`, `--list-devices` and `--build-preset-bank` (both the
+  * `--opt value` and `--opt=value` forms). Consumed arguments are removed
+  * from `argv` so the remainder can be passed on to GTK.
+  *
+  * @param[in,out] cfg The configuration to update.
+  * @param[in,out] argc Pointer to the argument count, updated on return.
+  * @param[in,out] argv The argument vector, compacted on return.
+  * @return 1 on success, 0 on an invalid or incomplete option.
+  */
+ int audio_config_parse_args(AudioConfig *cfg, int *argc, char **argv);
+
+ /**
+  * @brief Prints the supported command-line options to stdout.
+  * @param[in] prog The program name (argv[0]).
+  */
+ void audio_config_print_usage(const char *prog);
+
+ /**
+  * @brief Returns the configuration name of a backend ("portaudio", "alsa").
+  * @param backend The backend type.
+  * @return A static string, "unknown" for invalid values.
+  */
+ const char *audio_backend_name(AudioBackendType backend);
+
+ #endif // CONFIG_H
@@ -0,0 +1,236 @@
+/**
+ * @file control.c
+ * @brief Implements parsing of control socket requests and their translation into engine events.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <strings.h>
+ #include <math.h>
+
+ #include "control.h"
+
+ #define CONTROL_SEPARATORS " \t\r"
+
+ static const char *g_waveformNames[] = { "sine", "square", "saw", "triangle" };
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Parses a whole token as a number.
+  * @return 1 on success, 0 if the token is missing, not a number or not finite.
+  */
+ static int control_parse_number(const char *token, double *value) {
+     char *end;
+
+     if (token == NULL) return 0;
+     *value = strtod(token, &end);
+     return end != token && *end == '\0' && isfinite(*value);
+ }
+
+ /**
+  * @brief Looks up a set/get target by name.
+  * @return The target, or -1 if the name is unknown.
+  */
+ static int control_target_from_name(const char *name) {
+     if (name == NULL) return -1;
+     if (strcasecmp(name, "wave1") == 0) return CONTROL_TARGET_WAVE1;
+     if (strcasecmp(name, "wave2") == 0) return CONTROL_TARGET_WAVE2;
+     return midimap_param_from_name(name);
+ }
+
+ /**
+  * @brief Looks up a waveform by name or number 0-3.
+  * @return The waveform, or -1 if unknown.
+  */
+ static int control_waveform_from_name(const char *name) {
+     double number;
+
+     if (name == NULL) return -1;
+     for (int i = 0; i <= WAVE_TRIANGLE; i++) {
+         if (strcasecmp(name, g_waveformNames[i]) == 0) return i;
+     }
+     if (strcasecmp(name, "sawtooth") == 0) return WAVE_SAWTOOTH;
+     if (control_parse_number(name, &number) && number >= 0 && number <= WAVE_TRIANGLE && number == floor(number)) return (int)number;
+     return -1;
+ }
+
+ /**
+  * @brief Parses the words of one command.
+  * @param[out] reason Receives why the command is invalid.
+  * @return 1 on success, 0 if invalid.
+  */
+ static int control_parse_command(char *text, ControlCommand *cmd, const char **reason) {
+     char *save = NULL;
+     char *verb = strtok_r(text, CONTROL_SEPARATORS, &save);
+     char *arg1 = strtok_r(NULL, CONTROL_SEPARATORS, &save);
+     char *arg2 = (arg1 != NULL) ? strtok_r(NULL, CONTROL_SEPARATORS, &save) : NULL;
+     int extra = (arg2 != NULL && strtok_r(NULL, CONTROL_SEPARATORS, &save) != NULL);
+     MidiMapping range;
+     int wave;
+
+     memset(cmd, 0, sizeof(*cmd));
+     if (verb == NULL) { *reason = "empty command"; return 0; }
+
+     if (strcasecmp(verb, "set") == 0) {
+         cmd->type = CONTROL_CMD_SET;
+         if ((cmd->target = control_target_from_name(arg1)) < 0) { *reason = "unknown parameter"; return 0; }
+         if (arg2 == NULL || extra) { *reason = "usage: set PARAM VALUE"; return 0; }
+         if (cmd->target >= CONTROL_TARGET_WAVE1) {
+             if ((wave = control_waveform_from_name(arg2)) < 0) { *reason = "unknown waveform"; return 0; }
+             cmd->value = wave;
+             return 1;
+         }
+         if (!control_parse_number(arg2, &cmd->value)) { *reason = "value is not a number"; return 0; }
+         range = midimap_default((SynthParam)cmd->target, MIDI_MAP_ANY_CHANNEL, 0);
+         if (cmd->value < range.min || cmd->value > range.max) { *reason = "value out of range"; return 0; }
+         return 1;
+     }
+     if (strcasecmp(verb, "get") == 0) {
+         cmd->type = CONTROL_CMD_GET;
+         if ((cmd->target = control_target_from_name(arg1)) < 0) { *reason = "unknown parameter"; return 0; }
+         if (arg2 != NULL) { *reason = "usage: get PARAM"; return 0; }
+         return 1;
+     }
+     if (strcasecmp(verb, "on") == 0 || strcasecmp(verb, "off") == 0) {
+         double note, velocity = CONTROL_DEFAULT_VELOCITY;
+
+         cmd->type = (verb[1] == 'n' || verb[1] == 'N') ? CONTROL_CMD_NOTE_ON : CONTROL_CMD_NOTE_OFF;
+         if (!control_parse_number(arg1, &note) || note < 0 || note > 127 || note != floor(note)) {
+             *reason = "note must be 0-127"; return 0;
+         }
+         if (cmd->type == CONTROL_CMD_NOTE_OFF && arg2 != NULL) { *reason = "usage: off NOTE"; return 0; }
+         if (arg2 != NULL && (extra || !control_parse_number(arg2, &velocity) || velocity < 1 || velocity > 127)) {
+             *reason = "velocity must be 1-127"; return 0;
+         }
+         cmd->target = (int)note;
+         cmd->value = (cmd->type == CONTROL_CMD_NOTE_ON) ? floor(velocity) : 0.0;
+         return 1;
+     }
+     if (strcasecmp(verb, "preset") == 0) {
+         cmd->type = CONTROL_CMD_PRESET;
+         if (arg1 == NULL || arg2 != NULL) { *reason = "usage: preset NAME"; return 0; }
+         cmd->name = arg1;
+         return 1;
+     }
+     if (strcasecmp(verb, "stats") == 0) {
+         cmd->type = CONTROL_CMD_STATS;
+         if (arg1 != NULL) { *reason = "usage: stats"; return 0; }
+         return 1;
+     }
+     *reason = "unknown command";
+     return 0;
+ }
+
+ /** @brief Appends a parameter event. */
+ static void control_param_event(MidiEvent *ev, SynthParam param, double value) {
+     memset(ev, 0, sizeof(*ev));
+     ev->type = MIDI_EVENT_PARAM;
+     ev->data1 = (uint8_t)param;
+     ev->value = value;
+ }
+
+ /** @brief Appends a waveform event. */
+ static void control_waveform_event(MidiEvent *ev, int wave, WaveformType waveform) {
+     memset(ev, 0, sizeof(*ev));
+     ev->type = MIDI_EVENT_WAVEFORM;
+     ev->data1 = (uint8_t)wave;
+     ev->data2 = (uint8_t)waveform;
+ }
+
+
+ // --- Public Functions ---
+
+ int control_parse_frame(char *line, ControlFrame *frame, char *error, size_t error_size) {
+     char *save = NULL;
+     char *text;
+     int presets = 0;
+
+     frame->count = 0;
+     for (text = strtok_r(line, ";", &save); text != NULL; text = strtok_r(NULL, ";", &save)) {
+         const char *reason = NULL;
+         ControlCommand *cmd;
+
+         if (frame->count >= CONTROL_MAX_COMMANDS) {
+             snprintf(error, error_size, "%d too many commands", frame->count + 1);
+             return 0;
+         }
+         cmd = &frame->commands[frame->count];
+         if (!control_parse_command(text, cmd, &reason)) {
+             snprintf(error, error_size, "%d %s", frame->count + 1, reason);
+             return 0;
+         }
+         if (cmd->type == CONTROL_CMD_PRESET && ++presets > CONTROL_MAX_PRESETS) {
+             snprintf(error, error_size, "%d too many presets", frame->count + 1);
+             return 0;
+         }
+         frame->count++;
+     }
+     if (frame->count == 0) {
+         snprintf(error, error_size, "1 empty command");
+         return 0;
+     }
+     return 1;
+ }
+
+ int control_frame_to_events(const ControlFrame *frame, const PresetData *presets, MidiEvent *events, int max) {
+     int n = 0;
+
+     for (int i = 0; i < frame->count; i++) {
+         const ControlCommand *cmd = &frame->commands[i];
+         const PresetData *p;
+
+         switch (cmd->type) {
+             case CONTROL_CMD_SET:
+                 if (n + 1 > max) return -1;
+                 if (cmd->target >= CONTROL_TARGET_WAVE1) {
+                     control_waveform_event(&events[n++], cmd->target - CONTROL_TARGET_WAVE1, (WaveformType)cmd->value);
+                 } else {
+                     control_param_event(&events[n++], (SynthParam)cmd->target, cmd->value);
+                 }
+                 break;
+             case CONTROL_CMD_NOTE_ON:
+             case CONTROL_CMD_NOTE_OFF:
+                 if (n + 1 > max) return -1;
+                 memset(&events[n], 0, sizeof(events[n]));
+                 events[n].type = (cmd->type == CONTROL_CMD_NOTE_ON) ? MIDI_EVENT_NOTE_ON : MIDI_EVENT_NOTE_OFF;
+                 events[n].data1 = (uint8_t)cmd->target;
+                 events[n].data2 = (uint8_t)cmd->value;
+                 n++;
+                 break;
+             case CONTROL_CMD_PRESET:
+                 if (n + SYNTH_PARAM_COUNT + 2 > max) return -1;
+                 p = presets++;
+                 control_waveform_event(&events[n++], 0, p->waveform1);
+                 control_waveform_event(&events[n++], 1, p->waveform2);
+                 control_param_event(&events[n++], SYNTH_PARAM_FREQ1, p->frequency1);
+                 control_param_event(&events[n++], SYNTH_PARAM_AMP1, p->amplitude1);
+                 control_param_event(&events[n++], SYNTH_PARAM_ATTACK1, p->attackTime1);
+                 control_param_event(&events[n++], SYNTH_PARAM_DECAY1, p->decayTime1);
+                 control_param_event(&events[n++], SYNTH_PARAM_SUSTAIN1, p->sustainLevel1);
+                 control_param_event(&events[n++], SYNTH_PARAM_RELEASE1, p->releaseTime1);
+                 control_param_event(&events[n++], SYNTH_PARAM_FREQ2, p->frequency2);
+                 control_param_event(&events[n++], SYNTH_PARAM_AMP2, p->amplitude2);
+                 control_param_event(&events[n++], SYNTH_PARAM_ATTACK2, p->attackTime2);
+                 control_param_event(&events[n++], SYNTH_PARAM_DECAY2, p->decayTime2);
+                 control_param_event(&events[n++], SYNTH_PARAM_SUSTAIN2, p->sustainLevel2);
+                 control_param_event(&events[n++], SYNTH_PARAM_RELEASE2, p->releaseTime2);
+                 break;
+             default:
+                 break;
+         }
+     }
+     return n;
+ }
+
+ const char *control_target_name(int target) {
+     if (target == CONTROL_TARGET_WAVE1) return "wave1";
+     if (target == CONTROL_TARGET_WAVE2) return "wave2";
+     return midimap_param_name((SynthParam)target);
+ }
+
+ const char *control_waveform_name(WaveformType wave) {
+     return (wave >= WAVE_SINE && wave <= WAVE_TRIANGLE) ? g_waveformNames[wave] : "unknown";
+ }
@@ -0,0 +1,105 @@
+/**
+ * @file control.h
+ * @brief Text protocol of the control socket.
+ *
+ * Every request is one line, a frame of one or more commands separated by
+ * `;`, and gets one line back:
+ *
+ * - `set PARAM VALUE` sets a parameter (`freq1`, `amp1`, `attack1`, `decay1`,
+ *   `sustain1`, `release1` and the same with `2`) within its slider range, or
+ *   a waveform (`wave1`, `wave2`) to `sine`, `square`, `saw` or `triangle`;
+ * - `get PARAM` reads one;
+ * - `on NOTE [VELOCITY]` and `off NOTE` play notes 0-127 (velocity 1-127, default 100);
+ * - `preset NAME` loads NAME from the preset bank `presets/presets.synthbank`
+ *   if there is one and it holds NAME, else `presets/NAME.synthpreset`, or the
+ *   file NAME if it contains a `/`;
+ * - `stats` reports engine counters.
+ *
+ * The answer is `OK` followed by the results of the frame's `get` and `stats`
+ * commands in order, or `ERR N reason` if command N (from 1) is invalid; an
+ * invalid frame changes nothing. The changes of a valid frame are applied
+ * together, at the same sample of one audio block, e.g.
+ * `preset pad; set freq1 220; on 57` switches sound and plays in one step.
+ */
+
+ #ifndef CONTROL_H
+ #define CONTROL_H
+
+ #include <stddef.h>
+
+ #include "midi.h"
+ #include "midimap.h"
+ #include "synth_data.h"
+
+ // --- Constants ---
+ #define CONTROL_MAX_LINE 1024          ///< Longest request line, terminator included.
+ #define CONTROL_MAX_COMMANDS 32        ///< Commands per frame.
+ #define CONTROL_MAX_PRESETS 2          ///< `preset` commands per frame (each adds 14 events).
+ #define CONTROL_TARGET_WAVE1 SYNTH_PARAM_COUNT        ///< `set`/`get` target of the wave 1 waveform.
+ #define CONTROL_TARGET_WAVE2 (SYNTH_PARAM_COUNT + 1)  ///< `set`/`get` target of the wave 2 waveform.
+ #define CONTROL_DEFAULT_VELOCITY 100
+
+ /**
+  * @enum ControlCommandType
+  * @brief The commands of the protocol.
+  */
+ typedef enum {
+     CONTROL_CMD_SET,
+     CONTROL_CMD_GET,
+     CONTROL_CMD_NOTE_ON,
+     CONTROL_CMD_NOTE_OFF,
+     CONTROL_CMD_PRESET,
+     CONTROL_CMD_STATS
+ } ControlCommandType;
+
+ /**
+  * @struct ControlCommand
+  * @brief One parsed command.
+  */
+ typedef struct {
+     ControlCommandType type;
+     int target;          ///< SynthParam or CONTROL_TARGET_WAVE1/2 of set/get, note of on/off.
+     double value;        ///< Value of set (a WaveformType for waveforms), velocity of on.
+     const char *name;    ///< Preset name or path (points into the parsed line).
+ } ControlCommand;
+
+ /**
+  * @struct ControlFrame
+  * @brief The commands of one request line.
+  */
+ typedef struct {
+     int count;
+     ControlCommand commands[CONTROL_MAX_COMMANDS];
+ } ControlFrame;
+
+ /**
+  * @brief Parses a request line.
+  * @param[in,out] line The line without its newline; split in place, so it must outlive `frame`.
+  * @param[out] frame Receives the commands.
+  * @param[out] error Receives `N reason` on failure.
+  * @param error_size Size of `error`.
+  * @return 1 on success, 0 if a command is invalid.
+  */
+ int control_parse_frame(char *line, ControlFrame *frame, char *error, size_t error_size);
+
+ /**
+  * @brief Translates the commands of a frame that change the engine into events.
+  * @param[in] frame The frame.
+  * @param[in] presets The preset of each `preset` command, in frame order.
+  * @param[out] events Receives the events in frame order (`frame` left for the caller).
+  * @param max Room in `events`.
+  * @return The number of events, or -1 if they do not fit.
+  */
+ int control_frame_to_events(const ControlFrame *frame, const PresetData *presets, MidiEvent *events, int max);
+
+ /**
+  * @brief Returns the protocol name of a set/get target ("freq1", "wave2", ...).
+  */
+ const char *control_target_name(int target);
+
+ /**
+  * @brief Returns the protocol name of a waveform ("sine", "square", "saw", "triangle").
+  */
+ const char *control_waveform_name(WaveformType wave);
+
+ #endif // CONTROL_H
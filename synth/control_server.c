@@ -0,0 +1,385 @@
+/**
+ * @file control_server.c
+ * @brief Event-loop thread serving the control socket.
+ *
+ * One thread polls the listening socket, the clients and a stop pipe. Each
+ * client's bytes are collected until a newline; the line is parsed, presets
+ * are read (from the preset bank if there is one, else from their files) and
+ * the frame's events are queued as one batch, all on this thread, which runs at normal priority: a slow preset file delays the
+ * answer, never the audio.
+ */
+
+ #include <pthread.h>
+ #include <poll.h>
+ #include <stdio.h>
+ #include <stdarg.h>
+ #include <string.h>
+ #include <errno.h>
+ #include <unistd.h>
+ #include <stdatomic.h>
+ #include <sys/socket.h>
+ #include <sys/stat.h>
+ #include <sys/un.h>
+
+ #include "control_server.h"
+ #include "control.h"
+ #include "preset_file.h"
+ #include "presetbank.h"
+ #include "audio.h"
+ #include "audio_internal.h"
+
+ // --- Constants ---
+ #define CONTROL_MAX_REPLY 4096   ///< Longest answer line.
+
+ /**
+  * @struct ControlClient
+  * @brief A connection and its partial request line.
+  */
+ typedef struct {
+     int fd;                          ///< -1 for a free slot.
+     size_t len;                      ///< Bytes in `line`.
+     char line[CONTROL_MAX_LINE];
+ } ControlClient;
+
+ /**
+  * @struct ControlServer
+  * @brief State of the server. Only one instance exists.
+  */
+ typedef struct {
+     int sock;                        ///< Listening socket, -1 when stopped.
+     char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+     SharedSynthData *data;
+     pthread_t thread;
+     int thread_started;
+     int stop_pipe[2];                ///< Wakes the thread out of poll() on stop.
+     ControlClient clients[CONTROL_MAX_CLIENTS];
+     PresetBank bank;                 ///< The preset bank if one was found at start, read by the thread.
+     atomic_ulong accepted;
+     atomic_ulong frames;
+     atomic_ulong errors;
+ } ControlServer;
+
+ static ControlServer g_control = { .sock = -1, .stop_pipe = { -1, -1 } };
+
+
+ // --- Helper Functions ---
+
+ /** @brief Appends formatted text to a reply, truncating at its end. */
+ static void control_reply_append(char *reply, size_t *len, const char *fmt, ...) {
+     va_list ap;
+     int n;
+
+     if (*len >= CONTROL_MAX_REPLY) return;
+     va_start(ap, fmt);
+     n = vsnprintf(reply + *len, CONTROL_MAX_REPLY - *len, fmt, ap);
+     va_end(ap);
+     if (n > 0) *len = (*len + (size_t)n < CONTROL_MAX_REPLY) ? *len + (size_t)n : CONTROL_MAX_REPLY - 1;
+ }
+
+ /**
+  * @brief Resolves a preset name: a path if it contains '/', else a file of PRESET_DIR.
+  */
+ static void control_preset_path(const char *name, char *path, size_t size) {
+     size_t len = strlen(name), suffix = strlen(PRESET_SUFFIX);
+     int has_suffix = (len >= suffix && strcmp(name + len - suffix, PRESET_SUFFIX) == 0);
+
+     if (strchr(name, '/') != NULL) snprintf(path, size, "%s", name);
+     else snprintf(path, size, "%s/%s%s", PRESET_DIR, name, has_suffix ? "" : PRESET_SUFFIX);
+ }
+
+ /**
+  * @brief Reads a preset by name: from the bank if it holds the name, else from its file.
+  * @return 1 on success, 0 if it cannot be read.
+  */
+ static int control_read_preset(ControlServer *srv, const char *name, PresetData *preset) {
+     size_t len = strlen(name), suffix = strlen(PRESET_SUFFIX);
+     char path[512];
+     long index = -1;
+
+     if (strchr(name, '/') == NULL && presetbank_count(&srv->bank) > 0) {
+         // The bank names presets without the suffix
+         if (len >= suffix && strcmp(name + len - suffix, PRESET_SUFFIX) == 0) len -= suffix;
+         snprintf(path, sizeof(path), "%.*s", (int)len, name);
+         index = presetbank_find(&srv->bank, path);
+     }
+     if (index >= 0) return presetbank_get(&srv->bank, (size_t)index, preset, NULL);
+     control_preset_path(name, path, sizeof(path));
+     return preset_file_read(path, preset);
+ }
+
+ /**
+  * @brief Executes a request line and writes the answer (without newline) to `reply`.
+  * @return 1 for an OK answer, 0 for ERR.
+  */
+ static int control_execute(ControlServer *srv, char *line, char *reply) {
+     ControlFrame frame;
+     PresetData presets[CONTROL_MAX_PRESETS];
+     MidiEvent events[AUDIO_CONTROL_BATCH_MAX];
+     double values[SYNTH_PARAM_COUNT];
+     WaveformType waves[2];
+     char error[128];
+     size_t len = 0;
+     int count, presets_read = 0, have_values = 0;
+
+     if (!control_parse_frame(line, &frame, error, sizeof(error))) {
+         snprintf(reply, CONTROL_MAX_REPLY, "ERR %s", error);
+         return 0;
+     }
+     // Everything that can fail happens before the first change is queued
+     for (int i = 0; i < frame.count; i++) {
+         if (frame.commands[i].type == CONTROL_CMD_PRESET) {
+             if (!control_read_preset(srv, frame.commands[i].name, &presets[presets_read++])) {
+                 snprintf(reply, CONTROL_MAX_REPLY, "ERR %d cannot read preset", i + 1);
+                 return 0;
+             }
+         } else if (frame.commands[i].type == CONTROL_CMD_GET && !have_values) {
+             // Reads see the state before this frame's changes
+             if (!audio_get_params(srv->data, values, waves)) {
+                 snprintf(reply, CONTROL_MAX_REPLY, "ERR %d parameters unavailable", i + 1);
+                 return 0;
+             }
+             have_values = 1;
+         }
+     }
+     count = control_frame_to_events(&frame, presets, events, AUDIO_CONTROL_BATCH_MAX);
+     if (count < 0) {
+         snprintf(reply, CONTROL_MAX_REPLY, "ERR 0 frame has too many changes");
+         return 0;
+     }
+     if (!audio_control_batch(events, (unsigned int)count, audio_time_now())) {
+         snprintf(reply, CONTROL_MAX_REPLY, "ERR 0 event queue full");
+         return 0;
+     }
+
+     control_reply_append(reply, &len, "OK");
+     for (int i = 0; i < frame.count; i++) {
+         const ControlCommand *cmd = &frame.commands[i];
+
+         if (cmd->type == CONTROL_CMD_GET) {
+             if (cmd->target >= CONTROL_TARGET_WAVE1) {
+                 control_reply_append(reply, &len, " %s", control_waveform_name(waves[cmd->target - CONTROL_TARGET_WAVE1]));
+             } else {
+                 control_reply_append(reply, &len, " %.6g", values[cmd->target]);
+             }
+         } else if (cmd->type == CONTROL_CMD_STATS) {
+             AudioStats st;
+             audio_get_stats(&st);
+             control_reply_append(reply, &len, " backend=%s blocks=%llu xruns=%lu load=%.3f events=%lu late=%lu dropped=%lu",
+                                  st.backend, st.callbacks, st.xruns, st.cpuLoad,
+                                  st.midiEvents, st.midiLateEvents, st.midiDroppedEvents);
+         }
+     }
+     return 1;
+ }
+
+ /** @brief Closes a client's connection and frees its slot. */
+ static void control_client_close(ControlClient *c) {
+     close(c->fd);
+     c->fd = -1;
+     c->len = 0;
+ }
+
+ /** @brief Sends a whole answer line. @return 1 on success, 0 if the client is gone or does not read. */
+ static int control_client_send(ControlClient *c, const char *reply) {
+     size_t len = strlen(reply);
+     char buffer[CONTROL_MAX_REPLY + 1];
+
+     memcpy(buffer, reply, len);
+     buffer[len++] = '\n';
+     // Answers are short; a client that lets its socket buffer fill up is dropped rather than waited for
+     return send(c->fd, buffer, len, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)len;
+ }
+
+ /**
+  * @brief Reads what a client sent and answers its complete lines.
+  * @return 0 if the client has to be closed.
+  */
+ static int control_client_read(ControlServer *srv, ControlClient *c) {
+     char reply[CONTROL_MAX_REPLY];
+     ssize_t n = recv(c->fd, c->line + c->len, sizeof(c->line) - c->len, MSG_DONTWAIT);
+     char *start, *nl;
+
+     if (n == 0) return 0;
+     if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+     c->len += (size_t)n;
+
+     start = c->line;
+     while ((nl = memchr(start, '\n', c->len - (size_t)(start - c->line))) != NULL) {
+         int ok;
+
+         *nl = '\0';
+         ok = control_execute(srv, start, reply);
+         atomic_fetch_add_explicit(ok ? &srv->frames : &srv->errors, 1, memory_order_relaxed);
+         if (!control_client_send(c, reply)) return 0;
+         start = nl + 1;
+     }
+     c->len -= (size_t)(start - c->line);
+     memmove(c->line, start, c->len);
+     if (c->len == sizeof(c->line)) {
+         atomic_fetch_add_explicit(&srv->errors, 1, memory_order_relaxed);
+         control_client_send(c, "ERR 0 line too long");
+         return 0;
+     }
+     return 1;
+ }
+
+ /** @brief Accepts a pending connection into a free slot, or refuses it. */
+ static void control_accept(ControlServer *srv) {
+     int fd = accept(srv->sock, NULL, NULL);
+
+     if (fd < 0) return;
+     for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+         if (srv->clients[i].fd < 0) {
+             srv->clients[i].fd = fd;
+             srv->clients[i].len = 0;
+             atomic_fetch_add_explicit(&srv->accepted, 1, memory_order_relaxed);
+             return;
+         }
+     }
+     send(fd, "ERR 0 too many clients\n", 23, MSG_DONTWAIT | MSG_NOSIGNAL);
+     close(fd);
+ }
+
+ /**
+  * @brief Event loop: waits in poll() for connections, requests and the stop pipe.
+  */
+ static void *control_server_thread_main(void *arg) {
+     ControlServer *srv = (ControlServer *)arg;
+     struct pollfd pfds[2 + CONTROL_MAX_CLIENTS];
+     int slots[CONTROL_MAX_CLIENTS];
+
+     for (;;) {
+         int n = 2;
+
+         pfds[0] = (struct pollfd){ .fd = srv->stop_pipe[0], .events = POLLIN };
+         pfds[1] = (struct pollfd){ .fd = srv->sock, .events = POLLIN };
+         for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+             if (srv->clients[i].fd < 0) continue;
+             slots[n - 2] = i;
+             pfds[n++] = (struct pollfd){ .fd = srv->clients[i].fd, .events = POLLIN };
+         }
+         if (poll(pfds, (nfds_t)n, -1) < 0) {
+             if (errno == EINTR) continue;
+             fprintf(stderr, "Control Error: poll: %s\n", strerror(errno));
+             break;
+         }
+         if (pfds[0].revents & POLLIN) break; // Stop requested
+         for (int i = 2; i < n; i++) {
+             ControlClient *c = &srv->clients[slots[i - 2]];
+             if (pfds[i].revents == 0) continue;
+             if (!control_client_read(srv, c)) control_client_close(c);
+         }
+         if (pfds[1].revents & POLLIN) control_accept(srv);
+     }
+     return NULL;
+ }
+
+ /**
+  * @brief Releases everything owned by the server state.
+  */
+ static void control_server_release(ControlServer *srv) {
+     for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+         if (srv->clients[i].fd >= 0) control_client_close(&srv->clients[i]);
+     }
+     if (srv->sock >= 0) {
+         close(srv->sock);
+         srv->sock = -1;
+         unlink(srv->path);
+     }
+     if (srv->stop_pipe[0] >= 0) { close(srv->stop_pipe[0]); srv->stop_pipe[0] = -1; }
+     if (srv->stop_pipe[1] >= 0) { close(srv->stop_pipe[1]); srv->stop_pipe[1] = -1; }
+     presetbank_close(&srv->bank);
+     srv->thread_started = 0;
+ }
+
+
+ // --- Public Functions ---
+
+ int control_server_start(const char *path, SharedSynthData *data) {
+     ControlServer *srv = &g_control;
+     struct sockaddr_un addr;
+     struct stat st;
+     int err;
+
+     if (srv->sock >= 0) return 1;
+     if (path == NULL || path[0] == '\0' || strlen(path) >= sizeof(addr.sun_path)) {
+         fprintf(stderr, "Control Error: invalid socket path\n");
+         return 0;
+     }
+     // Replace the socket of a previous run, but never another kind of file
+     if (lstat(path, &st) == 0) {
+         if (!S_ISSOCK(st.st_mode)) {
+             fprintf(stderr, "Control Error: %s exists and is not a socket\n", path);
+             return 0;
+         }
+         unlink(path);
+     }
+
+     for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) srv->clients[i].fd = -1;
+     srv->data = data;
+     snprintf(srv->path, sizeof(srv->path), "%s", path);
+     srv->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+     if (srv->sock < 0) {
+         fprintf(stderr, "Control Error: cannot create socket: %s\n", strerror(errno));
+         return 0;
+     }
+     memset(&addr, 0, sizeof(addr));
+     addr.sun_family = AF_UNIX;
+     memcpy(addr.sun_path, path, strlen(path) + 1);
+     if (bind(srv->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+         fprintf(stderr, "Control Error: cannot bind %s: %s\n", path, strerror(errno));
+         close(srv->sock);
+         srv->sock = -1;
+         return 0;
+     }
+     if (chmod(path, S_IRUSR | S_IWUSR) != 0 || listen(srv->sock, CONTROL_MAX_CLIENTS) != 0) {
+         fprintf(stderr, "Control Error: cannot listen on %s: %s\n", path, strerror(errno));
+         control_server_release(srv);
+         return 0;
+     }
+     if (pipe(srv->stop_pipe) != 0) {
+         fprintf(stderr, "Control Error: cannot create stop pipe: %s\n", strerror(errno));
+         control_server_release(srv);
+         return 0;
+     }
+
+     if (access(PRESETBANK_FILE, R_OK) == 0 && presetbank_open(&srv->bank, PRESETBANK_FILE)) {
+         printf("Control socket reads presets from %s (%zu presets)\n", PRESETBANK_FILE, presetbank_count(&srv->bank));
+     }
+     atomic_store(&srv->accepted, 0);
+     atomic_store(&srv->frames, 0);
+     atomic_store(&srv->errors, 0);
+     err = pthread_create(&srv->thread, NULL, control_server_thread_main, srv);
+     if (err != 0) {
+         fprintf(stderr, "Control Error: cannot create server thread: %s\n", strerror(err));
+         control_server_release(srv);
+         return 0;
+     }
+     srv->thread_started = 1;
+     printf("Control socket listening on %s\n", srv->path);
+     return 1;
+ }
+
+ void control_server_stop(void) {
+     ControlServer *srv = &g_control;
+     ControlServerStats st;
+
+     if (srv->sock < 0) return;
+
+     if (srv->thread_started) {
+         char c = 0;
+         if (write(srv->stop_pipe[1], &c, 1) < 0) {
+             fprintf(stderr, "Warning: cannot wake control thread: %s\n", strerror(errno));
+         }
+         pthread_join(srv->thread, NULL);
+     }
+     control_server_release(srv);
+     control_server_get_stats(&st);
+     printf("Control socket closed (%lu requests, %lu errors).\n", st.frames + st.errors, st.errors);
+ }
+
+ void control_server_get_stats(ControlServerStats *stats) {
+     stats->clients = atomic_load_explicit(&g_control.accepted, memory_order_relaxed);
+     stats->frames = atomic_load_explicit(&g_control.frames, memory_order_relaxed);
+     stats->errors = atomic_load_explicit(&g_control.errors, memory_order_relaxed);
+ }
@@ -0,0 +1,51 @@
+/**
+ * @file control_server.h
+ * @brief Control socket: scripting the synth over a Unix domain socket.
+ *
+ * An event-loop thread accepts any number of local clients and answers
+ * their request lines (see control.h for the protocol). Changes go to the
+ * engine with audio_control_batch() and parameters are read with
+ * audio_get_params(), so the thread never takes a lock the audio thread waits on.
+ */
+
+ #ifndef CONTROL_SERVER_H
+ #define CONTROL_SERVER_H
+
+ #include "synth_data.h"
+
+ // --- Constants ---
+ #define CONTROL_MAX_CLIENTS 16   ///< Connections served at once; further ones are refused.
+
+ /**
+  * @struct ControlServerStats
+  * @brief Counters of the running (or last) server.
+  */
+ typedef struct {
+     unsigned long clients;   ///< Connections accepted.
+     unsigned long frames;    ///< Request lines answered with OK.
+     unsigned long errors;    ///< Request lines answered with ERR.
+ } ControlServerStats;
+
+ /**
+  * @brief Creates the socket and starts the event-loop thread.
+  *
+  * A stale socket file left at `path` by a previous run is replaced; the new
+  * socket is only accessible to the user running the synth.
+  *
+  * @param[in] path File system path of the socket.
+  * @param[in] data The shared synthesizer data, read when no audio block renders.
+  * @return 1 on success (or if already running), 0 if the socket or the thread cannot be created.
+  */
+ int control_server_start(const char *path, SharedSynthData *data);
+
+ /**
+  * @brief Stops the thread, disconnects the clients and removes the socket file. Safe to call when not running.
+  */
+ void control_server_stop(void);
+
+ /**
+  * @brief Copies the counters. Callable from any thread.
+  */
+ void control_server_get_stats(ControlServerStats *stats);
+
+ #endif // CONTROL_SERVER_H
@@ -26,12 +26,12 @@
  #include "gui.h"
  #include "synth_data.h"
  #include "presets.h" 
+ #include "midimap.h"
 
  // --- External Global Shared Data Instance ---
  extern SharedSynthData g_synth_data;
  
  // --- Constants ---
- #define PRESET_DIR "presets"
  #define FREQ_MIN 20.0
  #define FREQ_MAX 2000.0
  static const double LOG_FREQ_BASE_RATIO = FREQ_MAX / FREQ_MIN;
@@ -39,6 +39,28 @@
  // --- Static Global Widgets ---
  static GtkWidget *freq_value_label1 = NULL;
  static GtkWidget *freq_value_label2 = NULL;
+ static GtkWidget *audio_device_combo = NULL;
+
+ // --- Audio Device Selection State ---
+ static GuiAudioSwitchFn audio_switch_handler = NULL;
+ /** @brief Id of the entry the stream currently runs on, restored when a switch fails. */
+ static gchar *audio_device_active_id = NULL;
+
+ // --- MIDI Learn State ---
+ static GuiMidiLearnFn midi_learn_handler = NULL;
+ static GuiMidiPollFn midi_poll_handler = NULL;
+ static GtkWidget *midi_param_combo = NULL;
+ static GtkWidget *midi_learn_button = NULL;
+ static GtkWidget *midi_learn_status = NULL;
+ static guint midi_poll_source = 0;
+ /** @brief Last value of the poll handler's counter, to refresh the sliders only when it moved. */
+ static unsigned long midi_param_updates = 0;
+
+ // --- Computer Keyboard State ---
+ static GuiKeyNoteFn key_note_handler = NULL;
+ static int key_base_note = GUI_KEY_BASE_NOTE;
+ /** @brief Note each physical key (by hardware keycode) is holding, -1 if none; releases what was pressed even after an octave change. */
+ static int key_held_notes[256];
  
  // --- Error Handling Macros ---
  #define CHECK_PTHREAD_ERR(ret, func_name) \
@@ -71,6 +93,14 @@
  static void on_note_on_button_toggled_wave2(GtkToggleButton *button, gpointer user_data);
  static void on_save_preset_clicked(GtkButton *button, gpointer user_data);
  static void on_preset_combo_changed(GtkComboBox *widget, gpointer user_data);
+ static void on_preset_loaded(const char *entry);
+ static void on_audio_device_changed(GtkComboBox *widget, gpointer user_data);
+ static void on_restart_audio_clicked(GtkButton *button, gpointer user_data);
+ static void on_midi_learn_toggled(GtkToggleButton *button, gpointer user_data);
+ static gboolean on_midi_poll_timeout(gpointer user_data);
+ static gboolean on_key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer user_data);
+ static gboolean on_key_release_event(GtkWidget *widget, GdkEventKey *event, gpointer user_data);
+ static gboolean on_focus_out_event(GtkWidget *widget, GdkEventFocus *event, gpointer user_data);
  static gboolean on_draw_event(GtkWidget *widget, cairo_t *cr, gpointer user_data);
  static void cleanup_on_destroy();
  static void update_gui_from_data();
@@ -82,6 +112,10 @@
  static 
  #endif
  double calculate_current_envelope_wave2(const SharedSynthData *data);
+ #ifndef TESTING
+ static
+ #endif
+ int gui_key_to_note(guint keyval, int base_note);
  static inline double linear_to_log_freq(double linear_value);
  static inline double log_freq_to_linear(double freq);
  
@@ -120,12 +154,22 @@
      GtkWidget *preset_combo_label;
      GtkWidget *preset_combo;
      GtkWidget *freq_hbox1, *freq_hbox2;
+     GtkWidget *audio_hbox, *audio_device_label, *restart_audio_button;
+     GtkWidget *midi_hbox, *midi_label;
  
      window = gtk_application_window_new(app);
      CHECK_GTK_WIDGET(window, "GtkApplicationWindow");
      gtk_window_set_title(GTK_WINDOW(window), "C Synth - Dual Wave");
      gtk_window_fullscreen(GTK_WINDOW(window));
      g_signal_connect(window, "destroy", G_CALLBACK(cleanup_on_destroy), NULL);
+     if (key_note_handler != NULL) {
+         // Connected to the window, so the keys play notes before any focused widget sees them
+         for (int i = 0; i < G_N_ELEMENTS(key_held_notes); i++) key_held_notes[i] = -1;
+         gtk_widget_add_events(window, GDK_KEY_PRESS_MASK | GDK_KEY_RELEASE_MASK | GDK_FOCUS_CHANGE_MASK);
+         g_signal_connect(window, "key-press-event", G_CALLBACK(on_key_press_event), NULL);
+         g_signal_connect(window, "key-release-event", G_CALLBACK(on_key_release_event), NULL);
+         g_signal_connect(window, "focus-out-event", G_CALLBACK(on_focus_out_event), NULL);
+     }
  
      main_vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 3);
      CHECK_GTK_WIDGET(main_vbox, "main_vbox");
@@ -241,7 +285,54 @@
      gtk_widget_set_hexpand(preset_combo, TRUE); // Combo box expands horizontally
      gtk_box_pack_start(GTK_BOX(preset_hbox), preset_combo, TRUE, TRUE, 5);
      populate_preset_combo(GTK_COMBO_BOX_TEXT(preset_combo));
+     watch_preset_dir(GTK_COMBO_BOX_TEXT(preset_combo));
      g_signal_connect(preset_combo, "changed", G_CALLBACK(on_preset_combo_changed), window);
+     presets_set_loaded_handler(on_preset_loaded);
+
+     // --- Audio Device Controls ---
+     if (audio_switch_handler != NULL) {
+         audio_hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+         CHECK_GTK_WIDGET(audio_hbox, "audio_hbox");
+         gtk_box_pack_start(GTK_BOX(main_vbox), audio_hbox, FALSE, FALSE, 5);
+         audio_device_label = gtk_label_new("Audio Device:");
+         CHECK_GTK_WIDGET(audio_device_label, "audio_device_label");
+         gtk_box_pack_start(GTK_BOX(audio_hbox), audio_device_label, FALSE, FALSE, 5);
+         audio_device_combo = gtk_combo_box_text_new();
+         CHECK_GTK_WIDGET(audio_device_combo, "audio_device_combo");
+         gtk_widget_set_hexpand(audio_device_combo, TRUE);
+         gtk_box_pack_start(GTK_BOX(audio_hbox), audio_device_combo, TRUE, TRUE, 5);
+         g_signal_connect(audio_device_combo, "changed", G_CALLBACK(on_audio_device_changed), window);
+         restart_audio_button = gtk_button_new_with_label("Restart Audio");
+         CHECK_GTK_WIDGET(restart_audio_button, "restart_audio_button");
+         gtk_box_pack_start(GTK_BOX(audio_hbox), restart_audio_button, FALSE, FALSE, 5);
+         g_signal_connect(restart_audio_button, "clicked", G_CALLBACK(on_restart_audio_clicked), window);
+     }
+
+     // --- MIDI Learn Controls ---
+     if (midi_learn_handler != NULL && midi_poll_handler != NULL) {
+         midi_hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+         CHECK_GTK_WIDGET(midi_hbox, "midi_hbox");
+         gtk_box_pack_start(GTK_BOX(main_vbox), midi_hbox, FALSE, FALSE, 5);
+         midi_label = gtk_label_new("MIDI Learn:");
+         CHECK_GTK_WIDGET(midi_label, "midi_label");
+         gtk_box_pack_start(GTK_BOX(midi_hbox), midi_label, FALSE, FALSE, 5);
+         midi_param_combo = gtk_combo_box_text_new();
+         CHECK_GTK_WIDGET(midi_param_combo, "midi_param_combo");
+         for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+             gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(midi_param_combo), midimap_param_name((SynthParam)i));
+         }
+         gtk_combo_box_set_active(GTK_COMBO_BOX(midi_param_combo), 0);
+         gtk_box_pack_start(GTK_BOX(midi_hbox), midi_param_combo, FALSE, FALSE, 5);
+         midi_learn_button = gtk_toggle_button_new_with_label("Learn");
+         CHECK_GTK_WIDGET(midi_learn_button, "midi_learn_button");
+         gtk_box_pack_start(GTK_BOX(midi_hbox), midi_learn_button, FALSE, FALSE, 5);
+         g_signal_connect(midi_learn_button, "toggled", G_CALLBACK(on_midi_learn_toggled), NULL);
+         midi_learn_status = gtk_label_new("");
+         CHECK_GTK_WIDGET(midi_learn_status, "midi_learn_status");
+         gtk_box_pack_start(GTK_BOX(midi_hbox), midi_learn_status, FALSE, FALSE, 5);
+         midi_param_updates = midi_poll_handler(NULL);
+         midi_poll_source = g_timeout_add(GUI_MIDI_POLL_MS, on_midi_poll_timeout, NULL);
+     }
  
  
      // --- Waveform Drawing Area ---
@@ -402,30 +493,225 @@
      int success = 0;
  
      if (selected_preset_filename != NULL && strcmp(selected_preset_filename, "Select Preset...") != 0) {
-         char *full_path = g_build_filename(PRESET_DIR, selected_preset_filename, NULL);
-         if (full_path) {
-              printf("GUI: Attempting to load preset: %s\n", full_path);
-              success = handle_load_preset_from_file(full_path, parent_window);
-              if (success) {
-                  update_gui_from_data();
-                  printf("GUI: Preset loaded and GUI updated.\n");
-              } else {
-                  printf("GUI: Preset loading failed.\n");
-              }
-              g_free(full_path);
-         } else {
-             fprintf(stderr, "Error building full path for preset '%s'.\n", selected_preset_filename);
-              GtkWidget *err_dialog = gtk_message_dialog_new(parent_window, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Internal error building path for preset.");
-              gtk_dialog_run(GTK_DIALOG(err_dialog));
-              gtk_widget_destroy(err_dialog);
-         }
+         printf("GUI: Attempting to load preset: %s\n", selected_preset_filename);
+         // Applied now or once the loader thread read it, see on_preset_loaded()
+         success = handle_load_preset(selected_preset_filename, parent_window);
+         if (!success) printf("GUI: Preset loading failed.\n");
      } else {
          printf("GUI: Placeholder or NULL selected in preset combo.\n");
      }
      g_free(selected_preset_filename);
  }
+
+ static void on_preset_loaded(const char *entry) {
+     update_gui_from_data();
+     printf("GUI: Preset '%s' loaded and GUI updated.\n", entry);
+ }
  
  
+ // ==================== AUDIO DEVICE SELECTION ====================
+ void gui_set_audio_switch_handler(GuiAudioSwitchFn handler) {
+     audio_switch_handler = handler;
+ }
+
+ /**
+  * @brief Blocks (or unblocks) the selector's "changed" handler while the GUI itself changes it.
+  */
+ static void block_audio_device_signal(gboolean block) {
+     if (block) g_signal_handlers_block_matched(audio_device_combo, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, (gpointer)on_audio_device_changed, NULL);
+     else g_signal_handlers_unblock_matched(audio_device_combo, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, (gpointer)on_audio_device_changed, NULL);
+ }
+
+ /**
+  * @brief Shows entry `id` as the running device without triggering a switch.
+  */
+ static void show_active_audio_device(const gchar *id) {
+     block_audio_device_signal(TRUE);
+     gtk_combo_box_set_active_id(GTK_COMBO_BOX(audio_device_combo), id);
+     block_audio_device_signal(FALSE);
+     if (id != audio_device_active_id) {
+         g_free(audio_device_active_id); audio_device_active_id = g_strdup(id);
+     }
+ }
+
+ void gui_clear_audio_devices(void) {
+     if (audio_device_combo == NULL) return;
+     block_audio_device_signal(TRUE);
+     gtk_combo_box_text_remove_all(GTK_COMBO_BOX_TEXT(audio_device_combo));
+     block_audio_device_signal(FALSE);
+     g_free(audio_device_active_id); audio_device_active_id = NULL;
+ }
+
+ void gui_add_audio_device(int device_index, const char *name, int active) {
+     gchar id[16];
+     if (audio_device_combo == NULL) return;
+     g_snprintf(id, sizeof(id), "%d", device_index);
+     gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(audio_device_combo), id, name);
+     if (active) show_active_audio_device(id);
+ }
+
+ /**
+  * @brief Calls the switch handler and reports a failure in a dialog.
+  * @return 1 on success, 0 on failure.
+  */
+ static int switch_audio_device(GtkWindow *parent_window, int device_index) {
+     if (audio_switch_handler(device_index)) return 1;
+
+     GtkWidget *err_dialog = gtk_message_dialog_new(parent_window, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Could not open the selected audio device.\nThe previous device is used again.");
+     gtk_dialog_run(GTK_DIALOG(err_dialog));
+     gtk_widget_destroy(err_dialog);
+     return 0;
+ }
+
+ static void on_audio_device_changed(GtkComboBox *widget, gpointer user_data) {
+     const gchar *id = gtk_combo_box_get_active_id(widget);
+     if (id == NULL || audio_switch_handler == NULL) return;
+
+     printf("GUI: Switching audio output to device %s\n", id);
+     if (switch_audio_device(GTK_WINDOW(user_data), atoi(id))) {
+         g_free(audio_device_active_id); audio_device_active_id = g_strdup(id);
+     } else if (audio_device_active_id != NULL) {
+         show_active_audio_device(audio_device_active_id);
+     }
+ }
+
+ static void on_restart_audio_clicked(GtkButton *button, gpointer user_data) {
+     if (audio_switch_handler == NULL) return;
+     printf("GUI: Restarting audio\n");
+     switch_audio_device(GTK_WINDOW(user_data), audio_device_active_id ? atoi(audio_device_active_id) : GUI_AUDIO_DEVICE_CURRENT);
+ }
+
+
+ // ==================== MIDI LEARN ====================
+ void gui_set_midi_handlers(GuiMidiLearnFn learn, GuiMidiPollFn poll) {
+     midi_learn_handler = learn;
+     midi_poll_handler = poll;
+ }
+
+ static void on_midi_learn_toggled(GtkToggleButton *button, gpointer user_data) {
+     int param = gtk_combo_box_get_active(GTK_COMBO_BOX(midi_param_combo));
+
+     if (gtk_toggle_button_get_active(button) && param >= 0) {
+         midi_learn_handler(param);
+         gtk_label_set_text(GTK_LABEL(midi_learn_status), "Move a controller...");
+     } else {
+         midi_learn_handler(-1);
+         gtk_label_set_text(GTK_LABEL(midi_learn_status), "");
+     }
+ }
+
+ /**
+  * @brief Refreshes the sliders after controller changes and ends a completed learn.
+  *
+  * Runs every GUI_MIDI_POLL_MS, so a controller sending hundreds of messages
+  * per second redraws the GUI at the poll rate at most.
+  */
+ static gboolean on_midi_poll_timeout(gpointer user_data) {
+     int learning = -1;
+     unsigned long updates = midi_poll_handler(&learning);
+
+     if (updates != midi_param_updates) {
+         midi_param_updates = updates;
+         update_gui_from_data();
+     }
+     if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(midi_learn_button)) && learning < 0) {
+         g_signal_handlers_block_matched(midi_learn_button, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, (gpointer)on_midi_learn_toggled, NULL);
+         gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(midi_learn_button), FALSE);
+         g_signal_handlers_unblock_matched(midi_learn_button, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, (gpointer)on_midi_learn_toggled, NULL);
+         gtk_label_set_text(GTK_LABEL(midi_learn_status), "Mapped");
+     }
+     return G_SOURCE_CONTINUE;
+ }
+
+
+ // ==================== COMPUTER KEYBOARD ====================
+ void gui_set_key_handler(GuiKeyNoteFn handler) {
+     key_note_handler = handler;
+ }
+
+ #ifndef TESTING
+ static
+ #endif
+ int gui_key_to_note(guint keyval, int base_note) {
+     // Semitones above the `z` key: the lower row from C, the upper row an octave up
+     static const struct { guint keyval; int offset; } keys[] = {
+         { GDK_KEY_z, 0 }, { GDK_KEY_s, 1 }, { GDK_KEY_x, 2 }, { GDK_KEY_d, 3 }, { GDK_KEY_c, 4 },
+         { GDK_KEY_v, 5 }, { GDK_KEY_g, 6 }, { GDK_KEY_b, 7 }, { GDK_KEY_h, 8 }, { GDK_KEY_n, 9 },
+         { GDK_KEY_j, 10 }, { GDK_KEY_m, 11 }, { GDK_KEY_comma, 12 }, { GDK_KEY_l, 13 },
+         { GDK_KEY_period, 14 }, { GDK_KEY_semicolon, 15 }, { GDK_KEY_slash, 16 },
+         { GDK_KEY_q, 12 }, { GDK_KEY_2, 13 }, { GDK_KEY_w, 14 }, { GDK_KEY_3, 15 }, { GDK_KEY_e, 16 },
+         { GDK_KEY_r, 17 }, { GDK_KEY_5, 18 }, { GDK_KEY_t, 19 }, { GDK_KEY_6, 20 }, { GDK_KEY_y, 21 },
+         { GDK_KEY_7, 22 }, { GDK_KEY_u, 23 }, { GDK_KEY_i, 24 }, { GDK_KEY_9, 25 }, { GDK_KEY_o, 26 },
+         { GDK_KEY_0, 27 }, { GDK_KEY_p, 28 }
+     };
+     guint lower = gdk_keyval_to_lower(keyval);
+
+     for (int i = 0; i < G_N_ELEMENTS(keys); i++) {
+         if (keys[i].keyval == lower) {
+             int note = base_note + keys[i].offset;
+             return (note >= 0 && note <= 127) ? note : -1;
+         }
+     }
+     return -1;
+ }
+
+ /**
+  * @brief Releases every note still held on the computer keyboard.
+  */
+ static void release_held_keys(void) {
+     for (int i = 0; i < G_N_ELEMENTS(key_held_notes); i++) {
+         if (key_held_notes[i] >= 0) {
+             key_note_handler(key_held_notes[i], 0);
+             key_held_notes[i] = -1;
+         }
+     }
+ }
+
+ static gboolean on_key_press_event(GtkWidget *widget, GdkEventKey *event, gpointer user_data) {
+     int note;
+
+     // Leave shortcuts to the widgets
+     if (event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK)) return FALSE;
+     if (event->hardware_keycode >= G_N_ELEMENTS(key_held_notes)) return FALSE;
+
+     if (event->keyval == GDK_KEY_minus || event->keyval == GDK_KEY_equal) {
+         int base = key_base_note + (event->keyval == GDK_KEY_minus ? -12 : 12);
+         if (base >= 0 && base + 28 <= 127) {
+             key_base_note = base;
+             printf("GUI: Keyboard plays from note %d\n", key_base_note);
+         }
+         return TRUE;
+     }
+     note = gui_key_to_note(event->keyval, key_base_note);
+     if (note < 0) return FALSE;
+     // A held key repeats its press; only the first one plays
+     if (key_held_notes[event->hardware_keycode] < 0) {
+         key_held_notes[event->hardware_keycode] = note;
+         key_note_handler(note, GUI_KEY_VELOCITY);
+     }
+     return TRUE;
+ }
+
+ static gboolean on_key_release_event(GtkWidget *widget, GdkEventKey *event, gpointer user_data) {
+     int note;
+
+     if (event->hardware_keycode >= G_N_ELEMENTS(key_held_notes)) return FALSE;
+     note = key_held_notes[event->hardware_keycode];
+     if (note < 0) return FALSE;
+     key_held_notes[event->hardware_keycode] = -1;
+     key_note_handler(note, 0);
+     return TRUE;
+ }
+
+ /**
+  * @brief Releases the held notes when the window loses focus, which would swallow their key releases.
+  */
+ static gboolean on_focus_out_event(GtkWidget *widget, GdkEventFocus *event, gpointer user_data) {
+     release_held_keys();
+     return FALSE;
+ }
+
+
  // ==================== GUI UPDATE HELPER ====================
  static void update_gui_from_data() {
      int ret_lock, ret_unlock;
@@ -552,4 +838,7 @@
  // ==================== CLEANUP CALLBACK ====================
  static void cleanup_on_destroy() {
      printf("GUI: Window destroyed signal received.\n");
+     if (midi_poll_source != 0) { g_source_remove(midi_poll_source); midi_poll_source = 0; }
+     unwatch_preset_dir();
+     stop_preset_loader();
  }
\ No newline at end of file
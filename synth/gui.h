@@ -26,6 +26,100 @@
   * @see create_gui() implementation in gui.c
   */
  void create_gui(GtkApplication *app);
+
+ // --- Audio Device Selection ---
+
+ /** @brief Device id meaning "restart on the device that is configured now". */
+ #define GUI_AUDIO_DEVICE_CURRENT -2
+
+ /**
+  * @brief Called by the GUI to move the audio output to another device, or to restart it.
+  * @param device_index A device index, -1 for the default device or GUI_AUDIO_DEVICE_CURRENT.
+  * @return 1 if the stream runs on the requested device, 0 otherwise.
+  */
+ typedef int (*GuiAudioSwitchFn)(int device_index);
+
+ /**
+  * @brief Registers the function performing device switches and restarts.
+  *
+  * Must be called before create_gui(); without a handler the GUI shows no
+  * audio device controls. This keeps gui.c independent of the audio module.
+  *
+  * @param handler The switch function.
+  */
+ void gui_set_audio_switch_handler(GuiAudioSwitchFn handler);
+
+ /**
+  * @brief Removes all entries from the audio device selector.
+  */
+ void gui_clear_audio_devices(void);
+
+ /**
+  * @brief Adds an entry to the audio device selector (GTK thread, after create_gui()).
+  * @param device_index Value passed to the switch handler when the entry is chosen.
+  * @param name Label shown in the selector.
+  * @param active Non-zero to show this entry as the current device.
+  */
+ void gui_add_audio_device(int device_index, const char *name, int active);
+
+
+ // --- MIDI Learn ---
+
+ /** @brief Interval at which the GUI polls controller activity, in ms. */
+ #define GUI_MIDI_POLL_MS 40
+
+ /**
+  * @brief Called by the GUI to arm MIDI learn for a parameter.
+  * @param param A SynthParam, or -1 to cancel learning.
+  * @return 1 if learn is armed (or cancelled), 0 otherwise.
+  */
+ typedef int (*GuiMidiLearnFn)(int param);
+
+ /**
+  * @brief Called by the GUI every GUI_MIDI_POLL_MS.
+  * @param[out] learning The parameter still waiting for a controller, -1 if none.
+  * @return A counter that changes whenever controllers changed parameters in the shared data.
+  */
+ typedef unsigned long (*GuiMidiPollFn)(int *learning);
+
+ /**
+  * @brief Registers the MIDI learn functions.
+  *
+  * Must be called before create_gui(); without handlers the GUI shows no MIDI
+  * learn controls and does not poll. The sliders follow controller changes at
+  * the poll rate, however many controller messages arrive in between.
+  *
+  * @param learn Arms or cancels learning.
+  * @param poll Reports controller activity.
+  */
+ void gui_set_midi_handlers(GuiMidiLearnFn learn, GuiMidiPollFn poll);
+
+
+ // --- Computer Keyboard Playing ---
+
+ #define GUI_KEY_VELOCITY 100   ///< Velocity of the notes played on the computer keyboard.
+ #define GUI_KEY_BASE_NOTE 48   ///< Note of the `z` key (C3) until the octave is changed; `q` plays an octave higher.
+
+ /**
+  * @brief Called by the GUI thread for every key pressed or released on the computer keyboard.
+  * @param note MIDI note 0-127.
+  * @param velocity GUI_KEY_VELOCITY on press, 0 on release.
+  * @return 1 if the note was passed on, 0 if it was dropped.
+  */
+ typedef int (*GuiKeyNoteFn)(int note, int velocity);
+
+ /**
+  * @brief Registers the function playing notes from the computer keyboard.
+  *
+  * Must be called before create_gui(); without a handler the keys are left to
+  * the widgets. With one, the rows `z`-`/` and `q`-`p` (with the number row
+  * for the black keys) play two overlapping octaves like a piano keyboard and
+  * `-`/`=` move them down or up an octave. The handler is called straight from
+  * the key event, without taking the synth data mutex.
+  *
+  * @param handler The note function.
+  */
+ void gui_set_key_handler(GuiKeyNoteFn handler);
  
  
  // --- Declaration for Testing ---
@@ -55,6 +149,16 @@
   * @see calculate_current_envelope_wave2() implementation in gui.c
   */
  double calculate_current_envelope_wave2(const SharedSynthData *data); 
+
+ /**
+  * @brief Declaration of the computer keyboard note mapping for testing.
+  *
+  * @param keyval GDK key value (either case).
+  * @param base_note Note of the `z` key.
+  * @return The key's note, -1 if the key plays no note or the note is outside 0-127.
+  * @see gui_key_to_note() implementation in gui.c
+  */
+ int gui_key_to_note(guint keyval, int base_note);
  
  #endif // TESTING
  
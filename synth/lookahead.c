@@ -0,0 +1,196 @@
+/**
+ * @file lookahead.c
+ * @brief Render thread filling the lookahead ring ahead of the audio device.
+ *
+ * The thread renders LOOKAHEAD_BLOCK_FRAMES at a time with render_audio()
+ * while the ring holds less than the target lookahead (plus any pre-render
+ * the engine asked for), and otherwise sleeps for half a block. The device
+ * side never signals it, so reading stays wait-free and portable (no
+ * semaphores in the real-time path).
+ */
+
+ #include <pthread.h>
+ #include <sched.h>
+ #include <stdio.h>
+ #include <string.h>
+ #include <time.h>
+ #include <stdatomic.h>
+
+ #include "lookahead.h"
+ #include "ringbuffer.h"
+ #include "audio_internal.h"
+
+ // --- Constants ---
+ #define LOOKAHEAD_RT_PRIORITY_OFFSET 20 ///< Render thread runs below the device thread's priority.
+
+ /**
+  * @struct Lookahead
+  * @brief State of the render thread and its ring. Only one instance exists.
+  */
+ typedef struct {
+     RingBuffer ring;               ///< Rendered samples waiting for the device.
+     SharedSynthData *data;         ///< Shared data rendered by the thread.
+     atomic_ulong target_frames;    ///< Fill level the thread maintains.
+     atomic_ulong prerender_frames; ///< Rendered on top of the target while the engine allows it.
+     unsigned long max_frames;      ///< Largest target the ring can hold.
+     double sample_rate;            ///< Used to derive the idle sleep time.
+     pthread_t thread;              ///< The render thread.
+     atomic_int running;            ///< Cleared by lookahead_stop().
+     atomic_int active;             ///< Set while the ring may be read.
+ } Lookahead;
+
+ static Lookahead g_lookahead;
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Renders one block into the ring. Lock failures produce a silent block.
+  */
+ static void lookahead_render_block(Lookahead *la) {
+     float block[LOOKAHEAD_BLOCK_FRAMES];
+     // render_audio() already writes silence when it fails
+     render_audio(la->data, block, LOOKAHEAD_BLOCK_FRAMES);
+     ringbuffer_write(&la->ring, block, LOOKAHEAD_BLOCK_FRAMES);
+ }
+
+ /**
+  * @brief Render thread: tops the ring up to the target fill level.
+  */
+ static void *lookahead_thread_main(void *arg) {
+     Lookahead *la = (Lookahead *)arg;
+     struct timespec idle = { 0, (long)(0.5e9 * LOOKAHEAD_BLOCK_FRAMES / la->sample_rate) };
+
+     while (atomic_load(&la->running)) {
+         unsigned long target = atomic_load_explicit(&la->target_frames, memory_order_relaxed) +
+                                atomic_load_explicit(&la->prerender_frames, memory_order_relaxed);
+         if (target > la->max_frames) target = la->max_frames;
+         if (ringbuffer_read_available(&la->ring) + LOOKAHEAD_BLOCK_FRAMES <= target) {
+             lookahead_render_block(la);
+         } else {
+             nanosleep(&idle, NULL);
+         }
+     }
+     return NULL;
+ }
+
+ /**
+  * @brief Starts the render thread with SCHED_FIFO if permitted, normal priority otherwise.
+  * @return 0 on success, an errno value on failure.
+  */
+ static int lookahead_start_thread(Lookahead *la) {
+     pthread_attr_t attr;
+     struct sched_param param;
+     int ret;
+
+     pthread_attr_init(&attr);
+     pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+     pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+     param.sched_priority = sched_get_priority_max(SCHED_FIFO) - LOOKAHEAD_RT_PRIORITY_OFFSET;
+     pthread_attr_setschedparam(&attr, &param);
+     ret = pthread_create(&la->thread, &attr, lookahead_thread_main, la);
+     pthread_attr_destroy(&attr);
+
+     if (ret != 0) {
+         ret = pthread_create(&la->thread, NULL, lookahead_thread_main, la);
+     }
+     return ret;
+ }
+
+
+ // --- Public Functions ---
+
+ int lookahead_start(SharedSynthData *data, unsigned long lookahead_frames, unsigned long max_frames) {
+     Lookahead *la = &g_lookahead;
+     int ret;
+
+     if (atomic_load(&la->active)) return 1;
+     if (lookahead_frames < LOOKAHEAD_BLOCK_FRAMES) lookahead_frames = LOOKAHEAD_BLOCK_FRAMES;
+     if (max_frames < lookahead_frames) max_frames = lookahead_frames;
+
+     if (!ringbuffer_init(&la->ring, max_frames + LOOKAHEAD_BLOCK_FRAMES)) {
+         fprintf(stderr, "Error: Cannot allocate lookahead ring of %lu frames.\n", max_frames);
+         return 0;
+     }
+     la->data = data;
+     la->max_frames = max_frames;
+     atomic_store(&la->target_frames, lookahead_frames);
+     atomic_store(&la->prerender_frames, 0);
+     if (pthread_mutex_lock(&data->mutex) == 0) {
+         la->sample_rate = data->sampleRate;
+         pthread_mutex_unlock(&data->mutex);
+     } else {
+         la->sample_rate = 44100.0;
+     }
+
+     // Prefill so the device never starts on an empty ring
+     while (ringbuffer_read_available(&la->ring) + LOOKAHEAD_BLOCK_FRAMES <= lookahead_frames) {
+         lookahead_render_block(la);
+     }
+
+     atomic_store(&la->running, 1);
+     ret = lookahead_start_thread(la);
+     if (ret != 0) {
+         fprintf(stderr, "Error: Cannot create render thread: %s\n", strerror(ret));
+         atomic_store(&la->running, 0);
+         ringbuffer_free(&la->ring);
+         return 0;
+     }
+
+     audio_stats_set_lookahead(lookahead_frames);
+     atomic_store(&la->active, 1);
+     printf("Render thread started: lookahead %lu frames (%.1f ms).\n",
+            lookahead_frames, 1000.0 * lookahead_frames / la->sample_rate);
+     return 1;
+ }
+
+ void lookahead_stop(void) {
+     Lookahead *la = &g_lookahead;
+
+     if (!atomic_load(&la->active)) return;
+     atomic_store(&la->active, 0);
+     atomic_store(&la->running, 0);
+     pthread_join(la->thread, NULL);
+     ringbuffer_free(&la->ring);
+     audio_stats_set_lookahead(0);
+     printf("Render thread stopped.\n");
+ }
+
+ unsigned long lookahead_set_target(unsigned long lookahead_frames) {
+     Lookahead *la = &g_lookahead;
+
+     if (!atomic_load(&la->active)) return 0;
+     if (lookahead_frames < LOOKAHEAD_BLOCK_FRAMES) lookahead_frames = LOOKAHEAD_BLOCK_FRAMES;
+     if (lookahead_frames > la->max_frames) lookahead_frames = la->max_frames;
+     // A larger target is rendered ahead within a few blocks, a smaller one drains as the device reads
+     atomic_store(&la->target_frames, lookahead_frames);
+     audio_stats_set_lookahead(lookahead_frames);
+     return lookahead_frames;
+ }
+
+ void lookahead_set_prerender(unsigned long frames) {
+     if (atomic_load_explicit(&g_lookahead.active, memory_order_relaxed)) {
+         atomic_store_explicit(&g_lookahead.prerender_frames, frames, memory_order_relaxed);
+     }
+ }
+
+ unsigned long lookahead_get_target(void) {
+     if (!atomic_load(&g_lookahead.active)) return 0;
+     return atomic_load(&g_lookahead.target_frames);
+ }
+
+ int lookahead_is_running(void) {
+     return atomic_load_explicit(&g_lookahead.active, memory_order_acquire);
+ }
+
+ unsigned long lookahead_read(float *out, unsigned long frames) {
+     Lookahead *la = &g_lookahead;
+     size_t fill = ringbuffer_read_available(&la->ring);
+     size_t got = ringbuffer_read(&la->ring, out, frames);
+
+     if (got < frames) {
+         memset(out + got, 0, (frames - got) * sizeof(float));
+     }
+     audio_stats_record_lookahead((unsigned long)fill, got < frames);
+     return (unsigned long)got;
+ }
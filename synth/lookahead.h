@@ -0,0 +1,72 @@
+/**
+ * @file lookahead.h
+ * @brief Decoupled render thread that renders ahead into a lock-free ring.
+ *
+ * When a lookahead is configured, a dedicated thread keeps up to
+ * `lookahead_frames` of mixed audio rendered in advance. The device side
+ * (any backend's callback, or the blocking PortAudio writer) only copies out
+ * of the ring, so a slow block or a long GUI lock is absorbed by the
+ * lookahead instead of causing a dropout. Costs `lookahead_frames` of latency.
+ */
+
+ #ifndef LOOKAHEAD_H
+ #define LOOKAHEAD_H
+
+ #include "synth_data.h"
+
+ #define LOOKAHEAD_BLOCK_FRAMES 64 ///< Frames the render thread produces per iteration.
+
+ /**
+  * @brief Prefills the ring and starts the render thread.
+  * @param[in,out] data Shared synthesizer data rendered by the thread.
+  * @param lookahead_frames Target fill level of the ring in frames (>= LOOKAHEAD_BLOCK_FRAMES).
+  * @param max_frames Largest target lookahead_set_target() may later select (the ring is sized
+  * for it); values below `lookahead_frames` mean no growth.
+  * @return 1 on success, 0 on allocation or thread creation failure.
+  */
+ int lookahead_start(SharedSynthData *data, unsigned long lookahead_frames, unsigned long max_frames);
+
+ /**
+  * @brief Stops the render thread and frees the ring. Safe to call when not running.
+  */
+ void lookahead_stop(void);
+
+ /**
+  * @brief Changes the fill level the running render thread maintains, without a dropout.
+  * @param lookahead_frames New target, clamped to the range given to lookahead_start().
+  * @return The target now in effect, or 0 if the render thread is not running.
+  */
+ unsigned long lookahead_set_target(unsigned long lookahead_frames);
+
+ /**
+  * @brief Renders `frames` ahead on top of the target, while what is rendered does not depend on
+  * when it is rendered (the engine's sequencer pre-render). Safe to call from the render thread.
+  * @param frames Extra frames, 0 to return to the target; the total is clamped to the ring's size.
+  * Does nothing if the render thread is not running. Lowering it lets the ring drain as the device reads.
+  */
+ void lookahead_set_prerender(unsigned long frames);
+
+ /**
+  * @brief Returns the current target fill level, 0 if the render thread is not running.
+  */
+ unsigned long lookahead_get_target(void);
+
+ /**
+  * @brief Reports whether the render thread is feeding the ring.
+  * @return 1 if running, 0 otherwise.
+  */
+ int lookahead_is_running(void);
+
+ /**
+  * @brief Copies rendered audio out of the ring (real-time safe, never blocks).
+  *
+  * Missing frames are filled with silence and counted as a lookahead underrun
+  * in the engine statistics.
+  *
+  * @param[out] out Buffer receiving `frames` samples.
+  * @param frames Number of frames requested.
+  * @return Number of frames that came from the ring.
+  */
+ unsigned long lookahead_read(float *out, unsigned long frames);
+
+ #endif // LOOKAHEAD_H
@@ -13,10 +13,15 @@
  #include <stdlib.h> 
  #include <string.h> 
  #include <errno.h>  
+ #include <unistd.h>
  
  #include "synth_data.h" 
  #include "gui.h"        
  #include "audio.h"      
+ #include "config.h"
+ #include "presets.h"
+ #include "preset_file.h"
+ #include "presetbank.h"
  
  // --- Global Shared Data Instance Definition ---
  /**
@@ -44,6 +49,31 @@
   * @param user_data User data passed during signal connection (unused here).
   */
  static void activate(GtkApplication *app, gpointer user_data);
+
+ /**
+  * @brief GUI handler moving the audio output to another device (or restarting it).
+  * @param device_index PortAudio device index, -1 for the default device or GUI_AUDIO_DEVICE_CURRENT.
+  * @return 1 if the stream runs on the requested device, 0 otherwise.
+  */
+ static int switch_audio_device(int device_index);
+
+ /**
+  * @brief Fills the GUI's audio device selector with the available output devices.
+  */
+ static void populate_audio_devices(void);
+
+ /**
+  * @brief GUI handler arming MIDI learn for a parameter (-1 cancels).
+  * @return 1 (learn can always be armed while MIDI input is enabled).
+  */
+ static int midi_learn(int param);
+
+ /**
+  * @brief GUI handler reporting controller activity.
+  * @param[out] learning Parameter still waiting for a controller, -1 if none.
+  * @return Counter that changes whenever controllers changed parameters.
+  */
+ static unsigned long midi_poll(int *learning);
  
  
  // --- Main Application Entry Point ---
@@ -52,6 +82,8 @@
   * @brief Main function and entry point of the synthesizer application.
   *
   * Orchestrates the application lifecycle:
+  * 0. Reads the audio configuration (`synth.conf` if present, then command-line options);
+  *    with `--build-preset-bank` it converts the presets into the bank and exits.
   * 1. Initializes the global shared data (`g_synth_data`) with default values for **both waves**.
   * 2. Initializes the mutex within `g_synth_data`.
   * 3. Initializes the PortAudio library and audio state.
@@ -69,6 +101,24 @@
      int status = 0; // Default exit status to success
      int mutex_ret;
      PaError pa_err;
+     AudioConfig audio_cfg;
+ 
+     // --- 0. Read Audio Configuration ---
+     // Config file first, command line overrides. Audio options are removed from
+     // argv so GTK only sees the arguments it understands.
+     audio_config_set_defaults(&audio_cfg);
+     if (access(CONFIG_DEFAULT_FILE, R_OK) == 0 && !audio_config_load_file(&audio_cfg, CONFIG_DEFAULT_FILE)) {
+         fprintf(stderr, "Invalid configuration in %s. Exiting.\n", CONFIG_DEFAULT_FILE);
+         return EXIT_FAILURE;
+     }
+     if (!audio_config_parse_args(&audio_cfg, &argc, argv)) {
+         audio_config_print_usage(argv[0]);
+         return EXIT_FAILURE;
+     }
+     // Bank building mode: convert and exit without touching audio or the GUI
+     if (audio_cfg.buildPresetBank) {
+         return presetbank_convert(PRESET_DIR, PRESETBANK_FILE) ? EXIT_SUCCESS : EXIT_FAILURE;
+     }
  
      // --- 1. Initialize Global Data Defaults for Both Waves ---
      // Use designated initializers (C99+) for clarity
@@ -102,7 +152,8 @@
          .lastEnvValue2 = 0.0,
  
          // Common Defaults
-         .sampleRate = 44100.0,     // Standard CD quality sample rate
+         // Engine rate: the fixed internal rate if one is set (resampled to the device), else the device rate
+         .sampleRate = (audio_cfg.internalRate > 0.0) ? audio_cfg.internalRate : audio_cfg.sampleRate,
          .waveform_drawing_area = NULL // GUI sets this later
  
          // Mutex field requires explicit initialization below
@@ -132,6 +183,20 @@
          return EXIT_FAILURE; // Exit if audio system fails to initialize
      }
  
+     // Device listing mode: print and exit without starting the GUI
+     if (audio_cfg.listDevices) {
+         pa_err = list_audio_devices();
+         terminate_audio();
+         pthread_mutex_destroy(&g_synth_data.mutex);
+         return (pa_err == paNoError) ? EXIT_SUCCESS : EXIT_FAILURE;
+     }
+     audio_set_config(&audio_cfg);
+     printf("Audio backend: %s\n", audio_backend_name(audio_cfg.backend));
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         const MidiMapping *m = &audio_cfg.midiMap.params[i];
+         if (audio_cfg.midiMapped & (1u << i)) audio_midi_map((SynthParam)i, (m->cc >= 0) ? m : NULL);
+     }
+ 
      // --- 4. Create and Configure GTK Application ---
      app = gtk_application_new("com.example.csynth.dualwave", G_APPLICATION_DEFAULT_FLAGS);
       if (app == NULL) {
@@ -195,6 +260,12 @@
      // --- 1. Create the GUI ---
      // This function (defined in gui.c) builds the window, widgets for both waves,
      // connects widget signals, and shows the window.
+     AudioConfig cfg;
+     audio_get_config(&cfg);
+     gui_set_audio_switch_handler(switch_audio_device);
+     if (cfg.midiInput) gui_set_midi_handlers(midi_learn, midi_poll);
+     gui_set_key_handler(audio_key_input);
+     presets_set_pattern_handlers(audio_seq_get_pattern, audio_seq_set_pattern);
      create_gui(app); // Call function from gui module
      printf("GUI created.\n");
  
@@ -221,4 +292,55 @@
          exit(EXIT_FAILURE);
      }
      printf("Audio stream started.\n");
- }
\ No newline at end of file
+     populate_audio_devices();
+ }
+
+ static int switch_audio_device(int device_index) {
+     AudioConfig cfg;
+     PaError pa_err;
+
+     audio_get_config(&cfg);
+     if (device_index != GUI_AUDIO_DEVICE_CURRENT) {
+         cfg.deviceIndex = device_index;
+         cfg.deviceName[0] = '\0';
+     }
+     pa_err = audio_restart(&g_synth_data, (device_index != GUI_AUDIO_DEVICE_CURRENT) ? &cfg : NULL);
+     if (pa_err != paNoError) {
+         fprintf(stderr, "Audio device switch failed: %s\n", Pa_GetErrorText(pa_err));
+         return 0;
+     }
+     return 1;
+ }
+
+ static void populate_audio_devices(void) {
+     AudioOutputDevice devices[32];
+     AudioConfig cfg;
+     char label[CONFIG_DEVICE_NAME_MAX + 16];
+     int count;
+
+     audio_get_config(&cfg);
+     gui_clear_audio_devices();
+     if (cfg.backend != AUDIO_BACKEND_PORTAUDIO) {
+         // ALSA and JACK devices are not PortAudio indices: offer a restart on the configured one
+         snprintf(label, sizeof(label), "%s: %s", audio_backend_name(cfg.backend), cfg.deviceName[0] ? cfg.deviceName : "default");
+         gui_add_audio_device(GUI_AUDIO_DEVICE_CURRENT, label, 1);
+         return;
+     }
+
+     count = audio_get_output_devices(devices, (int)(sizeof(devices) / sizeof(devices[0])));
+     gui_add_audio_device(-1, "System default", 0);
+     for (int i = 0; i < count && i < (int)(sizeof(devices) / sizeof(devices[0])); i++) {
+         snprintf(label, sizeof(label), "%d: %s", devices[i].index, devices[i].name);
+         gui_add_audio_device(devices[i].index, label, devices[i].isActive);
+     }
+ }
+
+ static int midi_learn(int param) {
+     audio_midi_learn(param);
+     return 1;
+ }
+
+ static unsigned long midi_poll(int *learning) {
+     if (learning) *learning = audio_midi_learning();
+     return audio_midi_param_updates();
+ }
@@ -0,0 +1,193 @@
+/**
+ * @file midi.c
+ * @brief Implements the MIDI event queue, the schedule of future events and the clock that stamps events.
+ *
+ * The queue follows the ring buffer's protocol: the producer publishes an
+ * event with a release store of `write_pos`, the consumer acquires it before
+ * reading the slot and releases `read_pos` once the slot may be reused.
+ */
+
+ #include <math.h>
+ #include <stddef.h>
+
+ #include "midi.h"
+
+ #define MIDI_QUEUE_MASK (MIDI_QUEUE_CAPACITY - 1)
+
+
+ // --- Event Queue ---
+
+ void midi_queue_init(MidiQueue *q) {
+     atomic_init(&q->write_pos, 0);
+     atomic_init(&q->read_pos, 0);
+ }
+
+ int midi_queue_push(MidiQueue *q, const MidiEvent *ev) {
+     unsigned int w = atomic_load_explicit(&q->write_pos, memory_order_relaxed);
+     unsigned int r = atomic_load_explicit(&q->read_pos, memory_order_acquire);
+
+     if (w - r >= MIDI_QUEUE_CAPACITY) return 0;
+     q->events[w & MIDI_QUEUE_MASK] = *ev;
+     atomic_store_explicit(&q->write_pos, w + 1, memory_order_release);
+     return 1;
+ }
+
+ int midi_queue_push_batch(MidiQueue *q, const MidiEvent *events, unsigned int count) {
+     unsigned int w = atomic_load_explicit(&q->write_pos, memory_order_relaxed);
+     unsigned int r = atomic_load_explicit(&q->read_pos, memory_order_acquire);
+
+     if (count > MIDI_QUEUE_CAPACITY - (w - r)) return 0;
+     for (unsigned int i = 0; i < count; i++) q->events[(w + i) & MIDI_QUEUE_MASK] = events[i];
+     // One release store publishes the whole batch
+     atomic_store_explicit(&q->write_pos, w + count, memory_order_release);
+     return 1;
+ }
+
+ const MidiEvent *midi_queue_peek(MidiQueue *q) {
+     unsigned int r = atomic_load_explicit(&q->read_pos, memory_order_relaxed);
+     unsigned int w = atomic_load_explicit(&q->write_pos, memory_order_acquire);
+
+     return (w == r) ? NULL : &q->events[r & MIDI_QUEUE_MASK];
+ }
+
+ const MidiEvent *midi_queue_peek_at(MidiQueue *q, unsigned int index) {
+     unsigned int r = atomic_load_explicit(&q->read_pos, memory_order_relaxed);
+     unsigned int w = atomic_load_explicit(&q->write_pos, memory_order_acquire);
+
+     return (w - r <= index) ? NULL : &q->events[(r + index) & MIDI_QUEUE_MASK];
+ }
+
+ void midi_queue_pop(MidiQueue *q) {
+     unsigned int r = atomic_load_explicit(&q->read_pos, memory_order_relaxed);
+     atomic_store_explicit(&q->read_pos, r + 1, memory_order_release);
+ }
+
+
+ // --- Schedule ---
+
+ /** @brief Heap order: earlier frame first, then earlier insertion. */
+ static int midi_schedule_before(const MidiSchedule *s, unsigned int a, unsigned int b) {
+     if (s->events[a].frame != s->events[b].frame) return s->events[a].frame < s->events[b].frame;
+     return s->order[a] < s->order[b];
+ }
+
+ static void midi_schedule_swap(MidiSchedule *s, unsigned int a, unsigned int b) {
+     MidiEvent ev = s->events[a];
+     unsigned long order = s->order[a];
+
+     s->events[a] = s->events[b]; s->order[a] = s->order[b];
+     s->events[b] = ev; s->order[b] = order;
+ }
+
+ void midi_schedule_init(MidiSchedule *s) {
+     s->count = 0;
+     s->next_order = 0;
+ }
+
+ int midi_schedule_push(MidiSchedule *s, const MidiEvent *ev) {
+     unsigned int i = s->count;
+
+     if (i >= MIDI_SCHEDULE_CAPACITY) return 0;
+     s->events[i] = *ev;
+     s->order[i] = s->next_order++;
+     s->count++;
+     // Events mostly arrive in frame order, so this loop rarely runs
+     while (i > 0 && midi_schedule_before(s, i, (i - 1) / 2)) {
+         midi_schedule_swap(s, i, (i - 1) / 2);
+         i = (i - 1) / 2;
+     }
+     return 1;
+ }
+
+ const MidiEvent *midi_schedule_peek(const MidiSchedule *s) {
+     return (s->count == 0) ? NULL : &s->events[0];
+ }
+
+ void midi_schedule_pop(MidiSchedule *s) {
+     unsigned int i = 0;
+
+     if (s->count == 0) return;
+     s->count--;
+     if (s->count == 0) return;
+     s->events[0] = s->events[s->count];
+     s->order[0] = s->order[s->count];
+     for (;;) {
+         unsigned int left = 2 * i + 1, right = left + 1, first = i;
+         if (left < s->count && midi_schedule_before(s, left, first)) first = left;
+         if (right < s->count && midi_schedule_before(s, right, first)) first = right;
+         if (first == i) break;
+         midi_schedule_swap(s, i, first);
+         i = first;
+     }
+ }
+
+ unsigned int midi_schedule_space(const MidiSchedule *s) {
+     return MIDI_SCHEDULE_CAPACITY - s->count;
+ }
+
+
+ // --- Clock ---
+
+ void midi_clock_init(MidiClock *clock) {
+     atomic_init(&clock->seq, 0);
+     atomic_init(&clock->frame, 0);
+     atomic_init(&clock->time_us, 0);
+     atomic_init(&clock->block, 0);
+     atomic_init(&clock->rate_mhz, 0);
+ }
+
+ void midi_clock_publish(MidiClock *clock, uint64_t frame, double time_sec, unsigned long frames, double rate) {
+     unsigned int seq = atomic_load_explicit(&clock->seq, memory_order_relaxed);
+
+     // Odd while the fields change, so a reader retries instead of mixing two blocks
+     atomic_store_explicit(&clock->seq, seq + 1, memory_order_relaxed);
+     atomic_thread_fence(memory_order_release);
+     atomic_store_explicit(&clock->frame, frame, memory_order_relaxed);
+     atomic_store_explicit(&clock->time_us, (long)(time_sec * 1e6), memory_order_relaxed);
+     atomic_store_explicit(&clock->block, frames, memory_order_relaxed);
+     atomic_store_explicit(&clock->rate_mhz, (unsigned long)(rate * 1000.0 + 0.5), memory_order_relaxed);
+     atomic_store_explicit(&clock->seq, seq + 2, memory_order_release);
+ }
+
+ /** @brief Reads a consistent snapshot of the published block. */
+ static void midi_clock_read(MidiClock *clock, uint64_t *frame, long *time_us, unsigned long *block, unsigned long *rate_mhz) {
+     unsigned int seq;
+
+     do {
+         seq = atomic_load_explicit(&clock->seq, memory_order_acquire);
+         *frame = atomic_load_explicit(&clock->frame, memory_order_relaxed);
+         *time_us = atomic_load_explicit(&clock->time_us, memory_order_relaxed);
+         *block = atomic_load_explicit(&clock->block, memory_order_relaxed);
+         *rate_mhz = atomic_load_explicit(&clock->rate_mhz, memory_order_relaxed);
+         atomic_thread_fence(memory_order_acquire);
+     } while ((seq & 1) || seq != atomic_load_explicit(&clock->seq, memory_order_relaxed));
+ }
+
+ uint64_t midi_clock_stamp(MidiClock *clock, double time_sec) {
+     uint64_t frame;
+     long time_us;
+     unsigned long block, rate_mhz;
+     double delay;
+
+     midi_clock_read(clock, &frame, &time_us, &block, &rate_mhz);
+     if (rate_mhz == 0) return 0;
+     // An event that raced the block start still belongs to the next block
+     delay = (time_sec - time_us * 1e-6) * (rate_mhz / 1000.0);
+     if (delay < 0.0) delay = 0.0;
+     return frame + block + (uint64_t)(delay + 0.5);
+ }
+
+ double midi_clock_time(MidiClock *clock, uint64_t frame) {
+     uint64_t start;
+     long time_us;
+     unsigned long block, rate_mhz;
+
+     (void)block;
+     midi_clock_read(clock, &start, &time_us, &block, &rate_mhz);
+     if (rate_mhz == 0) return -1.0;
+     return time_us * 1e-6 + ((double)frame - (double)start) / (rate_mhz / 1000.0);
+ }
+
+ double midi_note_to_freq(int note) {
+     return 440.0 * pow(2.0, (note - 69) / 12.0);
+ }
@@ -0,0 +1,202 @@
+/**
+ * @file midi.h
+ * @brief Timestamped note/controller events handed from a MIDI thread to the audio thread.
+ *
+ * The input thread stamps every event with the engine frame it should take
+ * effect at and pushes it into a single-producer/single-consumer queue; the
+ * render loop pops the events due in the block it renders and splits the
+ * block at their offsets. The stamp comes from the MidiClock, which the
+ * render loop updates at the start of each block with the engine frame and
+ * the audio clock time: an event received `t` seconds after a block started
+ * plays `t * rate` frames after the start of the following block. Delaying
+ * everything by exactly one block keeps the spacing between events intact,
+ * where applying them at the start of the next block would quantise them to
+ * the block size.
+ *
+ * Events from control interfaces (OSC, the control socket) may be stamped
+ * for any future frame, so the render loop moves them from their queue into
+ * a MidiSchedule, a heap that hands them back in frame order. A batch pushed
+ * with midi_queue_push_batch() becomes visible to the render loop all at
+ * once, so events stamped with the same frame apply in the same block.
+ *
+ * Neither the queues, the schedule nor the clock block or allocate.
+ */
+
+ #ifndef MIDI_H
+ #define MIDI_H
+
+ #include <stdint.h>
+ #include <stdatomic.h>
+
+ // --- Constants ---
+ #define MIDI_QUEUE_CAPACITY 2048    ///< Events the queue holds (power of two). A full queue drops new events.
+ #define MIDI_SCHEDULE_CAPACITY 2048 ///< Future events the schedule holds. A full schedule drops new events.
+ #define MIDI_CC_VOLUME 7               ///< Channel volume, scales both waves.
+ #define MIDI_CC_ALL_SOUND_OFF 120      ///< Silences both waves immediately.
+ #define MIDI_CC_ALL_NOTES_OFF 123      ///< Releases the held note.
+ #define MIDI_BEND_CENTRE 8192          ///< 14-bit pitch bend value of no bend.
+
+ /**
+  * @enum MidiEventType
+  * @brief The channel messages the synth reacts to.
+  */
+ typedef enum {
+     MIDI_EVENT_NOTE_OFF,  ///< `data1` note, `data2` release velocity.
+     MIDI_EVENT_NOTE_ON,   ///< `data1` note, `data2` velocity (0 means note off).
+     MIDI_EVENT_CONTROL,   ///< `data1` controller number, `data2` value.
+     MIDI_EVENT_PARAM,     ///< `data1` SynthParam, `value` its new value (control interfaces only).
+     MIDI_EVENT_WAVEFORM,  ///< `data1` wave (0 or 1), `data2` its WaveformType (control interfaces only).
+     MIDI_EVENT_PITCH_BEND, ///< `data1` low 7 bits, `data2` high 7 bits of the bend, 8192 is the centre.
+     MIDI_EVENT_PRESSURE,  ///< Channel pressure: `data1` 0-127.
+     MIDI_EVENT_CLOCK,     ///< System real-time: a clock tick, 24 per quarter note (see midisync.h).
+     MIDI_EVENT_START,     ///< System real-time: the transport starts from the beginning.
+     MIDI_EVENT_CONTINUE,  ///< System real-time: the transport resumes.
+     MIDI_EVENT_STOP       ///< System real-time: the transport stops.
+ } MidiEventType;
+
+ /**
+  * @struct MidiEvent
+  * @brief One channel message and the engine frame it takes effect at.
+  */
+ typedef struct {
+     uint64_t frame;        ///< Engine frame (see MidiClock); earlier frames play at the start of the next block.
+     MidiEventType type;
+     uint8_t channel;       ///< MIDI channel 0-15.
+     uint8_t data1;
+     uint8_t data2;
+     double value;          ///< Parameter value of MIDI_EVENT_PARAM; arrival time of a computer keyboard note.
+ } MidiEvent;
+
+ /**
+  * @struct MidiQueue
+  * @brief Lock-free single-producer/single-consumer event FIFO.
+  */
+ typedef struct {
+     MidiEvent events[MIDI_QUEUE_CAPACITY];
+     atomic_uint write_pos;  ///< Next slot to fill, only advanced by the producer.
+     atomic_uint read_pos;   ///< Next slot to read, only advanced by the consumer.
+ } MidiQueue;
+
+ /**
+  * @struct MidiSchedule
+  * @brief Binary min-heap of events by frame, owned by the render thread.
+  *
+  * Events with the same frame come out in the order they went in, so a note
+  * off sent after its note on is never applied first.
+  */
+ typedef struct {
+     MidiEvent events[MIDI_SCHEDULE_CAPACITY];
+     unsigned long order[MIDI_SCHEDULE_CAPACITY]; ///< Insertion number of each slot, the tie-break.
+     unsigned int count;
+     unsigned long next_order;
+ } MidiSchedule;
+
+ /**
+  * @struct MidiClock
+  * @brief Engine position at the start of the newest rendered block, for stamping events.
+  *
+  * Written by the render loop, read by the input thread. A sequence counter
+  * (odd while an update is in progress) keeps the fields consistent.
+  */
+ typedef struct {
+     atomic_uint seq;
+     atomic_ullong frame;    ///< Engine frame of the block start.
+     atomic_long time_us;    ///< audio_time_now() at the block start, in microseconds.
+     atomic_ulong block;     ///< Frames in the block.
+     atomic_ulong rate_mhz;  ///< Engine sample rate in millihertz, 0 until the first block.
+ } MidiClock;
+
+ /** @brief Empties the queue. Neither side may use it concurrently. */
+ void midi_queue_init(MidiQueue *q);
+
+ /**
+  * @brief Appends an event. Producer side.
+  * @return 1 on success, 0 if the queue is full (the event is dropped).
+  */
+ int midi_queue_push(MidiQueue *q, const MidiEvent *ev);
+
+ /**
+  * @brief Appends several events, published together: the consumer sees all of them or none.
+  * @return 1 on success, 0 if they do not all fit (none is queued).
+  */
+ int midi_queue_push_batch(MidiQueue *q, const MidiEvent *events, unsigned int count);
+
+ /**
+  * @brief Returns the oldest event without removing it. Consumer side.
+  * @return The event, or NULL if the queue is empty.
+  */
+ const MidiEvent *midi_queue_peek(MidiQueue *q);
+
+ /**
+  * @brief Returns the event `index` places after the oldest without removing anything. Consumer side.
+  * @return The event, or NULL if the queue holds no more than `index` events.
+  */
+ const MidiEvent *midi_queue_peek_at(MidiQueue *q, unsigned int index);
+
+ /** @brief Removes the event returned by midi_queue_peek(). Consumer side. */
+ void midi_queue_pop(MidiQueue *q);
+
+ /** @brief Empties the schedule. */
+ void midi_schedule_init(MidiSchedule *s);
+
+ /**
+  * @brief Adds an event in frame order.
+  * @return 1 on success, 0 if the schedule is full (the event is dropped).
+  */
+ int midi_schedule_push(MidiSchedule *s, const MidiEvent *ev);
+
+ /**
+  * @brief Returns the event with the earliest frame without removing it.
+  * @return The event, or NULL if the schedule is empty.
+  */
+ const MidiEvent *midi_schedule_peek(const MidiSchedule *s);
+
+ /** @brief Removes the event returned by midi_schedule_peek(). */
+ void midi_schedule_pop(MidiSchedule *s);
+
+ /** @brief Returns how many more events the schedule takes before it is full. */
+ unsigned int midi_schedule_space(const MidiSchedule *s);
+
+ /** @brief Forgets the published position; midi_clock_stamp() returns 0 until the next publish. */
+ void midi_clock_init(MidiClock *clock);
+
+ /**
+  * @brief Publishes the start of a block. Called by the render loop only.
+  * @param[in,out] clock The clock.
+  * @param frame Engine frame of the first sample of the block.
+  * @param time_sec audio_time_now() when rendering the block started.
+  * @param frames Frames in the block.
+  * @param rate Engine sample rate in Hz.
+  */
+ void midi_clock_publish(MidiClock *clock, uint64_t frame, double time_sec, unsigned long frames, double rate);
+
+ /**
+  * @brief Converts an arrival time into the engine frame the event plays at.
+  * @param[in] clock The clock.
+  * @param time_sec audio_time_now() when the event arrived.
+  * @return The frame one block after the arrival time, never before the start of the next block.
+  * 0 (play as soon as possible) if no block has been rendered yet.
+  */
+ uint64_t midi_clock_stamp(MidiClock *clock, double time_sec);
+
+ /**
+  * @brief When to send an event rendered at an engine frame, for MIDI output.
+  *
+  * Like received events, sent ones are delayed by a block: an event at frame
+  * `f` of the newest block goes out `(f - frame) / rate` seconds after the
+  * block started rendering, so events keep their spacing however the blocks
+  * are timed.
+  * @param[in] clock The clock.
+  * @param frame Engine frame of the event.
+  * @return The audio_time_now() time to send at, or -1 if no block has been rendered yet.
+  */
+ double midi_clock_time(MidiClock *clock, uint64_t frame);
+
+ /**
+  * @brief Equal-tempered frequency of a MIDI note (A4 = note 69 = 440 Hz).
+  * @param note Note number 0-127.
+  * @return Frequency in Hz.
+  */
+ double midi_note_to_freq(int note);
+
+ #endif // MIDI_H
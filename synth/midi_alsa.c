@@ -0,0 +1,311 @@
+/**
+ * @file midi_alsa.c
+ * @brief ALSA sequencer input thread feeding the audio engine's event queue.
+ *
+ * The sequencer is opened non-blocking; the thread sleeps in poll() on its
+ * descriptors and a stop pipe, then drains every pending event. Events are
+ * timestamped on arrival with audio_time_now(): the sequencer's own queue
+ * timestamps would need a running queue and a second clock to reconcile.
+ * The thread runs with real-time priority when permitted so the arrival
+ * time stays close to the time the event was sent.
+ *
+ * When the engine sends MIDI clock, the same thread sends it from a second,
+ * readable port: poll() sleeps until the millisecond before the next tick is
+ * due, a nanosleep() covers the rest, and the tick goes out directly to the
+ * subscribers. Clock, Start, Continue and Stop received on the input port go
+ * to the engine like any other event.
+ *
+ * The whole file compiles to nothing unless `HAVE_ALSA` is defined.
+ */
+
+ #ifdef HAVE_ALSA
+
+ #include <alsa/asoundlib.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <poll.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <errno.h>
+ #include <unistd.h>
+ #include <stdatomic.h>
+ #include <time.h>
+
+ #include "midi_alsa.h"
+ #include "audio.h"
+ #include "audio_internal.h"
+
+ // --- Constants ---
+ #define MIDI_CLIENT_NAME "A2 Synthesizer"
+ #define MIDI_PORT_NAME "MIDI In"
+ #define MIDI_CLOCK_PORT_NAME "Clock Out"
+ #define MIDI_CLOCK_IDLE_MS 1      ///< poll() timeout while no clock message waits: the engine queues a block's ticks at a time.
+ #define MIDI_RT_PRIORITY_OFFSET 5 ///< Above the ALSA render thread: the input thread only stamps and queues.
+
+ /**
+  * @struct AlsaMidiInput
+  * @brief State of the sequencer input. Only one instance exists.
+  */
+ typedef struct {
+     snd_seq_t *seq;          ///< Open sequencer, NULL when stopped.
+     int port;                ///< Our writable port.
+     int clock_port;          ///< Our readable port sending MIDI clock, -1 if the engine sends none.
+     pthread_t thread;
+     int thread_started;
+     atomic_int running;      ///< Cleared by midi_alsa_stop() to end the thread.
+     int stop_pipe[2];        ///< Wakes the thread out of poll() on stop.
+     struct pollfd *pfds;     ///< Sequencer descriptors followed by the stop pipe's read end.
+     int seq_nfds;
+ } AlsaMidiInput;
+
+ static AlsaMidiInput g_midiIn = { .port = -1, .clock_port = -1, .stop_pipe = { -1, -1 } };
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Passes one sequencer event on to the engine. Other event types are ignored.
+  */
+ static void midi_alsa_dispatch(const snd_seq_event_t *ev) {
+     switch (ev->type) {
+         case SND_SEQ_EVENT_NOTEON:
+             audio_midi_input(MIDI_EVENT_NOTE_ON, ev->data.note.channel, ev->data.note.note, ev->data.note.velocity);
+             break;
+         case SND_SEQ_EVENT_NOTEOFF:
+             audio_midi_input(MIDI_EVENT_NOTE_OFF, ev->data.note.channel, ev->data.note.note, ev->data.note.velocity);
+             break;
+         case SND_SEQ_EVENT_CONTROLLER:
+             audio_midi_input(MIDI_EVENT_CONTROL, ev->data.control.channel, (int)ev->data.control.param, ev->data.control.value);
+             break;
+         case SND_SEQ_EVENT_PITCHBEND: {
+             int bend = ev->data.control.value + MIDI_BEND_CENTRE; // The sequencer centres it on 0
+             audio_midi_input(MIDI_EVENT_PITCH_BEND, ev->data.control.channel, bend & 0x7f, (bend >> 7) & 0x7f);
+             break;
+         }
+         case SND_SEQ_EVENT_CHANPRESS:
+             audio_midi_input(MIDI_EVENT_PRESSURE, ev->data.control.channel, ev->data.control.value, 0);
+             break;
+         case SND_SEQ_EVENT_CLOCK:
+             audio_midi_input(MIDI_EVENT_CLOCK, 0, 0, 0);
+             break;
+         case SND_SEQ_EVENT_START:
+             audio_midi_input(MIDI_EVENT_START, 0, 0, 0);
+             break;
+         case SND_SEQ_EVENT_CONTINUE:
+             audio_midi_input(MIDI_EVENT_CONTINUE, 0, 0, 0);
+             break;
+         case SND_SEQ_EVENT_STOP:
+             audio_midi_input(MIDI_EVENT_STOP, 0, 0, 0);
+             break;
+         default:
+             break;
+     }
+ }
+
+ /**
+  * @brief Sends a real-time message (SND_SEQ_EVENT_CLOCK, _START or _STOP) to the subscribers of the clock port.
+  */
+ static void midi_alsa_send_realtime(AlsaMidiInput *in, snd_seq_event_type_t type) {
+     snd_seq_event_t ev;
+     int err;
+
+     snd_seq_ev_clear(&ev);
+     ev.type = type;
+     snd_seq_ev_set_source(&ev, in->clock_port);
+     snd_seq_ev_set_subs(&ev);
+     snd_seq_ev_set_direct(&ev);
+     if ((err = snd_seq_event_output_direct(in->seq, &ev)) < 0 && err != -EAGAIN) {
+         fprintf(stderr, "MIDI Error: cannot send clock: %s\n", snd_strerror(err));
+     }
+ }
+
+ /**
+  * @brief Sends the clock messages that are due.
+  * @return poll() timeout until the next one, in milliseconds (-1 to wait for input only).
+  */
+ static int midi_alsa_send_clock(AlsaMidiInput *in) {
+     MidiEvent ev;
+     double due, wait;
+
+     if (in->clock_port < 0) return -1;
+     while (audio_midi_clock_peek(&ev, &due)) {
+         wait = due - audio_time_now();
+         if (wait >= 0.001) return (int)(wait * 1000.0);
+         if (wait > 0.0) {
+             struct timespec ts = { 0, (long)(wait * 1e9) };
+             nanosleep(&ts, NULL);
+         }
+         midi_alsa_send_realtime(in, (ev.type == MIDI_EVENT_START) ? SND_SEQ_EVENT_START : SND_SEQ_EVENT_CLOCK);
+         audio_midi_clock_sent(audio_time_now() - due);
+     }
+     return MIDI_CLOCK_IDLE_MS;
+ }
+
+ /**
+  * @brief MIDI thread: drains the sequencer and sends the clock that is due, then sleeps in poll().
+  */
+ static void *midi_alsa_thread_main(void *arg) {
+     AlsaMidiInput *in = (AlsaMidiInput *)arg;
+
+     while (atomic_load(&in->running)) {
+         snd_seq_event_t *ev = NULL;
+         int err, timeout;
+
+         while ((err = snd_seq_event_input(in->seq, &ev)) >= 0 && ev != NULL) {
+             midi_alsa_dispatch(ev);
+         }
+         if (err == -ENOSPC) {
+             fprintf(stderr, "Warning: ALSA sequencer input overrun, MIDI events were lost.\n");
+         } else if (err != -EAGAIN) {
+             fprintf(stderr, "MIDI Error: snd_seq_event_input: %s\n", snd_strerror(err));
+             break;
+         }
+
+         timeout = midi_alsa_send_clock(in);
+         if (poll(in->pfds, (nfds_t)in->seq_nfds + 1, timeout) < 0) {
+             if (errno == EINTR) continue;
+             fprintf(stderr, "MIDI Error: poll: %s\n", strerror(errno));
+             break;
+         }
+         if (in->pfds[in->seq_nfds].revents & POLLIN) break; // Stop requested
+     }
+
+     atomic_store(&in->running, 0);
+     return NULL;
+ }
+
+ /**
+  * @brief Starts the input thread with SCHED_FIFO, falling back to normal scheduling.
+  * @return 0 on success, an errno value on failure.
+  */
+ static int midi_alsa_start_thread(AlsaMidiInput *in) {
+     pthread_attr_t attr;
+     struct sched_param param;
+     int ret;
+
+     pthread_attr_init(&attr);
+     pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+     pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+     param.sched_priority = sched_get_priority_max(SCHED_FIFO) - MIDI_RT_PRIORITY_OFFSET;
+     pthread_attr_setschedparam(&attr, &param);
+     ret = pthread_create(&in->thread, &attr, midi_alsa_thread_main, in);
+     pthread_attr_destroy(&attr);
+
+     if (ret == EPERM) {
+         ret = pthread_create(&in->thread, NULL, midi_alsa_thread_main, in);
+     }
+     if (ret == 0) in->thread_started = 1;
+     return ret;
+ }
+
+ /**
+  * @brief Releases everything owned by the input state.
+  */
+ static void midi_alsa_release(AlsaMidiInput *in) {
+     if (in->seq) { snd_seq_close(in->seq); in->seq = NULL; }
+     if (in->stop_pipe[0] >= 0) { close(in->stop_pipe[0]); in->stop_pipe[0] = -1; }
+     if (in->stop_pipe[1] >= 0) { close(in->stop_pipe[1]); in->stop_pipe[1] = -1; }
+     free(in->pfds); in->pfds = NULL;
+     in->port = -1;
+     in->clock_port = -1;
+     in->thread_started = 0;
+ }
+
+
+ // --- Public Functions ---
+
+ int midi_alsa_start(const char *source, int clock_out) {
+     AlsaMidiInput *in = &g_midiIn;
+     int err;
+
+     if (in->seq != NULL) return 1;
+
+     err = snd_seq_open(&in->seq, "default", clock_out ? SND_SEQ_OPEN_DUPLEX : SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK);
+     if (err < 0) {
+         fprintf(stderr, "MIDI Error: cannot open the ALSA sequencer: %s\n", snd_strerror(err));
+         in->seq = NULL;
+         return 0;
+     }
+     snd_seq_set_client_name(in->seq, MIDI_CLIENT_NAME);
+     in->port = snd_seq_create_simple_port(in->seq, MIDI_PORT_NAME,
+                                           SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                           SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+     if (in->port < 0) {
+         fprintf(stderr, "MIDI Error: cannot create sequencer port: %s\n", snd_strerror(in->port));
+         midi_alsa_release(in);
+         return 0;
+     }
+     if (clock_out) {
+         in->clock_port = snd_seq_create_simple_port(in->seq, MIDI_CLOCK_PORT_NAME,
+                                                     SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                                     SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+         if (in->clock_port < 0) {
+             fprintf(stderr, "MIDI Error: cannot create clock port: %s\n", snd_strerror(in->clock_port));
+             midi_alsa_release(in);
+             return 0;
+         }
+     }
+
+     if (source != NULL && source[0] != '\0') {
+         snd_seq_addr_t addr;
+         if ((err = snd_seq_parse_address(in->seq, &addr, source)) < 0 ||
+             (err = snd_seq_connect_from(in->seq, in->port, addr.client, addr.port)) < 0) {
+             fprintf(stderr, "MIDI Error: cannot connect from '%s': %s\n", source, snd_strerror(err));
+             midi_alsa_release(in);
+             return 0;
+         }
+     }
+
+     in->seq_nfds = snd_seq_poll_descriptors_count(in->seq, POLLIN);
+     in->pfds = (in->seq_nfds > 0) ? calloc((size_t)in->seq_nfds + 1, sizeof(struct pollfd)) : NULL;
+     if (!in->pfds || pipe(in->stop_pipe) != 0) {
+         fprintf(stderr, "MIDI Error: cannot allocate input resources.\n");
+         midi_alsa_release(in);
+         return 0;
+     }
+     snd_seq_poll_descriptors(in->seq, in->pfds, (unsigned int)in->seq_nfds, POLLIN);
+     in->pfds[in->seq_nfds].fd = in->stop_pipe[0];
+     in->pfds[in->seq_nfds].events = POLLIN;
+
+     atomic_store(&in->running, 1);
+     err = midi_alsa_start_thread(in);
+     if (err != 0) {
+         fprintf(stderr, "MIDI Error: cannot create input thread: %s\n", strerror(err));
+         atomic_store(&in->running, 0);
+         midi_alsa_release(in);
+         return 0;
+     }
+
+     printf("MIDI input on ALSA sequencer port %d:%d%s%s\n", snd_seq_client_id(in->seq), in->port,
+            (source && source[0]) ? ", connected from " : "", (source && source[0]) ? source : "");
+     if (in->clock_port >= 0) printf("MIDI clock out on ALSA sequencer port %d:%d\n", snd_seq_client_id(in->seq), in->clock_port);
+     return 1;
+ }
+
+ void midi_alsa_stop(void) {
+     AlsaMidiInput *in = &g_midiIn;
+
+     if (in->seq == NULL) return;
+
+     atomic_store(&in->running, 0);
+     if (in->thread_started) {
+         char c = 0;
+         if (write(in->stop_pipe[1], &c, 1) < 0) {
+             fprintf(stderr, "Warning: cannot wake MIDI thread: %s\n", strerror(errno));
+         }
+         pthread_join(in->thread, NULL);
+     }
+     if (in->clock_port >= 0) midi_alsa_send_realtime(in, SND_SEQ_EVENT_STOP); // Receivers stop with us
+     midi_alsa_release(in);
+     printf("MIDI input closed.\n");
+ }
+
+ int midi_alsa_address(int *client, int *port) {
+     if (g_midiIn.seq == NULL) return 0;
+     if (client) *client = snd_seq_client_id(g_midiIn.seq);
+     if (port) *port = g_midiIn.port;
+     return 1;
+ }
+
+ #endif // HAVE_ALSA
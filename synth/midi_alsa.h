@@ -0,0 +1,44 @@
+/**
+ * @file midi_alsa.h
+ * @brief MIDI input from the ALSA sequencer.
+ *
+ * Creates a sequencer client with one writable port that other clients
+ * (hardware keyboards, `aseqdump`-style tools, virtual keyboards) connect to.
+ * A dedicated thread waits in poll() on the sequencer and hands every note
+ * and controller event to audio_midi_input(), which stamps it against the
+ * audio clock. With MIDI clock out, a second, readable port sends the
+ * engine's clock ticks from the same thread. Only available when built with
+ * `HAVE_ALSA`.
+ */
+
+ #ifndef MIDI_ALSA_H
+ #define MIDI_ALSA_H
+
+ #ifdef HAVE_ALSA
+
+ /**
+  * @brief Opens the sequencer, creates the input port and starts the input thread.
+  * @param[in] source Client and port to connect from ("20:0", "Virtual Raw MIDI 1-0"),
+  * or NULL / "" to wait for connections (e.g. from `aconnect`).
+  * @param clock_out Non-zero to also create the "Clock Out" port and send the engine's
+  * MIDI clock (see audio_midi_clock_peek()), with a Stop when stopped.
+  * @return 1 on success, 0 if the sequencer is unavailable or the source cannot be connected.
+  */
+ int midi_alsa_start(const char *source, int clock_out);
+
+ /**
+  * @brief Stops the input thread and closes the sequencer. Safe to call when not running.
+  */
+ void midi_alsa_stop(void);
+
+ /**
+  * @brief Sequencer address of the input port, for connecting to it.
+  * @param[out] client Client number.
+  * @param[out] port Port number.
+  * @return 1 if the port exists, 0 otherwise.
+  */
+ int midi_alsa_address(int *client, int *port);
+
+ #endif // HAVE_ALSA
+
+ #endif // MIDI_ALSA_H
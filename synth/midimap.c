@@ -0,0 +1,112 @@
+/**
+ * @file midimap.c
+ * @brief Implements controller scaling and the parameter/curve name tables.
+ */
+
+ #include <math.h>
+ #include <string.h>
+
+ #include "midimap.h"
+
+ #define MIDI_MAP_TAPER_RATIO 1000.0 ///< End-to-start ratio of the exponential curve when the range touches 0 (60 dB).
+
+ /**
+  * @struct ParamInfo
+  * @brief Name, slider range and natural curve of a parameter.
+  */
+ typedef struct {
+     const char *name;
+     double min, max;
+     MidiCurve curve;
+ } ParamInfo;
+
+ // Ranges match the GUI sliders
+ static const ParamInfo g_paramInfo[SYNTH_PARAM_COUNT] = {
+     [SYNTH_PARAM_FREQ1]    = { "freq1",    20.0, 2000.0, MIDI_CURVE_EXP },
+     [SYNTH_PARAM_AMP1]     = { "amp1",     0.0, 1.0, MIDI_CURVE_LINEAR },
+     [SYNTH_PARAM_ATTACK1]  = { "attack1",  0.0, 2.0, MIDI_CURVE_EXP },
+     [SYNTH_PARAM_DECAY1]   = { "decay1",   0.0, 2.0, MIDI_CURVE_EXP },
+     [SYNTH_PARAM_SUSTAIN1] = { "sustain1", 0.0, 1.0, MIDI_CURVE_LINEAR },
+     [SYNTH_PARAM_RELEASE1] = { "release1", 0.0, 5.0, MIDI_CURVE_EXP },
+     [SYNTH_PARAM_FREQ2]    = { "freq2",    20.0, 2000.0, MIDI_CURVE_EXP },
+     [SYNTH_PARAM_AMP2]     = { "amp2",     0.0, 1.0, MIDI_CURVE_LINEAR },
+     [SYNTH_PARAM_ATTACK2]  = { "attack2",  0.0, 2.0, MIDI_CURVE_EXP },
+     [SYNTH_PARAM_DECAY2]   = { "decay2",   0.0, 2.0, MIDI_CURVE_EXP },
+     [SYNTH_PARAM_SUSTAIN2] = { "sustain2", 0.0, 1.0, MIDI_CURVE_LINEAR },
+     [SYNTH_PARAM_RELEASE2] = { "release2", 0.0, 5.0, MIDI_CURVE_EXP },
+ };
+
+ static const char *const g_curveNames[] = { "linear", "exp", "log" };
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Position 0-1 within the range for a travel 0-1 on the exponential curve.
+  *
+  * For a positive range `min * (max/min)^x`; otherwise the same shape with a
+  * fixed ratio, so a range starting at 0 still gets the fine control near 0.
+  */
+ static double exp_shape(const MidiMapping *m, double x) {
+     double ratio = (m->min > 0.0 && m->max > 0.0) ? m->max / m->min : MIDI_MAP_TAPER_RATIO;
+
+     if (fabs(ratio - 1.0) < 1e-9) return x;
+     return (pow(ratio, x) - 1.0) / (ratio - 1.0);
+ }
+
+
+ // --- Public Functions ---
+
+ void midimap_init(MidiMap *map) {
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         map->params[i] = midimap_default((SynthParam)i, MIDI_MAP_ANY_CHANNEL, -1);
+     }
+ }
+
+ MidiMapping midimap_default(SynthParam param, int channel, int cc) {
+     MidiMapping m = { .cc = cc, .channel = channel, .min = 0.0, .max = 1.0, .curve = MIDI_CURVE_LINEAR };
+
+     if (param >= 0 && param < SYNTH_PARAM_COUNT) {
+         m.min = g_paramInfo[param].min;
+         m.max = g_paramInfo[param].max;
+         m.curve = g_paramInfo[param].curve;
+     }
+     return m;
+ }
+
+ double midimap_scale(const MidiMapping *m, int value) {
+     double x = (value <= 0) ? 0.0 : (value >= 127) ? 1.0 : value / 127.0;
+     double t;
+
+     switch (m->curve) {
+         case MIDI_CURVE_EXP: t = exp_shape(m, x); break;
+         case MIDI_CURVE_LOG: t = 1.0 - exp_shape(m, 1.0 - x); break;
+         default:             t = x; break;
+     }
+     // The ends are exact, whatever the rounding of pow()
+     if (value <= 0) return m->min;
+     if (value >= 127) return m->max;
+     return m->min + (m->max - m->min) * t;
+ }
+
+ const char *midimap_param_name(SynthParam param) {
+     return (param >= 0 && param < SYNTH_PARAM_COUNT) ? g_paramInfo[param].name : "unknown";
+ }
+
+ int midimap_param_from_name(const char *name) {
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         if (strcmp(name, g_paramInfo[i].name) == 0) return i;
+     }
+     return -1;
+ }
+
+ const char *midimap_curve_name(MidiCurve curve) {
+     return (curve >= MIDI_CURVE_LINEAR && curve <= MIDI_CURVE_LOG) ? g_curveNames[curve] : "unknown";
+ }
+
+ int midimap_curve_from_name(const char *name) {
+     for (int i = 0; i <= MIDI_CURVE_LOG; i++) {
+         if (strcmp(name, g_curveNames[i]) == 0) return i;
+     }
+     return -1;
+ }
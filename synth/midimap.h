@@ -0,0 +1,118 @@
+/**
+ * @file midimap.h
+ * @brief Assignment of MIDI controllers to synth parameters, with range and curve.
+ *
+ * Every slider of both waves (frequency, amplitude and the four ADSR values)
+ * is a SynthParam. A MidiMapping ties one parameter to a controller number,
+ * optionally restricted to one channel, and scales the 0-127 controller value
+ * into a range of the parameter through a curve. The table is plain data: the
+ * audio engine keeps a private copy for the render thread and applies the
+ * mapped values itself.
+ */
+
+ #ifndef MIDIMAP_H
+ #define MIDIMAP_H
+
+ // --- Constants ---
+ #define MIDI_MAP_CONTROLLERS 120 ///< Controllers 0-119 can be mapped; 120-127 are channel mode messages.
+ #define MIDI_MAP_ANY_CHANNEL -1  ///< MidiMapping::channel value matching every channel.
+
+ /**
+  * @enum SynthParam
+  * @brief The parameters a controller can drive, in the order of the GUI.
+  */
+ typedef enum {
+     SYNTH_PARAM_FREQ1,
+     SYNTH_PARAM_AMP1,
+     SYNTH_PARAM_ATTACK1,
+     SYNTH_PARAM_DECAY1,
+     SYNTH_PARAM_SUSTAIN1,
+     SYNTH_PARAM_RELEASE1,
+     SYNTH_PARAM_FREQ2,
+     SYNTH_PARAM_AMP2,
+     SYNTH_PARAM_ATTACK2,
+     SYNTH_PARAM_DECAY2,
+     SYNTH_PARAM_SUSTAIN2,
+     SYNTH_PARAM_RELEASE2,
+     SYNTH_PARAM_COUNT
+ } SynthParam;
+
+ /**
+  * @enum MidiCurve
+  * @brief Shape of the controller travel across the range.
+  */
+ typedef enum {
+     MIDI_CURVE_LINEAR, ///< Equal steps.
+     MIDI_CURVE_EXP,    ///< Equal ratios (geometric) for a positive range, else a 60 dB taper: fine control at the start.
+     MIDI_CURVE_LOG     ///< The mirror image of MIDI_CURVE_EXP: fine control at the end.
+ } MidiCurve;
+
+ /**
+  * @struct MidiMapping
+  * @brief One parameter's controller assignment.
+  */
+ typedef struct {
+     int cc;             ///< Controller 0-119, -1 if the parameter is not mapped.
+     int channel;        ///< Channel 0-15 or MIDI_MAP_ANY_CHANNEL.
+     double min;         ///< Value at controller 0 (may exceed `max` for a reversed knob).
+     double max;         ///< Value at controller 127.
+     MidiCurve curve;
+ } MidiMapping;
+
+ /**
+  * @struct MidiMap
+  * @brief Controller assignment of every parameter, indexed by SynthParam.
+  */
+ typedef struct {
+     MidiMapping params[SYNTH_PARAM_COUNT];
+ } MidiMap;
+
+ /** @brief Unmaps every parameter. */
+ void midimap_init(MidiMap *map);
+
+ /**
+  * @brief Returns a parameter's default mapping for a controller: its full slider range and natural curve.
+  * @param param The parameter.
+  * @param channel Channel 0-15 or MIDI_MAP_ANY_CHANNEL.
+  * @param cc Controller 0-119.
+  */
+ MidiMapping midimap_default(SynthParam param, int channel, int cc);
+
+ /**
+  * @brief Scales a controller value through a mapping's range and curve.
+  * @param[in] m The mapping.
+  * @param value Controller value 0-127.
+  * @return The parameter value.
+  */
+ double midimap_scale(const MidiMapping *m, int value);
+
+ /**
+  * @brief Tests whether a mapping reacts to a controller message.
+  */
+ static inline int midimap_matches(const MidiMapping *m, int channel, int cc) {
+     return m->cc == cc && (m->channel == MIDI_MAP_ANY_CHANNEL || m->channel == channel);
+ }
+
+ /**
+  * @brief Returns a parameter's name as used in the configuration ("freq1", "release2", ...).
+  */
+ const char *midimap_param_name(SynthParam param);
+
+ /**
+  * @brief Looks up a parameter by name.
+  * @return The parameter, or -1 if the name is unknown.
+  */
+ int midimap_param_from_name(const char *name);
+
+ /**
+  * @brief Returns a curve's name ("linear", "exp", "log").
+  */
+ const char *midimap_curve_name(MidiCurve curve);
+
+ /**
+  * @brief Looks up a curve by name.
+  * @return The curve, or -1 if the name is unknown.
+  */
+ int midimap_curve_from_name(const char *name);
+
+ #endif // MIDIMAP_H
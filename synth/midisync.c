@@ -0,0 +1,136 @@
+/**
+ * @file midisync.c
+ * @brief Implements MIDI clock sync: the delay-locked loop, transport and jitter statistics.
+ */
+
+ #include <math.h>
+
+ #include "midisync.h"
+
+
+ // --- Helper Functions ---
+
+ /** @brief Frames per tick at `tempo` beats per minute. */
+ static double midisync_period_of(const MidiSync *s, double tempo) {
+     return s->sample_rate * 60.0 / (tempo * MIDISYNC_PPQN);
+ }
+
+ /** @brief Starts locking again on the tick at `frame`, keeping the period if there is one. */
+ static void midisync_relock(MidiSync *s, uint64_t frame) {
+     s->state = MIDISYNC_LOCKING;
+     s->state_ticks = 0;
+     s->tick_frame = (double)frame;
+     s->next = (double)frame + s->period;
+ }
+
+
+ // --- Public Functions ---
+
+ void midisync_init(MidiSync *s, double sample_rate) {
+     *s = (MidiSync){ .sample_rate = sample_rate, .state = MIDISYNC_IDLE, .running = 1 };
+ }
+
+ void midisync_set_sample_rate(MidiSync *s, double sample_rate) {
+     if (sample_rate == s->sample_rate) return;
+     s->sample_rate = sample_rate;
+     s->state = MIDISYNC_IDLE;
+     s->period = 0.0;
+ }
+
+ int midisync_tick(MidiSync *s, uint64_t frame) {
+     const double min_period = midisync_period_of(s, MIDISYNC_MAX_TEMPO);
+     const double max_period = midisync_period_of(s, MIDISYNC_MIN_TEMPO);
+     double error, omega;
+
+     s->ticks++;
+     s->tick = (s->restarted || s->ticks == 1) ? 0 : s->tick + 1;
+     s->restarted = 0;
+     if (s->sample_rate <= 0.0) return 0;
+
+     if (s->state == MIDISYNC_IDLE || s->period == 0.0) {
+         // The second tick gives the first period; until then there is no tempo
+         double spacing = (double)(frame - s->last_frame);
+         if (s->state != MIDISYNC_IDLE && frame > s->last_frame && spacing >= min_period && spacing <= max_period) {
+             s->period = spacing;
+         }
+         s->last_frame = frame;
+         midisync_relock(s, frame);
+         return s->period > 0.0;
+     }
+     s->last_frame = frame;
+
+     error = (double)frame - s->next;
+     if (fabs(error) > s->period) {
+         // Missed ticks or a stall, not jitter: lock again from here
+         midisync_relock(s, frame);
+         return 1;
+     }
+     omega = 2.0 * M_PI * ((s->state == MIDISYNC_LOCKED) ? MIDISYNC_BANDWIDTH : MIDISYNC_LOCK_BANDWIDTH) * s->period / s->sample_rate;
+     if (omega > MIDISYNC_MAX_OMEGA) omega = MIDISYNC_MAX_OMEGA;
+     s->tick_frame = s->next;
+     s->next += sqrt(2.0) * omega * error + s->period;
+     s->period += omega * omega * error;
+     if (s->period < min_period) s->period = min_period;
+     if (s->period > max_period) s->period = max_period;
+
+     s->error_last = error;
+     if (s->state == MIDISYNC_LOCKED) {
+         s->errors++;
+         s->error_sq += error * error;
+         if (fabs(error) > s->error_max) s->error_max = fabs(error);
+     } else if (++s->state_ticks >= MIDISYNC_PPQN) {
+         s->state = MIDISYNC_LOCKED;
+     }
+     return 1;
+ }
+
+ void midisync_start(MidiSync *s) {
+     s->running = 1;
+     s->restarted = 1;
+ }
+
+ void midisync_continue(MidiSync *s) {
+     s->running = 1;
+ }
+
+ void midisync_stop(MidiSync *s) {
+     s->running = 0;
+ }
+
+ int midisync_check(MidiSync *s, uint64_t frame) {
+     double limit;
+
+     if (s->state == MIDISYNC_IDLE || frame <= s->last_frame) return 0;
+     limit = MIDISYNC_TIMEOUT_TICKS * ((s->period > 0.0) ? s->period : midisync_period_of(s, MIDISYNC_MIN_TEMPO));
+     if ((double)(frame - s->last_frame) <= limit) return 0;
+     s->state = MIDISYNC_IDLE;
+     return s->period > 0.0;
+ }
+
+ double midisync_tempo(const MidiSync *s) {
+     double tempo;
+
+     if (s->period <= 0.0) return 0.0;
+     tempo = s->sample_rate * 60.0 / (s->period * MIDISYNC_PPQN);
+     return (tempo < MIDISYNC_MIN_TEMPO) ? MIDISYNC_MIN_TEMPO : (tempo > MIDISYNC_MAX_TEMPO) ? MIDISYNC_MAX_TEMPO : tempo;
+ }
+
+ void midisync_position(const MidiSync *s, double *beat_frame, double *beat) {
+     *beat_frame = s->tick_frame;
+     *beat = (double)s->tick / MIDISYNC_PPQN;
+ }
+
+ int midisync_jitter(const MidiSync *s, double *rms_ms, double *max_ms) {
+     if (s->errors == 0 || s->sample_rate <= 0.0) return 0;
+     *rms_ms = 1000.0 * sqrt(s->error_sq / (double)s->errors) / s->sample_rate;
+     *max_ms = 1000.0 * s->error_max / s->sample_rate;
+     return 1;
+ }
+
+ const char *midisync_mode_name(MidiClockMode mode) {
+     switch (mode) {
+         case MIDI_CLOCK_IN: return "in";
+         case MIDI_CLOCK_OUT: return "out";
+         default: return "off";
+     }
+ }
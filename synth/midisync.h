@@ -0,0 +1,130 @@
+/**
+ * @file midisync.h
+ * @brief MIDI clock sync: a delay-locked loop that turns received clock ticks into a smooth tempo and beat position.
+ *
+ * A MIDI clock sends 24 ticks per quarter note. Their arrival frames (stamped
+ * against the audio clock like any MIDI event, see midi.h) jitter by the
+ * sender's, the cable's and our own scheduling, often by a millisecond or
+ * more, so the tick spacing alone would make a nervous tempo. The loop
+ * predicts the frame of the next tick from a smoothed tick period, and each
+ * tick corrects prediction and period by a fraction of the error: a
+ * second-order delay-locked loop whose bandwidth sets how much jitter it
+ * averages out against how fast it follows a tempo change. It locks on a
+ * wider bandwidth for the first beat and then narrows to
+ * MIDISYNC_BANDWIDTH.
+ *
+ * The smoothed frames of the ticks and their count since the last Start give
+ * the beat position on the engine's sample timeline, which the arpeggiator
+ * and the sequencer lay their grids on (see arp_sync() and seq_sync()). The
+ * prediction errors are the jitter statistics.
+ *
+ * A MidiSync belongs to the render thread; nothing here blocks or allocates.
+ */
+
+ #ifndef MIDISYNC_H
+ #define MIDISYNC_H
+
+ #include <stdint.h>
+
+ // --- Constants ---
+ #define MIDISYNC_PPQN 24                 ///< Clock ticks per quarter note.
+ #define MIDISYNC_BANDWIDTH 0.5           ///< Loop bandwidth in Hz once locked: jitter is averaged over about two seconds.
+ #define MIDISYNC_LOCK_BANDWIDTH 4.0      ///< Loop bandwidth in Hz for the first beat.
+ #define MIDISYNC_MAX_OMEGA 0.5           ///< Caps the loop gain per tick, for slow clocks.
+ #define MIDISYNC_TIMEOUT_TICKS 4.0       ///< Tick periods without a tick after which the clock counts as lost.
+ #define MIDISYNC_MIN_TEMPO 20.0          ///< Tempo range a clock is followed in, beats per minute.
+ #define MIDISYNC_MAX_TEMPO 300.0
+
+ /**
+  * @enum MidiClockMode
+  * @brief Whether the engine follows a MIDI clock, sends one or neither.
+  */
+ typedef enum {
+     MIDI_CLOCK_OFF,   ///< The internal tempo, nothing sent.
+     MIDI_CLOCK_IN,    ///< Follow the clock, Start, Stop and Continue received on the MIDI input.
+     MIDI_CLOCK_OUT    ///< Send clock ticks of the internal tempo and Start/Stop from a MIDI output port.
+ } MidiClockMode;
+
+ /**
+  * @enum MidiSyncState
+  * @brief How far the loop is locked to the received clock.
+  */
+ typedef enum {
+     MIDISYNC_IDLE,      ///< No clock (yet, or lost).
+     MIDISYNC_LOCKING,   ///< Following, on the wide bandwidth.
+     MIDISYNC_LOCKED     ///< Following, on MIDISYNC_BANDWIDTH.
+ } MidiSyncState;
+
+ /**
+  * @struct MidiSync
+  * @brief Loop state, transport and jitter statistics of the received clock.
+  */
+ typedef struct {
+     double sample_rate;
+     MidiSyncState state;
+     int running;                    ///< Transport: cleared by Stop, set by Start and Continue.
+     int restarted;                  ///< A Start arrived: the next tick is beat 0.
+     double period;                  ///< Smoothed frames per tick, 0 until two ticks arrived.
+     double tick_frame;              ///< Smoothed frame of the last tick...
+     uint64_t tick;                  ///< ...and its number since the last Start (or the first tick).
+     double next;                    ///< Predicted frame of the next tick.
+     uint64_t last_frame;            ///< Frame the last tick arrived at.
+     unsigned long ticks;            ///< Ticks received since midisync_init().
+     unsigned long state_ticks;      ///< Ticks since locking started.
+     unsigned long errors;           ///< Prediction errors in the statistics: ticks while locked.
+     double error_sq;                ///< Sum of squared prediction errors while locked, in frames.
+     double error_max;               ///< Largest prediction error while locked, in frames.
+     double error_last;              ///< Prediction error of the last tick, in frames.
+ } MidiSync;
+
+ /** @brief Resets the loop to no clock, the transport running, the statistics cleared. */
+ void midisync_init(MidiSync *s, double sample_rate);
+
+ /** @brief Sets the engine rate the frames count at; a changed rate restarts locking. */
+ void midisync_set_sample_rate(MidiSync *s, double sample_rate);
+
+ /**
+  * @brief Feeds a clock tick.
+  * @param frame Engine frame the tick arrived at.
+  * @return 1 if the loop has a tempo and position (from the second tick on), 0 otherwise.
+  */
+ int midisync_tick(MidiSync *s, uint64_t frame);
+
+ /** @brief Start: the transport runs from beat 0, which is the next tick. */
+ void midisync_start(MidiSync *s);
+
+ /** @brief Continue: the transport runs on from the current position. */
+ void midisync_continue(MidiSync *s);
+
+ /** @brief Stop: the transport stops; ticks keep the tempo. */
+ void midisync_stop(MidiSync *s);
+
+ /**
+  * @brief Checks for a lost clock at `frame`.
+  * @return 1 if the clock was followed and no tick arrived for MIDISYNC_TIMEOUT_TICKS periods
+  * (the loop is then idle and starts locking again with the next tick), 0 otherwise.
+  */
+ int midisync_check(MidiSync *s, uint64_t frame);
+
+ /** @brief Tempo of the smoothed tick period in beats per minute, clamped to the followed range; 0 without one. */
+ double midisync_tempo(const MidiSync *s);
+
+ /**
+  * @brief Where the clock's beats fall on the engine timeline.
+  * @param[out] beat_frame Smoothed frame of the last tick.
+  * @param[out] beat Its position in beats since the last Start.
+  */
+ void midisync_position(const MidiSync *s, double *beat_frame, double *beat);
+
+ /**
+  * @brief Jitter of the ticks against the loop's prediction since it locked.
+  * @param[out] rms_ms Root mean square in milliseconds.
+  * @param[out] max_ms Largest in milliseconds.
+  * @return 1 if there are statistics, 0 before the loop locked.
+  */
+ int midisync_jitter(const MidiSync *s, double *rms_ms, double *max_ms);
+
+ /** @brief Name of a MidiClockMode as in the configuration ("off", "in", "out"). */
+ const char *midisync_mode_name(MidiClockMode mode);
+
+ #endif // MIDISYNC_H
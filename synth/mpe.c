@@ -0,0 +1,136 @@
+/**
+ * @file mpe.c
+ * @brief Implements the MPE voice pool: allocation, stealing and the expression ramps.
+ */
+
+ #include <string.h>
+
+ #include "mpe.h"
+
+ #define MPE_ALL_VOICES (~(uint64_t)0)
+
+
+ // --- Helper Functions ---
+
+ /** @brief Expression a voice of `channel` aims for in dimension `dim`. */
+ static float mpe_channel_target(const MpeVoices *m, int channel, MpeDimension dim) {
+     const float master = m->channel_value[MPE_MASTER_CHANNEL][MPE_BEND] * (float)MPE_MASTER_BEND_RANGE;
+
+     if (dim != MPE_BEND) return m->channel_value[channel][dim];
+     if (channel == MPE_MASTER_CHANNEL) return master;
+     return m->channel_value[channel][MPE_BEND] * m->bend_range + master;
+ }
+
+ /** @brief Points a voice at a new target, reached at the end of the block. */
+ static void mpe_set_target(MpeVoices *m, int voice, MpeDimension dim, float target) {
+     m->target[dim][voice] = target;
+     m->step[dim][voice] = (m->remaining > 0) ? (target - m->value[dim][voice]) / (float)m->remaining : 0.0f;
+ }
+
+ /**
+  * @brief Picks the oldest voice among `candidates`.
+  * @return The voice index, -1 if there is no candidate.
+  */
+ static int mpe_oldest(const MpeVoices *m, uint64_t candidates) {
+     int oldest = -1;
+     uint32_t oldest_age = 0;
+
+     for (uint64_t bits = candidates; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         uint32_t age = m->next_age - m->age[v]; // Wraps correctly
+         if (oldest < 0 || age > oldest_age) { oldest = v; oldest_age = age; }
+     }
+     return oldest;
+ }
+
+
+ // --- Public Functions ---
+
+ void mpe_init(MpeVoices *m, double bend_range) {
+     memset(m, 0, sizeof(*m));
+     m->bend_range = (float)bend_range;
+     for (int c = 0; c < 16; c++) m->channel_value[c][MPE_TIMBRE] = 0.5f;
+     for (int v = 0; v < MPE_MAX_VOICES; v++) m->value[MPE_TIMBRE][v] = m->target[MPE_TIMBRE][v] = 0.5f;
+ }
+
+ int mpe_enabled(const MpeVoices *m) {
+     return m->bend_range > 0.0f;
+ }
+
+ void mpe_begin_block(MpeVoices *m, unsigned long frames) {
+     m->remaining = frames;
+     for (uint64_t bits = m->active; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         for (int d = 0; d < MPE_DIMENSIONS; d++) {
+             m->step[d][v] = (frames > 0) ? (m->target[d][v] - m->value[d][v]) / (float)frames : 0.0f;
+         }
+     }
+ }
+
+ void mpe_end_block(MpeVoices *m) {
+     for (uint64_t bits = m->active; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         for (int d = 0; d < MPE_DIMENSIONS; d++) {
+             m->value[d][v] = m->target[d][v];
+             m->step[d][v] = 0.0f;
+         }
+     }
+     m->remaining = 0;
+ }
+
+ int mpe_note_on(MpeVoices *m, int channel, int note, int velocity) {
+     uint64_t free_voices = ~m->active;
+     int v;
+
+     channel &= 0x0f;
+     if (free_voices != 0) {
+         v = __builtin_ctzll(free_voices);
+     } else {
+         v = mpe_oldest(m, m->active & ~m->held);
+         if (v < 0) v = mpe_oldest(m, m->held);
+         m->stolen++;
+     }
+     m->active |= (uint64_t)1 << v;
+     m->held |= (uint64_t)1 << v;
+     m->note[v] = (uint8_t)note;
+     m->channel[v] = (uint8_t)channel;
+     m->velocity[v] = (float)velocity / 127.0f;
+     m->age[v] = m->next_age++;
+     // A new note starts where its channel is, without a ramp from the voice's previous note
+     for (int d = 0; d < MPE_DIMENSIONS; d++) {
+         m->value[d][v] = m->target[d][v] = mpe_channel_target(m, channel, (MpeDimension)d);
+         m->step[d][v] = 0.0f;
+     }
+     return v;
+ }
+
+ int mpe_note_off(MpeVoices *m, int channel, int note) {
+     channel &= 0x0f;
+     for (uint64_t bits = m->held; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         if (m->channel[v] == channel && m->note[v] == note) {
+             m->held &= ~((uint64_t)1 << v);
+             return v;
+         }
+     }
+     return -1;
+ }
+
+ void mpe_expression(MpeVoices *m, int channel, MpeDimension dim, double value) {
+     int everyone;
+
+     if (dim < 0 || dim >= MPE_DIMENSIONS) return;
+     channel &= 0x0f;
+     m->channel_value[channel][dim] = (float)value;
+     everyone = (dim == MPE_BEND && channel == MPE_MASTER_CHANNEL);
+     for (uint64_t bits = m->active; bits != 0; bits &= bits - 1) {
+         int v = __builtin_ctzll(bits);
+         if (everyone || m->channel[v] == channel) mpe_set_target(m, v, dim, mpe_channel_target(m, m->channel[v], dim));
+     }
+ }
+
+ void mpe_free(MpeVoices *m, int voice) {
+     if (voice < 0 || voice >= MPE_MAX_VOICES) return;
+     m->active &= ~((uint64_t)1 << voice);
+     m->held &= ~((uint64_t)1 << voice);
+ }
@@ -0,0 +1,119 @@
+/**
+ * @file mpe.h
+ * @brief MIDI Polyphonic Expression: a pool of voices with per-note pitch bend, pressure and timbre.
+ *
+ * In MPE mode every note gets a voice of its own, and the pitch bend, channel
+ * pressure and controller 74 (timbre) of the note's channel modulate only that
+ * voice (lower zone: channel 1 is the master channel, whose pitch bend moves
+ * every voice, channels 2-16 carry one note each).
+ *
+ * The expression values are kept per dimension in arrays over all voices
+ * (structure of arrays), so the render loop walking the sounding voices reads
+ * consecutive floats: one dimension of 64 voices is 4 cache lines, the whole
+ * per-sample state (value and step of three dimensions) 24, touched in order
+ * every sample of a block. A new value does not jump: the voice ramps from
+ * where it is to the target over the rest of the block, reaching it exactly
+ * at the block end. Note, channel and velocity are only used on note on/off.
+ *
+ * The pool belongs to the render thread; nothing here blocks or allocates.
+ */
+
+ #ifndef MPE_H
+ #define MPE_H
+
+ #include <stdint.h>
+
+ // --- Constants ---
+ #define MPE_MAX_VOICES 64              ///< Voices in the pool (one bit each in MpeVoices::active).
+ #define MPE_DEFAULT_BEND_RANGE 48.0    ///< Member channel pitch bend range in semitones (MPE default).
+ #define MPE_MASTER_BEND_RANGE 2.0      ///< Master channel pitch bend range in semitones (MPE default).
+ #define MPE_MAX_BEND_RANGE 96.0
+ #define MPE_MASTER_CHANNEL 0           ///< Channel 1, the lower zone's master channel.
+ #define MPE_CC_TIMBRE 74               ///< Controller carrying the third dimension.
+
+ /**
+  * @enum MpeDimension
+  * @brief The per-note expression dimensions.
+  */
+ typedef enum {
+     MPE_BEND,          ///< Pitch offset in semitones (member plus master bend).
+     MPE_PRESSURE,      ///< Channel pressure 0-1.
+     MPE_TIMBRE,        ///< Controller 74 0-1, 0.5 until the controller moves.
+     MPE_DIMENSIONS
+ } MpeDimension;
+
+ /**
+  * @struct MpeVoices
+  * @brief The voice pool: expression ramps and note allocation.
+  */
+ typedef struct {
+     // Per sample: advanced for every sounding voice
+     _Alignas(64) float value[MPE_DIMENSIONS][MPE_MAX_VOICES];  ///< Current expression.
+     _Alignas(64) float step[MPE_DIMENSIONS][MPE_MAX_VOICES];   ///< Added to `value` each sample.
+     // Per event
+     _Alignas(64) float target[MPE_DIMENSIONS][MPE_MAX_VOICES]; ///< Value reached at the end of the block.
+     float channel_value[16][MPE_DIMENSIONS];  ///< Latest raw expression of each channel (bend -1..1), what a new note starts with.
+     uint64_t active;                ///< Bit per voice sounding (held or releasing).
+     uint64_t held;                  ///< Bit per voice whose key is down.
+     uint8_t note[MPE_MAX_VOICES];
+     uint8_t channel[MPE_MAX_VOICES];
+     float velocity[MPE_MAX_VOICES];  ///< Note-on velocity 0-1.
+     uint32_t age[MPE_MAX_VOICES];    ///< Note-on order, for stealing the oldest voice.
+     uint32_t next_age;
+     float bend_range;               ///< Member channel bend range in semitones, 0 when MPE is off.
+     unsigned long remaining;        ///< Frames left in the block, the length of new ramps.
+     unsigned long stolen;           ///< Notes that took over a sounding voice.
+ } MpeVoices;
+
+ /**
+  * @brief Empties the pool and resets every channel's expression.
+  * @param[out] m The pool.
+  * @param bend_range Member channel bend range in semitones, 0 to leave MPE off.
+  */
+ void mpe_init(MpeVoices *m, double bend_range);
+
+ /** @brief Returns 1 if MPE is on. */
+ int mpe_enabled(const MpeVoices *m);
+
+ /**
+  * @brief Starts the ramps of a block: every voice moves from its value to its target over `frames`.
+  */
+ void mpe_begin_block(MpeVoices *m, unsigned long frames);
+
+ /**
+  * @brief Ends a block: the ramps land exactly on their targets.
+  */
+ void mpe_end_block(MpeVoices *m);
+
+ /**
+  * @brief Allocates a voice for a note, starting from its channel's current expression.
+  *
+  * A free voice is taken if there is one, otherwise the oldest released voice,
+  * otherwise the oldest held one.
+  *
+  * @return The voice index; the caller starts its envelopes.
+  */
+ int mpe_note_on(MpeVoices *m, int channel, int note, int velocity);
+
+ /**
+  * @brief Finds the held voice of a note and marks it released.
+  * @return The voice index; the caller releases its envelopes. -1 if the note is not held.
+  */
+ int mpe_note_off(MpeVoices *m, int channel, int note);
+
+ /**
+  * @brief Sets a channel's expression and ramps the voices it moves towards it.
+  *
+  * The master channel's pitch bend moves every voice, any other message only
+  * the voices of its channel.
+  *
+  * @param channel MIDI channel 0-15.
+  * @param dim The dimension.
+  * @param value Bend -1..1, pressure or timbre 0..1.
+  */
+ void mpe_expression(MpeVoices *m, int channel, MpeDimension dim, double value);
+
+ /** @brief Returns a voice to the pool once its envelopes have finished. */
+ void mpe_free(MpeVoices *m, int voice);
+
+ #endif // MPE_H
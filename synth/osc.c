@@ -0,0 +1,252 @@
+/**
+ * @file osc.c
+ * @brief Implements OSC packet parsing and the mapping of the synth's addresses to events.
+ *
+ * All fields of an OSC packet are big-endian and 4-byte aligned: strings are
+ * NUL-terminated and padded with NULs to a multiple of 4, a bundle is the
+ * string "#bundle", a 64-bit NTP timetag and elements each preceded by their
+ * 32-bit size.
+ */
+
+ #include <math.h>
+ #include <string.h>
+
+ #include "osc.h"
+ #include "midimap.h"
+
+ #define OSC_BUNDLE_TAG "#bundle"
+ #define OSC_DEFAULT_VELOCITY 100
+
+ /**
+  * @struct OscParamAddress
+  * @brief An address that sets a parameter.
+  */
+ typedef struct {
+     const char *address;
+     SynthParam param;
+ } OscParamAddress;
+
+ static const OscParamAddress g_paramAddresses[] = {
+     { "/synth/wave1/freq", SYNTH_PARAM_FREQ1 },
+     { "/synth/wave1/amp", SYNTH_PARAM_AMP1 },
+     { "/synth/wave1/attack", SYNTH_PARAM_ATTACK1 },
+     { "/synth/wave1/decay", SYNTH_PARAM_DECAY1 },
+     { "/synth/wave1/sustain", SYNTH_PARAM_SUSTAIN1 },
+     { "/synth/wave1/release", SYNTH_PARAM_RELEASE1 },
+     { "/synth/wave2/freq", SYNTH_PARAM_FREQ2 },
+     { "/synth/wave2/amp", SYNTH_PARAM_AMP2 },
+     { "/synth/wave2/attack", SYNTH_PARAM_ATTACK2 },
+     { "/synth/wave2/decay", SYNTH_PARAM_DECAY2 },
+     { "/synth/wave2/sustain", SYNTH_PARAM_SUSTAIN2 },
+     { "/synth/wave2/release", SYNTH_PARAM_RELEASE2 },
+ };
+
+
+ // --- Helper Functions ---
+
+ static uint32_t osc_read_u32(const char *p) {
+     const unsigned char *b = (const unsigned char *)p;
+     return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+ }
+
+ static uint64_t osc_read_u64(const char *p) {
+     return ((uint64_t)osc_read_u32(p) << 32) | osc_read_u32(p + 4);
+ }
+
+ /**
+  * @brief Reads a padded string.
+  * @return Bytes taken including the padding, 0 if the string is unterminated.
+  */
+ static size_t osc_read_string(const char *p, size_t size) {
+     const char *end = memchr(p, '\0', size);
+     size_t len;
+
+     if (end == NULL) return 0;
+     len = ((size_t)(end - p) + 4) & ~(size_t)3;
+     return (len <= size) ? len : 0;
+ }
+
+ /**
+  * @brief Parses one message.
+  * @return 1 on success, 0 if malformed.
+  */
+ static int osc_parse_message(const char *data, size_t size, OscMessage *msg) {
+     size_t pos, len;
+     const char *tags;
+
+     if ((len = osc_read_string(data, size)) == 0 || data[0] != '/') return 0;
+     msg->address = data;
+     msg->argc = 0;
+     pos = len;
+     // A message without a type tag string has no arguments (pre-1.0 senders)
+     if (pos == size) return 1;
+     if ((len = osc_read_string(data + pos, size - pos)) == 0 || data[pos] != ',') return 0;
+     tags = data + pos + 1;
+     pos += len;
+
+     for (; *tags != '\0'; tags++) {
+         OscArg arg = { .type = *tags, .number = 0.0, .string = NULL };
+         union { uint32_t u; float f; } f32;
+         union { uint64_t u; double d; } f64;
+
+         switch (*tags) {
+             case 'i':
+                 if (size - pos < 4) return 0;
+                 arg.number = (int32_t)osc_read_u32(data + pos);
+                 pos += 4;
+                 break;
+             case 'f':
+                 if (size - pos < 4) return 0;
+                 f32.u = osc_read_u32(data + pos);
+                 arg.number = f32.f;
+                 pos += 4;
+                 break;
+             case 'h':
+                 if (size - pos < 8) return 0;
+                 arg.number = (double)(int64_t)osc_read_u64(data + pos);
+                 pos += 8;
+                 break;
+             case 'd':
+                 if (size - pos < 8) return 0;
+                 f64.u = osc_read_u64(data + pos);
+                 arg.number = f64.d;
+                 pos += 8;
+                 break;
+             case 't':
+                 if (size - pos < 8) return 0;
+                 pos += 8;
+                 break;
+             case 's': case 'S':
+                 if ((len = osc_read_string(data + pos, size - pos)) == 0) return 0;
+                 arg.string = data + pos;
+                 pos += len;
+                 break;
+             case 'b':
+                 if (size - pos < 4) return 0;
+                 len = osc_read_u32(data + pos);
+                 if (len > size - pos - 4) return 0;
+                 pos += 4 + ((len + 3) & ~(size_t)3);
+                 if (pos > size) return 0;
+                 break;
+             case 'T': arg.number = 1.0; break;
+             case 'F': case 'N': case 'I': break;
+             default: return 0;
+         }
+         if (msg->argc < OSC_MAX_ARGS) msg->args[msg->argc] = arg;
+         msg->argc++;
+     }
+     return 1;
+ }
+
+ /**
+  * @brief Parses a message or bundle element, recursing into nested bundles.
+  * @return Messages delivered, -1 if malformed.
+  */
+ static int osc_parse_element(const char *data, size_t size, uint64_t timetag, int depth,
+                              OscMessageFn fn, void *user) {
+     OscMessage msg;
+     size_t pos;
+     int count = 0;
+
+     if (size == 0 || (size & 3) != 0) return -1;
+     if (data[0] == '/') {
+         if (!osc_parse_message(data, size, &msg)) return -1;
+         fn(&msg, timetag, user);
+         return 1;
+     }
+     if (size < 16 || memcmp(data, OSC_BUNDLE_TAG, sizeof(OSC_BUNDLE_TAG)) != 0 || depth >= OSC_MAX_BUNDLE_DEPTH) return -1;
+
+     timetag = osc_read_u64(data + 8);
+     for (pos = 16; pos < size;) {
+         size_t len;
+         int n;
+
+         if (size - pos < 4) return -1;
+         len = osc_read_u32(data + pos);
+         pos += 4;
+         if (len > size - pos) return -1;
+         if ((n = osc_parse_element(data + pos, len, timetag, depth + 1, fn, user)) < 0) return -1;
+         count += n;
+         pos += len;
+     }
+     return count;
+ }
+
+ /** @brief Numeric value of argument `i`, or `fallback` if it is missing or not numeric. */
+ static double osc_arg_number(const OscMessage *msg, int i, double fallback) {
+     if (i >= msg->argc || i >= OSC_MAX_ARGS || msg->args[i].string != NULL) return fallback;
+     return msg->args[i].number;
+ }
+
+ /** @brief Converts a number to a 7-bit MIDI value. */
+ static uint8_t osc_midi_value(double x) {
+     if (!(x > 0.0)) return 0;
+     if (x >= 127.0) return 127;
+     return (uint8_t)lround(x);
+ }
+
+
+ // --- Public Functions ---
+
+ int osc_parse_packet(const char *data, size_t size, OscMessageFn fn, void *user) {
+     return osc_parse_element(data, size, OSC_TIMETAG_IMMEDIATE, 0, fn, user);
+ }
+
+ double osc_timetag_to_unix(uint64_t timetag) {
+     return (double)((timetag >> 32) - OSC_NTP_UNIX_OFFSET) + (double)(timetag & 0xffffffffu) / 4294967296.0;
+ }
+
+ uint64_t osc_timetag_from_unix(double unix_sec) {
+     // Split before adding the epoch offset, which would cost the fraction its precision
+     double whole = floor(unix_sec);
+     uint64_t frac = (uint64_t)((unix_sec - whole) * 4294967296.0);
+
+     if (frac > 0xffffffffu) frac = 0xffffffffu;
+     return (((uint64_t)whole + OSC_NTP_UNIX_OFFSET) << 32) | frac;
+ }
+
+ int osc_message_to_event(const OscMessage *msg, MidiEvent *ev) {
+     const char *address = msg->address;
+     double x;
+
+     memset(ev, 0, sizeof(*ev));
+     if (strncmp(address, "/synth/", 7) != 0) return 0;
+
+     if (strncmp(address, "/synth/wave", 11) == 0) {
+         for (size_t i = 0; i < sizeof(g_paramAddresses) / sizeof(g_paramAddresses[0]); i++) {
+             MidiMapping range;
+
+             if (strcmp(address, g_paramAddresses[i].address) != 0) continue;
+             x = osc_arg_number(msg, 0, NAN);
+             if (isnan(x)) return 0;
+             range = midimap_default(g_paramAddresses[i].param, MIDI_MAP_ANY_CHANNEL, 0);
+             ev->type = MIDI_EVENT_PARAM;
+             ev->data1 = (uint8_t)g_paramAddresses[i].param;
+             ev->value = (x < range.min) ? range.min : (x > range.max) ? range.max : x;
+             return 1;
+         }
+         return 0;
+     }
+     if (strcmp(address, "/synth/note/on") == 0 || strcmp(address, "/synth/note/off") == 0) {
+         x = osc_arg_number(msg, 0, NAN);
+         if (isnan(x) || x < 0.0 || x > 127.0) return 0;
+         ev->type = (address[13] == 'n') ? MIDI_EVENT_NOTE_ON : MIDI_EVENT_NOTE_OFF;
+         ev->data1 = osc_midi_value(x);
+         ev->data2 = (ev->type == MIDI_EVENT_NOTE_ON) ? osc_midi_value(osc_arg_number(msg, 1, OSC_DEFAULT_VELOCITY)) : 0;
+         return 1;
+     }
+     if (strcmp(address, "/synth/volume") == 0) {
+         x = osc_arg_number(msg, 0, NAN);
+         if (isnan(x)) return 0;
+         ev->type = MIDI_EVENT_CONTROL;
+         ev->data1 = MIDI_CC_VOLUME;
+         ev->data2 = osc_midi_value(x * 127.0);
+         return 1;
+     }
+     if (strcmp(address, "/synth/panic") == 0) {
+         ev->type = MIDI_EVENT_CONTROL;
+         ev->data1 = MIDI_CC_ALL_SOUND_OFF;
+         return 1;
+     }
+     return 0;
+ }
@@ -0,0 +1,93 @@
+/**
+ * @file osc.h
+ * @brief Open Sound Control packet parsing and the synth's OSC address space.
+ *
+ * Parses OSC 1.0 packets (a message, or a bundle of messages and nested
+ * bundles with their timetags) in place, without allocating, and turns the
+ * messages of the synth's address space into engine events:
+ *
+ * - `/synth/wave1/freq`, `amp`, `attack`, `decay`, `sustain`, `release` (and
+ *   `/synth/wave2/...`) with one value set the parameter, clamped to its slider range;
+ * - `/synth/note/on` with a note and an optional velocity 0-127 (default 100);
+ * - `/synth/note/off` with a note;
+ * - `/synth/volume` with a gain 0-1 acts like controller 7;
+ * - `/synth/panic` silences both waves like controller 120.
+ *
+ * Numeric arguments may be sent as `i`, `h`, `f`, `d` or `T`/`F`.
+ */
+
+ #ifndef OSC_H
+ #define OSC_H
+
+ #include <stddef.h>
+ #include <stdint.h>
+
+ #include "midi.h"
+
+ // --- Constants ---
+ #define OSC_MAX_ARGS 8                    ///< Arguments kept per message; further ones are parsed but not stored.
+ #define OSC_MAX_BUNDLE_DEPTH 8            ///< Deepest bundle nesting accepted.
+ #define OSC_TIMETAG_IMMEDIATE 1ULL        ///< The special timetag meaning "as soon as possible".
+ #define OSC_NTP_UNIX_OFFSET 2208988800ULL ///< Seconds from the NTP epoch (1900) to the Unix epoch (1970).
+
+ /**
+  * @struct OscArg
+  * @brief One message argument.
+  */
+ typedef struct {
+     char type;           ///< OSC type tag (`i`, `f`, `s`, ...).
+     double number;       ///< Value of a numeric or boolean argument, 0 otherwise.
+     const char *string;  ///< Value of an `s`/`S` argument (points into the packet), NULL otherwise.
+ } OscArg;
+
+ /**
+  * @struct OscMessage
+  * @brief A parsed message. Strings point into the packet buffer.
+  */
+ typedef struct {
+     const char *address;
+     int argc;                    ///< Arguments in the message (may exceed OSC_MAX_ARGS).
+     OscArg args[OSC_MAX_ARGS];
+ } OscMessage;
+
+ /**
+  * @brief Receives each message of a packet.
+  * @param[in] msg The message, valid during the call only.
+  * @param timetag Timetag of the innermost enclosing bundle, OSC_TIMETAG_IMMEDIATE for a bare message.
+  * @param user The pointer passed to osc_parse_packet().
+  */
+ typedef void (*OscMessageFn)(const OscMessage *msg, uint64_t timetag, void *user);
+
+ /**
+  * @brief Parses a packet and hands every message in it to `fn`, in packet order.
+  *
+  * Parsing stops at the first malformed element (bad size, missing padding,
+  * unknown type tag); the messages before it have been delivered.
+  *
+  * @param[in] data The packet, e.g. one UDP datagram.
+  * @param size Packet size in bytes.
+  * @param fn Called for each message.
+  * @param user Passed to `fn`.
+  * @return The number of messages delivered, or -1 if the packet is malformed.
+  */
+ int osc_parse_packet(const char *data, size_t size, OscMessageFn fn, void *user);
+
+ /**
+  * @brief Converts a timetag to seconds since the Unix epoch.
+  */
+ double osc_timetag_to_unix(uint64_t timetag);
+
+ /**
+  * @brief Converts seconds since the Unix epoch to a timetag.
+  */
+ uint64_t osc_timetag_from_unix(double unix_sec);
+
+ /**
+  * @brief Translates a message of the synth's address space into an engine event.
+  * @param[in] msg The message.
+  * @param[out] ev The event (channel 0, `frame` left for the caller).
+  * @return 1 on success, 0 if the address is unknown or the arguments do not fit it.
+  */
+ int osc_message_to_event(const OscMessage *msg, MidiEvent *ev);
+
+ #endif // OSC_H
@@ -0,0 +1,206 @@
+/**
+ * @file osc_server.c
+ * @brief UDP receive thread turning OSC packets into engine events.
+ *
+ * The socket is bound to the loopback address only: OSC has no
+ * authentication, so the synth is never controllable from the network. The
+ * thread sleeps in poll() on the socket and a stop pipe, then drains every
+ * pending datagram without blocking. It runs at normal priority: senders
+ * that care about timing use bundles, whose timetags do not depend on when
+ * the thread gets to run.
+ */
+
+ #include <pthread.h>
+ #include <poll.h>
+ #include <stdio.h>
+ #include <string.h>
+ #include <errno.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <stdatomic.h>
+ #include <sys/socket.h>
+ #include <netinet/in.h>
+ #include <arpa/inet.h>
+
+ #include "osc_server.h"
+ #include "osc.h"
+ #include "audio.h"
+ #include "audio_internal.h"
+
+ // --- Constants ---
+ #define OSC_MAX_PACKET 65536               ///< Largest UDP payload.
+ #define OSC_RECEIVE_BUFFER (1024 * 1024)   ///< Socket buffer requested, room for bursts while the thread is descheduled.
+
+ /**
+  * @struct OscServer
+  * @brief State of the server. Only one instance exists.
+  */
+ typedef struct {
+     int sock;                  ///< Bound socket, -1 when stopped.
+     int port;
+     pthread_t thread;
+     int thread_started;
+     int stop_pipe[2];          ///< Wakes the thread out of poll() on stop.
+     double arrival;            ///< audio_time_now() of the datagram being dispatched.
+     double unix_offset;        ///< Wall clock minus audio clock, for converting timetags.
+     atomic_ulong packets;
+     atomic_ulong messages;
+     atomic_ulong errors;
+     char buffer[OSC_MAX_PACKET];
+ } OscServer;
+
+ static OscServer g_osc = { .sock = -1, .stop_pipe = { -1, -1 } };
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Wall-clock time minus the audio clock, to map timetags onto the audio clock.
+  */
+ static double osc_unix_offset(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_REALTIME, &ts);
+     return (double)ts.tv_sec + ts.tv_nsec * 1e-9 - audio_time_now();
+ }
+
+ /**
+  * @brief Queues the event of one message at its timetag (or its arrival for "immediately").
+  */
+ static void osc_server_dispatch(const OscMessage *msg, uint64_t timetag, void *user) {
+     OscServer *srv = (OscServer *)user;
+     MidiEvent ev;
+     double when = srv->arrival;
+
+     if (!osc_message_to_event(msg, &ev)) {
+         atomic_fetch_add_explicit(&srv->errors, 1, memory_order_relaxed);
+         return;
+     }
+     if (timetag != OSC_TIMETAG_IMMEDIATE && timetag != 0) {
+         when = osc_timetag_to_unix(timetag) - srv->unix_offset;
+     }
+     audio_control_event(&ev, when);
+     atomic_fetch_add_explicit(&srv->messages, 1, memory_order_relaxed);
+ }
+
+ /**
+  * @brief Receive thread: drains the socket, then sleeps in poll().
+  */
+ static void *osc_server_thread_main(void *arg) {
+     OscServer *srv = (OscServer *)arg;
+     struct pollfd pfds[2] = { { .fd = srv->sock, .events = POLLIN }, { .fd = srv->stop_pipe[0], .events = POLLIN } };
+
+     for (;;) {
+         ssize_t n;
+
+         // The offset drifts with NTP adjustments, so it is refreshed per wakeup
+         srv->unix_offset = osc_unix_offset();
+         while ((n = recv(srv->sock, srv->buffer, sizeof(srv->buffer), MSG_DONTWAIT)) >= 0) {
+             srv->arrival = audio_time_now();
+             atomic_fetch_add_explicit(&srv->packets, 1, memory_order_relaxed);
+             if (osc_parse_packet(srv->buffer, (size_t)n, osc_server_dispatch, srv) < 0) {
+                 atomic_fetch_add_explicit(&srv->errors, 1, memory_order_relaxed);
+             }
+         }
+         if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+             fprintf(stderr, "OSC Error: recv: %s\n", strerror(errno));
+             break;
+         }
+
+         if (poll(pfds, 2, -1) < 0) {
+             if (errno == EINTR) continue;
+             fprintf(stderr, "OSC Error: poll: %s\n", strerror(errno));
+             break;
+         }
+         if (pfds[1].revents & POLLIN) break; // Stop requested
+     }
+     return NULL;
+ }
+
+ /**
+  * @brief Releases everything owned by the server state.
+  */
+ static void osc_server_release(OscServer *srv) {
+     if (srv->sock >= 0) { close(srv->sock); srv->sock = -1; }
+     if (srv->stop_pipe[0] >= 0) { close(srv->stop_pipe[0]); srv->stop_pipe[0] = -1; }
+     if (srv->stop_pipe[1] >= 0) { close(srv->stop_pipe[1]); srv->stop_pipe[1] = -1; }
+     srv->port = 0;
+     srv->thread_started = 0;
+ }
+
+
+ // --- Public Functions ---
+
+ int osc_server_start(int port) {
+     OscServer *srv = &g_osc;
+     struct sockaddr_in addr;
+     socklen_t len = sizeof(addr);
+     int rcvbuf = OSC_RECEIVE_BUFFER;
+     int err;
+
+     if (srv->sock >= 0) return 1;
+     if (port < 0 || port > 65535) return 0;
+
+     srv->sock = socket(AF_INET, SOCK_DGRAM, 0);
+     if (srv->sock < 0) {
+         fprintf(stderr, "OSC Error: cannot create socket: %s\n", strerror(errno));
+         return 0;
+     }
+     setsockopt(srv->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+     memset(&addr, 0, sizeof(addr));
+     addr.sin_family = AF_INET;
+     addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+     addr.sin_port = htons((uint16_t)port);
+     if (bind(srv->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+         getsockname(srv->sock, (struct sockaddr *)&addr, &len) != 0) {
+         fprintf(stderr, "OSC Error: cannot bind UDP port %d: %s\n", port, strerror(errno));
+         osc_server_release(srv);
+         return 0;
+     }
+     srv->port = ntohs(addr.sin_port);
+     if (pipe(srv->stop_pipe) != 0) {
+         fprintf(stderr, "OSC Error: cannot create stop pipe: %s\n", strerror(errno));
+         osc_server_release(srv);
+         return 0;
+     }
+
+     atomic_store(&srv->packets, 0);
+     atomic_store(&srv->messages, 0);
+     atomic_store(&srv->errors, 0);
+     err = pthread_create(&srv->thread, NULL, osc_server_thread_main, srv);
+     if (err != 0) {
+         fprintf(stderr, "OSC Error: cannot create server thread: %s\n", strerror(err));
+         osc_server_release(srv);
+         return 0;
+     }
+     srv->thread_started = 1;
+     printf("OSC server listening on 127.0.0.1:%d (UDP)\n", srv->port);
+     return 1;
+ }
+
+ void osc_server_stop(void) {
+     OscServer *srv = &g_osc;
+     OscServerStats st;
+
+     if (srv->sock < 0) return;
+
+     if (srv->thread_started) {
+         char c = 0;
+         if (write(srv->stop_pipe[1], &c, 1) < 0) {
+             fprintf(stderr, "Warning: cannot wake OSC thread: %s\n", strerror(errno));
+         }
+         pthread_join(srv->thread, NULL);
+     }
+     osc_server_release(srv);
+     osc_server_get_stats(&st);
+     printf("OSC server closed (%lu messages, %lu errors).\n", st.messages, st.errors);
+ }
+
+ int osc_server_port(void) {
+     return (g_osc.sock >= 0) ? g_osc.port : 0;
+ }
+
+ void osc_server_get_stats(OscServerStats *stats) {
+     stats->packets = atomic_load_explicit(&g_osc.packets, memory_order_relaxed);
+     stats->messages = atomic_load_explicit(&g_osc.messages, memory_order_relaxed);
+     stats->errors = atomic_load_explicit(&g_osc.errors, memory_order_relaxed);
+ }
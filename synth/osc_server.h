@@ -0,0 +1,48 @@
+/**
+ * @file osc_server.h
+ * @brief OSC control server on a localhost UDP port.
+ *
+ * A background thread receives OSC packets (see osc.h for the address
+ * space) and queues the resulting events with audio_control_event(). A bare
+ * message plays as soon as possible; the messages of a bundle play at the
+ * bundle's timetag, converted from NTP wall-clock time to the audio clock, so
+ * a sender that timestamps its bundles a little ahead gets its events placed
+ * to the sample whatever the network and thread scheduling jitter.
+ */
+
+ #ifndef OSC_SERVER_H
+ #define OSC_SERVER_H
+
+ /**
+  * @struct OscServerStats
+  * @brief Counters of the running (or last) server.
+  */
+ typedef struct {
+     unsigned long packets;   ///< Datagrams received.
+     unsigned long messages;  ///< Messages turned into events (queued or dropped by a full queue).
+     unsigned long errors;    ///< Malformed packets plus messages with an unknown address or bad arguments.
+ } OscServerStats;
+
+ /**
+  * @brief Binds the UDP port on 127.0.0.1 and starts the receive thread.
+  * @param port UDP port, or 0 to let the system pick one (see osc_server_port()).
+  * @return 1 on success (or if already running), 0 if the port cannot be bound or the thread cannot start.
+  */
+ int osc_server_start(int port);
+
+ /**
+  * @brief Stops the thread and closes the socket. Safe to call when not running.
+  */
+ void osc_server_stop(void);
+
+ /**
+  * @brief Returns the bound port, or 0 if the server is not running.
+  */
+ int osc_server_port(void);
+
+ /**
+  * @brief Copies the counters. Callable from any thread.
+  */
+ void osc_server_get_stats(OscServerStats *stats);
+
+ #endif // OSC_SERVER_H
@@ -0,0 +1,467 @@
+/**
+ * @file preset_file.c
+ * @brief Implements the `.synthpreset` parser.
+ *
+ * Files hold one `key: value` pair per line; blank lines and lines starting
+ * with `#` are skipped. The file is taken into memory whole (read into a
+ * stack buffer, or mapped if it is large) and parsed in one pass without
+ * copying lines: keys are looked up by binary search in a table sorted by
+ * name that gives each one's type, destination and range, and numbers are
+ * converted in place, with strtod() only for the forms the fast path does
+ * not take.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <stddef.h>
+ #include <string.h>
+ #include <errno.h>
+ #include <math.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+
+ #include "preset_file.h"
+ #include "midimap.h"
+
+ // --- Constants ---
+ #define PRESET_FILE_READ_MAX 16384      ///< Files up to this size are read onto the stack, larger ones mapped.
+ #define PRESET_NUMBER_MAX 64            ///< Longest number handed to strtod().
+ #define PRESET_STEP_PREFIX "step"
+
+ /**
+  * @enum PresetFieldType
+  * @brief What a key's value is and where it goes.
+  */
+ typedef enum {
+     PRESET_FIELD_DOUBLE,       ///< A number stored in PresetData.
+     PRESET_FIELD_WAVEFORM,     ///< An integer stored in PresetData as a WaveformType.
+     PRESET_FIELD_SEQ_LENGTH,   ///< An integer stored as the pattern's length.
+     PRESET_FIELD_SEQ_RATE      ///< A number stored as the pattern's rate.
+ } PresetFieldType;
+
+ /**
+  * @struct PresetField
+  * @brief A key of the format.
+  */
+ typedef struct {
+     const char *key;
+     unsigned char len;         ///< strlen(key).
+     unsigned char type;        ///< A PresetFieldType.
+     unsigned char required;    ///< Every preset must have the key.
+     size_t offset;             ///< Of the value in PresetData, for the PresetData types.
+     double min, max;           ///< Values allowed, inclusive (max may be INFINITY; NaN never passes).
+ } PresetField;
+
+ #define PRESET_DOUBLE(k, member, lo, hi) { k, sizeof(k) - 1, PRESET_FIELD_DOUBLE, 1, offsetof(PresetData, member), lo, hi }
+ #define PRESET_WAVEFORM(k, member) { k, sizeof(k) - 1, PRESET_FIELD_WAVEFORM, 1, offsetof(PresetData, member), WAVE_SINE, WAVE_TRIANGLE }
+
+ /** @brief The keys, sorted by strcmp() for the binary search. */
+ static const PresetField g_presetFields[] = {
+     PRESET_DOUBLE("amplitude1", amplitude1, 0.0, 1.0),
+     PRESET_DOUBLE("amplitude2", amplitude2, 0.0, 1.0),
+     PRESET_DOUBLE("attackTime1", attackTime1, 0.0, INFINITY),
+     PRESET_DOUBLE("attackTime2", attackTime2, 0.0, INFINITY),
+     PRESET_DOUBLE("decayTime1", decayTime1, 0.0, INFINITY),
+     PRESET_DOUBLE("decayTime2", decayTime2, 0.0, INFINITY),
+     PRESET_DOUBLE("frequency1", frequency1, 0.0, INFINITY),
+     PRESET_DOUBLE("frequency2", frequency2, 0.0, INFINITY),
+     PRESET_DOUBLE("releaseTime1", releaseTime1, 0.0, INFINITY),
+     PRESET_DOUBLE("releaseTime2", releaseTime2, 0.0, INFINITY),
+     { "seqLength", 9, PRESET_FIELD_SEQ_LENGTH, 0, 0, 1, SEQ_MAX_STEPS },
+     { "seqRate", 7, PRESET_FIELD_SEQ_RATE, 0, 0, 0.0, SEQ_MAX_RATE },
+     PRESET_DOUBLE("sustainLevel1", sustainLevel1, 0.0, 1.0),
+     PRESET_DOUBLE("sustainLevel2", sustainLevel2, 0.0, 1.0),
+     PRESET_WAVEFORM("waveform1", waveform1),
+     PRESET_WAVEFORM("waveform2", waveform2),
+ };
+ #define PRESET_FIELD_COUNT ((int)(sizeof(g_presetFields) / sizeof(g_presetFields[0])))
+
+ /** @brief Powers of ten a double holds exactly, for the fast path of parse_double(). */
+ static const double g_pow10[] = {
+     1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+ };
+
+
+ // --- Helper Functions ---
+
+ /** @brief Whitespace as isspace() in the C locale, without the locale lookup. */
+ static int is_blank(char c) {
+     return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+ }
+
+ static int is_digit(char c) {
+     return c >= '0' && c <= '9';
+ }
+
+ /**
+  * @brief Finds a key in g_presetFields.
+  * @return Its index, or -1 if it is not a key of the format.
+  */
+ static int find_field(const char *key, size_t len) {
+     int lo = 0, hi = PRESET_FIELD_COUNT - 1;
+
+     while (lo <= hi) {
+         int mid = (lo + hi) / 2;
+         const PresetField *f = &g_presetFields[mid];
+         size_t n = (len < f->len) ? len : f->len;
+         int cmp = memcmp(key, f->key, n);
+
+         if (cmp == 0) cmp = (len > f->len) - (len < f->len);
+         if (cmp == 0) return mid;
+         if (cmp < 0) hi = mid - 1; else lo = mid + 1;
+     }
+     return -1;
+ }
+
+ /**
+  * @brief Parses a number ending at whitespace or `end`, as strtod() would.
+  *
+  * Plain decimals with up to 19 digits whose value and power of ten a
+  * double holds exactly (everything the preset writer produces) are
+  * converted with one multiplication or division, which rounds correctly;
+  * other forms go to strtod() through a copy ending in NUL.
+  *
+  * @param[in,out] p Start of the number; moved past it on success.
+  * @return 1 on success, 0 if the text is not a finite number.
+  */
+ static int parse_double(const char **p, const char *end, double *out) {
+     const char *s = *p, *token_end = s;
+     unsigned long long mantissa = 0;
+     int digits = 0, exponent = 0, negative = 0;
+
+     while (token_end < end && !is_blank(*token_end)) token_end++;
+     if (s < token_end && (*s == '-' || *s == '+')) negative = (*s++ == '-');
+     for (; s < token_end && is_digit(*s); s++, digits++) mantissa = mantissa * 10 + (unsigned)(*s - '0');
+     if (s < token_end && *s == '.') {
+         for (s++; s < token_end && is_digit(*s); s++, digits++, exponent--) mantissa = mantissa * 10 + (unsigned)(*s - '0');
+     }
+     if (s < token_end && (*s == 'e' || *s == 'E') && digits > 0) {
+         int exp_negative = 0, e = 0;
+         const char *exp_start;
+
+         s++;
+         if (s < token_end && (*s == '-' || *s == '+')) exp_negative = (*s++ == '-');
+         for (exp_start = s; s < token_end && is_digit(*s) && e < 1000; s++) e = e * 10 + (*s - '0');
+         if (s == exp_start) s = token_end + 1; // Not a number this path takes
+         exponent += exp_negative ? -e : e;
+     }
+     if (s == token_end && digits > 0 && digits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+         double value = (double)mantissa;
+
+         value = (exponent < 0) ? value / g_pow10[-exponent] : value * g_pow10[exponent];
+         *out = negative ? -value : value;
+         *p = token_end;
+         return 1;
+     }
+
+     // Long mantissas, large exponents, hexadecimal, inf and nan
+     char copy[PRESET_NUMBER_MAX];
+     size_t len = (size_t)(token_end - *p);
+     char *copy_end;
+
+     if (len == 0 || len >= sizeof(copy)) return 0;
+     memcpy(copy, *p, len);
+     copy[len] = '\0';
+     *out = strtod(copy, &copy_end);
+     if (copy_end != copy + len || !isfinite(*out)) return 0;
+     *p = token_end;
+     return 1;
+ }
+
+ /**
+  * @brief Parses a decimal integer ending at whitespace or `end`.
+  * @param[in,out] p Start of the number; moved past it on success.
+  * @return 1 on success, 0 if the text is not an integer or out of [min, max].
+  */
+ static int parse_int(const char **p, const char *end, long min, long max, long *out) {
+     const char *s = *p;
+     long value = 0;
+     int negative = 0;
+
+     if (s < end && (*s == '-' || *s == '+')) negative = (*s++ == '-');
+     if (s == end || !is_digit(*s)) return 0;
+     for (; s < end && is_digit(*s); s++) {
+         value = value * 10 + (*s - '0');
+         if (value > 1000000000L) return 0;
+     }
+     if (s < end && !is_blank(*s)) return 0;
+     if (negative) value = -value;
+     if (value < min || value > max) return 0;
+     *out = value;
+     *p = s;
+     return 1;
+ }
+
+ static const char *skip_blanks(const char *p, const char *end) {
+     while (p < end && is_blank(*p)) p++;
+     return p;
+ }
+
+ /**
+  * @brief Parses the number of a `stepK` key.
+  * @return The step index 0-63, -1 if the key is not a step key, -2 if its number is out of range.
+  */
+ static int parse_step_key(const char *key, size_t len) {
+     const size_t prefix = sizeof(PRESET_STEP_PREFIX) - 1;
+     const char *p = key + prefix;
+     long k;
+
+     if (len <= prefix || memcmp(key, PRESET_STEP_PREFIX, prefix) != 0 || !is_digit(*p)) return -1;
+     if (!parse_int(&p, key + len, 1, SEQ_MAX_STEPS, &k) || p != key + len) return -2;
+     return (int)k - 1;
+ }
+
+ /**
+  * @brief Parses a step: `NOTE VELOCITY GATE` and up to SEQ_MAX_LOCKS `PARAM=VALUE` locks.
+  * @param value The value text, without surrounding whitespace.
+  * @return 1 on success, 0 if a field is missing or out of range.
+  */
+ static int parse_step(const char *value, const char *end, SeqStep *step) {
+     const char *p = value;
+     long note, velocity;
+     double gate;
+
+     if (!parse_int(&p, end, 0, 127, &note)) return 0;
+     p = skip_blanks(p, end);
+     if (!parse_int(&p, end, 0, 127, &velocity)) return 0;
+     p = skip_blanks(p, end);
+     if (!parse_double(&p, end, &gate) || !(gate >= SEQ_MIN_GATE && gate <= 1.0)) return 0;
+     step->note = (uint8_t)note;
+     step->velocity = (uint8_t)velocity;
+     step->gate = gate;
+     step->locks = 0;
+     for (p = skip_blanks(p, end); p < end; p = skip_blanks(p, end)) {
+         const char *equals = p;
+         char name[32];
+         int param;
+
+         while (equals < end && *equals != '=' && !is_blank(*equals)) equals++;
+         if (equals == end || *equals != '=' || step->locks == SEQ_MAX_LOCKS) return 0;
+         if ((size_t)(equals - p) >= sizeof(name)) return 0;
+         memcpy(name, p, (size_t)(equals - p));
+         name[equals - p] = '\0';
+         if ((param = midimap_param_from_name(name)) < 0) return 0;
+         p = equals + 1;
+         if (p == end || is_blank(*p) || !parse_double(&p, end, &step->lock[step->locks].value)) return 0;
+         step->lock[step->locks].param = param;
+         step->locks++;
+     }
+     return 1;
+ }
+
+ /**
+  * @brief Parses the value of a table key into the preset or the pattern.
+  * @return 1 on success, 0 if the value has the wrong type or is out of range.
+  */
+ static int parse_field(const PresetField *f, const char *value, const char *end, PresetData *preset, SeqPattern *pattern) {
+     const char *p = value;
+     double d;
+     long i;
+
+     switch ((PresetFieldType)f->type) {
+     case PRESET_FIELD_DOUBLE:
+         if (!parse_double(&p, end, &d) || p != end || !(d >= f->min && d <= f->max)) return 0;
+         *(double *)((char *)preset + f->offset) = d;
+         return 1;
+     case PRESET_FIELD_WAVEFORM:
+         if (!parse_int(&p, end, (long)f->min, (long)f->max, &i) || p != end) return 0;
+         *(WaveformType *)((char *)preset + f->offset) = (WaveformType)i;
+         return 1;
+     case PRESET_FIELD_SEQ_LENGTH:
+         if (!parse_int(&p, end, (long)f->min, (long)f->max, &i) || p != end) return 0;
+         pattern->length = (int)i;
+         return 1;
+     case PRESET_FIELD_SEQ_RATE:
+         // The rate must be positive: the lower end is exclusive
+         if (!parse_double(&p, end, &d) || p != end || !(d > f->min && d <= f->max)) return 0;
+         pattern->rate = d;
+         return 1;
+     }
+     return 0;
+ }
+
+ /**
+  * @brief Reads a whole file into `buf`, or maps it if it does not fit.
+  * @param[out] text Receives the contents; `*mapped` tells whether to munmap() it.
+  * @return 1 on success, 0 on an error (reported on stderr).
+  */
+ static int load_file(int fd, const char *filepath, char *buf, size_t size, const char **text, size_t *len, int *mapped) {
+     struct stat st;
+     size_t used = 0;
+     ssize_t n;
+
+     *mapped = 0;
+     if (fstat(fd, &st) != 0) {
+         fprintf(stderr, "Error reading preset file %s: %s\n", filepath, strerror(errno));
+         return 0;
+     }
+     if (S_ISREG(st.st_mode) && (size_t)st.st_size > size) {
+         void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+         if (map == MAP_FAILED) {
+             fprintf(stderr, "Error mapping preset file %s: %s\n", filepath, strerror(errno));
+             return 0;
+         }
+         *text = map;
+         *len = (size_t)st.st_size;
+         *mapped = 1;
+         return 1;
+     }
+     // Small files, and pipes and the like that have no size
+     while (used < size && (n = read(fd, buf + used, size - used)) != 0) {
+         if (n < 0) {
+             if (errno == EINTR) continue;
+             fprintf(stderr, "Error reading preset file %s: %s\n", filepath, strerror(errno));
+             return 0;
+         }
+         used += (size_t)n;
+     }
+     if (used == size && !S_ISREG(st.st_mode)) {
+         fprintf(stderr, "Error: Preset file %s is larger than %zu bytes\n", filepath, size);
+         return 0;
+     }
+     *text = buf;
+     *len = used;
+     return 1;
+ }
+
+
+ // --- Public Functions ---
+
+ int preset_file_parse(const char *text, size_t len, const char *source, PresetData *preset, SeqPattern *pattern) {
+     const char *end = text + len, *next;
+     PresetData loaded_preset;
+     SeqPattern loaded_pattern;
+     unsigned found = 0, required = 0;
+     int last_step = -1;
+     int line_num = 0;
+
+     if (!text || !preset) {
+         fprintf(stderr, "Error: Null argument passed to preset_file_parse\n");
+         return 0;
+     }
+     memset(&loaded_preset, 0, sizeof(loaded_preset));
+     seq_pattern_init(&loaded_pattern, 0);
+
+     for (const char *line = text; line < end; line = next) {
+         const char *line_end = memchr(line, '\n', (size_t)(end - line));
+         const char *key, *key_end, *value, *value_end, *colon;
+         int index;
+
+         next = (line_end != NULL) ? line_end + 1 : end;
+         if (line_end == NULL) line_end = end;
+         line_num++;
+
+         // Trim the line; skip empty lines and comments
+         key = skip_blanks(line, line_end);
+         value_end = line_end;
+         while (value_end > key && is_blank(value_end[-1])) value_end--;
+         if (key == value_end || *key == '#') continue;
+
+         colon = memchr(key, ':', (size_t)(value_end - key));
+         if (colon == NULL) {
+             fprintf(stderr, "Warning: Invalid format (no colon) on line %d of %s: \"%.*s\"\n",
+                     line_num, source, (int)(value_end - key), key);
+             continue;
+         }
+         key_end = colon;
+         while (key_end > key && is_blank(key_end[-1])) key_end--;
+         value = skip_blanks(colon + 1, value_end);
+         if (key == key_end || value == value_end) {
+             fprintf(stderr, "Warning: Empty key or value on line %d of %s: \"%.*s\"\n",
+                     line_num, source, (int)(value_end - key), key);
+             continue;
+         }
+
+         if ((index = find_field(key, (size_t)(key_end - key))) >= 0) {
+             if (!parse_field(&g_presetFields[index], value, value_end, &loaded_preset, &loaded_pattern)) index = -2;
+             else found |= 1u << index;
+         } else if ((index = parse_step_key(key, (size_t)(key_end - key))) != -1) {
+             if (index < 0 || !parse_step(value, value_end, &loaded_pattern.steps[index])) index = -2;
+             else if (index > last_step) last_step = index;
+         } else {
+             // Left for a newer version of the synthesizer
+             fprintf(stderr, "Warning: Unknown key '%.*s' on line %d of %s\n", (int)(key_end - key), key, line_num, source);
+             continue;
+         }
+         if (index == -2) {
+             fprintf(stderr, "Error: Failed to parse value for key '%.*s' on line %d of %s: value was '%.*s'\n",
+                     (int)(key_end - key), key, line_num, source, (int)(value_end - value), value);
+             return 0;
+         }
+     }
+
+     for (int i = 0; i < PRESET_FIELD_COUNT; i++) {
+         if (g_presetFields[i].required) required |= 1u << i;
+     }
+     if ((found & required) != required) {
+         for (int i = 0; i < PRESET_FIELD_COUNT; i++) {
+             if ((required & ~found) & (1u << i)) {
+                 fprintf(stderr, "Error: Preset file format incomplete. Missing field '%s' in %s\n", g_presetFields[i].key, source);
+                 break;
+             }
+         }
+         return 0;
+     }
+
+     if (last_step >= loaded_pattern.length) {
+         fprintf(stderr, "Error: step%d is beyond the pattern's seqLength of %d in %s\n", last_step + 1, loaded_pattern.length, source);
+         return 0;
+     }
+
+     *preset = loaded_preset;
+     if (pattern != NULL) *pattern = loaded_pattern;
+     return 1;
+ }
+
+ int preset_file_read(const char *filepath, PresetData *preset) {
+     return preset_file_read_with_pattern(filepath, preset, NULL);
+ }
+
+ int preset_file_read_with_pattern(const char *filepath, PresetData *preset, SeqPattern *pattern) {
+     char buf[PRESET_FILE_READ_MAX];
+     const char *text = NULL;
+     size_t len = 0;
+     int fd, mapped = 0, ok;
+
+     if (!filepath || !preset) {
+         fprintf(stderr, "Error: Null argument passed to preset_file_read\n");
+         return 0;
+     }
+
+     fd = open(filepath, O_RDONLY | O_CLOEXEC);
+     if (fd < 0) {
+         fprintf(stderr, "Error opening preset file %s for reading: %s\n", filepath, strerror(errno));
+         return 0;
+     }
+     ok = load_file(fd, filepath, buf, sizeof(buf), &text, &len, &mapped);
+     close(fd);
+     if (!ok) return 0;
+
+     ok = preset_file_parse(text, len, filepath, preset, pattern);
+     if (mapped) munmap((void *)text, len);
+     return ok;
+ }
+
+ int preset_file_write_pattern(FILE *fp, const SeqPattern *pattern) {
+     int write_errors = 0;
+
+     if (pattern->length <= 0) return 1;
+     if (fprintf(fp, "seqLength: %d\n", pattern->length) < 0) write_errors++;
+     if (fprintf(fp, "seqRate: %f\n", pattern->rate) < 0) write_errors++;
+     for (int i = 0; i < pattern->length && i < SEQ_MAX_STEPS; i++) {
+         const SeqStep *step = &pattern->steps[i];
+         // Silent rests are the default and left out
+         if (step->velocity == 0 && step->locks == 0) continue;
+         if (fprintf(fp, "step%d: %d %d %f", i + 1, step->note, step->velocity, step->gate) < 0) write_errors++;
+         for (int l = 0; l < step->locks && l < SEQ_MAX_LOCKS; l++) {
+             if (step->lock[l].param < 0 || step->lock[l].param >= SYNTH_PARAM_COUNT) continue;
+             if (fprintf(fp, " %s=%f", midimap_param_name((SynthParam)step->lock[l].param), step->lock[l].value) < 0) write_errors++;
+         }
+         if (fputc('\n', fp) == EOF) write_errors++;
+     }
+     return write_errors == 0;
+ }
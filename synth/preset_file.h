@@ -0,0 +1,72 @@
+/**
+ * @file preset_file.h
+ * @brief Reading `.synthpreset` files without the GUI.
+ *
+ * The parser behind the GUI's preset loading, usable from any thread: it
+ * reports problems on stderr and leaves dialogs to the caller.
+ *
+ * Besides the 14 parameters a preset may store a step pattern for the
+ * sequencer: `seqLength: N` (1-64 steps), optionally `seqRate: R` (steps per
+ * beat, 4 for sixteenth notes), and a line per step that is not a silent rest,
+ * `stepK: NOTE VELOCITY GATE [PARAM=VALUE ...]`, e.g.
+ * `step3: 67 100 0.25 release1=0.05 amp2=0.2` (velocity 0 for a rest that
+ * only locks parameters; PARAM as in `midiMap`, at most 4 per step).
+ *
+ * Values are checked against the format's table of keys: waveforms are
+ * integers 0-3, amplitudes and sustain levels lie in 0-1, frequencies and
+ * times are not negative, and a value with anything after the number is
+ * refused. Unknown keys are skipped with a warning, so presets saved by a
+ * newer version with more parameters still load.
+ */
+
+ #ifndef PRESET_FILE_H
+ #define PRESET_FILE_H
+
+ #include <stdio.h>
+ #include <stddef.h>
+
+ #include "synth_data.h"
+ #include "sequencer.h"
+
+ // --- Preset Directory ---
+ #define PRESET_DIR "presets"
+ #define PRESET_SUFFIX ".synthpreset"
+
+ /**
+  * @brief Parses preset text held in memory, such as a file read whole or mapped.
+  * @param[in] text The text; it need not end in a newline or NUL.
+  * @param len Bytes of `text`.
+  * @param[in] source Name of the text in messages, usually its path.
+  * @param[out] preset Receives the parameters of both waves.
+  * @param[out] pattern Receives the pattern, length 0 if the preset has none; may be NULL.
+  * @return 1 if all 14 fields and any pattern lines parsed, 0 otherwise (details on stderr).
+  * Nothing is written on failure.
+  */
+ int preset_file_parse(const char *text, size_t len, const char *source, PresetData *preset, SeqPattern *pattern);
+
+ /**
+  * @brief Reads a preset file.
+  * @param[in] filepath Path of the `.synthpreset` file.
+  * @param[out] preset Receives the parameters of both waves.
+  * @return 1 if the file was read and all 14 fields parsed, 0 otherwise.
+  */
+ int preset_file_read(const char *filepath, PresetData *preset);
+
+ /**
+  * @brief Reads a preset file and the step pattern stored with it.
+  * @param[in] filepath Path of the `.synthpreset` file.
+  * @param[out] preset Receives the parameters of both waves.
+  * @param[out] pattern Receives the pattern, length 0 if the preset has none.
+  * @return 1 if the file was read, all 14 fields and any pattern lines parsed, 0 otherwise.
+  */
+ int preset_file_read_with_pattern(const char *filepath, PresetData *preset, SeqPattern *pattern);
+
+ /**
+  * @brief Appends a step pattern to a preset being written, in the format read above.
+  * @param fp The preset file, open for writing.
+  * @param[in] pattern The pattern; nothing is written for length 0.
+  * @return 1 on success, 0 on a write error.
+  */
+ int preset_file_write_pattern(FILE *fp, const SeqPattern *pattern);
+
+ #endif // PRESET_FILE_H
@@ -0,0 +1,486 @@
+/**
+ * @file presetbank.c
+ * @brief Implements preset banks: mapping and reading a bank, building one and converting text presets.
+ */
+
+ #include <dirent.h>
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+
+ #include "presetbank.h"
+ #include "preset_file.h"
+ #include "midimap.h"
+
+ // Record layout
+ #define REC_NAME_OFFSET 0
+ #define REC_NAME_LENGTH 4
+ #define REC_PATTERN_OFFSET 8
+ #define REC_PATTERN_SIZE 12
+ #define REC_WAVEFORM1 16
+ #define REC_WAVEFORM2 20
+ #define REC_PARAMS 24                    ///< Twelve doubles, in the order of record_params().
+
+
+ // --- Helper Functions ---
+
+ static uint32_t get_u32(const uint8_t *p) {
+     return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+ }
+
+ static uint64_t get_u64(const uint8_t *p) {
+     return (uint64_t)get_u32(p + 4) << 32 | get_u32(p);
+ }
+
+ static double get_f64(const uint8_t *p) {
+     uint64_t bits = get_u64(p);
+     double v;
+
+     memcpy(&v, &bits, sizeof(v));
+     return v;
+ }
+
+ static void put_u32(uint8_t *p, uint32_t v) {
+     for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+ }
+
+ static void put_u64(uint8_t *p, uint64_t v) {
+     for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+ }
+
+ static void put_f64(uint8_t *p, double v) {
+     uint64_t bits;
+
+     memcpy(&bits, &v, sizeof(bits));
+     put_u64(p, bits);
+ }
+
+ /** @brief FNV-1a hash of a name. */
+ static uint32_t name_hash(const char *name, size_t len) {
+     uint32_t h = 2166136261u;
+
+     for (size_t i = 0; i < len; i++) {
+         h ^= (uint8_t)name[i];
+         h *= 16777619u;
+     }
+     return h;
+ }
+
+ /** @brief Hash slots for `count` presets: a power of two at least twice as many. */
+ static uint32_t hash_slots_for(size_t count) {
+     uint32_t slots = 1;
+
+     while (slots < 2 * count) slots <<= 1;
+     return slots;
+ }
+
+ /** @brief The twelve double parameters of a preset, in record order. */
+ static void record_params(PresetData *p, double **v) {
+     v[0] = &p->frequency1; v[1] = &p->amplitude1; v[2] = &p->attackTime1;
+     v[3] = &p->decayTime1; v[4] = &p->sustainLevel1; v[5] = &p->releaseTime1;
+     v[6] = &p->frequency2; v[7] = &p->amplitude2; v[8] = &p->attackTime2;
+     v[9] = &p->decayTime2; v[10] = &p->sustainLevel2; v[11] = &p->releaseTime2;
+ }
+
+ /** @brief Whether a step is valid in a pattern, as the text parser accepts it. */
+ static int step_valid(const SeqStep *step) {
+     if (step->note > 127 || step->velocity > 127 || !(step->gate >= SEQ_MIN_GATE && step->gate <= 1.0)) return 0;
+     if (step->locks < 0 || step->locks > SEQ_MAX_LOCKS) return 0;
+     for (int l = 0; l < step->locks; l++) {
+         if (step->lock[l].param < 0 || step->lock[l].param >= SYNTH_PARAM_COUNT) return 0;
+     }
+     return 1;
+ }
+
+ /** @brief Grows a buffer to hold `needed` bytes. @return 1 on success, 0 when memory runs out. */
+ static int reserve(void **buffer, size_t *capacity, size_t needed) {
+     size_t cap = *capacity ? *capacity : 4096;
+     void *grown;
+
+     if (needed <= *capacity) return 1;
+     while (cap < needed) cap *= 2;
+     grown = realloc(*buffer, cap);
+     if (grown == NULL) return 0;
+     *buffer = grown;
+     *capacity = cap;
+     return 1;
+ }
+
+ /** @brief Whether a section of `size` bytes at `offset` lies inside a file of `file_size` bytes. */
+ static int section_fits(uint64_t offset, uint64_t size, size_t file_size) {
+     return offset <= file_size && size <= file_size - offset;
+ }
+
+ /** @brief Orders file names for qsort(). */
+ static int compare_names(const void *a, const void *b) {
+     return strcmp(*(char * const *)a, *(char * const *)b);
+ }
+
+
+ // --- Public Functions ---
+
+ long presetbank_pattern_encode(const SeqPattern *pattern, uint8_t *out) {
+     size_t pos = PRESETBANK_PATTERN_HEADER;
+     int stored = 0;
+
+     if (pattern == NULL || pattern->length <= 0) return 0;
+     if (pattern->length > SEQ_MAX_STEPS || !(pattern->rate > 0.0 && pattern->rate <= SEQ_MAX_RATE)) return -1;
+     for (int i = 0; i < pattern->length; i++) {
+         const SeqStep *step = &pattern->steps[i];
+
+         // Silent rests are the default and left out, as in text presets
+         if (step->velocity == 0 && step->locks == 0) continue;
+         if (!step_valid(step)) return -1;
+         out[pos] = (uint8_t)i;
+         out[pos + 1] = step->note;
+         out[pos + 2] = step->velocity;
+         out[pos + 3] = (uint8_t)step->locks;
+         put_f64(out + pos + 4, step->gate);
+         pos += PRESETBANK_STEP_SIZE;
+         for (int l = 0; l < step->locks; l++) {
+             out[pos] = (uint8_t)step->lock[l].param;
+             put_f64(out + pos + 1, step->lock[l].value);
+             pos += PRESETBANK_LOCK_SIZE;
+         }
+         stored++;
+     }
+     out[0] = (uint8_t)pattern->length;
+     out[1] = (uint8_t)stored;
+     put_f64(out + 2, pattern->rate);
+     return (long)pos;
+ }
+
+ int presetbank_pattern_decode(const uint8_t *data, size_t size, SeqPattern *pattern) {
+     size_t pos = PRESETBANK_PATTERN_HEADER;
+     int stored;
+
+     if (size < PRESETBANK_PATTERN_HEADER || data[0] < 1 || data[0] > SEQ_MAX_STEPS) return 0;
+     seq_pattern_init(pattern, data[0]);
+     pattern->rate = get_f64(data + 2);
+     if (!(pattern->rate > 0.0 && pattern->rate <= SEQ_MAX_RATE)) return 0;
+     stored = data[1];
+     for (int s = 0; s < stored; s++) {
+         SeqStep *step;
+
+         if (size - pos < PRESETBANK_STEP_SIZE || data[pos] >= pattern->length) return 0;
+         step = &pattern->steps[data[pos]];
+         step->note = data[pos + 1];
+         step->velocity = data[pos + 2];
+         step->locks = data[pos + 3];
+         step->gate = get_f64(data + pos + 4);
+         pos += PRESETBANK_STEP_SIZE;
+         if (step->locks > SEQ_MAX_LOCKS || size - pos < (size_t)step->locks * PRESETBANK_LOCK_SIZE) return 0;
+         for (int l = 0; l < step->locks; l++) {
+             step->lock[l].param = data[pos];
+             step->lock[l].value = get_f64(data + pos + 1);
+             pos += PRESETBANK_LOCK_SIZE;
+         }
+         if (!step_valid(step)) return 0;
+     }
+     return pos == size;
+ }
+
+ int presetbank_open(PresetBank *b, const char *path) {
+     struct stat st;
+     const uint8_t *data, *h;
+     uint64_t records_offset, hash_offset, strings_offset, strings_size, patterns_offset, patterns_size;
+     uint32_t version, count, record_size, slots;
+     void *map;
+     int fd;
+
+     memset(b, 0, sizeof(*b));
+     fd = open(path, O_RDONLY);
+     if (fd < 0) {
+         fprintf(stderr, "Error opening preset bank %s: %s\n", path, strerror(errno));
+         return 0;
+     }
+     if (fstat(fd, &st) != 0 || st.st_size < PRESETBANK_HEADER_SIZE) {
+         fprintf(stderr, "Error: %s is not a preset bank\n", path);
+         close(fd);
+         return 0;
+     }
+     map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd); // The mapping keeps the file
+     if (map == MAP_FAILED) {
+         fprintf(stderr, "Error mapping preset bank %s: %s\n", path, strerror(errno));
+         return 0;
+     }
+     data = map;
+     h = data;
+     version = get_u32(h + 8); count = get_u32(h + 12); record_size = get_u32(h + 16); slots = get_u32(h + 20);
+     records_offset = get_u64(h + 24); hash_offset = get_u64(h + 32);
+     strings_offset = get_u64(h + 40); strings_size = get_u64(h + 48);
+     patterns_offset = get_u64(h + 56); patterns_size = get_u64(h + 64);
+     if (memcmp(h, PRESETBANK_MAGIC, 8) != 0) {
+         fprintf(stderr, "Error: %s is not a preset bank\n", path);
+     } else if (version != PRESETBANK_VERSION || record_size != PRESETBANK_RECORD_SIZE) {
+         fprintf(stderr, "Error: %s has an unsupported version %u\n", path, version);
+     } else if (slots == 0 || (slots & (slots - 1)) != 0 || slots < 2 * (uint64_t)count ||
+                !section_fits(records_offset, (uint64_t)count * PRESETBANK_RECORD_SIZE, (size_t)st.st_size) ||
+                !section_fits(hash_offset, (uint64_t)slots * 4, (size_t)st.st_size) ||
+                !section_fits(strings_offset, strings_size, (size_t)st.st_size) ||
+                !section_fits(patterns_offset, patterns_size, (size_t)st.st_size)) {
+         fprintf(stderr, "Error: %s is truncated or damaged\n", path);
+     } else {
+         b->data = data;
+         b->size = (size_t)st.st_size;
+         b->count = count;
+         b->hash_slots = slots;
+         b->records = data + records_offset;
+         b->hash = data + hash_offset;
+         b->strings = data + strings_offset;
+         b->strings_size = (size_t)strings_size;
+         b->patterns = data + patterns_offset;
+         b->patterns_size = (size_t)patterns_size;
+         return 1;
+     }
+     munmap(map, (size_t)st.st_size);
+     return 0;
+ }
+
+ void presetbank_close(PresetBank *b) {
+     if (b->data != NULL) munmap((void *)b->data, b->size);
+     memset(b, 0, sizeof(*b));
+ }
+
+ size_t presetbank_count(const PresetBank *b) {
+     return (b->data != NULL) ? b->count : 0;
+ }
+
+ const char *presetbank_name(const PresetBank *b, size_t index) {
+     const uint8_t *rec;
+     uint32_t offset, len;
+
+     if (index >= presetbank_count(b)) return NULL;
+     rec = b->records + index * PRESETBANK_RECORD_SIZE;
+     offset = get_u32(rec + REC_NAME_OFFSET);
+     len = get_u32(rec + REC_NAME_LENGTH);
+     // The name and its terminator must lie in the pool
+     if (offset >= b->strings_size || len >= b->strings_size - offset || b->strings[offset + len] != '\0') return NULL;
+     return (const char *)b->strings + offset;
+ }
+
+ long presetbank_find(const PresetBank *b, const char *name) {
+     size_t len = strlen(name);
+     uint32_t mask, slot;
+
+     if (presetbank_count(b) == 0) return -1;
+     mask = b->hash_slots - 1;
+     slot = name_hash(name, len) & mask;
+     // At least half the slots are empty, so a probe ends within a few steps
+     for (uint32_t probes = 0; probes < b->hash_slots; probes++, slot = (slot + 1) & mask) {
+         uint32_t entry = get_u32(b->hash + 4 * (size_t)slot);
+         const char *candidate;
+
+         if (entry == 0) return -1;
+         if (entry > b->count) continue;
+         candidate = presetbank_name(b, entry - 1);
+         if (candidate != NULL && strcmp(candidate, name) == 0) return (long)entry - 1;
+     }
+     return -1;
+ }
+
+ int presetbank_get(const PresetBank *b, size_t index, PresetData *preset, SeqPattern *pattern) {
+     const uint8_t *rec;
+     PresetData p;
+     double *params[12];
+     uint32_t wave1, wave2, offset, size;
+
+     if (index >= presetbank_count(b)) return 0;
+     rec = b->records + index * PRESETBANK_RECORD_SIZE;
+     wave1 = get_u32(rec + REC_WAVEFORM1);
+     wave2 = get_u32(rec + REC_WAVEFORM2);
+     offset = get_u32(rec + REC_PATTERN_OFFSET);
+     size = get_u32(rec + REC_PATTERN_SIZE);
+     if (wave1 > WAVE_TRIANGLE || wave2 > WAVE_TRIANGLE || offset > b->patterns_size || size > b->patterns_size - offset) return 0;
+     p.waveform1 = (WaveformType)wave1;
+     p.waveform2 = (WaveformType)wave2;
+     record_params(&p, params);
+     for (int i = 0; i < 12; i++) *params[i] = get_f64(rec + REC_PARAMS + 8 * i);
+     if (pattern != NULL) {
+         if (size == 0) seq_pattern_init(pattern, 0);
+         else if (!presetbank_pattern_decode(b->patterns + offset, size, pattern)) return 0;
+     }
+     *preset = p;
+     return 1;
+ }
+
+ void presetbank_writer_init(PresetBankWriter *w) {
+     memset(w, 0, sizeof(*w));
+ }
+
+ void presetbank_writer_free(PresetBankWriter *w) {
+     free(w->records);
+     free(w->strings);
+     free(w->patterns);
+     presetbank_writer_init(w);
+ }
+
+ int presetbank_writer_add(PresetBankWriter *w, const char *name, const PresetData *preset, const SeqPattern *pattern) {
+     uint8_t encoded[PRESETBANK_PATTERN_MAX], *rec;
+     PresetData p = *preset;
+     double *params[12];
+     size_t len = strlen(name);
+     long pattern_size = presetbank_pattern_encode(pattern, encoded);
+
+     if (len == 0 || len > PRESETBANK_NAME_MAX || pattern_size < 0 || w->count >= UINT32_MAX / 2 ||
+         w->strings_size + len + 1 > UINT32_MAX || w->patterns_size + (size_t)pattern_size > UINT32_MAX) {
+         return 0;
+     }
+     if (!reserve((void **)&w->records, &w->records_capacity, (w->count + 1) * PRESETBANK_RECORD_SIZE) ||
+         !reserve((void **)&w->strings, &w->strings_capacity, w->strings_size + len + 1) ||
+         !reserve((void **)&w->patterns, &w->patterns_capacity, w->patterns_size + (size_t)pattern_size)) {
+         return 0;
+     }
+     rec = w->records + w->count * PRESETBANK_RECORD_SIZE;
+     memset(rec, 0, PRESETBANK_RECORD_SIZE);
+     put_u32(rec + REC_NAME_OFFSET, (uint32_t)w->strings_size);
+     put_u32(rec + REC_NAME_LENGTH, (uint32_t)len);
+     put_u32(rec + REC_PATTERN_OFFSET, pattern_size > 0 ? (uint32_t)w->patterns_size : 0);
+     put_u32(rec + REC_PATTERN_SIZE, (uint32_t)pattern_size);
+     put_u32(rec + REC_WAVEFORM1, (uint32_t)p.waveform1);
+     put_u32(rec + REC_WAVEFORM2, (uint32_t)p.waveform2);
+     record_params(&p, params);
+     for (int i = 0; i < 12; i++) put_f64(rec + REC_PARAMS + 8 * i, *params[i]);
+     memcpy(w->strings + w->strings_size, name, len + 1);
+     w->strings_size += len + 1;
+     memcpy(w->patterns + w->patterns_size, encoded, (size_t)pattern_size);
+     w->patterns_size += (size_t)pattern_size;
+     w->count++;
+     return 1;
+ }
+
+ int presetbank_writer_save(const PresetBankWriter *w, const char *path) {
+     const uint32_t slots = hash_slots_for(w->count);
+     const uint64_t records_offset = PRESETBANK_HEADER_SIZE;
+     const uint64_t hash_offset = records_offset + (uint64_t)w->count * PRESETBANK_RECORD_SIZE;
+     const uint64_t strings_offset = hash_offset + (uint64_t)slots * 4;
+     const uint64_t patterns_offset = strings_offset + w->strings_size;
+     uint8_t header[PRESETBANK_HEADER_SIZE];
+     uint8_t *hash = calloc(slots, 4);
+     char tmp_path[1024];
+     FILE *f;
+     int ok;
+
+     if (hash == NULL) {
+         fprintf(stderr, "Error: Out of memory writing preset bank %s\n", path);
+         return 0;
+     }
+     for (size_t i = 0; i < w->count; i++) {
+         const uint8_t *rec = w->records + i * PRESETBANK_RECORD_SIZE;
+         const char *name = w->strings + get_u32(rec + REC_NAME_OFFSET);
+         uint32_t slot = name_hash(name, get_u32(rec + REC_NAME_LENGTH)) & (slots - 1);
+         uint32_t entry;
+
+         while ((entry = get_u32(hash + 4 * (size_t)slot)) != 0) {
+             const uint8_t *other = w->records + (entry - 1) * PRESETBANK_RECORD_SIZE;
+             if (strcmp(w->strings + get_u32(other + REC_NAME_OFFSET), name) == 0) {
+                 fprintf(stderr, "Error: Preset bank %s would hold '%s' twice\n", path, name);
+                 free(hash);
+                 return 0;
+             }
+             slot = (slot + 1) & (slots - 1);
+         }
+         put_u32(hash + 4 * (size_t)slot, (uint32_t)i + 1);
+     }
+
+     memcpy(header, PRESETBANK_MAGIC, 8);
+     put_u32(header + 8, PRESETBANK_VERSION);
+     put_u32(header + 12, (uint32_t)w->count);
+     put_u32(header + 16, PRESETBANK_RECORD_SIZE);
+     put_u32(header + 20, slots);
+     put_u64(header + 24, records_offset);
+     put_u64(header + 32, hash_offset);
+     put_u64(header + 40, strings_offset);
+     put_u64(header + 48, w->strings_size);
+     put_u64(header + 56, patterns_offset);
+     put_u64(header + 64, w->patterns_size);
+
+     // Written beside the old bank and renamed over it, so a bank that is mapped elsewhere stays intact
+     snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+     f = fopen(tmp_path, "wb");
+     if (f == NULL) {
+         fprintf(stderr, "Error opening preset bank %s for writing: %s\n", tmp_path, strerror(errno));
+         free(hash);
+         return 0;
+     }
+     ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) &&
+          fwrite(w->records, PRESETBANK_RECORD_SIZE, w->count, f) == w->count &&
+          fwrite(hash, 4, slots, f) == slots &&
+          fwrite(w->strings, 1, w->strings_size, f) == w->strings_size &&
+          fwrite(w->patterns, 1, w->patterns_size, f) == w->patterns_size;
+     if (fclose(f) != 0) ok = 0;
+     free(hash);
+     if (ok && rename(tmp_path, path) != 0) ok = 0;
+     if (!ok) {
+         fprintf(stderr, "Error writing preset bank %s: %s\n", path, strerror(errno));
+         remove(tmp_path);
+     }
+     // The rename changed the directory; the bank must not look older than it (see presetbank_is_current())
+     if (ok) utimensat(AT_FDCWD, path, NULL, 0);
+     return ok;
+ }
+
+ int presetbank_is_current(const char *path, const char *dir) {
+     struct stat bank_st, dir_st;
+
+     if (stat(path, &bank_st) != 0 || stat(dir, &dir_st) != 0) return 0;
+     if (bank_st.st_mtim.tv_sec != dir_st.st_mtim.tv_sec) return bank_st.st_mtim.tv_sec > dir_st.st_mtim.tv_sec;
+     return bank_st.st_mtim.tv_nsec >= dir_st.st_mtim.tv_nsec;
+ }
+
+ int presetbank_convert(const char *dir, const char *path) {
+     const size_t suffix_len = strlen(PRESET_SUFFIX);
+     PresetBankWriter w;
+     PresetData preset;
+     SeqPattern pattern;
+     DIR *d = opendir(dir);
+     struct dirent *entry;
+     char **names = NULL, filepath[1024];
+     size_t count = 0, capacity = 0, skipped = 0;
+     int ok = 1;
+
+     if (d == NULL) {
+         fprintf(stderr, "Error opening preset directory %s: %s\n", dir, strerror(errno));
+         return 0;
+     }
+     while (ok && (entry = readdir(d)) != NULL) {
+         size_t len = strlen(entry->d_name);
+
+         if (len <= suffix_len || strcmp(entry->d_name + len - suffix_len, PRESET_SUFFIX) != 0) continue;
+         if (!reserve((void **)&names, &capacity, (count + 1) * sizeof(*names)) ||
+             (names[count] = strdup(entry->d_name)) == NULL) {
+             ok = 0;
+             break;
+         }
+         count++;
+     }
+     closedir(d);
+     if (!ok) fprintf(stderr, "Error: Out of memory listing %s\n", dir);
+
+     qsort(names, count, sizeof(*names), compare_names);
+     presetbank_writer_init(&w);
+     for (size_t i = 0; ok && i < count; i++) {
+         snprintf(filepath, sizeof(filepath), "%s/%s", dir, names[i]);
+         names[i][strlen(names[i]) - suffix_len] = '\0';
+         if (!preset_file_read_with_pattern(filepath, &preset, &pattern)) {
+             skipped++; // Reported by the parser
+             continue;
+         }
+         if (!presetbank_writer_add(&w, names[i], &preset, &pattern)) {
+             fprintf(stderr, "Warning: Preset '%s' cannot be stored in a bank, skipped\n", names[i]);
+             skipped++;
+         }
+     }
+     if (ok) ok = presetbank_writer_save(&w, path);
+     if (ok) printf("Wrote %zu presets from %s to %s (%zu skipped).\n", w.count, dir, path, skipped);
+     presetbank_writer_free(&w);
+     for (size_t i = 0; i < count; i++) free(names[i]);
+     free(names);
+     return ok;
+ }
@@ -0,0 +1,177 @@
+/**
+ * @file presetbank.h
+ * @brief Preset banks: many presets in one memory-mapped binary file, built from `.synthpreset` files.
+ *
+ * Opening a directory of text presets costs an open and a parse per file,
+ * which dominates listing and loading once there are thousands. A bank holds
+ * them all in one file that is mapped once and read in place:
+ *
+ * - a header (PRESETBANK_HEADER_SIZE bytes): PRESETBANK_MAGIC, the version,
+ *   the number of presets, the record size, the number of name hash slots,
+ *   and the offset and size of each section below;
+ * - a record table of PRESETBANK_RECORD_SIZE bytes per preset: the offset and
+ *   length of its name, the offset and size of its step pattern (size 0 for
+ *   none), the two waveforms and the twelve remaining parameters as doubles;
+ * - a hash table of 32-bit slots, a power of two at least twice the number of
+ *   presets, holding record index + 1 (0 for empty) at the FNV-1a hash of the
+ *   name, collisions probing linearly;
+ * - a string pool of the NUL-terminated names;
+ * - a pattern pool: per pattern its length, rate and the steps that are not
+ *   silent rests, each with its locks.
+ *
+ * A preset is found by index or by name in constant time and decoded from its
+ * record without touching the others. Integers and doubles are little endian
+ * and are decoded byte by byte, so a bank is portable and needs no alignment.
+ * Offsets and sizes are checked at open and every access stays inside the
+ * mapping, so a truncated or damaged bank gives errors, not crashes.
+ *
+ * An open bank is only read; any number of threads may read it at once.
+ */
+
+ #ifndef PRESETBANK_H
+ #define PRESETBANK_H
+
+ #include <stddef.h>
+ #include <stdint.h>
+
+ #include "synth_data.h"
+ #include "sequencer.h"
+
+ // --- Constants ---
+ #define PRESETBANK_MAGIC "SYNTHBNK"       ///< First 8 bytes of a bank.
+ #define PRESETBANK_VERSION 1
+ #define PRESETBANK_HEADER_SIZE 72
+ #define PRESETBANK_RECORD_SIZE 128
+ #define PRESETBANK_NAME_MAX 255           ///< Longest preset name in bytes.
+ #define PRESETBANK_SUFFIX ".synthbank"
+ #define PRESETBANK_FILE "presets/presets.synthbank" ///< The bank the GUI and the control socket look in, built by `--build-preset-bank`.
+ #define PRESETBANK_PATTERN_HEADER 10      ///< Encoded pattern: length, stored steps, rate...
+ #define PRESETBANK_STEP_SIZE 12           ///< ...then per stored step: index, note, velocity, locks, gate...
+ #define PRESETBANK_LOCK_SIZE 9            ///< ...and per lock: parameter, value.
+ #define PRESETBANK_PATTERN_MAX (PRESETBANK_PATTERN_HEADER + SEQ_MAX_STEPS * (PRESETBANK_STEP_SIZE + SEQ_MAX_LOCKS * PRESETBANK_LOCK_SIZE))
+
+ /**
+  * @struct PresetBank
+  * @brief An open bank: the mapping and where its sections are. Zero-initialise, release with presetbank_close().
+  */
+ typedef struct {
+     const uint8_t *data;            ///< The mapped file, NULL if no bank is open.
+     size_t size;
+     uint32_t count;                 ///< Presets in the bank.
+     uint32_t hash_slots;
+     const uint8_t *records;
+     const uint8_t *hash;
+     const uint8_t *strings;
+     size_t strings_size;
+     const uint8_t *patterns;
+     size_t patterns_size;
+ } PresetBank;
+
+ /**
+  * @struct PresetBankWriter
+  * @brief A bank being built in memory. Zero-initialise, release with presetbank_writer_free().
+  */
+ typedef struct {
+     uint8_t *records;               ///< Encoded records, name and pattern offsets relative to their pools.
+     size_t count;
+     size_t records_capacity;
+     char *strings;
+     size_t strings_size;
+     size_t strings_capacity;
+     uint8_t *patterns;
+     size_t patterns_size;
+     size_t patterns_capacity;
+ } PresetBankWriter;
+
+ /**
+  * @brief Maps a bank and checks its header and layout.
+  * @return 1 on success, 0 if the file cannot be mapped or is not a valid bank (reported on stderr; `b` is left closed).
+  */
+ int presetbank_open(PresetBank *b, const char *path);
+
+ /** @brief Unmaps a bank. Safe on a closed or zeroed bank. */
+ void presetbank_close(PresetBank *b);
+
+ /** @brief Number of presets, 0 for a closed bank. */
+ size_t presetbank_count(const PresetBank *b);
+
+ /**
+  * @brief Name of a preset, pointing into the mapping (valid until presetbank_close()).
+  * @return The name, or NULL if `index` is out of range or its record is damaged.
+  */
+ const char *presetbank_name(const PresetBank *b, size_t index);
+
+ /**
+  * @brief Finds a preset by name through the hash table.
+  * @return Its index, or -1 if the bank has no preset of that name.
+  */
+ long presetbank_find(const PresetBank *b, const char *name);
+
+ /**
+  * @brief Decodes a preset.
+  * @param[out] preset Receives the parameters of both waves.
+  * @param[out] pattern Receives the step pattern, length 0 if it has none; may be NULL.
+  * @return 1 on success, 0 if `index` is out of range or the record or its pattern is damaged.
+  */
+ int presetbank_get(const PresetBank *b, size_t index, PresetData *preset, SeqPattern *pattern);
+
+ /**
+  * @brief Encodes a step pattern as stored in the pattern pool.
+  * @param[out] out At least PRESETBANK_PATTERN_MAX bytes.
+  * @return Bytes written, 0 for no pattern (NULL or length 0), -1 if the pattern is invalid.
+  */
+ long presetbank_pattern_encode(const SeqPattern *pattern, uint8_t *out);
+
+ /**
+  * @brief Decodes a step pattern encoded by presetbank_pattern_encode().
+  * @return 1 on success, 0 if the `size` bytes are not exactly a valid pattern.
+  */
+ int presetbank_pattern_decode(const uint8_t *data, size_t size, SeqPattern *pattern);
+
+ /** @brief Clears a writer to an empty bank. The writer must not hold allocations. */
+ void presetbank_writer_init(PresetBankWriter *w);
+
+ /** @brief Frees a writer's buffers and empties it. */
+ void presetbank_writer_free(PresetBankWriter *w);
+
+ /**
+  * @brief Adds a preset to a bank being built.
+  * @param name Its name, 1 to PRESETBANK_NAME_MAX bytes.
+  * @param[in] pattern Its step pattern, or NULL (or length 0) for none.
+  * @return 1 on success, 0 for an invalid name or pattern or when memory runs out (the writer is unchanged).
+  */
+ int presetbank_writer_add(PresetBankWriter *w, const char *name, const PresetData *preset, const SeqPattern *pattern);
+
+ /**
+  * @brief Writes the bank built so far to a file, replacing it atomically.
+  *
+  * The file's modification time is set after the rename, so a bank written
+  * into its own presets directory is not older than the directory.
+  *
+  * @return 1 on success, 0 on duplicate names or a write error (reported on stderr).
+  */
+ int presetbank_writer_save(const PresetBankWriter *w, const char *path);
+
+ /**
+  * @brief Whether a bank still reflects the text presets of a directory.
+  *
+  * Adding, removing or renaming a preset file changes the directory's
+  * modification time, so a bank at least as new as the directory has every
+  * file it lists. A preset edited in place does not change the directory and
+  * keeps the bank current.
+  *
+  * @return 1 if the bank exists and is not older than the directory, 0 otherwise (also if either cannot be stat'ed).
+  */
+ int presetbank_is_current(const char *path, const char *dir);
+
+ /**
+  * @brief Builds a bank from every `.synthpreset` file in a directory, named after the files without the suffix.
+  *
+  * Presets are stored sorted by name. Files that do not parse are reported
+  * and left out.
+  *
+  * @return 1 if the bank was written, 0 otherwise (reported on stderr).
+  */
+ int presetbank_convert(const char *dir, const char *path);
+
+ #endif // PRESETBANK_H
@@ -0,0 +1,563 @@
+/**
+ * @file presetindex.c
+ * @brief Implements the preset index: incremental directory scans and the cache file.
+ */
+
+ #include <dirent.h>
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <sys/stat.h>
+ #include <time.h>
+
+ #include "presetindex.h"
+ #include "presetbank.h"
+ #include "preset_file.h"
+
+ #define PRESETINDEX_FLAG_VALID 1
+ #define PRESETINDEX_FLAG_RACY 2
+
+ /**
+  * @struct IndexReader
+  * @brief Position in a cache file being decoded; `ok` drops to 0 at the first read past its end.
+  */
+ typedef struct {
+     const uint8_t *data;
+     size_t size;
+     size_t pos;
+     int ok;
+ } IndexReader;
+
+ /**
+  * @struct IndexBuffer
+  * @brief A cache file being encoded; `ok` drops to 0 when memory runs out.
+  */
+ typedef struct {
+     uint8_t *data;
+     size_t size;
+     size_t capacity;
+     int ok;
+ } IndexBuffer;
+
+
+ // --- Helper Functions ---
+
+ /** @brief The twelve double parameters of a preset, in cache order. */
+ static void preset_params(PresetData *p, double **v) {
+     v[0] = &p->frequency1; v[1] = &p->amplitude1; v[2] = &p->attackTime1;
+     v[3] = &p->decayTime1; v[4] = &p->sustainLevel1; v[5] = &p->releaseTime1;
+     v[6] = &p->frequency2; v[7] = &p->amplitude2; v[8] = &p->attackTime2;
+     v[9] = &p->decayTime2; v[10] = &p->sustainLevel2; v[11] = &p->releaseTime2;
+ }
+
+ static const uint8_t *read_bytes(IndexReader *r, size_t n) {
+     const uint8_t *p;
+
+     if (!r->ok || r->size - r->pos < n) {
+         r->ok = 0;
+         return NULL;
+     }
+     p = r->data + r->pos;
+     r->pos += n;
+     return p;
+ }
+
+ static uint64_t read_uint(IndexReader *r, int bytes) {
+     const uint8_t *p = read_bytes(r, (size_t)bytes);
+     uint64_t v = 0;
+
+     for (int i = 0; p != NULL && i < bytes; i++) v |= (uint64_t)p[i] << (8 * i);
+     return v;
+ }
+
+ static double read_f64(IndexReader *r) {
+     uint64_t bits = read_uint(r, 8);
+     double v;
+
+     memcpy(&v, &bits, sizeof(v));
+     return v;
+ }
+
+ static void write_bytes(IndexBuffer *b, const void *p, size_t n) {
+     if (!b->ok || n == 0) return;
+     if (b->size + n > b->capacity) {
+         size_t cap = b->capacity ? b->capacity : 65536;
+         uint8_t *grown;
+
+         while (cap < b->size + n) cap *= 2;
+         grown = realloc(b->data, cap);
+         if (grown == NULL) {
+             b->ok = 0;
+             return;
+         }
+         b->data = grown;
+         b->capacity = cap;
+     }
+     memcpy(b->data + b->size, p, n);
+     b->size += n;
+ }
+
+ static void write_uint(IndexBuffer *b, uint64_t v, int bytes) {
+     uint8_t p[8];
+
+     for (int i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (8 * i));
+     write_bytes(b, p, (size_t)bytes);
+ }
+
+ static void write_f64(IndexBuffer *b, double v) {
+     uint64_t bits;
+
+     memcpy(&bits, &v, sizeof(bits));
+     write_uint(b, bits, 8);
+ }
+
+ static void entry_free(PresetIndexEntry *e) {
+     free(e->name);
+     free(e->pattern);
+     memset(e, 0, sizeof(*e));
+ }
+
+ static int compare_entries(const void *a, const void *b) {
+     return strcmp(((const PresetIndexEntry *)a)->name, ((const PresetIndexEntry *)b)->name);
+ }
+
+ /** @brief Position of the first of the first `count` (sorted) entries not before `name`. */
+ static size_t lower_bound(const PresetIndex *idx, size_t count, const char *name) {
+     size_t lo = 0, hi = count;
+
+     while (lo < hi) {
+         size_t mid = lo + (hi - lo) / 2;
+
+         if (strcmp(idx->entries[mid].name, name) < 0) lo = mid + 1;
+         else hi = mid;
+     }
+     return lo;
+ }
+
+ /** @brief Index of the entry `name` among the first `count` (sorted) entries, or -1. */
+ static long find_entry(const PresetIndex *idx, size_t count, const char *name) {
+     size_t i = lower_bound(idx, count, name);
+     return (i < count && strcmp(idx->entries[i].name, name) == 0) ? (long)i : -1;
+ }
+
+ /** @brief Whether a file name is one a scan indexes. */
+ static int is_preset_name(const char *name) {
+     size_t len = strlen(name), suffix_len = strlen(PRESET_SUFFIX);
+     return len > suffix_len && strchr(name, '/') == NULL && strcmp(name + len - suffix_len, PRESET_SUFFIX) == 0;
+ }
+
+ /** @brief Makes room for one more entry. @return 1 on success, 0 when memory runs out. */
+ static int reserve_entry(PresetIndex *idx) {
+     size_t cap;
+     PresetIndexEntry *grown;
+
+     if (idx->count < idx->capacity) return 1;
+     cap = idx->capacity ? 2 * idx->capacity : 64;
+     grown = realloc(idx->entries, cap * sizeof(*grown));
+     if (grown == NULL) return 0;
+     idx->entries = grown;
+     idx->capacity = cap;
+     return 1;
+ }
+
+ static int64_t stat_mtime_ns(const struct stat *st) {
+     return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+ }
+
+ static int64_t now_ns(void) {
+     struct timespec ts;
+
+     clock_gettime(CLOCK_REALTIME, &ts);
+     return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+ }
+
+ /** @brief Whether an entry no longer matches its file's time and size. */
+ static int entry_changed(const PresetIndexEntry *e, const struct stat *st) {
+     return e->racy || e->mtime_ns != stat_mtime_ns(st) || e->size != (uint64_t)st->st_size;
+ }
+
+ /**
+  * @brief Parses an entry's file, stat'ed as `st` before reading, and stores the result under that key.
+  * @return 1 on success (parsed or not), 0 when memory runs out.
+  */
+ static int entry_parse(PresetIndexEntry *e, const char *dir, const struct stat *st, int64_t now) {
+     SeqPattern pattern;
+     uint8_t encoded[PRESETBANK_PATTERN_MAX];
+     char path[1024];
+     long size = 0;
+
+     snprintf(path, sizeof(path), "%s/%s", dir, e->name);
+     free(e->pattern);
+     e->pattern = NULL;
+     e->pattern_size = 0;
+     e->valid = preset_file_read_with_pattern(path, &e->preset, &pattern);
+     if (e->valid) size = presetbank_pattern_encode(&pattern, encoded);
+     if (size < 0) e->valid = 0; // The parser accepts nothing the encoding cannot hold
+     if (size > 0) {
+         e->pattern = malloc((size_t)size);
+         if (e->pattern == NULL) {
+             e->valid = 0;
+             return 0;
+         }
+         memcpy(e->pattern, encoded, (size_t)size);
+         e->pattern_size = (size_t)size;
+     }
+     e->mtime_ns = stat_mtime_ns(st);
+     e->size = (uint64_t)st->st_size;
+     // A change within the timestamp resolution after this would keep time and size
+     e->racy = e->mtime_ns > now - (int64_t)PRESETINDEX_RACY_SEC * 1000000000;
+     return 1;
+ }
+
+ /** @brief Reads a whole file. @return The bytes (free() them), or NULL. */
+ static uint8_t *read_file(const char *path, size_t *size) {
+     FILE *f = fopen(path, "rb");
+     uint8_t *data = NULL;
+     long len;
+
+     if (f == NULL) return NULL;
+     if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0 &&
+         (data = malloc(len > 0 ? (size_t)len : 1)) != NULL) {
+         if (fread(data, 1, (size_t)len, f) == (size_t)len) {
+             *size = (size_t)len;
+         } else {
+             free(data);
+             data = NULL;
+         }
+     }
+     fclose(f);
+     return data;
+ }
+
+ /** @brief Decodes the entries of a cache file into an empty index. @return 1 on success, 0 if malformed. */
+ static int decode_cache(PresetIndex *idx, IndexReader *r) {
+     const uint8_t *magic = read_bytes(r, 8);
+     uint32_t version, dir_len, count;
+     const uint8_t *dir;
+
+     if (magic == NULL || memcmp(magic, PRESETINDEX_MAGIC, 8) != 0) return 0;
+     version = (uint32_t)read_uint(r, 4);
+     dir_len = (uint32_t)read_uint(r, 4);
+     dir = read_bytes(r, dir_len);
+     count = (uint32_t)read_uint(r, 4);
+     if (!r->ok || version != PRESETINDEX_VERSION || dir_len == 0 || memchr(dir, '\0', dir_len) != NULL ||
+         count > r->size / 8) {
+         return 0;
+     }
+     if ((idx->dir = strndup((const char *)dir, dir_len)) == NULL) return 0;
+     idx->entries = calloc(count > 0 ? count : 1, sizeof(*idx->entries));
+     if (idx->entries == NULL) return 0;
+     idx->capacity = count;
+
+     for (uint32_t i = 0; i < count; i++) {
+         PresetIndexEntry *e = &idx->entries[i];
+         uint16_t name_len = (uint16_t)read_uint(r, 2);
+         const uint8_t *name = read_bytes(r, name_len);
+         uint8_t flags;
+
+         if (!r->ok || name_len == 0 || memchr(name, '\0', name_len) != NULL || memchr(name, '/', name_len) != NULL) return 0;
+         if ((e->name = strndup((const char *)name, name_len)) == NULL) return 0;
+         idx->count++;
+         // Sorted and unique, as the lookups expect
+         if (i > 0 && strcmp(idx->entries[i - 1].name, e->name) >= 0) return 0;
+         e->mtime_ns = (int64_t)read_uint(r, 8);
+         e->size = read_uint(r, 8);
+         flags = (uint8_t)read_uint(r, 1);
+         e->valid = (flags & PRESETINDEX_FLAG_VALID) != 0;
+         e->racy = (flags & PRESETINDEX_FLAG_RACY) != 0;
+         if (e->valid) {
+             double *params[12];
+             uint32_t wave1 = (uint32_t)read_uint(r, 4), wave2 = (uint32_t)read_uint(r, 4);
+             const uint8_t *pattern;
+             SeqPattern check;
+
+             if (wave1 > WAVE_TRIANGLE || wave2 > WAVE_TRIANGLE) return 0;
+             e->preset.waveform1 = (WaveformType)wave1;
+             e->preset.waveform2 = (WaveformType)wave2;
+             preset_params(&e->preset, params);
+             for (int k = 0; k < 12; k++) *params[k] = read_f64(r);
+             e->pattern_size = (size_t)read_uint(r, 4);
+             pattern = read_bytes(r, e->pattern_size);
+             if (!r->ok) return 0;
+             if (e->pattern_size > 0) {
+                 if (!presetbank_pattern_decode(pattern, e->pattern_size, &check)) return 0;
+                 if ((e->pattern = malloc(e->pattern_size)) == NULL) return 0;
+                 memcpy(e->pattern, pattern, e->pattern_size);
+             }
+         }
+     }
+     return r->ok && r->pos == r->size;
+ }
+
+
+ // --- Public Functions ---
+
+ void presetindex_init(PresetIndex *idx) {
+     memset(idx, 0, sizeof(*idx));
+ }
+
+ void presetindex_free(PresetIndex *idx) {
+     for (size_t i = 0; i < idx->count; i++) entry_free(&idx->entries[i]);
+     free(idx->entries);
+     free(idx->dir);
+     presetindex_init(idx);
+ }
+
+ int presetindex_copy(PresetIndex *dst, const PresetIndex *src) {
+     int ok = 1;
+
+     presetindex_init(dst);
+     if (src->dir != NULL && (dst->dir = strdup(src->dir)) == NULL) ok = 0;
+     if (ok && src->count > 0 && (dst->entries = malloc(src->count * sizeof(*dst->entries))) == NULL) ok = 0;
+     if (ok) dst->capacity = src->count;
+     for (size_t i = 0; ok && i < src->count; i++) {
+         PresetIndexEntry *e = &dst->entries[i];
+
+         *e = src->entries[i];
+         e->pattern = NULL;
+         if ((e->name = strdup(src->entries[i].name)) == NULL) { ok = 0; break; }
+         dst->count++;
+         if (e->pattern_size > 0) {
+             if ((e->pattern = malloc(e->pattern_size)) == NULL) { ok = 0; break; }
+             memcpy(e->pattern, src->entries[i].pattern, e->pattern_size);
+         }
+     }
+     if (!ok) {
+         fprintf(stderr, "Error: Out of memory copying the preset index of %s\n", src->dir ? src->dir : "(none)");
+         presetindex_free(dst);
+         return 0;
+     }
+     dst->dirty = src->dirty;
+     dst->parsed = src->parsed;
+     dst->reused = src->reused;
+     dst->removed = src->removed;
+     return 1;
+ }
+
+ int presetindex_load(PresetIndex *idx, const char *path) {
+     IndexReader r = { .ok = 1 };
+     uint8_t *data = read_file(path, &r.size);
+     int ok;
+
+     if (data == NULL) return 0;
+     r.data = data;
+     ok = decode_cache(idx, &r);
+     free(data);
+     if (!ok) {
+         fprintf(stderr, "Warning: Ignoring damaged or outdated preset index %s\n", path);
+         presetindex_free(idx);
+     }
+     return ok;
+ }
+
+ int presetindex_save(PresetIndex *idx, const char *path) {
+     IndexBuffer b = { .ok = 1 };
+     char tmp_path[1024];
+     size_t dir_len = idx->dir ? strlen(idx->dir) : 0;
+     FILE *f;
+     int ok;
+
+     write_bytes(&b, PRESETINDEX_MAGIC, 8);
+     write_uint(&b, PRESETINDEX_VERSION, 4);
+     write_uint(&b, dir_len, 4);
+     write_bytes(&b, idx->dir, dir_len);
+     write_uint(&b, idx->count, 4);
+     for (size_t i = 0; i < idx->count; i++) {
+         PresetIndexEntry *e = &idx->entries[i];
+         size_t name_len = strlen(e->name);
+
+         if (name_len > UINT16_MAX) continue; // Beyond any file system's names
+         write_uint(&b, name_len, 2);
+         write_bytes(&b, e->name, name_len);
+         write_uint(&b, (uint64_t)e->mtime_ns, 8);
+         write_uint(&b, e->size, 8);
+         write_uint(&b, (e->valid ? PRESETINDEX_FLAG_VALID : 0) | (e->racy ? PRESETINDEX_FLAG_RACY : 0), 1);
+         if (e->valid) {
+             double *params[12];
+
+             write_uint(&b, (uint32_t)e->preset.waveform1, 4);
+             write_uint(&b, (uint32_t)e->preset.waveform2, 4);
+             preset_params(&e->preset, params);
+             for (int k = 0; k < 12; k++) write_f64(&b, *params[k]);
+             write_uint(&b, e->pattern_size, 4);
+             write_bytes(&b, e->pattern, e->pattern_size);
+         }
+     }
+     if (!b.ok || dir_len == 0) {
+         fprintf(stderr, "Error: Cannot encode preset index %s\n", path);
+         free(b.data);
+         return 0;
+     }
+
+     snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+     f = fopen(tmp_path, "wb");
+     if (f == NULL) {
+         fprintf(stderr, "Error opening preset index %s for writing: %s\n", tmp_path, strerror(errno));
+         free(b.data);
+         return 0;
+     }
+     ok = fwrite(b.data, 1, b.size, f) == b.size;
+     if (fclose(f) != 0) ok = 0;
+     free(b.data);
+     if (ok && rename(tmp_path, path) != 0) ok = 0;
+     if (!ok) {
+         fprintf(stderr, "Error writing preset index %s: %s\n", path, strerror(errno));
+         remove(tmp_path);
+         return 0;
+     }
+     idx->dirty = 0;
+     return 1;
+ }
+
+ int presetindex_scan(PresetIndex *idx, const char *dir) {
+     const int64_t now = now_ns();
+     DIR *d = opendir(dir);
+     struct dirent *de;
+     size_t old_count, kept = 0;
+     int ok = 1;
+
+     if (d == NULL) {
+         fprintf(stderr, "Error opening preset directory %s: %s\n", dir, strerror(errno));
+         return 0;
+     }
+     if (idx->dir == NULL || strcmp(idx->dir, dir) != 0) {
+         char *copy = strdup(dir);
+
+         if (copy == NULL) {
+             fprintf(stderr, "Error: Out of memory scanning %s\n", dir);
+             closedir(d);
+             return 0;
+         }
+         for (size_t i = 0; i < idx->count; i++) entry_free(&idx->entries[i]);
+         idx->count = 0;
+         free(idx->dir);
+         idx->dir = copy;
+         idx->dirty = 1;
+     }
+     idx->parsed = idx->reused = idx->removed = 0;
+     for (size_t i = 0; i < idx->count; i++) idx->entries[i].seen = 0;
+     old_count = idx->count;
+
+     while ((de = readdir(d)) != NULL) {
+         struct stat st;
+         PresetIndexEntry *e;
+         long found;
+
+         if (!is_preset_name(de->d_name)) continue;
+         if (fstatat(dirfd(d), de->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+         // New files are appended past old_count and sorted in afterwards
+         found = find_entry(idx, old_count, de->d_name);
+         if (found >= 0) {
+             e = &idx->entries[found];
+             e->seen = 1;
+             if (!entry_changed(e, &st)) {
+                 idx->reused++;
+                 continue;
+             }
+         } else {
+             if (!reserve_entry(idx)) { ok = 0; break; }
+             e = &idx->entries[idx->count];
+             memset(e, 0, sizeof(*e));
+             if ((e->name = strdup(de->d_name)) == NULL) { ok = 0; break; }
+             e->seen = 1;
+             idx->count++;
+         }
+         if (!entry_parse(e, dir, &st, now)) { ok = 0; break; }
+         idx->parsed++;
+         idx->dirty = 1;
+     }
+     closedir(d);
+     if (!ok) fprintf(stderr, "Error: Out of memory scanning %s\n", dir);
+
+     // Drop what is gone (or was not reached) and restore the order
+     for (size_t i = 0; i < idx->count; i++) {
+         if (!idx->entries[i].seen) {
+             entry_free(&idx->entries[i]);
+             idx->removed++;
+             continue;
+         }
+         idx->entries[kept++] = idx->entries[i];
+     }
+     idx->count = kept;
+     if (idx->removed > 0) idx->dirty = 1;
+     if (idx->count > old_count - idx->removed) {
+         qsort(idx->entries, idx->count, sizeof(*idx->entries), compare_entries);
+     }
+     return ok;
+ }
+
+ PresetIndexChange presetindex_update(PresetIndex *idx, const char *name, size_t *pos) {
+     size_t at = lower_bound(idx, idx->count, name);
+     int found = at < idx->count && strcmp(idx->entries[at].name, name) == 0;
+     int present = 0;
+     PresetIndexEntry added;
+     struct stat st;
+     char path[1024];
+
+     if (pos != NULL) *pos = at;
+     if (idx->dir == NULL) return PRESETINDEX_UNCHANGED;
+     if (is_preset_name(name)) {
+         snprintf(path, sizeof(path), "%s/%s", idx->dir, name);
+         present = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+     }
+
+     if (!present) {
+         if (!found) return PRESETINDEX_UNCHANGED;
+         entry_free(&idx->entries[at]);
+         memmove(&idx->entries[at], &idx->entries[at + 1], (idx->count - at - 1) * sizeof(*idx->entries));
+         idx->count--;
+         idx->dirty = 1;
+         return PRESETINDEX_REMOVED;
+     }
+     if (found) {
+         if (!entry_changed(&idx->entries[at], &st)) return PRESETINDEX_UNCHANGED;
+         if (!entry_parse(&idx->entries[at], idx->dir, &st, now_ns())) {
+             fprintf(stderr, "Error: Out of memory indexing %s\n", path);
+             return PRESETINDEX_ERROR;
+         }
+         idx->dirty = 1;
+         return PRESETINDEX_CHANGED;
+     }
+
+     memset(&added, 0, sizeof(added));
+     if (!reserve_entry(idx) || (added.name = strdup(name)) == NULL || !entry_parse(&added, idx->dir, &st, now_ns())) {
+         fprintf(stderr, "Error: Out of memory indexing %s\n", path);
+         entry_free(&added);
+         return PRESETINDEX_ERROR;
+     }
+     memmove(&idx->entries[at + 1], &idx->entries[at], (idx->count - at) * sizeof(*idx->entries));
+     idx->entries[at] = added;
+     idx->count++;
+     idx->dirty = 1;
+     return PRESETINDEX_ADDED;
+ }
+
+ const PresetIndexEntry *presetindex_find(const PresetIndex *idx, const char *name) {
+     long i = find_entry(idx, idx->count, name);
+     return (i >= 0) ? &idx->entries[i] : NULL;
+ }
+
+ int presetindex_get(PresetIndex *idx, const char *name, PresetData *preset, SeqPattern *pattern) {
+     long i = find_entry(idx, idx->count, name);
+     PresetIndexEntry *e;
+     struct stat st;
+     char path[1024];
+
+     if (i < 0) return 0;
+     e = &idx->entries[i];
+     snprintf(path, sizeof(path), "%s/%s", idx->dir, e->name);
+     if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+     if (entry_changed(e, &st)) {
+         if (!entry_parse(e, idx->dir, &st, now_ns())) return 0;
+         idx->dirty = 1;
+     }
+     if (!e->valid) return 0;
+     if (pattern != NULL) {
+         if (e->pattern_size == 0) seq_pattern_init(pattern, 0);
+         else if (!presetbank_pattern_decode(e->pattern, e->pattern_size, pattern)) return 0;
+     }
+     *preset = e->preset;
+     return 1;
+ }
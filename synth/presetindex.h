@@ -0,0 +1,147 @@
+/**
+ * @file presetindex.h
+ * @brief Preset index: the parsed presets of a directory, cached on disk and rescanned incrementally.
+ *
+ * Listing the presets directory used to stat every entry each time, and
+ * selecting a preset opened and parsed its file again on the GUI thread. The
+ * index keeps every `.synthpreset` file of a directory parsed in memory,
+ * keyed by its name, modification time and size, and persists that to a
+ * cache file. A scan reads the directory and stats each entry, but only
+ * parses files that are new or whose time or size changed; files that are
+ * gone are dropped. With the cache loaded at startup, a directory of
+ * thousands of presets is listed without parsing any of them.
+ *
+ * A file changed twice within its file system's timestamp resolution keeps
+ * time and size. Entries whose time was within PRESETINDEX_RACY_SEC of the
+ * scan that parsed them are therefore parsed again by the next scan.
+ *
+ * Files that do not parse stay in the index, marked invalid, so they are not
+ * parsed (and reported) again until they change.
+ *
+ * The cache file holds PRESETINDEX_MAGIC, a version, the directory and per
+ * entry its name, time, size and, if valid, the parameters and the step
+ * pattern encoded as in a preset bank (see presetbank.h), little endian.
+ * A cache of another version or directory, or a damaged one, is ignored and
+ * the next scan parses everything.
+ *
+ * An index belongs to one thread; presetindex_copy() hands a copy to another.
+ */
+
+ #ifndef PRESETINDEX_H
+ #define PRESETINDEX_H
+
+ #include <stddef.h>
+ #include <stdint.h>
+
+ #include "synth_data.h"
+ #include "sequencer.h"
+
+ // --- Constants ---
+ #define PRESETINDEX_MAGIC "SYNTHIDX"      ///< First 8 bytes of a cache file.
+ #define PRESETINDEX_VERSION 1
+ #define PRESETINDEX_FILE "presets/.synthpreset-index" ///< The cache the GUI keeps for PRESET_DIR.
+ #define PRESETINDEX_RACY_SEC 2            ///< Files this close to their scan are parsed again by the next one.
+
+ /**
+  * @enum PresetIndexChange
+  * @brief What presetindex_update() did to an entry.
+  */
+ typedef enum {
+     PRESETINDEX_ERROR = -1,         ///< Out of memory (reported on stderr); the index is unchanged.
+     PRESETINDEX_UNCHANGED = 0,      ///< Not a preset file, or the same time and size as indexed.
+     PRESETINDEX_ADDED,
+     PRESETINDEX_CHANGED,            ///< Parsed again; the name and position are the same.
+     PRESETINDEX_REMOVED
+ } PresetIndexChange;
+
+ /**
+  * @struct PresetIndexEntry
+  * @brief A preset file: its key and, if it parsed, its contents.
+  */
+ typedef struct {
+     char *name;                     ///< File name within the directory.
+     int64_t mtime_ns;               ///< Modification time in nanoseconds...
+     uint64_t size;                  ///< ...and size in bytes when it was parsed.
+     int valid;                      ///< Whether it parsed.
+     int racy;                       ///< Parsed too soon after a change to trust its time: parse again.
+     PresetData preset;
+     uint8_t *pattern;               ///< Step pattern encoded by presetbank_pattern_encode(), NULL for none.
+     size_t pattern_size;
+     int seen;                       ///< Found by the scan in progress.
+ } PresetIndexEntry;
+
+ /**
+  * @struct PresetIndex
+  * @brief The entries sorted by name and what the last scan did. Initialise with presetindex_init().
+  */
+ typedef struct {
+     char *dir;                      ///< Directory the entries belong to, NULL before the first scan or load.
+     PresetIndexEntry *entries;
+     size_t count;
+     size_t capacity;
+     int dirty;                      ///< Entries changed since the cache was loaded or saved.
+     size_t parsed;                  ///< Files the last scan parsed...
+     size_t reused;                  ///< ...took from the index unchanged...
+     size_t removed;                 ///< ...and dropped because they are gone.
+ } PresetIndex;
+
+ /** @brief Clears an index to empty. The index must not hold allocations. */
+ void presetindex_init(PresetIndex *idx);
+
+ /** @brief Frees an index's entries and empties it. */
+ void presetindex_free(PresetIndex *idx);
+
+ /**
+  * @brief Copies an index, entries and counters, for another thread to own.
+  * @param[out] dst Receives the copy; it must not hold allocations.
+  * @return 1 on success, 0 when memory runs out (reported on stderr; `dst` is left empty).
+  */
+ int presetindex_copy(PresetIndex *dst, const PresetIndex *src);
+
+ /**
+  * @brief Loads a cache file into an empty index.
+  * @return 1 if it was loaded, 0 if it is missing, of another version or damaged (the index stays empty).
+  */
+ int presetindex_load(PresetIndex *idx, const char *path);
+
+ /**
+  * @brief Writes an index to a cache file, replacing it atomically, and clears `dirty`.
+  * @return 1 on success, 0 on a write error (reported on stderr).
+  */
+ int presetindex_save(PresetIndex *idx, const char *path);
+
+ /**
+  * @brief Brings an index up to date with a directory, parsing only new and changed files.
+  *
+  * Entries of another directory (a cache of a different one) are dropped.
+  *
+  * @return 1 on success, 0 if the directory cannot be read (the index is unchanged) or memory
+  * runs out (files that could not be added are left out); both are reported on stderr.
+  */
+ int presetindex_scan(PresetIndex *idx, const char *dir);
+
+ /**
+  * @brief Brings one entry up to date with its file, as a scan would, without reading the directory.
+  *
+  * For a watcher that is told which names changed: the file is stat'ed and
+  * added, parsed again or dropped. Only an index that was scanned (or loaded)
+  * has a directory to look in; before that nothing changes.
+  *
+  * @param name File name within the index's directory.
+  * @param[out] pos Receives the entry's position in `entries`: where it was added, is, or was
+  * before it was removed. May be NULL.
+  */
+ PresetIndexChange presetindex_update(PresetIndex *idx, const char *name, size_t *pos);
+
+ /** @brief Finds an entry by file name. @return The entry, or NULL. */
+ const PresetIndexEntry *presetindex_find(const PresetIndex *idx, const char *name);
+
+ /**
+  * @brief Reads a preset through the index: its file is stat'ed and only parsed again if it changed since the scan.
+  * @param[out] preset Receives the parameters of both waves.
+  * @param[out] pattern Receives the step pattern, length 0 if it has none; may be NULL.
+  * @return 1 on success, 0 if the index does not hold `name`, the file is gone or does not parse.
+  */
+ int presetindex_get(PresetIndex *idx, const char *name, PresetData *preset, SeqPattern *pattern);
+
+ #endif // PRESETINDEX_H
@@ -0,0 +1,190 @@
+/**
+ * @file presetload.c
+ * @brief Loader thread reading the latest requested preset into a private result.
+ *
+ * The thread sleeps on a condition variable until a request is queued,
+ * copies it out under the mutex and does all file access with the mutex
+ * released, so presetload_request() and presetload_take() never wait for
+ * the file system. The request slot and the result slot each hold one entry:
+ * newer requests overwrite older ones.
+ */
+
+ #include <pthread.h>
+ #include <stdio.h>
+ #include <string.h>
+ #include <sys/stat.h>
+
+ #include "presetload.h"
+ #include "preset_file.h"
+
+ /**
+  * @struct PresetLoader
+  * @brief State of the loader. Only one instance exists.
+  */
+ typedef struct {
+     pthread_t thread;
+     PresetLoadNotifyFn notify;
+     void *user_data;
+     pthread_mutex_t lock;      ///< Guards the fields below.
+     int running;               ///< The thread was started and not yet stopped (written by the owner, under the lock).
+     pthread_cond_t wake;       ///< Signalled for a request or a stop.
+     int stopping;
+     int pending;               ///< `request` waits for the thread.
+     PresetLoadRequest request;
+     unsigned long serial;      ///< Serial of the latest request.
+     int ready;                 ///< `result` waits to be taken.
+     PresetLoadResult result;
+     PresetLoadStats stats;
+     PresetLoadRequest work;    ///< The request being loaded, the thread's own.
+     PresetLoadResult done;     ///< Its result, the thread's own until published.
+ } PresetLoader;
+
+ static PresetLoader g_loader = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Loads a request: from its cached copy if the file still has that time and size, else from the file.
+  */
+ static void presetload_run(const PresetLoadRequest *req, PresetLoadResult *res) {
+     struct stat st;
+
+     memcpy(res->name, req->name, sizeof(res->name));
+     memcpy(res->path, req->path, sizeof(res->path));
+     res->from_cache = 0;
+     if (req->cached && stat(req->path, &st) == 0 && S_ISREG(st.st_mode) &&
+         (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec == req->mtime_ns &&
+         (uint64_t)st.st_size == req->size) {
+         res->preset = req->preset;
+         res->pattern = req->pattern;
+         res->ok = 1;
+         res->from_cache = 1;
+         return;
+     }
+     res->ok = preset_file_read_with_pattern(req->path, &res->preset, &res->pattern);
+ }
+
+ /**
+  * @brief Loader thread: loads the latest request, publishes the result unless a newer one is waiting.
+  */
+ static void *presetload_thread_main(void *arg) {
+     PresetLoader *l = (PresetLoader *)arg;
+
+     pthread_mutex_lock(&l->lock);
+     for (;;) {
+         int notify = 0;
+
+         while (!l->pending && !l->stopping) pthread_cond_wait(&l->wake, &l->lock);
+         if (l->stopping) break;
+         l->work = l->request;
+         l->done.serial = l->serial;
+         l->pending = 0;
+         pthread_mutex_unlock(&l->lock);
+
+         presetload_run(&l->work, &l->done);
+
+         pthread_mutex_lock(&l->lock);
+         l->stats.loads++;
+         if (l->done.from_cache) l->stats.from_cache++;
+         if (l->pending) {
+             l->stats.superseded++; // Selected past already: the next one is what counts
+         } else if (!l->stopping) {
+             l->result = l->done;
+             l->ready = 1;
+             notify = 1;
+         }
+         if (notify && l->notify != NULL) {
+             pthread_mutex_unlock(&l->lock);
+             l->notify(l->user_data);
+             pthread_mutex_lock(&l->lock);
+         }
+     }
+     pthread_mutex_unlock(&l->lock);
+     return NULL;
+ }
+
+
+ // --- Public Functions ---
+
+ int presetload_start(PresetLoadNotifyFn notify, void *user_data) {
+     PresetLoader *l = &g_loader;
+     int err;
+
+     if (l->running) return 1;
+
+     pthread_mutex_lock(&l->lock);
+     l->notify = notify;
+     l->user_data = user_data;
+     l->stopping = l->pending = l->ready = 0;
+     memset(&l->stats, 0, sizeof(l->stats));
+     pthread_mutex_unlock(&l->lock);
+     err = pthread_create(&l->thread, NULL, presetload_thread_main, l);
+     if (err != 0) {
+         fprintf(stderr, "Preset loader Error: cannot create thread: %s\n", strerror(err));
+         return 0;
+     }
+     pthread_mutex_lock(&l->lock);
+     l->running = 1;
+     pthread_mutex_unlock(&l->lock);
+     return 1;
+ }
+
+ void presetload_stop(void) {
+     PresetLoader *l = &g_loader;
+
+     if (!l->running) return;
+
+     pthread_mutex_lock(&l->lock);
+     l->stopping = 1;
+     pthread_cond_signal(&l->wake);
+     pthread_mutex_unlock(&l->lock);
+     pthread_join(l->thread, NULL);
+
+     pthread_mutex_lock(&l->lock);
+     l->pending = l->ready = 0;
+     l->running = 0;
+     pthread_mutex_unlock(&l->lock);
+ }
+
+ unsigned long presetload_request(const PresetLoadRequest *request) {
+     PresetLoader *l = &g_loader;
+     unsigned long serial;
+
+     pthread_mutex_lock(&l->lock);
+     if (!l->running || l->stopping) {
+         pthread_mutex_unlock(&l->lock);
+         return 0;
+     }
+     if (l->pending) l->stats.superseded++;
+     l->request = *request;
+     l->request.name[PRESETLOAD_NAME_MAX - 1] = '\0';
+     l->request.path[PRESETLOAD_PATH_MAX - 1] = '\0';
+     serial = ++l->serial;
+     l->pending = 1;
+     // A result not taken yet is for an older selection
+     l->ready = 0;
+     pthread_cond_signal(&l->wake);
+     pthread_mutex_unlock(&l->lock);
+     return serial;
+ }
+
+ int presetload_take(PresetLoadResult *result) {
+     PresetLoader *l = &g_loader;
+     int taken;
+
+     pthread_mutex_lock(&l->lock);
+     taken = l->ready;
+     if (taken) {
+         *result = l->result;
+         l->ready = 0;
+     }
+     pthread_mutex_unlock(&l->lock);
+     return taken;
+ }
+
+ void presetload_get_stats(PresetLoadStats *stats) {
+     pthread_mutex_lock(&g_loader.lock);
+     *stats = g_loader.stats;
+     pthread_mutex_unlock(&g_loader.lock);
+ }
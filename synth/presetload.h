@@ -0,0 +1,103 @@
+/**
+ * @file presetload.h
+ * @brief Preset loader: reads and parses preset files on a worker thread.
+ *
+ * Selecting a preset used to open and parse its file on the GTK thread,
+ * which froze the window for as long as the file system took (hundreds of
+ * milliseconds on network home directories). The loader thread now does the
+ * stat, the read and the parse into a result of its own, and calls a notify
+ * function when it is done; the thread that owns the synthesizer state (the
+ * GUI, from a g_idle_add() callback) takes the result with presetload_take()
+ * and applies it in one step.
+ *
+ * Only the latest selection matters: a request replaces one that has not
+ * started, and a result is dropped if a newer request is waiting by the
+ * time it completes. A request may carry the preset as the preset index
+ * holds it, with the file time and size it was parsed at; if the file still
+ * has them it is not read again.
+ */
+
+ #ifndef PRESETLOAD_H
+ #define PRESETLOAD_H
+
+ #include <stdint.h>
+
+ #include "synth_data.h"
+ #include "sequencer.h"
+
+ // --- Constants ---
+ #define PRESETLOAD_NAME_MAX 256
+ #define PRESETLOAD_PATH_MAX 1024
+
+ /** @brief Called on the loader thread when a result is ready; it must not block. */
+ typedef void (*PresetLoadNotifyFn)(void *user_data);
+
+ /**
+  * @struct PresetLoadRequest
+  * @brief A preset to load.
+  */
+ typedef struct {
+     char name[PRESETLOAD_NAME_MAX];  ///< The entry selected, for the caller's messages.
+     char path[PRESETLOAD_PATH_MAX];  ///< File to read.
+     int cached;                      ///< `preset` and `pattern` hold the file as it was at `mtime_ns` and `size`...
+     int64_t mtime_ns;
+     uint64_t size;                   ///< ...and are used without reading it if it still has them.
+     PresetData preset;
+     SeqPattern pattern;
+ } PresetLoadRequest;
+
+ /**
+  * @struct PresetLoadResult
+  * @brief A completed request.
+  */
+ typedef struct {
+     unsigned long serial;            ///< As returned by presetload_request().
+     char name[PRESETLOAD_NAME_MAX];
+     char path[PRESETLOAD_PATH_MAX];
+     int ok;                          ///< 0 if the file cannot be read or is incomplete (details on stderr).
+     int from_cache;                  ///< The request's copy was still current and the file was not read.
+     PresetData preset;
+     SeqPattern pattern;              ///< Length 0 if the preset has none.
+ } PresetLoadResult;
+
+ /**
+  * @struct PresetLoadStats
+  * @brief Counters of the running (or last) loader.
+  */
+ typedef struct {
+     unsigned long loads;             ///< Requests completed...
+     unsigned long from_cache;        ///< ...of which the file was not read...
+     unsigned long superseded;        ///< ...and requests replaced or results dropped for a newer request.
+ } PresetLoadStats;
+
+ /**
+  * @brief Starts the loader thread.
+  * @param notify Called when a result is ready; may be NULL to poll with presetload_take().
+  * @return 1 on success (or if already running), 0 if the thread cannot be created (reported on stderr).
+  */
+ int presetload_start(PresetLoadNotifyFn notify, void *user_data);
+
+ /**
+  * @brief Stops the thread, after the read in progress if any, and drops what was not taken.
+  * Safe to call when not running. No notify call is made once this returns.
+  */
+ void presetload_stop(void);
+
+ /**
+  * @brief Queues a preset to load, replacing a request that has not started. Callable from any thread.
+  * @return The request's serial (counting from 1), or 0 if the loader is not running.
+  */
+ unsigned long presetload_request(const PresetLoadRequest *request);
+
+ /**
+  * @brief Takes the result of the latest request if it is ready. Callable from any thread.
+  * @return 1 if a result was taken, 0 if none is ready.
+  */
+ int presetload_take(PresetLoadResult *result);
+
+ /**
+  * @brief Copies the counters. Callable from any thread.
+  */
+ void presetload_get_stats(PresetLoadStats *stats);
+
+ #endif // PRESETLOAD_H
@@ -2,8 +2,9 @@
  * @file presets.c
  * @brief Implements preset saving, loading, and discovery functionality.
  *
- * Handles file I/O, parsing using a more robust line-by-line approach,
- * and directory scanning for presets.
+ * Handles the save dialog and file writing, loading through the parser in
+ * preset_file.c or from the preset bank (presetbank.c), and listing the
+ * presets of the bank or, without one, of the presets directory.
  */
 
  #include <stdio.h>
@@ -11,20 +12,75 @@
  #include <string.h>
  #include <errno.h>
  #include <gtk/gtk.h>
- #include <dirent.h>
- #include <sys/stat.h>
  #include <ctype.h> 
+ #include <unistd.h>
  
  #include "synth_data.h" 
  #include "presets.h"    
+ #include "preset_file.h"
+ #include "presetbank.h"
+ #include "presetindex.h"
+ #include "presetwatch.h"
+ #include "presetload.h"
  
  // --- External Global Shared Data Instance ---
  extern SharedSynthData g_synth_data;
+
+ // --- Preset Bank (GUI thread), open while the combo lists it ---
+ static PresetBank preset_bank;
+
+ // --- Preset Index (GUI thread), used without a bank ---
+ static PresetIndex preset_index;
+ static int preset_index_loaded = 0;
+
+ // --- Preset Directory Watcher, keeping this combo up to date ---
+ static GtkComboBoxText *watched_combo = NULL;
+ static PresetIndex watch_index; // Watcher thread: what the combo lists once the pending update is shown
+
+ /** @brief An inserted or removed row of the watched combo. */
+ typedef struct {
+     PresetIndexChange change;       ///< PRESETINDEX_ADDED or PRESETINDEX_REMOVED.
+     size_t pos;                     ///< Index position, the row after the placeholder.
+     char *name;
+ } PresetRowChange;
+
+ /**
+  * @brief What the watcher thread prepared for the combo and the GUI thread has not shown yet.
+  */
+ typedef struct {
+     int ready;                      ///< Holds an update; an idle call is queued for it.
+     int refill;                     ///< List `bank` or `index` from scratch instead of applying `rows`.
+     int failed;                     ///< The directory could not be scanned.
+     PresetBank bank;                ///< The bank to list, if one was mapped...
+     PresetIndex index;              ///< ...else the watcher's index after the changes.
+     PresetRowChange *rows;
+     size_t row_count;
+     size_t row_capacity;
+ } PresetDirUpdate;
+
+ /** @brief The pending update, taken whole by on_preset_dir_changed_idle(). */
+ static struct {
+     pthread_mutex_t lock;
+     PresetDirUpdate pending;
+ } preset_dir = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+ /** @brief Frees what an update holds and empties it. */
+ static void preset_dir_update_free(PresetDirUpdate *u) {
+     for (size_t i = 0; i < u->row_count; i++) free(u->rows[i].name);
+     free(u->rows);
+     presetbank_close(&u->bank);
+     presetindex_free(&u->index);
+     memset(u, 0, sizeof(*u));
+ }
  
- // --- Preset Directory ---
- #define PRESET_DIR "presets"
- #define PRESET_SUFFIX ".synthpreset"
- 
+ // --- Preset Loader: the window its errors are shown over ---
+ static GtkWindow *load_parent_window = NULL;
+
+ // --- Step Pattern and Loaded Handlers ---
+ static PresetPatternGetFn pattern_get_handler = NULL;
+ static PresetPatternSetFn pattern_set_handler = NULL;
+ static PresetLoadedFn loaded_handler = NULL;
+
  // --- Error Handling Macros ---
  #define CHECK_PTHREAD_ERR(ret, func_name) \
      if (ret != 0) { \
@@ -32,32 +88,16 @@
      }
  
  
- // --- Helper Function ---
- 
- /**
-  * @brief Trims leading and trailing whitespace from a string in place.
-  * @param str The string to trim. Modifies the string directly.
-  */
- static void trim_whitespace(char *str) {
-     if (!str) return;
-     char *start = str;
-     // Trim leading space
-     while (isspace((unsigned char)*start)) start++;
- 
-     // Trim trailing space
-     char *end = start + strlen(start) - 1;
-     while (end > start && isspace((unsigned char)*end)) end--;
- 
-     // Null terminate trimmed string
-     *(end + 1) = '\0';
- 
-     // Shift string if leading space was trimmed
-     if (start != str) {
-         memmove(str, start, strlen(start) + 1);
-     }
+ void presets_set_pattern_handlers(PresetPatternGetFn get, PresetPatternSetFn set) {
+     pattern_get_handler = get;
+     pattern_set_handler = set;
  }
- 
- 
+
+ void presets_set_loaded_handler(PresetLoadedFn loaded) {
+     loaded_handler = loaded;
+ }
+
+
  /**
   * @brief Handles the process of saving a synthesizer preset to a file.
   * @param parent_window The parent GtkWindow for the file chooser dialog.
@@ -70,6 +110,7 @@
      char *filename = NULL;
      FILE *fp = NULL;
      PresetData current_preset;
+     SeqPattern pattern;
      int ret_lock, ret_unlock;
      int write_errors = 0;
  
@@ -137,6 +178,10 @@
              if (fprintf(fp, "decayTime2: %f\n", current_preset.decayTime2) < 0) write_errors++;
              if (fprintf(fp, "sustainLevel2: %f\n", current_preset.sustainLevel2) < 0) write_errors++;
              if (fprintf(fp, "releaseTime2: %f\n", current_preset.releaseTime2) < 0) write_errors++;
+             if (pattern_get_handler != NULL) {
+                 pattern_get_handler(&pattern);
+                 if (!preset_file_write_pattern(fp, &pattern)) write_errors++;
+             }
              fclose(fp);
  
              // Show feedback dialog 
@@ -154,11 +199,54 @@
  }
  
  
+ /**
+  * @brief Updates the global synthesizer data and the step pattern from a loaded preset.
+  *
+  * Both change under the one lock: the audio thread reads the parameters
+  * under it at the start of a block and the pattern later in the same block,
+  * so it never plays the new parameters with the old pattern.
+  *
+  * @return 1 on success, 0 if the data could not be locked (reported in a dialog).
+  */
+ static int apply_loaded_preset(const PresetData *loaded_preset, const SeqPattern *pattern, GtkWindow *parent_window_for_errors) {
+     int ret_lock, ret_unlock;
+
+     ret_lock = pthread_mutex_lock(&g_synth_data.mutex);
+     CHECK_PTHREAD_ERR(ret_lock, "load preset lock");
+     if (ret_lock != 0) {
+         GtkWidget *err_dialog = gtk_message_dialog_new(parent_window_for_errors, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Error locking mutex to apply loaded preset.");
+         gtk_dialog_run(GTK_DIALOG(err_dialog)); gtk_widget_destroy(err_dialog);
+         return 0; // Failure
+     }
+     // Update global synth data from loaded preset
+     g_synth_data.frequency = loaded_preset->frequency1;
+     g_synth_data.amplitude = loaded_preset->amplitude1;
+     g_synth_data.waveform = loaded_preset->waveform1;
+     g_synth_data.attackTime = loaded_preset->attackTime1;
+     g_synth_data.decayTime = loaded_preset->decayTime1;
+     g_synth_data.sustainLevel = loaded_preset->sustainLevel1;
+     g_synth_data.releaseTime = loaded_preset->releaseTime1;
+     g_synth_data.frequency2 = loaded_preset->frequency2;
+     g_synth_data.amplitude2 = loaded_preset->amplitude2;
+     g_synth_data.waveform2 = loaded_preset->waveform2;
+     g_synth_data.attackTime2 = loaded_preset->attackTime2;
+     g_synth_data.decayTime2 = loaded_preset->decayTime2;
+     g_synth_data.sustainLevel2 = loaded_preset->sustainLevel2;
+     g_synth_data.releaseTime2 = loaded_preset->releaseTime2;
+     // A preset without a pattern stops the sequencer
+     if (pattern_set_handler != NULL) pattern_set_handler(pattern);
+
+     ret_unlock = pthread_mutex_unlock(&g_synth_data.mutex);
+     CHECK_PTHREAD_ERR(ret_unlock, "load preset unlock");
+     return 1;
+ }
+
+
  /**
   * @brief Handles the process of loading a synthesizer preset from a specific file path.
   *
-  * Reads the synthesizer parameters from the given file path using a more robust
-  * line-by-line parsing method, updates the global synthesizer data structure,
+  * Reads the synthesizer parameters from the given file path with
+  * preset_file_read(), updates the global synthesizer data structure,
   * and returns success or failure.
   *
   * @param filepath The full path to the preset file to load.
@@ -167,193 +255,333 @@
   * @note The caller is responsible for updating the GUI widgets after a successful load.
   */
  int handle_load_preset_from_file(const char *filepath, GtkWindow *parent_window_for_errors) {
-     FILE *fp = NULL;
      PresetData loaded_preset;
-     int ret_lock, ret_unlock;
-     int parse_success = 1;
-     char line_buffer[256];
-     int fields_found_mask = 0;
-     const int ALL_FIELDS_MASK = (1 << 14) - 1; // Mask for 14 fields
-     int line_num = 0;
- 
+     SeqPattern pattern;
+
      if (!filepath) {
          fprintf(stderr, "Error: Null filepath passed to handle_load_preset_from_file\n");
          return 0;
      }
- 
-     fp = fopen(filepath, "r");
-     if (fp == NULL) {
-         perror("Error opening preset file for reading");
-         parse_success = 0;
-         GtkWidget *err_dialog = gtk_message_dialog_new(parent_window_for_errors, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Failed to open preset file for reading:\n%s\n%s", filepath, strerror(errno));
+
+     // --- Read & Parse (details are reported on stderr) ---
+     if (!preset_file_read_with_pattern(filepath, &loaded_preset, &pattern)) {
+         GtkWidget *err_dialog = gtk_message_dialog_new(parent_window_for_errors, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Failed to load preset:\nCannot read or incomplete file\n%s", filepath);
          gtk_dialog_run(GTK_DIALOG(err_dialog)); gtk_widget_destroy(err_dialog);
-         return 0; // Return failure
+         return 0;
      }
- 
-     // --- Robust Parsing Loop ---
-     while (fgets(line_buffer, sizeof(line_buffer), fp) != NULL) {
-         line_num++;
-         char *line = line_buffer; // Pointer to work with for trimming
- 
-         // 1. Trim leading/trailing whitespace from the whole line
-         trim_whitespace(line);
- 
-         // 2. Skip empty lines or comments (optional, e.g., lines starting with #)
-         if (line[0] == '\0' || line[0] == '#') {
-             continue;
-         }
- 
-         // 3. Find the colon separator
-         char *colon_ptr = strchr(line, ':');
-         if (colon_ptr == NULL) {
-             fprintf(stderr, "Warning: Invalid format (no colon) on line %d of %s: \"%s\"\n", line_num, filepath, line_buffer);
-             // Decide whether to continue parsing or fail immediately
-             // parse_success = 0; break;
-             continue; 
-         }
- 
-         // 4. Separate key and value strings
-         *colon_ptr = '\0'; // Null-terminate the key string
-         char *key_str = line;
-         char *value_str = colon_ptr + 1;
- 
-         // 5. Trim whitespace from key and value individually
-         trim_whitespace(key_str);
-         trim_whitespace(value_str);
- 
-         // 6. Check if key or value is now empty
-         if (key_str[0] == '\0' || value_str[0] == '\0') {
-              fprintf(stderr, "Warning: Empty key or value on line %d of %s: \"%s\"\n", line_num, filepath, line_buffer);
-              continue; // Skip line if key or value became empty after trim
-         }
- 
-         // 7. Compare key and parse value
-         double d_value;
-         int i_value;
-         int parsed_ok = 0;
- 
-         if (strcmp(key_str, "frequency1") == 0)      { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.frequency1 = d_value; fields_found_mask |= (1 << 0); parsed_ok=1;} }
-         else if (strcmp(key_str, "amplitude1") == 0) { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.amplitude1 = d_value; fields_found_mask |= (1 << 1); parsed_ok=1;} }
-         else if (strcmp(key_str, "waveform1") == 0)  { if(sscanf(value_str, "%d", &i_value)==1)  { loaded_preset.waveform1 = (WaveformType)i_value; fields_found_mask |= (1 << 2); parsed_ok=1;} }
-         else if (strcmp(key_str, "attackTime1") == 0) { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.attackTime1 = d_value; fields_found_mask |= (1 << 3); parsed_ok=1;} }
-         else if (strcmp(key_str, "decayTime1") == 0)  { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.decayTime1 = d_value; fields_found_mask |= (1 << 4); parsed_ok=1;} }
-         else if (strcmp(key_str, "sustainLevel1") == 0){ if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.sustainLevel1 = d_value; fields_found_mask |= (1 << 5); parsed_ok=1;} }
-         else if (strcmp(key_str, "releaseTime1") == 0) { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.releaseTime1 = d_value; fields_found_mask |= (1 << 6); parsed_ok=1;} }
-         // Wave 2
-         else if (strcmp(key_str, "frequency2") == 0)  { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.frequency2 = d_value; fields_found_mask |= (1 << 7); parsed_ok=1;} }
-         else if (strcmp(key_str, "amplitude2") == 0)  { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.amplitude2 = d_value; fields_found_mask |= (1 << 8); parsed_ok=1;} }
-         else if (strcmp(key_str, "waveform2") == 0)  { if(sscanf(value_str, "%d", &i_value)==1)  { loaded_preset.waveform2 = (WaveformType)i_value; fields_found_mask |= (1 << 9); parsed_ok=1;} }
-         else if (strcmp(key_str, "attackTime2") == 0) { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.attackTime2 = d_value; fields_found_mask |= (1 << 10); parsed_ok=1;} }
-         else if (strcmp(key_str, "decayTime2") == 0)  { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.decayTime2 = d_value; fields_found_mask |= (1 << 11); parsed_ok=1;} }
-         else if (strcmp(key_str, "sustainLevel2") == 0){ if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.sustainLevel2 = d_value; fields_found_mask |= (1 << 12); parsed_ok=1;} }
-         else if (strcmp(key_str, "releaseTime2") == 0) { if(sscanf(value_str, "%lf", &d_value)==1) { loaded_preset.releaseTime2 = d_value; fields_found_mask |= (1 << 13); parsed_ok=1;} }
-         else {
-              fprintf(stderr, "Warning: Unknown key '%s' on line %d of %s\n", key_str, line_num, filepath);
-         }
- 
-         // If sscanf failed for a known key
-         if (!parsed_ok && strcmp(key_str, "frequency1") != 0 /* Add checks for all known keys */ ) {
-              fprintf(stderr, "Error: Failed to parse value for key '%s' on line %d of %s: value was '%s'\n", key_str, line_num, filepath, value_str);
-              parse_success = 0; // Fail parsing
-              break; // Stop processing file on parse error
-         }
- 
-     } // end while(fgets...)
- 
-     fclose(fp);
- 
-     // Check if all fields were found AFTER reading the whole file (if not already failed)
-     if (parse_success && fields_found_mask != ALL_FIELDS_MASK) {
-         fprintf(stderr, "Error: Preset file format incomplete. Missing fields in %s (mask=0x%X)\n", filepath, fields_found_mask);
-         parse_success = 0;
-         GtkWidget *err_dialog = gtk_message_dialog_new(parent_window_for_errors, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Failed to load preset:\nIncomplete or invalid file format in\n%s", filepath);
+     return apply_loaded_preset(&loaded_preset, &pattern, parent_window_for_errors);
+ }
+
+
+ /**
+  * @brief Applies the preset the loader thread read (GUI thread), or reports why it could not.
+  */
+ static gboolean on_preset_loaded_idle(gpointer user_data) {
+     PresetLoadResult result;
+
+     (void)user_data;
+     if (!presetload_take(&result)) return G_SOURCE_REMOVE; // Superseded, or the loader stopped
+     if (!result.ok) {
+         GtkWidget *err_dialog = gtk_message_dialog_new(load_parent_window, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Failed to load preset:\nCannot read or incomplete file\n%s", result.path);
          gtk_dialog_run(GTK_DIALOG(err_dialog)); gtk_widget_destroy(err_dialog);
+         return G_SOURCE_REMOVE;
      }
-     // --- End Read & Parse ---
- 
- 
-     // --- Update global state if successful ---
-     if (parse_success) {
-         ret_lock = pthread_mutex_lock(&g_synth_data.mutex);
-         CHECK_PTHREAD_ERR(ret_lock, "load preset lock");
-         if (ret_lock == 0) {
-             // Update global synth data from loaded preset
-             g_synth_data.frequency = loaded_preset.frequency1;
-             g_synth_data.amplitude = loaded_preset.amplitude1;
-             g_synth_data.waveform = loaded_preset.waveform1;
-             g_synth_data.attackTime = loaded_preset.attackTime1;
-             g_synth_data.decayTime = loaded_preset.decayTime1;
-             g_synth_data.sustainLevel = loaded_preset.sustainLevel1;
-             g_synth_data.releaseTime = loaded_preset.releaseTime1;
-             g_synth_data.frequency2 = loaded_preset.frequency2;
-             g_synth_data.amplitude2 = loaded_preset.amplitude2;
-             g_synth_data.waveform2 = loaded_preset.waveform2;
-             g_synth_data.attackTime2 = loaded_preset.attackTime2;
-             g_synth_data.decayTime2 = loaded_preset.decayTime2;
-             g_synth_data.sustainLevel2 = loaded_preset.sustainLevel2;
-             g_synth_data.releaseTime2 = loaded_preset.releaseTime2;
- 
-             ret_unlock = pthread_mutex_unlock(&g_synth_data.mutex);
-             CHECK_PTHREAD_ERR(ret_unlock, "load preset unlock");
-          } else { /* Handle lock failure */
-             GtkWidget *err_dialog = gtk_message_dialog_new(parent_window_for_errors, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Error locking mutex to apply loaded preset.");
+     if (apply_loaded_preset(&result.preset, &result.pattern, load_parent_window) && loaded_handler != NULL) {
+         loaded_handler(result.name);
+     }
+     return G_SOURCE_REMOVE;
+ }
+
+ /** @brief Called on the loader thread: hands the result to the GUI thread. */
+ static void on_preset_loaded(void *user_data) {
+     g_idle_add(on_preset_loaded_idle, user_data);
+ }
+
+ /**
+  * @brief Fills a load request with what the preset index holds for an entry, if it can be trusted.
+  * @return 1 if the request carries the preset, 0 if the file must be read.
+  */
+ static int fill_cached_request(PresetLoadRequest *request, const char *entry) {
+     const PresetIndexEntry *e = presetindex_find(&preset_index, entry);
+
+     if (e == NULL || !e->valid || e->racy) return 0;
+     if (e->pattern_size == 0) seq_pattern_init(&request->pattern, 0);
+     else if (!presetbank_pattern_decode(e->pattern, e->pattern_size, &request->pattern)) return 0;
+     request->preset = e->preset;
+     request->mtime_ns = e->mtime_ns;
+     request->size = e->size;
+     return 1;
+ }
+
+ int handle_load_preset(const char *entry, GtkWindow *parent_window_for_errors) {
+     PresetData loaded_preset;
+     SeqPattern pattern;
+     PresetLoadRequest request;
+     long index;
+
+     if (!entry) {
+         fprintf(stderr, "Error: Null entry passed to handle_load_preset\n");
+         return 0;
+     }
+     index = presetbank_find(&preset_bank, entry);
+     if (index >= 0) {
+         // Decoded from the mapping in place: nothing to wait for
+         if (!presetbank_get(&preset_bank, (size_t)index, &loaded_preset, &pattern)) {
+             GtkWidget *err_dialog = gtk_message_dialog_new(parent_window_for_errors, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE, "Failed to load preset:\nDamaged entry '%s' in %s", entry, PRESETBANK_FILE);
              gtk_dialog_run(GTK_DIALOG(err_dialog)); gtk_widget_destroy(err_dialog);
-             return 0; // Failure
-          }
+             return 0;
+         }
+         if (!apply_loaded_preset(&loaded_preset, &pattern, parent_window_for_errors)) return 0;
+         if (loaded_handler != NULL) loaded_handler(entry);
+         return 1;
      }
-     // --- End Update State ---
- 
-     return parse_success; // Return 1 if parsed and updated, 0 otherwise
+
+     // Files are read on the loader thread, so a slow file system does not freeze the window
+     memset(&request, 0, sizeof(request));
+     snprintf(request.name, sizeof(request.name), "%s", entry);
+     snprintf(request.path, sizeof(request.path), "%s/%s", PRESET_DIR, entry);
+     request.cached = fill_cached_request(&request, entry);
+     load_parent_window = parent_window_for_errors;
+     if (presetload_start(on_preset_loaded, NULL) && presetload_request(&request) != 0) return 1;
+
+     // Without the thread, load here
+     if (!handle_load_preset_from_file(request.path, parent_window_for_errors)) return 0;
+     if (loaded_handler != NULL) loaded_handler(entry);
+     return 1;
+ }
+
+ void stop_preset_loader(void) {
+     presetload_stop();
  }
  
  
  /**
-  * @brief Scans the presets directory and populates a GtkComboBoxText.
-  * @param combo The GtkComboBoxText widget to populate.
-  * @note Assumes PRESET_DIR exists relative to the current working directory.
+  * @brief Refills a combo with the placeholder and the open bank's presets or, without one, the index entries.
+  * @param failed The directory could not be read: say so instead of listing it.
   */
- void populate_preset_combo(GtkComboBoxText *combo) {
-     DIR *dir;
-     struct dirent *entry;
-     struct stat entry_stat;
-     char filepath[1024]; // Buffer for constructing full path for stat
- 
+ static void fill_preset_combo(GtkComboBoxText *combo, int failed) {
      // Clear existing items (important for refresh)
      gtk_combo_box_text_remove_all(combo);
- 
+
      // Add a default placeholder item
      gtk_combo_box_text_append_text(combo, "Select Preset...");
      gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0); // Make placeholder active
- 
-     dir = opendir(PRESET_DIR);
-     if (dir == NULL) {
-         perror("Could not open presets directory");
+
+     if (preset_bank.data != NULL) {
+         for (size_t i = 0; i < presetbank_count(&preset_bank); i++) {
+             const char *name = presetbank_name(&preset_bank, i);
+             if (name != NULL) gtk_combo_box_text_append_text(combo, name);
+         }
+         return;
+     }
+     if (failed) {
          gtk_combo_box_text_append_text(combo, "Error: Cannot open presets dir");
          return;
      }
- 
-     while ((entry = readdir(dir)) != NULL) {
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-             continue;
+     // Files that do not parse are listed too; selecting one reports why
+     for (size_t i = 0; i < preset_index.count; i++) {
+         gtk_combo_box_text_append_text(combo, preset_index.entries[i].name);
+     }
+ }
+
+ /**
+  * @brief Lists the preset bank, or without a current one the presets directory through the preset index, into a GtkComboBoxText.
+  * @param combo The GtkComboBoxText widget to populate.
+  * @note Assumes PRESET_DIR exists relative to the current working directory.
+  */
+ void populate_preset_combo(GtkComboBoxText *combo) {
+     int failed = 0;
+
+     // A bank lists every preset from one mapping, without a file per preset, unless files came or went since it was built
+     presetbank_close(&preset_bank);
+     if (access(PRESETBANK_FILE, R_OK) == 0 && !presetbank_is_current(PRESETBANK_FILE, PRESET_DIR)) {
+         printf("Presets: %s is older than %s, listing the directory.\n", PRESETBANK_FILE, PRESET_DIR);
+     } else if (access(PRESETBANK_FILE, R_OK) == 0 && presetbank_open(&preset_bank, PRESETBANK_FILE)) {
+         fill_preset_combo(combo, 0);
+         return;
+     }
+
+     // Otherwise the index parses only what changed since the last scan (or run)
+     if (!preset_index_loaded) {
+         presetindex_load(&preset_index, PRESETINDEX_FILE);
+         preset_index_loaded = 1;
+     }
+     if (!presetindex_scan(&preset_index, PRESET_DIR)) {
+         failed = 1;
+     } else {
+         printf("Presets: %zu listed, %zu parsed, %zu from the index.\n", preset_index.count, preset_index.parsed, preset_index.reused);
+         if (preset_index.dirty) presetindex_save(&preset_index, PRESETINDEX_FILE);
+     }
+     fill_preset_combo(combo, failed);
+ }
+
+
+ /**
+  * @brief Takes the update the watcher thread prepared and shows it in the watched combo (GUI thread).
+  *
+  * Nothing is read or parsed here: the finished index (or bank) replaces the
+  * one the combo lists, then the combo is refilled or its rows changed. The
+  * combo lists the placeholder, then the index entries in order, so an entry
+  * at position `pos` of the index is row `pos + 1`.
+  */
+ static gboolean on_preset_dir_changed_idle(gpointer user_data) {
+     PresetDirUpdate update;
+
+     (void)user_data;
+     pthread_mutex_lock(&preset_dir.lock);
+     update = preset_dir.pending;
+     memset(&preset_dir.pending, 0, sizeof(preset_dir.pending));
+     pthread_mutex_unlock(&preset_dir.lock);
+     if (!update.ready) return G_SOURCE_REMOVE;
+     if (watched_combo == NULL) {
+         preset_dir_update_free(&update);
+         return G_SOURCE_REMOVE;
+     }
+
+     presetbank_close(&preset_bank);
+     preset_bank = update.bank;
+     presetindex_free(&preset_index);
+     preset_index = update.index;
+     memset(&update.bank, 0, sizeof(update.bank));
+     presetindex_init(&update.index);
+     if (update.refill) {
+         fill_preset_combo(watched_combo, update.failed);
+     } else {
+         for (size_t i = 0; i < update.row_count; i++) {
+             if (update.rows[i].change == PRESETINDEX_ADDED) {
+                 gtk_combo_box_text_insert_text(watched_combo, (gint)update.rows[i].pos + 1, update.rows[i].name);
+             } else {
+                 gtk_combo_box_text_remove(watched_combo, (gint)update.rows[i].pos + 1);
+             }
          }
- 
-         // Construct full path to check if it's a file
-         snprintf(filepath, sizeof(filepath), "%s/%s", PRESET_DIR, entry->d_name);
-         if (stat(filepath, &entry_stat) == -1) {
-             // Silently ignore files u can't stat? Or log?
-             // perror("Stat failed for preset entry");
-             continue; // Skip if stat fails
+     }
+     preset_dir_update_free(&update);
+     return G_SOURCE_REMOVE;
+ }
+
+ /**
+  * @brief Makes room for `extra` more row changes in an update.
+  * @return 1 on success, 0 when memory runs out.
+  */
+ static int preset_dir_update_reserve(PresetDirUpdate *u, size_t extra) {
+     if (u->row_count + extra > u->row_capacity) {
+         size_t cap = u->row_capacity ? u->row_capacity : 16;
+         while (cap < u->row_count + extra) cap *= 2;
+         PresetRowChange *grown = realloc(u->rows, cap * sizeof(*grown));
+         if (grown == NULL) return 0;
+         u->rows = grown;
+         u->row_capacity = cap;
+     }
+     return 1;
+ }
+
+ /**
+  * @brief Adds a row change to an update.
+  * @return 1 on success, 0 when memory runs out.
+  */
+ static int preset_dir_update_add_row(PresetDirUpdate *u, PresetIndexChange change, size_t pos, const char *name) {
+     if (!preset_dir_update_reserve(u, 1) || (u->rows[u->row_count].name = strdup(name)) == NULL) return 0;
+     u->rows[u->row_count].change = change;
+     u->rows[u->row_count].pos = pos;
+     u->row_count++;
+     return 1;
+ }
+
+ /**
+  * @brief Brings the watcher's index up to date with a batch and hands the result to the GUI (watcher thread).
+  *
+  * Files are stat'ed and parsed here rather than on the GTK main loop. Named
+  * changes are applied one by one and remembered as rows to insert or remove.
+  * A rescan, or a batch while the bank is listed, maps the bank again if it
+  * is still current and otherwise scans the directory, and the combo is
+  * refilled. A copy of the index is left in `preset_dir` for
+  * on_preset_dir_changed_idle(), merged with an update it has not taken yet;
+  * the lock is only held for that merge.
+  */
+ static void on_preset_dir_changed(void *user_data) {
+     PresetWatchBatch batch;
+     PresetDirUpdate update;
+     PresetDirUpdate *pending = &preset_dir.pending;
+     int rows_ok = 1, schedule;
+     size_t added = 0, changed = 0, removed = 0;
+
+     (void)user_data;
+     if (!presetwatch_take(&batch)) return;
+     memset(&update, 0, sizeof(update));
+
+     if (batch.rescan || watch_index.dir == NULL) {
+         update.refill = 1;
+         if (presetbank_is_current(PRESETBANK_FILE, PRESET_DIR) && presetbank_open(&update.bank, PRESETBANK_FILE)) {
+             presetindex_free(&watch_index); // Looked at from scratch again by the next batch
+         } else {
+             if (watch_index.dir == NULL) presetindex_load(&watch_index, PRESETINDEX_FILE);
+             update.failed = !presetindex_scan(&watch_index, PRESET_DIR);
          }
- 
-         // Check if it's a regular file and ends with the preset suffix
-         if (S_ISREG(entry_stat.st_mode)) {
-             const char *suffix_ptr = strstr(entry->d_name, PRESET_SUFFIX);
-             if (suffix_ptr != NULL && strcmp(suffix_ptr, PRESET_SUFFIX) == 0) {
-                  // Add only the filename part to the combo box
-                  gtk_combo_box_text_append_text(combo, entry->d_name);
-             }
+     }
+     for (size_t i = 0; !update.refill && i < batch.count; i++) {
+         size_t pos;
+         PresetIndexChange change = presetindex_update(&watch_index, batch.names[i], &pos);
+
+         if (change == PRESETINDEX_ADDED) added++;
+         else if (change == PRESETINDEX_CHANGED) changed++;
+         else if (change == PRESETINDEX_REMOVED) removed++;
+         if (rows_ok && (change == PRESETINDEX_ADDED || change == PRESETINDEX_REMOVED)) {
+             rows_ok = preset_dir_update_add_row(&update, change, pos, batch.names[i]);
          }
      }
- 
-     closedir(dir);
- }
\ No newline at end of file
+     if (!rows_ok) update.refill = 1; // Out of memory for the rows: list the whole index instead
+     if (update.bank.data == NULL && !presetindex_copy(&update.index, &watch_index)) update.refill = 1;
+
+     pthread_mutex_lock(&preset_dir.lock);
+     // Rows of an update not taken yet come first; a refill, pending or new, makes all of them moot
+     if (!update.refill && !pending->refill && preset_dir_update_reserve(pending, update.row_count)) {
+         memcpy(pending->rows + pending->row_count, update.rows, update.row_count * sizeof(*update.rows));
+         pending->row_count += update.row_count;
+         update.row_count = 0;
+     } else {
+         pending->refill = 1;
+         pending->failed = update.failed;
+     }
+     presetbank_close(&pending->bank);
+     pending->bank = update.bank;
+     presetindex_free(&pending->index);
+     pending->index = update.index;
+     schedule = !pending->ready;
+     pending->ready = 1;
+     pthread_mutex_unlock(&preset_dir.lock);
+     if (schedule) g_idle_add(on_preset_dir_changed_idle, NULL);
+     // The bank and index now belong to the pending update; what is left are rows not needed
+     memset(&update.bank, 0, sizeof(update.bank));
+     presetindex_init(&update.index);
+     preset_dir_update_free(&update);
+
+     if (added + changed + removed > 0) {
+         printf("Presets: %zu added, %zu changed, %zu removed in %s.\n", added, changed, removed, PRESET_DIR);
+     }
+     if (watch_index.dirty) presetindex_save(&watch_index, PRESETINDEX_FILE);
+     presetwatch_batch_free(&batch);
+ }
+
+ int watch_preset_dir(GtkComboBoxText *combo) {
+     if (watched_combo != NULL) return 1;
+     // The watcher works on its own copy of what the combo lists; with a bank it starts empty
+     if (preset_bank.data == NULL && preset_index.dir != NULL && !presetindex_copy(&watch_index, &preset_index)) return 0;
+     // Also while a bank is listed: a file coming or going makes it out of date
+     if (!presetwatch_start(PRESET_DIR, PRESETWATCH_DEBOUNCE_MS, on_preset_dir_changed, NULL)) {
+         presetindex_free(&watch_index);
+         return 0;
+     }
+     watched_combo = combo;
+     return 1;
+ }
+
+ void unwatch_preset_dir(void) {
+     if (watched_combo == NULL) return;
+     // No notify call runs once the stop returns; an idle call still queued finds nothing
+     presetwatch_stop();
+     watched_combo = NULL;
+     pthread_mutex_lock(&preset_dir.lock);
+     preset_dir_update_free(&preset_dir.pending);
+     pthread_mutex_unlock(&preset_dir.lock);
+     presetindex_free(&watch_index);
+ }
@@ -11,13 +11,40 @@
  
  #include <gtk/gtk.h> 
  #include "synth_data.h"
+ #include "sequencer.h"
+
+ /** @brief Copies the sequencer's pattern, to be saved with a preset. */
+ typedef void (*PresetPatternGetFn)(SeqPattern *pattern);
+
+ /** @brief Hands the sequencer the pattern of a loaded preset (length 0 if it has none). */
+ typedef void (*PresetPatternSetFn)(const SeqPattern *pattern);
+
+ /** @brief Told (on the GTK main loop) that the preset of a combo entry was applied, to update the GUI. */
+ typedef void (*PresetLoadedFn)(const char *entry);
+
+ /**
+  * @brief Registers the functions presets exchange their step pattern with.
+  *
+  * Without them presets are saved without a pattern and the pattern of a
+  * loaded preset is ignored.
+  *
+  * @param get Reads the pattern for handle_save_preset().
+  * @param set Receives the pattern from handle_load_preset_from_file().
+  */
+ void presets_set_pattern_handlers(PresetPatternGetFn get, PresetPatternSetFn set);
+
+ /**
+  * @brief Registers the function told when handle_load_preset() applied a preset.
+  * @param loaded Called with the entry once its preset is applied, possibly after handle_load_preset() returned.
+  */
+ void presets_set_loaded_handler(PresetLoadedFn loaded);
  
  /**
   * @brief Handles the process of saving a synthesizer preset to a file.
   *
   * This function displays a file chooser dialog to allow the user to select
   * a location and filename for the preset file, then writes the current
-  * synthesizer parameters to the file.
+  * synthesizer parameters and step pattern to the file.
   *
   * @param parent_window The parent GtkWindow for the file chooser dialog.
   */
@@ -27,7 +54,7 @@
   * @brief Handles the process of loading a synthesizer preset from a specific file path.
   *
   * Reads the synthesizer parameters from the given file path
-  * and updates the global synthesizer data structure.
+  * and updates the global synthesizer data structure and the step pattern.
   *
   * @param filepath The full path to the preset file to load.
   * @param parent_window_for_errors The parent GtkWindow for displaying potential error dialogs.
@@ -36,11 +63,51 @@
  int handle_load_preset_from_file(const char *filepath, GtkWindow *parent_window_for_errors);
  
  /**
-  * @brief Scans the presets directory and populates a GtkComboBoxText with found preset files.
+  * @brief Loads the preset of an entry listed by populate_preset_combo().
+  *
+  * A preset of the bank, if one is listed, is applied at once. A file of
+  * the presets directory is read on the loader thread (see presetload.h),
+  * using the preset index's copy if the file did not change since it was
+  * indexed. Its preset is then applied from the GTK main loop, with parameters
+  * and step pattern changing together; an unreadable file is reported in a
+  * dialog there. Selecting another entry before that drops the earlier one.
+  * Either way the loaded handler is called once the preset is applied.
+  *
+  * @param entry The combo entry.
+  * @param parent_window_for_errors The parent GtkWindow for displaying potential error dialogs.
+  * @return 1 if the preset was applied or is being loaded, 0 on failure.
+  */
+ int handle_load_preset(const char *entry, GtkWindow *parent_window_for_errors);
+
+ /** @brief Stops the loader thread; a load in progress is finished and dropped. Safe to call when not running. */
+ void stop_preset_loader(void);
+ 
+ /**
+  * @brief Populates a GtkComboBoxText with the presets of the preset bank or,
+  * without one or if it is older than the presets directory (see
+  * presetbank_is_current()), with the preset files found in the directory.
   *
   * @param combo The GtkComboBoxText widget to populate.
   */
  void populate_preset_combo(GtkComboBoxText *combo);
+
+ /**
+  * @brief Keeps a combo filled by populate_preset_combo() up to date as preset files change.
+  *
+  * An inotify thread (see presetwatch.h) reports changed files and stats and
+  * parses them into its own copy of the preset index; the GTK main loop only
+  * swaps in the finished index and inserts or removes the rows concerned,
+  * without refilling the combo. While a preset bank is listed, a change
+  * refills the combo, which lists the directory once the bank is out of date.
+  * populate_preset_combo() must not be called again while watching.
+  *
+  * @param combo The combo, already populated.
+  * @return 1 if watching, 0 if the directory cannot be watched.
+  */
+ int watch_preset_dir(GtkComboBoxText *combo);
+
+ /** @brief Stops watching the presets directory. Safe to call when not watching. */
+ void unwatch_preset_dir(void);
  
  
  #endif // PRESETS_H
\ No newline at end of file
@@ -0,0 +1,306 @@
+/**
+ * @file presetwatch.c
+ * @brief inotify thread collecting changed preset file names into debounced batches.
+ *
+ * The thread sleeps in poll() on the inotify descriptor and a stop pipe.
+ * Names are appended as events arrive, under a mutex shared with
+ * presetwatch_take(); duplicates are removed when a batch is taken, so a
+ * file written a thousand times in a burst costs a thousand pointers, not a
+ * search per event. While a burst is pending, poll() times out at the end of
+ * the debounce interval, which every event pushes back up to the maximum
+ * delay.
+ */
+
+ #include <pthread.h>
+ #include <poll.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <errno.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <stdatomic.h>
+ #include <sys/inotify.h>
+
+ #include "presetwatch.h"
+ #include "preset_file.h"
+
+ // --- Constants ---
+ #define PRESETWATCH_EVENT_BUFFER 16384   ///< Bytes read from inotify at once, many events each.
+ #define PRESETWATCH_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | \
+                           IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+ /**
+  * @struct PresetWatch
+  * @brief State of the watcher. Only one instance exists.
+  */
+ typedef struct {
+     int fd;                    ///< inotify descriptor, -1 when stopped.
+     pthread_t thread;
+     int thread_started;
+     int stop_pipe[2];          ///< Wakes the thread out of poll() on stop.
+     int debounce_ms;
+     PresetWatchNotifyFn notify;
+     void *user_data;
+     pthread_mutex_t lock;      ///< Guards the fields below.
+     char **names;              ///< Changed names collected, in event order with duplicates.
+     size_t count;
+     size_t capacity;
+     int rescan;
+     int ready;                 ///< A batch is ready to be taken.
+     int notified;              ///< notify was called for the ready batch.
+     atomic_ulong events;
+     atomic_ulong batches;
+ } PresetWatch;
+
+ static PresetWatch g_watch = { .fd = -1, .stop_pipe = { -1, -1 }, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+ // --- Helper Functions ---
+
+ static long long presetwatch_now_ms(void) {
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+ }
+
+ static int compare_names(const void *a, const void *b) {
+     return strcmp(*(char *const *)a, *(char *const *)b);
+ }
+
+ /**
+  * @brief Adds a changed name (or a rescan when it cannot be kept). Call with the lock held.
+  */
+ static void presetwatch_add_name(PresetWatch *w, const char *name) {
+     char *copy;
+
+     if (w->rescan) return; // Everything is scanned anyway
+     if (w->count == w->capacity) {
+         size_t cap = w->capacity ? 2 * w->capacity : 64;
+         char **grown = (cap <= PRESETWATCH_MAX_PENDING) ? realloc(w->names, cap * sizeof(*grown)) : NULL;
+
+         if (grown == NULL) {
+             w->rescan = 1;
+             return;
+         }
+         w->names = grown;
+         w->capacity = cap;
+     }
+     if ((copy = strdup(name)) == NULL) {
+         w->rescan = 1;
+         return;
+     }
+     w->names[w->count++] = copy;
+ }
+
+ /**
+  * @brief Records the events of one read(). @return Whether any concerned the presets.
+  */
+ static int presetwatch_handle_events(PresetWatch *w, const char *buf, ssize_t len) {
+     const size_t suffix_len = strlen(PRESET_SUFFIX);
+     int relevant = 0;
+
+     pthread_mutex_lock(&w->lock);
+     for (const char *p = buf; p < buf + len; ) {
+         const struct inotify_event *ev = (const struct inotify_event *)p;
+         size_t name_len = (ev->len > 0) ? strlen(ev->name) : 0;
+
+         p += sizeof(*ev) + ev->len;
+         if (ev->mask & IN_Q_OVERFLOW) {
+             fprintf(stderr, "Warning: Preset watcher missed events, rescanning the directory\n");
+             w->rescan = 1;
+         } else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+             fprintf(stderr, "Warning: Preset directory was removed or moved, no longer watching it\n");
+             w->rescan = 1;
+         } else if (name_len > suffix_len && strcmp(ev->name + name_len - suffix_len, PRESET_SUFFIX) == 0) {
+             presetwatch_add_name(w, ev->name);
+         } else {
+             continue; // Other files, and IN_IGNORED after the directory went away
+         }
+         atomic_fetch_add_explicit(&w->events, 1, memory_order_relaxed);
+         relevant = 1;
+     }
+     pthread_mutex_unlock(&w->lock);
+     return relevant;
+ }
+
+ /**
+  * @brief Marks the changes collected as a batch and notifies, once per batch taken.
+  */
+ static void presetwatch_publish(PresetWatch *w) {
+     int notify;
+
+     pthread_mutex_lock(&w->lock);
+     w->ready = 1;
+     notify = !w->notified;
+     w->notified = 1;
+     pthread_mutex_unlock(&w->lock);
+     atomic_fetch_add_explicit(&w->batches, 1, memory_order_relaxed);
+     if (notify && w->notify != NULL) w->notify(w->user_data);
+ }
+
+ /**
+  * @brief Watcher thread: reads events and hands them over once the directory is quiet.
+  */
+ static void *presetwatch_thread_main(void *arg) {
+     PresetWatch *w = (PresetWatch *)arg;
+     struct pollfd pfds[2] = { { .fd = w->fd, .events = POLLIN }, { .fd = w->stop_pipe[0], .events = POLLIN } };
+     char buf[PRESETWATCH_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+     long long first = 0, last = 0;
+     int pending = 0;
+
+     for (;;) {
+         int timeout = -1;
+         ssize_t n;
+
+         if (pending) {
+             long long now = presetwatch_now_ms();
+             long long due = last + w->debounce_ms;
+
+             if (due > first + PRESETWATCH_MAX_DELAY_MS) due = first + PRESETWATCH_MAX_DELAY_MS;
+             if (now >= due) {
+                 presetwatch_publish(w);
+                 pending = 0;
+                 continue;
+             }
+             timeout = (int)(due - now);
+         }
+         if (poll(pfds, 2, timeout) < 0) {
+             if (errno == EINTR) continue;
+             fprintf(stderr, "Preset watcher Error: poll: %s\n", strerror(errno));
+             break;
+         }
+         if (pfds[1].revents & POLLIN) break; // Stop requested
+
+         while ((n = read(w->fd, buf, sizeof(buf))) > 0) {
+             if (presetwatch_handle_events(w, buf, n)) {
+                 last = presetwatch_now_ms();
+                 if (!pending) first = last;
+                 pending = 1;
+             }
+         }
+         if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+             fprintf(stderr, "Preset watcher Error: read: %s\n", strerror(errno));
+             break;
+         }
+     }
+     return NULL;
+ }
+
+ /**
+  * @brief Releases everything owned by the watcher state.
+  */
+ static void presetwatch_release(PresetWatch *w) {
+     PresetWatchBatch dropped = { 0 };
+
+     if (w->fd >= 0) { close(w->fd); w->fd = -1; }
+     if (w->stop_pipe[0] >= 0) { close(w->stop_pipe[0]); w->stop_pipe[0] = -1; }
+     if (w->stop_pipe[1] >= 0) { close(w->stop_pipe[1]); w->stop_pipe[1] = -1; }
+     w->thread_started = 0;
+     pthread_mutex_lock(&w->lock);
+     dropped.names = w->names;
+     dropped.count = w->count;
+     w->names = NULL;
+     w->count = w->capacity = 0;
+     w->rescan = w->ready = w->notified = 0;
+     pthread_mutex_unlock(&w->lock);
+     presetwatch_batch_free(&dropped);
+ }
+
+
+ // --- Public Functions ---
+
+ int presetwatch_start(const char *dir, int debounce_ms, PresetWatchNotifyFn notify, void *user_data) {
+     PresetWatch *w = &g_watch;
+     int err;
+
+     if (w->fd >= 0) return 1;
+
+     w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+     if (w->fd < 0) {
+         fprintf(stderr, "Preset watcher Error: cannot initialise inotify: %s\n", strerror(errno));
+         return 0;
+     }
+     if (inotify_add_watch(w->fd, dir, PRESETWATCH_MASK) < 0) {
+         fprintf(stderr, "Preset watcher Error: cannot watch %s: %s\n", dir, strerror(errno));
+         presetwatch_release(w);
+         return 0;
+     }
+     if (pipe(w->stop_pipe) != 0) {
+         fprintf(stderr, "Preset watcher Error: cannot create stop pipe: %s\n", strerror(errno));
+         presetwatch_release(w);
+         return 0;
+     }
+
+     w->debounce_ms = (debounce_ms > 0) ? debounce_ms : 0;
+     w->notify = notify;
+     w->user_data = user_data;
+     atomic_store(&w->events, 0);
+     atomic_store(&w->batches, 0);
+     err = pthread_create(&w->thread, NULL, presetwatch_thread_main, w);
+     if (err != 0) {
+         fprintf(stderr, "Preset watcher Error: cannot create thread: %s\n", strerror(err));
+         presetwatch_release(w);
+         return 0;
+     }
+     w->thread_started = 1;
+     printf("Watching %s for preset changes.\n", dir);
+     return 1;
+ }
+
+ void presetwatch_stop(void) {
+     PresetWatch *w = &g_watch;
+
+     if (w->fd < 0) return;
+
+     if (w->thread_started) {
+         char c = 0;
+         if (write(w->stop_pipe[1], &c, 1) < 0) {
+             fprintf(stderr, "Warning: cannot wake preset watcher thread: %s\n", strerror(errno));
+         }
+         pthread_join(w->thread, NULL);
+     }
+     presetwatch_release(w);
+ }
+
+ int presetwatch_take(PresetWatchBatch *batch) {
+     PresetWatch *w = &g_watch;
+     size_t kept = 0;
+
+     memset(batch, 0, sizeof(*batch));
+     pthread_mutex_lock(&w->lock);
+     if (!w->ready) {
+         pthread_mutex_unlock(&w->lock);
+         return 0;
+     }
+     batch->names = w->names;
+     batch->count = w->count;
+     batch->rescan = w->rescan;
+     w->names = NULL;
+     w->count = w->capacity = 0;
+     w->rescan = w->ready = w->notified = 0;
+     pthread_mutex_unlock(&w->lock);
+
+     // Sorted and unique: each file is looked at once however often it changed
+     qsort(batch->names, batch->count, sizeof(*batch->names), compare_names);
+     for (size_t i = 0; i < batch->count; i++) {
+         if (kept > 0 && strcmp(batch->names[kept - 1], batch->names[i]) == 0) {
+             free(batch->names[i]);
+             continue;
+         }
+         batch->names[kept++] = batch->names[i];
+     }
+     batch->count = kept;
+     return 1;
+ }
+
+ void presetwatch_batch_free(PresetWatchBatch *batch) {
+     for (size_t i = 0; i < batch->count; i++) free(batch->names[i]);
+     free(batch->names);
+     memset(batch, 0, sizeof(*batch));
+ }
+
+ void presetwatch_get_stats(PresetWatchStats *stats) {
+     stats->events = atomic_load_explicit(&g_watch.events, memory_order_relaxed);
+     stats->batches = atomic_load_explicit(&g_watch.batches, memory_order_relaxed);
+ }
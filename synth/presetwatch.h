@@ -0,0 +1,87 @@
+/**
+ * @file presetwatch.h
+ * @brief Watches the presets directory with inotify and reports which preset files changed.
+ *
+ * Presets copied in by other programs used to appear only when the combo
+ * was filled again. A background thread now reads inotify events for the
+ * directory and collects the names of the `.synthpreset` files that were
+ * created, written, moved in or out, or deleted. Events come in bursts (a
+ * sync job copying hundreds of files, an editor writing a temporary file and
+ * renaming it), so names are only handed over once the directory has been
+ * quiet for the debounce interval, or PRESETWATCH_MAX_DELAY_MS after the
+ * first event of a burst that does not stop. The notify function is then
+ * called on the watcher thread, which can take the batch with
+ * presetwatch_take() and do the file work there: the GUI keeps a copy of the
+ * preset index that this thread updates entry by entry with
+ * presetindex_update(), and only hands the result to the GTK main loop.
+ * Events arriving meanwhile wait in the kernel's queue.
+ *
+ * When the kernel's event queue overflows, or the directory itself is
+ * removed or moved, the names are not known: the batch asks for a full
+ * rescan instead.
+ */
+
+ #ifndef PRESETWATCH_H
+ #define PRESETWATCH_H
+
+ #include <stddef.h>
+
+ // --- Constants ---
+ #define PRESETWATCH_DEBOUNCE_MS 250     ///< Quiet time before a burst of changes is handed over.
+ #define PRESETWATCH_MAX_DELAY_MS 2000   ///< Longest a change waits while events keep coming.
+ #define PRESETWATCH_MAX_PENDING 65536   ///< Names collected beyond this turn into a rescan.
+
+ /** @brief Called on the watcher thread when a batch is ready; events are not read until it returns. */
+ typedef void (*PresetWatchNotifyFn)(void *user_data);
+
+ /**
+  * @struct PresetWatchBatch
+  * @brief Changed file names, sorted and unique, taken with presetwatch_take().
+  */
+ typedef struct {
+     char **names;
+     size_t count;
+     int rescan;          ///< Changes were lost: scan the whole directory (names may be empty).
+ } PresetWatchBatch;
+
+ /**
+  * @struct PresetWatchStats
+  * @brief Counters of the running (or last) watcher.
+  */
+ typedef struct {
+     unsigned long events;    ///< inotify events about preset files (or the directory).
+     unsigned long batches;   ///< Batches handed over, one notify call each at most.
+ } PresetWatchStats;
+
+ /**
+  * @brief Starts watching a directory.
+  * @param dir The directory; it must exist.
+  * @param debounce_ms Quiet time before a batch is ready, normally PRESETWATCH_DEBOUNCE_MS.
+  * @param notify Called when a batch becomes ready and the previous one was taken; may be NULL to poll.
+  * @return 1 on success (or if already running), 0 if inotify or the thread cannot be set up (reported on stderr).
+  */
+ int presetwatch_start(const char *dir, int debounce_ms, PresetWatchNotifyFn notify, void *user_data);
+
+ /**
+  * @brief Stops the thread and drops changes not taken. Safe to call when not running.
+  *
+  * No notify call is made once this returns.
+  */
+ void presetwatch_stop(void);
+
+ /**
+  * @brief Takes the changes collected so far if a batch is ready. Callable from any thread.
+  * @param[out] batch Receives the names; release with presetwatch_batch_free().
+  * @return 1 if a batch was taken, 0 if none is ready (`batch` is emptied).
+  */
+ int presetwatch_take(PresetWatchBatch *batch);
+
+ /** @brief Frees the names of a batch and empties it. */
+ void presetwatch_batch_free(PresetWatchBatch *batch);
+
+ /**
+  * @brief Copies the counters. Callable from any thread.
+  */
+ void presetwatch_get_stats(PresetWatchStats *stats);
+
+ #endif // PRESETWATCH_H
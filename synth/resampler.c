@@ -0,0 +1,229 @@
+/**
+ * @file resampler.c
+ * @brief Polyphase windowed-sinc resampler (Kaiser window, per-phase DC normalisation).
+ *
+ * Output sample n lies at input time n*M/L. Its integer part selects the
+ * input samples, its fractional part p/L selects one of the L precomputed
+ * filter phases. The filter is zero-phase around the output time, so the only
+ * added latency is the half filter length of input that has to be rendered
+ * ahead of it.
+ */
+
+ #include <math.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+
+ #if defined(__SSE__) || defined(__x86_64__)
+ #include <xmmintrin.h>
+ #define RESAMPLER_SSE 1
+ #elif defined(__ARM_NEON)
+ #include <arm_neon.h>
+ #define RESAMPLER_NEON 1
+ #endif
+
+ #include "resampler.h"
+
+ #ifndef M_PI
+ #define M_PI 3.14159265358979323846
+ #endif
+
+ // --- Filter Design per Quality Level ---
+ /** @brief Base taps, Kaiser beta and passband edge (fraction of the lower Nyquist) per quality. */
+ static const struct { unsigned int taps; double beta; double rolloff; } k_quality[] = {
+     [RESAMPLER_QUALITY_LOW]    = { 16,  6.0, 0.80 },
+     [RESAMPLER_QUALITY_MEDIUM] = { 32,  8.0, 0.88 },
+     [RESAMPLER_QUALITY_HIGH]   = { 64, 10.0, 0.92 },
+ };
+ #define RESAMPLER_MAX_TAPS 1024 ///< Upper bound after scaling the taps for downsampling.
+
+
+ // --- Helper Functions ---
+
+ static unsigned long gcd_ul(unsigned long a, unsigned long b) {
+     while (b != 0) { unsigned long t = a % b; a = b; b = t; }
+     return a;
+ }
+
+ /**
+  * @brief Zeroth-order modified Bessel function of the first kind (power series).
+  */
+ static double bessel_i0(double x) {
+     double sum = 1.0, term = 1.0, q = x * x / 4.0;
+     for (int k = 1; k < 64 && term > sum * 1e-17; k++) {
+         term *= q / ((double)k * k);
+         sum += term;
+     }
+     return sum;
+ }
+
+ /**
+  * @brief Windowed sinc at distance `d` input samples from the output time.
+  * @param cutoff Cutoff as a fraction of the input Nyquist frequency.
+  * @param half Half the filter length in input samples.
+  */
+ static double kernel(double d, double cutoff, double half, double beta) {
+     double u = d / half;
+     double x = M_PI * cutoff * d;
+     double sinc = (fabs(x) < 1e-12) ? 1.0 : sin(x) / x;
+     if (u <= -1.0 || u >= 1.0) return 0.0;
+     return cutoff * sinc * bessel_i0(beta * sqrt(1.0 - u * u)) / bessel_i0(beta);
+ }
+
+ /**
+  * @brief Dot product of `n` (a multiple of 4) floats with four fixed partial sums.
+  *
+  * The SIMD and scalar paths add the same products in the same order, so the
+  * result is bit-identical on every platform without FMA contraction.
+  */
+ static inline float dot_product(const float *restrict a, const float *restrict b, unsigned int n) {
+ #if defined(RESAMPLER_SSE)
+     __m128 acc = _mm_setzero_ps();
+     float lanes[4];
+     for (unsigned int k = 0; k < n; k += 4) {
+         acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k)));
+     }
+     _mm_storeu_ps(lanes, acc);
+     return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+ #elif defined(RESAMPLER_NEON)
+     float32x4_t acc = vdupq_n_f32(0.0f);
+     float lanes[4];
+     for (unsigned int k = 0; k < n; k += 4) {
+         acc = vaddq_f32(acc, vmulq_f32(vld1q_f32(a + k), vld1q_f32(b + k)));
+     }
+     vst1q_f32(lanes, acc);
+     return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+ #else
+     float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+     for (unsigned int k = 0; k < n; k += 4) {
+         s0 += a[k] * b[k];
+         s1 += a[k + 1] * b[k + 1];
+         s2 += a[k + 2] * b[k + 2];
+         s3 += a[k + 3] * b[k + 3];
+     }
+     return (s0 + s2) + (s1 + s3);
+ #endif
+ }
+
+
+ // --- Public Functions ---
+
+ int resampler_init(Resampler *rs, double in_rate, double out_rate, ResamplerQuality quality) {
+     unsigned long in_hz = (unsigned long)(in_rate + 0.5), out_hz = (unsigned long)(out_rate + 0.5);
+     unsigned long g;
+     double ratio, cutoff, half;
+     unsigned int taps;
+
+     memset(rs, 0, sizeof(*rs));
+     if (in_hz == 0 || out_hz == 0 || quality < RESAMPLER_QUALITY_LOW || quality > RESAMPLER_QUALITY_HIGH) return 0;
+
+     g = gcd_ul(in_hz, out_hz);
+     if (out_hz / g > RESAMPLER_MAX_PHASES) {
+         fprintf(stderr, "Resampler Error: %lu -> %lu Hz needs %lu filter phases (max %d).\n",
+                 in_hz, out_hz, out_hz / g, RESAMPLER_MAX_PHASES);
+         return 0;
+     }
+     rs->in_rate = (double)in_hz;
+     rs->out_rate = (double)out_hz;
+     rs->quality = quality;
+     rs->up = (unsigned int)(out_hz / g);
+     rs->down = (unsigned int)(in_hz / g);
+
+     // Downsampling lowers the cutoff, so the filter needs proportionally more taps
+     ratio = (double)out_hz / (double)in_hz;
+     cutoff = k_quality[quality].rolloff * (ratio < 1.0 ? ratio : 1.0);
+     taps = (unsigned int)ceil(k_quality[quality].taps / (ratio < 1.0 ? ratio : 1.0));
+     taps = (taps + 3) & ~3u;
+     if (taps > RESAMPLER_MAX_TAPS) taps = RESAMPLER_MAX_TAPS;
+     rs->taps = taps;
+     half = taps / 2.0;
+
+     rs->coeffs = malloc((size_t)rs->up * taps * sizeof(float));
+     rs->history = malloc(((size_t)taps + RESAMPLER_MAX_PULL) * sizeof(float));
+     if (rs->coeffs == NULL || rs->history == NULL) {
+         resampler_free(rs);
+         return 0;
+     }
+
+     for (unsigned int p = 0; p < rs->up; p++) {
+         double frac = (double)p / rs->up;
+         double h[RESAMPLER_MAX_TAPS];
+         double sum = 0.0;
+         for (unsigned int k = 0; k < taps; k++) {
+             // history[pos + k] is the input sample (half - 1 - k) samples before the output time
+             h[k] = kernel(frac + half - 1.0 - k, cutoff, half, k_quality[quality].beta);
+             if (rs->up == rs->down) h[k] = (k == taps / 2 - 1) ? 1.0 : 0.0; // Equal rates: exact copy
+             sum += h[k];
+         }
+         // Unity gain at DC for every phase, otherwise the phases beat against each other
+         for (unsigned int k = 0; k < taps; k++) {
+             rs->coeffs[(size_t)p * taps + k] = (float)(h[k] / sum);
+         }
+     }
+
+     resampler_reset(rs);
+     return 1;
+ }
+
+ void resampler_free(Resampler *rs) {
+     free(rs->coeffs); rs->coeffs = NULL;
+     free(rs->history); rs->history = NULL;
+ }
+
+ void resampler_reset(Resampler *rs) {
+     if (rs->history == NULL) return;
+     // Silence before the first input sample: half the filter minus the sample at the output time
+     rs->fill = rs->taps / 2 - 1;
+     memset(rs->history, 0, rs->fill * sizeof(float));
+     rs->pos = 0;
+     rs->phase = 0;
+ }
+
+ int resampler_process(Resampler *rs, float *out, unsigned long frames, ResamplerPullFn pull, void *ctx) {
+     const unsigned long capacity = rs->taps + RESAMPLER_MAX_PULL;
+
+     for (unsigned long n = 0; n < frames; n++) {
+         while (rs->pos + rs->taps > rs->fill) {
+             // Input position of the last output still to produce in this call
+             unsigned long last = rs->pos + (unsigned long)(((unsigned long long)rs->phase +
+                                  (unsigned long long)(frames - n - 1) * rs->down) / rs->up);
+             unsigned long drop = (rs->pos < rs->fill) ? rs->pos : rs->fill;
+             unsigned long want;
+             int err;
+
+             memmove(rs->history, rs->history + drop, (rs->fill - drop) * sizeof(float));
+             rs->fill -= drop;
+             rs->pos -= drop;
+             last -= drop;
+
+             want = last + rs->taps - rs->fill;
+             if (want > capacity - rs->fill) want = capacity - rs->fill;
+             if (want > RESAMPLER_MAX_PULL) want = RESAMPLER_MAX_PULL;
+             err = pull(ctx, rs->history + rs->fill, want);
+             if (err != 0) {
+                 memset(out + n, 0, (frames - n) * sizeof(float));
+                 return err;
+             }
+             rs->fill += want;
+         }
+
+         out[n] = dot_product(rs->coeffs + (size_t)rs->phase * rs->taps, rs->history + rs->pos, rs->taps);
+         rs->phase += rs->down;
+         rs->pos += rs->phase / rs->up;
+         rs->phase %= rs->up;
+     }
+     return 0;
+ }
+
+ double resampler_latency(const Resampler *rs) {
+     return (rs->in_rate > 0.0) ? (rs->taps / 2.0) / rs->in_rate : 0.0;
+ }
+
+ const char *resampler_quality_name(ResamplerQuality quality) {
+     switch (quality) {
+         case RESAMPLER_QUALITY_LOW:    return "low";
+         case RESAMPLER_QUALITY_MEDIUM: return "medium";
+         case RESAMPLER_QUALITY_HIGH:   return "high";
+         default:                       return "unknown";
+     }
+ }
@@ -0,0 +1,98 @@
+/**
+ * @file resampler.h
+ * @brief Polyphase windowed-sinc sample-rate converter for mono float streams.
+ *
+ * Converts between two rates whose ratio reduces to L/M (e.g. 44100 -> 48000
+ * is 160/147). One Kaiser-windowed sinc filter is precomputed per output phase,
+ * so each output sample costs one dot product of `taps` input samples. The dot
+ * product uses SSE or NEON when available and a scalar loop with the same four
+ * partial sums otherwise, so every platform produces identical output.
+ *
+ * Input is pulled on demand from a callback, which lets the converter sit
+ * between a render function running at the engine rate and a device buffer.
+ */
+
+ #ifndef RESAMPLER_H
+ #define RESAMPLER_H
+
+ #define RESAMPLER_MAX_PHASES 4096 ///< Largest reduced interpolation factor L (limits table size).
+ #define RESAMPLER_MAX_PULL 1024   ///< Largest number of input frames requested per pull.
+
+ /**
+  * @enum ResamplerQuality
+  * @brief Filter length / stopband trade-off.
+  */
+ typedef enum {
+     RESAMPLER_QUALITY_LOW,    ///< 16 taps: cheap, audible rolloff above ~16 kHz.
+     RESAMPLER_QUALITY_MEDIUM, ///< 32 taps.
+     RESAMPLER_QUALITY_HIGH    ///< 64 taps: flat to ~20 kHz at 44.1 kHz, >90 dB stopband.
+ } ResamplerQuality;
+
+ /**
+  * @brief Source of input samples at the input rate.
+  * @param ctx Context pointer given to resampler_process().
+  * @param[out] in Buffer to fill with `frames` samples.
+  * @param frames Number of samples requested.
+  * @return 0 on success, non-zero to abort the conversion.
+  */
+ typedef int (*ResamplerPullFn)(void *ctx, float *in, unsigned long frames);
+
+ /**
+  * @struct Resampler
+  * @brief Filter bank and input history. Initialise with resampler_init().
+  */
+ typedef struct {
+     double in_rate, out_rate;   ///< Conversion rates in Hz.
+     ResamplerQuality quality;   ///< Selected quality level.
+     unsigned int up, down;      ///< Reduced ratio: L output phases per M input samples.
+     unsigned int taps;          ///< Filter taps per phase (multiple of 4).
+     float *coeffs;              ///< `up * taps` coefficients, phase-major.
+     float *history;             ///< Input samples, `taps + RESAMPLER_MAX_PULL` long.
+     unsigned long fill;         ///< Valid samples in `history`.
+     unsigned long pos;          ///< Index in `history` of the first tap of the next output.
+     unsigned int phase;         ///< Output phase (0 .. up-1) of the next output.
+ } Resampler;
+
+ /**
+  * @brief Builds the filter bank for a rate pair.
+  * @param[out] rs The converter to initialise.
+  * @param in_rate Input (engine) rate in Hz.
+  * @param out_rate Output (device) rate in Hz.
+  * @param quality Filter quality.
+  * @return 1 on success, 0 if the rates are invalid, their ratio needs more than
+  * RESAMPLER_MAX_PHASES phases, or memory cannot be allocated.
+  */
+ int resampler_init(Resampler *rs, double in_rate, double out_rate, ResamplerQuality quality);
+
+ /**
+  * @brief Frees the filter bank and history. Safe on a zeroed or freed converter.
+  */
+ void resampler_free(Resampler *rs);
+
+ /**
+  * @brief Clears the input history (silence before the next input).
+  */
+ void resampler_reset(Resampler *rs);
+
+ /**
+  * @brief Produces `frames` output samples, pulling input as needed (real-time safe).
+  * @param[in,out] rs The converter.
+  * @param[out] out Buffer receiving `frames` samples at the output rate.
+  * @param frames Number of output samples.
+  * @param pull Input source.
+  * @param ctx Passed to `pull`.
+  * @return 0 on success, the pull function's non-zero result if it failed (the rest of `out` is silent).
+  */
+ int resampler_process(Resampler *rs, float *out, unsigned long frames, ResamplerPullFn pull, void *ctx);
+
+ /**
+  * @brief Latency added by the filter: half its length, in seconds.
+  */
+ double resampler_latency(const Resampler *rs);
+
+ /**
+  * @brief Returns the name of a quality level ("low", "medium", "high").
+  */
+ const char *resampler_quality_name(ResamplerQuality quality);
+
+ #endif // RESAMPLER_H
@@ -0,0 +1,105 @@
+/**
+ * @file ringbuffer.c
+ * @brief Implements the lock-free SPSC float ring buffer.
+ *
+ * The producer publishes samples with a release store of `write_pos` after
+ * copying them; the consumer acquires `write_pos` before copying and releases
+ * `read_pos` afterwards, so each side only ever sees fully written data.
+ */
+
+ #include <stdlib.h>
+ #include <string.h>
+
+ #include "ringbuffer.h"
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Copies `count` samples into the ring starting at position `pos`, wrapping at the end.
+  */
+ static void copy_in(RingBuffer *rb, size_t pos, const float *data, size_t count) {
+     size_t start = pos & rb->mask;
+     size_t first = rb->capacity - start;
+     if (first > count) first = count;
+     memcpy(rb->buffer + start, data, first * sizeof(float));
+     memcpy(rb->buffer, data + first, (count - first) * sizeof(float));
+ }
+
+ /**
+  * @brief Copies `count` samples out of the ring starting at position `pos`, wrapping at the end.
+  */
+ static void copy_out(const RingBuffer *rb, size_t pos, float *data, size_t count) {
+     size_t start = pos & rb->mask;
+     size_t first = rb->capacity - start;
+     if (first > count) first = count;
+     memcpy(data, rb->buffer + start, first * sizeof(float));
+     memcpy(data + first, rb->buffer, (count - first) * sizeof(float));
+ }
+
+
+ // --- Public Functions ---
+
+ int ringbuffer_init(RingBuffer *rb, size_t min_capacity) {
+     size_t capacity = 1;
+
+     if (!rb || min_capacity == 0) return 0;
+     while (capacity < min_capacity) {
+         capacity <<= 1;
+         if (capacity == 0) return 0; // Overflow
+     }
+
+     rb->buffer = calloc(capacity, sizeof(float));
+     if (rb->buffer == NULL) return 0;
+     rb->capacity = capacity;
+     rb->mask = capacity - 1;
+     atomic_init(&rb->write_pos, 0);
+     atomic_init(&rb->read_pos, 0);
+     return 1;
+ }
+
+ void ringbuffer_free(RingBuffer *rb) {
+     if (!rb) return;
+     free(rb->buffer);
+     rb->buffer = NULL;
+     rb->capacity = 0;
+     rb->mask = 0;
+ }
+
+ void ringbuffer_reset(RingBuffer *rb) {
+     atomic_store(&rb->write_pos, 0);
+     atomic_store(&rb->read_pos, 0);
+ }
+
+ size_t ringbuffer_read_available(const RingBuffer *rb) {
+     size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+     size_t r = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+     return w - r;
+ }
+
+ size_t ringbuffer_write_available(const RingBuffer *rb) {
+     return rb->capacity - ringbuffer_read_available(rb);
+ }
+
+ size_t ringbuffer_write(RingBuffer *rb, const float *data, size_t count) {
+     size_t w = atomic_load_explicit(&rb->write_pos, memory_order_relaxed);
+     size_t r = atomic_load_explicit(&rb->read_pos, memory_order_acquire);
+     size_t space = rb->capacity - (w - r);
+
+     if (count > space) count = space;
+     if (count == 0) return 0;
+     copy_in(rb, w, data, count);
+     atomic_store_explicit(&rb->write_pos, w + count, memory_order_release);
+     return count;
+ }
+
+ size_t ringbuffer_read(RingBuffer *rb, float *data, size_t count) {
+     size_t r = atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+     size_t w = atomic_load_explicit(&rb->write_pos, memory_order_acquire);
+     size_t avail = w - r;
+
+     if (count > avail) count = avail;
+     if (count == 0) return 0;
+     copy_out(rb, r, data, count);
+     atomic_store_explicit(&rb->read_pos, r + count, memory_order_release);
+     return count;
+ }
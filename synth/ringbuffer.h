@@ -0,0 +1,68 @@
+/**
+ * @file ringbuffer.h
+ * @brief Lock-free single-producer/single-consumer ring buffer of float samples.
+ *
+ * One thread writes, one thread reads; neither ever blocks or takes a lock, so
+ * the reader can be a real-time audio callback. The capacity is rounded up to
+ * a power of two and positions are free-running counters masked on access.
+ */
+
+ #ifndef RINGBUFFER_H
+ #define RINGBUFFER_H
+
+ #include <stddef.h>
+ #include <stdatomic.h>
+
+ /**
+  * @struct RingBuffer
+  * @brief SPSC float ring. Initialise with ringbuffer_init(), release with ringbuffer_free().
+  */
+ typedef struct {
+     float *buffer;                ///< Sample storage of `capacity` floats.
+     size_t capacity;              ///< Number of samples, a power of two.
+     size_t mask;                  ///< `capacity - 1`.
+     atomic_size_t write_pos;      ///< Total samples written (owned by the producer).
+     atomic_size_t read_pos;       ///< Total samples read (owned by the consumer).
+ } RingBuffer;
+
+ /**
+  * @brief Allocates a ring holding at least `min_capacity` samples.
+  * @param[out] rb The ring to initialise.
+  * @param min_capacity Requested capacity, rounded up to a power of two.
+  * @return 1 on success, 0 on invalid size or allocation failure.
+  */
+ int ringbuffer_init(RingBuffer *rb, size_t min_capacity);
+
+ /**
+  * @brief Frees the storage of a ring. Safe on a zeroed or already freed ring.
+  */
+ void ringbuffer_free(RingBuffer *rb);
+
+ /**
+  * @brief Empties the ring. Not thread-safe: only call while neither side is active.
+  */
+ void ringbuffer_reset(RingBuffer *rb);
+
+ /**
+  * @brief Number of samples the consumer can read right now.
+  */
+ size_t ringbuffer_read_available(const RingBuffer *rb);
+
+ /**
+  * @brief Number of samples the producer can write right now.
+  */
+ size_t ringbuffer_write_available(const RingBuffer *rb);
+
+ /**
+  * @brief Writes up to `count` samples (producer side).
+  * @return The number of samples actually written.
+  */
+ size_t ringbuffer_write(RingBuffer *rb, const float *data, size_t count);
+
+ /**
+  * @brief Reads up to `count` samples (consumer side).
+  * @return The number of samples actually read.
+  */
+ size_t ringbuffer_read(RingBuffer *rb, float *data, size_t count);
+
+ #endif // RINGBUFFER_H
@@ -0,0 +1,205 @@
+/**
+ * @file sampleformat.c
+ * @brief Float to int16/int24 conversion with TPDF dither and noise shaping.
+ *
+ * Every integer conversion is: scale to LSB units, add dither, clip, round to
+ * nearest (ties to even, the SSE2 and lrintf() default) and store. The SSE2
+ * and scalar paths perform the same float operations in the same order, so
+ * without FMA contraction they produce bit-identical output.
+ */
+
+ #include <math.h>
+ #include <string.h>
+
+ #if defined(__SSE2__) || defined(__x86_64__)
+ #include <emmintrin.h>
+ #define SAMPLEFORMAT_SSE2 1
+ #endif
+
+ #include "sampleformat.h"
+
+ #define RNG_TO_UNIFORM (1.0f / 4294967296.0f) ///< Maps a signed 32-bit random value to [-0.5, 0.5).
+ #define SHAPING_ERROR_LIMIT 2.0f             ///< Error fed back per sample is limited so clipping cannot destabilise the loop.
+
+
+ // --- Helper Functions ---
+
+ /** @brief Full-scale factor of an integer format (LSB per 1.0). */
+ static float format_scale(SampleFormat format) {
+     return (format == SAMPLE_FORMAT_INT24) ? 8388608.0f : 32768.0f;
+ }
+
+ /** @brief Largest positive code of an integer format. */
+ static float format_max(SampleFormat format) {
+     return (format == SAMPLE_FORMAT_INT24) ? 8388607.0f : 32767.0f;
+ }
+
+ /** @brief Advances one xorshift32 generator and returns a uniform value in [-0.5, 0.5). */
+ static inline float next_uniform(uint32_t *state) {
+     uint32_t x = *state;
+     x ^= x << 13;
+     x ^= x >> 17;
+     x ^= x << 5;
+     *state = x;
+     return (float)(int32_t)x * RNG_TO_UNIFORM;
+ }
+
+ /** @brief Stores one integer code at sample index `i`. */
+ static inline void store_sample(SampleFormat format, void *out, unsigned long i, int32_t q) {
+     if (format == SAMPLE_FORMAT_INT16) {
+         ((int16_t *)out)[i] = (int16_t)q;
+     } else {
+         unsigned char *b = (unsigned char *)out + 3 * i;
+         b[0] = (unsigned char)(q & 0xff);
+         b[1] = (unsigned char)((q >> 8) & 0xff);
+         b[2] = (unsigned char)((q >> 16) & 0xff);
+     }
+ }
+
+ /** @brief Converts one sample without noise shaping, using and advancing the current lane. */
+ static inline void convert_one(SampleConverter *conv, float scale, float lo, float hi,
+                                const float *in, void *out, unsigned long i) {
+     float v = in[i] * scale;
+     if (conv->dither == DITHER_TPDF) {
+         float u1 = next_uniform(&conv->rng[conv->lane]);
+         float u2 = next_uniform(&conv->rng[conv->lane]);
+         v = v + (u1 + u2);
+     }
+     v = fminf(fmaxf(v, lo), hi);
+     store_sample(conv->format, out, i, (int32_t)lrintf(v));
+     conv->lane = (conv->lane + 1) % SAMPLE_CONVERTER_LANES;
+ }
+
+ /**
+  * @brief Noise-shaped conversion: the total error of the last two samples is fed back
+  * so the error spectrum follows (1 - z^-1)^2.
+  */
+ static void convert_shaped(SampleConverter *conv, const float *in, void *out, unsigned long frames) {
+     const float scale = format_scale(conv->format), hi = format_max(conv->format), lo = -scale;
+     float e1 = conv->err1, e2 = conv->err2;
+
+     for (unsigned long i = 0; i < frames; i++) {
+         float u = in[i] * scale - (2.0f * e1 - e2);
+         float d = next_uniform(&conv->rng[conv->lane]);
+         d = d + next_uniform(&conv->rng[conv->lane]);
+         float v = fminf(fmaxf(u + d, lo), hi);
+         float q = (float)lrintf(v);
+         float e = fminf(fmaxf(q - u, -SHAPING_ERROR_LIMIT), SHAPING_ERROR_LIMIT);
+         store_sample(conv->format, out, i, (int32_t)q);
+         e2 = e1;
+         e1 = e;
+         conv->lane = (conv->lane + 1) % SAMPLE_CONVERTER_LANES;
+     }
+     conv->err1 = e1;
+     conv->err2 = e2;
+ }
+
+ #ifdef SAMPLEFORMAT_SSE2
+ /** @brief One xorshift32 step on four generators at once. */
+ static inline __m128i xorshift4(__m128i x) {
+     x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+     x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+     return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+ }
+
+ /**
+  * @brief Converts four samples per step starting at `i` (lane 0) while four remain.
+  * @return Index of the first sample not converted.
+  */
+ static unsigned long convert_sse2(SampleConverter *conv, const float *in, void *out, unsigned long i, unsigned long frames) {
+     const __m128 scale = _mm_set1_ps(format_scale(conv->format));
+     const __m128 hi = _mm_set1_ps(format_max(conv->format));
+     const __m128 lo = _mm_set1_ps(-format_scale(conv->format));
+     const __m128 norm = _mm_set1_ps(RNG_TO_UNIFORM);
+     const int dither = (conv->dither == DITHER_TPDF);
+     __m128i rng = _mm_loadu_si128((const __m128i *)conv->rng);
+
+     for (; i + 4 <= frames; i += 4) {
+         __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+         if (dither) {
+             rng = xorshift4(rng);
+             __m128 u1 = _mm_mul_ps(_mm_cvtepi32_ps(rng), norm);
+             rng = xorshift4(rng);
+             __m128 u2 = _mm_mul_ps(_mm_cvtepi32_ps(rng), norm);
+             v = _mm_add_ps(v, _mm_add_ps(u1, u2));
+         }
+         v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+         __m128i q = _mm_cvtps_epi32(v);
+         if (conv->format == SAMPLE_FORMAT_INT16) {
+             _mm_storel_epi64((__m128i *)((int16_t *)out + i), _mm_packs_epi32(q, q));
+         } else {
+             int32_t codes[4];
+             _mm_storeu_si128((__m128i *)codes, q);
+             for (int k = 0; k < 4; k++) store_sample(SAMPLE_FORMAT_INT24, out, i + k, codes[k]);
+         }
+     }
+     _mm_storeu_si128((__m128i *)conv->rng, rng);
+     return i;
+ }
+ #endif // SAMPLEFORMAT_SSE2
+
+
+ // --- Public Functions ---
+
+ void sample_converter_init(SampleConverter *conv, SampleFormat format, DitherMode dither, uint32_t seed) {
+     memset(conv, 0, sizeof(*conv));
+     conv->format = format;
+     conv->dither = dither;
+     for (int k = 0; k < SAMPLE_CONVERTER_LANES; k++) {
+         // Xorshift must not start at 0; spread the lanes with the golden-ratio constant
+         conv->rng[k] = seed ^ (0x9E3779B9u * (uint32_t)(k + 1));
+         if (conv->rng[k] == 0) conv->rng[k] = 1;
+     }
+ }
+
+ void sample_convert(SampleConverter *conv, const float *in, void *out, unsigned long frames) {
+     const float scale = format_scale(conv->format), hi = format_max(conv->format), lo = -scale;
+     unsigned long i = 0;
+
+     if (conv->format == SAMPLE_FORMAT_FLOAT32) {
+         memcpy(out, in, frames * sizeof(float));
+         return;
+     }
+     if (conv->dither == DITHER_SHAPED) {
+         convert_shaped(conv, in, out, frames);
+         return;
+     }
+
+     // Finish the current group of lanes so the vector loop starts on lane 0
+     while (i < frames && conv->lane != 0) {
+         convert_one(conv, scale, lo, hi, in, out, i);
+         i++;
+     }
+ #ifdef SAMPLEFORMAT_SSE2
+     i = convert_sse2(conv, in, out, i, frames);
+ #endif
+     for (; i < frames; i++) {
+         convert_one(conv, scale, lo, hi, in, out, i);
+     }
+ }
+
+ size_t sample_format_bytes(SampleFormat format) {
+     switch (format) {
+         case SAMPLE_FORMAT_INT16: return 2;
+         case SAMPLE_FORMAT_INT24: return 3;
+         default:                  return sizeof(float);
+     }
+ }
+
+ const char *sample_format_name(SampleFormat format) {
+     switch (format) {
+         case SAMPLE_FORMAT_FLOAT32: return "float32";
+         case SAMPLE_FORMAT_INT16:   return "int16";
+         case SAMPLE_FORMAT_INT24:   return "int24";
+         default:                    return "unknown";
+     }
+ }
+
+ const char *dither_mode_name(DitherMode dither) {
+     switch (dither) {
+         case DITHER_NONE:   return "none";
+         case DITHER_TPDF:   return "tpdf";
+         case DITHER_SHAPED: return "shaped";
+         default:            return "unknown";
+     }
+ }
@@ -0,0 +1,109 @@
+/**
+ * @file sequencer.c
+ * @brief Implements the step sequencer: the pattern loop on the tempo grid.
+ */
+
+ #include <string.h>
+
+ #include "sequencer.h"
+
+
+ // --- Helper Functions ---
+
+ /** @brief Derives the grid from the rate and pattern and aligns the next step at or after `frame`. */
+ static void seq_update_grid(Sequencer *s, uint64_t frame) {
+     if (s->sample_rate <= 0.0 || s->pattern.length == 0) {
+         s->grid.step_frames = 0.0;
+         return;
+     }
+     s->grid.step_frames = s->sample_rate * 60.0 / (s->tempo * s->pattern.rate);
+     tempogrid_align(&s->grid, frame);
+ }
+
+
+ // --- Public Functions ---
+
+ void seq_pattern_init(SeqPattern *p, int length) {
+     memset(p, 0, sizeof(*p));
+     p->length = (length < 0) ? 0 : (length > SEQ_MAX_STEPS) ? SEQ_MAX_STEPS : length;
+     p->rate = SEQ_DEFAULT_RATE;
+     for (int i = 0; i < SEQ_MAX_STEPS; i++) {
+         p->steps[i].note = 60;
+         p->steps[i].gate = SEQ_DEFAULT_GATE;
+     }
+ }
+
+ void seq_init(Sequencer *s, double tempo) {
+     memset(s, 0, sizeof(*s));
+     seq_pattern_init(&s->pattern, 0);
+     s->tempo = (tempo > 0.0) ? tempo : 120.0;
+     s->sounding = -1;
+     s->off_frame = SEQ_NEVER;
+ }
+
+ int seq_playing(const Sequencer *s) {
+     return s->grid.step_frames > 0.0;
+ }
+
+ void seq_set_sample_rate(Sequencer *s, double sampleRate) {
+     if (sampleRate == s->sample_rate) return;
+     s->sample_rate = sampleRate;
+     seq_update_grid(s, s->grid.step_frame);
+ }
+
+ void seq_set_pattern(Sequencer *s, const SeqPattern *p, uint64_t frame) {
+     s->pattern = *p;
+     if (s->pattern.length < 0) s->pattern.length = 0;
+     if (s->pattern.length > SEQ_MAX_STEPS) s->pattern.length = SEQ_MAX_STEPS;
+     if (!(s->pattern.rate > 0.0)) s->pattern.rate = SEQ_DEFAULT_RATE;
+     if (s->pattern.rate > SEQ_MAX_RATE) s->pattern.rate = SEQ_MAX_RATE;
+     seq_update_grid(s, frame);
+ }
+
+ void seq_sync(Sequencer *s, double beat_frame, double beat, double tempo, uint64_t frame, int restart) {
+     s->tempo = tempo;
+     s->grid.origin = beat_frame;
+     s->grid.origin_step = beat * s->pattern.rate;
+     if (s->sample_rate <= 0.0 || s->pattern.length == 0) return;
+     s->grid.step_frames = s->sample_rate * 60.0 / (s->tempo * s->pattern.rate);
+     tempogrid_resync(&s->grid, frame, restart);
+     // A note playing is over by the step, wherever it moved
+     if (s->sounding >= 0 && s->off_frame > s->grid.step_frame) s->off_frame = s->grid.step_frame;
+ }
+
+ uint64_t seq_next_frame(const Sequencer *s) {
+     uint64_t next = seq_playing(s) ? s->grid.step_frame : SEQ_NEVER;
+
+     if (s->sounding >= 0 && s->off_frame <= next) return s->off_frame;
+     return next;
+ }
+
+ int seq_next(Sequencer *s, SeqEvent *ev) {
+     const uint64_t frame = seq_next_frame(s);
+     const SeqStep *step;
+     double gate, gate_frames;
+
+     if (frame == SEQ_NEVER) return 0;
+     ev->frame = frame;
+     if (s->sounding >= 0 && s->off_frame == frame) {
+         ev->step = NULL;
+         ev->note = s->sounding;
+         s->sounding = -1;
+         s->off_frame = SEQ_NEVER;
+         return 1;
+     }
+
+     step = &s->pattern.steps[s->grid.step % (uint64_t)s->pattern.length];
+     ev->step = step;
+     ev->note = step->note;
+     tempogrid_advance(&s->grid);
+     if (step->velocity > 0) {
+         // At least a frame long, and over by the next step (gate 1 is legato: off and on on the same frame)
+         gate = (step->gate < SEQ_MIN_GATE) ? SEQ_MIN_GATE : (step->gate > 1.0) ? 1.0 : step->gate;
+         gate_frames = gate * s->grid.step_frames;
+         s->sounding = step->note;
+         s->off_frame = frame + ((gate_frames < 1.0) ? 1 : (uint64_t)(gate_frames + 0.5));
+         if (s->off_frame > s->grid.step_frame) s->off_frame = s->grid.step_frame;
+     }
+     return 1;
+ }
@@ -0,0 +1,147 @@
+/**
+ * @file sequencer.h
+ * @brief Step sequencer: loops a pattern of notes with per-step parameter locks on the tempo grid, run by the render loop.
+ *
+ * A pattern is 1-64 steps, each a note with its velocity (0 for a rest) and
+ * gate, plus up to SEQ_MAX_LOCKS parameter locks: values that replace the
+ * GUI's for that parameter from the step's first sample until the next step.
+ * The grid is counted in engine frames like the arpeggiator's (see
+ * tempogrid.h): step `k` starts at frame `round(k * step_frames)` since
+ * audio_midi_reset() and plays step `k % length` of the pattern, so a pattern
+ * always starts its bar on the same grid and a new pattern picks up where the
+ * old one would have been.
+ * Following a MIDI clock, seq_sync() lays the grid on the clock's beats,
+ * counted from its Start. The render loop asks for the frame of the next
+ * step or note off and splits the block there.
+ *
+ * Since the whole sequence is known in advance, nothing it plays depends on
+ * when a block is rendered; the engine uses this to render further ahead
+ * while only the sequencer is playing (see `seqPrerenderMs` in config.h).
+ *
+ * The sequencer belongs to the render thread; nothing here blocks or allocates.
+ */
+
+ #ifndef SEQUENCER_H
+ #define SEQUENCER_H
+
+ #include <stdint.h>
+
+ #include "tempogrid.h"
+
+ // --- Constants ---
+ #define SEQ_MAX_STEPS 64
+ #define SEQ_DEFAULT_STEPS 16
+ #define SEQ_MAX_LOCKS 4                ///< Parameter locks per step.
+ #define SEQ_DEFAULT_RATE 4.0           ///< Steps per beat: sixteenth notes.
+ #define SEQ_MAX_RATE 24.0              ///< Steps per beat: 1/64 triplets.
+ #define SEQ_DEFAULT_GATE 0.5           ///< Fraction of a step a note sounds.
+ #define SEQ_MIN_GATE 0.01
+ #define SEQ_NEVER UINT64_MAX           ///< seq_next_frame() when nothing is due.
+
+ /**
+  * @struct SeqLock
+  * @brief A parameter held at a value for one step.
+  */
+ typedef struct {
+     int param;                      ///< SynthParam.
+     double value;
+ } SeqLock;
+
+ /**
+  * @struct SeqStep
+  * @brief One step of a pattern.
+  */
+ typedef struct {
+     uint8_t note;                   ///< MIDI note 0-127.
+     uint8_t velocity;               ///< 1-127, 0 for a rest (whose locks still apply).
+     double gate;                    ///< Fraction of the step the note sounds, 0.01-1 (1 for legato).
+     int locks;                      ///< Entries of `lock` in use.
+     SeqLock lock[SEQ_MAX_LOCKS];
+ } SeqStep;
+
+ /**
+  * @struct SeqPattern
+  * @brief A loop of steps and the rate they play at.
+  */
+ typedef struct {
+     int length;                     ///< Steps in the loop, 0 for no pattern.
+     double rate;                    ///< Steps per beat.
+     SeqStep steps[SEQ_MAX_STEPS];
+ } SeqPattern;
+
+ /**
+  * @struct SeqEvent
+  * @brief What the sequencer does at a frame: start a step or end a note.
+  */
+ typedef struct {
+     uint64_t frame;                 ///< Engine frame it takes effect at.
+     const SeqStep *step;            ///< Step starting (its note plays if its velocity is not 0), NULL for a note off.
+     int note;                       ///< Note of the step, or the note ending.
+ } SeqEvent;
+
+ /**
+  * @struct Sequencer
+  * @brief Pattern and position of the sequencer.
+  */
+ typedef struct {
+     SeqPattern pattern;
+     double tempo;                   ///< Beats per minute.
+     double sample_rate;             ///< Engine rate, 0 until seq_set_sample_rate().
+     TempoGrid grid;                 ///< Steps at the engine rate, spacing 0 while there is no pattern or rate.
+     int sounding;                   ///< Note playing, -1 if none.
+     uint64_t off_frame;             ///< Frame the note off of `sounding` is due.
+ } Sequencer;
+
+ /**
+  * @brief Clears a pattern to `length` rests of middle C at the default rate and gate.
+  * @param[out] p The pattern.
+  * @param length Steps, clamped to 0-SEQ_MAX_STEPS.
+  */
+ void seq_pattern_init(SeqPattern *p, int length);
+
+ /**
+  * @brief Resets the sequencer to no pattern.
+  * @param[out] s The sequencer.
+  * @param tempo Beats per minute.
+  */
+ void seq_init(Sequencer *s, double tempo);
+
+ /** @brief Returns 1 while a pattern is looping. */
+ int seq_playing(const Sequencer *s);
+
+ /**
+  * @brief Sets the engine rate the grid is counted in. Called at the start of every block.
+  * A changed rate moves the next step to the first step of the new grid from there on.
+  */
+ void seq_set_sample_rate(Sequencer *s, double sampleRate);
+
+ /**
+  * @brief Replaces the pattern; it starts with the step of the grid at or after `frame`.
+  * A note still playing ends at its gate. A length of 0 stops the sequencer.
+  * @param[in] p The pattern, copied. Lengths over SEQ_MAX_STEPS and rates out of range are clamped.
+  * @param frame Engine frame the pattern takes over at.
+  */
+ void seq_set_pattern(Sequencer *s, const SeqPattern *p, uint64_t frame);
+
+ /**
+  * @brief Lays the grid on an external clock's beats and tempo, like arp_sync().
+  * With `restart` the pattern plays on from the step of the new grid at the
+  * tick: after a Start, the first step of the pattern on beat 0.
+  */
+ void seq_sync(Sequencer *s, double beat_frame, double beat, double tempo, uint64_t frame, int restart);
+
+ /**
+  * @brief Returns the frame of the next step or note off.
+  * @return The frame, SEQ_NEVER if no pattern is set and no note is playing.
+  */
+ uint64_t seq_next_frame(const Sequencer *s);
+
+ /**
+  * @brief Produces the step or note off due at seq_next_frame() and moves on.
+  * At a frame with both, the note off comes first.
+  * @param[out] ev The event. `ev->step` points into the sequencer's pattern.
+  * @return 1 if there was an event, 0 if nothing is due.
+  */
+ int seq_next(Sequencer *s, SeqEvent *ev);
+
+ #endif // SEQUENCER_H
@@ -0,0 +1,140 @@
+/**
+ * @file sidechain.c
+ * @brief Ring modulator, envelope follower and channel vocoder driven by audio input.
+ *
+ * Every mode works sample by sample on the output block in place, reading the
+ * input block where the driver left it. The vocoder uses constant-peak-gain
+ * bandpass biquads (transposed direct form II) spaced logarithmically between
+ * SIDECHAIN_VOCODER_LOW_HZ and SIDECHAIN_VOCODER_HIGH_HZ.
+ */
+
+ #include <math.h>
+ #include <string.h>
+
+ #include "sidechain.h"
+
+ #ifndef M_PI
+ #define M_PI 3.14159265358979323846
+ #endif
+
+ #define SIDECHAIN_BAND_RELEASE_MS 20.0 ///< Vocoder band envelope release (attack uses the follower's).
+ #define SIDECHAIN_VOCODER_MAKEUP 2.0f  ///< Restores roughly unity level for a full-scale modulator.
+ #define SIDECHAIN_DENORMAL 1e-20f      ///< Filter states below this are flushed to zero after each block.
+
+
+ // --- Helper Functions ---
+
+ /** @brief One-pole smoothing coefficient for a time constant in milliseconds. */
+ static float smoothing_coeff(double ms, double rate) {
+     return (float)(1.0 - exp(-1000.0 / (ms * rate)));
+ }
+
+ /** @brief Moves an envelope towards |x| with separate attack and release coefficients. */
+ static inline float follow(float env, float x, float attack, float release) {
+     float level = fabsf(x);
+     return env + ((level > env) ? attack : release) * (level - env);
+ }
+
+ /** @brief Flushes a filter state that has decayed into the denormal range. */
+ static inline float flush(float v) {
+     return (fabsf(v) < SIDECHAIN_DENORMAL) ? 0.0f : v;
+ }
+
+ /**
+  * @brief Designs the vocoder filter bank for the current rate.
+  *
+  * Each band's bandwidth matches the spacing to its neighbours so the bank
+  * covers the range without gaps. Bands at or above 0.45 * rate are muted.
+  */
+ static void design_bands(Sidechain *sc) {
+     const double ratio = pow(SIDECHAIN_VOCODER_HIGH_HZ / SIDECHAIN_VOCODER_LOW_HZ, 1.0 / (SIDECHAIN_VOCODER_BANDS - 1));
+     const double q = sqrt(ratio) / (ratio - 1.0);
+
+     for (int b = 0; b < SIDECHAIN_VOCODER_BANDS; b++) {
+         SidechainBand *band = &sc->bands[b];
+         double freq = SIDECHAIN_VOCODER_LOW_HZ * pow(ratio, b);
+         memset(band, 0, sizeof(*band));
+         if (freq >= 0.45 * sc->rate) continue;
+         double w0 = 2.0 * M_PI * freq / sc->rate;
+         double alpha = sin(w0) / (2.0 * q);
+         band->b0 = (float)(alpha / (1.0 + alpha));
+         band->a1 = (float)(-2.0 * cos(w0) / (1.0 + alpha));
+         band->a2 = (float)((1.0 - alpha) / (1.0 + alpha));
+     }
+ }
+
+
+ // --- Public Functions ---
+
+ int sidechain_init(Sidechain *sc, SidechainMode mode, double rate, float gain) {
+     memset(sc, 0, sizeof(*sc));
+     if (rate <= 0.0 || !(gain > 0.0f) || mode < SIDECHAIN_OFF || mode > SIDECHAIN_VOCODER) return 0;
+     sc->mode = mode;
+     sc->rate = rate;
+     sc->gain = gain;
+     sc->attack = smoothing_coeff(SIDECHAIN_FOLLOW_ATTACK_MS, rate);
+     sc->release = smoothing_coeff(SIDECHAIN_FOLLOW_RELEASE_MS, rate);
+     design_bands(sc);
+     return 1;
+ }
+
+ void sidechain_process(Sidechain *sc, const float *in, float *out, unsigned long frames) {
+     const float gain = sc->gain;
+
+     switch (sc->mode) {
+         case SIDECHAIN_RINGMOD:
+             for (unsigned long i = 0; i < frames; i++) out[i] *= gain * in[i];
+             break;
+
+         case SIDECHAIN_FOLLOW: {
+             float env = sc->env;
+             for (unsigned long i = 0; i < frames; i++) {
+                 env = follow(env, gain * in[i], sc->attack, sc->release);
+                 out[i] *= env;
+             }
+             sc->env = flush(env);
+             break;
+         }
+
+         case SIDECHAIN_VOCODER: {
+             const float band_release = smoothing_coeff(SIDECHAIN_BAND_RELEASE_MS, sc->rate);
+             for (unsigned long i = 0; i < frames; i++) {
+                 const float carrier = out[i], modulator = gain * in[i];
+                 float sum = 0.0f;
+                 for (int b = 0; b < SIDECHAIN_VOCODER_BANDS; b++) {
+                     SidechainBand *band = &sc->bands[b];
+                     float yc = band->b0 * carrier + band->c1;
+                     band->c1 = band->c2 - band->a1 * yc;
+                     band->c2 = -band->b0 * carrier - band->a2 * yc;
+                     float ym = band->b0 * modulator + band->m1;
+                     band->m1 = band->m2 - band->a1 * ym;
+                     band->m2 = -band->b0 * modulator - band->a2 * ym;
+                     band->env = follow(band->env, ym, sc->attack, band_release);
+                     sum += yc * band->env;
+                 }
+                 out[i] = SIDECHAIN_VOCODER_MAKEUP * sum;
+             }
+             for (int b = 0; b < SIDECHAIN_VOCODER_BANDS; b++) {
+                 SidechainBand *band = &sc->bands[b];
+                 band->c1 = flush(band->c1); band->c2 = flush(band->c2);
+                 band->m1 = flush(band->m1); band->m2 = flush(band->m2);
+                 band->env = flush(band->env);
+             }
+             break;
+         }
+
+         case SIDECHAIN_OFF:
+         default:
+             break;
+     }
+ }
+
+ const char *sidechain_mode_name(SidechainMode mode) {
+     switch (mode) {
+         case SIDECHAIN_OFF:     return "off";
+         case SIDECHAIN_RINGMOD: return "ringmod";
+         case SIDECHAIN_FOLLOW:  return "follow";
+         case SIDECHAIN_VOCODER: return "vocoder";
+         default:                return "unknown";
+     }
+ }
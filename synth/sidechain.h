@@ -0,0 +1,84 @@
+/**
+ * @file sidechain.h
+ * @brief Uses live audio input as a modulator for the synthesizer output.
+ *
+ * The device's input samples are read straight from the driver's buffer and
+ * applied to the rendered output block in place, so no intermediate copy of
+ * either signal is made:
+ * - ring modulation multiplies the output by the input,
+ * - the envelope follower scales the output by the input's amplitude,
+ * - the vocoder splits both signals into bands and imposes each input band's
+ *   envelope on the matching output band.
+ *
+ * Kept free of any audio API so it can be unit tested with synthetic input.
+ */
+
+ #ifndef SIDECHAIN_H
+ #define SIDECHAIN_H
+
+ #define SIDECHAIN_VOCODER_BANDS 16      ///< Number of vocoder analysis/synthesis bands.
+ #define SIDECHAIN_VOCODER_LOW_HZ 100.0  ///< Centre of the lowest vocoder band.
+ #define SIDECHAIN_VOCODER_HIGH_HZ 8000.0 ///< Centre of the highest vocoder band.
+ #define SIDECHAIN_FOLLOW_ATTACK_MS 5.0   ///< Envelope follower attack time.
+ #define SIDECHAIN_FOLLOW_RELEASE_MS 100.0 ///< Envelope follower release time.
+
+ /**
+  * @enum SidechainMode
+  * @brief How the input signal modulates the output.
+  */
+ typedef enum {
+     SIDECHAIN_OFF,      ///< Output only, no input stream.
+     SIDECHAIN_RINGMOD,  ///< out = out * in.
+     SIDECHAIN_FOLLOW,   ///< out = out * envelope(in).
+     SIDECHAIN_VOCODER   ///< Per-band envelope of the input applied to the output.
+ } SidechainMode;
+
+ /**
+  * @struct SidechainBand
+  * @brief One vocoder band: a bandpass biquad for each signal plus the input band's envelope.
+  */
+ typedef struct {
+     float b0, a1, a2;        ///< Bandpass coefficients (b1 = 0, b2 = -b0).
+     float c1, c2;            ///< Carrier (synth output) filter state.
+     float m1, m2;            ///< Modulator (input) filter state.
+     float env;               ///< Envelope of the filtered modulator.
+ } SidechainBand;
+
+ /**
+  * @struct Sidechain
+  * @brief Modulator state. Initialise with sidechain_init().
+  */
+ typedef struct {
+     SidechainMode mode;      ///< Selected mode.
+     double rate;             ///< Sample rate in Hz.
+     float gain;              ///< Linear gain applied to the input before use.
+     float attack, release;   ///< One-pole follower coefficients.
+     float env;               ///< Envelope of the whole input (follow mode).
+     SidechainBand bands[SIDECHAIN_VOCODER_BANDS]; ///< Vocoder filter bank.
+ } Sidechain;
+
+ /**
+  * @brief Prepares the modulator for a sample rate, clearing all state.
+  * @param[out] sc The modulator to initialise.
+  * @param mode Modulation mode.
+  * @param rate Device sample rate in Hz.
+  * @param gain Linear input gain (must be positive).
+  * @return 1 on success, 0 if the rate or gain is invalid.
+  */
+ int sidechain_init(Sidechain *sc, SidechainMode mode, double rate, float gain);
+
+ /**
+  * @brief Modulates a rendered block in place with the matching input block (real-time safe).
+  * @param[in,out] sc The modulator.
+  * @param[in] in `frames` mono input samples, read directly from the device buffer.
+  * @param[in,out] out `frames` mono output samples, modulated in place.
+  * @param frames Block length.
+  */
+ void sidechain_process(Sidechain *sc, const float *in, float *out, unsigned long frames);
+
+ /**
+  * @brief Returns the name of a mode ("off", "ringmod", "follow", "vocoder").
+  */
+ const char *sidechain_mode_name(SidechainMode mode);
+
+ #endif // SIDECHAIN_H
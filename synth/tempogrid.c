@@ -0,0 +1,36 @@
+/**
+ * @file tempogrid.c
+ * @brief Implements the tempo grid shared by the arpeggiator and the sequencer.
+ */
+
+ #include "tempogrid.h"
+
+
+ // --- Public Functions ---
+
+ uint64_t tempogrid_frame(const TempoGrid *g, uint64_t k) {
+     double frame = g->origin + ((double)k - g->origin_step) * g->step_frames;
+     return (frame <= 0.0) ? 0 : (uint64_t)(frame + 0.5);
+ }
+
+ void tempogrid_align(TempoGrid *g, uint64_t frame) {
+     double estimate = ((double)frame - g->origin) / g->step_frames + g->origin_step;
+     uint64_t k = (estimate <= 0.0) ? 0 : (uint64_t)estimate;
+
+     while (k > 0 && tempogrid_frame(g, k - 1) >= frame) k--;
+     while (tempogrid_frame(g, k) < frame) k++;
+     g->step = k;
+     g->step_frame = tempogrid_frame(g, k);
+ }
+
+ void tempogrid_advance(TempoGrid *g) {
+     g->step++;
+     g->step_frame = tempogrid_frame(g, g->step);
+ }
+
+ void tempogrid_resync(TempoGrid *g, uint64_t frame, int restart) {
+     // After a restart the grid starts at the tick, even one a few frames back
+     if (restart) tempogrid_align(g, (g->origin > 0.0) ? (uint64_t)g->origin : 0);
+     else g->step_frame = tempogrid_frame(g, g->step);
+     if (g->step_frame < frame) g->step_frame = frame;
+ }
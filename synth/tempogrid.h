@@ -0,0 +1,54 @@
+/**
+ * @file tempogrid.h
+ * @brief Tempo grid: the frames of the steps the arpeggiator and the sequencer play on.
+ *
+ * Steps are counted in engine frames from an origin: step `k` starts at frame
+ * `round(origin + (k - origin_step) * step_frames)`. On the internal clock
+ * the origin is frame 0 since audio_midi_reset(), so a tempo that does not
+ * divide the sample rate does not drift and a step lands on the same sample
+ * wherever the block boundaries fall; following a MIDI clock, the origin is
+ * moved onto the clock's beats (see midisync.h).
+ *
+ * A TempoGrid belongs to the render thread; nothing here blocks or allocates.
+ */
+
+ #ifndef TEMPOGRID_H
+ #define TEMPOGRID_H
+
+ #include <stdint.h>
+
+ /**
+  * @struct TempoGrid
+  * @brief Spacing and origin of the grid and the next step on it.
+  */
+ typedef struct {
+     double step_frames;             ///< Frames per step, 0 while the grid does not run.
+     double origin;                  ///< Frame of grid step `origin_step` (both 0 on the internal clock):
+     double origin_step;             ///< step `k` starts at `round(origin + (k - origin_step) * step_frames)`.
+     uint64_t step;                  ///< Grid index of the next step.
+     uint64_t step_frame;            ///< Frame of that step.
+ } TempoGrid;
+
+ /** @brief Returns the frame grid step `k` starts at (0 for steps before the start of the timeline). */
+ uint64_t tempogrid_frame(const TempoGrid *g, uint64_t k);
+
+ /**
+  * @brief Moves the next step to the first grid step at or after `frame`.
+  * @pre `step_frames` is above 0.
+  */
+ void tempogrid_align(TempoGrid *g, uint64_t frame);
+
+ /** @brief Moves the next step one step on. */
+ void tempogrid_advance(TempoGrid *g);
+
+ /**
+  * @brief Puts the next step back on the grid after its origin or spacing changed.
+  *
+  * After a restart the grid starts at the origin, even one a few frames
+  * back; otherwise the next step keeps its index and takes its new frame.
+  * Either way it is not placed before `frame`, which has been rendered.
+  * @pre `step_frames` is above 0.
+  */
+ void tempogrid_resync(TempoGrid *g, uint64_t frame, int restart);
+
+ #endif // TEMPOGRID_H
@@ -0,0 +1,53 @@
+/**
+ * @file watchdog.c
+ * @brief Stall detection and restart backoff for the audio watchdog.
+ *
+ * Kept free of any audio API and of the clock so the policy can be unit
+ * tested with synthetic timestamps.
+ */
+
+ #include <string.h>
+
+ #include "watchdog.h"
+
+ void watchdog_init(Watchdog *w, double timeout_sec) {
+     memset(w, 0, sizeof(*w));
+     w->timeout = timeout_sec;
+ }
+
+ WatchdogDecision watchdog_update(Watchdog *w, double now, double last_beat, double last_start) {
+     double alive = (last_beat > last_start) ? last_beat : last_start;
+
+     if (w->in_outage) {
+         // Any block newer than the stall means the stream plays again
+         if (last_beat > w->stall_beat) {
+             w->in_outage = 0;
+             return WATCHDOG_RECOVERED;
+         }
+         return (now >= w->next_attempt) ? WATCHDOG_RETRY : WATCHDOG_OK;
+     }
+
+     // A stream that was just (re)opened gets one timeout to deliver its first block
+     if (now - alive < w->timeout) return WATCHDOG_OK;
+
+     w->in_outage = 1;
+     w->stall_beat = last_beat;
+     w->outage_start = alive;
+     w->attempts = 0;
+     w->next_attempt = now;
+     return WATCHDOG_STALLED;
+ }
+
+ void watchdog_restarted(Watchdog *w, double now) {
+     double backoff = w->timeout;
+
+     // timeout, 2 * timeout, 4 * timeout, ... up to the cap
+     for (unsigned int i = 0; i < w->attempts && backoff < WATCHDOG_MAX_BACKOFF_SEC; i++) backoff *= 2.0;
+     if (backoff > WATCHDOG_MAX_BACKOFF_SEC) backoff = WATCHDOG_MAX_BACKOFF_SEC;
+     w->attempts++;
+     w->next_attempt = now + backoff;
+ }
+
+ double watchdog_outage_duration(const Watchdog *w, double first_beat) {
+     return (first_beat > w->outage_start) ? first_beat - w->outage_start : 0.0;
+ }
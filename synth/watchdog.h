@@ -0,0 +1,77 @@
+/**
+ * @file watchdog.h
+ * @brief Policy that decides when a silent audio stream has stalled and must be reopened.
+ *
+ * Every backend timestamps each block it delivers to the device. The audio
+ * module's watchdog thread passes the newest timestamp and the time the
+ * current stream was opened to watchdog_update() a few times per timeout.
+ * When neither is younger than the timeout the stream is considered dead
+ * (device unplugged, driver error, a callback that returned `paAbort`) and
+ * the policy asks for a restart; while restarts keep failing it asks again
+ * with an exponentially growing interval. The policy only decides, audio.c
+ * logs and restarts.
+ */
+
+ #ifndef WATCHDOG_H
+ #define WATCHDOG_H
+
+ // --- Policy Constants ---
+ #define WATCHDOG_MAX_BACKOFF_SEC 5.0 ///< Longest wait between two failed restart attempts.
+
+ /**
+  * @enum WatchdogDecision
+  * @brief Result of one policy update.
+  */
+ typedef enum {
+     WATCHDOG_OK,        ///< Blocks arrive, or a restart is pending its backoff: nothing to do.
+     WATCHDOG_STALLED,   ///< A new outage: no block for longer than the timeout. Restart.
+     WATCHDOG_RETRY,     ///< The outage continues after a restart attempt. Restart again.
+     WATCHDOG_RECOVERED  ///< Blocks arrive again after an outage.
+ } WatchdogDecision;
+
+ /**
+  * @struct Watchdog
+  * @brief Timeout and the state of the current outage. All times are in seconds on one clock.
+  */
+ typedef struct {
+     double timeout;         ///< Time without a block after which the stream counts as stalled.
+     int in_outage;          ///< Non-zero between WATCHDOG_STALLED and WATCHDOG_RECOVERED.
+     double stall_beat;      ///< Last block timestamp before the outage (0 if the stream never delivered one).
+     double outage_start;    ///< Time the stream went silent (last block, or the stream start).
+     double next_attempt;    ///< Earliest time of the next WATCHDOG_RETRY.
+     unsigned int attempts;  ///< Restarts attempted in the current outage.
+ } Watchdog;
+
+ /**
+  * @brief Prepares the policy.
+  * @param[out] w The policy state.
+  * @param timeout_sec Time without a block that counts as a stall (> 0).
+  */
+ void watchdog_init(Watchdog *w, double timeout_sec);
+
+ /**
+  * @brief Checks the stream's heartbeat.
+  * @param[in,out] w The policy state.
+  * @param now Current time.
+  * @param last_beat Timestamp of the newest device block (0 if none yet).
+  * @param last_start Time the current stream was opened (0 if never); counts as a heartbeat.
+  * @return The decision. After acting on STALLED or RETRY the caller calls watchdog_restarted().
+  */
+ WatchdogDecision watchdog_update(Watchdog *w, double now, double last_beat, double last_start);
+
+ /**
+  * @brief Notes a restart attempt and schedules the next one should it not help.
+  * @param[in,out] w The policy state.
+  * @param now Time the attempt finished.
+  */
+ void watchdog_restarted(Watchdog *w, double now);
+
+ /**
+  * @brief Length of the outage that WATCHDOG_RECOVERED just reported.
+  * @param[in] w The policy state.
+  * @param first_beat Timestamp of the first block after the outage.
+  * @return Seconds from the stream going silent until `first_beat`.
+  */
+ double watchdog_outage_duration(const Watchdog *w, double first_beat);
+
+ #endif // WATCHDOG_H
@@ -0,0 +1,118 @@
+/**
+ * @file test_adaptive.c
+ * @brief Unit tests for the adaptive latency policy (adaptive.c) using CUnit.
+ *
+ * Feeds synthetic xrun counts and load figures at the monitor's poll interval
+ * and checks when the policy asks to step the buffering up or down.
+ */
+
+ #include <stdio.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/adaptive.h"
+
+ // --- Test Globals ---
+ /** @brief Policy state under test. */
+ AdaptivePolicy g_test_policy;
+ /** @brief Seconds between two simulated monitor polls. */
+ #define POLL_SEC (ADAPTIVE_POLL_MS / 1000.0)
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_adaptive_suite(void) {
+     return 0;
+ }
+
+ int clean_adaptive_suite(void) {
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Runs the policy for `seconds` of clean, lightly loaded audio.
+  * @return The first decision other than ADAPTIVE_HOLD, or ADAPTIVE_HOLD.
+  */
+ AdaptiveDecision run_stable(double seconds, double load) {
+     for (double t = 0.0; t < seconds; t += POLL_SEC) {
+         AdaptiveDecision d = adaptive_policy_update(&g_test_policy, 0, load, POLL_SEC);
+         if (d != ADAPTIVE_HOLD) return d;
+     }
+     return ADAPTIVE_HOLD;
+ }
+
+ // --- Test Functions ---
+
+ void test_adaptive_single_xrun_holds(void) {
+     adaptive_policy_reset(&g_test_policy);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 1, 0.2, POLL_SEC), ADAPTIVE_HOLD);
+     // The window expires before a second xrun arrives
+     CU_ASSERT_EQUAL(run_stable(ADAPTIVE_XRUN_WINDOW_SEC + POLL_SEC, 0.2), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 1, 0.2, POLL_SEC), ADAPTIVE_HOLD);
+ }
+
+ void test_adaptive_repeated_xruns_step_up(void) {
+     adaptive_policy_reset(&g_test_policy);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 1, 0.2, POLL_SEC), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(run_stable(1.0, 0.2), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 1, 0.2, POLL_SEC), ADAPTIVE_STEP_UP);
+
+     adaptive_policy_reset(&g_test_policy);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, ADAPTIVE_XRUN_THRESHOLD, 0.2, POLL_SEC), ADAPTIVE_STEP_UP);
+ }
+
+ void test_adaptive_high_load_steps_up(void) {
+     adaptive_policy_reset(&g_test_policy);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 0, ADAPTIVE_LOAD_HIGH - 0.05, POLL_SEC), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 0, ADAPTIVE_LOAD_HIGH + 0.05, POLL_SEC), ADAPTIVE_STEP_UP);
+ }
+
+ void test_adaptive_settle_ignores_reopen_glitch(void) {
+     adaptive_policy_reset(&g_test_policy);
+     adaptive_policy_applied(&g_test_policy);
+     // Xruns right after a step are blamed on the reopen, not on the new size
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 5, 0.2, POLL_SEC), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(run_stable(ADAPTIVE_SETTLE_SEC, 0.2), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 5, 0.2, POLL_SEC), ADAPTIVE_STEP_UP);
+ }
+
+ void test_adaptive_stable_steps_down(void) {
+     adaptive_policy_reset(&g_test_policy);
+     CU_ASSERT_EQUAL(run_stable(ADAPTIVE_STABLE_SEC - 1.0, 0.2), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(run_stable(2.0, 0.2), ADAPTIVE_STEP_DOWN);
+
+     // Moderate load neither steps up nor counts as stable
+     adaptive_policy_reset(&g_test_policy);
+     CU_ASSERT_EQUAL(run_stable(2 * ADAPTIVE_STABLE_SEC, (ADAPTIVE_LOAD_LOW + ADAPTIVE_LOAD_HIGH) / 2), ADAPTIVE_HOLD);
+
+     // A single xrun restarts the stable period
+     adaptive_policy_reset(&g_test_policy);
+     CU_ASSERT_EQUAL(run_stable(ADAPTIVE_STABLE_SEC - 1.0, 0.2), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(adaptive_policy_update(&g_test_policy, 1, 0.2, POLL_SEC), ADAPTIVE_HOLD);
+     CU_ASSERT_EQUAL(run_stable(2.0, 0.2), ADAPTIVE_HOLD);
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("Adaptive_Latency_Policy_Tests", init_adaptive_suite, clean_adaptive_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_adaptive_single_xrun_holds", test_adaptive_single_xrun_holds)) ||
+          (NULL == CU_add_test(pSuite, "test_adaptive_repeated_xruns_step_up", test_adaptive_repeated_xruns_step_up)) ||
+          (NULL == CU_add_test(pSuite, "test_adaptive_high_load_steps_up", test_adaptive_high_load_steps_up)) ||
+          (NULL == CU_add_test(pSuite, "test_adaptive_settle_ignores_reopen_glitch", test_adaptive_settle_ignores_reopen_glitch)) ||
+          (NULL == CU_add_test(pSuite, "test_adaptive_stable_steps_down", test_adaptive_stable_steps_down))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
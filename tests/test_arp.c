@@ -0,0 +1,291 @@
+/**
+ * @file test_arp.c
+ * @brief Unit tests for the arpeggiator (arp.c) and the arpeggiated notes of the engine using CUnit.
+ *
+ * Covers the patterns of every mode, the tempo grid (steps on exact frames
+ * without drift, a chord starting on the next step), gate lengths, releasing
+ * keys, the seeded random mode, and in the rendered output the sample each
+ * note starts and ends on and that renders with different block sizes match.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <pthread.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/arp.h"
+ #include "../synth/midi.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_internal.h"
+ #include "../synth/config.h"
+ #include "test_engine.h"
+
+ // --- Test Globals ---
+ #define TEST_SAMPLE_RATE 44100.0
+ #define STEP_FRAMES 5512.5       ///< Sixteenth notes at 120 BPM and 44.1 kHz: the grid alternates 5512 and 5513 frames.
+ #define RENDER_FRAMES 44100      ///< 1 s: eight steps.
+
+ /** @brief Arpeggiator under test. */
+ Arp g_test_arp;
+ /** @brief Two renders of the same input. */
+ float g_test_render[2][RENDER_FRAMES];
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_arp_suite(void) {
+     return 0;
+ }
+
+ int clean_arp_suite(void) {
+     audio_set_config(NULL);
+     audio_midi_reset();
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief Resets the arpeggiator at 120 BPM in sixteenth notes on a 44.1 kHz grid. */
+ static void arp_setup(ArpMode mode, double gate, int octaves) {
+     arp_init(&g_test_arp, mode, 120.0, 4.0, gate, octaves);
+     arp_set_sample_rate(&g_test_arp, TEST_SAMPLE_RATE);
+ }
+
+ /**
+  * @brief Runs the arpeggiator for `count` note ons and collects their notes and frames.
+  * @return The number of note ons it produced.
+  */
+ static int collect_notes(int count, int *notes, uint64_t *frames) {
+     MidiEvent ev;
+     int n = 0;
+
+     while (n < count && arp_next(&g_test_arp, &ev)) {
+         if (ev.type != MIDI_EVENT_NOTE_ON) continue;
+         notes[n] = ev.data1;
+         if (frames != NULL) frames[n] = ev.frame;
+         n++;
+     }
+     return n;
+ }
+
+ /** @brief Sets up wave 1 as a square playing at full sustain without attack or release, wave 2 silent, and the arpeggiator on. */
+ static void setup_engine(ArpMode mode) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+
+     test_engine_init_data(WAVE_SQUARE, TEST_SAMPLE_RATE);
+     cfg.arpMode = mode;
+     cfg.tempo = 120.0;
+     cfg.arpRate = 4.0;
+     cfg.arpGate = 0.5;
+     audio_set_config(&cfg);
+     audio_midi_reset();
+ }
+
+ /** @brief Schedules a note on (velocity > 0) or off at an engine frame. */
+ static void schedule_note(uint64_t frame, int note, int velocity) {
+     MidiEvent ev = { .frame = frame, .type = velocity > 0 ? MIDI_EVENT_NOTE_ON : MIDI_EVENT_NOTE_OFF,
+                      .channel = 0, .data1 = (uint8_t)note, .data2 = (uint8_t)velocity };
+     CU_ASSERT_FATAL(audio_midi_schedule(&ev));
+ }
+
+
+ // --- Test Functions ---
+
+ void test_arp_patterns(void) {
+     static const int up[] = { 60, 64, 67, 72, 76, 79, 60 };
+     static const int down[] = { 79, 76, 72, 67, 64, 60, 79 };
+     static const int up_down[] = { 60, 64, 67, 64, 60, 64, 67 };
+     static const int played[] = { 67, 60, 64, 67, 60 };
+     int notes[8];
+
+     arp_setup(ARP_UP, 0.5, 2);
+     arp_note_on(&g_test_arp, 0, 67, 100);
+     arp_note_on(&g_test_arp, 0, 60, 100);
+     arp_note_on(&g_test_arp, 0, 64, 100);
+     CU_ASSERT_EQUAL_FATAL(collect_notes(7, notes, NULL), 7);
+     CU_ASSERT_EQUAL(memcmp(notes, up, sizeof(up)), 0);
+
+     g_test_arp.mode = ARP_DOWN;
+     g_test_arp.position = 0;
+     CU_ASSERT_EQUAL_FATAL(collect_notes(7, notes, NULL), 7);
+     CU_ASSERT_EQUAL(memcmp(notes, down, sizeof(down)), 0);
+
+     g_test_arp.mode = ARP_UP_DOWN;
+     g_test_arp.octaves = 1;
+     g_test_arp.position = 0;
+     CU_ASSERT_EQUAL_FATAL(collect_notes(7, notes, NULL), 7);
+     CU_ASSERT_EQUAL(memcmp(notes, up_down, sizeof(up_down)), 0);
+
+     g_test_arp.mode = ARP_AS_PLAYED;
+     g_test_arp.position = 0;
+     CU_ASSERT_EQUAL_FATAL(collect_notes(5, notes, NULL), 5);
+     CU_ASSERT_EQUAL(memcmp(notes, played, sizeof(played)), 0);
+
+     // Octaves above note 127 are left out
+     arp_setup(ARP_UP, 0.5, 4);
+     arp_note_on(&g_test_arp, 0, 120, 100);
+     CU_ASSERT_EQUAL_FATAL(collect_notes(3, notes, NULL), 3);
+     CU_ASSERT_EQUAL(notes[0], 120);
+     CU_ASSERT_EQUAL(notes[1], 120);
+     CU_ASSERT_EQUAL(notes[2], 120);
+ }
+
+ void test_arp_grid_is_sample_exact(void) {
+     int notes[1000];
+     uint64_t frames[1000];
+     MidiEvent ev;
+
+     arp_setup(ARP_UP, 0.5, 1);
+     CU_ASSERT_EQUAL(arp_next_frame(&g_test_arp), ARP_NEVER);
+     // A chord struck between steps starts on the next one
+     arp_note_on(&g_test_arp, 100, 60, 90);
+     CU_ASSERT_EQUAL(arp_next_frame(&g_test_arp), 5513);
+     CU_ASSERT_EQUAL_FATAL(collect_notes(1000, notes, frames), 1000);
+     // Step k is at round(k * 5512.5) however many steps came before: no drift
+     for (int k = 0; k < 1000; k++) CU_ASSERT_EQUAL(frames[k], (uint64_t)llround((k + 1) * STEP_FRAMES));
+
+     // The gate: half a step, and the note off comes before the next note on
+     arp_setup(ARP_UP, 0.5, 1);
+     arp_note_on(&g_test_arp, 0, 60, 90);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_ON);
+     CU_ASSERT_EQUAL(ev.frame, 0);
+     CU_ASSERT_EQUAL(ev.data2, 90);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_OFF);
+     CU_ASSERT_EQUAL(ev.frame, 2756);
+     CU_ASSERT_EQUAL(ev.data1, 60);
+
+     // Gate 1 is legato: the note off and the next note on share a frame
+     arp_setup(ARP_UP, 1.0, 1);
+     arp_note_on(&g_test_arp, 0, 60, 90);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_OFF);
+     CU_ASSERT_EQUAL(ev.frame, 5513);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_ON);
+     CU_ASSERT_EQUAL(ev.frame, 5513);
+ }
+
+ void test_arp_release(void) {
+     MidiEvent ev;
+
+     arp_setup(ARP_UP, 0.5, 1);
+     arp_note_on(&g_test_arp, 0, 60, 100);
+     arp_note_on(&g_test_arp, 0, 64, 100);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(ev.data1, 60);
+     // Releasing a key takes it out of the pattern
+     arp_note_off(&g_test_arp, 64);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_ON);
+     CU_ASSERT_EQUAL(ev.data1, 60);
+     // The last key up: the note playing still ends at its gate, then nothing follows
+     arp_note_off(&g_test_arp, 60);
+     CU_ASSERT_EQUAL(arp_next_frame(&g_test_arp), 5513 + 2756);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_OFF);
+     CU_ASSERT_FALSE(arp_next(&g_test_arp, &ev));
+     CU_ASSERT_EQUAL(arp_next_frame(&g_test_arp), ARP_NEVER);
+
+     // All sound off forgets the note playing as well
+     arp_note_on(&g_test_arp, 20000, 62, 100);
+     CU_ASSERT(arp_next(&g_test_arp, &ev));
+     arp_silence(&g_test_arp);
+     CU_ASSERT_EQUAL(arp_next_frame(&g_test_arp), ARP_NEVER);
+ }
+
+ void test_arp_random_is_reproducible(void) {
+     int first[64], second[64], counts[3] = { 0, 0, 0 };
+
+     for (int run = 0; run < 2; run++) {
+         arp_setup(ARP_RANDOM, 0.5, 1);
+         arp_note_on(&g_test_arp, 0, 60, 100);
+         arp_note_on(&g_test_arp, 0, 64, 100);
+         arp_note_on(&g_test_arp, 0, 67, 100);
+         CU_ASSERT_EQUAL_FATAL(collect_notes(64, run == 0 ? first : second, NULL), 64);
+     }
+     CU_ASSERT_EQUAL(memcmp(first, second, sizeof(first)), 0);
+     for (int i = 0; i < 64; i++) {
+         CU_ASSERT(first[i] == 60 || first[i] == 64 || first[i] == 67);
+         counts[first[i] == 60 ? 0 : first[i] == 64 ? 1 : 2]++;
+     }
+     CU_ASSERT(counts[0] > 0 && counts[1] > 0 && counts[2] > 0);
+ }
+
+ void test_arp_engine_plays_on_exact_samples(void) {
+     static const uint64_t steps[] = { 0, 5513, 11025, 16538, 22050, 27563, 33075, 38588 };
+     AudioStats before, after;
+
+     setup_engine(ARP_UP);
+     audio_get_stats(&before);
+     schedule_note(0, 60, 127);
+     schedule_note(0, 64, 127);
+     render_blocks(g_test_render[0], RENDER_FRAMES, 256);
+
+     // Each step sounds from its frame for half a step (2756 frames), silence until the next
+     for (int k = 0; k < 8; k++) {
+         uint64_t on = steps[k], off = on + 2756;
+         CU_ASSERT(fabsf(g_test_render[0][on]) > 0.4f);
+         CU_ASSERT(fabsf(g_test_render[0][off - 1]) > 0.4f);
+         CU_ASSERT_EQUAL(g_test_render[0][off], 0.0f);
+         if (k > 0) CU_ASSERT_EQUAL(g_test_render[0][on - 1], 0.0f);
+     }
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.arpNotes - before.arpNotes, 8);
+     audio_midi_reset();
+ }
+
+ void test_arp_engine_renders_reproducibly(void) {
+     static const unsigned long blocks[2] = { 256, 97 };
+     AudioStats st;
+
+     // The same input rendered twice from a reset, with different block boundaries
+     for (int run = 0; run < 2; run++) {
+         setup_engine(ARP_RANDOM);
+         schedule_note(0, 60, 127);
+         schedule_note(1000, 64, 100);
+         schedule_note(7000, 67, 80);
+         schedule_note(30000, 64, 0);
+         render_blocks(g_test_render[run], RENDER_FRAMES, blocks[run]);
+     }
+     audio_get_stats(&st);
+     CU_ASSERT(st.arpNotes > 0);
+     CU_ASSERT_EQUAL(memcmp(g_test_render[0], g_test_render[1], sizeof(g_test_render[0])), 0);
+     audio_midi_reset();
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("Arpeggiator_Tests", init_arp_suite, clean_arp_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_arp_patterns", test_arp_patterns)) ||
+          (NULL == CU_add_test(pSuite, "test_arp_grid_is_sample_exact", test_arp_grid_is_sample_exact)) ||
+          (NULL == CU_add_test(pSuite, "test_arp_release", test_arp_release)) ||
+          (NULL == CU_add_test(pSuite, "test_arp_random_is_reproducible", test_arp_random_is_reproducible)) ||
+          (NULL == CU_add_test(pSuite, "test_arp_engine_plays_on_exact_samples", test_arp_engine_plays_on_exact_samples)) ||
+          (NULL == CU_add_test(pSuite, "test_arp_engine_renders_reproducibly", test_arp_engine_renders_reproducibly))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
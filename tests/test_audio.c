@@ -19,6 +19,10 @@
 
  #include "../synth/synth_data.h" 
  #include "../synth/audio.h"     
+ #include "../synth/audio_internal.h"
+ #include "../synth/lookahead.h"
+ #include "../synth/config.h"
+ #include <unistd.h>
 
  // --- Test Globals ---
  /** @brief Mock sample rate used for calculations in tests. */
@@ -379,6 +383,378 @@
      CU_ASSERT(get_max_abs_output() > g_test_synth_data.amplitude2 * g_test_synth_data.sustainLevel2);
  }
 
+ // ============================================
+ // ==       Render / Statistics Tests        ==
+ // ============================================
+ void test_render_audio_matches_callback(void) {
+     float direct[TEST_BUFFER_SIZE];
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, direct, TEST_BUFFER_SIZE), 0);
+     double phase_after_direct = g_test_synth_data.phase;
+
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     CU_ASSERT_EQUAL(paCallback(NULL, g_test_output_buffer, TEST_BUFFER_SIZE, NULL, 0, &g_test_synth_data), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.phase, phase_after_direct, 1e-12);
+     CU_ASSERT_EQUAL(memcmp(direct, g_test_output_buffer, sizeof(direct)), 0);
+ }
+
+ void test_callback_records_stats(void) {
+     PaStreamCallbackTimeInfo time_info = { .inputBufferAdcTime = 0.0, .currentTime = 10.0, .outputBufferDacTime = 10.005 };
+     AudioStats stats;
+     setup_default_synth_data();
+     audio_stats_reset("portaudio");
+
+     CU_ASSERT_EQUAL(paCallback(NULL, g_test_output_buffer, TEST_BUFFER_SIZE, &time_info, 0, &g_test_synth_data), 0);
+     CU_ASSERT_EQUAL(paCallback(NULL, g_test_output_buffer, TEST_BUFFER_SIZE, NULL, paOutputUnderflow, &g_test_synth_data), 0);
+
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.backend, "portaudio");
+     CU_ASSERT_EQUAL(stats.callbacks, 2);
+     CU_ASSERT_EQUAL(stats.framesRendered, 2 * TEST_BUFFER_SIZE);
+     CU_ASSERT_EQUAL(stats.xruns, 1);
+     CU_ASSERT_DOUBLE_EQUAL(stats.dacLatencyMs, 5.0, 0.01);
+     CU_ASSERT_DOUBLE_EQUAL(stats.dacLatencyMinMs, 5.0, 0.01);
+     CU_ASSERT_DOUBLE_EQUAL(stats.dacLatencyMaxMs, 5.0, 0.01);
+
+     audio_stats_reset("none");
+     audio_get_stats(&stats);
+     CU_ASSERT_EQUAL(stats.callbacks, 0);
+     CU_ASSERT(stats.dacLatencyAvgMs < 0.0);
+ }
+
+ void test_nonblocking_render_when_mutex_busy(void) {
+     float direct[TEST_BUFFER_SIZE];
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     render_audio_nonblocking_reset();
+
+     // Lock never taken yet: silence instead of blocking
+     pthread_mutex_lock(&g_test_synth_data.mutex);
+     CU_ASSERT_EQUAL(render_audio_nonblocking(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT(get_max_abs_output() < 1e-9);
+     pthread_mutex_unlock(&g_test_synth_data.mutex);
+
+     // First block reads parameters and writes the phase back
+     CU_ASSERT_EQUAL(render_audio_nonblocking(&g_test_synth_data, direct, TEST_BUFFER_SIZE), 0);
+     double phase_after_one = g_test_synth_data.phase;
+     CU_ASSERT(phase_after_one != 0.0);
+
+     // Mutex busy: still renders from the cache, shared state untouched
+     pthread_mutex_lock(&g_test_synth_data.mutex);
+     CU_ASSERT_EQUAL(render_audio_nonblocking(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT(get_max_abs_output() > 0.1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.phase, phase_after_one, 1e-12);
+     pthread_mutex_unlock(&g_test_synth_data.mutex);
+
+     // Next block continues from the cached voice rather than replaying the stale shared phase
+     CU_ASSERT_EQUAL(render_audio_nonblocking(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT(memcmp(direct, g_test_output_buffer, sizeof(direct)) != 0);
+     CU_ASSERT(g_test_synth_data.phase != phase_after_one);
+ }
+
+ void test_nonblocking_render_keeps_gui_note_change(void) {
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     render_audio_nonblocking_reset();
+     CU_ASSERT_EQUAL(render_audio_nonblocking(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+
+     // Block rendered while the GUI holds the lock...
+     pthread_mutex_lock(&g_test_synth_data.mutex);
+     CU_ASSERT_EQUAL(render_audio_nonblocking(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     // ...and the GUI releases the note before unlocking
+     g_test_synth_data.lastEnvValue = g_test_synth_data.amplitude * g_test_synth_data.sustainLevel;
+     g_test_synth_data.currentStage = ENV_RELEASE; g_test_synth_data.timeInStage = 0.0;
+     pthread_mutex_unlock(&g_test_synth_data.mutex);
+
+     CU_ASSERT_EQUAL(render_audio_nonblocking(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT_EQUAL(g_test_synth_data.currentStage, ENV_RELEASE);
+     CU_ASSERT(g_test_synth_data.timeInStage > 0.0);
+ }
+
+ void test_lookahead_feeds_callback(void) {
+     AudioStats stats;
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     audio_stats_reset("portaudio");
+
+     CU_ASSERT_FATAL(lookahead_start(&g_test_synth_data, 1024, 4096));
+     CU_ASSERT_EQUAL(lookahead_is_running(), 1);
+     // Ring was prefilled: the callback only copies and gets audio immediately
+     CU_ASSERT_EQUAL(paCallback(NULL, g_test_output_buffer, TEST_BUFFER_SIZE, NULL, 0, &g_test_synth_data), 0);
+     CU_ASSERT(get_max_abs_output() > 0.1);
+
+     audio_get_stats(&stats);
+     CU_ASSERT_EQUAL(stats.lookaheadFrames, 1024);
+     CU_ASSERT(stats.lookaheadFill >= 1024 - 64);
+     CU_ASSERT_EQUAL(stats.lookaheadUnderruns, 0);
+
+     // Reading more than the lookahead at once underruns and pads with silence
+     float big[4096];
+     usleep(20000);
+     CU_ASSERT(lookahead_read(big, 4096) < 4096);
+     CU_ASSERT_DOUBLE_EQUAL(big[4095], 0.0, 1e-9);
+     audio_get_stats(&stats);
+     CU_ASSERT_EQUAL(stats.lookaheadUnderruns, 1);
+
+     // The target can be resized in place up to the size the ring was allocated for
+     CU_ASSERT_EQUAL(lookahead_set_target(2048), 2048);
+     CU_ASSERT_EQUAL(lookahead_set_target(100000), 4096);
+     CU_ASSERT_EQUAL(lookahead_get_target(), 4096);
+     usleep(100000);
+     audio_get_stats(&stats);
+     CU_ASSERT_EQUAL(stats.lookaheadFrames, 4096);
+     CU_ASSERT(lookahead_read(big, 4096) > 2048);
+
+     lookahead_stop();
+     CU_ASSERT_EQUAL(lookahead_is_running(), 0);
+     audio_get_stats(&stats);
+     CU_ASSERT_EQUAL(stats.lookaheadFrames, 0);
+ }
+
+ void test_internal_rate_resamples_callback(void) {
+     AudioConfig config = AUDIO_CONFIG_DEFAULTS;
+     AudioStats stats;
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     g_test_synth_data.sampleRate = 44100.0;
+     config.internalRate = 44100.0;
+     config.sampleRate = 48000.0;
+     config.srcQuality = RESAMPLER_QUALITY_LOW;
+     audio_set_config(&config);
+     audio_stats_reset("portaudio");
+
+     CU_ASSERT_DOUBLE_EQUAL(audio_device_rate_requested(&g_test_synth_data), 48000.0, 1e-9);
+     CU_ASSERT_FATAL(audio_device_rate_adopt(&g_test_synth_data, 48000.0));
+     // The engine keeps its fixed rate; the callback output is resampled
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.sampleRate, 44100.0, 1e-9);
+     CU_ASSERT_EQUAL(paCallback(NULL, g_test_output_buffer, TEST_BUFFER_SIZE, NULL, 0, &g_test_synth_data), 0);
+     CU_ASSERT_EQUAL(paCallback(NULL, g_test_output_buffer, TEST_BUFFER_SIZE, NULL, 0, &g_test_synth_data), 0);
+     CU_ASSERT(get_max_abs_output() > 0.1);
+
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.srcQuality, "low");
+     CU_ASSERT_DOUBLE_EQUAL(stats.srcEngineRate, 44100.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(stats.srcDeviceRate, 48000.0, 1e-9);
+     CU_ASSERT(stats.srcLatencyMs > 0.0);
+     CU_ASSERT(stats.srcLoad >= 0.0);
+
+     audio_src_release();
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.srcQuality, "off");
+
+     // Without a fixed internal rate the engine follows the device
+     audio_set_config(NULL);
+     CU_ASSERT(audio_device_rate_adopt(&g_test_synth_data, 48000.0));
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.sampleRate, 48000.0, 1e-9);
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.srcQuality, "off");
+ }
+
+ void test_duplex_input_modulates_callback(void) {
+     AudioConfig config = AUDIO_CONFIG_DEFAULTS;
+     AudioStats stats;
+     static float input[TEST_BUFFER_SIZE];
+     PaStreamCallbackTimeInfo timeInfo = { .inputBufferAdcTime = 1.000, .currentTime = 1.002, .outputBufferDacTime = 1.010 };
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     config.inputMode = SIDECHAIN_RINGMOD;
+     audio_set_config(&config);
+     audio_stats_reset("portaudio");
+     CU_ASSERT_FATAL(audio_device_rate_adopt(&g_test_synth_data, 44100.0));
+
+     // Silent input silences a ring-modulated output
+     for (int i = 0; i < TEST_BUFFER_SIZE; i++) input[i] = 0.0f;
+     CU_ASSERT_EQUAL(paCallback(input, g_test_output_buffer, TEST_BUFFER_SIZE, &timeInfo, 0, &g_test_synth_data), 0);
+     CU_ASSERT_DOUBLE_EQUAL(get_max_abs_output(), 0.0, 1e-9);
+
+     for (int i = 0; i < TEST_BUFFER_SIZE; i++) input[i] = 1.0f;
+     CU_ASSERT_EQUAL(paCallback(input, g_test_output_buffer, TEST_BUFFER_SIZE, &timeInfo, 0, &g_test_synth_data), 0);
+     CU_ASSERT(get_max_abs_output() > 0.1);
+
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.inputMode, "ringmod");
+     CU_ASSERT_DOUBLE_EQUAL(stats.duplexLatencyMs, 10.0, 1e-3);
+     CU_ASSERT_DOUBLE_EQUAL(stats.duplexLatencyMaxMs, 10.0, 1e-3);
+
+     // Output-only streams leave the round trip unmeasured
+     audio_set_config(NULL);
+     audio_stats_reset("portaudio");
+     CU_ASSERT(audio_device_rate_adopt(&g_test_synth_data, 44100.0));
+     CU_ASSERT_EQUAL(paCallback(NULL, g_test_output_buffer, TEST_BUFFER_SIZE, &timeInfo, 0, &g_test_synth_data), 0);
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.inputMode, "off");
+     CU_ASSERT_DOUBLE_EQUAL(stats.duplexLatencyMs, -1.0, 1e-9);
+ }
+
+ void test_integer_output_conversion_stats(void) {
+     AudioStats stats;
+     SampleConverter conv;
+     static int16_t converted[TEST_BUFFER_SIZE];
+     setup_default_synth_data();
+     g_test_synth_data.currentStage = ENV_SUSTAIN; g_test_synth_data.note_active = 1;
+     audio_stats_reset("portaudio");
+
+     // Float streams report no conversion
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.sampleFormat, "float32");
+     CU_ASSERT_DOUBLE_EQUAL(stats.convertLoad, -1.0, 1e-9);
+
+     audio_stats_set_format("int16", "none");
+     sample_converter_init(&conv, SAMPLE_FORMAT_INT16, DITHER_NONE, 1);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     audio_convert_output(&conv, g_test_output_buffer, converted, TEST_BUFFER_SIZE, 44100.0);
+     for (int i = 0; i < TEST_BUFFER_SIZE; i += 37) {
+         CU_ASSERT_EQUAL(converted[i], (int16_t)lrintf(g_test_output_buffer[i] * 32768.0f));
+     }
+
+     audio_get_stats(&stats);
+     CU_ASSERT_STRING_EQUAL(stats.sampleFormat, "int16");
+     CU_ASSERT_STRING_EQUAL(stats.dither, "none");
+     CU_ASSERT(stats.convertLoad >= 0.0 && stats.convertLoad < 1.0);
+ }
+
+ void test_midi_events_are_sample_accurate(void) {
+     AudioStats before, after;
+     MidiEvent ev = { .channel = 0 };
+     setup_default_synth_data();
+     // Square wave without attack or release: the output steps exactly at the event
+     g_test_synth_data.waveform = WAVE_SQUARE; g_test_synth_data.amplitude = 0.5;
+     g_test_synth_data.attackTime = 0.0; g_test_synth_data.decayTime = 0.0;
+     g_test_synth_data.sustainLevel = 1.0; g_test_synth_data.releaseTime = 0.0;
+     audio_midi_reset();
+     audio_get_stats(&before);
+
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT(get_max_abs_output() < 1e-9);
+
+     // A4 an octave up (880 Hz) from offset 100 to 200 of the second block
+     ev.type = MIDI_EVENT_NOTE_ON; ev.data1 = 81; ev.data2 = 127; ev.frame = TEST_BUFFER_SIZE + 100;
+     CU_ASSERT_FATAL(audio_midi_schedule(&ev));
+     ev.type = MIDI_EVENT_NOTE_OFF; ev.data2 = 0; ev.frame = TEST_BUFFER_SIZE + 200;
+     CU_ASSERT_FATAL(audio_midi_schedule(&ev));
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+
+     for (int i = 0; i < 100; i++) CU_ASSERT_EQUAL(g_test_output_buffer[i], 0.0f);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_output_buffer[100], 0.5, 1e-6);
+     // Half a period of 880 Hz is 25.06 samples: the square flips after sample 125
+     CU_ASSERT(g_test_output_buffer[125] > 0.4f);
+     CU_ASSERT(g_test_output_buffer[126] < -0.4f);
+     CU_ASSERT(fabsf(g_test_output_buffer[199]) > 0.4f);
+     for (int i = 200; i < TEST_BUFFER_SIZE; i++) CU_ASSERT_EQUAL(g_test_output_buffer[i], 0.0f);
+     CU_ASSERT_EQUAL(g_test_synth_data.currentStage, ENV_IDLE);
+
+     // An event stamped for an already rendered frame plays at the start of the next block
+     ev.type = MIDI_EVENT_NOTE_ON; ev.data2 = 127; ev.frame = 10;
+     CU_ASSERT_FATAL(audio_midi_schedule(&ev));
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_output_buffer[0], 0.5, 1e-6);
+
+     // Live input is stamped one block ahead of the last rendered block start, never late
+     CU_ASSERT_EQUAL(audio_midi_input(MIDI_EVENT_CONTROL, 0, MIDI_CC_ALL_SOUND_OFF, 0), 1);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT_EQUAL(g_test_synth_data.currentStage, ENV_IDLE);
+
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.midiEvents - before.midiEvents, 4);
+     CU_ASSERT_EQUAL(after.midiLateEvents - before.midiLateEvents, 1);
+     CU_ASSERT_EQUAL(after.midiDroppedEvents, before.midiDroppedEvents);
+     audio_midi_reset();
+ }
+
+ void test_key_input_plays_without_mutex(void) {
+     AudioStats before, after;
+     double block_ms = 1000.0 * TEST_BUFFER_SIZE / 44100.0;
+     int first = -1;
+     setup_default_synth_data();
+     g_test_synth_data.waveform = WAVE_SQUARE; g_test_synth_data.amplitude = 0.5;
+     g_test_synth_data.attackTime = 0.0; g_test_synth_data.decayTime = 0.0;
+     g_test_synth_data.sustainLevel = 1.0; g_test_synth_data.releaseTime = 0.0;
+     audio_midi_reset();
+     audio_get_stats(&before);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+
+     // The GUI may hold the mutex: the key goes to the render thread without it
+     CU_ASSERT_EQUAL(pthread_mutex_lock(&g_test_synth_data.mutex), 0);
+     CU_ASSERT_EQUAL(audio_key_input(69, 100), 1);
+     CU_ASSERT_EQUAL(pthread_mutex_unlock(&g_test_synth_data.mutex), 0);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     for (int i = 0; i < TEST_BUFFER_SIZE && first < 0; i++) if (g_test_output_buffer[i] != 0.0f) first = i;
+     CU_ASSERT(first >= 0);
+     CU_ASSERT_EQUAL(g_test_synth_data.currentStage, ENV_SUSTAIN);
+
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.keyNotes - before.keyNotes, 1);
+     // From the key to its sample: at most the rest of the block it arrived in plus its offset here
+     CU_ASSERT(after.keyLatencyMs >= 0.0 && after.keyLatencyMs < 2.0 * block_ms);
+     CU_ASSERT(after.keyLatencyMinMs <= after.keyLatencyMs && after.keyLatencyMaxMs >= after.keyLatencyMs);
+
+     CU_ASSERT_EQUAL(audio_key_input(69, 0), 1);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT_EQUAL(g_test_synth_data.currentStage, ENV_IDLE);
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.keyNotes - before.keyNotes, 1);
+     audio_midi_reset();
+ }
+
+ void test_midi_mapped_controller_sets_param(void) {
+     MidiMapping m = midimap_default(SYNTH_PARAM_AMP1, MIDI_MAP_ANY_CHANNEL, 74);
+     MidiEvent ev = { .type = MIDI_EVENT_CONTROL, .channel = 2, .data1 = 74 };
+     MidiMap map;
+     AudioStats before, after;
+     unsigned long updates;
+     setup_default_synth_data();
+     g_test_synth_data.waveform = WAVE_SQUARE; g_test_synth_data.amplitude = 0.5;
+     g_test_synth_data.attackTime = 0.0; g_test_synth_data.decayTime = 0.0;
+     g_test_synth_data.sustainLevel = 1.0; g_test_synth_data.note_active = 1;
+     g_test_synth_data.currentStage = ENV_SUSTAIN;
+     audio_midi_reset();
+     CU_ASSERT_FATAL(audio_midi_map(SYNTH_PARAM_AMP1, &m));
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     updates = audio_midi_param_updates();
+
+     // Controller 74 at 0 halfway through the next block silences wave 1 from that sample on
+     ev.data2 = 0; ev.frame = TEST_BUFFER_SIZE + 128;
+     CU_ASSERT_FATAL(audio_midi_schedule(&ev));
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT(fabsf(g_test_output_buffer[127]) > 0.4f);
+     for (int i = 128; i < TEST_BUFFER_SIZE; i++) CU_ASSERT_EQUAL(g_test_output_buffer[i], 0.0f);
+     // ...and the value reaches the shared data for the GUI
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.0, 1e-12);
+     CU_ASSERT_EQUAL(audio_midi_param_updates(), updates + 1);
+
+     // A burst of live messages is merged: one event applies the latest value
+     audio_get_stats(&before);
+     for (int v = 0; v < 100; v++) CU_ASSERT_EQUAL(audio_midi_input(MIDI_EVENT_CONTROL, 5, 74, v), 1);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.midiEvents - before.midiEvents, 1);
+     CU_ASSERT_EQUAL(after.midiCoalescedEvents - before.midiCoalescedEvents, 99);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 99.0 / 127.0, 1e-12);
+
+     // Learn assigns the next controller moved, with its channel
+     audio_midi_learn(SYNTH_PARAM_RELEASE2);
+     CU_ASSERT_EQUAL(audio_midi_learning(), SYNTH_PARAM_RELEASE2);
+     CU_ASSERT_EQUAL(audio_midi_input(MIDI_EVENT_CONTROL, 3, 21, 127), 1);
+     CU_ASSERT_EQUAL(audio_midi_learning(), -1);
+     audio_midi_get_map(&map);
+     CU_ASSERT_EQUAL(map.params[SYNTH_PARAM_RELEASE2].cc, 21);
+     CU_ASSERT_EQUAL(map.params[SYNTH_PARAM_RELEASE2].channel, 3);
+     CU_ASSERT_EQUAL(map.params[SYNTH_PARAM_AMP1].cc, 74);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.releaseTime2, 5.0, 1e-12);
+
+     // Unmapped controllers leave the parameters alone
+     CU_ASSERT_TRUE(audio_midi_map(SYNTH_PARAM_AMP1, NULL));
+     CU_ASSERT_TRUE(audio_midi_map(SYNTH_PARAM_RELEASE2, NULL));
+     CU_ASSERT_FALSE(audio_midi_map(SYNTH_PARAM_COUNT, &m));
+     CU_ASSERT_EQUAL(audio_midi_input(MIDI_EVENT_CONTROL, 5, 74, 10), 1);
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, g_test_output_buffer, TEST_BUFFER_SIZE), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 99.0 / 127.0, 1e-12);
+     audio_midi_reset();
+ }
+
  // --- Main Test Runner Function ---
  int main() {
      CU_pSuite pSuite = NULL;
@@ -388,7 +764,18 @@
 
      if ( (NULL == CU_add_test(pSuite, "test_adsr_idle_both_waves", test_adsr_idle_both_waves)) ||
           (NULL == CU_add_test(pSuite, "test_w1_adsr_attack_ramp", test_w1_adsr_attack_ramp)) ||
-          (NULL == CU_add_test(pSuite, "test_mixing_two_sines_sustain", test_mixing_two_sines_sustain))
+          (NULL == CU_add_test(pSuite, "test_mixing_two_sines_sustain", test_mixing_two_sines_sustain)) ||
+          (NULL == CU_add_test(pSuite, "test_render_audio_matches_callback", test_render_audio_matches_callback)) ||
+          (NULL == CU_add_test(pSuite, "test_callback_records_stats", test_callback_records_stats)) ||
+          (NULL == CU_add_test(pSuite, "test_nonblocking_render_when_mutex_busy", test_nonblocking_render_when_mutex_busy)) ||
+          (NULL == CU_add_test(pSuite, "test_nonblocking_render_keeps_gui_note_change", test_nonblocking_render_keeps_gui_note_change)) ||
+          (NULL == CU_add_test(pSuite, "test_lookahead_feeds_callback", test_lookahead_feeds_callback)) ||
+          (NULL == CU_add_test(pSuite, "test_internal_rate_resamples_callback", test_internal_rate_resamples_callback)) ||
+          (NULL == CU_add_test(pSuite, "test_duplex_input_modulates_callback", test_duplex_input_modulates_callback)) ||
+          (NULL == CU_add_test(pSuite, "test_integer_output_conversion_stats", test_integer_output_conversion_stats)) ||
+          (NULL == CU_add_test(pSuite, "test_midi_events_are_sample_accurate", test_midi_events_are_sample_accurate)) ||
+          (NULL == CU_add_test(pSuite, "test_key_input_plays_without_mutex", test_key_input_plays_without_mutex)) ||
+          (NULL == CU_add_test(pSuite, "test_midi_mapped_controller_sets_param", test_midi_mapped_controller_sets_param))
         )
      { CU_cleanup_registry(); return CU_get_error(); }
 
@@ -0,0 +1,141 @@
+/**
+ * @file test_audio_jack.c
+ * @brief Tests for the JACK client backend (audio_jack.c) using CUnit.
+ *
+ * Needs a running JACK server; no sound card is required when it uses the
+ * dummy driver:
+ *
+ *     jackd -d dummy -r 48000 -p 256 &
+ *     ./test_runner_audio_jack
+ *
+ * Without a server the tests only check that the backend reports the device
+ * as unavailable. Builds without `HAVE_JACK` check that the backend reports
+ * itself unavailable.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <unistd.h>
+ #include <pthread.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/synth_data.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_jack.h"
+
+ // --- Test Globals ---
+ /** @brief Shared data rendered by the JACK process callback. */
+ SharedSynthData g_test_synth_data;
+ /** @brief Configuration selecting the JACK backend on the default server. */
+ AudioConfig g_test_config;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_jack_suite(void) {
+     return 0;
+ }
+
+ int clean_jack_suite(void) {
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Resets the shared data to a sustained Wave 1 and a JACK configuration.
+  */
+ void setup_jack_test(void) {
+     g_test_synth_data = (SharedSynthData){
+         .frequency = 440.0, .amplitude = 0.5, .waveform = WAVE_SINE,
+         .attackTime = 0.01, .decayTime = 0.01, .sustainLevel = 1.0, .releaseTime = 0.1,
+         .note_active = 1, .currentStage = ENV_SUSTAIN,
+         .frequency2 = 660.0, .amplitude2 = 0.0, .waveform2 = WAVE_SINE,
+         .sampleRate = 44100.0
+     };
+     pthread_mutex_init(&g_test_synth_data.mutex, NULL);
+     audio_config_set_defaults(&g_test_config);
+     g_test_config.backend = AUDIO_BACKEND_JACK;
+ }
+
+ // --- Test Functions ---
+
+ #ifdef HAVE_JACK
+
+ void test_jack_client_renders_in_process_callback(void) {
+     AudioStats stats;
+     setup_jack_test();
+
+     PaError err = jack_backend_start(&g_test_synth_data, &g_test_config);
+     if (err == paDeviceUnavailable) {
+         printf("\n  No JACK server running (start 'jackd -d dummy'), skipping.\n");
+         CU_ASSERT_EQUAL(jack_backend_is_running(), 0);
+         pthread_mutex_destroy(&g_test_synth_data.mutex);
+         return;
+     }
+     CU_ASSERT_FATAL(err == paNoError);
+     CU_ASSERT_EQUAL(jack_backend_is_running(), 1);
+     usleep(300000);
+
+     // Hold the mutex for a while: the process callback must keep running
+     audio_get_stats(&stats);
+     unsigned long long before = stats.callbacks;
+     pthread_mutex_lock(&g_test_synth_data.mutex);
+     usleep(100000);
+     audio_get_stats(&stats);
+     pthread_mutex_unlock(&g_test_synth_data.mutex);
+     CU_ASSERT(stats.callbacks > before);
+
+     CU_ASSERT_EQUAL(jack_backend_stop(), paNoError);
+     CU_ASSERT_EQUAL(jack_backend_is_running(), 0);
+
+     CU_ASSERT_STRING_EQUAL(stats.backend, "jack");
+     CU_ASSERT(stats.framesRendered > 0);
+     CU_ASSERT(g_test_synth_data.phase != 0.0);
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+ void test_jack_stop_when_not_running(void) {
+     CU_ASSERT_EQUAL(jack_backend_is_running(), 0);
+     CU_ASSERT_EQUAL(jack_backend_stop(), paNoError);
+ }
+
+ #else
+
+ void test_jack_backend_unavailable(void) {
+     setup_jack_test();
+     audio_set_config(&g_test_config);
+     CU_ASSERT_EQUAL(start_audio(&g_test_synth_data), paHostApiNotFound);
+     audio_set_config(NULL);
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+ #endif // HAVE_JACK
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("Audio_JACK_Backend_Tests", init_jack_suite, clean_jack_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+ #ifdef HAVE_JACK
+     if ( (NULL == CU_add_test(pSuite, "test_jack_client_renders_in_process_callback", test_jack_client_renders_in_process_callback)) ||
+          (NULL == CU_add_test(pSuite, "test_jack_stop_when_not_running", test_jack_stop_when_not_running))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+ #else
+     printf("Built without JACK support: only checking that the backend reports itself unavailable.\n");
+     if (NULL == CU_add_test(pSuite, "test_jack_backend_unavailable", test_jack_backend_unavailable))
+     { CU_cleanup_registry(); return CU_get_error(); }
+ #endif
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
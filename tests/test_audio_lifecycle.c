@@ -16,6 +16,7 @@
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <unistd.h>
  
  #include <cmocka.h>
  #include <portaudio.h> 
@@ -28,7 +29,8 @@
  #define Pa_GetDefaultOutputDevice __wrap_Pa_GetDefaultOutputDevice
  #define Pa_GetDeviceInfo __wrap_Pa_GetDeviceInfo
  #define Pa_GetVersionInfo __wrap_Pa_GetVersionInfo
- #define Pa_OpenDefaultStream __wrap_Pa_OpenDefaultStream
+ #define Pa_GetDeviceCount __wrap_Pa_GetDeviceCount
+ #define Pa_OpenStream __wrap_Pa_OpenStream
  #define Pa_StartStream __wrap_Pa_StartStream
  #define Pa_StopStream __wrap_Pa_StopStream
  #define Pa_CloseStream __wrap_Pa_CloseStream
@@ -59,12 +61,23 @@
      return (PaDeviceIndex)mock();
  }
  
+ /** @brief Mock implementation FOR Pa_GetDeviceCount. Uses CMocka expectations. */
+ PaDeviceIndex __wrap_Pa_GetDeviceCount(void) {
+     return (PaDeviceIndex)mock();
+ }
+ 
  /** @brief Static mock device info instance returned by mock Pa_GetDeviceInfo. */
  static const PaDeviceInfo mock_device_info = {
      .structVersion = 1, .name = "Mock Device", .hostApi = 0, .maxInputChannels = 0,
      .maxOutputChannels = 2, .defaultLowInputLatency = 0.0, .defaultLowOutputLatency = 0.01,
      .defaultHighInputLatency = 0.0, .defaultHighOutputLatency = 0.1, .defaultSampleRate = 44100.0
  };
+ /** @brief Static mock info of a capture-only device, used for duplex streams. */
+ static const PaDeviceInfo mock_input_device_info = {
+     .structVersion = 1, .name = "Mock Input", .hostApi = 0, .maxInputChannels = 1,
+     .maxOutputChannels = 0, .defaultLowInputLatency = 0.005, .defaultLowOutputLatency = 0.0,
+     .defaultHighInputLatency = 0.05, .defaultHighOutputLatency = 0.0, .defaultSampleRate = 44100.0
+ };
  /** @brief Mock implementation FOR Pa_GetDeviceInfo. Uses CMocka expectations. */
  const PaDeviceInfo* __wrap_Pa_GetDeviceInfo(PaDeviceIndex device) {
      check_expected(device);
@@ -84,13 +97,19 @@
  /** @brief Mock PaStream pointer value used to simulate an active stream. */
  #define MOCK_PA_STREAM ((PaStream*)0xDEADBEEF)
  
- /** @brief Mock implementation FOR Pa_OpenDefaultStream. Uses CMocka expectations. */
- PaError __wrap_Pa_OpenDefaultStream( PaStream** stream,
-                                      int numInputChannels, int numOutputChannels,
-                                      PaSampleFormat sampleFormat, double sampleRate,
-                                      unsigned long framesPerBuffer,
-                                      PaStreamCallback *streamCallback, void *userData ) {
+ /** @brief Mock implementation FOR Pa_OpenStream. Uses CMocka expectations. */
+ PaError __wrap_Pa_OpenStream( PaStream** stream,
+                               const PaStreamParameters *inputParameters,
+                               const PaStreamParameters *outputParameters,
+                               double sampleRate, unsigned long framesPerBuffer,
+                               PaStreamFlags streamFlags,
+                               PaStreamCallback *streamCallback, void *userData ) {
+     int numInputChannels = inputParameters ? inputParameters->channelCount : 0;
+     int numOutputChannels = outputParameters ? outputParameters->channelCount : 0;
+     PaDeviceIndex outputDevice = outputParameters ? outputParameters->device : paNoDevice;
      check_expected(stream);
+     check_expected(outputDevice);
+     check_expected(framesPerBuffer);
      check_expected(numInputChannels);
      check_expected(numOutputChannels);
      check_expected(sampleRate);
@@ -153,6 +172,7 @@
  
  static int teardown(void **state) {
      g_paStream = NULL;
+     audio_set_config(NULL); // Restore default device/buffer selection
      pthread_mutex_destroy(&g_test_synth_data.mutex);
      return 0;
  }
@@ -190,12 +210,14 @@
      will_return(__wrap_Pa_GetDefaultOutputDevice, defaultDevice);
      expect_value(__wrap_Pa_GetDeviceInfo, device, defaultDevice);
      will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
-     expect_any(__wrap_Pa_OpenDefaultStream, stream);
-     expect_value(__wrap_Pa_OpenDefaultStream, numInputChannels, 0);
-     expect_value(__wrap_Pa_OpenDefaultStream, numOutputChannels, 1);
-     expect_value(__wrap_Pa_OpenDefaultStream, sampleRate, g_test_synth_data.sampleRate);
-     expect_value(__wrap_Pa_OpenDefaultStream, userData, &g_test_synth_data);
-     will_return(__wrap_Pa_OpenDefaultStream, paNoError);
+     expect_any(__wrap_Pa_OpenStream, stream);
+     expect_value(__wrap_Pa_OpenStream, outputDevice, defaultDevice);
+     expect_value(__wrap_Pa_OpenStream, framesPerBuffer, paFramesPerBufferUnspecified);
+     expect_value(__wrap_Pa_OpenStream, numInputChannels, 0);
+     expect_value(__wrap_Pa_OpenStream, numOutputChannels, 1);
+     expect_value(__wrap_Pa_OpenStream, sampleRate, g_test_synth_data.sampleRate);
+     expect_value(__wrap_Pa_OpenStream, userData, &g_test_synth_data);
+     will_return(__wrap_Pa_OpenStream, paNoError);
      expect_value(__wrap_Pa_StartStream, stream, MOCK_PA_STREAM);
      will_return(__wrap_Pa_StartStream, paNoError);
  
@@ -217,26 +239,64 @@
      will_return(__wrap_Pa_GetDefaultOutputDevice, defaultDevice);
      expect_value(__wrap_Pa_GetDeviceInfo, device, defaultDevice);
      will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
-     expect_any(__wrap_Pa_OpenDefaultStream, stream);
-     expect_any(__wrap_Pa_OpenDefaultStream, numInputChannels);
-     expect_any(__wrap_Pa_OpenDefaultStream, numOutputChannels);
-     expect_any(__wrap_Pa_OpenDefaultStream, sampleRate);
-     expect_any(__wrap_Pa_OpenDefaultStream, userData);
-     will_return(__wrap_Pa_OpenDefaultStream, paInternalError);
+     expect_any(__wrap_Pa_OpenStream, stream);
+     expect_any(__wrap_Pa_OpenStream, outputDevice);
+     expect_any(__wrap_Pa_OpenStream, framesPerBuffer);
+     expect_any(__wrap_Pa_OpenStream, numInputChannels);
+     expect_any(__wrap_Pa_OpenStream, numOutputChannels);
+     expect_any(__wrap_Pa_OpenStream, sampleRate);
+     expect_any(__wrap_Pa_OpenStream, userData);
+     will_return(__wrap_Pa_OpenStream, paInternalError);
  
      PaError result = start_audio(&g_test_synth_data);
  
      assert_int_equal(result, paInternalError);
  }
  
+ static void test_start_audio_configured_device(void **state) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+     cfg.deviceIndex = 1;
+     cfg.framesPerBuffer = 32;
+     cfg.suggestedLatency = 0.002;
+     audio_set_config(&cfg);
+
+     // Explicit index: validated against the device count, default device not queried
+     will_return(__wrap_Pa_GetDeviceCount, 2);
+     expect_value(__wrap_Pa_GetDeviceInfo, device, 1);
+     will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
+     expect_any(__wrap_Pa_OpenStream, stream);
+     expect_value(__wrap_Pa_OpenStream, outputDevice, 1);
+     expect_value(__wrap_Pa_OpenStream, framesPerBuffer, 32);
+     expect_value(__wrap_Pa_OpenStream, numInputChannels, 0);
+     expect_value(__wrap_Pa_OpenStream, numOutputChannels, 1);
+     expect_value(__wrap_Pa_OpenStream, sampleRate, g_test_synth_data.sampleRate);
+     expect_value(__wrap_Pa_OpenStream, userData, &g_test_synth_data);
+     will_return(__wrap_Pa_OpenStream, paNoError);
+     expect_value(__wrap_Pa_StartStream, stream, MOCK_PA_STREAM);
+     will_return(__wrap_Pa_StartStream, paNoError);
+
+     PaError result = start_audio(&g_test_synth_data);
+
+     assert_int_equal(result, paNoError);
+ }
+ 
+ static void test_start_audio_configured_device_out_of_range(void **state) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+     cfg.deviceIndex = 5;
+     audio_set_config(&cfg);
+     will_return(__wrap_Pa_GetDeviceCount, 2);
+     PaError result = start_audio(&g_test_synth_data);
+     assert_int_equal(result, paDeviceUnavailable);
+ }
+ 
  // Similar adjustments for stop/terminate tests - expect calls to __wrap_ functions
  static void test_stop_audio_success(void **state) {
      // Simulate internal state by calling start_audio first
      PaDeviceIndex defaultDevice = 0;
      expect_function_call(__wrap_Pa_GetDefaultOutputDevice); will_return(__wrap_Pa_GetDefaultOutputDevice, defaultDevice);
      expect_value(__wrap_Pa_GetDeviceInfo, device, defaultDevice); will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
-     expect_any(__wrap_Pa_OpenDefaultStream, stream); expect_any(__wrap_Pa_OpenDefaultStream, numInputChannels); expect_any(__wrap_Pa_OpenDefaultStream, numOutputChannels); expect_any(__wrap_Pa_OpenDefaultStream, sampleRate); expect_any(__wrap_Pa_OpenDefaultStream, userData);
-     will_return(__wrap_Pa_OpenDefaultStream, paNoError);
+     expect_any(__wrap_Pa_OpenStream, stream); expect_any(__wrap_Pa_OpenStream, outputDevice); expect_any(__wrap_Pa_OpenStream, framesPerBuffer); expect_any(__wrap_Pa_OpenStream, numInputChannels); expect_any(__wrap_Pa_OpenStream, numOutputChannels); expect_any(__wrap_Pa_OpenStream, sampleRate); expect_any(__wrap_Pa_OpenStream, userData);
+     will_return(__wrap_Pa_OpenStream, paNoError);
      expect_value(__wrap_Pa_StartStream, stream, MOCK_PA_STREAM); will_return(__wrap_Pa_StartStream, paNoError);
      start_audio(&g_test_synth_data); // Call real start
  
@@ -269,8 +329,8 @@
      PaDeviceIndex defaultDevice = 0;
      expect_function_call(__wrap_Pa_GetDefaultOutputDevice); will_return(__wrap_Pa_GetDefaultOutputDevice, defaultDevice);
      expect_value(__wrap_Pa_GetDeviceInfo, device, defaultDevice); will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
-     expect_any(__wrap_Pa_OpenDefaultStream, stream); expect_any(__wrap_Pa_OpenDefaultStream, numInputChannels); expect_any(__wrap_Pa_OpenDefaultStream, numOutputChannels); expect_any(__wrap_Pa_OpenDefaultStream, sampleRate); expect_any(__wrap_Pa_OpenDefaultStream, userData);
-     will_return(__wrap_Pa_OpenDefaultStream, paNoError);
+     expect_any(__wrap_Pa_OpenStream, stream); expect_any(__wrap_Pa_OpenStream, outputDevice); expect_any(__wrap_Pa_OpenStream, framesPerBuffer); expect_any(__wrap_Pa_OpenStream, numInputChannels); expect_any(__wrap_Pa_OpenStream, numOutputChannels); expect_any(__wrap_Pa_OpenStream, sampleRate); expect_any(__wrap_Pa_OpenStream, userData);
+     will_return(__wrap_Pa_OpenStream, paNoError);
      expect_value(__wrap_Pa_StartStream, stream, MOCK_PA_STREAM); will_return(__wrap_Pa_StartStream, paNoError);
      start_audio(&g_test_synth_data); // Call real start
  
@@ -286,6 +346,156 @@
      assert_int_equal(result, paNoError);
  }
  
+ /** @brief Expects the PortAudio calls that open and start a stream on an explicit device index. */
+ static void expect_open_device(PaDeviceIndex device, PaError open_result) {
+     will_return(__wrap_Pa_GetDeviceCount, 2);
+     expect_value(__wrap_Pa_GetDeviceInfo, device, device);
+     will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
+     expect_any(__wrap_Pa_OpenStream, stream);
+     expect_value(__wrap_Pa_OpenStream, outputDevice, device);
+     expect_any(__wrap_Pa_OpenStream, framesPerBuffer); expect_any(__wrap_Pa_OpenStream, numInputChannels); expect_any(__wrap_Pa_OpenStream, numOutputChannels);
+     expect_value(__wrap_Pa_OpenStream, sampleRate, g_test_synth_data.sampleRate);
+     expect_value(__wrap_Pa_OpenStream, userData, &g_test_synth_data);
+     will_return(__wrap_Pa_OpenStream, open_result);
+     if (open_result != paNoError) return;
+     expect_value(__wrap_Pa_StartStream, stream, MOCK_PA_STREAM);
+     will_return(__wrap_Pa_StartStream, paNoError);
+ }
+
+ /** @brief Expects the PortAudio calls that stop and close the mock stream. */
+ static void expect_close_stream(void) {
+     expect_value(__wrap_Pa_StopStream, stream, MOCK_PA_STREAM);
+     will_return(__wrap_Pa_StopStream, paNoError);
+     expect_value(__wrap_Pa_CloseStream, stream, MOCK_PA_STREAM);
+     will_return(__wrap_Pa_CloseStream, paNoError);
+ }
+
+ static void test_start_audio_duplex_input(void **state) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+     cfg.deviceIndex = 0;
+     cfg.inputDeviceIndex = 1;
+     cfg.inputMode = SIDECHAIN_VOCODER;
+     audio_set_config(&cfg);
+
+     // Output device, then the input device is validated and opened with one channel
+     will_return(__wrap_Pa_GetDeviceCount, 2);
+     expect_value(__wrap_Pa_GetDeviceInfo, device, 0);
+     will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
+     will_return(__wrap_Pa_GetDeviceCount, 2);
+     expect_value(__wrap_Pa_GetDeviceInfo, device, 1);
+     will_return(__wrap_Pa_GetDeviceInfo, &mock_input_device_info);
+     expect_value(__wrap_Pa_GetDeviceInfo, device, 1);
+     will_return(__wrap_Pa_GetDeviceInfo, &mock_input_device_info);
+     expect_any(__wrap_Pa_OpenStream, stream);
+     expect_value(__wrap_Pa_OpenStream, outputDevice, 0);
+     expect_any(__wrap_Pa_OpenStream, framesPerBuffer);
+     expect_value(__wrap_Pa_OpenStream, numInputChannels, 1);
+     expect_value(__wrap_Pa_OpenStream, numOutputChannels, 1);
+     expect_value(__wrap_Pa_OpenStream, sampleRate, g_test_synth_data.sampleRate);
+     expect_value(__wrap_Pa_OpenStream, userData, &g_test_synth_data);
+     will_return(__wrap_Pa_OpenStream, paNoError);
+     expect_value(__wrap_Pa_StartStream, stream, MOCK_PA_STREAM);
+     will_return(__wrap_Pa_StartStream, paNoError);
+     assert_int_equal(start_audio(&g_test_synth_data), paNoError);
+     expect_close_stream();
+     assert_int_equal(stop_audio(), paNoError);
+
+     // A device without input channels falls back to an output-only stream
+     cfg.inputDeviceIndex = 0;
+     audio_set_config(&cfg);
+     will_return(__wrap_Pa_GetDeviceCount, 2);
+     expect_value(__wrap_Pa_GetDeviceInfo, device, 0);
+     will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
+     will_return(__wrap_Pa_GetDeviceCount, 2);
+     expect_value(__wrap_Pa_GetDeviceInfo, device, 0);
+     will_return(__wrap_Pa_GetDeviceInfo, &mock_device_info);
+     expect_any(__wrap_Pa_OpenStream, stream);
+     expect_value(__wrap_Pa_OpenStream, outputDevice, 0);
+     expect_any(__wrap_Pa_OpenStream, framesPerBuffer);
+     expect_value(__wrap_Pa_OpenStream, numInputChannels, 0);
+     expect_value(__wrap_Pa_OpenStream, numOutputChannels, 1);
+     expect_any(__wrap_Pa_OpenStream, sampleRate);
+     expect_any(__wrap_Pa_OpenStream, userData);
+     will_return(__wrap_Pa_OpenStream, paNoError);
+     expect_value(__wrap_Pa_StartStream, stream, MOCK_PA_STREAM);
+     will_return(__wrap_Pa_StartStream, paNoError);
+     assert_int_equal(start_audio(&g_test_synth_data), paNoError);
+     expect_close_stream();
+     assert_int_equal(stop_audio(), paNoError);
+ }
+
+ static void test_restart_audio_switches_device(void **state) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+     AudioStats before, after;
+     cfg.deviceIndex = 0;
+     audio_set_config(&cfg);
+     expect_open_device(0, paNoError);
+     assert_int_equal(start_audio(&g_test_synth_data), paNoError);
+     g_test_synth_data.phase = 1.25;
+     audio_get_stats(&before);
+
+     // Only the device side is reopened; the voices are left alone
+     cfg.deviceIndex = 1;
+     expect_close_stream();
+     expect_open_device(1, paNoError);
+     assert_int_equal(audio_restart(&g_test_synth_data, &cfg), paNoError);
+
+     audio_get_stats(&after);
+     assert_int_equal(after.restarts, before.restarts + 1);
+     assert_true(after.restartMs >= 0.0);
+     assert_int_equal(g_test_synth_data.currentStage, ENV_ATTACK);
+     assert_float_equal(g_test_synth_data.timeInStage, 1.0, 1e-9);
+     assert_float_equal(g_test_synth_data.phase, 1.25, 1e-9);
+
+     expect_close_stream();
+     assert_int_equal(stop_audio(), paNoError);
+ }
+
+ static void test_restart_audio_failure_restores_device(void **state) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS, current;
+     cfg.deviceIndex = 0;
+     audio_set_config(&cfg);
+     expect_open_device(0, paNoError);
+     assert_int_equal(start_audio(&g_test_synth_data), paNoError);
+
+     // Device 1 refuses to open: the stream comes back on device 0
+     cfg.deviceIndex = 1;
+     expect_close_stream();
+     expect_open_device(1, paInternalError);
+     expect_open_device(0, paNoError);
+     assert_int_equal(audio_restart(&g_test_synth_data, &cfg), paInternalError);
+     audio_get_config(&current);
+     assert_int_equal(current.deviceIndex, 0);
+
+     expect_close_stream();
+     assert_int_equal(stop_audio(), paNoError);
+ }
+
+ static void test_watchdog_restarts_silent_stream(void **state) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+     AudioStats before, after;
+     cfg.deviceIndex = 0;
+     cfg.watchdogMs = 200.0;
+     audio_set_config(&cfg);
+     expect_open_device(0, paNoError);
+     assert_int_equal(start_audio(&g_test_synth_data), paNoError);
+     g_test_synth_data.phase = 0.75;
+     audio_get_stats(&before);
+
+     // The mock stream never calls back: after 200 ms the watchdog reopens it once
+     expect_close_stream();
+     expect_open_device(0, paNoError);
+     usleep(300000);
+
+     audio_get_stats(&after);
+     assert_int_equal(after.watchdogOutages, before.watchdogOutages + 1);
+     assert_int_equal(after.restarts, before.restarts + 1);
+     assert_float_equal(g_test_synth_data.phase, 0.75, 1e-9);
+
+     expect_close_stream();
+     assert_int_equal(stop_audio(), paNoError);
+ }
+
  static void test_terminate_audio_fail(void **state) {
      expect_function_call(__wrap_Pa_Terminate);
      will_return(__wrap_Pa_Terminate, paInternalError);
@@ -301,9 +511,15 @@
          cmocka_unit_test_setup_teardown(test_start_audio_success, setup, teardown),
          cmocka_unit_test_setup_teardown(test_start_audio_no_device, setup, teardown),
          cmocka_unit_test_setup_teardown(test_start_audio_open_fail, setup, teardown),
+         cmocka_unit_test_setup_teardown(test_start_audio_configured_device, setup, teardown),
+         cmocka_unit_test_setup_teardown(test_start_audio_configured_device_out_of_range, setup, teardown),
+         cmocka_unit_test_setup_teardown(test_start_audio_duplex_input, setup, teardown),
          cmocka_unit_test_setup_teardown(test_stop_audio_success, setup, teardown),
          cmocka_unit_test_setup_teardown(test_stop_audio_already_stopped, setup, teardown),
          // Add tests for stop_audio failures here if needed
+         cmocka_unit_test_setup_teardown(test_restart_audio_switches_device, setup, teardown),
+         cmocka_unit_test_setup_teardown(test_restart_audio_failure_restores_device, setup, teardown),
+         cmocka_unit_test_setup_teardown(test_watchdog_restarts_silent_stream, setup, teardown),
          cmocka_unit_test_setup_teardown(test_terminate_audio_success_stream_null, setup, teardown),
          cmocka_unit_test_setup_teardown(test_terminate_audio_success_stream_active, setup, teardown),
          cmocka_unit_test_setup_teardown(test_terminate_audio_fail, setup, teardown),
@@ -0,0 +1,338 @@
+/**
+ * @file test_automation.c
+ * @brief Unit tests for parameter automation (automation.c) and the engine recording and playing it using CUnit.
+ *
+ * Covers the size of an hour of dense automation, seeking in it (with a
+ * benchmark), ramps and the step after a pause, saving, appending and loading
+ * a take including a file cut short, and the engine recording control events
+ * and GUI changes at their frames and playing them back to the same samples.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <pthread.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/automation.h"
+ #include "../synth/midi.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_internal.h"
+ #include "../synth/config.h"
+ #include "test_bench.h"
+
+ // --- Test Globals ---
+ #define TEST_SAMPLE_RATE 44100.0
+ #define DENSE_INTERVAL 256       ///< Frames between points of the dense take: a value every block.
+ #define DENSE_SECONDS 3600
+ #define SEEKS 100000
+ #define RENDER_FRAMES 8192
+ #define BLOCK_FRAMES 256
+ #define TEST_TAKE_PATH "/tmp/synth_test_automation.synthauto"
+
+ /** @brief Take under test. */
+ Automation g_test_take;
+ /** @brief Shared data rendered by the engine test. */
+ SharedSynthData g_test_synth_data;
+ /** @brief The recorded render and its playback. */
+ float g_test_render[2][RENDER_FRAMES];
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_automation_suite(void) {
+     automation_init(&g_test_take, TEST_SAMPLE_RATE);
+     return 0;
+ }
+
+ int clean_automation_suite(void) {
+     automation_free(&g_test_take);
+     audio_automation_stop();
+     audio_set_config(NULL);
+     audio_midi_reset();
+     remove(TEST_TAKE_PATH);
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief Value of the dense take's point `k`: a slow sweep like a hand on a knob. */
+ static double dense_value(size_t k) {
+     return 0.5 + 0.4 * sin(2.0 * M_PI * (double)(k * DENSE_INTERVAL) / (10.0 * TEST_SAMPLE_RATE));
+ }
+
+ /** @brief Fills lane 0 of g_test_take with an hour of points, one every DENSE_INTERVAL frames. */
+ static size_t fill_dense(void) {
+     const size_t points = (size_t)(DENSE_SECONDS * TEST_SAMPLE_RATE / DENSE_INTERVAL);
+
+     automation_free(&g_test_take);
+     automation_init(&g_test_take, TEST_SAMPLE_RATE);
+     for (size_t k = 0; k < points; k++) {
+         if (!automation_lane_append(&g_test_take.lanes[0], k * DENSE_INTERVAL, dense_value(k))) return 0;
+     }
+     return points;
+ }
+
+ /** @brief Sets up wave 1 as a square at full sustain without attack or release and wave 2 as a silent sine. */
+ static void setup_engine(void) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+
+     g_test_synth_data = (SharedSynthData){
+         .frequency = 440.0, .amplitude = 0.5, .waveform = WAVE_SQUARE,
+         .attackTime = 0.0, .decayTime = 0.0, .sustainLevel = 1.0, .releaseTime = 0.0,
+         .currentStage = ENV_ATTACK,
+         .frequency2 = 330.0, .amplitude2 = 0.0, .waveform2 = WAVE_SINE,
+         .attackTime2 = 0.0, .decayTime2 = 0.0, .sustainLevel2 = 1.0, .releaseTime2 = 0.0,
+         .currentStage2 = ENV_ATTACK,
+         .sampleRate = TEST_SAMPLE_RATE
+     };
+     pthread_mutex_init(&g_test_synth_data.mutex, NULL);
+     cfg.sampleRate = TEST_SAMPLE_RATE;
+     audio_set_config(&cfg);
+     audio_midi_reset();
+ }
+
+ /** @brief Schedules a parameter change at an engine frame. */
+ static void schedule_param(SynthParam param, double value, uint64_t frame) {
+     MidiEvent ev = { .frame = frame, .type = MIDI_EVENT_PARAM, .data1 = (uint8_t)param, .value = value };
+     CU_ASSERT(audio_midi_schedule(&ev));
+ }
+
+ /** @brief Renders blocks of BLOCK_FRAMES from frame `from` up to frame `to`. */
+ static void render(float *out, unsigned long from, unsigned long to) {
+     for (unsigned long done = from; done < to; done += BLOCK_FRAMES) {
+         CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, out + done, BLOCK_FRAMES), 0);
+     }
+ }
+
+
+ // --- Test Functions ---
+
+ void test_automation_dense_hour_is_compact(void) {
+     const size_t points = fill_dense();
+     size_t bytes;
+     double value;
+
+     CU_ASSERT_FATAL(points > 0);
+     CU_ASSERT_EQUAL(automation_points(&g_test_take), points);
+     bytes = automation_bytes(&g_test_take);
+     printf("\n    Automation: %zu points in an hour, %zu bytes (%.2f bytes/point) ", points, bytes, (double)bytes / points);
+     // Two bytes of frame and at most two of value per point, against 16 for a raw frame and double
+     CU_ASSERT(bytes <= 4 * points);
+     CU_ASSERT(g_test_take.lanes[0].index_count == (points + AUTO_INDEX_INTERVAL - 1) / AUTO_INDEX_INTERVAL);
+
+     // Values come back to the quantum, and ramp between the points
+     CU_ASSERT(automation_lane_value(&g_test_take.lanes[0], 0, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, dense_value(0), AUTO_VALUE_QUANTUM);
+     CU_ASSERT(automation_lane_value(&g_test_take.lanes[0], 1000 * DENSE_INTERVAL, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, dense_value(1000), AUTO_VALUE_QUANTUM);
+     CU_ASSERT(automation_lane_value(&g_test_take.lanes[0], 1000 * DENSE_INTERVAL + DENSE_INTERVAL / 2, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, (dense_value(1000) + dense_value(1001)) / 2.0, 2 * AUTO_VALUE_QUANTUM);
+     CU_ASSERT(automation_lane_value(&g_test_take.lanes[0], (points - 1) * DENSE_INTERVAL, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, dense_value(points - 1), AUTO_VALUE_QUANTUM);
+
+     // Out of order is refused, an empty lane sets nothing
+     CU_ASSERT_FALSE(automation_lane_append(&g_test_take.lanes[0], 0, 1.0));
+     CU_ASSERT_EQUAL(g_test_take.lanes[0].points, points);
+     CU_ASSERT_FALSE(automation_lane_value(&g_test_take.lanes[1], 0, &value));
+ }
+
+ void test_automation_seek_benchmark(void) {
+     const size_t points = fill_dense();
+     struct timespec t0, t1;
+     AutoCursor c;
+     unsigned int seed = 1;
+     double value, sec;
+     int wrong = 0;
+
+     CU_ASSERT_FATAL(points > 0);
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     for (int i = 0; i < SEEKS; i++) {
+         size_t k = (size_t)rand_r(&seed) % points;
+         automation_cursor_seek(&c, &g_test_take.lanes[0], k * DENSE_INTERVAL);
+         if (automation_cursor_next_frame(&c) != k * DENSE_INTERVAL || !automation_cursor_next(&c, &value) ||
+             fabs(value - dense_value(k)) > AUTO_VALUE_QUANTUM) {
+             wrong++;
+         }
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     sec = seconds_between(&t0, &t1);
+     printf("\n    Automation: %d seeks in an hour-long lane, %.2f us each ", SEEKS, 1e6 * sec / SEEKS);
+     CU_ASSERT_EQUAL(wrong, 0);
+
+     // Past the end the last value holds once, then the lane is done
+     automation_cursor_seek(&c, &g_test_take.lanes[0], points * DENSE_INTERVAL + 5);
+     CU_ASSERT(automation_cursor_next(&c, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, dense_value(points - 1), AUTO_VALUE_QUANTUM);
+     CU_ASSERT_EQUAL(automation_cursor_next_frame(&c), AUTO_NEVER);
+     CU_ASSERT_FALSE(automation_cursor_next(&c, &value));
+ }
+
+ void test_automation_ramps_and_steps(void) {
+     AutoCursor c;
+     double value;
+
+     automation_free(&g_test_take);
+     automation_init(&g_test_take, TEST_SAMPLE_RATE);
+
+     // A ramp produces a value every AUTO_CONTROL_FRAMES up to its end
+     CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_AMP1, 100, 0.0));
+     CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_AMP1, 100 + 2 * AUTO_CONTROL_FRAMES, 1.0));
+     automation_cursor_seek(&c, &g_test_take.lanes[SYNTH_PARAM_AMP1], 0);
+     CU_ASSERT_EQUAL(automation_cursor_next_frame(&c), 100); // Nothing before the first point
+     CU_ASSERT(automation_cursor_next(&c, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, 0.0, 1e-9);
+     CU_ASSERT_EQUAL(automation_cursor_next_frame(&c), 100 + AUTO_CONTROL_FRAMES);
+     CU_ASSERT(automation_cursor_next(&c, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, 0.5, 1e-9);
+     CU_ASSERT_EQUAL(automation_cursor_next_frame(&c), 100 + 2 * AUTO_CONTROL_FRAMES);
+     CU_ASSERT(automation_cursor_next(&c, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, 1.0, 1e-9);
+     CU_ASSERT_EQUAL(automation_cursor_next_frame(&c), AUTO_NEVER);
+
+     // An unchanged value is not stored; a change after a pause is a step, not a second-long ramp
+     CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_AMP2, 0, 0.25));
+     CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_AMP2, 1000, 0.25));
+     CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_AMP2, 44100, 0.75));
+     CU_ASSERT_EQUAL(g_test_take.lanes[SYNTH_PARAM_AMP2].points, 3);
+     CU_ASSERT(automation_lane_value(&g_test_take.lanes[SYNTH_PARAM_AMP2], 44099, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, 0.25, 1e-9);
+     CU_ASSERT(automation_lane_value(&g_test_take.lanes[SYNTH_PARAM_AMP2], 44100, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, 0.75, 1e-9);
+     // The flat stretch costs no values
+     automation_cursor_seek(&c, &g_test_take.lanes[SYNTH_PARAM_AMP2], 10);
+     CU_ASSERT(automation_cursor_next(&c, &value));
+     CU_ASSERT_EQUAL(automation_cursor_next_frame(&c), 44100);
+     CU_ASSERT_FALSE(automation_record(&g_test_take, SYNTH_PARAM_AMP2, 5, 0.5));
+ }
+
+ void test_automation_save_append_load(void) {
+     Automation loaded;
+     double value;
+     FILE *f;
+     long size;
+
+     automation_free(&g_test_take);
+     automation_init(&g_test_take, 48000.0);
+     for (int i = 0; i < 1000; i++) CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_FREQ1, (uint64_t)i * 128, 100.0 + i));
+     CU_ASSERT_FATAL(automation_save(&g_test_take, TEST_TAKE_PATH));
+     // A later flush appends only the new points
+     for (int i = 1000; i < 1500; i++) CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_FREQ1, (uint64_t)i * 128, 100.0 + i));
+     CU_ASSERT(automation_record(&g_test_take, SYNTH_PARAM_DECAY2, 7, 0.125));
+     CU_ASSERT_FATAL(automation_append(&g_test_take, TEST_TAKE_PATH));
+     CU_ASSERT(automation_append(&g_test_take, TEST_TAKE_PATH)); // Nothing new: nothing written
+
+     automation_init(&loaded, 0.0);
+     CU_ASSERT_FATAL(automation_load(&loaded, TEST_TAKE_PATH));
+     CU_ASSERT_DOUBLE_EQUAL(loaded.sample_rate, 48000.0, 1e-9);
+     CU_ASSERT_EQUAL(automation_points(&loaded), 1501);
+     CU_ASSERT_EQUAL(automation_bytes(&loaded), automation_bytes(&g_test_take));
+     CU_ASSERT(automation_lane_value(&loaded.lanes[SYNTH_PARAM_FREQ1], 1499 * 128, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, 1599.0, 1e-6);
+     CU_ASSERT(automation_lane_value(&loaded.lanes[SYNTH_PARAM_DECAY2], 7, &value));
+     CU_ASSERT_DOUBLE_EQUAL(value, 0.125, 1e-6);
+     automation_free(&loaded);
+
+     // A file cut off in its last block (a crash mid-flush) keeps the blocks before it
+     f = fopen(TEST_TAKE_PATH, "rb");
+     CU_ASSERT_FATAL(f != NULL);
+     fseek(f, 0, SEEK_END);
+     size = ftell(f);
+     fclose(f);
+     CU_ASSERT_FATAL(truncate(TEST_TAKE_PATH, size - 2) == 0);
+     automation_init(&loaded, 0.0);
+     CU_ASSERT_FATAL(automation_load(&loaded, TEST_TAKE_PATH));
+     CU_ASSERT_EQUAL(loaded.lanes[SYNTH_PARAM_FREQ1].points, 1500);
+     CU_ASSERT_EQUAL(loaded.lanes[SYNTH_PARAM_DECAY2].points, 0);
+     automation_free(&loaded);
+
+     // Anything else is refused
+     f = fopen(TEST_TAKE_PATH, "wb");
+     CU_ASSERT_FATAL(f != NULL);
+     fputs("not automation", f);
+     fclose(f);
+     automation_init(&loaded, 0.0);
+     CU_ASSERT_FALSE(automation_load(&loaded, TEST_TAKE_PATH));
+     CU_ASSERT_EQUAL(automation_points(&loaded), 0);
+ }
+
+ void test_automation_engine_record_and_play(void) {
+     AudioStats st;
+     float diff = 0.0f;
+
+     // Record: a control event at frame 3000, a GUI change before the block at 4096, another event at 6000
+     setup_engine();
+     CU_ASSERT_FATAL(audio_automation_record(TEST_TAKE_PATH));
+     schedule_param(SYNTH_PARAM_AMP1, 0.25, 3000);
+     render(g_test_render[0], 0, 4096);
+     pthread_mutex_lock(&g_test_synth_data.mutex);
+     g_test_synth_data.amplitude2 = 0.3;
+     pthread_mutex_unlock(&g_test_synth_data.mutex);
+     schedule_param(SYNTH_PARAM_AMP1, 0.75, 6000);
+     render(g_test_render[0], 4096, RENDER_FRAMES);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.75, 1e-9);
+     audio_automation_stop();
+     audio_get_stats(&st);
+     CU_ASSERT_EQUAL(st.automationMode, AUDIO_AUTOMATION_OFF);
+     // Every parameter at frame 0, then hold and step for each change
+     CU_ASSERT_EQUAL(st.automationPoints, SYNTH_PARAM_COUNT + 6);
+     CU_ASSERT_EQUAL(st.automationDropped, 0);
+     CU_ASSERT(access(TEST_TAKE_PATH, R_OK) == 0);
+
+     // Play the file back from the starting sound: the same samples, and the GUI follows
+     setup_engine();
+     CU_ASSERT_FATAL(audio_automation_play(TEST_TAKE_PATH));
+     render(g_test_render[1], 0, 3072);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.25, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude2, 0.0, 1e-6);
+     render(g_test_render[1], 3072, RENDER_FRAMES);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.75, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude2, 0.3, 1e-6);
+     for (int i = 0; i < RENDER_FRAMES; i++) {
+         float d = fabsf(g_test_render[0][i] - g_test_render[1][i]);
+         if (d > diff) diff = d;
+     }
+     CU_ASSERT(diff < 1e-5f);
+     audio_get_stats(&st);
+     CU_ASSERT_EQUAL(st.automationMode, AUDIO_AUTOMATION_PLAY);
+
+     // Stopping leaves the parameters where the take put them
+     audio_automation_stop();
+     render(g_test_render[1], 0, BLOCK_FRAMES);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.75, 1e-6);
+     CU_ASSERT_FALSE(audio_automation_save("/nonexistent-dir/take.synthauto"));
+     audio_midi_reset();
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("Automation_Tests", init_automation_suite, clean_automation_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_automation_dense_hour_is_compact", test_automation_dense_hour_is_compact)) ||
+          (NULL == CU_add_test(pSuite, "test_automation_seek_benchmark", test_automation_seek_benchmark)) ||
+          (NULL == CU_add_test(pSuite, "test_automation_ramps_and_steps", test_automation_ramps_and_steps)) ||
+          (NULL == CU_add_test(pSuite, "test_automation_save_append_load", test_automation_save_append_load)) ||
+          (NULL == CU_add_test(pSuite, "test_automation_engine_record_and_play", test_automation_engine_record_and_play))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
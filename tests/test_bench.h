@@ -0,0 +1,20 @@
+/**
+ * @file test_bench.h
+ * @brief Timing helper shared by the test benchmarks.
+ *
+ * Benchmarks print their timings and assert only what they computed: a
+ * throughput or speedup depends on the machine and the build (sanitizers,
+ * -O0), so it is reported rather than checked.
+ */
+
+ #ifndef TEST_BENCH_H
+ #define TEST_BENCH_H
+
+ #include <time.h>
+
+ /** @brief Seconds from `t0` to `t1`, both read with clock_gettime(). */
+ static inline double seconds_between(const struct timespec *t0, const struct timespec *t1) {
+     return (double)(t1->tv_sec - t0->tv_sec) + (double)(t1->tv_nsec - t0->tv_nsec) / 1e9;
+ }
+
+ #endif // TEST_BENCH_H
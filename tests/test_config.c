@@ -0,0 +1,549 @@
+/**
+ * @file test_config.c
+ * @brief Unit tests for the audio configuration parser (config.c) using CUnit.
+ *
+ * Covers defaults, key/value validation, configuration files and the
+ * command-line parser, including removal of consumed arguments from argv.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <unistd.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/config.h"
+
+ // --- Test Globals ---
+ /** @brief Temporary configuration file written by the file tests. */
+ #define TEST_CONFIG_PATH "test_config_tmp.conf"
+ /** @brief Configuration under test, reset before each test. */
+ AudioConfig g_test_config;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_config_suite(void) {
+     return 0;
+ }
+
+ int clean_config_suite(void) {
+     unlink(TEST_CONFIG_PATH);
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /**
+  * @brief Writes `contents` to the temporary configuration file.
+  * @return 1 on success, 0 on failure.
+  */
+ int write_test_config(const char *contents) {
+     FILE *fp = fopen(TEST_CONFIG_PATH, "w");
+     if (!fp) return 0;
+     fputs(contents, fp);
+     fclose(fp);
+     return 1;
+ }
+
+ // --- Test Functions ---
+
+ void test_config_defaults(void) {
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_EQUAL(g_test_config.deviceIndex, -1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.deviceName, "");
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.sampleRate, 44100.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.framesPerBuffer, 0);
+     CU_ASSERT(g_test_config.suggestedLatency < 0.0);
+     CU_ASSERT_EQUAL(g_test_config.listDevices, 0);
+     CU_ASSERT_EQUAL(g_test_config.buildPresetBank, 0);
+     CU_ASSERT_EQUAL(g_test_config.backend, AUDIO_BACKEND_PORTAUDIO);
+     CU_ASSERT_EQUAL(g_test_config.periods, CONFIG_DEFAULT_PERIODS);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.lookaheadMs, 0.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.ioMode, AUDIO_IO_CALLBACK);
+     CU_ASSERT_EQUAL(g_test_config.adaptive, 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.adaptiveMaxMs, CONFIG_DEFAULT_ADAPTIVE_MAX_MS, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.watchdogMs, 0.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.internalRate, 0.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.srcQuality, RESAMPLER_QUALITY_HIGH);
+     CU_ASSERT_EQUAL(g_test_config.inputMode, SIDECHAIN_OFF);
+     CU_ASSERT_EQUAL(g_test_config.sampleFormat, SAMPLE_FORMAT_FLOAT32);
+     CU_ASSERT_EQUAL(g_test_config.dither, DITHER_TPDF);
+     CU_ASSERT_EQUAL(g_test_config.inputDeviceIndex, -1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.inputGain, 1.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.midiInput, 0);
+     CU_ASSERT_EQUAL(g_test_config.midiClock, MIDI_CLOCK_OFF);
+     CU_ASSERT_EQUAL(g_test_config.midiMapped, 0);
+     CU_ASSERT_EQUAL(g_test_config.oscPort, 0);
+     CU_ASSERT_STRING_EQUAL(g_test_config.controlSocket, "");
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.mpeBendRange, 0.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.arpMode, ARP_OFF);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.tempo, ARP_DEFAULT_TEMPO, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.sequencer, 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.seqPrerenderMs, 0.0, 1e-9);
+     CU_ASSERT_STRING_EQUAL(g_test_config.automationRecord, "");
+     CU_ASSERT_STRING_EQUAL(g_test_config.automationPlay, "");
+ }
+
+ void test_config_lookahead_and_io_mode(void) {
+     char *argv[] = { "synthesizer", "--lookahead", "15", "--io=blocking", NULL };
+     int argc = 4;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.lookaheadMs, 15.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.ioMode, AUDIO_IO_BLOCKING);
+     CU_ASSERT_EQUAL(argc, 1);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "lookaheadMs", "-1"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "lookaheadMs", "9000"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "ioMode", "async"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "lookaheadMs", "off"), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.lookaheadMs, 0.0, 1e-9);
+ }
+
+ void test_config_adaptive(void) {
+     char *argv[] = { "synthesizer", "--adaptive", "on", "--adaptive-max=80", NULL };
+     int argc = 4;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(g_test_config.adaptive, 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.adaptiveMaxMs, 80.0, 1e-9);
+     CU_ASSERT_EQUAL(argc, 1);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "adaptive", "maybe"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "adaptiveMaxMs", "0"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "adaptive", "off"), 1);
+     CU_ASSERT_EQUAL(g_test_config.adaptive, 0);
+ }
+
+ void test_config_internal_rate(void) {
+     char *argv[] = { "synthesizer", "--internal-rate", "44100", "--src-quality=medium", NULL };
+     int argc = 4;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.internalRate, 44100.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.srcQuality, RESAMPLER_QUALITY_MEDIUM);
+     CU_ASSERT_EQUAL(argc, 1);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "internalRate", "100"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "srcQuality", "best"), 0);
+     CU_ASSERT_EQUAL(g_test_config.srcQuality, RESAMPLER_QUALITY_MEDIUM);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "internalRate", "off"), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.internalRate, 0.0, 1e-9);
+ }
+
+ void test_config_watchdog(void) {
+     char *argv[] = { "synthesizer", "--watchdog", "250", NULL };
+     int argc = 3;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.watchdogMs, 250.0, 1e-9);
+     CU_ASSERT_EQUAL(argc, 1);
+
+     // Shorter than any sensible block, or longer than a minute, is rejected
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "watchdogMs", "5"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "watchdogMs", "120000"), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.watchdogMs, 250.0, 1e-9);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "watchdogMs", "off"), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.watchdogMs, 0.0, 1e-9);
+ }
+
+ void test_config_midi_input(void) {
+     char *argv[] = { "synthesizer", "--midi=20:0", NULL };
+     int argc = 2;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(g_test_config.midiInput, 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.midiSource, "20:0");
+     CU_ASSERT_EQUAL(argc, 1);
+
+     // "on" only creates the port
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiIn", "on"), 1);
+     CU_ASSERT_EQUAL(g_test_config.midiInput, 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.midiSource, "");
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiIn", ""), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiIn", "off"), 1);
+     CU_ASSERT_EQUAL(g_test_config.midiInput, 0);
+ }
+
+ void test_config_midi_clock(void) {
+     char *argv[] = { "synthesizer", "--midi-clock", "in", NULL };
+     int argc = 3;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(g_test_config.midiClock, MIDI_CLOCK_IN);
+     CU_ASSERT_EQUAL(argc, 1);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiClock", "out"), 1);
+     CU_ASSERT_EQUAL(g_test_config.midiClock, MIDI_CLOCK_OUT);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiClock", "both"), 0);
+     CU_ASSERT_EQUAL(g_test_config.midiClock, MIDI_CLOCK_OUT);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiClock", "off"), 1);
+     CU_ASSERT_EQUAL(g_test_config.midiClock, MIDI_CLOCK_OFF);
+ }
+
+ void test_config_midi_map(void) {
+     char *argv[] = { "synthesizer", "--midi-map", "amp1,74", "--midi-map=freq2, 1, 100, 400, log, 3", NULL };
+     int argc = 4;
+     const MidiMapping *m;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(argc, 1);
+     CU_ASSERT_EQUAL(g_test_config.midiMapped, (1u << SYNTH_PARAM_AMP1) | (1u << SYNTH_PARAM_FREQ2));
+     m = &g_test_config.midiMap.params[SYNTH_PARAM_AMP1];
+     CU_ASSERT_EQUAL(m->cc, 74);
+     CU_ASSERT_EQUAL(m->channel, MIDI_MAP_ANY_CHANNEL);
+     CU_ASSERT_DOUBLE_EQUAL(m->max, 1.0, 1e-9);
+     m = &g_test_config.midiMap.params[SYNTH_PARAM_FREQ2];
+     CU_ASSERT_EQUAL(m->cc, 1);
+     CU_ASSERT_DOUBLE_EQUAL(m->min, 100.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(m->max, 400.0, 1e-9);
+     CU_ASSERT_EQUAL(m->curve, MIDI_CURVE_LOG);
+     CU_ASSERT_EQUAL(m->channel, 2);
+
+     // "off" unmaps a parameter a previous file or option assigned
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "amp1,off"), 1);
+     CU_ASSERT_EQUAL(g_test_config.midiMap.params[SYNTH_PARAM_AMP1].cc, -1);
+     CU_ASSERT(g_test_config.midiMapped & (1u << SYNTH_PARAM_AMP1));
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "volume,7"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "amp1"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "amp1,120"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "amp1,7,0"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "amp1,7,0,1,cubic"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "amp1,7,0,1,exp,17"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "midiMap", "amp1,off,0,1"), 0);
+ }
+
+ void test_config_osc(void) {
+     char *argv[] = { "synthesizer", "--osc", "9000", NULL };
+     int argc = 3;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(g_test_config.oscPort, 9000);
+     CU_ASSERT_EQUAL(argc, 1);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "osc", "off"), 1);
+     CU_ASSERT_EQUAL(g_test_config.oscPort, 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "osc", "0"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "osc", "65536"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "osc", "udp"), 0);
+ }
+
+ void test_config_control_socket(void) {
+     char *argv[] = { "synthesizer", "--control", "/tmp/synth.sock", NULL };
+     int argc = 3;
+     char long_path[CONFIG_SOCKET_PATH_MAX + 8];
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.controlSocket, "/tmp/synth.sock");
+     CU_ASSERT_EQUAL(argc, 1);
+     memset(long_path, 'x', sizeof(long_path) - 1);
+     long_path[sizeof(long_path) - 1] = '\0';
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "control", long_path), 0);
+     CU_ASSERT_STRING_EQUAL(g_test_config.controlSocket, "/tmp/synth.sock");
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "control", "off"), 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.controlSocket, "");
+ }
+
+ void test_config_mpe(void) {
+     char *argv[] = { "synthesizer", "--mpe", "on", NULL };
+     int argc = 3;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.mpeBendRange, MPE_DEFAULT_BEND_RANGE, 1e-9);
+     CU_ASSERT_EQUAL(argc, 1);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "mpe", "24"), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.mpeBendRange, 24.0, 1e-9);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "mpe", "0"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "mpe", "97"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "mpe", "x"), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.mpeBendRange, 24.0, 1e-9);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "mpe", "off"), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.mpeBendRange, 0.0, 1e-9);
+ }
+
+ void test_config_arp(void) {
+     char *argv[] = { "synthesizer", "--arp", "updown", "--arp-rate=1/8t", "--arp-gate", "0.25",
+                      "--arp-octaves", "3", "--tempo", "96", NULL };
+     int argc = 10;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(argc, 1);
+     CU_ASSERT_EQUAL(g_test_config.arpMode, ARP_UP_DOWN);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.arpRate, 3.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.arpGate, 0.25, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.arpOctaves, 3);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.tempo, 96.0, 1e-9);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arpRate", "16"), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.arpRate, 4.0, 1e-9);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arpRate", "1/12"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arpRate", "1/128"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arpRate", "t"), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.arpRate, 4.0, 1e-9);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arp", "sideways"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arpGate", "0"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arpOctaves", "5"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "tempo", "301"), 0);
+     CU_ASSERT_EQUAL(g_test_config.arpMode, ARP_UP_DOWN);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "arp", "off"), 1);
+     CU_ASSERT_EQUAL(g_test_config.arpMode, ARP_OFF);
+ }
+
+ void test_config_sequencer(void) {
+     char *argv[] = { "synthesizer", "--seq", "on", "--seq-prerender=150", NULL };
+     int argc = 4;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(argc, 1);
+     CU_ASSERT_EQUAL(g_test_config.sequencer, 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.seqPrerenderMs, 150.0, 1e-9);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "sequencer", "maybe"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "seqPrerenderMs", "501"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "seqPrerenderMs", "-1"), 0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.seqPrerenderMs, 150.0, 1e-9);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "seqPrerenderMs", "off"), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.seqPrerenderMs, 0.0, 1e-9);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "sequencer", "off"), 1);
+     CU_ASSERT_EQUAL(g_test_config.sequencer, 0);
+ }
+
+ void test_config_automation(void) {
+     char *argv[] = { "synthesizer", "--auto-record", "/tmp/take.synthauto", "--auto-play=/tmp/old.synthauto", NULL };
+     char long_path[CONFIG_AUTOMATION_PATH_MAX + 1];
+     int argc = 4;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(argc, 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.automationRecord, "/tmp/take.synthauto");
+     CU_ASSERT_STRING_EQUAL(g_test_config.automationPlay, "/tmp/old.synthauto");
+
+     memset(long_path, 'a', CONFIG_AUTOMATION_PATH_MAX);
+     long_path[CONFIG_AUTOMATION_PATH_MAX] = '\0';
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "automationPlay", long_path), 0);
+     CU_ASSERT_STRING_EQUAL(g_test_config.automationPlay, "/tmp/old.synthauto");
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "automationPlay", "off"), 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.automationPlay, "");
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "automationRecord", "off"), 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.automationRecord, "");
+ }
+
+ void test_config_sample_format(void) {
+     char *argv[] = { "synthesizer", "--format", "int24", "--dither=shaped", NULL };
+     int argc = 4;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(g_test_config.sampleFormat, SAMPLE_FORMAT_INT24);
+     CU_ASSERT_EQUAL(g_test_config.dither, DITHER_SHAPED);
+     CU_ASSERT_EQUAL(argc, 1);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "sampleFormat", "int8"), 0);
+     CU_ASSERT_EQUAL(g_test_config.sampleFormat, SAMPLE_FORMAT_INT24);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "dither", "rpdf"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "dither", "none"), 1);
+     CU_ASSERT_EQUAL(g_test_config.dither, DITHER_NONE);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "sampleFormat", "int16"), 1);
+     CU_ASSERT_EQUAL(g_test_config.sampleFormat, SAMPLE_FORMAT_INT16);
+ }
+
+ void test_config_input(void) {
+     char *argv[] = { "synthesizer", "--input", "vocoder", "--input-device=2", "--input-gain", "4", NULL };
+     int argc = 6;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(g_test_config.inputMode, SIDECHAIN_VOCODER);
+     CU_ASSERT_EQUAL(g_test_config.inputDeviceIndex, 2);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.inputGain, 4.0, 1e-9);
+     CU_ASSERT_EQUAL(argc, 1);
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "input", "chorus"), 0);
+     CU_ASSERT_EQUAL(g_test_config.inputMode, SIDECHAIN_VOCODER);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "inputGain", "0"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "inputDevice", "mic"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "inputDevice", "default"), 1);
+     CU_ASSERT_EQUAL(g_test_config.inputDeviceIndex, -1);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "input", "ringmod"), 1);
+     CU_ASSERT_EQUAL(g_test_config.inputMode, SIDECHAIN_RINGMOD);
+ }
+
+ void test_config_backend_and_periods(void) {
+     char *argv[] = { "synthesizer", "--backend", "alsa", "--periods=4", NULL };
+     int argc = 4;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_EQUAL(g_test_config.backend, AUDIO_BACKEND_ALSA);
+     CU_ASSERT_EQUAL(g_test_config.periods, 4);
+     CU_ASSERT_EQUAL(argc, 1);
+     CU_ASSERT_STRING_EQUAL(audio_backend_name(g_test_config.backend), "alsa");
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "backend", "oss"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "periods", "1"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "periods", "64"), 0);
+     CU_ASSERT_EQUAL(g_test_config.periods, 4);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "backend", "jack"), 1);
+     CU_ASSERT_STRING_EQUAL(audio_backend_name(g_test_config.backend), "jack");
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "backend", "portaudio"), 1);
+     CU_ASSERT_EQUAL(g_test_config.backend, AUDIO_BACKEND_PORTAUDIO);
+ }
+
+ void test_config_device_index_and_name(void) {
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "device", "3"), 1);
+     CU_ASSERT_EQUAL(g_test_config.deviceIndex, 3);
+     CU_ASSERT_STRING_EQUAL(g_test_config.deviceName, "");
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "device", "USB Audio"), 1);
+     CU_ASSERT_EQUAL(g_test_config.deviceIndex, -1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.deviceName, "USB Audio");
+
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "device", "default"), 1);
+     CU_ASSERT_EQUAL(g_test_config.deviceIndex, -1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.deviceName, "");
+ }
+
+ void test_config_rejects_invalid_values(void) {
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "sampleRate", "abc"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "sampleRate", "100"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "framesPerBuffer", "-32"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "latencyMs", "0"), 0);
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "bogus", "1"), 0);
+     // Nothing changed
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.sampleRate, 44100.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.framesPerBuffer, 0);
+ }
+
+ void test_config_load_file(void) {
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_FATAL(write_test_config("# low latency box\n"
+                                       "device: hw:1\n"
+                                       "sampleRate: 48000\n"
+                                       "\n"
+                                       "framesPerBuffer : 32\n"
+                                       "latencyMs: 2.5\n"));
+     CU_ASSERT_EQUAL(audio_config_load_file(&g_test_config, TEST_CONFIG_PATH), 1);
+     CU_ASSERT_STRING_EQUAL(g_test_config.deviceName, "hw:1");
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.sampleRate, 48000.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.framesPerBuffer, 32);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.suggestedLatency, 0.0025, 1e-9);
+ }
+
+ void test_config_load_file_invalid(void) {
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_FATAL(write_test_config("sampleRate: fast\n"));
+     CU_ASSERT_EQUAL(audio_config_load_file(&g_test_config, TEST_CONFIG_PATH), 0);
+     CU_ASSERT_EQUAL(audio_config_load_file(&g_test_config, "does_not_exist.conf"), 0);
+ }
+
+ void test_config_load_file_skips_unknown_keys(void) {
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_FATAL(write_test_config("sampleRate: 48000\n"
+                                       "reverbMix: 0.3\n"
+                                       "framesPerBuffer: 64\n"));
+     CU_ASSERT_EQUAL(audio_config_load_file(&g_test_config, TEST_CONFIG_PATH), 1);
+     // The lines around the unknown key are applied
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.sampleRate, 48000.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.framesPerBuffer, 64);
+     // On the command line an unknown key is still an error
+     CU_ASSERT_EQUAL(audio_config_set_value(&g_test_config, "reverbMix", "0.3"), 0);
+ }
+
+ void test_config_parse_args_consumes_audio_options(void) {
+     char *argv[] = { "synthesizer", "--sample-rate", "96000", "--gapplication-service",
+                      "--frames=4096", "--device", "2", "--latency", "40", "--list-devices", "--build-preset-bank", NULL };
+     int argc = 11;
+     audio_config_set_defaults(&g_test_config);
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.sampleRate, 96000.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.framesPerBuffer, 4096);
+     CU_ASSERT_EQUAL(g_test_config.deviceIndex, 2);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.suggestedLatency, 0.040, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.listDevices, 1);
+     CU_ASSERT_EQUAL(g_test_config.buildPresetBank, 1);
+     // Only the program name and the GTK option remain
+     CU_ASSERT_EQUAL(argc, 2);
+     CU_ASSERT_STRING_EQUAL(argv[0], "synthesizer");
+     CU_ASSERT_STRING_EQUAL(argv[1], "--gapplication-service");
+     CU_ASSERT_PTR_NULL(argv[2]);
+ }
+
+ void test_config_parse_args_config_file_then_override(void) {
+     char *argv[] = { "synthesizer", "--config", TEST_CONFIG_PATH, "--frames", "64", NULL };
+     int argc = 5;
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_FATAL(write_test_config("sampleRate: 48000\nframesPerBuffer: 32\n"));
+
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_config.sampleRate, 48000.0, 1e-9);
+     CU_ASSERT_EQUAL(g_test_config.framesPerBuffer, 64); // Later option wins
+     CU_ASSERT_EQUAL(argc, 1);
+ }
+
+ void test_config_parse_args_missing_value(void) {
+     char *argv[] = { "synthesizer", "--sample-rate", NULL };
+     int argc = 2;
+     audio_config_set_defaults(&g_test_config);
+     CU_ASSERT_EQUAL(audio_config_parse_args(&g_test_config, &argc, argv), 0);
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("Config_Tests", init_config_suite, clean_config_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_config_defaults", test_config_defaults)) ||
+          (NULL == CU_add_test(pSuite, "test_config_device_index_and_name", test_config_device_index_and_name)) ||
+          (NULL == CU_add_test(pSuite, "test_config_rejects_invalid_values", test_config_rejects_invalid_values)) ||
+          (NULL == CU_add_test(pSuite, "test_config_load_file", test_config_load_file)) ||
+          (NULL == CU_add_test(pSuite, "test_config_load_file_invalid", test_config_load_file_invalid)) ||
+          (NULL == CU_add_test(pSuite, "test_config_load_file_skips_unknown_keys", test_config_load_file_skips_unknown_keys)) ||
+          (NULL == CU_add_test(pSuite, "test_config_parse_args_consumes_audio_options", test_config_parse_args_consumes_audio_options)) ||
+          (NULL == CU_add_test(pSuite, "test_config_parse_args_config_file_then_override", test_config_parse_args_config_file_then_override)) ||
+          (NULL == CU_add_test(pSuite, "test_config_parse_args_missing_value", test_config_parse_args_missing_value)) ||
+          (NULL == CU_add_test(pSuite, "test_config_backend_and_periods", test_config_backend_and_periods)) ||
+          (NULL == CU_add_test(pSuite, "test_config_lookahead_and_io_mode", test_config_lookahead_and_io_mode)) ||
+          (NULL == CU_add_test(pSuite, "test_config_adaptive", test_config_adaptive)) ||
+          (NULL == CU_add_test(pSuite, "test_config_internal_rate", test_config_internal_rate)) ||
+          (NULL == CU_add_test(pSuite, "test_config_input", test_config_input)) ||
+          (NULL == CU_add_test(pSuite, "test_config_sample_format", test_config_sample_format)) ||
+          (NULL == CU_add_test(pSuite, "test_config_watchdog", test_config_watchdog)) ||
+          (NULL == CU_add_test(pSuite, "test_config_midi_input", test_config_midi_input)) ||
+          (NULL == CU_add_test(pSuite, "test_config_midi_clock", test_config_midi_clock)) ||
+          (NULL == CU_add_test(pSuite, "test_config_midi_map", test_config_midi_map)) ||
+          (NULL == CU_add_test(pSuite, "test_config_osc", test_config_osc)) ||
+          (NULL == CU_add_test(pSuite, "test_config_control_socket", test_config_control_socket)) ||
+          (NULL == CU_add_test(pSuite, "test_config_mpe", test_config_mpe)) ||
+          (NULL == CU_add_test(pSuite, "test_config_arp", test_config_arp)) ||
+          (NULL == CU_add_test(pSuite, "test_config_sequencer", test_config_sequencer)) ||
+          (NULL == CU_add_test(pSuite, "test_config_automation", test_config_automation))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,345 @@
+/**
+ * @file test_control.c
+ * @brief Unit tests for the control socket protocol (control.c), its server (control_server.c)
+ * and the preset file reader (preset_file.c) using CUnit.
+ *
+ * Covers request parsing and its errors, the translation of frames into
+ * engine events, batches taking effect at one sample, lock-free parameter
+ * reads, and a session over a real socket with the round-trip time printed.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <time.h>
+ #include <pthread.h>
+ #include <unistd.h>
+ #include <stdatomic.h>
+ #include <sys/socket.h>
+ #include <sys/stat.h>
+ #include <sys/un.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/control.h"
+ #include "../synth/control_server.h"
+ #include "../synth/preset_file.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_internal.h"
+ #include "test_bench.h"
+ #include "test_engine.h"
+ #include "test_presets.h"
+
+ // --- Test Globals ---
+ #define TEST_SAMPLE_RATE 44100.0
+ #define TEST_BLOCK 256
+ #define BENCH_REQUESTS 2000
+
+ static char g_preset_path[64];
+ static char g_socket_path[64];
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_control_suite(void) {
+     PresetData preset = {
+         .frequency1 = 220.0, .amplitude1 = 0.4, .waveform1 = WAVE_SAWTOOTH,
+         .attackTime1 = 0.0, .decayTime1 = 0.0, .sustainLevel1 = 1.0, .releaseTime1 = 0.0,
+         .frequency2 = 330.0, .amplitude2 = 0.1, .waveform2 = WAVE_TRIANGLE,
+         .attackTime2 = 0.0, .decayTime2 = 0.0, .sustainLevel2 = 1.0, .releaseTime2 = 0.0
+     };
+
+     snprintf(g_preset_path, sizeof(g_preset_path), "/tmp/test_control_%d.synthpreset", (int)getpid());
+     snprintf(g_socket_path, sizeof(g_socket_path), "/tmp/test_control_%d.sock", (int)getpid());
+     return write_text_preset(g_preset_path, &preset, NULL) ? 0 : -1;
+ }
+
+ int clean_control_suite(void) {
+     unlink(g_preset_path);
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ static void setup_synth_data(void) {
+     test_engine_init_data(WAVE_SQUARE, TEST_SAMPLE_RATE);
+     g_test_synth_data.frequency = 441.0;
+     g_test_synth_data.frequency2 = 660.0;
+ }
+
+ /** @brief Parses a copy of `text`, returning the parser's result; the error lands in `error`. */
+ static int parse(const char *text, ControlFrame *frame, char *line, char *error) {
+     snprintf(line, CONTROL_MAX_LINE, "%s", text);
+     error[0] = '\0';
+     return control_parse_frame(line, frame, error, 128);
+ }
+
+ /** @brief Sends a request line and reads the answer line. */
+ static int request(int sock, const char *text, char *reply, size_t size) {
+     size_t len = 0;
+
+     if (send(sock, text, strlen(text), MSG_NOSIGNAL) != (ssize_t)strlen(text) || send(sock, "\n", 1, MSG_NOSIGNAL) != 1) return 0;
+     while (len + 1 < size) {
+         ssize_t n = recv(sock, reply + len, 1, 0);
+         if (n <= 0) return 0;
+         if (reply[len] == '\n') break;
+         len++;
+     }
+     reply[len] = '\0';
+     return 1;
+ }
+
+ /** @brief Set to stop render_thread_main(). */
+ static atomic_int g_render_stop;
+
+ /** @brief Stands in for the audio device, rendering a block every millisecond. */
+ static void *render_thread_main(void *arg) {
+     static float out[TEST_BLOCK];
+     (void)arg;
+     while (!atomic_load(&g_render_stop)) {
+         render_audio(&g_test_synth_data, out, TEST_BLOCK);
+         usleep(1000);
+     }
+     return NULL;
+ }
+
+
+ // --- Test Functions ---
+
+ void test_control_parse_frame(void) {
+     ControlFrame frame;
+     char line[CONTROL_MAX_LINE], error[128];
+
+     CU_ASSERT_TRUE(parse("set freq1 220; set wave2 saw;on 60 90 ;off 60; get release2; preset pad; stats", &frame, line, error));
+     CU_ASSERT_EQUAL_FATAL(frame.count, 7);
+     CU_ASSERT_EQUAL(frame.commands[0].type, CONTROL_CMD_SET);
+     CU_ASSERT_EQUAL(frame.commands[0].target, SYNTH_PARAM_FREQ1);
+     CU_ASSERT_DOUBLE_EQUAL(frame.commands[0].value, 220.0, 1e-12);
+     CU_ASSERT_EQUAL(frame.commands[1].target, CONTROL_TARGET_WAVE2);
+     CU_ASSERT_DOUBLE_EQUAL(frame.commands[1].value, WAVE_SAWTOOTH, 1e-12);
+     CU_ASSERT_EQUAL(frame.commands[2].type, CONTROL_CMD_NOTE_ON);
+     CU_ASSERT_EQUAL(frame.commands[2].target, 60);
+     CU_ASSERT_DOUBLE_EQUAL(frame.commands[2].value, 90.0, 1e-12);
+     CU_ASSERT_EQUAL(frame.commands[3].type, CONTROL_CMD_NOTE_OFF);
+     CU_ASSERT_EQUAL(frame.commands[4].type, CONTROL_CMD_GET);
+     CU_ASSERT_EQUAL(frame.commands[4].target, SYNTH_PARAM_RELEASE2);
+     CU_ASSERT_EQUAL(frame.commands[5].type, CONTROL_CMD_PRESET);
+     CU_ASSERT_STRING_EQUAL(frame.commands[5].name, "pad");
+     CU_ASSERT_EQUAL(frame.commands[6].type, CONTROL_CMD_STATS);
+     // Default velocity, waveform numbers
+     CU_ASSERT_TRUE(parse("ON 64; set wave1 3", &frame, line, error));
+     CU_ASSERT_DOUBLE_EQUAL(frame.commands[0].value, CONTROL_DEFAULT_VELOCITY, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(frame.commands[1].value, WAVE_TRIANGLE, 1e-12);
+     CU_ASSERT_STRING_EQUAL(control_target_name(CONTROL_TARGET_WAVE1), "wave1");
+     CU_ASSERT_STRING_EQUAL(control_target_name(SYNTH_PARAM_AMP2), "amp2");
+     CU_ASSERT_STRING_EQUAL(control_waveform_name(WAVE_SAWTOOTH), "saw");
+ }
+
+ void test_control_parse_errors(void) {
+     ControlFrame frame;
+     char line[CONTROL_MAX_LINE], error[128];
+
+     CU_ASSERT_FALSE(parse("set amp1 0.5; set amp1 1.5", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "2 value out of range");
+     CU_ASSERT_FALSE(parse("set volume 1", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "1 unknown parameter");
+     CU_ASSERT_FALSE(parse("set freq1 loud", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "1 value is not a number");
+     CU_ASSERT_FALSE(parse("set wave1 noise", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "1 unknown waveform");
+     CU_ASSERT_FALSE(parse("on 128", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "1 note must be 0-127");
+     CU_ASSERT_FALSE(parse("on 60 0", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "1 velocity must be 1-127");
+     CU_ASSERT_FALSE(parse("on 60.5", &frame, line, error));
+     CU_ASSERT_FALSE(parse("get amp1 amp2", &frame, line, error));
+     CU_ASSERT_FALSE(parse("stats; ; stats", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "2 empty command");
+     CU_ASSERT_FALSE(parse("dance", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "1 unknown command");
+     CU_ASSERT_FALSE(parse("", &frame, line, error));
+     CU_ASSERT_FALSE(parse("preset a; preset b; preset c", &frame, line, error));
+     CU_ASSERT_STRING_EQUAL(error, "3 too many presets");
+ }
+
+ void test_control_frame_to_events(void) {
+     ControlFrame frame;
+     PresetData preset;
+     MidiEvent events[AUDIO_CONTROL_BATCH_MAX];
+     char line[CONTROL_MAX_LINE], error[128];
+
+     CU_ASSERT_FATAL(preset_file_read(g_preset_path, &preset));
+     CU_ASSERT_FATAL(parse("get amp1; set amp1 0.3; preset x; on 60; stats", &frame, line, error));
+     CU_ASSERT_EQUAL_FATAL(control_frame_to_events(&frame, &preset, events, AUDIO_CONTROL_BATCH_MAX), 1 + 14 + 1);
+     CU_ASSERT_EQUAL(events[0].type, MIDI_EVENT_PARAM);
+     CU_ASSERT_EQUAL(events[0].data1, SYNTH_PARAM_AMP1);
+     CU_ASSERT_DOUBLE_EQUAL(events[0].value, 0.3, 1e-12);
+     // The preset: both waveforms, then the parameters in SynthParam order
+     CU_ASSERT_EQUAL(events[1].type, MIDI_EVENT_WAVEFORM);
+     CU_ASSERT_EQUAL(events[1].data1, 0);
+     CU_ASSERT_EQUAL(events[1].data2, WAVE_SAWTOOTH);
+     CU_ASSERT_EQUAL(events[2].data2, WAVE_TRIANGLE);
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) CU_ASSERT_EQUAL(events[3 + i].data1, i);
+     CU_ASSERT_DOUBLE_EQUAL(events[3 + SYNTH_PARAM_AMP2].value, 0.1, 1e-12);
+     CU_ASSERT_EQUAL(events[15].type, MIDI_EVENT_NOTE_ON);
+     CU_ASSERT_EQUAL(events[15].data2, CONTROL_DEFAULT_VELOCITY);
+     // Too many changes for the room given
+     CU_ASSERT_EQUAL(control_frame_to_events(&frame, &preset, events, 10), -1);
+ }
+
+ void test_preset_file_read(void) {
+     PresetData preset;
+     char path[80];
+     FILE *fp;
+
+     CU_ASSERT_FATAL(preset_file_read(g_preset_path, &preset));
+     CU_ASSERT_DOUBLE_EQUAL(preset.frequency1, 220.0, 1e-12);
+     CU_ASSERT_EQUAL(preset.waveform1, WAVE_SAWTOOTH);
+     CU_ASSERT_DOUBLE_EQUAL(preset.amplitude2, 0.1, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(preset.frequency2, 330.0, 1e-12);
+     // Missing fields and missing files fail
+     snprintf(path, sizeof(path), "%s.partial", g_preset_path);
+     fp = fopen(path, "w");
+     CU_ASSERT_FATAL(fp != NULL);
+     fprintf(fp, "frequency1: 100\n");
+     fclose(fp);
+     CU_ASSERT_FALSE(preset_file_read(path, &preset));
+     unlink(path);
+     CU_ASSERT_FALSE(preset_file_read(path, &preset));
+ }
+
+ void test_control_batch_applies_in_one_block(void) {
+     float out[4 * TEST_BLOCK];
+     MidiEvent batch[3] = {
+         { .type = MIDI_EVENT_PARAM, .data1 = SYNTH_PARAM_AMP1, .value = 0.25 },
+         { .type = MIDI_EVENT_WAVEFORM, .data1 = 0, .data2 = WAVE_SQUARE },
+         { .type = MIDI_EVENT_NOTE_ON, .data1 = 69, .data2 = 127 }
+     };
+     double values[SYNTH_PARAM_COUNT];
+     WaveformType waves[2];
+     AudioStats before, after;
+     int onset = -1;
+
+     setup_synth_data();
+     g_test_synth_data.waveform = WAVE_SINE;
+     audio_midi_reset();
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, out, TEST_BLOCK), 0);
+     audio_get_stats(&before);
+     CU_ASSERT_FATAL(audio_control_batch(batch, 3, audio_time_now()));
+     for (int b = 0; b < 3; b++) CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, out + b * TEST_BLOCK, TEST_BLOCK), 0);
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.midiEvents - before.midiEvents, 3);
+     for (int i = 0; i < 3 * TEST_BLOCK && onset < 0; i++) if (out[i] != 0.0f) onset = i;
+     CU_ASSERT_FATAL(onset >= 0);
+     // The first sample already plays the new amplitude and the new waveform
+     CU_ASSERT_DOUBLE_EQUAL(fabsf(out[onset]), 0.25, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(fabsf(out[onset + 10]), 0.25, 1e-6);
+     CU_ASSERT_EQUAL(g_test_synth_data.waveform, WAVE_SQUARE);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.25, 1e-12);
+     // Parameter reads come from the render thread's copy
+     CU_ASSERT_TRUE(audio_get_params(&g_test_synth_data, values, waves));
+     CU_ASSERT_DOUBLE_EQUAL(values[SYNTH_PARAM_AMP1], 0.25, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(values[SYNTH_PARAM_FREQ2], 660.0, 1e-12);
+     CU_ASSERT_EQUAL(waves[0], WAVE_SQUARE);
+     // Too large a batch is refused whole
+     CU_ASSERT_FALSE(audio_control_batch(batch, AUDIO_CONTROL_BATCH_MAX + 1, audio_time_now()));
+     audio_midi_reset();
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+ void test_control_server_session(void) {
+     struct sockaddr_un addr;
+     struct stat st;
+     pthread_t renderer;
+     ControlServerStats stats;
+     char reply[CONTROL_MAX_LINE], text[160];
+     struct timespec t0, t1;
+     int sock;
+
+     setup_synth_data();
+     audio_midi_reset();
+     CU_ASSERT_FATAL(control_server_start(g_socket_path, &g_test_synth_data));
+     CU_ASSERT_FATAL(stat(g_socket_path, &st) == 0);
+     CU_ASSERT_EQUAL(st.st_mode & 0777, 0600);
+     atomic_store(&g_render_stop, 0);
+     CU_ASSERT_FATAL(pthread_create(&renderer, NULL, render_thread_main, NULL) == 0);
+
+     sock = socket(AF_UNIX, SOCK_STREAM, 0);
+     CU_ASSERT_FATAL(sock >= 0);
+     memset(&addr, 0, sizeof(addr));
+     addr.sun_family = AF_UNIX;
+     snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", g_socket_path);
+     CU_ASSERT_FATAL(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+     CU_ASSERT_FATAL(request(sock, "set amp1 0.25; set wave1 saw; on 69", reply, sizeof(reply)));
+     CU_ASSERT_STRING_EQUAL(reply, "OK");
+     usleep(20000);
+     CU_ASSERT_FATAL(request(sock, "get amp1; get wave1; get freq2", reply, sizeof(reply)));
+     CU_ASSERT_STRING_EQUAL(reply, "OK 0.25 saw 660");
+     // An invalid frame changes nothing
+     CU_ASSERT_FATAL(request(sock, "set amp1 0.5; set amp2 7", reply, sizeof(reply)));
+     CU_ASSERT_STRING_EQUAL(reply, "ERR 2 value out of range");
+     CU_ASSERT_FATAL(request(sock, "preset /nonexistent/x", reply, sizeof(reply)));
+     CU_ASSERT_STRING_EQUAL(reply, "ERR 1 cannot read preset");
+     usleep(20000);
+     CU_ASSERT_FATAL(request(sock, "get amp1", reply, sizeof(reply)));
+     CU_ASSERT_STRING_EQUAL(reply, "OK 0.25");
+     // A preset with a change on top, applied together
+     snprintf(text, sizeof(text), "preset %s; set freq2 440", g_preset_path);
+     CU_ASSERT_FATAL(request(sock, text, reply, sizeof(reply)));
+     CU_ASSERT_STRING_EQUAL(reply, "OK");
+     usleep(20000);
+     CU_ASSERT_FATAL(request(sock, "get freq1; get freq2; get wave2", reply, sizeof(reply)));
+     CU_ASSERT_STRING_EQUAL(reply, "OK 220 440 triangle");
+     CU_ASSERT_FATAL(request(sock, "stats", reply, sizeof(reply)));
+     CU_ASSERT_EQUAL(strncmp(reply, "OK backend=", 11), 0);
+
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     for (int i = 0; i < BENCH_REQUESTS; i++) {
+         if (!request(sock, "set release1 0.5; get amp1", reply, sizeof(reply))) break;
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     CU_ASSERT_STRING_EQUAL(reply, "OK 0.4");
+     printf("\n  control socket round trip: %.1f us/request", seconds_between(&t0, &t1) / BENCH_REQUESTS * 1e6);
+
+     close(sock);
+     control_server_get_stats(&stats);
+     CU_ASSERT_EQUAL(stats.clients, 1);
+     CU_ASSERT_EQUAL(stats.errors, 2);
+     CU_ASSERT_EQUAL(stats.frames, 6 + BENCH_REQUESTS);
+     control_server_stop();
+     CU_ASSERT_NOT_EQUAL(access(g_socket_path, F_OK), 0);
+     atomic_store(&g_render_stop, 1);
+     pthread_join(renderer, NULL);
+     audio_midi_reset();
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("Control_Tests", init_control_suite, clean_control_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_control_parse_frame", test_control_parse_frame)) ||
+          (NULL == CU_add_test(pSuite, "test_control_parse_errors", test_control_parse_errors)) ||
+          (NULL == CU_add_test(pSuite, "test_control_frame_to_events", test_control_frame_to_events)) ||
+          (NULL == CU_add_test(pSuite, "test_preset_file_read", test_preset_file_read)) ||
+          (NULL == CU_add_test(pSuite, "test_control_batch_applies_in_one_block", test_control_batch_applies_in_one_block)) ||
+          (NULL == CU_add_test(pSuite, "test_control_server_session", test_control_server_session))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,47 @@
+/**
+ * @file test_engine.h
+ * @brief Engine fixture shared by the tests that render through render_audio().
+ *
+ * Each test runner includes it once and sets up g_test_synth_data with
+ * test_engine_init_data() before configuring the engine for its feature.
+ */
+
+ #ifndef TEST_ENGINE_H
+ #define TEST_ENGINE_H
+
+ #include <pthread.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/synth_data.h"
+ #include "../synth/audio_internal.h"
+
+ /** @brief Shared data rendered by the engine tests. */
+ static SharedSynthData g_test_synth_data;
+
+ /**
+  * @brief Sets up wave 1 at 440 Hz and half amplitude, full sustain without attack or release, and wave 2 silent.
+  *
+  * Both envelopes start idle, so the engine is silent until a note plays.
+  */
+ static inline void test_engine_init_data(WaveformType waveform, double sampleRate) {
+     g_test_synth_data = (SharedSynthData){
+         .frequency = 440.0, .amplitude = 0.5, .waveform = waveform,
+         .attackTime = 0.0, .decayTime = 0.0, .sustainLevel = 1.0, .releaseTime = 0.0,
+         .currentStage = ENV_IDLE,
+         .frequency2 = 440.0, .amplitude2 = 0.0, .waveform2 = WAVE_SINE,
+         .attackTime2 = 0.0, .decayTime2 = 0.0, .sustainLevel2 = 1.0, .releaseTime2 = 0.0,
+         .currentStage2 = ENV_IDLE,
+         .sampleRate = sampleRate
+     };
+     pthread_mutex_init(&g_test_synth_data.mutex, NULL);
+ }
+
+ /** @brief Renders `frames` of g_test_synth_data into `out` in blocks of `block` frames. */
+ static inline void render_blocks(float *out, unsigned long frames, unsigned long block) {
+     for (unsigned long done = 0; done < frames; done += block) {
+         unsigned long n = (frames - done < block) ? frames - done : block;
+         CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, out + done, n), 0);
+     }
+ }
+
+ #endif // TEST_ENGINE_H
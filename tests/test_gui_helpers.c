@@ -4,7 +4,7 @@
  *
  * Focuses on testing the calculate_current_envelope() and calculate_current_envelope_wave2()
  * functions, which determine the envelope amplitude based on the current ADSR state for
- * each respective wave.
+ * each respective wave, and the computer keyboard note mapping gui_key_to_note().
  */
 
  #include <stdio.h>
@@ -398,6 +398,32 @@
  }
  
  
+ // --- Computer Keyboard Mapping Tests ---
+
+ void test_key_to_note_rows(void) {
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_z, GUI_KEY_BASE_NOTE), 48);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_s, GUI_KEY_BASE_NOTE), 49);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_m, GUI_KEY_BASE_NOTE), 59);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_slash, GUI_KEY_BASE_NOTE), 64);
+     // The upper row starts where the lower row's comma is
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_q, GUI_KEY_BASE_NOTE), 60);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_comma, GUI_KEY_BASE_NOTE), 60);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_2, GUI_KEY_BASE_NOTE), 61);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_p, GUI_KEY_BASE_NOTE), 76);
+     // Shift does not change the note
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_Q, GUI_KEY_BASE_NOTE), 60);
+ }
+
+ void test_key_to_note_unmapped_and_range(void) {
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_a, GUI_KEY_BASE_NOTE), -1);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_1, GUI_KEY_BASE_NOTE), -1);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_minus, GUI_KEY_BASE_NOTE), -1);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_z, 0), 0);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_p, 96), 124);
+     CU_ASSERT_EQUAL(gui_key_to_note(GDK_KEY_p, 100), -1);
+ }
+
+
  // --- Main Test Runner Function ---
  
  /**
@@ -447,7 +473,9 @@
          (NULL == CU_add_test(pSuite, "test_w2_calc_env_decay_past_end", test_w2_calc_env_decay_past_end)) ||
          (NULL == CU_add_test(pSuite, "test_w2_calc_env_decay_zero_time", test_w2_calc_env_decay_zero_time)) ||
          (NULL == CU_add_test(pSuite, "test_w2_calc_env_sustain", test_w2_calc_env_sustain)) ||
-         (NULL == CU_add_test(pSuite, "test_w2_calc_env_release", test_w2_calc_env_release))
+         (NULL == CU_add_test(pSuite, "test_w2_calc_env_release", test_w2_calc_env_release)) ||
+         (NULL == CU_add_test(pSuite, "test_key_to_note_rows", test_key_to_note_rows)) ||
+         (NULL == CU_add_test(pSuite, "test_key_to_note_unmapped_and_range", test_key_to_note_unmapped_and_range))
         )
      {
          CU_cleanup_registry();
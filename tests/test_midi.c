@@ -0,0 +1,159 @@
+/**
+ * @file test_midi.c
+ * @brief Unit tests for the MIDI event queue and clock (midi.c) using CUnit.
+ *
+ * Covers queue order, the full-queue drop, a threaded producer/consumer run,
+ * the frame stamps the clock derives from arrival times and the note table.
+ */
+
+ #include <stdio.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/midi.h"
+
+ // --- Test Globals ---
+ /** @brief Events pushed through the queue by the threaded test. */
+ #define STRESS_EVENTS 1000000
+ /** @brief Queue under test. */
+ MidiQueue g_test_queue;
+ /** @brief Clock under test. */
+ MidiClock g_test_clock;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_midi_suite(void) {
+     return 0;
+ }
+
+ int clean_midi_suite(void) {
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ static MidiEvent make_event(uint64_t frame, uint8_t note) {
+     MidiEvent ev = { .frame = frame, .type = MIDI_EVENT_NOTE_ON, .channel = 0, .data1 = note, .data2 = 100 };
+     return ev;
+ }
+
+ // --- Test Functions ---
+
+ void test_midi_queue_order_and_full(void) {
+     MidiEvent ev;
+     int pushed = 0;
+     midi_queue_init(&g_test_queue);
+     CU_ASSERT_PTR_NULL(midi_queue_peek(&g_test_queue));
+
+     // Fills up to the capacity, then drops
+     for (int i = 0; i < MIDI_QUEUE_CAPACITY + 10; i++) {
+         ev = make_event((uint64_t)i, (uint8_t)(i & 0x7f));
+         pushed += midi_queue_push(&g_test_queue, &ev);
+     }
+     CU_ASSERT_EQUAL(pushed, MIDI_QUEUE_CAPACITY);
+
+     // Looking ahead removes nothing
+     CU_ASSERT_PTR_EQUAL(midi_queue_peek_at(&g_test_queue, 0), midi_queue_peek(&g_test_queue));
+     CU_ASSERT_EQUAL(midi_queue_peek_at(&g_test_queue, MIDI_QUEUE_CAPACITY - 1)->frame, MIDI_QUEUE_CAPACITY - 1);
+     CU_ASSERT_PTR_NULL(midi_queue_peek_at(&g_test_queue, MIDI_QUEUE_CAPACITY));
+
+     for (int i = 0; i < MIDI_QUEUE_CAPACITY; i++) {
+         const MidiEvent *head = midi_queue_peek(&g_test_queue);
+         CU_ASSERT_PTR_NOT_NULL_FATAL(head);
+         if (head->frame != (uint64_t)i) { CU_FAIL("event out of order"); break; }
+         midi_queue_pop(&g_test_queue);
+     }
+     CU_ASSERT_PTR_NULL(midi_queue_peek(&g_test_queue));
+
+     // Space is usable again after the wrap
+     ev = make_event(42, 60);
+     CU_ASSERT_EQUAL(midi_queue_push(&g_test_queue, &ev), 1);
+     CU_ASSERT_EQUAL(midi_queue_peek(&g_test_queue)->frame, 42);
+ }
+
+ /**
+  * @brief Producer thread: pushes frames 0..STRESS_EVENTS-1, retrying while the queue is full.
+  */
+ void *midi_producer(void *arg) {
+     MidiQueue *q = (MidiQueue *)arg;
+     for (uint64_t i = 0; i < STRESS_EVENTS; i++) {
+         MidiEvent ev = make_event(i, (uint8_t)(i & 0x7f));
+         while (!midi_queue_push(q, &ev)) sched_yield();
+     }
+     return NULL;
+ }
+
+ void test_midi_queue_threaded_spsc(void) {
+     pthread_t producer;
+     uint64_t expected = 0;
+     int errors = 0;
+     midi_queue_init(&g_test_queue);
+     CU_ASSERT_FATAL(pthread_create(&producer, NULL, midi_producer, &g_test_queue) == 0);
+
+     while (expected < STRESS_EVENTS) {
+         const MidiEvent *ev = midi_queue_peek(&g_test_queue);
+         if (ev == NULL) { sched_yield(); continue; }
+         if (ev->frame != expected || ev->data1 != (expected & 0x7f)) errors++;
+         midi_queue_pop(&g_test_queue);
+         expected++;
+     }
+     pthread_join(producer, NULL);
+
+     CU_ASSERT_EQUAL(errors, 0);
+     CU_ASSERT_PTR_NULL(midi_queue_peek(&g_test_queue));
+ }
+
+ void test_midi_clock_stamp(void) {
+     midi_clock_init(&g_test_clock);
+     // Nothing rendered yet: play as soon as possible, and nothing to send by
+     CU_ASSERT_EQUAL(midi_clock_stamp(&g_test_clock, 5.0), 0);
+     CU_ASSERT(midi_clock_time(&g_test_clock, 100) < 0.0);
+
+     // Block of 256 frames at 48 kHz started at t=10 s, engine frame 1000
+     midi_clock_publish(&g_test_clock, 1000, 10.0, 256, 48000.0);
+     CU_ASSERT_EQUAL(midi_clock_stamp(&g_test_clock, 10.0), 1256);
+     // 1 ms later is 48 frames later: the spacing between events is kept
+     CU_ASSERT_EQUAL(midi_clock_stamp(&g_test_clock, 10.001), 1304);
+     CU_ASSERT_EQUAL(midi_clock_stamp(&g_test_clock, 10.004), 1448);
+     // An arrival that raced the block start still goes into the next block
+     CU_ASSERT_EQUAL(midi_clock_stamp(&g_test_clock, 9.999), 1256);
+     // Sent events are delayed by a block the same way, keeping their spacing
+     CU_ASSERT_DOUBLE_EQUAL(midi_clock_time(&g_test_clock, 1000), 10.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(midi_clock_time(&g_test_clock, 1048), 10.001, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(midi_clock_time(&g_test_clock, 1256), 10.0053333, 1e-6);
+
+     midi_clock_publish(&g_test_clock, 1256, 10.00533, 256, 48000.0);
+     CU_ASSERT_EQUAL(midi_clock_stamp(&g_test_clock, 10.00533), 1512);
+ }
+
+ void test_midi_note_to_freq(void) {
+     CU_ASSERT_DOUBLE_EQUAL(midi_note_to_freq(69), 440.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(midi_note_to_freq(81), 880.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(midi_note_to_freq(60), 261.6256, 1e-3);
+     CU_ASSERT_DOUBLE_EQUAL(midi_note_to_freq(0), 8.1758, 1e-3);
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("MIDI_Queue_Tests", init_midi_suite, clean_midi_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_midi_queue_order_and_full", test_midi_queue_order_and_full)) ||
+          (NULL == CU_add_test(pSuite, "test_midi_queue_threaded_spsc", test_midi_queue_threaded_spsc)) ||
+          (NULL == CU_add_test(pSuite, "test_midi_clock_stamp", test_midi_clock_stamp)) ||
+          (NULL == CU_add_test(pSuite, "test_midi_note_to_freq", test_midi_note_to_freq))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,134 @@
+/**
+ * @file test_midimap.c
+ * @brief Unit tests for the controller mapping (midimap.c) using CUnit.
+ *
+ * Covers the scaling curves, the default mappings, channel matching and the
+ * parameter/curve name tables used by the configuration.
+ */
+
+ #include <stdio.h>
+ #include <math.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/midimap.h"
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_midimap_suite(void) {
+     return 0;
+ }
+
+ int clean_midimap_suite(void) {
+     return 0;
+ }
+
+ // --- Test Functions ---
+
+ void test_midimap_linear_scale(void) {
+     MidiMapping m = { .cc = 1, .channel = MIDI_MAP_ANY_CHANNEL, .min = 0.2, .max = 0.8, .curve = MIDI_CURVE_LINEAR };
+
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&m, 0), 0.2, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&m, 127), 0.8, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&m, 64), 0.2 + 0.6 * 64.0 / 127.0, 1e-12);
+     // Out-of-range values clamp, a reversed range runs backwards
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&m, 200), 0.8, 1e-12);
+     m.min = 1.0; m.max = 0.0;
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&m, 0), 1.0, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&m, 127), 0.0, 1e-12);
+ }
+
+ void test_midimap_exp_and_log_curves(void) {
+     MidiMapping freq = midimap_default(SYNTH_PARAM_FREQ1, MIDI_MAP_ANY_CHANNEL, 74);
+     MidiMapping time = midimap_default(SYNTH_PARAM_RELEASE2, MIDI_MAP_ANY_CHANNEL, 75);
+     double prev = -1.0;
+
+     // A positive range is geometric: equal controller steps are equal frequency ratios
+     CU_ASSERT_EQUAL(freq.curve, MIDI_CURVE_EXP);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&freq, 0), 20.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&freq, 127), 2000.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&freq, 64), 20.0 * pow(100.0, 64.0 / 127.0), 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&freq, 60) / midimap_scale(&freq, 50),
+                            midimap_scale(&freq, 110) / midimap_scale(&freq, 100), 1e-9);
+
+     // A range starting at 0 still gets fine control at the bottom, and stays monotonic
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&time, 0), 0.0, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&time, 127), 5.0, 1e-12);
+     CU_ASSERT(midimap_scale(&time, 64) < 0.5);
+     for (int v = 0; v <= 127; v++) {
+         double x = midimap_scale(&time, v);
+         if (x <= prev) { CU_FAIL("exp curve not increasing"); break; }
+         prev = x;
+     }
+
+     // The log curve mirrors it: coarse at the bottom, fine at the top
+     time.curve = MIDI_CURVE_LOG;
+     CU_ASSERT(midimap_scale(&time, 64) > 4.5);
+     time.curve = MIDI_CURVE_EXP;
+     double e = midimap_scale(&time, 27);
+     time.curve = MIDI_CURVE_LOG;
+     CU_ASSERT_DOUBLE_EQUAL(midimap_scale(&time, 100), 5.0 - e, 1e-9);
+ }
+
+ void test_midimap_defaults_and_matching(void) {
+     MidiMap map;
+     MidiMapping m;
+     midimap_init(&map);
+
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) CU_ASSERT_EQUAL(map.params[i].cc, -1);
+     CU_ASSERT_FALSE(midimap_matches(&map.params[SYNTH_PARAM_AMP1], 0, 0));
+
+     m = midimap_default(SYNTH_PARAM_SUSTAIN2, 3, 21);
+     CU_ASSERT_EQUAL(m.cc, 21);
+     CU_ASSERT_EQUAL(m.channel, 3);
+     CU_ASSERT_DOUBLE_EQUAL(m.min, 0.0, 1e-12);
+     CU_ASSERT_DOUBLE_EQUAL(m.max, 1.0, 1e-12);
+     CU_ASSERT_EQUAL(m.curve, MIDI_CURVE_LINEAR);
+     CU_ASSERT_TRUE(midimap_matches(&m, 3, 21));
+     CU_ASSERT_FALSE(midimap_matches(&m, 4, 21));
+     CU_ASSERT_FALSE(midimap_matches(&m, 3, 22));
+     m.channel = MIDI_MAP_ANY_CHANNEL;
+     CU_ASSERT_TRUE(midimap_matches(&m, 15, 21));
+
+     m = midimap_default(SYNTH_PARAM_ATTACK1, MIDI_MAP_ANY_CHANNEL, 5);
+     CU_ASSERT_DOUBLE_EQUAL(m.max, 2.0, 1e-12);
+     CU_ASSERT_EQUAL(m.curve, MIDI_CURVE_EXP);
+ }
+
+ void test_midimap_names(void) {
+     for (int i = 0; i < SYNTH_PARAM_COUNT; i++) {
+         CU_ASSERT_EQUAL(midimap_param_from_name(midimap_param_name((SynthParam)i)), i);
+     }
+     CU_ASSERT_EQUAL(midimap_param_from_name("freq2"), SYNTH_PARAM_FREQ2);
+     CU_ASSERT_EQUAL(midimap_param_from_name("volume"), -1);
+     CU_ASSERT_STRING_EQUAL(midimap_param_name(SYNTH_PARAM_COUNT), "unknown");
+
+     CU_ASSERT_EQUAL(midimap_curve_from_name("linear"), MIDI_CURVE_LINEAR);
+     CU_ASSERT_EQUAL(midimap_curve_from_name("exp"), MIDI_CURVE_EXP);
+     CU_ASSERT_EQUAL(midimap_curve_from_name("log"), MIDI_CURVE_LOG);
+     CU_ASSERT_EQUAL(midimap_curve_from_name("cubic"), -1);
+     CU_ASSERT_STRING_EQUAL(midimap_curve_name(MIDI_CURVE_LOG), "log");
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("MIDI_Map_Tests", init_midimap_suite, clean_midimap_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_midimap_linear_scale", test_midimap_linear_scale)) ||
+          (NULL == CU_add_test(pSuite, "test_midimap_exp_and_log_curves", test_midimap_exp_and_log_curves)) ||
+          (NULL == CU_add_test(pSuite, "test_midimap_defaults_and_matching", test_midimap_defaults_and_matching)) ||
+          (NULL == CU_add_test(pSuite, "test_midimap_names", test_midimap_names))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,285 @@
+/**
+ * @file test_midisync.c
+ * @brief Unit tests for MIDI clock sync (midisync.c) and the engine following and sending a clock using CUnit.
+ *
+ * Covers the tempo loop locking through a jittery clock (tempo error, smoothed
+ * tick frames and the jitter it measures), following a tempo change, Start,
+ * lost clocks, and in the engine the arpeggiator stepping on a received
+ * clock's beats and the ticks queued for sending, across a period change.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <pthread.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/midisync.h"
+ #include "../synth/midi.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_internal.h"
+ #include "../synth/config.h"
+ #include "test_engine.h"
+
+ // --- Test Globals ---
+ #define TEST_SAMPLE_RATE 48000.0
+ #define TICK_FRAMES_120 1000.0   ///< Clock tick at 120 BPM and 48 kHz.
+ #define JITTER_FRAMES 48.0       ///< 1 ms at 48 kHz.
+ #define RENDER_FRAMES 96000      ///< 2 s.
+
+ /** @brief Loop under test. */
+ MidiSync g_test_sync;
+ /** @brief Rendered output. */
+ float g_test_render[RENDER_FRAMES];
+ /** @brief State of the jitter generator. */
+ static unsigned int g_test_seed;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_midisync_suite(void) {
+     return 0;
+ }
+
+ int clean_midisync_suite(void) {
+     audio_set_config(NULL);
+     audio_midi_reset();
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief Uniform jitter in [-JITTER_FRAMES, JITTER_FRAMES] from a fixed seed. */
+ static double jitter(void) {
+     g_test_seed = g_test_seed * 1103515245u + 12345u;
+     return JITTER_FRAMES * (2.0 * ((g_test_seed >> 8) & 0xffff) / 65535.0 - 1.0);
+ }
+
+ /**
+  * @brief Feeds `count` ticks of `period` frames from `*clock`, each arriving with jitter.
+  * @return RMS distance of the smoothed tick frames from the true ones over the last `tail` ticks, in frames.
+  */
+ static double feed_ticks(double *clock, double period, int count, int tail) {
+     double sq = 0.0;
+
+     for (int k = 0; k < count; k++) {
+         midisync_tick(&g_test_sync, (uint64_t)(*clock + jitter() + 0.5));
+         if (k >= count - tail) sq += (g_test_sync.tick_frame - *clock) * (g_test_sync.tick_frame - *clock);
+         *clock += period;
+     }
+     return (tail > 0) ? sqrt(sq / tail) : 0.0;
+ }
+
+ /** @brief Sets up wave 1 as a square at full sustain without attack or release, wave 2 silent, and the arpeggiator on. */
+ static void setup_engine(MidiClockMode clock) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+
+     test_engine_init_data(WAVE_SQUARE, TEST_SAMPLE_RATE);
+     cfg.arpMode = ARP_UP;
+     cfg.tempo = 120.0;
+     cfg.arpRate = 4.0;
+     cfg.arpGate = 0.5;
+     cfg.midiClock = clock;
+     audio_set_config(&cfg);
+     audio_midi_reset();
+ }
+
+ /** @brief Schedules a MIDI event at an engine frame. */
+ static void schedule(uint64_t frame, MidiEventType type, int data1, int data2) {
+     MidiEvent ev = { .frame = frame, .type = type, .channel = 0, .data1 = (uint8_t)data1, .data2 = (uint8_t)data2 };
+     CU_ASSERT_FATAL(audio_midi_schedule(&ev));
+ }
+
+
+ // --- Test Functions ---
+
+ void test_midisync_locks_through_jitter(void) {
+     double clock = 12345.0, rms_ms, max_ms, smoothed;
+
+     midisync_init(&g_test_sync, TEST_SAMPLE_RATE);
+     g_test_seed = 1;
+     CU_ASSERT_EQUAL(midisync_tempo(&g_test_sync), 0.0);
+     CU_ASSERT_FALSE(midisync_jitter(&g_test_sync, &rms_ms, &max_ms));
+
+     // 20 s of a 120 BPM clock whose ticks arrive up to 1 ms early or late
+     smoothed = feed_ticks(&clock, TICK_FRAMES_120, 960, 480);
+     CU_ASSERT_EQUAL(g_test_sync.state, MIDISYNC_LOCKED);
+     CU_ASSERT_DOUBLE_EQUAL(midisync_tempo(&g_test_sync), 120.0, 0.5);
+     // The smoothed ticks sit far closer to the true ones than the arrivals (0.58 ms RMS)
+     CU_ASSERT(1000.0 * smoothed / TEST_SAMPLE_RATE < 0.2);
+     // Uniform jitter of +-1 ms measures about 0.58 ms RMS against the prediction
+     CU_ASSERT_FATAL(midisync_jitter(&g_test_sync, &rms_ms, &max_ms));
+     CU_ASSERT(rms_ms > 0.4 && rms_ms < 0.8);
+     CU_ASSERT(max_ms >= rms_ms && max_ms < 1.3);
+     printf("\n    MIDI clock: 120 BPM with +-1 ms jitter: tempo %.3f BPM, jitter rms=%.3fms max=%.3fms, "
+            "smoothed ticks rms=%.3fms ", midisync_tempo(&g_test_sync), rms_ms, max_ms, 1000.0 * smoothed / TEST_SAMPLE_RATE);
+ }
+
+ void test_midisync_follows_tempo_change(void) {
+     double clock = 0.0;
+
+     midisync_init(&g_test_sync, TEST_SAMPLE_RATE);
+     g_test_seed = 2;
+     feed_ticks(&clock, TICK_FRAMES_120, 480, 0);
+     CU_ASSERT_DOUBLE_EQUAL(midisync_tempo(&g_test_sync), 120.0, 0.5);
+
+     // 140 BPM: followed within a few seconds, without losing lock
+     feed_ticks(&clock, TICK_FRAMES_120 * 120.0 / 140.0, 56 * 4, 0);
+     CU_ASSERT_DOUBLE_EQUAL(midisync_tempo(&g_test_sync), 140.0, 0.5);
+     CU_ASSERT_EQUAL(g_test_sync.state, MIDISYNC_LOCKED);
+
+     // A tick spacing outside the followed tempo range gives no tempo
+     midisync_init(&g_test_sync, TEST_SAMPLE_RATE);
+     midisync_tick(&g_test_sync, 0);
+     midisync_tick(&g_test_sync, 10);
+     CU_ASSERT_EQUAL(midisync_tempo(&g_test_sync), 0.0);
+ }
+
+ void test_midisync_start_and_loss(void) {
+     double beat_frame, beat;
+
+     midisync_init(&g_test_sync, TEST_SAMPLE_RATE);
+     CU_ASSERT_FALSE(midisync_tick(&g_test_sync, 1000));
+     for (int k = 2; k <= 48; k++) CU_ASSERT(midisync_tick(&g_test_sync, 1000 * (uint64_t)k));
+     midisync_position(&g_test_sync, &beat_frame, &beat);
+     CU_ASSERT_DOUBLE_EQUAL(beat_frame, 48000.0, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(beat, 47.0 / 24.0, 1e-9);
+
+     // Start: the next tick is beat 0
+     midisync_stop(&g_test_sync);
+     CU_ASSERT_FALSE(g_test_sync.running);
+     midisync_start(&g_test_sync);
+     CU_ASSERT(g_test_sync.running);
+     CU_ASSERT(midisync_tick(&g_test_sync, 49000));
+     midisync_position(&g_test_sync, &beat_frame, &beat);
+     CU_ASSERT_DOUBLE_EQUAL(beat_frame, 49000.0, 1e-6);
+     CU_ASSERT_EQUAL(beat, 0.0);
+
+     // Lost after four tick periods without a tick; the tempo stays for the next lock
+     CU_ASSERT_FALSE(midisync_check(&g_test_sync, 53000));
+     CU_ASSERT(midisync_check(&g_test_sync, 53001));
+     CU_ASSERT_EQUAL(g_test_sync.state, MIDISYNC_IDLE);
+     CU_ASSERT_FALSE(midisync_check(&g_test_sync, 60000));
+     CU_ASSERT_DOUBLE_EQUAL(midisync_tempo(&g_test_sync), 120.0, 1e-9);
+     CU_ASSERT(midisync_tick(&g_test_sync, 100000));
+     CU_ASSERT_EQUAL(g_test_sync.state, MIDISYNC_LOCKING);
+ }
+
+ void test_midisync_engine_follows_clock(void) {
+     const double period = TEST_SAMPLE_RATE * 60.0 / (100.0 * MIDISYNC_PPQN); // 100 BPM: 1200 frames per tick
+     const uint64_t step = 7200;                                              // A sixteenth note
+     AudioStats st;
+
+     // Configured for 120 BPM; the clock runs at 100 BPM with beat 0 on frame 100
+     setup_engine(MIDI_CLOCK_IN);
+     schedule(50, MIDI_EVENT_START, 0, 0);
+     for (int k = 0; 100 + k * period < RENDER_FRAMES; k++) {
+         schedule(100 + (uint64_t)(k * period), MIDI_EVENT_CLOCK, 0, 0);
+         if (k == 1) schedule(2000, MIDI_EVENT_NOTE_ON, 60, 127); // The queue plays in order
+     }
+     render_blocks(g_test_render, RENDER_FRAMES, 256);
+
+     // The chord starts on the next sixteenth of the clock's grid; each note lasts half a step
+     for (uint64_t on = 100 + step; on + step < RENDER_FRAMES; on += step) {
+         CU_ASSERT_EQUAL(g_test_render[on - 1], 0.0f);
+         CU_ASSERT(fabsf(g_test_render[on]) > 0.4f);
+         CU_ASSERT(fabsf(g_test_render[on + step / 2 - 1]) > 0.4f);
+         CU_ASSERT_EQUAL(g_test_render[on + step / 2], 0.0f);
+     }
+     for (uint64_t i = 0; i < 100 + step; i++) {
+         if (g_test_render[i] != 0.0f) { CU_FAIL("sound before the first step"); break; }
+     }
+     audio_get_stats(&st);
+     CU_ASSERT_EQUAL(st.midiClockTicks, 80);
+     CU_ASSERT_DOUBLE_EQUAL(st.midiClockTempo, 100.0, 0.001);
+     CU_ASSERT(st.midiClockLocked);
+     audio_midi_reset();
+ }
+
+ void test_midisync_engine_sends_clock(void) {
+     MidiEvent ev;
+     double time_sec, first = 0.0;
+     AudioStats before, after;
+     int ticks = 0;
+
+     setup_engine(MIDI_CLOCK_OUT);
+     audio_get_stats(&before);
+     CU_ASSERT_FALSE(audio_midi_clock_peek(&ev, &time_sec));
+     render_blocks(g_test_render, 10000, 256);
+
+     // A Start, then a tick every 1000 frames from frame 0, due a block after rendering
+     CU_ASSERT_FATAL(audio_midi_clock_peek(&ev, &time_sec));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_START);
+     CU_ASSERT_EQUAL(ev.frame, 0);
+     audio_midi_clock_sent(0.0);
+     while (audio_midi_clock_peek(&ev, &time_sec)) {
+         CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_CLOCK);
+         CU_ASSERT_EQUAL(ev.frame, (uint64_t)ticks * 1000);
+         if (ticks == 0) first = time_sec;
+         // Only the last block is published; earlier ticks were due before it
+         if (ticks == 9) CU_ASSERT_DOUBLE_EQUAL(time_sec - first, 9000.0 / TEST_SAMPLE_RATE, 0.05);
+         audio_midi_clock_sent(0.0005);
+         ticks++;
+     }
+     CU_ASSERT_EQUAL(ticks, 10); // Frames 0-9000 of the 10000 rendered
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.midiClockSent - before.midiClockSent, 10);
+     CU_ASSERT_DOUBLE_EQUAL(after.midiClockLateMs, 0.5, 0.1);
+     audio_midi_reset();
+ }
+
+ void test_midisync_engine_clock_period_change(void) {
+     MidiEvent ev;
+     double time_sec;
+     const uint64_t expected[] = { 0, 1000, 2000, 3000, 4000, 5000, 5500, 6000, 6500 };
+     unsigned int ticks = 0;
+
+     setup_engine(MIDI_CLOCK_OUT);
+     render_blocks(g_test_render, 5000, 250);
+     // Half the rate halves the period from the last tick on; the ticks already sent stay put
+     g_test_synth_data.sampleRate = TEST_SAMPLE_RATE / 2.0;
+     render_blocks(g_test_render, 2000, 250);
+
+     CU_ASSERT_FATAL(audio_midi_clock_peek(&ev, &time_sec));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_START);
+     audio_midi_clock_sent(0.0);
+     while (audio_midi_clock_peek(&ev, &time_sec)) {
+         if (ticks < sizeof(expected) / sizeof(expected[0])) CU_ASSERT_EQUAL(ev.frame, expected[ticks]);
+         audio_midi_clock_sent(0.0);
+         ticks++;
+     }
+     CU_ASSERT_EQUAL(ticks, sizeof(expected) / sizeof(expected[0]));
+     audio_midi_reset();
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("MIDI_Clock_Sync_Tests", init_midisync_suite, clean_midisync_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_midisync_locks_through_jitter", test_midisync_locks_through_jitter)) ||
+          (NULL == CU_add_test(pSuite, "test_midisync_follows_tempo_change", test_midisync_follows_tempo_change)) ||
+          (NULL == CU_add_test(pSuite, "test_midisync_start_and_loss", test_midisync_start_and_loss)) ||
+          (NULL == CU_add_test(pSuite, "test_midisync_engine_follows_clock", test_midisync_engine_follows_clock)) ||
+          (NULL == CU_add_test(pSuite, "test_midisync_engine_sends_clock", test_midisync_engine_sends_clock)) ||
+          (NULL == CU_add_test(pSuite, "test_midisync_engine_clock_period_change", test_midisync_engine_clock_period_change))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,280 @@
+/**
+ * @file test_mpe.c
+ * @brief Unit tests for the MPE voice pool (mpe.c) and the MPE voices of the engine using CUnit.
+ *
+ * Covers voice allocation and stealing, the routing of each channel's
+ * expression to its voices, the per-block ramps, per-note pitch bend and
+ * pressure in the rendered output, and the render time of 64 voices.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <time.h>
+ #include <pthread.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/mpe.h"
+ #include "../synth/midi.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_internal.h"
+ #include "../synth/config.h"
+ #include "test_bench.h"
+ #include "test_engine.h"
+
+ // --- Test Globals ---
+ #define TEST_SAMPLE_RATE 44100.0
+ #define TEST_BLOCK 256
+ #define ANALYSIS_FRAMES 4410      ///< 0.1 s: whole cycles of 220 and 440 Hz.
+ #define BENCH_BLOCKS 2000
+
+ /** @brief Pool under test. */
+ MpeVoices g_test_pool;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_mpe_suite(void) {
+     return 0;
+ }
+
+ int clean_mpe_suite(void) {
+     audio_set_config(NULL);
+     audio_midi_reset();
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief Sets up wave 1 as a sine playing at full sustain, wave 2 silent, and MPE on. */
+ static void setup_engine(void) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+
+     test_engine_init_data(WAVE_SINE, TEST_SAMPLE_RATE);
+     cfg.mpeBendRange = MPE_DEFAULT_BEND_RANGE;
+     audio_set_config(&cfg);
+     audio_midi_reset();
+ }
+
+ /** @brief Sends a pitch bend of `semitones` for the default bend range. */
+ static void send_bend(int channel, double semitones) {
+     int bend = MIDI_BEND_CENTRE + (int)lround(semitones / MPE_DEFAULT_BEND_RANGE * MIDI_BEND_CENTRE);
+     audio_midi_input(MIDI_EVENT_PITCH_BEND, channel, bend & 0x7f, bend >> 7);
+ }
+
+ /** @brief Amplitude of the `freq` component of a signal (Goertzel). */
+ static double tone_amplitude(const float *x, int n, double freq) {
+     double w = 2.0 * M_PI * freq / TEST_SAMPLE_RATE, c = 2.0 * cos(w), s1 = 0.0, s2 = 0.0;
+
+     for (int i = 0; i < n; i++) {
+         double s0 = x[i] + c * s1 - s2;
+         s2 = s1;
+         s1 = s0;
+     }
+     return 2.0 * sqrt(s1 * s1 + s2 * s2 - c * s1 * s2) / n;
+ }
+
+
+ // --- Test Functions ---
+
+ void test_mpe_allocation(void) {
+     mpe_init(&g_test_pool, MPE_DEFAULT_BEND_RANGE);
+     CU_ASSERT_TRUE(mpe_enabled(&g_test_pool));
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 1, 60, 127), 0);
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 2, 64, 64), 1);
+     CU_ASSERT_EQUAL(g_test_pool.active, 3);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.velocity[0], 1.0, 1e-6);
+     // Note off matches channel and note
+     CU_ASSERT_EQUAL(mpe_note_off(&g_test_pool, 2, 60), -1);
+     CU_ASSERT_EQUAL(mpe_note_off(&g_test_pool, 1, 60), 0);
+     CU_ASSERT_EQUAL(mpe_note_off(&g_test_pool, 1, 60), -1);
+     CU_ASSERT_EQUAL(g_test_pool.held, 2);
+     CU_ASSERT_EQUAL(g_test_pool.active, 3);   // Still releasing
+     mpe_free(&g_test_pool, 0);
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 3, 67, 100), 0);
+     mpe_init(&g_test_pool, 0.0);
+     CU_ASSERT_FALSE(mpe_enabled(&g_test_pool));
+ }
+
+ void test_mpe_stealing(void) {
+     mpe_init(&g_test_pool, MPE_DEFAULT_BEND_RANGE);
+     for (int i = 0; i < MPE_MAX_VOICES; i++) CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 1 + i % 15, i, 100), i);
+     CU_ASSERT_EQUAL(g_test_pool.stolen, 0);
+     // The oldest released voice goes first...
+     CU_ASSERT_EQUAL(mpe_note_off(&g_test_pool, 1 + 9 % 15, 9), 9);
+     CU_ASSERT_EQUAL(mpe_note_off(&g_test_pool, 1 + 5 % 15, 5), 5);
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 1, 100, 100), 5);
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 1, 101, 100), 9);
+     // ...then the oldest held one
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 1, 102, 100), 0);
+     CU_ASSERT_EQUAL(g_test_pool.stolen, 3);
+     CU_ASSERT_EQUAL(g_test_pool.note[0], 102);
+     CU_ASSERT_EQUAL(mpe_note_off(&g_test_pool, 1, 102), 0);
+ }
+
+ void test_mpe_expression_routing(void) {
+     mpe_init(&g_test_pool, MPE_DEFAULT_BEND_RANGE);
+     mpe_begin_block(&g_test_pool, 100);
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 1, 60, 100), 0);
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 2, 60, 100), 1);
+     mpe_expression(&g_test_pool, 1, MPE_BEND, 0.5);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_BEND][0], 24.0, 1e-5);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_BEND][1], 0.0, 1e-5);
+     // The master channel bends everyone, on top of their own bend
+     mpe_expression(&g_test_pool, MPE_MASTER_CHANNEL, MPE_BEND, -1.0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_BEND][0], 22.0, 1e-5);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_BEND][1], -2.0, 1e-5);
+     mpe_expression(&g_test_pool, 2, MPE_PRESSURE, 0.75);
+     mpe_expression(&g_test_pool, 2, MPE_TIMBRE, 0.25);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_PRESSURE][0], 0.0, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_PRESSURE][1], 0.75, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_TIMBRE][0], 0.5, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.target[MPE_TIMBRE][1], 0.25, 1e-6);
+     // A new note on a channel starts from the channel's expression, without a ramp
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 2, 72, 100), 2);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.value[MPE_PRESSURE][2], 0.75, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.value[MPE_BEND][2], -2.0, 1e-5);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.step[MPE_BEND][2], 0.0, 1e-9);
+ }
+
+ void test_mpe_ramp(void) {
+     mpe_init(&g_test_pool, MPE_DEFAULT_BEND_RANGE);
+     CU_ASSERT_EQUAL(mpe_note_on(&g_test_pool, 1, 60, 100), 0);
+     mpe_begin_block(&g_test_pool, 100);
+     // An event 60 frames into the block ramps over the remaining 40
+     for (int i = 0; i < 60; i++) g_test_pool.value[MPE_PRESSURE][0] += g_test_pool.step[MPE_PRESSURE][0];
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.value[MPE_PRESSURE][0], 0.0, 1e-9);
+     g_test_pool.remaining = 40;
+     mpe_expression(&g_test_pool, 1, MPE_PRESSURE, 1.0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.step[MPE_PRESSURE][0], 1.0 / 40.0, 1e-7);
+     for (int i = 0; i < 20; i++) g_test_pool.value[MPE_PRESSURE][0] += g_test_pool.step[MPE_PRESSURE][0];
+     CU_ASSERT_DOUBLE_EQUAL(g_test_pool.value[MPE_PRESSURE][0], 0.5, 1e-5);
+     mpe_end_block(&g_test_pool);
+     CU_ASSERT_EQUAL(g_test_pool.value[MPE_PRESSURE][0], 1.0f);
+     // The next block holds still
+     mpe_begin_block(&g_test_pool, 100);
+     CU_ASSERT_EQUAL(g_test_pool.step[MPE_PRESSURE][0], 0.0f);
+ }
+
+ void test_mpe_per_note_bend(void) {
+     static float out[ANALYSIS_FRAMES];
+     AudioStats st;
+
+     setup_engine();
+     // Two voices on note 57 (220 Hz); only the second channel bends up an octave
+     audio_midi_input(MIDI_EVENT_NOTE_ON, 1, 57, 127);
+     audio_midi_input(MIDI_EVENT_NOTE_ON, 2, 57, 127);
+     render_blocks(out, 2 * TEST_BLOCK, TEST_BLOCK);
+     send_bend(2, 12.0);
+     render_blocks(out, 4 * TEST_BLOCK, TEST_BLOCK);
+     render_blocks(out, ANALYSIS_FRAMES, TEST_BLOCK);
+     CU_ASSERT_DOUBLE_EQUAL(tone_amplitude(out, ANALYSIS_FRAMES, 220.0), 0.5, 0.01);
+     CU_ASSERT_DOUBLE_EQUAL(tone_amplitude(out, ANALYSIS_FRAMES, 440.0), 0.5, 0.01);
+     CU_ASSERT(tone_amplitude(out, ANALYSIS_FRAMES, 330.0) < 0.01);
+     // The GUI voices stay silent: the notes did not touch them
+     CU_ASSERT_EQUAL(g_test_synth_data.currentStage, ENV_IDLE);
+
+     // Releasing the notes frees their voices once the envelopes finish
+     audio_midi_input(MIDI_EVENT_NOTE_OFF, 1, 57, 0);
+     audio_midi_input(MIDI_EVENT_NOTE_ON, 2, 57, 0);
+     render_blocks(out, 4 * TEST_BLOCK, TEST_BLOCK);
+     for (int i = 2 * TEST_BLOCK; i < 4 * TEST_BLOCK; i++) CU_ASSERT_EQUAL_FATAL(out[i], 0.0f);
+     audio_get_stats(&st);
+     CU_ASSERT_EQUAL(st.mpeNotes, 2);
+     CU_ASSERT_EQUAL(st.mpeVoicesPeak, 2);
+     CU_ASSERT_EQUAL(st.mpeStolen, 0);
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+ void test_mpe_pressure_ramps(void) {
+     static float out[8 * TEST_BLOCK];
+     float peak_start = 0.0f, peak_end = 0.0f;
+
+     setup_engine();
+     // A soft note, then full pressure: the level rises over a block instead of jumping
+     audio_midi_input(MIDI_EVENT_NOTE_ON, 3, 69, 1);
+     render_blocks(out, 2 * TEST_BLOCK, TEST_BLOCK);
+     audio_midi_input(MIDI_EVENT_PRESSURE, 3, 127, 0);
+     render_blocks(out, 2 * TEST_BLOCK, TEST_BLOCK);
+     // The event lands early in the first of these blocks
+     for (int i = 0; i < 32; i++) peak_start = fmaxf(peak_start, fabsf(out[i]));
+     for (int i = 1; i < TEST_BLOCK; i++) {
+         // Never more than a sine step plus one ramp step from the previous sample
+         CU_ASSERT(fabsf(out[i] - out[i - 1]) < 0.5f * (2.0 * M_PI * 440.0 / TEST_SAMPLE_RATE) + 0.5f / 200.0f);
+     }
+     render_blocks(out, 2 * TEST_BLOCK, TEST_BLOCK);
+     for (int i = 0; i < 2 * TEST_BLOCK; i++) peak_end = fmaxf(peak_end, fabsf(out[i]));
+     CU_ASSERT(peak_start < 0.5f * 0.25f);
+     CU_ASSERT_DOUBLE_EQUAL(peak_end, 0.5, 0.01);
+     // Outside MPE mode the same messages leave the note alone
+     audio_set_config(NULL);
+     audio_midi_reset();
+     audio_midi_input(MIDI_EVENT_NOTE_ON, 3, 69, 127);
+     audio_midi_input(MIDI_EVENT_PITCH_BEND, 3, 0, 0);
+     render_blocks(out, 4 * TEST_BLOCK, TEST_BLOCK);
+     peak_end = 0.0f;
+     for (int i = 2 * TEST_BLOCK; i < 4 * TEST_BLOCK; i++) peak_end = fmaxf(peak_end, fabsf(out[i]));
+     CU_ASSERT_DOUBLE_EQUAL(peak_end, 0.5, 0.01);
+     CU_ASSERT_EQUAL(g_test_synth_data.currentStage, ENV_SUSTAIN);
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+ void test_mpe_benchmark(void) {
+     static float out[TEST_BLOCK];
+     struct timespec t0, t1;
+     AudioStats st;
+     double sec;
+
+     setup_engine();
+     for (int i = 0; i < MPE_MAX_VOICES; i++) audio_midi_input(MIDI_EVENT_NOTE_ON, 1 + i % 15, 36 + i, 100);
+     render_blocks(out, TEST_BLOCK, TEST_BLOCK);
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     for (int b = 0; b < BENCH_BLOCKS; b++) {
+         // Every channel moves every block, like a player's fingers on an MPE surface
+         for (int ch = 1; ch < 16; ch++) {
+             send_bend(ch, (b % 7) * 0.1);
+             audio_midi_input(MIDI_EVENT_PRESSURE, ch, b % 128, 0);
+         }
+         render_blocks(out, TEST_BLOCK, TEST_BLOCK);
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     sec = seconds_between(&t0, &t1);
+     audio_get_stats(&st);
+     CU_ASSERT_EQUAL(st.mpeVoicesPeak, MPE_MAX_VOICES);
+     CU_ASSERT_EQUAL(st.mpeStolen, 0);
+     printf("\n  %d MPE voices: %.1f ns per voice-sample, %.1f%% of real time",
+            MPE_MAX_VOICES, sec / ((double)BENCH_BLOCKS * TEST_BLOCK * MPE_MAX_VOICES) * 1e9,
+            100.0 * sec / (BENCH_BLOCKS * TEST_BLOCK / TEST_SAMPLE_RATE));
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("MPE_Tests", init_mpe_suite, clean_mpe_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_mpe_allocation", test_mpe_allocation)) ||
+          (NULL == CU_add_test(pSuite, "test_mpe_stealing", test_mpe_stealing)) ||
+          (NULL == CU_add_test(pSuite, "test_mpe_expression_routing", test_mpe_expression_routing)) ||
+          (NULL == CU_add_test(pSuite, "test_mpe_ramp", test_mpe_ramp)) ||
+          (NULL == CU_add_test(pSuite, "test_mpe_per_note_bend", test_mpe_per_note_bend)) ||
+          (NULL == CU_add_test(pSuite, "test_mpe_pressure_ramps", test_mpe_pressure_ramps)) ||
+          (NULL == CU_add_test(pSuite, "test_mpe_benchmark", test_mpe_benchmark))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,55 @@
+/**
+ * @file test_notify.h
+ * @brief Notify callback shared by the tests of the preset worker threads.
+ *
+ * The watcher and the loader call a notify function from their thread when
+ * there is something to take; on_notify() counts those calls and
+ * wait_notify() blocks the test until one arrives.
+ */
+
+ #ifndef TEST_NOTIFY_H
+ #define TEST_NOTIFY_H
+
+ #include <pthread.h>
+ #include <time.h>
+
+ static pthread_mutex_t g_notify_lock = PTHREAD_MUTEX_INITIALIZER;
+ static pthread_cond_t g_notify_cond = PTHREAD_COND_INITIALIZER;
+ static int g_notify_count = 0;
+
+ /** @brief Notify function: counts calls and wakes the test. */
+ static inline void on_notify(void *user_data) {
+     (void)user_data;
+     pthread_mutex_lock(&g_notify_lock);
+     g_notify_count++;
+     pthread_cond_broadcast(&g_notify_cond);
+     pthread_mutex_unlock(&g_notify_lock);
+ }
+
+ /** @brief Waits for a notify call and consumes it. @return 1 if one came within `timeout_ms`. */
+ static inline int wait_notify(int timeout_ms) {
+     struct timespec deadline;
+     int ok = 1;
+
+     clock_gettime(CLOCK_REALTIME, &deadline);
+     deadline.tv_sec += timeout_ms / 1000;
+     deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+     if (deadline.tv_nsec >= 1000000000L) {
+         deadline.tv_sec++;
+         deadline.tv_nsec -= 1000000000L;
+     }
+     pthread_mutex_lock(&g_notify_lock);
+     while (g_notify_count == 0 && ok) {
+         ok = pthread_cond_timedwait(&g_notify_cond, &g_notify_lock, &deadline) == 0;
+     }
+     if (ok) g_notify_count--;
+     pthread_mutex_unlock(&g_notify_lock);
+     return ok;
+ }
+
+ static inline void sleep_ms(int ms) {
+     struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+     nanosleep(&ts, NULL);
+ }
+
+ #endif // TEST_NOTIFY_H
@@ -0,0 +1,406 @@
+/**
+ * @file test_osc.c
+ * @brief Unit tests and benchmark for the OSC parser (osc.c) and server (osc_server.c) using CUnit.
+ *
+ * Covers message and nested bundle parsing, malformed packets, timetags, the
+ * synth's address space, sample-accurate placement of timed events by the
+ * engine, and the throughput of the parser and of the server over loopback.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <time.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <unistd.h>
+ #include <stdatomic.h>
+ #include <sys/socket.h>
+ #include <netinet/in.h>
+ #include <arpa/inet.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/osc.h"
+ #include "../synth/osc_server.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_internal.h"
+ #include "test_bench.h"
+ #include "test_engine.h"
+
+ // --- Test Globals ---
+ #define TEST_SAMPLE_RATE 44100.0
+ #define TEST_BLOCK 256
+ #define BENCH_PARSE_MESSAGES 1000000
+ #define BENCH_UDP_MESSAGES 50000
+ #define BENCH_BUNDLE_SIZE 16
+ /** @brief Messages the server may be behind the sender in the UDP benchmark. */
+ #define BENCH_WINDOW 1024
+
+ /**
+  * @struct Received
+  * @brief What the test callback saw of a packet.
+  */
+ typedef struct {
+     int count;
+     char addresses[4][64];
+     uint64_t timetags[4];
+     OscMessage last;
+ } Received;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_osc_suite(void) {
+     return 0;
+ }
+
+ int clean_osc_suite(void) {
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ static size_t put_u32(char *p, uint32_t v) {
+     p[0] = (char)(v >> 24); p[1] = (char)(v >> 16); p[2] = (char)(v >> 8); p[3] = (char)v;
+     return 4;
+ }
+
+ static size_t put_string(char *p, const char *s) {
+     size_t len = (strlen(s) + 4) & ~(size_t)3;
+     memset(p, 0, len);
+     memcpy(p, s, strlen(s));
+     return len;
+ }
+
+ /**
+  * @brief Encodes a message whose arguments are all `i` or `f` (in `types`), taken from `values`.
+  */
+ static size_t encode_message(char *p, const char *address, const char *types, const double *values) {
+     char tags[16] = ",";
+     size_t n = put_string(p, address);
+
+     strncat(tags, types, sizeof(tags) - 2);
+     n += put_string(p + n, tags);
+     for (int i = 0; types[i] != '\0'; i++) {
+         union { float f; uint32_t u; } f32;
+         if (types[i] == 'i') n += put_u32(p + n, (uint32_t)(int32_t)values[i]);
+         else { f32.f = (float)values[i]; n += put_u32(p + n, f32.u); }
+     }
+     return n;
+ }
+
+ static size_t begin_bundle(char *p, uint64_t timetag) {
+     size_t n = put_string(p, "#bundle");
+     n += put_u32(p + n, (uint32_t)(timetag >> 32));
+     n += put_u32(p + n, (uint32_t)timetag);
+     return n;
+ }
+
+ /** @brief Appends an element of `len` bytes already written at `p + n + 4`. */
+ static size_t add_element(char *p, size_t n, size_t len) {
+     put_u32(p + n, (uint32_t)len);
+     return n + 4 + len;
+ }
+
+ static void record_message(const OscMessage *msg, uint64_t timetag, void *user) {
+     Received *r = (Received *)user;
+     if (r->count < 4) {
+         snprintf(r->addresses[r->count], sizeof(r->addresses[0]), "%s", msg->address);
+         r->timetags[r->count] = timetag;
+     }
+     r->last = *msg;
+     r->count++;
+ }
+
+ static void count_message(const OscMessage *msg, uint64_t timetag, void *user) {
+     MidiEvent ev;
+     (void)timetag;
+     *(unsigned long *)user += (unsigned long)osc_message_to_event(msg, &ev);
+ }
+
+ static void setup_synth_data(void) {
+     test_engine_init_data(WAVE_SQUARE, TEST_SAMPLE_RATE);
+     g_test_synth_data.frequency = 441.0;
+     g_test_synth_data.frequency2 = 660.0;
+ }
+
+ // --- Test Functions ---
+
+ void test_osc_parse_message(void) {
+     char buf[256];
+     double values[] = { 440.0, 7.0 };
+     Received r = { 0 };
+     size_t n = encode_message(buf, "/synth/wave1/freq", "fi", values);
+
+     CU_ASSERT_EQUAL(n % 4, 0);
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n, record_message, &r), 1);
+     CU_ASSERT_STRING_EQUAL(r.addresses[0], "/synth/wave1/freq");
+     CU_ASSERT_EQUAL(r.timetags[0], OSC_TIMETAG_IMMEDIATE);
+     CU_ASSERT_EQUAL(r.last.argc, 2);
+     CU_ASSERT_EQUAL(r.last.args[0].type, 'f');
+     CU_ASSERT_DOUBLE_EQUAL(r.last.args[0].number, 440.0, 1e-9);
+     CU_ASSERT_EQUAL(r.last.args[1].type, 'i');
+     CU_ASSERT_DOUBLE_EQUAL(r.last.args[1].number, 7.0, 1e-9);
+
+     // A string, a boolean and a blob are parsed too
+     memset(&r, 0, sizeof(r));
+     n = put_string(buf, "/x");
+     n += put_string(buf + n, ",sTbi");
+     n += put_string(buf + n, "hello");
+     n += put_u32(buf + n, 3);
+     memcpy(buf + n, "abc", 4); n += 4;
+     n += put_u32(buf + n, (uint32_t)-5);
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n, record_message, &r), 1);
+     CU_ASSERT_EQUAL(r.last.argc, 4);
+     CU_ASSERT_STRING_EQUAL(r.last.args[0].string, "hello");
+     CU_ASSERT_DOUBLE_EQUAL(r.last.args[1].number, 1.0, 1e-9);
+     CU_ASSERT_DOUBLE_EQUAL(r.last.args[3].number, -5.0, 1e-9);
+ }
+
+ void test_osc_parse_nested_bundle(void) {
+     char buf[512];
+     double v = 0.25;
+     Received r = { 0 };
+     size_t n, inner_start, inner;
+
+     n = begin_bundle(buf, 1000ULL << 32);
+     n = add_element(buf, n, encode_message(buf + n + 4, "/synth/wave1/amp", "f", &v));
+     // A bundle inside carries its own timetag
+     inner_start = n;
+     inner = begin_bundle(buf + inner_start + 4, 2000ULL << 32);
+     inner = add_element(buf + inner_start + 4, inner, encode_message(buf + inner_start + 4 + inner + 4, "/synth/panic", "", NULL));
+     n = add_element(buf, inner_start, inner);
+     n = add_element(buf, n, encode_message(buf + n + 4, "/synth/wave2/amp", "f", &v));
+
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n, record_message, &r), 3);
+     CU_ASSERT_STRING_EQUAL(r.addresses[0], "/synth/wave1/amp");
+     CU_ASSERT_EQUAL(r.timetags[0], 1000ULL << 32);
+     CU_ASSERT_STRING_EQUAL(r.addresses[1], "/synth/panic");
+     CU_ASSERT_EQUAL(r.timetags[1], 2000ULL << 32);
+     CU_ASSERT_STRING_EQUAL(r.addresses[2], "/synth/wave2/amp");
+     CU_ASSERT_EQUAL(r.timetags[2], 1000ULL << 32);
+ }
+
+ void test_osc_parse_malformed(void) {
+     char buf[256];
+     double v = 1.0;
+     Received r = { 0 };
+     size_t n = encode_message(buf, "/synth/wave1/amp", "f", &v);
+
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n - 4, record_message, &r), -1);  // Argument missing
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n - 1, record_message, &r), -1);  // Not a multiple of 4
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, 0, record_message, &r), -1);
+     memcpy(buf, "#bundlX", 8);
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n, record_message, &r), -1);
+     n = encode_message(buf, "/a", "f", &v);
+     buf[5] = 'q';                                                            // Unknown type tag
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n, record_message, &r), -1);
+     memset(buf, 'a', 8); buf[0] = '/';                                       // Unterminated address
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, 8, record_message, &r), -1);
+     // A bundle element claiming more bytes than the packet holds
+     n = begin_bundle(buf, OSC_TIMETAG_IMMEDIATE);
+     n += put_u32(buf + n, 64);
+     CU_ASSERT_EQUAL(osc_parse_packet(buf, n, record_message, &r), -1);
+     CU_ASSERT_EQUAL(r.count, 0);
+ }
+
+ void test_osc_timetags(void) {
+     uint64_t tt = osc_timetag_from_unix(1700000000.25);
+
+     CU_ASSERT_EQUAL(tt >> 32, 1700000000ULL + OSC_NTP_UNIX_OFFSET);
+     CU_ASSERT_EQUAL(tt & 0xffffffffu, 0x40000000u);
+     CU_ASSERT_DOUBLE_EQUAL(osc_timetag_to_unix(tt), 1700000000.25, 1e-6);
+     CU_ASSERT_DOUBLE_EQUAL(osc_timetag_to_unix(osc_timetag_from_unix(1234.000123)), 1234.000123, 1e-8);
+ }
+
+ void test_osc_message_to_event(void) {
+     OscMessage msg = { .address = "/synth/wave2/freq", .argc = 1, .args = { { .type = 'f', .number = 330.0 } } };
+     MidiEvent ev;
+
+     CU_ASSERT_TRUE(osc_message_to_event(&msg, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_PARAM);
+     CU_ASSERT_EQUAL(ev.data1, SYNTH_PARAM_FREQ2);
+     CU_ASSERT_DOUBLE_EQUAL(ev.value, 330.0, 1e-9);
+     // Clamped to the slider range
+     msg.address = "/synth/wave1/amp"; msg.args[0].number = 3.0;
+     CU_ASSERT_TRUE(osc_message_to_event(&msg, &ev));
+     CU_ASSERT_DOUBLE_EQUAL(ev.value, 1.0, 1e-9);
+
+     msg.address = "/synth/note/on"; msg.args[0].type = 'i'; msg.args[0].number = 64;
+     CU_ASSERT_TRUE(osc_message_to_event(&msg, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_ON);
+     CU_ASSERT_EQUAL(ev.data1, 64);
+     CU_ASSERT_EQUAL(ev.data2, 100);
+     msg.address = "/synth/note/off";
+     CU_ASSERT_TRUE(osc_message_to_event(&msg, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_NOTE_OFF);
+     msg.address = "/synth/volume"; msg.args[0].number = 0.5;
+     CU_ASSERT_TRUE(osc_message_to_event(&msg, &ev));
+     CU_ASSERT_EQUAL(ev.type, MIDI_EVENT_CONTROL);
+     CU_ASSERT_EQUAL(ev.data1, MIDI_CC_VOLUME);
+     CU_ASSERT_EQUAL(ev.data2, 64);
+     msg.address = "/synth/panic"; msg.argc = 0;
+     CU_ASSERT_TRUE(osc_message_to_event(&msg, &ev));
+     CU_ASSERT_EQUAL(ev.data1, MIDI_CC_ALL_SOUND_OFF);
+
+     // Unknown addresses and missing or non-numeric arguments are rejected
+     msg.address = "/synth/wave1/amp";
+     CU_ASSERT_FALSE(osc_message_to_event(&msg, &ev));
+     msg.argc = 1; msg.args[0].type = 's'; msg.args[0].string = "loud";
+     CU_ASSERT_FALSE(osc_message_to_event(&msg, &ev));
+     msg.address = "/synth/wave3/amp";
+     CU_ASSERT_FALSE(osc_message_to_event(&msg, &ev));
+     msg.address = "/other/thing";
+     CU_ASSERT_FALSE(osc_message_to_event(&msg, &ev));
+ }
+
+ void test_osc_timed_events_are_sample_accurate(void) {
+     float out[8 * TEST_BLOCK];
+     MidiEvent on = { .type = MIDI_EVENT_NOTE_ON, .data1 = 69, .data2 = 127 };
+     MidiEvent amp = { .type = MIDI_EVENT_PARAM, .data1 = SYNTH_PARAM_AMP1, .value = 0.25 };
+     int onset = -1, change = -1;
+     double t;
+
+     setup_synth_data();
+     audio_midi_reset();
+     CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, out, TEST_BLOCK), 0);
+
+     // Queued out of order: the schedule sorts them, and their spacing survives to the sample
+     t = audio_time_now() + 0.005;
+     CU_ASSERT_FATAL(audio_control_event(&amp, t + 100.0 / TEST_SAMPLE_RATE));
+     CU_ASSERT_FATAL(audio_control_event(&on, t));
+     for (int b = 0; b < 8; b++) {
+         CU_ASSERT_EQUAL(render_audio(&g_test_synth_data, out + b * TEST_BLOCK, TEST_BLOCK), 0);
+     }
+     for (int i = 0; i < 8 * TEST_BLOCK; i++) {
+         if (onset < 0 && out[i] != 0.0f) onset = i;
+         if (onset >= 0 && change < 0 && fabsf(out[i]) < 0.3f) change = i;
+     }
+     CU_ASSERT_FATAL(onset >= 0 && change > onset);
+     CU_ASSERT(abs(change - onset - 100) <= 1);
+     CU_ASSERT_DOUBLE_EQUAL(fabsf(out[change]), 0.25, 1e-6);
+     // The parameter reaches the shared data like a mapped controller's
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.25, 1e-12);
+     audio_midi_reset();
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+ void test_osc_parse_benchmark(void) {
+     char buf[1024];
+     double v = 0.5;
+     size_t n = begin_bundle(buf, OSC_TIMETAG_IMMEDIATE);
+     unsigned long handled = 0;
+     struct timespec t0, t1;
+     double sec;
+
+     for (int i = 0; i < BENCH_BUNDLE_SIZE; i++) n = add_element(buf, n, encode_message(buf + n + 4, "/synth/wave1/release", "f", &v));
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     for (int i = 0; i < BENCH_PARSE_MESSAGES / BENCH_BUNDLE_SIZE; i++) {
+         osc_parse_packet(buf, n, count_message, &handled);
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     sec = seconds_between(&t0, &t1);
+
+     CU_ASSERT_EQUAL(handled, BENCH_PARSE_MESSAGES);
+     printf("\n  osc bench parse+route: %.1f ns/message, %.2f M messages/s", sec / BENCH_PARSE_MESSAGES * 1e9,
+            BENCH_PARSE_MESSAGES / sec / 1e6);
+ }
+
+ /** @brief Set to stop render_thread_main(). */
+ static atomic_int g_render_stop;
+
+ /** @brief Stands in for the audio device: renders blocks as fast as it can, draining the event queues. */
+ static void *render_thread_main(void *arg) {
+     static float out[TEST_BLOCK];
+     (void)arg;
+     while (!atomic_load(&g_render_stop)) render_audio(&g_test_synth_data, out, TEST_BLOCK);
+     return NULL;
+ }
+
+ void test_osc_server_udp_benchmark(void) {
+     char buf[1024];
+     double v = 0.5;
+     struct sockaddr_in addr;
+     pthread_t renderer;
+     OscServerStats st;
+     AudioStats before, after;
+     struct timespec t0, t1;
+     unsigned long sent = 0;
+     size_t n = begin_bundle(buf, OSC_TIMETAG_IMMEDIATE);
+     int sock;
+     double sec;
+
+     for (int i = 0; i < BENCH_BUNDLE_SIZE; i++) n = add_element(buf, n, encode_message(buf + n + 4, "/synth/wave1/amp", "f", &v));
+     setup_synth_data();
+     audio_midi_reset();
+     audio_get_stats(&before);
+     CU_ASSERT_FATAL(osc_server_start(0));
+     CU_ASSERT_FATAL(osc_server_port() > 0);
+     atomic_store(&g_render_stop, 0);
+     CU_ASSERT_FATAL(pthread_create(&renderer, NULL, render_thread_main, NULL) == 0);
+
+     sock = socket(AF_INET, SOCK_DGRAM, 0);
+     CU_ASSERT_FATAL(sock >= 0);
+     memset(&addr, 0, sizeof(addr));
+     addr.sin_family = AF_INET;
+     addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+     addr.sin_port = htons((uint16_t)osc_server_port());
+
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     while (sent < BENCH_UDP_MESSAGES) {
+         // Stay a bounded amount ahead of the renderer so neither the socket nor the event queue overflows
+         audio_get_stats(&after);
+         if (sent - (after.midiEvents - before.midiEvents) >= BENCH_WINDOW) { sched_yield(); continue; }
+         if (sendto(sock, buf, n, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)n) sent += BENCH_BUNDLE_SIZE;
+     }
+     for (;;) {
+         audio_get_stats(&after);
+         clock_gettime(CLOCK_MONOTONIC, &t1);
+         if (after.midiEvents - before.midiEvents >= sent || seconds_between(&t0, &t1) > 10.0) break;
+         sched_yield();
+     }
+     sec = seconds_between(&t0, &t1);
+     close(sock);
+     osc_server_get_stats(&st);
+     osc_server_stop();
+     atomic_store(&g_render_stop, 1);
+     pthread_join(renderer, NULL);
+
+     // Every message made it from the socket through the queue into a rendered block
+     CU_ASSERT_EQUAL(st.messages, BENCH_UDP_MESSAGES);
+     CU_ASSERT_EQUAL(st.packets, BENCH_UDP_MESSAGES / BENCH_BUNDLE_SIZE);
+     CU_ASSERT_EQUAL(st.errors, 0);
+     CU_ASSERT_EQUAL(after.midiEvents - before.midiEvents, BENCH_UDP_MESSAGES);
+     CU_ASSERT_EQUAL(after.midiDroppedEvents, before.midiDroppedEvents);
+     printf("\n  osc bench udp loopback to render: %.0f messages/s", BENCH_UDP_MESSAGES / sec);
+     audio_midi_reset();
+     pthread_mutex_destroy(&g_test_synth_data.mutex);
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("OSC_Tests", init_osc_suite, clean_osc_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_osc_parse_message", test_osc_parse_message)) ||
+          (NULL == CU_add_test(pSuite, "test_osc_parse_nested_bundle", test_osc_parse_nested_bundle)) ||
+          (NULL == CU_add_test(pSuite, "test_osc_parse_malformed", test_osc_parse_malformed)) ||
+          (NULL == CU_add_test(pSuite, "test_osc_timetags", test_osc_timetags)) ||
+          (NULL == CU_add_test(pSuite, "test_osc_message_to_event", test_osc_message_to_event)) ||
+          (NULL == CU_add_test(pSuite, "test_osc_timed_events_are_sample_accurate", test_osc_timed_events_are_sample_accurate)) ||
+          (NULL == CU_add_test(pSuite, "test_osc_parse_benchmark", test_osc_parse_benchmark)) ||
+          (NULL == CU_add_test(pSuite, "test_osc_server_udp_benchmark", test_osc_server_udp_benchmark))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
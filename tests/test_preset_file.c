@@ -0,0 +1,275 @@
+/**
+ * @file test_preset_file.c
+ * @brief Unit tests and benchmark for the preset parser (preset_file.c) using CUnit.
+ *
+ * Covers the table of keys (layout, comments, unknown keys, ranges and
+ * types), numbers converted exactly as strtod() converts them, files read
+ * whole or mapped, and the parsing rate.
+ */
+
+ #include <math.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/preset_file.h"
+ #include "../synth/midimap.h"
+ #include "test_bench.h"
+ #include "test_presets.h"
+
+ // --- Test Globals ---
+ #define BENCH_PARSES 200000
+ #define NUMBER_SAMPLES 20000
+
+ /** @brief Path of the suite's scratch file. */
+ char g_test_path[64];
+
+ /** @brief The 14 parameters of a preset with wave 1 a 440 Hz sawtooth, written by the suite's setup. */
+ static char k_params[1024];
+
+ // --- Helper Functions ---
+
+ static int parse_text(const char *text, PresetData *preset, SeqPattern *pattern) {
+     return preset_file_parse(text, strlen(text), "test", preset, pattern);
+ }
+
+ /** @brief The parameters with one line replaced: `key` is a prefix such as "amplitude1:". */
+ static void params_with(char *buf, size_t size, const char *key, const char *line) {
+     const char *at = strstr(k_params, key);
+     const char *eol = strchr(at, '\n');
+
+     snprintf(buf, size, "%.*s%s%s", (int)(at - k_params), k_params, line, eol);
+ }
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_preset_file_suite(void) {
+     PresetData p = make_preset_at(440.0);
+
+     p.waveform1 = WAVE_SAWTOOTH;
+     snprintf(g_test_path, sizeof(g_test_path), "/tmp/synth_test_preset_file_%d%s", (int)getpid(), PRESET_SUFFIX);
+     return format_text_preset(k_params, sizeof(k_params), &p) ? 0 : -1;
+ }
+
+ int clean_preset_file_suite(void) {
+     unlink(g_test_path);
+     return 0;
+ }
+
+ // --- Test Cases ---
+
+ void test_preset_file_parses_layouts(void) {
+     PresetData preset;
+     SeqPattern pattern;
+     const char *text =
+         "# written by hand\r\n"
+         "\r\n"
+         "  frequency1 :\t523.25  \r\n"
+         "amplitude1:1\r\nwaveform1: 3\r\nattackTime1: 0\r\ndecayTime1: 1e-1\r\nsustainLevel1: .5\r\n"
+         "releaseTime1: 2.\r\nfrequency2: 1046.5\r\namplitude2: 0\r\nwaveform2: 0\r\nattackTime2: 0.05\r\n"
+         "filterCutoff: 1200\r\n" // A key of a newer version
+         "decayTime2: 0.2\r\nsustainLevel2: 0.5\r\nseqLength: 8\r\nseqRate: 2\r\n"
+         "step2: 64 90 0.5 amp1=0.25 release1=0.05\r\n"
+         "step8: 0 0 1\r\n"
+         "releaseTime2: 0.5"; // No final newline
+
+     CU_ASSERT_FATAL(parse_text(text, &preset, &pattern));
+     CU_ASSERT_EQUAL(preset.frequency1, 523.25);
+     CU_ASSERT_EQUAL(preset.amplitude1, 1.0);
+     CU_ASSERT_EQUAL(preset.waveform1, WAVE_TRIANGLE);
+     CU_ASSERT_EQUAL(preset.decayTime1, 0.1);
+     CU_ASSERT_EQUAL(preset.sustainLevel1, 0.5);
+     CU_ASSERT_EQUAL(preset.releaseTime1, 2.0);
+     CU_ASSERT_EQUAL(preset.frequency2, 1046.5);
+     CU_ASSERT_EQUAL(preset.waveform2, WAVE_SINE);
+     CU_ASSERT_EQUAL(preset.releaseTime2, 0.5);
+     CU_ASSERT_EQUAL(pattern.length, 8);
+     CU_ASSERT_EQUAL(pattern.rate, 2.0);
+     CU_ASSERT_EQUAL(pattern.steps[1].note, 64);
+     CU_ASSERT_EQUAL(pattern.steps[1].velocity, 90);
+     CU_ASSERT_EQUAL(pattern.steps[1].gate, 0.5);
+     CU_ASSERT_EQUAL_FATAL(pattern.steps[1].locks, 2);
+     CU_ASSERT_EQUAL(pattern.steps[1].lock[1].param, SYNTH_PARAM_RELEASE1);
+     CU_ASSERT_EQUAL(pattern.steps[1].lock[1].value, 0.05);
+     CU_ASSERT_EQUAL(pattern.steps[7].gate, 1.0);
+
+     // The text need not end where the buffer does: only `len` bytes are read
+     CU_ASSERT(preset_file_parse(k_params, strlen(k_params) - 1, "test", &preset, NULL));
+     CU_ASSERT_FALSE(preset_file_parse(k_params, strlen(k_params) - 20, "test", &preset, NULL));
+ }
+
+ void test_preset_file_checks_values(void) {
+     PresetData preset, untouched;
+     SeqPattern pattern;
+     char text[1024];
+     const struct { const char *key, *line; } bad[] = {
+         { "amplitude1:", "amplitude1: 1.5" },
+         { "amplitude2:", "amplitude2: -0.1" },
+         { "sustainLevel1:", "sustainLevel1: 2" },
+         { "waveform1:", "waveform1: 4" },
+         { "waveform1:", "waveform1: 2.0" },
+         { "waveform2:", "waveform2: -1" },
+         { "decayTime1:", "decayTime1: -0.1" },
+         { "frequency1:", "frequency1: nan" },
+         { "frequency1:", "frequency1: inf" },
+         { "frequency1:", "frequency1: 440Hz" },
+         { "frequency2:", "frequency2: 220 330" },
+         { "releaseTime2:", "releaseTime2: ." },
+         { "releaseTime2:", "releaseTime2: 1e" },
+         { "attackTime2:", "attackTime2: -" },
+     };
+
+     memset(&untouched, 0, sizeof(untouched));
+     for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+         preset = untouched;
+         params_with(text, sizeof(text), bad[i].key, bad[i].line);
+         CU_ASSERT_FALSE(parse_text(text, &preset, &pattern));
+         // Nothing is written on failure
+         CU_ASSERT_EQUAL(memcmp(&preset, &untouched, sizeof(preset)), 0);
+     }
+
+     // The pattern keys have ranges of their own
+     const char *bad_pattern[] = { "seqLength: 0\n", "seqLength: 65\n", "seqLength: 4\nseqRate: 0\n",
+                                   "seqLength: 4\nseqRate: 100\n", "seqLength: 4\nstep0: 60 100 0.5\n",
+                                   "seqLength: 4\nstep1: 60 100 0.5 amp1\n", "seqLength: 4\nstep1: 60 100\n" };
+     for (size_t i = 0; i < sizeof(bad_pattern) / sizeof(bad_pattern[0]); i++) {
+         snprintf(text, sizeof(text), "%s%s", k_params, bad_pattern[i]);
+         CU_ASSERT_FALSE(parse_text(text, &preset, &pattern));
+     }
+
+     // Every required key is needed, whatever else the file has
+     params_with(text, sizeof(text), "sustainLevel2:", "# sustainLevel2: 0.5");
+     CU_ASSERT_FALSE(parse_text(text, &preset, &pattern));
+     params_with(text, sizeof(text), "sustainLevel2:", "sustainLevel3: 0.5");
+     CU_ASSERT_FALSE(parse_text(text, &preset, &pattern));
+
+     // Edge values are allowed, and a later line wins
+     params_with(text, sizeof(text), "releaseTime2:", "releaseTime2: 0\nsustainLevel1: 1\nwaveform1: 0\namplitude1: 1.0");
+     CU_ASSERT_FATAL(parse_text(text, &preset, &pattern));
+     CU_ASSERT_EQUAL(preset.amplitude1, 1.0);
+     CU_ASSERT_EQUAL(preset.sustainLevel1, 1.0);
+     CU_ASSERT_EQUAL(preset.waveform1, WAVE_SINE);
+     CU_ASSERT_EQUAL(preset.releaseTime2, 0.0);
+ }
+
+ void test_preset_file_numbers_match_strtod(void) {
+     const char *formats[] = { "%f", "%.17g", "%.3f", "%g", "%.10e", "%.1f" };
+     PresetData preset;
+     char text[1024], line[80], *value;
+     int mismatches = 0;
+
+     srand(7);
+     for (int i = 0; i < NUMBER_SAMPLES; i++) {
+         double x = (double)rand() / RAND_MAX * pow(10.0, rand() % 12 - 6);
+
+         snprintf(line, sizeof(line), "frequency1: ");
+         value = line + strlen(line);
+         snprintf(value, sizeof(line) - strlen(line), formats[i % 6], x);
+         params_with(text, sizeof(text), "frequency1:", line);
+         if (!parse_text(text, &preset, NULL) || preset.frequency1 != strtod(value, NULL)) mismatches++;
+     }
+     CU_ASSERT_EQUAL(mismatches, 0);
+
+     // Forms the fast path leaves to strtod()
+     const char *others[] = { "123456789012345678901234567890", "1e300", "0x1p4", "9007199254740993", "4.4e-30" };
+     for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+         snprintf(line, sizeof(line), "frequency1: %s", others[i]);
+         params_with(text, sizeof(text), "frequency1:", line);
+         CU_ASSERT(parse_text(text, &preset, NULL));
+         CU_ASSERT_EQUAL(preset.frequency1, strtod(others[i], NULL));
+     }
+ }
+
+ void test_preset_file_reads_small_and_large_files(void) {
+     PresetData preset;
+     SeqPattern pattern;
+     FILE *f;
+
+     f = fopen(g_test_path, "w");
+     CU_ASSERT_FATAL(f != NULL);
+     fputs(k_params, f);
+     fclose(f);
+     CU_ASSERT_FATAL(preset_file_read_with_pattern(g_test_path, &preset, &pattern));
+     CU_ASSERT_EQUAL(preset.frequency1, 440.0);
+     CU_ASSERT_EQUAL(pattern.length, 0);
+
+     // Past the stack buffer the file is mapped
+     f = fopen(g_test_path, "w");
+     CU_ASSERT_FATAL(f != NULL);
+     for (int i = 0; i < 1000; i++) fprintf(f, "# padding line %04d of a preset with a long description\n", i);
+     fputs(k_params, f);
+     fputs("seqLength: 2\nstep2: 72 100 0.25", f);
+     fclose(f);
+     CU_ASSERT_FATAL(preset_file_read_with_pattern(g_test_path, &preset, &pattern));
+     CU_ASSERT_EQUAL(preset.releaseTime2, 0.5);
+     CU_ASSERT_EQUAL(pattern.steps[1].note, 72);
+
+     unlink(g_test_path);
+     CU_ASSERT_FALSE(preset_file_read(g_test_path, &preset));
+ }
+
+ void test_preset_file_parse_benchmark(void) {
+     char with_pattern[2048];
+     size_t plain_len = strlen(k_params), pattern_len;
+     struct timespec t0, t1;
+     PresetData preset;
+     SeqPattern pattern;
+     double sec, checksum = 0.0;
+     int ok = 0;
+
+     // Half of them with a 16-step pattern, a note every other step
+     pattern_len = (size_t)snprintf(with_pattern, sizeof(with_pattern), "%sseqLength: 16\nseqRate: 4.000000\n", k_params);
+     for (int s = 0; s < 16; s += 2) {
+         pattern_len += (size_t)snprintf(with_pattern + pattern_len, sizeof(with_pattern) - pattern_len,
+                                          "step%d: %d 100 0.500000 amp1=0.250000\n", s + 1, 60 + s);
+     }
+
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     for (int i = 0; i < BENCH_PARSES; i++) {
+         int parsed = (i & 1) ? preset_file_parse(with_pattern, pattern_len, "bench", &preset, &pattern)
+                              : preset_file_parse(k_params, plain_len, "bench", &preset, &pattern);
+         if (parsed) {
+             ok++;
+             checksum += preset.frequency1 + pattern.length;
+         }
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     sec = seconds_between(&t0, &t1);
+     printf("\n    Preset parser: %d presets in %.1f ms, %.0f per second ", BENCH_PARSES, 1e3 * sec, BENCH_PARSES / sec);
+     CU_ASSERT_EQUAL(ok, BENCH_PARSES);
+     CU_ASSERT_DOUBLE_EQUAL(checksum, BENCH_PARSES * 440.0 + BENCH_PARSES / 2 * 16, 1e-3);
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("PresetFile_Tests", init_preset_file_suite, clean_preset_file_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_preset_file_parses_layouts", test_preset_file_parses_layouts)) ||
+          (NULL == CU_add_test(pSuite, "test_preset_file_checks_values", test_preset_file_checks_values)) ||
+          (NULL == CU_add_test(pSuite, "test_preset_file_numbers_match_strtod", test_preset_file_numbers_match_strtod)) ||
+          (NULL == CU_add_test(pSuite, "test_preset_file_reads_small_and_large_files", test_preset_file_reads_small_and_large_files)) ||
+          (NULL == CU_add_test(pSuite, "test_preset_file_parse_benchmark", test_preset_file_parse_benchmark))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,285 @@
+/**
+ * @file test_presetbank.c
+ * @brief Unit tests for preset banks (presetbank.c) using CUnit.
+ *
+ * Covers writing and reading back presets with their step patterns, lookups
+ * by index and name, converting a directory of text presets, telling a bank
+ * older than its directory, rejecting damaged banks, and a benchmark of
+ * loading every preset of a large directory from text files against loading
+ * them from a bank.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <sys/stat.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/presetbank.h"
+ #include "../synth/preset_file.h"
+ #include "../synth/midimap.h"
+ #include "test_bench.h"
+ #include "test_presets.h"
+
+ // --- Test Globals ---
+ #define BENCH_PRESETS 2000
+
+ /** @brief Directory of the suite's text presets and banks. */
+ char g_test_dir[64];
+ /** @brief Path of the bank under test. */
+ char g_test_bank[128];
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_presetbank_suite(void) {
+     snprintf(g_test_dir, sizeof(g_test_dir), "/tmp/synth_test_presetbank_XXXXXX");
+     if (mkdtemp(g_test_dir) == NULL) return -1;
+     test_path(g_test_bank, sizeof(g_test_bank), "test" PRESETBANK_SUFFIX);
+     return 0;
+ }
+
+ int clean_presetbank_suite(void) {
+     clear_test_dir();
+     rmdir(g_test_dir);
+     return 0;
+ }
+
+ // --- Test Cases ---
+
+ void test_presetbank_round_trip(void) {
+     PresetBankWriter w;
+     PresetBank b;
+     PresetData p[3] = { make_preset(0), make_preset(1), make_preset(2) }, got;
+     SeqPattern pat = make_pattern(), got_pat;
+
+     presetbank_writer_init(&w);
+     CU_ASSERT(presetbank_writer_add(&w, "init", &p[0], NULL));
+     CU_ASSERT(presetbank_writer_add(&w, "bass sequence", &p[1], &pat));
+     CU_ASSERT(presetbank_writer_add(&w, "pad", &p[2], NULL));
+     // Invalid names and patterns are refused and change nothing
+     CU_ASSERT_FALSE(presetbank_writer_add(&w, "", &p[0], NULL));
+     pat.steps[3].gate = 2.0;
+     CU_ASSERT_FALSE(presetbank_writer_add(&w, "broken", &p[0], &pat));
+     pat.steps[3].gate = 0.25;
+     CU_ASSERT_EQUAL(w.count, 3);
+     CU_ASSERT_FATAL(presetbank_writer_save(&w, g_test_bank));
+     presetbank_writer_free(&w);
+
+     CU_ASSERT_FATAL(presetbank_open(&b, g_test_bank));
+     CU_ASSERT_EQUAL(presetbank_count(&b), 3);
+     CU_ASSERT_STRING_EQUAL(presetbank_name(&b, 0), "init");
+     CU_ASSERT_STRING_EQUAL(presetbank_name(&b, 1), "bass sequence");
+     CU_ASSERT_STRING_EQUAL(presetbank_name(&b, 2), "pad");
+     CU_ASSERT_PTR_NULL(presetbank_name(&b, 3));
+     CU_ASSERT_EQUAL(presetbank_find(&b, "pad"), 2);
+     CU_ASSERT_EQUAL(presetbank_find(&b, "bass sequence"), 1);
+     CU_ASSERT_EQUAL(presetbank_find(&b, "bass"), -1);
+     CU_ASSERT_EQUAL(presetbank_find(&b, "Pad"), -1);
+
+     CU_ASSERT(presetbank_get(&b, 1, &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &p[1]));
+     CU_ASSERT(patterns_equal(&got_pat, &pat));
+     CU_ASSERT(presetbank_get(&b, 0, &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &p[0]));
+     CU_ASSERT_EQUAL(got_pat.length, 0);
+     CU_ASSERT(presetbank_get(&b, 2, &got, NULL));
+     CU_ASSERT(presets_equal(&got, &p[2]));
+     CU_ASSERT_FALSE(presetbank_get(&b, 3, &got, NULL));
+     presetbank_close(&b);
+     CU_ASSERT_EQUAL(presetbank_count(&b), 0);
+     CU_ASSERT_EQUAL(presetbank_find(&b, "pad"), -1);
+     presetbank_close(&b);
+ }
+
+ void test_presetbank_convert_directory(void) {
+     PresetBank b;
+     PresetData p = make_preset(5), got, text;
+     SeqPattern pat = make_pattern(), got_pat, text_pat;
+     char path[128];
+     FILE *f;
+
+     clear_test_dir();
+     test_path(path, sizeof(path), "lead" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(write_text_preset(path, &p, &pat));
+     test_path(path, sizeof(path), "init" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(write_text_preset(path, &p, NULL));
+     // A preset missing fields is left out, other files are ignored
+     test_path(path, sizeof(path), "broken" PRESET_SUFFIX);
+     f = fopen(path, "w");
+     CU_ASSERT_FATAL(f != NULL);
+     fprintf(f, "frequency1: 440\n");
+     fclose(f);
+     test_path(path, sizeof(path), "notes.txt");
+     f = fopen(path, "w");
+     CU_ASSERT_FATAL(f != NULL);
+     fclose(f);
+
+     CU_ASSERT_FATAL(presetbank_convert(g_test_dir, g_test_bank));
+     CU_ASSERT_FATAL(presetbank_open(&b, g_test_bank));
+     CU_ASSERT_EQUAL(presetbank_count(&b), 2);
+     // Sorted by name
+     CU_ASSERT_STRING_EQUAL(presetbank_name(&b, 0), "init");
+     CU_ASSERT_STRING_EQUAL(presetbank_name(&b, 1), "lead");
+     CU_ASSERT_EQUAL(presetbank_find(&b, "broken"), -1);
+     // The bank holds what the text parser reads
+     test_path(path, sizeof(path), "lead" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(preset_file_read_with_pattern(path, &text, &text_pat));
+     CU_ASSERT(presetbank_get(&b, (size_t)presetbank_find(&b, "lead"), &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &text));
+     CU_ASSERT(patterns_equal(&got_pat, &text_pat));
+     presetbank_close(&b);
+
+     CU_ASSERT_FALSE(presetbank_convert("/nonexistent-dir", g_test_bank));
+ }
+
+ void test_presetbank_is_current(void) {
+     PresetData p = make_preset(2);
+     struct timespec times[2];
+     struct stat st;
+     char path[128];
+
+     clear_test_dir();
+     test_path(path, sizeof(path), "pad" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(write_text_preset(path, &p, NULL));
+     CU_ASSERT_FALSE(presetbank_is_current(g_test_bank, g_test_dir));
+     // Written into the directory it was built from, the bank is current
+     CU_ASSERT_FATAL(presetbank_convert(g_test_dir, g_test_bank));
+     CU_ASSERT(presetbank_is_current(g_test_bank, g_test_dir));
+
+     // A file added later makes the directory newer (set explicitly, timestamps can be coarse)
+     test_path(path, sizeof(path), "bass" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(write_text_preset(path, &p, NULL));
+     CU_ASSERT_FATAL(stat(g_test_bank, &st) == 0);
+     times[0] = st.st_mtim;
+     times[1] = st.st_mtim;
+     times[1].tv_sec += 10;
+     CU_ASSERT_FATAL(utimensat(AT_FDCWD, g_test_dir, times, 0) == 0);
+     CU_ASSERT_FALSE(presetbank_is_current(g_test_bank, g_test_dir));
+
+     // Rebuilding it makes it current again
+     CU_ASSERT_FATAL(presetbank_convert(g_test_dir, g_test_bank));
+     CU_ASSERT(presetbank_is_current(g_test_bank, g_test_dir));
+     CU_ASSERT_FALSE(presetbank_is_current(g_test_bank, "/nonexistent-dir"));
+ }
+
+ void test_presetbank_rejects_damaged(void) {
+     PresetBankWriter w;
+     PresetBank b;
+     PresetData p = make_preset(1);
+     char path[128];
+     long size;
+     FILE *f;
+
+     presetbank_writer_init(&w);
+     CU_ASSERT(presetbank_writer_add(&w, "a", &p, NULL));
+     CU_ASSERT(presetbank_writer_add(&w, "b", &p, NULL));
+     CU_ASSERT_FATAL(presetbank_writer_save(&w, g_test_bank));
+     // Two presets of the same name cannot both be found
+     CU_ASSERT(presetbank_writer_add(&w, "a", &p, NULL));
+     test_path(path, sizeof(path), "dup" PRESETBANK_SUFFIX);
+     CU_ASSERT_FALSE(presetbank_writer_save(&w, path));
+     CU_ASSERT_FALSE(access(path, F_OK) == 0);
+     presetbank_writer_free(&w);
+
+     CU_ASSERT_FALSE(presetbank_open(&b, "/nonexistent-dir/x" PRESETBANK_SUFFIX));
+     CU_ASSERT_PTR_NULL(b.data);
+
+     // Cut short: the sections no longer fit
+     f = fopen(g_test_bank, "r+b");
+     CU_ASSERT_FATAL(f != NULL);
+     fseek(f, 0, SEEK_END);
+     size = ftell(f);
+     fclose(f);
+     CU_ASSERT_EQUAL(truncate(g_test_bank, size - 1), 0);
+     CU_ASSERT_FALSE(presetbank_open(&b, g_test_bank));
+     CU_ASSERT_EQUAL(truncate(g_test_bank, PRESETBANK_HEADER_SIZE - 1), 0);
+     CU_ASSERT_FALSE(presetbank_open(&b, g_test_bank));
+
+     // A text preset is not a bank
+     test_path(path, sizeof(path), "text" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(write_text_preset(path, &p, NULL));
+     CU_ASSERT_FALSE(presetbank_open(&b, path));
+ }
+
+ void test_presetbank_load_benchmark(void) {
+     static char names[BENCH_PRESETS][32];
+     struct timespec t0, t1, t2;
+     PresetBank b;
+     PresetData got;
+     SeqPattern pat = make_pattern(), got_pat;
+     char path[128];
+     double text_sec, bank_sec, checksum_text = 0.0, checksum_bank = 0.0;
+     int text_ok = 0, bank_ok = 0;
+
+     clear_test_dir();
+     for (int i = 0; i < BENCH_PRESETS; i++) {
+         PresetData p = make_preset(i);
+         snprintf(names[i], sizeof(names[i]), "preset %04d", i);
+         snprintf(path, sizeof(path), "%s/%s%s", g_test_dir, names[i], PRESET_SUFFIX);
+         CU_ASSERT_FATAL(write_text_preset(path, &p, (i % 4 == 0) ? &pat : NULL));
+     }
+     CU_ASSERT_FATAL(presetbank_convert(g_test_dir, g_test_bank));
+
+     // Every preset by name, as the GUI or the control socket asks for them
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     for (int i = 0; i < BENCH_PRESETS; i++) {
+         snprintf(path, sizeof(path), "%s/%s%s", g_test_dir, names[i], PRESET_SUFFIX);
+         if (preset_file_read_with_pattern(path, &got, &got_pat)) {
+             text_ok++;
+             checksum_text += got.frequency1 + got_pat.length;
+         }
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     if (presetbank_open(&b, g_test_bank)) {
+         for (int i = 0; i < BENCH_PRESETS; i++) {
+             long index = presetbank_find(&b, names[i]);
+             if (index >= 0 && presetbank_get(&b, (size_t)index, &got, &got_pat)) {
+                 bank_ok++;
+                 checksum_bank += got.frequency1 + got_pat.length;
+             }
+         }
+         presetbank_close(&b);
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t2);
+     text_sec = seconds_between(&t0, &t1);
+     bank_sec = seconds_between(&t1, &t2);
+     printf("\n    Preset bank: %d presets by name, text files %.2f ms, bank %.3f ms (open included), %.0fx ",
+            BENCH_PRESETS, 1e3 * text_sec, 1e3 * bank_sec, text_sec / bank_sec);
+     CU_ASSERT_EQUAL(text_ok, BENCH_PRESETS);
+     CU_ASSERT_EQUAL(bank_ok, BENCH_PRESETS);
+     CU_ASSERT_DOUBLE_EQUAL(checksum_bank, checksum_text, 1e-6);
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("PresetBank_Tests", init_presetbank_suite, clean_presetbank_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_presetbank_round_trip", test_presetbank_round_trip)) ||
+          (NULL == CU_add_test(pSuite, "test_presetbank_convert_directory", test_presetbank_convert_directory)) ||
+          (NULL == CU_add_test(pSuite, "test_presetbank_is_current", test_presetbank_is_current)) ||
+          (NULL == CU_add_test(pSuite, "test_presetbank_rejects_damaged", test_presetbank_rejects_damaged)) ||
+          (NULL == CU_add_test(pSuite, "test_presetbank_load_benchmark", test_presetbank_load_benchmark))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
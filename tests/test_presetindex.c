@@ -0,0 +1,401 @@
+/**
+ * @file test_presetindex.c
+ * @brief Unit tests for the preset index (presetindex.c) using CUnit.
+ *
+ * Covers scans picking up new, changed and removed presets, the cache file
+ * round trip and rejection of damaged caches, re-parsing files changed too
+ * recently to trust their time, updating single entries as a directory
+ * watcher does, copying an index for another thread, and a benchmark of
+ * listing a large directory cold, from the cache, and after a few files
+ * changed.
+ */
+
+ #include <fcntl.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <sys/stat.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/presetindex.h"
+ #include "../synth/preset_file.h"
+ #include "../synth/midimap.h"
+ #include "test_bench.h"
+ #include "test_presets.h"
+
+ // --- Test Globals ---
+ #define BENCH_PRESETS 10000
+
+ /** @brief Directory of the suite's text presets. */
+ char g_test_dir[64];
+ /** @brief Path of the cache under test, outside the directory. */
+ char g_test_cache[64];
+
+ // --- Helper Functions ---
+
+ /** @brief Sets a file's time `age` seconds back, so scans trust it (see PRESETINDEX_RACY_SEC). */
+ static int age_file(const char *path, int age) {
+     struct timespec times[2];
+
+     clock_gettime(CLOCK_REALTIME, &times[0]);
+     times[0].tv_sec -= age;
+     times[1] = times[0];
+     return utimensat(AT_FDCWD, path, times, 0) == 0;
+ }
+
+ /** @brief Writes a text preset `name` of the suite's directory, `age` seconds old. */
+ static int put_preset(const char *name, int k, const SeqPattern *pat, int age) {
+     PresetData p = make_preset(k);
+     char path[128];
+
+     test_path(path, sizeof(path), name);
+     return write_text_preset(path, &p, pat) && age_file(path, age);
+ }
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_presetindex_suite(void) {
+     snprintf(g_test_dir, sizeof(g_test_dir), "/tmp/synth_test_presetindex_XXXXXX");
+     if (mkdtemp(g_test_dir) == NULL) return -1;
+     snprintf(g_test_cache, sizeof(g_test_cache), "%s.cache", g_test_dir);
+     return 0;
+ }
+
+ int clean_presetindex_suite(void) {
+     clear_test_dir();
+     rmdir(g_test_dir);
+     remove(g_test_cache);
+     return 0;
+ }
+
+ // --- Test Cases ---
+
+ void test_presetindex_scan_changes(void) {
+     PresetIndex idx;
+     PresetData got, want = make_preset(2);
+     SeqPattern pat = make_pattern(), got_pat;
+     const PresetIndexEntry *e;
+     char path[128];
+     FILE *f;
+
+     clear_test_dir();
+     CU_ASSERT_FATAL(put_preset("pad" PRESET_SUFFIX, 1, NULL, 100));
+     CU_ASSERT_FATAL(put_preset("bass" PRESET_SUFFIX, 2, &pat, 100));
+     CU_ASSERT_FATAL(put_preset("lead" PRESET_SUFFIX, 3, NULL, 100));
+     test_path(path, sizeof(path), "notes.txt");
+     f = fopen(path, "w");
+     CU_ASSERT_FATAL(f != NULL);
+     fclose(f);
+     // Incomplete: indexed as invalid
+     test_path(path, sizeof(path), "broken" PRESET_SUFFIX);
+     f = fopen(path, "w");
+     CU_ASSERT_FATAL(f != NULL);
+     fprintf(f, "frequency1: 440\n");
+     fclose(f);
+     CU_ASSERT_FATAL(age_file(path, 100));
+
+     presetindex_init(&idx);
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_EQUAL(idx.count, 4);
+     CU_ASSERT_EQUAL(idx.parsed, 4);
+     CU_ASSERT_EQUAL(idx.reused, 0);
+     CU_ASSERT(idx.dirty);
+     // Sorted by name
+     CU_ASSERT_STRING_EQUAL(idx.entries[0].name, "bass" PRESET_SUFFIX);
+     CU_ASSERT_STRING_EQUAL(idx.entries[1].name, "broken" PRESET_SUFFIX);
+     CU_ASSERT_STRING_EQUAL(idx.entries[2].name, "lead" PRESET_SUFFIX);
+     CU_ASSERT_STRING_EQUAL(idx.entries[3].name, "pad" PRESET_SUFFIX);
+     e = presetindex_find(&idx, "broken" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(e != NULL);
+     CU_ASSERT_FALSE(e->valid);
+     CU_ASSERT_PTR_NULL(presetindex_find(&idx, "notes.txt"));
+     CU_ASSERT(presetindex_get(&idx, "bass" PRESET_SUFFIX, &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &want));
+     CU_ASSERT(patterns_equal(&got_pat, &pat));
+     CU_ASSERT_FALSE(presetindex_get(&idx, "broken" PRESET_SUFFIX, &got, NULL));
+     CU_ASSERT_FALSE(presetindex_get(&idx, "missing" PRESET_SUFFIX, &got, NULL));
+
+     // Nothing changed: nothing parsed
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_EQUAL(idx.parsed, 0);
+     CU_ASSERT_EQUAL(idx.reused, 4);
+
+     // One changed, one added, one removed
+     CU_ASSERT_FATAL(put_preset("pad" PRESET_SUFFIX, 7, &pat, 50));
+     CU_ASSERT_FATAL(put_preset("arp" PRESET_SUFFIX, 8, NULL, 100));
+     test_path(path, sizeof(path), "lead" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(remove(path) == 0);
+     idx.dirty = 0;
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_EQUAL(idx.count, 4);
+     CU_ASSERT_EQUAL(idx.parsed, 2);
+     CU_ASSERT_EQUAL(idx.reused, 2);
+     CU_ASSERT_EQUAL(idx.removed, 1);
+     CU_ASSERT(idx.dirty);
+     CU_ASSERT_STRING_EQUAL(idx.entries[0].name, "arp" PRESET_SUFFIX);
+     CU_ASSERT_PTR_NULL(presetindex_find(&idx, "lead" PRESET_SUFFIX));
+     want = make_preset(7);
+     CU_ASSERT(presetindex_get(&idx, "pad" PRESET_SUFFIX, &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &want));
+     CU_ASSERT(patterns_equal(&got_pat, &pat));
+
+     // A file changed after the scan is read again on access
+     CU_ASSERT_FATAL(put_preset("arp" PRESET_SUFFIX, 9, NULL, 10));
+     want = make_preset(9);
+     CU_ASSERT(presetindex_get(&idx, "arp" PRESET_SUFFIX, &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &want));
+     CU_ASSERT_EQUAL(got_pat.length, 0);
+
+     CU_ASSERT_FALSE(presetindex_scan(&idx, "/nonexistent-dir"));
+     CU_ASSERT_EQUAL(idx.count, 4);
+     presetindex_free(&idx);
+     CU_ASSERT_EQUAL(idx.count, 0);
+ }
+
+ void test_presetindex_cache_round_trip(void) {
+     PresetIndex idx, loaded;
+     PresetData got, want = make_preset(4);
+     SeqPattern pat = make_pattern(), got_pat;
+     long size;
+     FILE *f;
+
+     clear_test_dir();
+     CU_ASSERT_FATAL(put_preset("a" PRESET_SUFFIX, 4, &pat, 100));
+     CU_ASSERT_FATAL(put_preset("b" PRESET_SUFFIX, 5, NULL, 100));
+     presetindex_init(&idx);
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_FATAL(presetindex_save(&idx, g_test_cache));
+     CU_ASSERT_FALSE(idx.dirty);
+     presetindex_free(&idx);
+
+     // Loaded, the cache answers the scan without parsing
+     presetindex_init(&loaded);
+     CU_ASSERT_FATAL(presetindex_load(&loaded, g_test_cache));
+     CU_ASSERT_EQUAL(loaded.count, 2);
+     CU_ASSERT_FATAL(presetindex_scan(&loaded, g_test_dir));
+     CU_ASSERT_EQUAL(loaded.parsed, 0);
+     CU_ASSERT_EQUAL(loaded.reused, 2);
+     CU_ASSERT_FALSE(loaded.dirty);
+     CU_ASSERT(presetindex_get(&loaded, "a" PRESET_SUFFIX, &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &want));
+     CU_ASSERT(patterns_equal(&got_pat, &pat));
+
+     // A cache of another directory is dropped by the scan
+     CU_ASSERT_FATAL(presetindex_scan(&loaded, "/"));
+     CU_ASSERT_EQUAL(loaded.count, 0);
+     presetindex_free(&loaded);
+
+     // Missing, cut short or not a cache: ignored, the index stays empty
+     CU_ASSERT_FALSE(presetindex_load(&loaded, "/nonexistent-dir/cache"));
+     f = fopen(g_test_cache, "r+b");
+     CU_ASSERT_FATAL(f != NULL);
+     fseek(f, 0, SEEK_END);
+     size = ftell(f);
+     fclose(f);
+     CU_ASSERT_EQUAL(truncate(g_test_cache, size - 1), 0);
+     CU_ASSERT_FALSE(presetindex_load(&loaded, g_test_cache));
+     CU_ASSERT_EQUAL(loaded.count, 0);
+     CU_ASSERT_PTR_NULL(loaded.dir);
+     f = fopen(g_test_cache, "r+b");
+     CU_ASSERT_FATAL(f != NULL);
+     fputs("SYNTHBNK", f);
+     fclose(f);
+     CU_ASSERT_FALSE(presetindex_load(&loaded, g_test_cache));
+     CU_ASSERT_EQUAL(loaded.count, 0);
+ }
+
+ void test_presetindex_racy_files(void) {
+     PresetIndex idx;
+     const PresetIndexEntry *e;
+
+     clear_test_dir();
+     CU_ASSERT_FATAL(put_preset("new" PRESET_SUFFIX, 1, NULL, 0));
+     CU_ASSERT_FATAL(put_preset("old" PRESET_SUFFIX, 2, NULL, 100));
+     presetindex_init(&idx);
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     e = presetindex_find(&idx, "new" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(e != NULL);
+     CU_ASSERT(e->racy);
+     CU_ASSERT_FALSE(presetindex_find(&idx, "old" PRESET_SUFFIX)->racy);
+
+     // Changed within the timestamp resolution, time and size may be the same:
+     // the recent file is parsed again, the old one is not
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_EQUAL(idx.parsed, 1);
+     CU_ASSERT_EQUAL(idx.reused, 1);
+
+     // Once its time is old enough it is trusted
+     CU_ASSERT_FATAL(put_preset("new" PRESET_SUFFIX, 1, NULL, 100));
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_EQUAL(idx.parsed, 1);
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_EQUAL(idx.parsed, 0);
+     CU_ASSERT_EQUAL(idx.reused, 2);
+     presetindex_free(&idx);
+ }
+
+ void test_presetindex_update_entries(void) {
+     PresetIndex idx;
+     PresetData got, want = make_preset(6);
+     char path[128];
+     size_t pos = 99;
+
+     clear_test_dir();
+     CU_ASSERT_FATAL(put_preset("b" PRESET_SUFFIX, 1, NULL, 100));
+     CU_ASSERT_FATAL(put_preset("d" PRESET_SUFFIX, 2, NULL, 100));
+     presetindex_init(&idx);
+     // Not scanned: no directory to look in
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "b" PRESET_SUFFIX, &pos), PRESETINDEX_UNCHANGED);
+     CU_ASSERT_EQUAL(idx.count, 0);
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+
+     // Added in order, as the combo rows are
+     CU_ASSERT_FATAL(put_preset("c" PRESET_SUFFIX, 6, NULL, 100));
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "c" PRESET_SUFFIX, &pos), PRESETINDEX_ADDED);
+     CU_ASSERT_EQUAL(pos, 1);
+     CU_ASSERT_FATAL(put_preset("a" PRESET_SUFFIX, 3, NULL, 100));
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "a" PRESET_SUFFIX, &pos), PRESETINDEX_ADDED);
+     CU_ASSERT_EQUAL(pos, 0);
+     CU_ASSERT_EQUAL(idx.count, 4);
+     for (size_t i = 1; i < idx.count; i++) CU_ASSERT(strcmp(idx.entries[i - 1].name, idx.entries[i].name) < 0);
+     CU_ASSERT(presetindex_get(&idx, "c" PRESET_SUFFIX, &got, NULL));
+     CU_ASSERT(presets_equal(&got, &want));
+
+     // Unchanged, then changed
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "d" PRESET_SUFFIX, &pos), PRESETINDEX_UNCHANGED);
+     CU_ASSERT_EQUAL(pos, 3);
+     CU_ASSERT_FATAL(put_preset("d" PRESET_SUFFIX, 6, NULL, 50));
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "d" PRESET_SUFFIX, &pos), PRESETINDEX_CHANGED);
+     CU_ASSERT_EQUAL(pos, 3);
+     CU_ASSERT_EQUAL(presetindex_find(&idx, "d" PRESET_SUFFIX)->preset.frequency1, want.frequency1);
+
+     // Removed: the position it had
+     test_path(path, sizeof(path), "b" PRESET_SUFFIX);
+     CU_ASSERT_FATAL(remove(path) == 0);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "b" PRESET_SUFFIX, &pos), PRESETINDEX_REMOVED);
+     CU_ASSERT_EQUAL(pos, 1);
+     CU_ASSERT_EQUAL(idx.count, 3);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "b" PRESET_SUFFIX, NULL), PRESETINDEX_UNCHANGED);
+
+     // Names a scan would not index
+     CU_ASSERT_FATAL(put_preset("notes.txt", 1, NULL, 100));
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "notes.txt", NULL), PRESETINDEX_UNCHANGED);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, "../b" PRESET_SUFFIX, NULL), PRESETINDEX_UNCHANGED);
+     CU_ASSERT_EQUAL(idx.count, 3);
+     presetindex_free(&idx);
+ }
+
+ void test_presetindex_copy(void) {
+     PresetIndex idx, copy;
+     PresetData got, want = make_preset(4);
+     SeqPattern pat = make_pattern(), got_pat;
+
+     clear_test_dir();
+     CU_ASSERT_FATAL(put_preset("a" PRESET_SUFFIX, 4, &pat, 100));
+     CU_ASSERT_FATAL(put_preset("b" PRESET_SUFFIX, 5, NULL, 100));
+     presetindex_init(&idx);
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_FATAL(presetindex_copy(&copy, &idx));
+     // The copy owns its entries: it outlives the original
+     presetindex_free(&idx);
+
+     CU_ASSERT_STRING_EQUAL(copy.dir, g_test_dir);
+     CU_ASSERT_EQUAL(copy.count, 2);
+     CU_ASSERT_EQUAL(copy.parsed, 2);
+     CU_ASSERT(copy.dirty);
+     CU_ASSERT(presetindex_get(&copy, "a" PRESET_SUFFIX, &got, &got_pat));
+     CU_ASSERT(presets_equal(&got, &want));
+     CU_ASSERT(patterns_equal(&got_pat, &pat));
+     CU_ASSERT_EQUAL(presetindex_find(&copy, "b" PRESET_SUFFIX)->pattern, NULL);
+     presetindex_free(&copy);
+
+     // An empty index copies to an empty one
+     CU_ASSERT_FATAL(presetindex_copy(&copy, &idx));
+     CU_ASSERT_EQUAL(copy.dir, NULL);
+     CU_ASSERT_EQUAL(copy.count, 0);
+     presetindex_free(&copy);
+ }
+
+ void test_presetindex_scan_benchmark(void) {
+     struct timespec t0, t1, t2, t3;
+     PresetIndex cold, warm;
+     SeqPattern pat = make_pattern();
+     char name[64];
+     double cold_sec, warm_sec, touched_sec;
+
+     clear_test_dir();
+     for (int i = 0; i < BENCH_PRESETS; i++) {
+         snprintf(name, sizeof(name), "preset %05d%s", i, PRESET_SUFFIX);
+         CU_ASSERT_FATAL(put_preset(name, i, (i % 4 == 0) ? &pat : NULL, 100));
+     }
+
+     // Cold: every file parsed, as without a cache
+     presetindex_init(&cold);
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     CU_ASSERT(presetindex_scan(&cold, g_test_dir));
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     CU_ASSERT_EQUAL(cold.parsed, BENCH_PRESETS);
+     CU_ASSERT_FATAL(presetindex_save(&cold, g_test_cache));
+     presetindex_free(&cold);
+
+     // Warm start: the cache loaded, then a scan that only stats
+     presetindex_init(&warm);
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     CU_ASSERT(presetindex_load(&warm, g_test_cache));
+     CU_ASSERT(presetindex_scan(&warm, g_test_dir));
+     clock_gettime(CLOCK_MONOTONIC, &t2);
+     CU_ASSERT_EQUAL(warm.parsed, 0);
+     CU_ASSERT_EQUAL(warm.reused, BENCH_PRESETS);
+
+     // A few files edited: only they are parsed
+     for (int i = 0; i < 10; i++) {
+         snprintf(name, sizeof(name), "preset %05d%s", i * 997, PRESET_SUFFIX);
+         CU_ASSERT_FATAL(put_preset(name, i + BENCH_PRESETS, NULL, 50));
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t2);
+     CU_ASSERT(presetindex_scan(&warm, g_test_dir));
+     clock_gettime(CLOCK_MONOTONIC, &t3);
+     CU_ASSERT_EQUAL(warm.parsed, 10);
+     CU_ASSERT_EQUAL(warm.reused, BENCH_PRESETS - 10);
+     presetindex_free(&warm);
+
+     cold_sec = seconds_between(&t0, &t1);
+     warm_sec = seconds_between(&t1, &t2);
+     touched_sec = seconds_between(&t2, &t3);
+     printf("\n    Preset index: %d presets, cold scan %.1f ms, warm start %.1f ms (%.1fx), 10 changed %.1f ms ",
+            BENCH_PRESETS, 1e3 * cold_sec, 1e3 * warm_sec, cold_sec / warm_sec, 1e3 * touched_sec);
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("PresetIndex_Tests", init_presetindex_suite, clean_presetindex_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_presetindex_scan_changes", test_presetindex_scan_changes)) ||
+          (NULL == CU_add_test(pSuite, "test_presetindex_cache_round_trip", test_presetindex_cache_round_trip)) ||
+          (NULL == CU_add_test(pSuite, "test_presetindex_racy_files", test_presetindex_racy_files)) ||
+          (NULL == CU_add_test(pSuite, "test_presetindex_update_entries", test_presetindex_update_entries)) ||
+          (NULL == CU_add_test(pSuite, "test_presetindex_copy", test_presetindex_copy)) ||
+          (NULL == CU_add_test(pSuite, "test_presetindex_scan_benchmark", test_presetindex_scan_benchmark))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
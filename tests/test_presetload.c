@@ -0,0 +1,263 @@
+/**
+ * @file test_presetload.c
+ * @brief Unit tests for the preset loader thread (presetload.c) using CUnit.
+ *
+ * Covers loading a preset on the worker while the requesting thread goes on
+ * (a FIFO stands in for a file system that takes its time), using the
+ * preset index's copy of an unchanged file, reporting unreadable files, and
+ * dropping loads a newer selection superseded.
+ */
+
+ #include <pthread.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <sys/stat.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/presetload.h"
+ #include "../synth/preset_file.h"
+ #include "test_notify.h"
+ #include "test_presets.h"
+
+ // --- Test Globals ---
+ #define TEST_WAIT_MS 3000       ///< Longest a test waits for a result.
+
+ /** @brief Directory of the suite's presets. */
+ char g_test_dir[64];
+
+ // --- Helper Functions ---
+
+ /** @brief Waits for a notify call and takes the result. @return 1 if one came within TEST_WAIT_MS. */
+ static int wait_result(PresetLoadResult *result) {
+     return wait_notify(TEST_WAIT_MS) && presetload_take(result);
+ }
+
+ /** @brief A request for the file `name` of the suite's directory. */
+ static PresetLoadRequest make_request(const char *name) {
+     PresetLoadRequest req;
+
+     memset(&req, 0, sizeof(req));
+     snprintf(req.name, sizeof(req.name), "%s", name);
+     test_path(req.path, sizeof(req.path), name);
+     return req;
+ }
+
+ /** @brief Writer end of a FIFO: blocks until the loader opens it, then writes a preset. */
+ static void *fifo_writer_main(void *arg) {
+     FILE *f = fopen((const char *)arg, "w");
+
+     if (f != NULL) {
+         PresetData p = make_preset_at(550.0);
+
+         write_preset_stream(f, &p, NULL);
+         fclose(f);
+     }
+     return NULL;
+ }
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_presetload_suite(void) {
+     snprintf(g_test_dir, sizeof(g_test_dir), "/tmp/synth_test_presetload_XXXXXX");
+     if (mkdtemp(g_test_dir) == NULL) return -1;
+     return presetload_start(on_notify, NULL) ? 0 : -1;
+ }
+
+ int clean_presetload_suite(void) {
+     char cmd[128];
+
+     presetload_stop();
+     snprintf(cmd, sizeof(cmd), "rm -rf %s", g_test_dir);
+     if (system(cmd) != 0) fprintf(stderr, "Warning: cannot remove %s\n", g_test_dir);
+     return 0;
+ }
+
+ // --- Test Cases ---
+
+ void test_presetload_reads_off_thread(void) {
+     PresetLoadRequest req = make_request("slow" PRESET_SUFFIX);
+     PresetLoadResult result;
+     pthread_t writer;
+     unsigned long serial;
+
+     g_notify_count = 0;
+     CU_ASSERT_FATAL(mkfifo(req.path, 0600) == 0);
+     // The read blocks until the FIFO has a writer; the request must not
+     serial = presetload_request(&req);
+     CU_ASSERT(serial > 0);
+     sleep_ms(50);
+     CU_ASSERT_FALSE(presetload_take(&result));
+     CU_ASSERT_EQUAL(g_notify_count, 0);
+
+     CU_ASSERT_FATAL(pthread_create(&writer, NULL, fifo_writer_main, req.path) == 0);
+     CU_ASSERT_FATAL(wait_result(&result));
+     pthread_join(writer, NULL);
+     CU_ASSERT(result.ok);
+     CU_ASSERT_FALSE(result.from_cache);
+     CU_ASSERT_EQUAL(result.serial, serial);
+     CU_ASSERT_STRING_EQUAL(result.name, "slow" PRESET_SUFFIX);
+     CU_ASSERT_EQUAL(result.preset.frequency1, 550.0);
+     CU_ASSERT_EQUAL(result.pattern.length, 0);
+     // Taken once
+     CU_ASSERT_FALSE(presetload_take(&result));
+     remove(req.path);
+ }
+
+ void test_presetload_uses_cached_copy(void) {
+     PresetLoadRequest req = make_request("cached" PRESET_SUFFIX);
+     PresetLoadResult result;
+     PresetLoadStats before, after;
+     struct stat st;
+
+     g_notify_count = 0;
+     CU_ASSERT_FATAL(put_preset_at("cached" PRESET_SUFFIX, 330.0));
+     CU_ASSERT_FATAL(stat(req.path, &st) == 0);
+     // The copy differs from the file, so the test sees which one was used
+     req.cached = 1;
+     req.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+     req.size = (uint64_t)st.st_size;
+     req.preset.frequency1 = 123.0;
+     seq_pattern_init(&req.pattern, 8);
+
+     presetload_get_stats(&before);
+     CU_ASSERT(presetload_request(&req) > 0);
+     CU_ASSERT_FATAL(wait_result(&result));
+     CU_ASSERT(result.ok);
+     CU_ASSERT(result.from_cache);
+     CU_ASSERT_EQUAL(result.preset.frequency1, 123.0);
+     CU_ASSERT_EQUAL(result.pattern.length, 8);
+     presetload_get_stats(&after);
+     CU_ASSERT_EQUAL(after.from_cache, before.from_cache + 1);
+
+     // Another size: the file changed since, so it is read
+     req.size++;
+     CU_ASSERT(presetload_request(&req) > 0);
+     CU_ASSERT_FATAL(wait_result(&result));
+     CU_ASSERT(result.ok);
+     CU_ASSERT_FALSE(result.from_cache);
+     CU_ASSERT_EQUAL(result.preset.frequency1, 330.0);
+     CU_ASSERT_EQUAL(result.pattern.length, 0);
+ }
+
+ void test_presetload_reports_failures(void) {
+     PresetLoadRequest req = make_request("missing" PRESET_SUFFIX);
+     PresetLoadResult result;
+     char path[128];
+     FILE *f;
+
+     g_notify_count = 0;
+     CU_ASSERT(presetload_request(&req) > 0);
+     CU_ASSERT_FATAL(wait_result(&result));
+     CU_ASSERT_FALSE(result.ok);
+     CU_ASSERT_STRING_EQUAL(result.path, req.path);
+
+     // Incomplete, and a cached copy of another time does not hide it
+     snprintf(path, sizeof(path), "%s/broken%s", g_test_dir, PRESET_SUFFIX);
+     f = fopen(path, "w");
+     CU_ASSERT_FATAL(f != NULL);
+     fprintf(f, "frequency1: 440\n");
+     fclose(f);
+     req = make_request("broken" PRESET_SUFFIX);
+     req.cached = 1;
+     req.mtime_ns = 1;
+     CU_ASSERT(presetload_request(&req) > 0);
+     CU_ASSERT_FATAL(wait_result(&result));
+     CU_ASSERT_FALSE(result.ok);
+     CU_ASSERT_FALSE(result.from_cache);
+ }
+
+ void test_presetload_latest_selection_wins(void) {
+     PresetLoadRequest slow = make_request("blocked" PRESET_SUFFIX);
+     PresetLoadRequest b = make_request("b" PRESET_SUFFIX), c = make_request("c" PRESET_SUFFIX);
+     PresetLoadResult result;
+     PresetLoadStats before, after;
+     pthread_t writer;
+     unsigned long serial;
+
+     g_notify_count = 0;
+     CU_ASSERT_FATAL(put_preset_at("b" PRESET_SUFFIX, 200.0));
+     CU_ASSERT_FATAL(put_preset_at("c" PRESET_SUFFIX, 300.0));
+     CU_ASSERT_FATAL(mkfifo(slow.path, 0600) == 0);
+     presetload_get_stats(&before);
+
+     // The first load hangs in the FIFO while the user moves on through two more
+     CU_ASSERT(presetload_request(&slow) > 0);
+     sleep_ms(50);
+     CU_ASSERT(presetload_request(&b) > 0);
+     serial = presetload_request(&c);
+     CU_ASSERT(serial > 0);
+     CU_ASSERT_FATAL(pthread_create(&writer, NULL, fifo_writer_main, slow.path) == 0);
+
+     // Only the last selection arrives
+     CU_ASSERT_FATAL(wait_result(&result));
+     pthread_join(writer, NULL);
+     CU_ASSERT(result.ok);
+     CU_ASSERT_EQUAL(result.serial, serial);
+     CU_ASSERT_STRING_EQUAL(result.name, "c" PRESET_SUFFIX);
+     CU_ASSERT_EQUAL(result.preset.frequency1, 300.0);
+     sleep_ms(50);
+     CU_ASSERT_FALSE(presetload_take(&result));
+     CU_ASSERT_EQUAL(g_notify_count, 0);
+     presetload_get_stats(&after);
+     // b replaced before it started, the blocked load dropped when it finished
+     CU_ASSERT_EQUAL(after.superseded, before.superseded + 2);
+     CU_ASSERT_EQUAL(after.loads, before.loads + 2);
+     remove(slow.path);
+ }
+
+ void test_presetload_start_stop(void) {
+     PresetLoadRequest req = make_request("b" PRESET_SUFFIX);
+     PresetLoadResult result;
+
+     presetload_stop();
+     presetload_stop(); // Not running: nothing to do
+     CU_ASSERT_EQUAL(presetload_request(&req), 0);
+
+     // Without a notify function results are polled for
+     CU_ASSERT_FATAL(presetload_start(NULL, NULL));
+     CU_ASSERT(presetload_start(NULL, NULL));
+     CU_ASSERT(presetload_request(&req) > 0);
+     for (int i = 0; i < TEST_WAIT_MS / 10 && !presetload_take(&result); i++) sleep_ms(10);
+     CU_ASSERT(result.ok);
+     CU_ASSERT_STRING_EQUAL(result.name, "b" PRESET_SUFFIX);
+
+     // A result not taken is dropped by the stop
+     CU_ASSERT(presetload_request(&req) > 0);
+     sleep_ms(50);
+     presetload_stop();
+     CU_ASSERT_FALSE(presetload_take(&result));
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("PresetLoad_Tests", init_presetload_suite, clean_presetload_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_presetload_reads_off_thread", test_presetload_reads_off_thread)) ||
+          (NULL == CU_add_test(pSuite, "test_presetload_uses_cached_copy", test_presetload_uses_cached_copy)) ||
+          (NULL == CU_add_test(pSuite, "test_presetload_reports_failures", test_presetload_reports_failures)) ||
+          (NULL == CU_add_test(pSuite, "test_presetload_latest_selection_wins", test_presetload_latest_selection_wins)) ||
+          (NULL == CU_add_test(pSuite, "test_presetload_start_stop", test_presetload_start_stop))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
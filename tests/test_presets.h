@@ -0,0 +1,131 @@
+/**
+ * @file test_presets.h
+ * @brief Preset fixtures shared by the preset tests.
+ *
+ * Presets and patterns to write, comparisons of what was read back, and
+ * text presets written as the GUI saves them into the suite's directory,
+ * g_test_dir, which each suite defines and creates.
+ */
+
+ #ifndef TEST_PRESETS_H
+ #define TEST_PRESETS_H
+
+ #include <stdio.h>
+ #include <stdlib.h>
+
+ #include "../synth/preset_file.h"
+ #include "../synth/sequencer.h"
+ #include "../synth/midimap.h"
+
+ /** @brief Directory of the suite's presets, defined by the suite. */
+ extern char g_test_dir[64];
+
+ /** @brief A preset whose values all derive from `k`. */
+ static inline PresetData make_preset(int k) {
+     PresetData p = {
+         .frequency1 = 100.0 + k, .amplitude1 = 0.5, .waveform1 = (WaveformType)(k % 4),
+         .attackTime1 = 0.01 * (k % 7), .decayTime1 = 0.1, .sustainLevel1 = 0.7, .releaseTime1 = 0.3 + 0.001 * k,
+         .frequency2 = 200.0 + k, .amplitude2 = 0.25, .waveform2 = (WaveformType)((k + 1) % 4),
+         .attackTime2 = 0.05, .decayTime2 = 0.2, .sustainLevel2 = 0.5, .releaseTime2 = 0.5
+     };
+     return p;
+ }
+
+ /** @brief A pattern with notes, a rest that only locks, and locks on a note. */
+ static inline SeqPattern make_pattern(void) {
+     SeqPattern pat;
+
+     seq_pattern_init(&pat, 16);
+     pat.rate = 3.0;
+     pat.steps[0].note = 60; pat.steps[0].velocity = 100; pat.steps[0].gate = 0.5;
+     pat.steps[3].note = 67; pat.steps[3].velocity = 90; pat.steps[3].gate = 0.25;
+     pat.steps[3].locks = 2;
+     pat.steps[3].lock[0].param = SYNTH_PARAM_RELEASE1; pat.steps[3].lock[0].value = 0.05;
+     pat.steps[3].lock[1].param = SYNTH_PARAM_AMP2; pat.steps[3].lock[1].value = 0.2;
+     pat.steps[15].locks = 1;
+     pat.steps[15].lock[0].param = SYNTH_PARAM_FREQ1; pat.steps[15].lock[0].value = 330.0;
+     return pat;
+ }
+
+ static inline int presets_equal(const PresetData *a, const PresetData *b) {
+     return a->frequency1 == b->frequency1 && a->amplitude1 == b->amplitude1 && a->waveform1 == b->waveform1 &&
+            a->attackTime1 == b->attackTime1 && a->decayTime1 == b->decayTime1 && a->sustainLevel1 == b->sustainLevel1 &&
+            a->releaseTime1 == b->releaseTime1 && a->frequency2 == b->frequency2 && a->amplitude2 == b->amplitude2 &&
+            a->waveform2 == b->waveform2 && a->attackTime2 == b->attackTime2 && a->decayTime2 == b->decayTime2 &&
+            a->sustainLevel2 == b->sustainLevel2 && a->releaseTime2 == b->releaseTime2;
+ }
+
+ static inline int patterns_equal(const SeqPattern *a, const SeqPattern *b) {
+     if (a->length != b->length || a->rate != b->rate) return 0;
+     for (int i = 0; i < a->length; i++) {
+         const SeqStep *x = &a->steps[i], *y = &b->steps[i];
+         if (x->note != y->note || x->velocity != y->velocity || x->gate != y->gate || x->locks != y->locks) return 0;
+         for (int l = 0; l < x->locks; l++) {
+             if (x->lock[l].param != y->lock[l].param || x->lock[l].value != y->lock[l].value) return 0;
+         }
+     }
+     return 1;
+ }
+
+ /** @brief make_preset(0) with wave 1 at `frequency`. */
+ static inline PresetData make_preset_at(double frequency) {
+     PresetData p = make_preset(0);
+
+     p.frequency1 = frequency;
+     return p;
+ }
+
+ /** @brief Formats the 14 parameters of `p` as the GUI saves them. @return 1 if they fit in `size` bytes. */
+ static inline int format_text_preset(char *buf, size_t size, const PresetData *p) {
+     int n = snprintf(buf, size,
+                      "frequency1: %.17g\namplitude1: %.17g\nwaveform1: %d\nattackTime1: %.17g\ndecayTime1: %.17g\n"
+                      "sustainLevel1: %.17g\nreleaseTime1: %.17g\nfrequency2: %.17g\namplitude2: %.17g\nwaveform2: %d\n"
+                      "attackTime2: %.17g\ndecayTime2: %.17g\nsustainLevel2: %.17g\nreleaseTime2: %.17g\n",
+                      p->frequency1, p->amplitude1, (int)p->waveform1, p->attackTime1, p->decayTime1, p->sustainLevel1,
+                      p->releaseTime1, p->frequency2, p->amplitude2, (int)p->waveform2, p->attackTime2, p->decayTime2,
+                      p->sustainLevel2, p->releaseTime2);
+     return n > 0 && (size_t)n < size;
+ }
+
+ /** @brief Writes a text preset to an open stream: the parameters, then the pattern if there is one. */
+ static inline int write_preset_stream(FILE *f, const PresetData *p, const SeqPattern *pat) {
+     char text[1024];
+
+     if (!format_text_preset(text, sizeof(text), p) || fputs(text, f) == EOF) return 0;
+     return pat == NULL || preset_file_write_pattern(f, pat);
+ }
+
+ /** @brief Writes a text preset as the GUI saves it. */
+ static inline int write_text_preset(const char *path, const PresetData *p, const SeqPattern *pat) {
+     FILE *f = fopen(path, "w");
+     int ok;
+
+     if (f == NULL) return 0;
+     ok = write_preset_stream(f, p, pat);
+     if (fclose(f) != 0) ok = 0;
+     return ok;
+ }
+
+ /** @brief Path of a file in the suite's directory. */
+ static inline void test_path(char *path, size_t size, const char *name) {
+     snprintf(path, size, "%s/%s", g_test_dir, name);
+ }
+
+ /** @brief Writes make_preset_at(`frequency`) as the file `name` of the suite's directory. */
+ static inline int put_preset_at(const char *name, double frequency) {
+     PresetData p = make_preset_at(frequency);
+     char path[128];
+
+     test_path(path, sizeof(path), name);
+     return write_text_preset(path, &p, NULL);
+ }
+
+ /** @brief Removes every file of the suite's directory. */
+ static inline void clear_test_dir(void) {
+     char cmd[128];
+
+     snprintf(cmd, sizeof(cmd), "rm -f %s/*", g_test_dir);
+     if (system(cmd) != 0) fprintf(stderr, "Warning: cannot clear %s\n", g_test_dir);
+ }
+
+ #endif // TEST_PRESETS_H
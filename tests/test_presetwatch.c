@@ -0,0 +1,209 @@
+/**
+ * @file test_presetwatch.c
+ * @brief Unit tests for the preset directory watcher (presetwatch.c) using CUnit.
+ *
+ * Covers files added, renamed and removed reaching the preset index through
+ * batches, other files being ignored, a burst of writes arriving as one
+ * batch of unique names, and starting and stopping.
+ */
+
+ #include <pthread.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/presetwatch.h"
+ #include "../synth/presetindex.h"
+ #include "../synth/preset_file.h"
+ #include "test_notify.h"
+ #include "test_presets.h"
+
+ // --- Test Globals ---
+ #define TEST_DEBOUNCE_MS 50
+ #define TEST_WAIT_MS 3000       ///< Longest a test waits for a batch.
+ #define BURST_FILES 200
+
+ /** @brief Directory the suite watches. */
+ char g_test_dir[64];
+
+ // --- Helper Functions ---
+
+ /** @brief Waits for a notify call and takes its batch. @return 1 if one came within TEST_WAIT_MS. */
+ static int wait_batch(PresetWatchBatch *batch) {
+     return wait_notify(TEST_WAIT_MS) && presetwatch_take(batch);
+ }
+
+ static int move_file(const char *from, const char *to) {
+     char a[128], b[128];
+
+     test_path(a, sizeof(a), from);
+     test_path(b, sizeof(b), to);
+     return rename(a, b) == 0;
+ }
+
+ static int remove_file(const char *name) {
+     char path[128];
+
+     test_path(path, sizeof(path), name);
+     return remove(path) == 0;
+ }
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_presetwatch_suite(void) {
+     snprintf(g_test_dir, sizeof(g_test_dir), "/tmp/synth_test_presetwatch_XXXXXX");
+     return (mkdtemp(g_test_dir) == NULL) ? -1 : 0;
+ }
+
+ int clean_presetwatch_suite(void) {
+     char cmd[128];
+
+     presetwatch_stop();
+     snprintf(cmd, sizeof(cmd), "rm -rf %s", g_test_dir);
+     if (system(cmd) != 0) fprintf(stderr, "Warning: cannot remove %s\n", g_test_dir);
+     return 0;
+ }
+
+ // --- Test Cases ---
+
+ void test_presetwatch_reports_changes(void) {
+     PresetIndex idx;
+     PresetWatchBatch batch;
+     size_t pos;
+
+     presetindex_init(&idx);
+     CU_ASSERT_FATAL(put_preset_at("keep" PRESET_SUFFIX, 110.0));
+     CU_ASSERT_FATAL(presetindex_scan(&idx, g_test_dir));
+     CU_ASSERT_EQUAL(idx.count, 1);
+     g_notify_count = 0;
+     CU_ASSERT_FATAL(presetwatch_start(g_test_dir, TEST_DEBOUNCE_MS, on_notify, NULL));
+     CU_ASSERT_FALSE(presetwatch_take(&batch));
+     CU_ASSERT_EQUAL(batch.count, 0);
+
+     // A new preset; other files are not reported
+     CU_ASSERT_FATAL(put_preset_at("notes.txt", 1.0));
+     CU_ASSERT_FATAL(put_preset_at("lead" PRESET_SUFFIX, 440.0));
+     CU_ASSERT_FATAL(wait_batch(&batch));
+     CU_ASSERT_FALSE(batch.rescan);
+     CU_ASSERT_EQUAL_FATAL(batch.count, 1);
+     CU_ASSERT_STRING_EQUAL(batch.names[0], "lead" PRESET_SUFFIX);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, batch.names[0], &pos), PRESETINDEX_ADDED);
+     CU_ASSERT_EQUAL(pos, 1);
+     presetwatch_batch_free(&batch);
+     CU_ASSERT_EQUAL(batch.count, 0);
+
+     // A rename reports both names: one goes, one comes
+     CU_ASSERT_FATAL(move_file("lead" PRESET_SUFFIX, "bass" PRESET_SUFFIX));
+     CU_ASSERT_FATAL(wait_batch(&batch));
+     CU_ASSERT_EQUAL_FATAL(batch.count, 2);
+     CU_ASSERT_STRING_EQUAL(batch.names[0], "bass" PRESET_SUFFIX);
+     CU_ASSERT_STRING_EQUAL(batch.names[1], "lead" PRESET_SUFFIX);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, batch.names[0], &pos), PRESETINDEX_ADDED);
+     CU_ASSERT_EQUAL(pos, 0);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, batch.names[1], &pos), PRESETINDEX_REMOVED);
+     CU_ASSERT_EQUAL(pos, 2);
+     presetwatch_batch_free(&batch);
+
+     // Written in place, then deleted
+     CU_ASSERT_FATAL(put_preset_at("keep" PRESET_SUFFIX, 330.0));
+     CU_ASSERT_FATAL(wait_batch(&batch));
+     CU_ASSERT_EQUAL_FATAL(batch.count, 1);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, batch.names[0], NULL), PRESETINDEX_CHANGED);
+     CU_ASSERT_EQUAL(presetindex_find(&idx, "keep" PRESET_SUFFIX)->preset.frequency1, 330.0);
+     presetwatch_batch_free(&batch);
+     CU_ASSERT_FATAL(remove_file("bass" PRESET_SUFFIX));
+     CU_ASSERT_FATAL(wait_batch(&batch));
+     CU_ASSERT_EQUAL_FATAL(batch.count, 1);
+     CU_ASSERT_EQUAL(presetindex_update(&idx, batch.names[0], NULL), PRESETINDEX_REMOVED);
+     presetwatch_batch_free(&batch);
+
+     CU_ASSERT_EQUAL(idx.count, 1);
+     CU_ASSERT_STRING_EQUAL(idx.entries[0].name, "keep" PRESET_SUFFIX);
+     presetwatch_stop();
+     presetindex_free(&idx);
+ }
+
+ void test_presetwatch_debounces_bursts(void) {
+     PresetWatchBatch batch;
+     PresetWatchStats stats;
+     char name[64];
+
+     g_notify_count = 0;
+     CU_ASSERT_FATAL(presetwatch_start(g_test_dir, TEST_DEBOUNCE_MS, on_notify, NULL));
+     // Every file written twice, as a sync job copying then fixing up would
+     for (int pass = 0; pass < 2; pass++) {
+         for (int i = 0; i < BURST_FILES; i++) {
+             snprintf(name, sizeof(name), "burst %03d%s", i, PRESET_SUFFIX);
+             CU_ASSERT_FATAL(put_preset_at(name, 100.0 + i + pass));
+         }
+     }
+     CU_ASSERT_FATAL(wait_batch(&batch));
+     CU_ASSERT_FALSE(batch.rescan);
+     CU_ASSERT_EQUAL(batch.count, BURST_FILES);
+     for (size_t i = 1; i < batch.count; i++) CU_ASSERT(strcmp(batch.names[i - 1], batch.names[i]) < 0);
+     presetwatch_batch_free(&batch);
+
+     // Quiet afterwards: nothing more comes
+     sleep_ms(4 * TEST_DEBOUNCE_MS);
+     CU_ASSERT_FALSE(presetwatch_take(&batch));
+     presetwatch_get_stats(&stats);
+     printf("\n    Preset watcher: %lu events in %lu batch(es) ", stats.events, stats.batches);
+     CU_ASSERT(stats.events >= 2 * BURST_FILES);
+     CU_ASSERT_EQUAL(stats.batches, 1);
+     presetwatch_stop();
+ }
+
+ void test_presetwatch_start_stop(void) {
+     PresetWatchBatch batch;
+
+     presetwatch_stop(); // Not running: nothing to do
+     CU_ASSERT_FALSE(presetwatch_start("/nonexistent-dir", TEST_DEBOUNCE_MS, on_notify, NULL));
+     CU_ASSERT_FATAL(presetwatch_start(g_test_dir, TEST_DEBOUNCE_MS, NULL, NULL));
+     CU_ASSERT(presetwatch_start(g_test_dir, TEST_DEBOUNCE_MS, NULL, NULL));
+
+     // Without a notify function batches are polled for
+     CU_ASSERT_FATAL(put_preset_at("polled" PRESET_SUFFIX, 220.0));
+     for (int i = 0; i < TEST_WAIT_MS / 10 && !presetwatch_take(&batch); i++) sleep_ms(10);
+     CU_ASSERT_EQUAL_FATAL(batch.count, 1);
+     CU_ASSERT_STRING_EQUAL(batch.names[0], "polled" PRESET_SUFFIX);
+     presetwatch_batch_free(&batch);
+
+     // Changes not taken are dropped by the stop
+     CU_ASSERT_FATAL(remove_file("polled" PRESET_SUFFIX));
+     sleep_ms(4 * TEST_DEBOUNCE_MS);
+     presetwatch_stop();
+     CU_ASSERT_FALSE(presetwatch_take(&batch));
+     presetwatch_stop();
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("PresetWatch_Tests", init_presetwatch_suite, clean_presetwatch_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_presetwatch_reports_changes", test_presetwatch_reports_changes)) ||
+          (NULL == CU_add_test(pSuite, "test_presetwatch_debounces_bursts", test_presetwatch_debounces_bursts)) ||
+          (NULL == CU_add_test(pSuite, "test_presetwatch_start_stop", test_presetwatch_start_stop))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,211 @@
+/**
+ * @file test_resampler.c
+ * @brief Unit tests for the polyphase sinc resampler (resampler.c) using CUnit.
+ *
+ * Checks conversion accuracy on a pure tone, alias rejection when
+ * downsampling, exact pass-through at equal rates, that the output does not
+ * depend on how the stream is split into blocks, and prints the cost per
+ * output sample of each quality level.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <time.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/resampler.h"
+ #include "test_bench.h"
+
+ #ifndef M_PI
+ #define M_PI 3.14159265358979323846
+ #endif
+
+ // --- Test Globals ---
+ #define TEST_FRAMES 4096
+ /** @brief Converter under test. */
+ Resampler g_test_rs;
+ /** @brief Output buffer. */
+ float g_test_out[TEST_FRAMES];
+
+ /**
+  * @struct ToneSource
+  * @brief Pull source producing a sine tone and counting the samples pulled.
+  */
+ typedef struct {
+     double freq, rate;
+     unsigned long index;
+ } ToneSource;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_resampler_suite(void) {
+     return 0;
+ }
+
+ int clean_resampler_suite(void) {
+     resampler_free(&g_test_rs);
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief ResamplerPullFn producing the next samples of the tone. */
+ int pull_tone(void *ctx, float *in, unsigned long frames) {
+     ToneSource *src = (ToneSource *)ctx;
+     for (unsigned long i = 0; i < frames; i++, src->index++) {
+         in[i] = (float)sin(2.0 * M_PI * src->freq * src->index / src->rate);
+     }
+     return 0;
+ }
+
+ /** @brief ResamplerPullFn that always fails. */
+ int pull_fail(void *ctx, float *in, unsigned long frames) {
+     (void)ctx; (void)in; (void)frames;
+     return -1;
+ }
+
+ /**
+  * @brief Converts a 1 kHz tone and returns the largest deviation from the ideal tone at the output rate.
+  */
+ double tone_error(double in_rate, double out_rate, ResamplerQuality quality) {
+     ToneSource src = { 1000.0, in_rate, 0 };
+     double max_err = 0.0;
+
+     CU_ASSERT_FATAL(resampler_init(&g_test_rs, in_rate, out_rate, quality));
+     CU_ASSERT_EQUAL(resampler_process(&g_test_rs, g_test_out, TEST_FRAMES, pull_tone, &src), 0);
+     // The filter is zero-phase: output n lies exactly at input time n * in_rate / out_rate
+     for (unsigned long n = g_test_rs.taps; n < TEST_FRAMES; n++) {
+         double ideal = sin(2.0 * M_PI * 1000.0 * n / out_rate);
+         double err = fabs(g_test_out[n] - ideal);
+         if (err > max_err) max_err = err;
+     }
+     resampler_free(&g_test_rs);
+     return max_err;
+ }
+
+ // --- Test Functions ---
+
+ void test_resampler_tone_accuracy(void) {
+     CU_ASSERT(tone_error(44100.0, 48000.0, RESAMPLER_QUALITY_HIGH) < 1e-3);
+     CU_ASSERT(tone_error(48000.0, 44100.0, RESAMPLER_QUALITY_HIGH) < 1e-3);
+     CU_ASSERT(tone_error(44100.0, 96000.0, RESAMPLER_QUALITY_MEDIUM) < 1e-2);
+     CU_ASSERT(tone_error(44100.0, 48000.0, RESAMPLER_QUALITY_LOW) < 5e-2);
+ }
+
+ void test_resampler_ratio_and_latency(void) {
+     ToneSource src = { 1000.0, 44100.0, 0 };
+     CU_ASSERT_FATAL(resampler_init(&g_test_rs, 44100.0, 48000.0, RESAMPLER_QUALITY_HIGH));
+     CU_ASSERT_EQUAL(g_test_rs.up, 160);
+     CU_ASSERT_EQUAL(g_test_rs.down, 147);
+     CU_ASSERT_EQUAL(g_test_rs.taps % 4, 0);
+     CU_ASSERT_DOUBLE_EQUAL(resampler_latency(&g_test_rs), 32.0 / 44100.0, 1e-9);
+
+     // 48000 outputs consume 44100 inputs plus the half filter rendered ahead
+     for (int i = 0; i < 48000 / TEST_FRAMES; i++) {
+         resampler_process(&g_test_rs, g_test_out, TEST_FRAMES, pull_tone, &src);
+     }
+     double consumed = (48000 / TEST_FRAMES) * TEST_FRAMES * 44100.0 / 48000.0;
+     CU_ASSERT(src.index >= consumed);
+     CU_ASSERT(src.index <= consumed + g_test_rs.taps + 1);
+     resampler_free(&g_test_rs);
+
+     CU_ASSERT_EQUAL(resampler_init(&g_test_rs, 44100.0, 0.0, RESAMPLER_QUALITY_HIGH), 0);
+     CU_ASSERT_EQUAL(resampler_init(&g_test_rs, 44100.0, 47999.0, RESAMPLER_QUALITY_HIGH), 0);
+ }
+
+ void test_resampler_rejects_aliases(void) {
+     // 23 kHz is above the 22.05 kHz output Nyquist and must not fold back into the audio band
+     ToneSource src = { 23000.0, 48000.0, 0 };
+     double energy = 0.0;
+     CU_ASSERT_FATAL(resampler_init(&g_test_rs, 48000.0, 44100.0, RESAMPLER_QUALITY_HIGH));
+     resampler_process(&g_test_rs, g_test_out, TEST_FRAMES, pull_tone, &src);
+     for (unsigned long n = g_test_rs.taps; n < TEST_FRAMES; n++) energy += g_test_out[n] * g_test_out[n];
+     CU_ASSERT(sqrt(energy / (TEST_FRAMES - g_test_rs.taps)) < 1e-3);
+     resampler_free(&g_test_rs);
+ }
+
+ void test_resampler_equal_rates_pass_through(void) {
+     ToneSource src = { 1000.0, 48000.0, 0 };
+     CU_ASSERT_FATAL(resampler_init(&g_test_rs, 48000.0, 48000.0, RESAMPLER_QUALITY_HIGH));
+     resampler_process(&g_test_rs, g_test_out, TEST_FRAMES, pull_tone, &src);
+     for (unsigned long n = 0; n < TEST_FRAMES; n++) {
+         if (g_test_out[n] != (float)sin(2.0 * M_PI * 1000.0 * n / 48000.0)) {
+             CU_FAIL("sample differs from input");
+             break;
+         }
+     }
+     resampler_free(&g_test_rs);
+ }
+
+ void test_resampler_block_size_independent(void) {
+     static float whole[TEST_FRAMES];
+     ToneSource src1 = { 440.0, 44100.0, 0 }, src2 = { 440.0, 44100.0, 0 };
+     unsigned long done = 0, chunk = 1;
+
+     CU_ASSERT_FATAL(resampler_init(&g_test_rs, 44100.0, 48000.0, RESAMPLER_QUALITY_MEDIUM));
+     resampler_process(&g_test_rs, whole, TEST_FRAMES, pull_tone, &src1);
+     resampler_reset(&g_test_rs);
+     while (done < TEST_FRAMES) {
+         unsigned long n = (done + chunk > TEST_FRAMES) ? TEST_FRAMES - done : chunk;
+         resampler_process(&g_test_rs, g_test_out + done, n, pull_tone, &src2);
+         done += n;
+         chunk = chunk * 3 % 509 + 1; // Irregular block sizes
+     }
+     CU_ASSERT_EQUAL(memcmp(whole, g_test_out, sizeof(whole)), 0);
+     CU_ASSERT_EQUAL(src1.index, src2.index);
+     resampler_free(&g_test_rs);
+ }
+
+ void test_resampler_pull_failure(void) {
+     CU_ASSERT_FATAL(resampler_init(&g_test_rs, 44100.0, 48000.0, RESAMPLER_QUALITY_LOW));
+     g_test_out[10] = 1.0f;
+     CU_ASSERT_EQUAL(resampler_process(&g_test_rs, g_test_out, 64, pull_fail, NULL), -1);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_out[10], 0.0, 1e-9);
+     resampler_free(&g_test_rs);
+ }
+
+ void test_resampler_benchmark(void) {
+     ResamplerQuality q;
+     for (q = RESAMPLER_QUALITY_LOW; q <= RESAMPLER_QUALITY_HIGH; q++) {
+         ToneSource src = { 1000.0, 44100.0, 0 };
+         struct timespec t0, t1;
+         const int blocks = 200;
+         CU_ASSERT_FATAL(resampler_init(&g_test_rs, 44100.0, 48000.0, q));
+         clock_gettime(CLOCK_MONOTONIC, &t0);
+         for (int i = 0; i < blocks; i++) resampler_process(&g_test_rs, g_test_out, TEST_FRAMES, pull_tone, &src);
+         clock_gettime(CLOCK_MONOTONIC, &t1);
+         double ns = 1e9 * seconds_between(&t0, &t1) / ((double)blocks * TEST_FRAMES);
+         printf("\n  resampler bench 44100->48000 %-6s taps=%u: %.1f ns/sample (incl. sin() source), latency %.2f ms",
+                resampler_quality_name(q), g_test_rs.taps, ns, 1000.0 * resampler_latency(&g_test_rs));
+         resampler_free(&g_test_rs);
+     }
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("Resampler_Tests", init_resampler_suite, clean_resampler_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_resampler_tone_accuracy", test_resampler_tone_accuracy)) ||
+          (NULL == CU_add_test(pSuite, "test_resampler_ratio_and_latency", test_resampler_ratio_and_latency)) ||
+          (NULL == CU_add_test(pSuite, "test_resampler_rejects_aliases", test_resampler_rejects_aliases)) ||
+          (NULL == CU_add_test(pSuite, "test_resampler_equal_rates_pass_through", test_resampler_equal_rates_pass_through)) ||
+          (NULL == CU_add_test(pSuite, "test_resampler_block_size_independent", test_resampler_block_size_independent)) ||
+          (NULL == CU_add_test(pSuite, "test_resampler_pull_failure", test_resampler_pull_failure)) ||
+          (NULL == CU_add_test(pSuite, "test_resampler_benchmark", test_resampler_benchmark))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
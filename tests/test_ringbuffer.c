@@ -0,0 +1,137 @@
+/**
+ * @file test_ringbuffer.c
+ * @brief Unit tests for the lock-free SPSC ring buffer (ringbuffer.c) using CUnit.
+ *
+ * Covers capacity rounding, partial reads/writes, wrap-around and a threaded
+ * producer/consumer run that checks every sample arrives exactly once and in order.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/ringbuffer.h"
+
+ // --- Test Globals ---
+ /** @brief Samples pushed through the ring by the threaded test. */
+ #define STRESS_SAMPLES 2000000
+ /** @brief Ring under test. */
+ RingBuffer g_test_ring;
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_ringbuffer_suite(void) {
+     return 0;
+ }
+
+ int clean_ringbuffer_suite(void) {
+     ringbuffer_free(&g_test_ring);
+     return 0;
+ }
+
+ // --- Test Functions ---
+
+ void test_ringbuffer_capacity_rounding(void) {
+     CU_ASSERT_FATAL(ringbuffer_init(&g_test_ring, 1000));
+     CU_ASSERT_EQUAL(g_test_ring.capacity, 1024);
+     CU_ASSERT_EQUAL(ringbuffer_read_available(&g_test_ring), 0);
+     CU_ASSERT_EQUAL(ringbuffer_write_available(&g_test_ring), 1024);
+     ringbuffer_free(&g_test_ring);
+     CU_ASSERT_EQUAL(ringbuffer_init(&g_test_ring, 0), 0);
+ }
+
+ void test_ringbuffer_partial_and_full(void) {
+     float in[20], out[20];
+     for (int i = 0; i < 20; i++) in[i] = (float)i;
+     CU_ASSERT_FATAL(ringbuffer_init(&g_test_ring, 16));
+
+     CU_ASSERT_EQUAL(ringbuffer_write(&g_test_ring, in, 20), 16); // Only 16 fit
+     CU_ASSERT_EQUAL(ringbuffer_write(&g_test_ring, in, 1), 0);
+     CU_ASSERT_EQUAL(ringbuffer_read(&g_test_ring, out, 10), 10);
+     CU_ASSERT_EQUAL(memcmp(in, out, 10 * sizeof(float)), 0);
+     CU_ASSERT_EQUAL(ringbuffer_read_available(&g_test_ring), 6);
+     CU_ASSERT_EQUAL(ringbuffer_read(&g_test_ring, out, 20), 6); // Only 6 left
+     CU_ASSERT_DOUBLE_EQUAL(out[0], 10.0, 1e-9);
+     CU_ASSERT_EQUAL(ringbuffer_read(&g_test_ring, out, 1), 0);
+     ringbuffer_free(&g_test_ring);
+ }
+
+ void test_ringbuffer_wraparound(void) {
+     float in[12], out[12];
+     CU_ASSERT_FATAL(ringbuffer_init(&g_test_ring, 16));
+     for (int round = 0; round < 10; round++) {
+         for (int i = 0; i < 12; i++) in[i] = (float)(round * 100 + i);
+         CU_ASSERT_EQUAL(ringbuffer_write(&g_test_ring, in, 12), 12);
+         CU_ASSERT_EQUAL(ringbuffer_read(&g_test_ring, out, 12), 12);
+         CU_ASSERT_EQUAL(memcmp(in, out, sizeof(in)), 0);
+     }
+     ringbuffer_reset(&g_test_ring);
+     CU_ASSERT_EQUAL(ringbuffer_read_available(&g_test_ring), 0);
+     ringbuffer_free(&g_test_ring);
+ }
+
+ /**
+  * @brief Producer thread: writes 0..STRESS_SAMPLES-1 in uneven chunks.
+  */
+ void *ringbuffer_producer(void *arg) {
+     RingBuffer *rb = (RingBuffer *)arg;
+     float chunk[37];
+     int next = 0;
+     while (next < STRESS_SAMPLES) {
+         int n = 0;
+         while (n < 37 && next + n < STRESS_SAMPLES) { chunk[n] = (float)(next + n); n++; }
+         size_t written = ringbuffer_write(rb, chunk, (size_t)n);
+         next += (int)written;
+         if (written == 0) sched_yield();
+     }
+     return NULL;
+ }
+
+ void test_ringbuffer_threaded_spsc(void) {
+     pthread_t producer;
+     float chunk[53];
+     int expected = 0, errors = 0;
+     CU_ASSERT_FATAL(ringbuffer_init(&g_test_ring, 256));
+     CU_ASSERT_FATAL(pthread_create(&producer, NULL, ringbuffer_producer, &g_test_ring) == 0);
+
+     while (expected < STRESS_SAMPLES) {
+         size_t got = ringbuffer_read(&g_test_ring, chunk, 53);
+         for (size_t i = 0; i < got; i++) {
+             if (chunk[i] != (float)expected) errors++;
+             expected++;
+         }
+         if (got == 0) sched_yield();
+     }
+     pthread_join(producer, NULL);
+
+     CU_ASSERT_EQUAL(errors, 0);
+     CU_ASSERT_EQUAL(ringbuffer_read_available(&g_test_ring), 0);
+     ringbuffer_free(&g_test_ring);
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("RingBuffer_Tests", init_ringbuffer_suite, clean_ringbuffer_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_ringbuffer_capacity_rounding", test_ringbuffer_capacity_rounding)) ||
+          (NULL == CU_add_test(pSuite, "test_ringbuffer_partial_and_full", test_ringbuffer_partial_and_full)) ||
+          (NULL == CU_add_test(pSuite, "test_ringbuffer_wraparound", test_ringbuffer_wraparound)) ||
+          (NULL == CU_add_test(pSuite, "test_ringbuffer_threaded_spsc", test_ringbuffer_threaded_spsc))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
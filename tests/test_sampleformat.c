@@ -0,0 +1,235 @@
+/**
+ * @file test_sampleformat.c
+ * @brief Unit tests for the integer output conversion (sampleformat.c) using CUnit.
+ *
+ * Checks rounding, clipping and 24-bit packing, that TPDF dither stays within
+ * +-1 LSB and linearises signals below one LSB, that noise shaping moves the
+ * noise out of the low band, that the output does not depend on how the
+ * stream is split into blocks (vector vs. scalar path), and prints the cost
+ * per sample of each conversion.
+ */
+
+ #include <stdio.h>
+ #include <stdint.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <time.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/sampleformat.h"
+ #include "test_bench.h"
+
+ #ifndef M_PI
+ #define M_PI 3.14159265358979323846
+ #endif
+
+ // --- Test Globals ---
+ #define TEST_FRAMES 8192
+ /** @brief Converter under test. */
+ SampleConverter g_test_conv;
+ /** @brief Float input block. */
+ float g_test_in[TEST_FRAMES];
+ /** @brief 16-bit output block. */
+ int16_t g_test_out16[TEST_FRAMES];
+ /** @brief Packed 24-bit output block. */
+ unsigned char g_test_out24[3 * TEST_FRAMES];
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_sampleformat_suite(void) {
+     return 0;
+ }
+
+ int clean_sampleformat_suite(void) {
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief Fills the input with a constant. */
+ void fill_const(float value) {
+     for (int i = 0; i < TEST_FRAMES; i++) g_test_in[i] = value;
+ }
+
+ /** @brief Decodes a packed little-endian 24-bit sample. */
+ int32_t read24(const unsigned char *b) {
+     int32_t v = (int32_t)b[0] | ((int32_t)b[1] << 8) | ((int32_t)b[2] << 16);
+     return (v & 0x800000) ? v - 0x1000000 : v;
+ }
+
+ /** @brief RMS (in LSB) of the means of 64-sample blocks of the 16-bit output: the noise below ~375 Hz at 48 kHz. */
+ double lowband_rms16(void) {
+     double sum = 0.0;
+     for (int b = 0; b < TEST_FRAMES / 64; b++) {
+         double mean = 0.0;
+         for (int k = 0; k < 64; k++) mean += g_test_out16[64 * b + k];
+         mean /= 64.0;
+         sum += mean * mean;
+     }
+     return sqrt(sum / (TEST_FRAMES / 64));
+ }
+
+ // --- Test Functions ---
+
+ void test_sampleformat_rounding_and_clipping(void) {
+     const float values[] = { 0.0f, 0.5f, -0.5f, 1.0f, -1.0f, 1.5f, -1.5f, 100.4f / 32768.0f, -100.6f / 32768.0f };
+     int16_t out[9];
+     unsigned char out24[27];
+
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT16, DITHER_NONE, 1);
+     sample_convert(&g_test_conv, values, out, 9);
+     CU_ASSERT_EQUAL(out[0], 0);
+     CU_ASSERT_EQUAL(out[1], 16384);
+     CU_ASSERT_EQUAL(out[2], -16384);
+     CU_ASSERT_EQUAL(out[3], 32767);  // +1.0 clips to the largest code
+     CU_ASSERT_EQUAL(out[4], -32768);
+     CU_ASSERT_EQUAL(out[5], 32767);
+     CU_ASSERT_EQUAL(out[6], -32768);
+     CU_ASSERT_EQUAL(out[7], 100);
+     CU_ASSERT_EQUAL(out[8], -101);
+
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT24, DITHER_NONE, 1);
+     sample_convert(&g_test_conv, values, out24, 9);
+     CU_ASSERT_EQUAL(out24[3], 0x00); CU_ASSERT_EQUAL(out24[4], 0x00); CU_ASSERT_EQUAL(out24[5], 0x40);
+     CU_ASSERT_EQUAL(read24(out24 + 6), -4194304);
+     CU_ASSERT_EQUAL(read24(out24 + 9), 8388607);
+     CU_ASSERT_EQUAL(read24(out24 + 12), -8388608);
+     CU_ASSERT_EQUAL(read24(out24 + 21), 25702); // 100.4 * 256 = 25702.4
+
+     CU_ASSERT_EQUAL(sample_format_bytes(SAMPLE_FORMAT_INT24), 3);
+     CU_ASSERT_STRING_EQUAL(dither_mode_name(DITHER_SHAPED), "shaped");
+ }
+
+ void test_sampleformat_float_passthrough(void) {
+     float out[4];
+     const float values[4] = { 0.1f, -0.2f, 1.5f, -3.0f };
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_FLOAT32, DITHER_TPDF, 1);
+     sample_convert(&g_test_conv, values, out, 4);
+     CU_ASSERT_EQUAL(memcmp(out, values, sizeof(values)), 0);
+ }
+
+ void test_sampleformat_tpdf_bounds_and_linearity(void) {
+     double mean = 0.0;
+     int min = 0, max = 0;
+
+     // Silence becomes triangular noise of at most +-1 LSB around zero
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT16, DITHER_TPDF, 7);
+     fill_const(0.0f);
+     sample_convert(&g_test_conv, g_test_in, g_test_out16, TEST_FRAMES);
+     for (int i = 0; i < TEST_FRAMES; i++) {
+         if (g_test_out16[i] < min) min = g_test_out16[i];
+         if (g_test_out16[i] > max) max = g_test_out16[i];
+         mean += g_test_out16[i];
+     }
+     CU_ASSERT(min >= -1 && max <= 1);
+     CU_ASSERT(min == -1 && max == 1);
+     CU_ASSERT(fabs(mean / TEST_FRAMES) < 0.05);
+
+     // A quarter LSB survives on average instead of rounding away
+     fill_const(0.25f / 32768.0f);
+     sample_convert(&g_test_conv, g_test_in, g_test_out16, TEST_FRAMES);
+     mean = 0.0;
+     for (int i = 0; i < TEST_FRAMES; i++) mean += g_test_out16[i];
+     CU_ASSERT_DOUBLE_EQUAL(mean / TEST_FRAMES, 0.25, 0.05);
+ }
+
+ void test_sampleformat_noise_shaping_moves_noise_up(void) {
+     double flat, shaped;
+     fill_const(0.0f);
+
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT16, DITHER_TPDF, 3);
+     sample_convert(&g_test_conv, g_test_in, g_test_out16, TEST_FRAMES);
+     flat = lowband_rms16();
+
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT16, DITHER_SHAPED, 3);
+     sample_convert(&g_test_conv, g_test_in, g_test_out16, TEST_FRAMES);
+     shaped = lowband_rms16();
+
+     // (1 - z^-1)^2 shaping leaves almost no noise at low frequencies
+     CU_ASSERT(shaped < flat * 0.25);
+
+     // Full-scale input clips without the error feedback running away
+     fill_const(1.0f);
+     sample_convert(&g_test_conv, g_test_in, g_test_out16, TEST_FRAMES);
+     fill_const(0.0f);
+     sample_convert(&g_test_conv, g_test_in, g_test_out16, 64);
+     CU_ASSERT(abs(g_test_out16[63]) < 16);
+ }
+
+ void test_sampleformat_block_size_independent(void) {
+     static int16_t whole[TEST_FRAMES];
+     static unsigned char whole24[3 * TEST_FRAMES];
+     unsigned long done = 0, chunk = 1;
+
+     for (int i = 0; i < TEST_FRAMES; i++) g_test_in[i] = (float)(0.3 * sin(2.0 * M_PI * 440.0 * i / 48000.0));
+
+     // One call uses the vector path, odd chunks mostly the scalar one
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT16, DITHER_TPDF, 11);
+     sample_convert(&g_test_conv, g_test_in, whole, TEST_FRAMES);
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT16, DITHER_TPDF, 11);
+     while (done < TEST_FRAMES) {
+         unsigned long n = (done + chunk > TEST_FRAMES) ? TEST_FRAMES - done : chunk;
+         sample_convert(&g_test_conv, g_test_in + done, g_test_out16 + done, n);
+         done += n;
+         chunk = chunk * 3 % 37 + 1;
+     }
+     CU_ASSERT_EQUAL(memcmp(whole, g_test_out16, sizeof(whole)), 0);
+
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT24, DITHER_TPDF, 11);
+     sample_convert(&g_test_conv, g_test_in, whole24, TEST_FRAMES);
+     sample_converter_init(&g_test_conv, SAMPLE_FORMAT_INT24, DITHER_TPDF, 11);
+     for (done = 0; done < TEST_FRAMES; done += 5) {
+         unsigned long n = (done + 5 > TEST_FRAMES) ? TEST_FRAMES - done : 5;
+         sample_convert(&g_test_conv, g_test_in + done, g_test_out24 + 3 * done, n);
+     }
+     CU_ASSERT_EQUAL(memcmp(whole24, g_test_out24, sizeof(whole24)), 0);
+ }
+
+ void test_sampleformat_benchmark(void) {
+     static const struct { SampleFormat format; DitherMode dither; } cases[] = {
+         { SAMPLE_FORMAT_INT16, DITHER_NONE }, { SAMPLE_FORMAT_INT16, DITHER_TPDF }, { SAMPLE_FORMAT_INT16, DITHER_SHAPED },
+         { SAMPLE_FORMAT_INT24, DITHER_TPDF }, { SAMPLE_FORMAT_INT24, DITHER_SHAPED },
+     };
+     const int blocks = 500;
+
+     for (int i = 0; i < TEST_FRAMES; i++) g_test_in[i] = (float)(0.5 * sin(2.0 * M_PI * 1000.0 * i / 48000.0));
+     for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+         struct timespec t0, t1;
+         void *out = (cases[c].format == SAMPLE_FORMAT_INT16) ? (void *)g_test_out16 : (void *)g_test_out24;
+         sample_converter_init(&g_test_conv, cases[c].format, cases[c].dither, 1);
+         clock_gettime(CLOCK_MONOTONIC, &t0);
+         for (int b = 0; b < blocks; b++) sample_convert(&g_test_conv, g_test_in, out, TEST_FRAMES);
+         clock_gettime(CLOCK_MONOTONIC, &t1);
+         double ns = 1e9 * seconds_between(&t0, &t1) / ((double)blocks * TEST_FRAMES);
+         // Share of a 64-frame period at 48 kHz (1.33 ms) spent converting
+         printf("\n  sampleformat bench %s/%-6s: %.2f ns/sample, %.3f%% of a 64-frame 48 kHz period",
+                sample_format_name(cases[c].format), dither_mode_name(cases[c].dither), ns, 100.0 * ns * 64 / (64 / 48000.0 * 1e9));
+     }
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("Sample_Format_Tests", init_sampleformat_suite, clean_sampleformat_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_sampleformat_rounding_and_clipping", test_sampleformat_rounding_and_clipping)) ||
+          (NULL == CU_add_test(pSuite, "test_sampleformat_float_passthrough", test_sampleformat_float_passthrough)) ||
+          (NULL == CU_add_test(pSuite, "test_sampleformat_tpdf_bounds_and_linearity", test_sampleformat_tpdf_bounds_and_linearity)) ||
+          (NULL == CU_add_test(pSuite, "test_sampleformat_noise_shaping_moves_noise_up", test_sampleformat_noise_shaping_moves_noise_up)) ||
+          (NULL == CU_add_test(pSuite, "test_sampleformat_block_size_independent", test_sampleformat_block_size_independent)) ||
+          (NULL == CU_add_test(pSuite, "test_sampleformat_benchmark", test_sampleformat_benchmark))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
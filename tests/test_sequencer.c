@@ -0,0 +1,350 @@
+/**
+ * @file test_sequencer.c
+ * @brief Unit tests for the step sequencer (sequencer.c), its preset storage and the engine playing it using CUnit.
+ *
+ * Covers the step grid and gates, rests, looping and replacing a pattern on
+ * the grid, writing and reading a pattern with a preset, and in the rendered
+ * output the sample each step starts and ends on, parameter locks lasting one
+ * step, that renders with different block sizes match, and the render thread
+ * rendering further ahead while only the sequencer plays.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <math.h>
+ #include <unistd.h>
+ #include <pthread.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/sequencer.h"
+ #include "../synth/preset_file.h"
+ #include "../synth/midi.h"
+ #include "../synth/audio.h"
+ #include "../synth/audio_internal.h"
+ #include "../synth/lookahead.h"
+ #include "../synth/config.h"
+ #include "test_engine.h"
+ #include "test_presets.h"
+
+ // --- Test Globals ---
+ #define TEST_SAMPLE_RATE 44100.0
+ #define STEP_FRAMES 5512.5       ///< Sixteenth notes at 120 BPM and 44.1 kHz: the grid alternates 5512 and 5513 frames.
+ #define RENDER_FRAMES 44100      ///< 1 s: eight steps.
+ #define TEST_PRESET_PATH "/tmp/synth_test_sequencer.synthpreset"
+
+ /** @brief Sequencer under test. */
+ Sequencer g_test_seq;
+ /** @brief Pattern under test. */
+ SeqPattern g_test_pattern;
+ /** @brief Two renders of the same pattern. */
+ float g_test_render[2][RENDER_FRAMES];
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_sequencer_suite(void) {
+     return 0;
+ }
+
+ int clean_sequencer_suite(void) {
+     audio_seq_set_pattern(NULL);
+     audio_set_config(NULL);
+     audio_midi_reset();
+     remove(TEST_PRESET_PATH);
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief Sets a step of g_test_pattern. */
+ static void set_step(int i, int note, int velocity, double gate) {
+     g_test_pattern.steps[i].note = (uint8_t)note;
+     g_test_pattern.steps[i].velocity = (uint8_t)velocity;
+     g_test_pattern.steps[i].gate = gate;
+ }
+
+ /** @brief Adds a parameter lock to a step of g_test_pattern. */
+ static void add_lock(int i, SynthParam param, double value) {
+     SeqStep *step = &g_test_pattern.steps[i];
+     step->lock[step->locks].param = param;
+     step->lock[step->locks++].value = value;
+ }
+
+ /** @brief Resets the sequencer at 120 BPM on a 44.1 kHz grid and gives it g_test_pattern from `frame`. */
+ static void seq_setup(uint64_t frame) {
+     seq_init(&g_test_seq, 120.0);
+     seq_set_sample_rate(&g_test_seq, TEST_SAMPLE_RATE);
+     seq_set_pattern(&g_test_seq, &g_test_pattern, frame);
+ }
+
+ /** @brief Sets up wave 1 as a square at full sustain without attack or release, wave 2 silent, and the sequencer on. */
+ static void setup_engine(double sampleRate, double prerender_ms) {
+     AudioConfig cfg = AUDIO_CONFIG_DEFAULTS;
+
+     test_engine_init_data(WAVE_SQUARE, sampleRate);
+     cfg.tempo = 120.0;
+     cfg.sequencer = 1;
+     cfg.seqPrerenderMs = prerender_ms;
+     audio_set_config(&cfg);
+     audio_midi_reset();
+     audio_seq_set_pattern(&g_test_pattern);
+ }
+
+
+ // --- Test Functions ---
+
+ void test_seq_steps_and_gates(void) {
+     SeqEvent ev;
+
+     seq_pattern_init(&g_test_pattern, 4);
+     set_step(0, 60, 100, 0.5);
+     set_step(2, 64, 90, 1.0);
+     add_lock(3, SYNTH_PARAM_AMP1, 0.2);
+     seq_init(&g_test_seq, 120.0);
+     CU_ASSERT_FALSE(seq_playing(&g_test_seq));
+     CU_ASSERT_EQUAL(seq_next_frame(&g_test_seq), SEQ_NEVER);
+     seq_setup(0);
+     CU_ASSERT(seq_playing(&g_test_seq));
+
+     // Step 0 plays for half a step
+     CU_ASSERT_FATAL(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_EQUAL(ev.frame, 0);
+     CU_ASSERT_PTR_EQUAL(ev.step, &g_test_seq.pattern.steps[0]);
+     CU_ASSERT_EQUAL(ev.note, 60);
+     CU_ASSERT(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_PTR_NULL(ev.step);
+     CU_ASSERT_EQUAL(ev.frame, 2756);
+     CU_ASSERT_EQUAL(ev.note, 60);
+     // A rest is still a step, without a note off
+     CU_ASSERT(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_EQUAL(ev.frame, 5513);
+     CU_ASSERT_EQUAL(ev.step->velocity, 0);
+     // Gate 1 is legato: the note off shares its frame with the next step and comes first
+     CU_ASSERT(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_EQUAL(ev.frame, 11025);
+     CU_ASSERT_EQUAL(ev.note, 64);
+     CU_ASSERT(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_PTR_NULL(ev.step);
+     CU_ASSERT_EQUAL(ev.frame, 16538);
+     CU_ASSERT(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_EQUAL(ev.frame, 16538);
+     CU_ASSERT_EQUAL(ev.step->locks, 1);
+     // And around again: step k of the grid plays step k % 4, at round(k * 5512.5)
+     for (int k = 4; k < 400; k++) {
+         do {
+             CU_ASSERT_FATAL(seq_next(&g_test_seq, &ev));
+         } while (ev.step == NULL);
+         CU_ASSERT_EQUAL(ev.frame, (uint64_t)llround(k * STEP_FRAMES));
+         CU_ASSERT_PTR_EQUAL(ev.step, &g_test_seq.pattern.steps[k % 4]);
+     }
+ }
+
+ void test_seq_replacing_the_pattern(void) {
+     SeqEvent ev;
+
+     seq_pattern_init(&g_test_pattern, 4);
+     for (int i = 0; i < 4; i++) set_step(i, 60 + i, 100, 0.5);
+     // A pattern set between steps starts on the next step of the grid, at its place in the bar
+     seq_setup(10000);
+     CU_ASSERT_EQUAL(seq_next_frame(&g_test_seq), 11025);
+     CU_ASSERT(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_EQUAL(ev.note, 62);
+
+     // The note playing still ends at its gate when the pattern is replaced or stopped
+     g_test_pattern.length = 0;
+     seq_set_pattern(&g_test_seq, &g_test_pattern, 12000);
+     CU_ASSERT_FALSE(seq_playing(&g_test_seq));
+     CU_ASSERT(seq_next(&g_test_seq, &ev));
+     CU_ASSERT_PTR_NULL(ev.step);
+     CU_ASSERT_EQUAL(ev.frame, 11025 + 2756);
+     CU_ASSERT_FALSE(seq_next(&g_test_seq, &ev));
+
+     // Out of range lengths and rates are clamped
+     g_test_pattern.length = 100;
+     g_test_pattern.rate = 0.0;
+     seq_set_pattern(&g_test_seq, &g_test_pattern, 0);
+     CU_ASSERT_EQUAL(g_test_seq.pattern.length, SEQ_MAX_STEPS);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_seq.pattern.rate, SEQ_DEFAULT_RATE, 1e-9);
+ }
+
+ void test_seq_preset_round_trip(void) {
+     PresetData params = make_preset_at(220.0), preset;
+     SeqPattern read;
+
+     seq_pattern_init(&g_test_pattern, 16);
+     g_test_pattern.rate = 3.0;
+     set_step(0, 48, 127, 0.25);
+     add_lock(0, SYNTH_PARAM_RELEASE1, 0.05);
+     add_lock(0, SYNTH_PARAM_AMP2, 0.125);
+     set_step(15, 72, 64, 1.0);
+     add_lock(7, SYNTH_PARAM_FREQ2, 660.0);
+
+     CU_ASSERT_FATAL(write_text_preset(TEST_PRESET_PATH, &params, &g_test_pattern));
+
+     CU_ASSERT_FATAL(preset_file_read_with_pattern(TEST_PRESET_PATH, &preset, &read));
+     CU_ASSERT_DOUBLE_EQUAL(preset.frequency1, 220.0, 1e-9);
+     CU_ASSERT_EQUAL(read.length, 16);
+     CU_ASSERT_DOUBLE_EQUAL(read.rate, 3.0, 1e-9);
+     CU_ASSERT_EQUAL(read.steps[0].note, 48);
+     CU_ASSERT_EQUAL(read.steps[0].velocity, 127);
+     CU_ASSERT_DOUBLE_EQUAL(read.steps[0].gate, 0.25, 1e-6);
+     CU_ASSERT_EQUAL_FATAL(read.steps[0].locks, 2);
+     CU_ASSERT_EQUAL(read.steps[0].lock[0].param, SYNTH_PARAM_RELEASE1);
+     CU_ASSERT_DOUBLE_EQUAL(read.steps[0].lock[0].value, 0.05, 1e-6);
+     CU_ASSERT_EQUAL(read.steps[0].lock[1].param, SYNTH_PARAM_AMP2);
+     CU_ASSERT_EQUAL(read.steps[7].velocity, 0);
+     CU_ASSERT_EQUAL(read.steps[7].locks, 1);
+     CU_ASSERT_DOUBLE_EQUAL(read.steps[7].lock[0].value, 660.0, 1e-6);
+     CU_ASSERT_EQUAL(read.steps[15].note, 72);
+     CU_ASSERT_EQUAL(read.steps[3].velocity, 0);
+     CU_ASSERT_EQUAL(read.steps[3].locks, 0);
+     // The plain reader accepts the pattern lines
+     CU_ASSERT(preset_file_read(TEST_PRESET_PATH, &preset));
+
+     // A preset without a pattern has length 0
+     CU_ASSERT(preset_file_read_with_pattern("presets/SquareBassPluck.synthpreset", &preset, &read));
+     CU_ASSERT_EQUAL(read.length, 0);
+
+     // Steps past the length, unknown parameters and too many locks make the load fail
+     const char *bad[] = { "seqLength: 4\nstep5: 60 100 0.5\n",
+                           "seqLength: 4\nstep1: 60 100 0.5 volume=1\n",
+                           "seqLength: 4\nstep1: 60 100 0.5 amp1=1 amp1=1 amp1=1 amp1=1 amp1=1\n",
+                           "seqLength: 4\nstep1: 60 200 0.5\n",
+                           "seqLength: 65\n" };
+     for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+         FILE *fp = fopen(TEST_PRESET_PATH, "w");
+
+         CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+         CU_ASSERT(write_preset_stream(fp, &params, NULL));
+         fputs(bad[i], fp);
+         fclose(fp);
+         CU_ASSERT_FALSE(preset_file_read_with_pattern(TEST_PRESET_PATH, &preset, &read));
+     }
+ }
+
+ void test_seq_engine_plays_on_exact_samples(void) {
+     AudioStats before, after;
+
+     seq_pattern_init(&g_test_pattern, 2);
+     set_step(0, 69, 127, 0.5);
+     setup_engine(TEST_SAMPLE_RATE, 0.0);
+     audio_get_stats(&before);
+     render_blocks(g_test_render[0], RENDER_FRAMES, 256);
+
+     // Every other step sounds from its frame for half a step (2756 frames), silence until the next
+     for (int k = 0; k < 8; k += 2) {
+         uint64_t on = (uint64_t)llround(k * STEP_FRAMES), off = on + 2756;
+         CU_ASSERT(fabsf(g_test_render[0][on]) > 0.4f);
+         CU_ASSERT(fabsf(g_test_render[0][off - 1]) > 0.4f);
+         CU_ASSERT_EQUAL(g_test_render[0][off], 0.0f);
+         if (k > 0) CU_ASSERT_EQUAL(g_test_render[0][on - 1], 0.0f);
+     }
+     audio_get_stats(&after);
+     CU_ASSERT_EQUAL(after.seqSteps - before.seqSteps, 8);
+
+     // Without the sequencer configured the pattern is kept but not played
+     audio_set_config(NULL);
+     audio_midi_reset();
+     render_blocks(g_test_render[0], 8192, 256);
+     for (int i = 0; i < 8192; i++) CU_ASSERT_EQUAL_FATAL(g_test_render[0][i], 0.0f);
+     audio_seq_get_pattern(&g_test_pattern);
+     CU_ASSERT_EQUAL(g_test_pattern.length, 2);
+ }
+
+ void test_seq_engine_locks_last_one_step(void) {
+     static const unsigned long blocks[2] = { 256, 97 };
+
+     seq_pattern_init(&g_test_pattern, 2);
+     set_step(0, 69, 127, 0.5);
+     set_step(1, 69, 127, 0.5);
+     add_lock(0, SYNTH_PARAM_AMP1, 0.25);
+     // The same pattern rendered twice from a reset, with different block boundaries
+     for (int run = 0; run < 2; run++) {
+         setup_engine(TEST_SAMPLE_RATE, 0.0);
+         render_blocks(g_test_render[run], RENDER_FRAMES, blocks[run]);
+     }
+     CU_ASSERT_EQUAL(memcmp(g_test_render[0], g_test_render[1], sizeof(g_test_render[0])), 0);
+
+     // Step 0 plays at the locked amplitude, step 1 at the GUI's again
+     for (int k = 0; k < 8; k++) {
+         float level = fabsf(g_test_render[0][llround(k * STEP_FRAMES) + 10]);
+         if (k % 2 == 0) CU_ASSERT(level > 0.2f && level < 0.3f);
+         else CU_ASSERT(level > 0.4f);
+     }
+     // Locks are not written to the shared data
+     CU_ASSERT_DOUBLE_EQUAL(g_test_synth_data.amplitude, 0.5, 1e-9);
+ }
+
+ void test_seq_engine_prerenders_when_idle(void) {
+     const double rate = 8000.0;
+     const unsigned long lookahead = 512, prerender = 800; // 100 ms at 8 kHz
+     float block[256];
+     unsigned long read = 0;
+     AudioStats st;
+     MidiEvent note = { .type = MIDI_EVENT_NOTE_ON, .data1 = 60, .data2 = 100 };
+
+     seq_pattern_init(&g_test_pattern, 4);
+     set_step(0, 57, 100, 0.5);
+     setup_engine(rate, 100.0);
+     audio_stats_reset("portaudio");
+     CU_ASSERT_FATAL(lookahead_start(&g_test_synth_data, lookahead, lookahead + prerender));
+
+     // Play through a little over a second of engine frames without input
+     while (read < (unsigned long)(1.5 * rate)) {
+         read += lookahead_read(block, 256);
+         usleep(2000);
+     }
+     usleep(50000);
+     audio_get_stats(&st);
+     CU_ASSERT_EQUAL(st.seqPrerendering, 1);
+     CU_ASSERT(st.seqPrerenders >= 1);
+     lookahead_read(block, 256);
+     audio_get_stats(&st);
+     CU_ASSERT(st.lookaheadFill > lookahead + prerender / 2);
+
+     // Input stops it: the ring drains back to the lookahead as the device reads
+     note.frame = 0;
+     CU_ASSERT(audio_midi_schedule(&note));
+     for (int i = 0; i < 20; i++) {
+         lookahead_read(block, 256);
+         usleep(2000);
+     }
+     audio_get_stats(&st);
+     CU_ASSERT_EQUAL(st.seqPrerendering, 0);
+     CU_ASSERT(st.lookaheadFill <= lookahead + 64);
+
+     lookahead_stop();
+     audio_midi_reset();
+ }
+
+ // --- Main Test Runner Function ---
+
+ int main() {
+     CU_pSuite pSuite = NULL;
+
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+
+     pSuite = CU_add_suite("Sequencer_Tests", init_sequencer_suite, clean_sequencer_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_seq_steps_and_gates", test_seq_steps_and_gates)) ||
+          (NULL == CU_add_test(pSuite, "test_seq_replacing_the_pattern", test_seq_replacing_the_pattern)) ||
+          (NULL == CU_add_test(pSuite, "test_seq_preset_round_trip", test_seq_preset_round_trip)) ||
+          (NULL == CU_add_test(pSuite, "test_seq_engine_plays_on_exact_samples", test_seq_engine_plays_on_exact_samples)) ||
+          (NULL == CU_add_test(pSuite, "test_seq_engine_locks_last_one_step", test_seq_engine_locks_last_one_step)) ||
+          (NULL == CU_add_test(pSuite, "test_seq_engine_prerenders_when_idle", test_seq_engine_prerenders_when_idle))
+        )
+     {
+         CU_cleanup_registry();
+         return CU_get_error();
+     }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
@@ -0,0 +1,174 @@
+/**
+ * @file test_sidechain.c
+ * @brief Unit tests for the audio-input modulator (sidechain.c) using CUnit.
+ *
+ * Feeds synthetic input and output blocks through each mode and checks the
+ * ring modulator's product, the follower's attack and release, that the
+ * vocoder only passes carrier energy where the modulator has energy, and
+ * prints the cost per sample of the vocoder.
+ */
+
+ #include <stdio.h>
+ #include <math.h>
+ #include <time.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/sidechain.h"
+ #include "test_bench.h"
+
+ #ifndef M_PI
+ #define M_PI 3.14159265358979323846
+ #endif
+
+ // --- Test Globals ---
+ #define TEST_RATE 48000.0
+ #define TEST_FRAMES 4800
+ /** @brief Modulator under test. */
+ Sidechain g_test_sc;
+ /** @brief Input (modulator) block. */
+ float g_test_in[TEST_FRAMES];
+ /** @brief Output (carrier) block, modulated in place. */
+ float g_test_out[TEST_FRAMES];
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_sidechain_suite(void) {
+     return 0;
+ }
+
+ int clean_sidechain_suite(void) {
+     return 0;
+ }
+
+ // --- Helper Functions ---
+
+ /** @brief Fills `buf` with a sine tone of the given frequency and amplitude. */
+ void fill_tone(float *buf, double freq, double amp) {
+     for (int i = 0; i < TEST_FRAMES; i++) buf[i] = (float)(amp * sin(2.0 * M_PI * freq * i / TEST_RATE));
+ }
+
+ /** @brief Fills `buf` with a constant value. */
+ void fill_const(float *buf, float value) {
+     for (int i = 0; i < TEST_FRAMES; i++) buf[i] = value;
+ }
+
+ /** @brief RMS of the second half of a block (after the filters have settled). */
+ double tail_rms(const float *buf) {
+     double sum = 0.0;
+     for (int i = TEST_FRAMES / 2; i < TEST_FRAMES; i++) sum += buf[i] * buf[i];
+     return sqrt(sum / (TEST_FRAMES / 2));
+ }
+
+ /** @brief Runs `blocks` vocoder blocks of a carrier tone against a modulator tone, returning the last block's RMS. */
+ double vocode(double carrier_hz, double modulator_hz, double modulator_amp, int blocks) {
+     CU_ASSERT_FATAL(sidechain_init(&g_test_sc, SIDECHAIN_VOCODER, TEST_RATE, 1.0f));
+     for (int b = 0; b < blocks; b++) {
+         fill_tone(g_test_in, modulator_hz, modulator_amp);
+         fill_tone(g_test_out, carrier_hz, 1.0);
+         sidechain_process(&g_test_sc, g_test_in, g_test_out, TEST_FRAMES);
+     }
+     return tail_rms(g_test_out);
+ }
+
+ // --- Test Functions ---
+
+ void test_sidechain_init_validates(void) {
+     CU_ASSERT_EQUAL(sidechain_init(&g_test_sc, SIDECHAIN_RINGMOD, 0.0, 1.0f), 0);
+     CU_ASSERT_EQUAL(sidechain_init(&g_test_sc, SIDECHAIN_RINGMOD, TEST_RATE, 0.0f), 0);
+     CU_ASSERT_EQUAL(sidechain_init(&g_test_sc, (SidechainMode)42, TEST_RATE, 1.0f), 0);
+     CU_ASSERT_EQUAL(sidechain_init(&g_test_sc, SIDECHAIN_VOCODER, 8000.0, 1.0f), 1);
+     // Bands above 0.45 * rate are muted rather than left unstable
+     CU_ASSERT_DOUBLE_EQUAL(g_test_sc.bands[SIDECHAIN_VOCODER_BANDS - 1].b0, 0.0, 1e-12);
+     CU_ASSERT_STRING_EQUAL(sidechain_mode_name(SIDECHAIN_VOCODER), "vocoder");
+ }
+
+ void test_sidechain_off_passes_output(void) {
+     CU_ASSERT_FATAL(sidechain_init(&g_test_sc, SIDECHAIN_OFF, TEST_RATE, 1.0f));
+     fill_const(g_test_in, 0.0f);
+     fill_const(g_test_out, 0.25f);
+     sidechain_process(&g_test_sc, g_test_in, g_test_out, TEST_FRAMES);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_out[TEST_FRAMES - 1], 0.25, 1e-9);
+ }
+
+ void test_sidechain_ringmod_multiplies(void) {
+     CU_ASSERT_FATAL(sidechain_init(&g_test_sc, SIDECHAIN_RINGMOD, TEST_RATE, 2.0f));
+     fill_tone(g_test_in, 300.0, 0.5);
+     fill_tone(g_test_out, 1000.0, 1.0);
+     float expected = g_test_out[123] * 2.0f * g_test_in[123];
+     sidechain_process(&g_test_sc, g_test_in, g_test_out, TEST_FRAMES);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_out[123], expected, 1e-6);
+ }
+
+ void test_sidechain_follower_attack_release(void) {
+     CU_ASSERT_FATAL(sidechain_init(&g_test_sc, SIDECHAIN_FOLLOW, TEST_RATE, 1.0f));
+     fill_const(g_test_in, 1.0f);
+     fill_const(g_test_out, 1.0f);
+     sidechain_process(&g_test_sc, g_test_in, g_test_out, TEST_FRAMES);
+     // One attack time constant reaches 1 - 1/e
+     int attack_frames = (int)(SIDECHAIN_FOLLOW_ATTACK_MS * TEST_RATE / 1000.0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_out[attack_frames - 1], 1.0 - exp(-1.0), 0.01);
+     CU_ASSERT(g_test_out[TEST_FRAMES - 1] > 0.99f);
+
+     // Input stops: the output decays with the slower release
+     fill_const(g_test_in, 0.0f);
+     fill_const(g_test_out, 1.0f);
+     sidechain_process(&g_test_sc, g_test_in, g_test_out, TEST_FRAMES);
+     int release_frames = (int)(SIDECHAIN_FOLLOW_RELEASE_MS * TEST_RATE / 1000.0);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_out[release_frames - 1], exp(-1.0), 0.01);
+ }
+
+ void test_sidechain_vocoder_follows_bands(void) {
+     double matched = vocode(1000.0, 1000.0, 1.0, 4);
+     double mismatched = vocode(4000.0, 150.0, 1.0, 4);
+     double silent = vocode(1000.0, 1000.0, 0.0, 4);
+
+     CU_ASSERT(matched > 0.1);
+     // Modulator energy in another band lets through far less of the carrier
+     CU_ASSERT(mismatched < matched * 0.05);
+     CU_ASSERT(silent < 1e-6);
+
+     // Silence flushes the filter states instead of leaving denormals behind
+     vocode(1000.0, 1000.0, 0.0, 20);
+     CU_ASSERT(g_test_sc.bands[0].m1 == 0.0f);
+ }
+
+ void test_sidechain_vocoder_benchmark(void) {
+     struct timespec t0, t1;
+     const int blocks = 100;
+     CU_ASSERT_FATAL(sidechain_init(&g_test_sc, SIDECHAIN_VOCODER, TEST_RATE, 1.0f));
+     fill_tone(g_test_in, 440.0, 0.5);
+     clock_gettime(CLOCK_MONOTONIC, &t0);
+     for (int b = 0; b < blocks; b++) {
+         fill_tone(g_test_out, 220.0, 0.5);
+         sidechain_process(&g_test_sc, g_test_in, g_test_out, TEST_FRAMES);
+     }
+     clock_gettime(CLOCK_MONOTONIC, &t1);
+     double ns = 1e9 * seconds_between(&t0, &t1) / ((double)blocks * TEST_FRAMES);
+     printf("\n  sidechain bench vocoder %d bands: %.1f ns/sample (incl. sin() carrier)", SIDECHAIN_VOCODER_BANDS, ns);
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("Sidechain_Tests", init_sidechain_suite, clean_sidechain_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_sidechain_init_validates", test_sidechain_init_validates)) ||
+          (NULL == CU_add_test(pSuite, "test_sidechain_off_passes_output", test_sidechain_off_passes_output)) ||
+          (NULL == CU_add_test(pSuite, "test_sidechain_ringmod_multiplies", test_sidechain_ringmod_multiplies)) ||
+          (NULL == CU_add_test(pSuite, "test_sidechain_follower_attack_release", test_sidechain_follower_attack_release)) ||
+          (NULL == CU_add_test(pSuite, "test_sidechain_vocoder_follows_bands", test_sidechain_vocoder_follows_bands)) ||
+          (NULL == CU_add_test(pSuite, "test_sidechain_vocoder_benchmark", test_sidechain_vocoder_benchmark))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }
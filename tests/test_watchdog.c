@@ -0,0 +1,118 @@
+/**
+ * @file test_watchdog.c
+ * @brief Unit tests for the audio watchdog policy (watchdog.c) using CUnit.
+ *
+ * Feeds synthetic heartbeat and stream start timestamps and checks when the
+ * policy reports a stall, how far apart it retries failed restarts and that
+ * the outage ends with the first block of the reopened stream.
+ */
+
+ #include <stdio.h>
+ #include <CUnit/Basic.h>
+
+ #include "../synth/watchdog.h"
+
+ // --- Test Globals ---
+ /** @brief Policy state under test. */
+ Watchdog g_test_wd;
+ /** @brief Stall timeout used by the tests, in seconds. */
+ #define TIMEOUT_SEC 0.5
+
+ // --- Test Suite Setup/Teardown ---
+
+ int init_watchdog_suite(void) {
+     return 0;
+ }
+
+ int clean_watchdog_suite(void) {
+     return 0;
+ }
+
+ // --- Test Functions ---
+
+ void test_watchdog_steady_heartbeat(void) {
+     int alarms = 0;
+     watchdog_init(&g_test_wd, TIMEOUT_SEC);
+     // Blocks every 10 ms for ten seconds
+     for (double t = 1.0; t < 11.0; t += 0.01) {
+         if (watchdog_update(&g_test_wd, t, t - 0.005, 1.0) != WATCHDOG_OK) alarms++;
+     }
+     CU_ASSERT_EQUAL(alarms, 0);
+ }
+
+ void test_watchdog_detects_stall(void) {
+     watchdog_init(&g_test_wd, TIMEOUT_SEC);
+     // Last block at t=2.0; just under the timeout is fine, past it is a stall
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 2.49, 2.0, 1.0), WATCHDOG_OK);
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 2.51, 2.0, 1.0), WATCHDOG_STALLED);
+     CU_ASSERT(g_test_wd.in_outage);
+     CU_ASSERT_DOUBLE_EQUAL(g_test_wd.outage_start, 2.0, 1e-9);
+ }
+
+ void test_watchdog_start_grace(void) {
+     watchdog_init(&g_test_wd, TIMEOUT_SEC);
+     // A stream that never delivered a block is judged from its start time
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 5.3, 0.0, 5.0), WATCHDOG_OK);
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 5.6, 0.0, 5.0), WATCHDOG_STALLED);
+
+     // A reopen (e.g. audio_restart() from the GUI) after an old heartbeat is not a stall
+     watchdog_init(&g_test_wd, TIMEOUT_SEC);
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 9.0, 6.0, 8.8), WATCHDOG_OK);
+ }
+
+ void test_watchdog_retry_backoff(void) {
+     double t = 3.0;
+     watchdog_init(&g_test_wd, TIMEOUT_SEC);
+     CU_ASSERT_EQUAL_FATAL(watchdog_update(&g_test_wd, t, 2.0, 1.0), WATCHDOG_STALLED);
+     watchdog_restarted(&g_test_wd, t);
+
+     // Failed restarts are retried after 0.5, 1, 2, 4, 5, 5 s
+     const double expected[] = { 0.5, 1.0, 2.0, 4.0, WATCHDOG_MAX_BACKOFF_SEC, WATCHDOG_MAX_BACKOFF_SEC };
+     for (int i = 0; i < 6; i++) {
+         CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, t + expected[i] - 0.01, 2.0, 1.0), WATCHDOG_OK);
+         CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, t + expected[i], 2.0, 1.0), WATCHDOG_RETRY);
+         t += expected[i];
+         watchdog_restarted(&g_test_wd, t);
+     }
+     CU_ASSERT_EQUAL(g_test_wd.attempts, 7);
+ }
+
+ void test_watchdog_recovers(void) {
+     watchdog_init(&g_test_wd, TIMEOUT_SEC);
+     CU_ASSERT_EQUAL_FATAL(watchdog_update(&g_test_wd, 2.6, 2.0, 1.0), WATCHDOG_STALLED);
+     watchdog_restarted(&g_test_wd, 2.65);
+     // The reopened stream delivers its first block at 2.66
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 2.7, 2.66, 2.65), WATCHDOG_RECOVERED);
+     CU_ASSERT_DOUBLE_EQUAL(watchdog_outage_duration(&g_test_wd, 2.66), 0.66, 1e-9);
+     CU_ASSERT_FALSE(g_test_wd.in_outage);
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 2.8, 2.79, 2.65), WATCHDOG_OK);
+
+     // A second, independent outage starts counting attempts from zero
+     CU_ASSERT_EQUAL(watchdog_update(&g_test_wd, 3.4, 2.8, 2.65), WATCHDOG_STALLED);
+     CU_ASSERT_EQUAL(g_test_wd.attempts, 0);
+ }
+
+ // --- Main Test Runner Function ---
+ int main() {
+     CU_pSuite pSuite = NULL;
+     if (CUE_SUCCESS != CU_initialize_registry()) return CU_get_error();
+     pSuite = CU_add_suite("Watchdog_Policy_Tests", init_watchdog_suite, clean_watchdog_suite);
+     if (NULL == pSuite) { CU_cleanup_registry(); return CU_get_error(); }
+
+     if ( (NULL == CU_add_test(pSuite, "test_watchdog_steady_heartbeat", test_watchdog_steady_heartbeat)) ||
+          (NULL == CU_add_test(pSuite, "test_watchdog_detects_stall", test_watchdog_detects_stall)) ||
+          (NULL == CU_add_test(pSuite, "test_watchdog_start_grace", test_watchdog_start_grace)) ||
+          (NULL == CU_add_test(pSuite, "test_watchdog_retry_backoff", test_watchdog_retry_backoff)) ||
+          (NULL == CU_add_test(pSuite, "test_watchdog_recovers", test_watchdog_recovers))
+        )
+     { CU_cleanup_registry(); return CU_get_error(); }
+
+     CU_basic_set_mode(CU_BRM_VERBOSE);
+     CU_basic_run_tests();
+     printf("\n");
+     CU_basic_show_failures(CU_get_failure_list());
+     printf("\n\n");
+     unsigned int failures = CU_get_number_of_failures();
+     CU_cleanup_registry();
+     return (failures > 0) ? 1 : 0;
+ }